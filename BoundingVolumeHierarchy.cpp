@@ -0,0 +1,156 @@
+#include "BoundingVolumeHierarchy.h"
+
+#include <assert.h>
+#include <float.h>
+#include <algorithm>
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy()
+	: m_leafSize(16)
+{
+}
+
+void BoundingVolumeHierarchy::Build(const BoundingBox* pBoxes, uint32_t count, uint32_t leafSize)
+{
+	assert(leafSize > 0);
+
+	m_leafSize = leafSize;
+	m_boxes.assign(pBoxes, pBoxes + count);
+
+	m_items.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		m_items[i] = i;
+	}
+
+	m_nodes.clear();
+	if (count > 0)
+	{
+		m_nodes.reserve(4 * (count / leafSize + 1));
+		m_nodes.push_back(Node());
+		BuildNode(0, 0, count);
+	}
+
+	m_centerX.resize(count);
+	m_centerY.resize(count);
+	m_centerZ.resize(count);
+	m_extentX.resize(count);
+	m_extentY.resize(count);
+	m_extentZ.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const BoundingBox& box = m_boxes[m_items[i]];
+		m_centerX[i] = box.center[0];
+		m_centerY[i] = box.center[1];
+		m_centerZ[i] = box.center[2];
+		m_extentX[i] = box.extent[0];
+		m_extentY[i] = box.extent[1];
+		m_extentZ[i] = box.extent[2];
+	}
+
+	m_boxes.clear();
+	m_leafVisible.resize(leafSize);
+}
+
+uint32_t BoundingVolumeHierarchy::Cull(const FrustumCuller& culler, std::vector<uint32_t>& visible) const
+{
+	size_t before = visible.size();
+	if (!m_nodes.empty())
+	{
+		CullNode(0, (1u << FrustumCuller::PlaneCount) - 1, culler, visible);
+	}
+	return (uint32_t)(visible.size() - before);
+}
+
+uint32_t BoundingVolumeHierarchy::GetNodeCount() const
+{
+	return (uint32_t)m_nodes.size();
+}
+
+void BoundingVolumeHierarchy::BuildNode(uint32_t index, uint32_t first, uint32_t count)
+{
+	float minCorner[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float maxCorner[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		const BoundingBox& box = m_boxes[m_items[i]];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			minCorner[axis] = std::min(minCorner[axis], box.center[axis] - box.extent[axis]);
+			maxCorner[axis] = std::max(maxCorner[axis], box.center[axis] + box.extent[axis]);
+		}
+	}
+
+	Node& node = m_nodes[index];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		node.bounds.center[axis] = (minCorner[axis] + maxCorner[axis]) * 0.5f;
+		node.bounds.extent[axis] = (maxCorner[axis] - minCorner[axis]) * 0.5f;
+	}
+	node.first = first;
+	node.count = count;
+	node.left = 0;
+
+	if (count <= m_leafSize)
+	{
+		return;
+	}
+
+	// Median split along the longest axis of the node
+	int axis = 0;
+	if (node.bounds.extent[1] > node.bounds.extent[axis])
+	{
+		axis = 1;
+	}
+	if (node.bounds.extent[2] > node.bounds.extent[axis])
+	{
+		axis = 2;
+	}
+
+	uint32_t half = count / 2;
+	std::nth_element(m_items.begin() + first, m_items.begin() + first + half, m_items.begin() + first + count,
+		[this, axis](uint32_t a, uint32_t b)
+		{
+			return m_boxes[a].center[axis] < m_boxes[b].center[axis];
+		});
+
+	// Children are allocated next to each other, the right one is left + 1
+	uint32_t left = (uint32_t)m_nodes.size();
+	node.left = left;
+	m_nodes.push_back(Node());
+	m_nodes.push_back(Node());
+
+	BuildNode(left, first, half);
+	BuildNode(left + 1, first + half, count - half);
+}
+
+void BoundingVolumeHierarchy::CullNode(uint32_t node, uint32_t planeMask, const FrustumCuller& culler, std::vector<uint32_t>& visible) const
+{
+	const Node& current = m_nodes[node];
+
+	FrustumCuller::Result result = culler.TestBox(current.bounds, &planeMask);
+	if (result == FrustumCuller::CULL_OUTSIDE)
+	{
+		return;
+	}
+
+	if (result == FrustumCuller::CULL_INSIDE)
+	{
+		visible.insert(visible.end(), m_items.begin() + current.first, m_items.begin() + current.first + current.count);
+		return;
+	}
+
+	if (current.left != 0)
+	{
+		CullNode(current.left, planeMask, culler, visible);
+		CullNode(current.left + 1, planeMask, culler, visible);
+		return;
+	}
+
+	uint32_t first = current.first;
+	uint32_t count = culler.CullBoxes(&m_centerX[first], &m_centerY[first], &m_centerZ[first],
+		&m_extentX[first], &m_extentY[first], &m_extentZ[first], current.count, m_leafVisible.data());
+	for (uint32_t i = 0; i < count; i++)
+	{
+		visible.push_back(m_items[first + m_leafVisible[i]]);
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "FrustumCuller.h"
+
+// Static tree of boxes for culling large scenes. Subtrees fully inside the
+// frustum are appended without tests, leaves are tested with SSE.
+class BoundingVolumeHierarchy
+{
+public:
+	BoundingVolumeHierarchy();
+
+	void Build(const BoundingBox* pBoxes, uint32_t count, uint32_t leafSize = 16);
+
+	// Appends indices of visible boxes in the order they were passed to Build()
+	// within each leaf, returns the number appended
+	uint32_t Cull(const FrustumCuller& culler, std::vector<uint32_t>& visible) const;
+
+	uint32_t GetNodeCount() const;
+
+private:
+	struct Node
+	{
+		BoundingBox bounds;
+		uint32_t first;     // range of m_items covered by the subtree
+		uint32_t count;
+		uint32_t left;      // 0 for leaves, right child is left + 1
+	};
+
+	void BuildNode(uint32_t index, uint32_t first, uint32_t count);
+	void CullNode(uint32_t node, uint32_t planeMask, const FrustumCuller& culler, std::vector<uint32_t>& visible) const;
+
+private:
+	uint32_t m_leafSize;
+
+	std::vector<Node> m_nodes;
+	std::vector<uint32_t> m_items;
+
+	// Boxes reordered by m_items as structure of arrays
+	std::vector<float> m_centerX, m_centerY, m_centerZ;
+	std::vector<float> m_extentX, m_extentY, m_extentZ;
+
+	std::vector<BoundingBox> m_boxes;
+	mutable std::vector<uint32_t> m_leafVisible;
+};
@@ -0,0 +1,144 @@
+#include "BufferSuballocator.h"
+
+#include <assert.h>
+#include <algorithm>
+
+const uint32_t BufferSuballocator::InvalidOffset;
+
+BufferSuballocator::BufferSuballocator()
+	: m_capacity(0)
+	, m_allocatedSize(0)
+{
+}
+
+void BufferSuballocator::Init(uint32_t capacity)
+{
+	m_capacity = capacity;
+	m_allocatedSize = 0;
+	m_free.clear();
+	m_allocations.clear();
+	if (capacity > 0)
+	{
+		Range all = { 0, capacity };
+		m_free.push_back(all);
+	}
+}
+
+uint32_t BufferSuballocator::Allocate(uint32_t size)
+{
+	assert(size > 0);
+
+	for (size_t i = 0; i < m_free.size(); i++)
+	{
+		Range& range = m_free[i];
+		if (range.size < size)
+		{
+			continue;
+		}
+
+		uint32_t offset = range.offset;
+		range.offset += size;
+		range.size -= size;
+		if (range.size == 0)
+		{
+			m_free.erase(m_free.begin() + i);
+		}
+
+		m_allocations[offset] = size;
+		m_allocatedSize += size;
+		return offset;
+	}
+
+	return InvalidOffset;
+}
+
+void BufferSuballocator::Free(uint32_t offset)
+{
+	std::map<uint32_t, uint32_t>::iterator allocation = m_allocations.find(offset);
+	assert(allocation != m_allocations.end());
+	uint32_t size = allocation->second;
+	m_allocations.erase(allocation);
+	m_allocatedSize -= size;
+
+	// Merge with the free ranges right before and after
+	std::vector<Range>::iterator next = std::lower_bound(m_free.begin(), m_free.end(), offset,
+		[](const Range& range, uint32_t value) { return range.offset < value; });
+	bool mergePrev = next != m_free.begin() && (next - 1)->offset + (next - 1)->size == offset;
+	bool mergeNext = next != m_free.end() && offset + size == next->offset;
+
+	if (mergePrev && mergeNext)
+	{
+		(next - 1)->size += size + next->size;
+		m_free.erase(next);
+	}
+	else if (mergePrev)
+	{
+		(next - 1)->size += size;
+	}
+	else if (mergeNext)
+	{
+		next->offset = offset;
+		next->size += size;
+	}
+	else
+	{
+		Range range = { offset, size };
+		m_free.insert(next, range);
+	}
+}
+
+void BufferSuballocator::Compact(std::vector<Move>* pMoves)
+{
+	pMoves->clear();
+
+	std::map<uint32_t, uint32_t> compacted;
+	uint32_t end = 0;
+	for (const std::pair<const uint32_t, uint32_t>& allocation : m_allocations)
+	{
+		if (allocation.first != end)
+		{
+			Move move = { allocation.first, end, allocation.second };
+			pMoves->push_back(move);
+		}
+		compacted.emplace_hint(compacted.end(), end, allocation.second);
+		end += allocation.second;
+	}
+	m_allocations.swap(compacted);
+
+	m_free.clear();
+	if (end < m_capacity)
+	{
+		Range rest = { end, m_capacity - end };
+		m_free.push_back(rest);
+	}
+}
+
+uint32_t BufferSuballocator::GetCapacity() const
+{
+	return m_capacity;
+}
+
+uint32_t BufferSuballocator::GetAllocatedSize() const
+{
+	return m_allocatedSize;
+}
+
+uint32_t BufferSuballocator::GetFreeSize() const
+{
+	return m_capacity - m_allocatedSize;
+}
+
+uint32_t BufferSuballocator::GetLargestFreeSize() const
+{
+	uint32_t largest = 0;
+	for (const Range& range : m_free)
+	{
+		largest = std::max(largest, range.size);
+	}
+	return largest;
+}
+
+uint32_t BufferSuballocator::GetFreeRangeCount() const
+{
+	return (uint32_t)m_free.size();
+}
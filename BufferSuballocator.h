@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+
+// Ranges of a fixed size space, such as the elements of a large buffer.
+// First fit over a free list ordered by offset, freed ranges merge with their
+// free neighbours. Compact() slides all allocations to the front so the free
+// space becomes one range again.
+//
+// TlsfAllocator is faster with many allocations, but its good fit may miss a
+// free range that fits and its defragmentation does not promise a single
+// free range. Pages of StaticBatcher need both, and hold few meshes.
+class BufferSuballocator
+{
+public:
+	static const uint32_t InvalidOffset = 0xFFFFFFFF;
+
+	struct Range
+	{
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	// An allocation moved by Compact(), the caller copies its contents
+	struct Move
+	{
+		uint32_t from;
+		uint32_t to;
+		uint32_t size;
+	};
+
+	BufferSuballocator();
+
+	void Init(uint32_t capacity);
+
+	// InvalidOffset if no free range is large enough
+	uint32_t Allocate(uint32_t size);
+	void Free(uint32_t offset);
+
+	// Moves are in increasing offset order, applying them in order never
+	// overwrites a range that is still to be moved
+	void Compact(std::vector<Move>* pMoves);
+
+	uint32_t GetCapacity() const;
+	uint32_t GetAllocatedSize() const;
+	uint32_t GetFreeSize() const;
+	uint32_t GetLargestFreeSize() const;
+	uint32_t GetFreeRangeCount() const;
+
+private:
+	uint32_t m_capacity;
+	uint32_t m_allocatedSize;
+	std::vector<Range> m_free;
+	std::map<uint32_t, uint32_t> m_allocations; // offset to size
+};
@@ -0,0 +1,135 @@
+#include "BuiltinScene.h"
+
+#include <random>
+#include "LightManager.h"
+
+const uint32_t BuiltinScene::RedLightCount;
+const uint32_t BuiltinScene::SmallFieldCount;
+const uint32_t BuiltinScene::LightFieldCount;
+
+// Position and power of the red lights
+static const float RedLights[BuiltinScene::RedLightCount][4] = {
+	{ 2.5f, 0.2f, -0.289f, 1 },
+	{ 2.5f, 0.2f, 0.289f, 1 },
+	{ 2, 0.2f, 0, 1 }
+};
+
+// Fewer field lights are brighter, so both fields light the plane about the same
+static const float LightFieldPowers[BuiltinScene::LIGHT_SETUP_COUNT] = { 0, 0.2f, 0.02f };
+
+static const char* LightSetupNames[BuiltinScene::LIGHT_SETUP_COUNT] = { "red", "small", "field" };
+
+void BuiltinScene::AddMeshes(std::vector<MeshVertex>* pVertices, std::vector<uint32_t>* pIndices, MeshRange* pRanges)
+{
+	// Textured cube
+	static const MeshVertex Vertices[28] = {
+		// Bottom face
+		{{-0.5, -0.5,  0.5}, {0,1}, {0,-1,0}},
+		{{ 0.5, -0.5,  0.5}, {1,1}, {0,-1,0}},
+		{{ 0.5, -0.5, -0.5}, {1,0}, {0,-1,0}},
+		{{-0.5, -0.5, -0.5}, {0,0}, {0,-1,0}},
+		// Top face
+		{{-0.5,  0.5, -0.5}, {0,1}, {0,1,0}},
+		{{ 0.5,  0.5, -0.5}, {1,1}, {0,1,0}},
+		{{ 0.5,  0.5,  0.5}, {1,0}, {0,1,0}},
+		{{-0.5,  0.5,  0.5}, {0,0}, {0,1,0}},
+		// Front face
+		{{ 0.5, -0.5, -0.5}, {0,1}, {1,0,0}},
+		{{ 0.5, -0.5,  0.5}, {1,1}, {1,0,0}},
+		{{ 0.5,  0.5,  0.5}, {1,0}, {1,0,0}},
+		{{ 0.5,  0.5, -0.5}, {0,0}, {1,0,0}},
+		// Back face
+		{{-0.5, -0.5,  0.5}, {0,1}, {-1,0,0}},
+		{{-0.5, -0.5, -0.5}, {1,1}, {-1,0,0}},
+		{{-0.5,  0.5, -0.5}, {1,0}, {-1,0,0}},
+		{{-0.5,  0.5,  0.5}, {0,0}, {-1,0,0}},
+		// Left face
+		{{ 0.5, -0.5,  0.5}, {0,1}, {0,0,1}},
+		{{-0.5, -0.5,  0.5}, {1,1}, {0,0,1}},
+		{{-0.5,  0.5,  0.5}, {1,0}, {0,0,1}},
+		{{ 0.5,  0.5,  0.5}, {0,0}, {0,0,1}},
+		// Right face
+		{{-0.5, -0.5, -0.5}, {0,1}, {0,0,-1}},
+		{{ 0.5, -0.5, -0.5}, {1,1}, {0,0,-1}},
+		{{ 0.5,  0.5, -0.5}, {1,0}, {0,0,-1}},
+		{{-0.5,  0.5, -0.5}, {0,0}, {0,0,-1}},
+
+		// Plane
+		{{ 4.5, -0.5, -2}, {0,1}, {0,1,0}},
+		{{ 4.5, -0.5,  2}, {1,1}, {0,1,0}},
+		{{ 0.75, -0.5, 2}, {1,0}, {0,1,0}},
+		{{ 0.75, -0.5, -2}, {0,0}, {0,1,0}}
+	};
+	static const uint32_t Indices[42] = {
+		0, 2, 1, 0, 3, 2,
+		4, 6, 5, 4, 7, 6,
+		8, 10, 9, 8, 11, 10,
+		12, 14, 13, 12, 15, 14,
+		16, 18, 17, 16, 19, 18,
+		20, 22, 21, 20, 23, 22,
+
+		24, 27, 26, 24, 26, 25
+	};
+
+	uint32_t baseVertex = (uint32_t)pVertices->size();
+	uint32_t baseIndex = (uint32_t)pIndices->size();
+	pVertices->insert(pVertices->end(), Vertices, Vertices + 28);
+	for (uint32_t index : Indices)
+	{
+		pIndices->push_back(baseVertex + index);
+	}
+
+	MeshRange cube = { { { 0, 0, 0 }, { 0.5f, 0.5f, 0.5f } }, baseVertex, 24, baseIndex, 36 };
+	MeshRange plane = { { { 2.625f, -0.5f, 0 }, { 1.875f, 0, 2 } }, baseVertex + 24, 4, baseIndex + 36, 6 };
+	pRanges[MESH_CUBE] = cube;
+	pRanges[MESH_PLANE] = plane;
+}
+
+const char* BuiltinScene::GetLightSetupName(LightSetup setup)
+{
+	return LightSetupNames[setup];
+}
+
+uint32_t BuiltinScene::AddLights(LightManager* pLights, LightSetup setup)
+{
+	uint32_t switchLight = LightManager::InvalidLight;
+	for (uint32_t i = 0; i < RedLightCount; i++)
+	{
+		uint32_t light = pLights->Create();
+		pLights->SetPosition(light, RedLights[i][0], RedLights[i][1], RedLights[i][2]);
+		pLights->SetColor(light, 0.75f, 0, 0);
+		pLights->SetPower(light, RedLights[i][3]);
+		switchLight = light;
+	}
+
+	// Field lights fade out at their range instead of being cut off
+	std::minstd_rand random(1);
+	std::uniform_real_distribution<float> x(0.75f, 4.5f);
+	std::uniform_real_distribution<float> y(-0.45f, 0.3f);
+	std::uniform_real_distribution<float> z(-2.0f, 2.0f);
+	std::uniform_real_distribution<float> color(0.2f, 1.0f);
+	for (uint32_t i = RedLightCount; i < GetLightCount(setup); i++)
+	{
+		uint32_t light = pLights->Create();
+		float position[3] = { x(random), y(random), z(random) };
+		float rgb[3] = { color(random), color(random), color(random) };
+		pLights->SetPosition(light, position[0], position[1], position[2]);
+		pLights->SetColor(light, rgb[0], rgb[1], rgb[2]);
+		pLights->SetPower(light, LightFieldPowers[setup]);
+		pLights->SetFalloff(light, LightManager::FALLOFF_WINDOWED);
+	}
+	return switchLight;
+}
+
+void BuiltinScene::PlaceModel(const BoundingBox& bounds, float* pScale, float* pPosition)
+{
+	float size = bounds.extent[0];
+	size = bounds.extent[1] > size ? bounds.extent[1] : size;
+	size = bounds.extent[2] > size ? bounds.extent[2] : size;
+	float scale = size > 0 ? 0.5f / size : 1.0f;
+
+	*pScale = scale;
+	pPosition[0] = -1.5f - bounds.center[0] * scale;
+	pPosition[1] = -bounds.center[1] * scale;
+	pPosition[2] = -bounds.center[2] * scale;
+}
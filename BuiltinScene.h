@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "FrustumCuller.h"
+#include "MeshImporter.h"
+
+class LightManager;
+
+// Contents of the built-in scene, shared by the renderer and the software
+// renderer: a textured unit cube at the origin, a plane on its right and the
+// lights above the plane.
+class BuiltinScene
+{
+public:
+	enum Mesh
+	{
+		MESH_CUBE = 0,
+		MESH_PLANE,
+		MESH_COUNT
+	};
+
+	struct MeshRange
+	{
+		BoundingBox bounds;
+		uint32_t firstVertex;
+		uint32_t vertexCount;
+		uint32_t startIndex;
+		uint32_t indexCount;
+	};
+
+	// Appends the meshes in Mesh order, indices refer to the whole vertex list
+	static void AddMeshes(std::vector<MeshVertex>* pVertices, std::vector<uint32_t>* pIndices, MeshRange* pRanges);
+
+	// Lights of the scene. The default is the red lights next to the cube,
+	// the fields add dim colored ones scattered over the plane: the small one
+	// few enough that each instance is shaded with its most important lights,
+	// the large one more than that so the scene is shaded through the cluster
+	// grid.
+	enum LightSetup
+	{
+		LIGHTS_RED = 0,
+		LIGHTS_SMALL_FIELD,
+		LIGHTS_FIELD,
+		LIGHT_SETUP_COUNT
+	};
+
+	static const uint32_t RedLightCount = 3;
+	static const uint32_t SmallFieldCount = 32;
+	static const uint32_t LightFieldCount = 1024;
+
+	// Inline so ShaderTableGen can check the embedded variants without the lights code
+	static uint32_t GetLightCount(LightSetup setup)
+	{
+		return RedLightCount + (setup == LIGHTS_FIELD ? LightFieldCount : setup == LIGHTS_SMALL_FIELD ? SmallFieldCount : 0);
+	}
+
+	// Name used on the command lines, "red", "small" or "field"
+	static const char* GetLightSetupName(LightSetup setup);
+
+	// Creates the lights of the setup, the field is seeded so every run
+	// places it the same. Returns the red light that can be switched off.
+	static uint32_t AddLights(LightManager* pLights, LightSetup setup);
+
+	// Uniform scale and position that fit a loaded model to the cube size
+	// and place it on the left of the cube
+	static void PlaceModel(const BoundingBox& bounds, float* pScale, float* pPosition);
+};
@@ -1,9 +1,55 @@
+// LIGHT_COUNT > 0 specializes the light loop at compile time, 0 reads lightParams.x
+#ifndef LIGHT_COUNT
+#define LIGHT_COUNT 0
+#endif
+
+#ifndef ALPHA_TEST
+#define ALPHA_TEST 0
+#endif
+
+// INSTANCED reads the world transform and material from the per-instance stream
+#ifndef INSTANCED
+#define INSTANCED 0
+#endif
+
+// VERTEX_FORMAT 1 and 2 read packed vertices: 16-bit positions normalized to the
+// mesh bounds, half UVs and octahedral normals in 2x16 bits (1) or as two bytes
+// in position.w (2). The instance transform holds the bounds scale and offset.
+#ifndef VERTEX_FORMAT
+#define VERTEX_FORMAT 0
+#endif
+
+#if VERTEX_FORMAT != 0 && !INSTANCED
+#error Packed vertex formats are decoded by the instance transform
+#endif
+
+// CLUSTERED reads the lights of the pixel's cluster from the light grid binned
+// on the CPU instead of the lights array, lights are cut off at their range
+#ifndef CLUSTERED
+#define CLUSTERED 0
+#endif
+
+// OBJECT_LIGHTS reads the up to MAX_OBJECT_LIGHTS lights assigned to the
+// instance on the CPU instead of the lights array
+#ifndef OBJECT_LIGHTS
+#define OBJECT_LIGHTS 0
+#endif
+
+#if OBJECT_LIGHTS && (!INSTANCED || CLUSTERED)
+#error Object lights are assigned per instance and exclude clustering
+#endif
+
+#define MAX_OBJECT_LIGHTS 4
+
+#define MAX_MATERIAL_COUNT 8
+
 cbuffer ModelBuffer : register(b0)
 {
     float4x4 modelMatrix;
 	float4x4 normalMatrix;
 }
 
+// pos.w - range, power.y - 1 if windowed to fade out at the range
 struct Light
 {
 	float4 pos;
@@ -16,17 +62,48 @@ cbuffer SceneBuffer : register(b1)
     float4x4 VP;
 	int4 lightParams;
 	Light lights[4];
+	float4 clusterParams; // x - 1 / tile size, y - slice scale, z - slice bias
+	int4 clusterGrid; // x, y - tiles, z - slices
 }
 
+#if INSTANCED
+cbuffer MaterialBuffer : register(b2)
+{
+	float4 materialColors[MAX_MATERIAL_COUNT];
+}
+#endif
+
 Texture2D ColorTexture : register(t0);
 
+#if CLUSTERED || OBJECT_LIGHTS
+StructuredBuffer<Light> SceneLights : register(t1);
+#endif
+#if CLUSTERED
+// A cluster's range holds offset and count in the index list
+Buffer<uint2> ClusterRanges : register(t2);
+Buffer<uint> ClusterLightIndices : register(t3);
+#endif
+
 SamplerState Sampler : register(s0);
 
 struct VSInput
 {
+#if VERTEX_FORMAT == 0
 	float4 pos : POSITION;
 	float2 uv : TEXCOORD;
 	float3 normal : NORMAL;
+#else
+	uint4 packedPos : POSITION;
+	float2 uv : TEXCOORD;
+#if VERTEX_FORMAT == 1
+	float2 octNormal : NORMAL;
+#endif
+#endif
+#if INSTANCED
+	float4 instanceWorld[3] : INSTANCE_WORLD;
+	uint instanceMaterial : INSTANCE_MATERIAL;
+	uint4 instanceLights : INSTANCE_LIGHTS;
+#endif
 };
 
 struct VSOutput
@@ -35,37 +112,132 @@ struct VSOutput
 	float4 worldPos : POSITION;
 	float2 uv : TEXCOORD;
 	float3 normal : NORMAL;
+#if INSTANCED
+	nointerpolation uint material : MATERIAL;
+#endif
+#if CLUSTERED
+	float viewDepth : VIEWDEPTH;
+#endif
+#if OBJECT_LIGHTS
+	nointerpolation uint4 lights : LIGHTS;
+#endif
 };
 
+#if VERTEX_FORMAT != 0
+float3 DecodeOctahedral(float2 e)
+{
+	float3 n = float3(e, 1 - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += n.xy >= 0 ? -t : t;
+	return normalize(n);
+}
+#endif
+
 VSOutput VS(in VSInput vertex)
 {
 	VSOutput output;
-	float4 worldPos = mul(vertex.pos, modelMatrix);
+#if VERTEX_FORMAT == 0
+	float4 pos = vertex.pos;
+	float3 normal = vertex.normal;
+#else
+	float4 pos = float4(vertex.packedPos.xyz * (1.0 / 65535.0), 1);
+#if VERTEX_FORMAT == 1
+	float3 normal = DecodeOctahedral(vertex.octNormal);
+#else
+	int2 octBytes = asint(vertex.packedPos.ww << uint2(24, 16)) >> 24;
+	float3 normal = DecodeOctahedral(max(octBytes / 127.0, -1.0));
+#endif
+#endif
+#if INSTANCED
+	// Instances are placed relative to the model transform, their rotation
+	// part is used for normals so only rigid and uniform scale are supported
+	float4 instancePos = float4(dot(pos, vertex.instanceWorld[0]), dot(pos, vertex.instanceWorld[1]), dot(pos, vertex.instanceWorld[2]), 1);
+	float3 instanceNormal = float3(dot(normal, vertex.instanceWorld[0].xyz), dot(normal, vertex.instanceWorld[1].xyz), dot(normal, vertex.instanceWorld[2].xyz));
+	float4 worldPos = mul(instancePos, modelMatrix);
+	output.normal = normalize(mul(instanceNormal, (float3x3)normalMatrix));
+	output.material = vertex.instanceMaterial;
+#else
+	float4 worldPos = mul(pos, modelMatrix);
+	output.normal = mul(normal, normalMatrix);
+#endif
 	output.pos = mul(worldPos, VP);
 	output.worldPos = worldPos;
+#if CLUSTERED
+	output.viewDepth = output.pos.w;
+#endif
+#if OBJECT_LIGHTS
+	output.lights = vertex.instanceLights;
+#endif
 	output.uv = vertex.uv;
-	output.normal = mul(vertex.normal, normalMatrix);
 	
 	return output;
 }
 
+float3 PointLight(Light light, float3 worldPos, float3 normal, float3 matColor)
+{
+	float3 l = light.pos.xyz - worldPos;
+	float dist = length(l);
+	l = l / dist;
+
+	float ndotl = max(dot(l, normal), 0);
+	float atten = dist > 1 ? 1.0 / (100 + dist * dist) : 1.0 / (0.2 + dist * dist);
+
+	// Windowed lights reach zero at their range
+	float ratio = dist / light.pos.w;
+	float window = saturate(1 - ratio * ratio * ratio * ratio);
+	atten *= lerp(1, window * window, light.power.y);
+	return light.power.x * matColor * light.color.xyz * ndotl * atten;
+}
+
 float4 PS(in VSOutput input) : SV_Target0
 {
 	float4 color = float4(0,0,0,1);
 
-	int lightCount = lightParams.x;
+	float4 texColor = ColorTexture.Sample(Sampler, input.uv);
+#if ALPHA_TEST
+	clip(texColor.a - 0.5);
+#endif
+	float3 matColor = texColor.rgb;
+#if INSTANCED
+	matColor *= materialColors[min(input.material, MAX_MATERIAL_COUNT - 1)].rgb;
+#endif
 
-	float3 matColor = ColorTexture.Sample(Sampler, input.uv);
+#if CLUSTERED
+	uint2 tile = uint2(input.pos.xy * clusterParams.x);
+	int slice = clamp((int)floor(log(input.viewDepth) * clusterParams.y + clusterParams.z), 0, clusterGrid.z - 1);
+	uint2 range = ClusterRanges[(slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x];
+	for (uint i = 0; i < range.y; i++)
+	{
+		Light light = SceneLights[ClusterLightIndices[range.x + i]];
+		float3 l = light.pos.xyz - input.worldPos.xyz;
+		if (dot(l, l) < light.pos.w * light.pos.w)
+		{
+			color.xyz += PointLight(light, input.worldPos.xyz, input.normal, matColor);
+		}
+	}
+#elif OBJECT_LIGHTS
+	[unroll]
+	for (int i = 0; i < MAX_OBJECT_LIGHTS; i++)
+	{
+		// Assigned lights are packed to the front
+		if (input.lights[i] == 0xFFFFFFFF)
+		{
+			break;
+		}
+		color.xyz += PointLight(SceneLights[input.lights[i]], input.worldPos.xyz, input.normal, matColor);
+	}
+#else
+#if LIGHT_COUNT > 0
+	[unroll]
+	for (int i = 0; i < LIGHT_COUNT; i++)
+#else
+	int lightCount = lightParams.x;
 	for (int i = 0; i < lightCount; i++)
+#endif
 	{
-		float3 l = lights[i].pos.xyz - input.worldPos.xyz;
-		float dist = length(l);		
-		l = l / dist;
-		
-		float ndotl = max(dot(l, input.normal), 0);
-		float atten = dist > 1 ? 1.0 / (100 + dist * dist) : 1.0 / (0.2 + dist * dist);	
-		color.xyz += lights[i].power.x * matColor * lights[i].color.xyz * ndotl * atten;
+		color.xyz += PointLight(lights[i], input.worldPos.xyz, input.normal, matColor);
 	}
+#endif
 
 	return color;
 }
@@ -0,0 +1,34 @@
+#include "ColorShaderVariants.h"
+
+const uint32_t ColorShaderVariants::MaxLightCount;
+const uint32_t ColorShaderVariants::MaxObjectModeLightCount;
+
+ShaderPermutationSpace ColorShaderVariants::CreateSpace()
+{
+	ShaderPermutationSpace space;
+	space.AddAxis("LIGHT_COUNT", MaxLightCount + 1);
+	space.AddAxis("ALPHA_TEST", 2);
+	space.AddAxis("INSTANCED", 2);
+	space.AddAxis("VERTEX_FORMAT", 3);
+	space.AddAxis("CLUSTERED", 2);
+	space.AddAxis("OBJECT_LIGHTS", 2);
+	return space;
+}
+
+LightMode ColorShaderVariants::GetLightMode(uint32_t lightCount)
+{
+	return lightCount <= MaxLightCount ? LIGHT_MODE_ARRAY : lightCount <= MaxObjectModeLightCount ? LIGHT_MODE_OBJECT : LIGHT_MODE_CLUSTERED;
+}
+
+uint32_t ColorShaderVariants::GetSceneKey(const ShaderPermutationSpace& space, uint32_t lightCount)
+{
+	LightMode lightMode = GetLightMode(lightCount);
+
+	uint32_t key = space.SetValue(0, AXIS_LIGHT_COUNT, lightMode == LIGHT_MODE_ARRAY ? lightCount : 0);
+	key = space.SetValue(key, AXIS_ALPHA_TEST, 0);
+	key = space.SetValue(key, AXIS_INSTANCED, 1);
+	key = space.SetValue(key, AXIS_VERTEX_FORMAT, SceneVertexFormat);
+	key = space.SetValue(key, AXIS_CLUSTERED, lightMode == LIGHT_MODE_CLUSTERED ? 1 : 0);
+	key = space.SetValue(key, AXIS_OBJECT_LIGHTS, lightMode == LIGHT_MODE_OBJECT ? 1 : 0);
+	return key;
+}
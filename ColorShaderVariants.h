@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include "ShaderPermutation.h"
+#include "VertexCompression.h"
+
+// How the ColorShader variant finds the lights of a pixel
+enum LightMode
+{
+	LIGHT_MODE_ARRAY = 0, // All lights in the scene buffer array
+	LIGHT_MODE_OBJECT, // Most important lights of each instance
+	LIGHT_MODE_CLUSTERED // Lights of the pixel's cluster
+};
+
+// Vertex buffer layout of all scene meshes, packed formats need the instanced program
+static const VertexFormat SceneVertexFormat = VERTEX_FORMAT_PACKED_OCT16;
+
+// ColorShader permutation space and the variant the renderer requests for a
+// scene. ShaderTableGen checks the embedded ColorShader defines against the
+// variant of the built-in scene, so the two can not drift apart.
+class ColorShaderVariants
+{
+public:
+	enum Axis
+	{
+		AXIS_LIGHT_COUNT = 0,
+		AXIS_ALPHA_TEST = 1,
+		AXIS_INSTANCED = 2,
+		AXIS_VERTEX_FORMAT = 3,
+		AXIS_CLUSTERED = 4,
+		AXIS_OBJECT_LIGHTS = 5
+	};
+
+	// Lights of the scene buffer array
+	static const uint32_t MaxLightCount = 4;
+
+	// Scenes with up to this many lights shade each instance with its
+	// MaxInstanceLights most important ones, more are binned into the cluster grid
+	static const uint32_t MaxObjectModeLightCount = 64;
+
+	static ShaderPermutationSpace CreateSpace();
+
+	static LightMode GetLightMode(uint32_t lightCount);
+
+	// Instanced program for a scene with the given number of lights
+	static uint32_t GetSceneKey(const ShaderPermutationSpace& space, uint32_t lightCount);
+};
@@ -0,0 +1,162 @@
+#include "ConstantBuffer.h"
+
+#include <assert.h>
+#include <string.h>
+#include <string>
+
+#define SAFE_RELEASE(p) \
+if (p != NULL) { \
+	p->Release(); \
+	p = NULL;\
+}
+
+ConstantBuffer::ConstantBuffer()
+	: m_pBuffer(nullptr)
+	, m_pContext1(nullptr)
+	, m_partialUpdates(false)
+{
+}
+
+HRESULT ConstantBuffer::Init(ID3D11Device* pDevice, const ConstantBufferLayout& layout)
+{
+	m_layout = layout;
+	m_shadow.Init(layout.GetSize());
+
+	D3D11_BUFFER_DESC cbDesc = { 0 };
+	cbDesc.ByteWidth = m_shadow.GetSize();
+	cbDesc.Usage = D3D11_USAGE_DEFAULT;
+	cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	cbDesc.CPUAccessFlags = 0;
+	cbDesc.MiscFlags = 0;
+	cbDesc.StructureByteStride = 0;
+
+	HRESULT result = pDevice->CreateBuffer(&cbDesc, NULL, &m_pBuffer);
+	assert(SUCCEEDED(result));
+
+	// Partial constant buffer updates need D3D 11.1 runtime and driver support
+	if (SUCCEEDED(result))
+	{
+		D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+		if (SUCCEEDED(pDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options)))
+			&& options.ConstantBufferPartialUpdate)
+		{
+			ID3D11DeviceContext* pContext = NULL;
+			pDevice->GetImmediateContext(&pContext);
+			m_partialUpdates = SUCCEEDED(pContext->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&m_pContext1));
+			SAFE_RELEASE(pContext);
+		}
+	}
+
+	return result;
+}
+
+void ConstantBuffer::Term()
+{
+	SAFE_RELEASE(m_pContext1);
+	SAFE_RELEASE(m_pBuffer);
+}
+
+void ConstantBuffer::Write(const void* pData, UINT size, UINT offset)
+{
+	m_shadow.Write(offset, pData, size);
+}
+
+UINT ConstantBuffer::Upload(ID3D11DeviceContext* pContext)
+{
+	if (!m_shadow.IsDirty())
+	{
+		m_shadow.CountSkipped();
+		return 0;
+	}
+
+	UINT uploaded = 0;
+	if (m_partialUpdates && pContext == m_pContext1)
+	{
+		m_shadow.GetDirtyRanges(m_ranges);
+		for (const ConstantBufferShadow::Range& range : m_ranges)
+		{
+			D3D11_BOX box = { range.offset, 0, 0, range.offset + range.size, 1, 1 };
+			m_pContext1->UpdateSubresource1(m_pBuffer, 0, &box, m_shadow.GetData() + range.offset, 0, 0, 0);
+			uploaded += range.size;
+		}
+	}
+	else
+	{
+		pContext->UpdateSubresource(m_pBuffer, 0, NULL, m_shadow.GetData(), 0, 0);
+		uploaded = m_shadow.GetSize();
+	}
+
+	m_shadow.ClearDirty(uploaded);
+
+	return uploaded;
+}
+
+bool ConstantBuffer::Validate(ID3DBlob* pShaderBlob) const
+{
+	ConstantBufferLayout shaderLayout;
+	if (FAILED(ReflectLayout(pShaderBlob, m_layout.GetName().c_str(), &shaderLayout)))
+	{
+		// The stage does not use this buffer
+		return true;
+	}
+
+	std::string error;
+	if (!m_layout.IsCompatible(shaderLayout, &error))
+	{
+		OutputDebugStringA(("[ConstantBuffer] layout mismatch, " + error + "\n").c_str());
+		return false;
+	}
+
+	return true;
+}
+
+ID3D11Buffer* ConstantBuffer::GetBuffer() const
+{
+	return m_pBuffer;
+}
+
+const ConstantBufferShadow& ConstantBuffer::GetShadow() const
+{
+	return m_shadow;
+}
+
+HRESULT ConstantBuffer::ReflectLayout(ID3DBlob* pShaderBlob, const char* name, ConstantBufferLayout* pLayout)
+{
+	ID3D11ShaderReflection* pReflection = NULL;
+	HRESULT result = D3DReflect(pShaderBlob->GetBufferPointer(), pShaderBlob->GetBufferSize(), IID_ID3D11ShaderReflection, (void**)&pReflection);
+	if (FAILED(result))
+	{
+		return result;
+	}
+
+	D3D11_SHADER_DESC shaderDesc;
+	pReflection->GetDesc(&shaderDesc);
+
+	result = E_FAIL;
+	for (UINT i = 0; i < shaderDesc.ConstantBuffers; i++)
+	{
+		ID3D11ShaderReflectionConstantBuffer* pBuffer = pReflection->GetConstantBufferByIndex(i);
+
+		D3D11_SHADER_BUFFER_DESC bufferDesc;
+		pBuffer->GetDesc(&bufferDesc);
+		if (strcmp(bufferDesc.Name, name) != 0)
+		{
+			continue;
+		}
+
+		*pLayout = ConstantBufferLayout(name);
+		for (UINT v = 0; v < bufferDesc.Variables; v++)
+		{
+			D3D11_SHADER_VARIABLE_DESC variableDesc;
+			pBuffer->GetVariableByIndex(v)->GetDesc(&variableDesc);
+			pLayout->AddVariable(variableDesc.Name, variableDesc.StartOffset, variableDesc.Size);
+		}
+
+		result = S_OK;
+		break;
+	}
+
+	SAFE_RELEASE(pReflection);
+
+	return result;
+}
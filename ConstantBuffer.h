@@ -0,0 +1,39 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <d3dcompiler.h>
+#include <vector>
+#include "ConstantBufferLayout.h"
+
+// Constant buffer backed by a CPU shadow. Upload() sends only the 16-byte
+// registers changed since the previous upload and nothing when clean.
+class ConstantBuffer
+{
+public:
+	ConstantBuffer();
+
+	HRESULT Init(ID3D11Device* pDevice, const ConstantBufferLayout& layout);
+	void Term();
+
+	void Write(const void* pData, UINT size, UINT offset = 0);
+
+	// Returns bytes sent to the GPU by this call
+	UINT Upload(ID3D11DeviceContext* pContext);
+
+	// Compares the CPU layout with the cbuffer of the same name in the shader
+	bool Validate(ID3DBlob* pShaderBlob) const;
+
+	ID3D11Buffer* GetBuffer() const;
+	const ConstantBufferShadow& GetShadow() const;
+
+	static HRESULT ReflectLayout(ID3DBlob* pShaderBlob, const char* name, ConstantBufferLayout* pLayout);
+
+private:
+	ID3D11Buffer* m_pBuffer;
+	ID3D11DeviceContext1* m_pContext1;
+	bool m_partialUpdates;
+
+	ConstantBufferLayout m_layout;
+	ConstantBufferShadow m_shadow;
+	std::vector<ConstantBufferShadow::Range> m_ranges;
+};
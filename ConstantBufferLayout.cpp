@@ -0,0 +1,224 @@
+#include "ConstantBufferLayout.h"
+
+#include <assert.h>
+#include <string.h>
+
+const uint32_t ConstantBufferLayout::RegisterSize;
+
+ConstantBufferLayout::ConstantBufferLayout()
+	: m_size(0)
+{
+}
+
+ConstantBufferLayout::ConstantBufferLayout(const std::string& name)
+	: m_name(name)
+	, m_size(0)
+{
+}
+
+void ConstantBufferLayout::AddVariable(const std::string& name, uint32_t offset, uint32_t size)
+{
+	Variable variable = { name, offset, size };
+	m_variables.push_back(variable);
+
+	if (offset + size > m_size)
+	{
+		m_size = offset + size;
+	}
+}
+
+uint32_t ConstantBufferLayout::AppendPacked(const std::string& name, uint32_t size, bool startsRegister)
+{
+	uint32_t offset = m_size;
+
+	uint32_t used = offset % RegisterSize;
+	if (used != 0 && (startsRegister || used + size > RegisterSize))
+	{
+		offset = AlignToRegister(offset);
+	}
+
+	AddVariable(name, offset, size);
+
+	return offset;
+}
+
+const std::string& ConstantBufferLayout::GetName() const
+{
+	return m_name;
+}
+
+uint32_t ConstantBufferLayout::GetSize() const
+{
+	return m_size;
+}
+
+const std::vector<ConstantBufferLayout::Variable>& ConstantBufferLayout::GetVariables() const
+{
+	return m_variables;
+}
+
+const ConstantBufferLayout::Variable* ConstantBufferLayout::FindVariable(const std::string& name) const
+{
+	for (const Variable& variable : m_variables)
+	{
+		if (variable.name == name)
+		{
+			return &variable;
+		}
+	}
+	return nullptr;
+}
+
+bool ConstantBufferLayout::IsCompatible(const ConstantBufferLayout& shaderLayout, std::string* pError) const
+{
+	for (const Variable& shaderVariable : shaderLayout.GetVariables())
+	{
+		const Variable* pVariable = FindVariable(shaderVariable.name);
+		if (pVariable == nullptr)
+		{
+			if (pError != nullptr)
+			{
+				*pError = m_name + ": '" + shaderVariable.name + "' is not declared on the CPU side";
+			}
+			return false;
+		}
+		if (pVariable->offset != shaderVariable.offset || pVariable->size != shaderVariable.size)
+		{
+			if (pError != nullptr)
+			{
+				*pError = m_name + ": '" + shaderVariable.name + "' is at offset " + std::to_string(pVariable->offset)
+					+ " size " + std::to_string(pVariable->size) + ", shader expects offset "
+					+ std::to_string(shaderVariable.offset) + " size " + std::to_string(shaderVariable.size);
+			}
+			return false;
+		}
+	}
+
+	// Shader reflection reports the register-aligned size
+	if (AlignToRegister(m_size) < shaderLayout.GetSize())
+	{
+		if (pError != nullptr)
+		{
+			*pError = m_name + ": buffer is smaller than the shader expects";
+		}
+		return false;
+	}
+
+	return true;
+}
+
+uint32_t ConstantBufferLayout::AlignToRegister(uint32_t size)
+{
+	return (size + RegisterSize - 1) / RegisterSize * RegisterSize;
+}
+
+ConstantBufferShadow::ConstantBufferShadow()
+	: m_anyDirty(false)
+	, m_bytesUploaded(0)
+	, m_uploadsSkipped(0)
+{
+}
+
+void ConstantBufferShadow::Init(uint32_t size)
+{
+	uint32_t registers = ConstantBufferLayout::AlignToRegister(size) / ConstantBufferLayout::RegisterSize;
+
+	m_data.assign((size_t)registers * ConstantBufferLayout::RegisterSize, 0);
+	m_dirty.assign((registers + 63) / 64, 0);
+
+	// The GPU copy is undefined until the first upload
+	for (uint32_t i = 0; i < registers; i++)
+	{
+		m_dirty[i / 64] |= 1ull << (i % 64);
+	}
+	m_anyDirty = registers > 0;
+}
+
+void ConstantBufferShadow::Write(uint32_t offset, const void* pData, uint32_t size)
+{
+	assert(offset + size <= m_data.size());
+
+	const uint8_t* pSrc = (const uint8_t*)pData;
+	uint32_t end = offset + size;
+	while (offset < end)
+	{
+		uint32_t reg = offset / ConstantBufferLayout::RegisterSize;
+		uint32_t regEnd = (reg + 1) * ConstantBufferLayout::RegisterSize;
+		uint32_t chunk = (regEnd < end ? regEnd : end) - offset;
+
+		if (memcmp(&m_data[offset], pSrc, chunk) != 0)
+		{
+			memcpy(&m_data[offset], pSrc, chunk);
+			m_dirty[reg / 64] |= 1ull << (reg % 64);
+			m_anyDirty = true;
+		}
+
+		pSrc += chunk;
+		offset += chunk;
+	}
+}
+
+bool ConstantBufferShadow::IsDirty() const
+{
+	return m_anyDirty;
+}
+
+void ConstantBufferShadow::GetDirtyRanges(std::vector<Range>& ranges) const
+{
+	ranges.clear();
+
+	uint32_t registers = (uint32_t)m_data.size() / ConstantBufferLayout::RegisterSize;
+	for (uint32_t reg = 0; reg < registers; reg++)
+	{
+		if ((m_dirty[reg / 64] & (1ull << (reg % 64))) == 0)
+		{
+			continue;
+		}
+
+		uint32_t offset = reg * ConstantBufferLayout::RegisterSize;
+		if (!ranges.empty() && ranges.back().offset + ranges.back().size == offset)
+		{
+			ranges.back().size += ConstantBufferLayout::RegisterSize;
+		}
+		else
+		{
+			Range range = { offset, ConstantBufferLayout::RegisterSize };
+			ranges.push_back(range);
+		}
+	}
+}
+
+void ConstantBufferShadow::ClearDirty(uint32_t uploadedBytes)
+{
+	for (uint64_t& bits : m_dirty)
+	{
+		bits = 0;
+	}
+	m_anyDirty = false;
+	m_bytesUploaded += uploadedBytes;
+}
+
+void ConstantBufferShadow::CountSkipped()
+{
+	m_uploadsSkipped++;
+}
+
+const uint8_t* ConstantBufferShadow::GetData() const
+{
+	return m_data.data();
+}
+
+uint32_t ConstantBufferShadow::GetSize() const
+{
+	return (uint32_t)m_data.size();
+}
+
+uint64_t ConstantBufferShadow::GetBytesUploaded() const
+{
+	return m_bytesUploaded;
+}
+
+uint64_t ConstantBufferShadow::GetUploadsSkipped() const
+{
+	return m_uploadsSkipped;
+}
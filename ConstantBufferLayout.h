@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Layout of a constant buffer, either reflected from a shader or declared from
+// the mirroring C++ struct.
+class ConstantBufferLayout
+{
+public:
+	static const uint32_t RegisterSize = 16;
+
+	struct Variable
+	{
+		std::string name;
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	ConstantBufferLayout();
+	explicit ConstantBufferLayout(const std::string& name);
+
+	void AddVariable(const std::string& name, uint32_t offset, uint32_t size);
+
+	// Appends a variable using HLSL packing rules: a variable may not straddle
+	// a 16-byte register and arrays/structs start on a register boundary
+	uint32_t AppendPacked(const std::string& name, uint32_t size, bool startsRegister = false);
+
+	const std::string& GetName() const;
+	uint32_t GetSize() const;
+	const std::vector<Variable>& GetVariables() const;
+	const Variable* FindVariable(const std::string& name) const;
+
+	// Checks that every variable of the shader layout exists in this layout
+	// with the same offset and size; the error describes the first mismatch
+	bool IsCompatible(const ConstantBufferLayout& shaderLayout, std::string* pError = nullptr) const;
+
+	static uint32_t AlignToRegister(uint32_t size);
+
+private:
+	std::string m_name;
+	std::vector<Variable> m_variables;
+	uint32_t m_size;
+};
+
+// CPU copy of a constant buffer that tracks which 16-byte registers changed
+// since the last upload.
+class ConstantBufferShadow
+{
+public:
+	struct Range
+	{
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	ConstantBufferShadow();
+
+	void Init(uint32_t size);
+
+	// Copies data into the shadow, marking only registers whose bytes differ
+	void Write(uint32_t offset, const void* pData, uint32_t size);
+
+	bool IsDirty() const;
+
+	// Contiguous dirty registers merged into byte ranges
+	void GetDirtyRanges(std::vector<Range>& ranges) const;
+
+	// Called after the dirty ranges (or the whole buffer) were uploaded
+	void ClearDirty(uint32_t uploadedBytes);
+	void CountSkipped();
+
+	const uint8_t* GetData() const;
+	uint32_t GetSize() const;
+
+	uint64_t GetBytesUploaded() const;
+	uint64_t GetUploadsSkipped() const;
+
+private:
+	std::vector<uint8_t> m_data;
+	std::vector<uint64_t> m_dirty; // one bit per register
+	bool m_anyDirty;
+
+	uint64_t m_bytesUploaded;
+	uint64_t m_uploadsSkipped;
+};
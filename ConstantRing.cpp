@@ -0,0 +1,212 @@
+#include "ConstantRing.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#define SAFE_RELEASE(p) \
+if (p != NULL) { \
+	p->Release(); \
+	p = NULL;\
+}
+
+const UINT ConstantRing::Alignment;
+
+ConstantRing::ConstantRing()
+	: m_pDevice(nullptr)
+	, m_pContext1(nullptr)
+	, m_pBuffer(nullptr)
+	, m_supported(false)
+	, m_frameFence(0)
+	, m_bytesAllocated(0)
+	, m_stallCount(0)
+{
+}
+
+HRESULT ConstantRing::Init(ID3D11Device* pDevice, UINT size)
+{
+	m_pDevice = pDevice;
+
+	// Binding with offsets and NO_OVERWRITE maps of constant buffers are D3D 11.1 features
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	if (FAILED(pDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options)))
+		|| !options.ConstantBufferOffsetting || !options.MapNoOverwriteOnDynamicConstantBuffer)
+	{
+		return S_OK;
+	}
+
+	ID3D11DeviceContext* pContext = NULL;
+	pDevice->GetImmediateContext(&pContext);
+	HRESULT result = pContext->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&m_pContext1);
+	SAFE_RELEASE(pContext);
+	if (FAILED(result))
+	{
+		return S_OK;
+	}
+
+	D3D11_BUFFER_DESC desc = { 0 };
+	desc.ByteWidth = (size + Alignment - 1) / Alignment * Alignment;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	desc.MiscFlags = 0;
+	desc.StructureByteStride = 0;
+
+	result = pDevice->CreateBuffer(&desc, NULL, &m_pBuffer);
+	assert(SUCCEEDED(result));
+	if (SUCCEEDED(result))
+	{
+		m_allocator.Init(desc.ByteWidth);
+		m_supported = true;
+	}
+
+	return result;
+}
+
+void ConstantRing::Term()
+{
+	for (Fence& fence : m_fences)
+	{
+		SAFE_RELEASE(fence.pQuery);
+	}
+	m_fences.clear();
+
+	for (ID3D11Query*& pQuery : m_freeQueries)
+	{
+		SAFE_RELEASE(pQuery);
+	}
+	m_freeQueries.clear();
+
+	SAFE_RELEASE(m_pBuffer);
+	SAFE_RELEASE(m_pContext1);
+	m_supported = false;
+}
+
+bool ConstantRing::IsSupported() const
+{
+	return m_supported;
+}
+
+void ConstantRing::BeginFrame()
+{
+	m_bytesAllocated = 0;
+
+	while (!m_fences.empty() && IsFenceComplete(m_fences.front().pQuery, false))
+	{
+		m_allocator.Retire(m_fences.front().value);
+		m_freeQueries.push_back(m_fences.front().pQuery);
+		m_fences.pop_front();
+	}
+}
+
+void ConstantRing::EndFrame()
+{
+	if (!m_supported)
+	{
+		return;
+	}
+
+	ID3D11Query* pQuery = NULL;
+	if (!m_freeQueries.empty())
+	{
+		pQuery = m_freeQueries.back();
+		m_freeQueries.pop_back();
+	}
+	else
+	{
+		D3D11_QUERY_DESC desc = { D3D11_QUERY_EVENT, 0 };
+		HRESULT result = m_pDevice->CreateQuery(&desc, &pQuery);
+		assert(SUCCEEDED(result));
+		if (FAILED(result))
+		{
+			return;
+		}
+	}
+
+	m_pContext1->End(pQuery);
+
+	Fence fence = { ++m_frameFence, pQuery };
+	m_fences.push_back(fence);
+	m_allocator.FinishFrame(fence.value);
+}
+
+void* ConstantRing::Map(UINT size, Allocation* pAllocation)
+{
+	assert(m_supported);
+
+	UINT alignedSize = (size + Alignment - 1) / Alignment * Alignment;
+
+	uint64_t offset = m_allocator.Allocate(alignedSize, Alignment);
+	while (offset == RingAllocator::InvalidOffset && !m_fences.empty())
+	{
+		// Ring is full of frames in flight, stall until the oldest one is done
+		WaitOldestFrame();
+		offset = m_allocator.Allocate(alignedSize, Alignment);
+	}
+	if (offset == RingAllocator::InvalidOffset)
+	{
+		OutputDebugStringA("[ConstantRing] allocation does not fit into the ring\n");
+		return nullptr;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	HRESULT result = m_pContext1->Map(m_pBuffer, 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped);
+	assert(SUCCEEDED(result));
+	if (FAILED(result))
+	{
+		return nullptr;
+	}
+
+	pAllocation->pBuffer = m_pBuffer;
+	pAllocation->firstConstant = (UINT)offset / 16;
+	pAllocation->numConstants = alignedSize / 16;
+
+	m_bytesAllocated += alignedSize;
+
+	return (BYTE*)mapped.pData + offset;
+}
+
+void ConstantRing::Unmap()
+{
+	m_pContext1->Unmap(m_pBuffer, 0);
+}
+
+UINT ConstantRing::GetBytesAllocated() const
+{
+	return m_bytesAllocated;
+}
+
+UINT ConstantRing::GetStallCount() const
+{
+	return m_stallCount;
+}
+
+bool ConstantRing::IsFenceComplete(ID3D11Query* pQuery, bool flush)
+{
+	BOOL done = FALSE;
+	HRESULT result = m_pContext1->GetData(pQuery, &done, sizeof(done), flush ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH);
+	return result == S_OK && done;
+}
+
+void ConstantRing::WaitOldestFrame()
+{
+	// The first poll flushes so the query reaches the GPU, later ones only
+	// yield the rest of the time slice while it catches up
+	Fence fence = m_fences.front();
+	if (!IsFenceComplete(fence.pQuery, true))
+	{
+		m_stallCount++;
+		char msg[128];
+		sprintf_s(msg, "[ConstantRing] stalled on frame %llu, %u stalls so far, the ring is too small\n",
+			(unsigned long long)fence.value, m_stallCount);
+		OutputDebugStringA(msg);
+
+		while (!IsFenceComplete(fence.pQuery, false))
+		{
+			Sleep(0);
+		}
+	}
+
+	m_allocator.Retire(fence.value);
+	m_freeQueries.push_back(fence.pQuery);
+	m_fences.pop_front();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <deque>
+#include <vector>
+#include "RingAllocator.h"
+
+// Per-frame constants suballocated from one large dynamic buffer. Each
+// allocation is mapped with NO_OVERWRITE and bound with an offset, space is
+// reclaimed once the GPU passes the event query issued at the end of a frame.
+// Needs D3D 11.1, IsSupported() is false otherwise and callers keep their own
+// constant buffers.
+class ConstantRing
+{
+public:
+	// Offset binding works in blocks of 16 constants
+	static const UINT Alignment = 256;
+
+	struct Allocation
+	{
+		ID3D11Buffer* pBuffer;
+		UINT firstConstant;
+		UINT numConstants;
+	};
+
+	ConstantRing();
+
+	HRESULT Init(ID3D11Device* pDevice, UINT size = 4 * 1024 * 1024);
+	void Term();
+
+	bool IsSupported() const;
+
+	// Reclaims space of frames the GPU has finished
+	void BeginFrame();
+	// Issues the fence for allocations made since BeginFrame()
+	void EndFrame();
+
+	// Returns mapped memory for size bytes, call Unmap() once written
+	void* Map(UINT size, Allocation* pAllocation);
+	void Unmap();
+
+	UINT GetBytesAllocated() const;
+
+	// Times Map() had to wait for the GPU to free space, since Init()
+	UINT GetStallCount() const;
+
+private:
+	bool IsFenceComplete(ID3D11Query* pQuery, bool flush);
+	void WaitOldestFrame();
+
+private:
+	struct Fence
+	{
+		uint64_t value;
+		ID3D11Query* pQuery;
+	};
+
+	ID3D11Device* m_pDevice;
+	ID3D11DeviceContext1* m_pContext1;
+	ID3D11Buffer* m_pBuffer;
+	bool m_supported;
+
+	RingAllocator m_allocator;
+	std::deque<Fence> m_fences;
+	std::vector<ID3D11Query*> m_freeQueries;
+	uint64_t m_frameFence;
+
+	UINT m_bytesAllocated;
+	UINT m_stallCount;
+};
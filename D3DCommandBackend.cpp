@@ -0,0 +1,117 @@
+#include "D3DCommandBackend.h"
+
+#include <assert.h>
+
+D3DCommandBackend::D3DCommandBackend()
+	: m_pStateCache(nullptr)
+	, m_pShaderManager(nullptr)
+{
+}
+
+void D3DCommandBackend::Init(StateCache* pStateCache, const ShaderManager* pShaderManager)
+{
+	m_pStateCache = pStateCache;
+	m_pShaderManager = pShaderManager;
+}
+
+void D3DCommandBackend::Term()
+{
+	m_targets.clear();
+	m_textures.clear();
+	m_vertexBuffers.clear();
+	m_indexBuffers.clear();
+	m_pStateCache = nullptr;
+	m_pShaderManager = nullptr;
+}
+
+void D3DCommandBackend::SetTarget(uint32_t index, ID3D11RenderTargetView* pRTV, ID3D11DepthStencilView* pDSV)
+{
+	if (index >= m_targets.size())
+	{
+		Target empty = { nullptr, nullptr };
+		m_targets.resize(index + 1, empty);
+	}
+	m_targets[index].pRTV = pRTV;
+	m_targets[index].pDSV = pDSV;
+}
+
+void D3DCommandBackend::SetTexture(uint32_t index, ID3D11ShaderResourceView* pSRV)
+{
+	if (index >= m_textures.size())
+	{
+		m_textures.resize(index + 1, nullptr);
+	}
+	m_textures[index] = pSRV;
+}
+
+void D3DCommandBackend::SetVertexBuffer(uint32_t index, ID3D11Buffer* pBuffer, UINT stride)
+{
+	if (index >= m_vertexBuffers.size())
+	{
+		VertexBuffer empty = { nullptr, 0 };
+		m_vertexBuffers.resize(index + 1, empty);
+	}
+	m_vertexBuffers[index].pBuffer = pBuffer;
+	m_vertexBuffers[index].stride = stride;
+}
+
+void D3DCommandBackend::SetIndexBuffer(uint32_t index, ID3D11Buffer* pBuffer, DXGI_FORMAT format)
+{
+	if (index >= m_indexBuffers.size())
+	{
+		IndexBuffer empty = { nullptr, DXGI_FORMAT_R32_UINT };
+		m_indexBuffers.resize(index + 1, empty);
+	}
+	m_indexBuffers[index].pBuffer = pBuffer;
+	m_indexBuffers[index].format = format;
+}
+
+void D3DCommandBackend::ClearTarget(const ClearTargetCommand& command)
+{
+	assert(command.target < m_targets.size());
+	const Target& target = m_targets[command.target];
+
+	ID3D11DeviceContext* pContext = m_pStateCache->GetContext();
+	if (target.pRTV != nullptr)
+	{
+		pContext->ClearRenderTargetView(target.pRTV, command.color);
+	}
+	if (target.pDSV != nullptr && command.depth >= 0.0f)
+	{
+		pContext->ClearDepthStencilView(target.pDSV, D3D11_CLEAR_DEPTH, command.depth, 0);
+	}
+}
+
+void D3DCommandBackend::BindProgram(const BindProgramCommand& command)
+{
+	const ShaderProgram& program = m_pShaderManager->GetProgram(command.program);
+	m_pStateCache->VSSetShader(program.pVertexShader);
+	m_pStateCache->PSSetShader(program.pPixelShader);
+}
+
+void D3DCommandBackend::BindTexture(const BindTextureCommand& command)
+{
+	assert(command.texture < m_textures.size());
+	m_pStateCache->PSSetShaderResources(command.slot, 1, &m_textures[command.texture]);
+}
+
+void D3DCommandBackend::BindVertexBuffer(const BindVertexBufferCommand& command)
+{
+	assert(command.buffer < m_vertexBuffers.size());
+	const VertexBuffer& vertexBuffer = m_vertexBuffers[command.buffer];
+	UINT offset = 0;
+	m_pStateCache->IASetVertexBuffers(command.slot, 1, &vertexBuffer.pBuffer, &vertexBuffer.stride, &offset);
+}
+
+void D3DCommandBackend::BindIndexBuffer(const BindIndexBufferCommand& command)
+{
+	assert(command.buffer < m_indexBuffers.size());
+	const IndexBuffer& indexBuffer = m_indexBuffers[command.buffer];
+	m_pStateCache->IASetIndexBuffer(indexBuffer.pBuffer, indexBuffer.format, 0);
+}
+
+void D3DCommandBackend::DrawIndexedInstanced(const DrawIndexedInstancedCommand& command)
+{
+	m_pStateCache->GetContext()->DrawIndexedInstanced(command.indexCount, command.instanceCount,
+		command.startIndex, command.baseVertex, command.startInstance);
+}
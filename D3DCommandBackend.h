@@ -0,0 +1,58 @@
+#pragma once
+
+#include <d3d11.h>
+#include <vector>
+#include "RenderCommands.h"
+#include "StateCache.h"
+#include "ShaderManager.h"
+
+// Replays render commands into the immediate context. Must only be used on the
+// thread owning the context, recording can happen anywhere.
+class D3DCommandBackend : public RenderCommandBackend
+{
+public:
+	D3DCommandBackend();
+
+	void Init(StateCache* pStateCache, const ShaderManager* pShaderManager);
+	void Term();
+
+	// Resource tables the command indices refer to, views are not referenced
+	void SetTarget(uint32_t index, ID3D11RenderTargetView* pRTV, ID3D11DepthStencilView* pDSV);
+	void SetTexture(uint32_t index, ID3D11ShaderResourceView* pSRV);
+	void SetVertexBuffer(uint32_t index, ID3D11Buffer* pBuffer, UINT stride);
+	void SetIndexBuffer(uint32_t index, ID3D11Buffer* pBuffer, DXGI_FORMAT format);
+
+	virtual void ClearTarget(const ClearTargetCommand& command) override;
+	virtual void BindProgram(const BindProgramCommand& command) override;
+	virtual void BindTexture(const BindTextureCommand& command) override;
+	virtual void BindVertexBuffer(const BindVertexBufferCommand& command) override;
+	virtual void BindIndexBuffer(const BindIndexBufferCommand& command) override;
+	virtual void DrawIndexedInstanced(const DrawIndexedInstancedCommand& command) override;
+
+private:
+	struct Target
+	{
+		ID3D11RenderTargetView* pRTV;
+		ID3D11DepthStencilView* pDSV;
+	};
+
+	StateCache* m_pStateCache;
+	const ShaderManager* m_pShaderManager;
+
+	struct VertexBuffer
+	{
+		ID3D11Buffer* pBuffer;
+		UINT stride;
+	};
+
+	struct IndexBuffer
+	{
+		ID3D11Buffer* pBuffer;
+		DXGI_FORMAT format;
+	};
+
+	std::vector<Target> m_targets;
+	std::vector<ID3D11ShaderResourceView*> m_textures;
+	std::vector<VertexBuffer> m_vertexBuffers;
+	std::vector<IndexBuffer> m_indexBuffers;
+};
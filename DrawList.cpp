@@ -0,0 +1,112 @@
+#include "DrawList.h"
+
+#include <assert.h>
+#include <string.h>
+
+const uint32_t DrawList::FieldBits[FIELD_COUNT] = { 4, 12, 12, 12, 24 };
+const uint32_t DrawList::FieldShift[FIELD_COUNT] = { 60, 48, 36, 24, 0 };
+
+uint64_t DrawList::MakeKey(uint32_t pass, uint32_t program, uint32_t material, uint32_t texture, float depth)
+{
+	assert(pass < (1u << FieldBits[FIELD_PASS]));
+	assert(program < (1u << FieldBits[FIELD_PROGRAM]));
+	assert(material < (1u << FieldBits[FIELD_MATERIAL]));
+	assert(texture < (1u << FieldBits[FIELD_TEXTURE]));
+
+	const uint32_t maxDepth = (1u << FieldBits[FIELD_DEPTH]) - 1;
+	depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+
+	return ((uint64_t)pass << FieldShift[FIELD_PASS])
+		| ((uint64_t)program << FieldShift[FIELD_PROGRAM])
+		| ((uint64_t)material << FieldShift[FIELD_MATERIAL])
+		| ((uint64_t)texture << FieldShift[FIELD_TEXTURE])
+		| (uint64_t)(uint32_t)(depth * maxDepth);
+}
+
+uint32_t DrawList::GetField(uint64_t key, Field field)
+{
+	return (uint32_t)((key >> FieldShift[field]) & ((1ull << FieldBits[field]) - 1));
+}
+
+void DrawList::Clear()
+{
+	m_items.clear();
+}
+
+void DrawList::Add(uint64_t key, uint32_t draw)
+{
+	Item item = { key, draw };
+	m_items.push_back(item);
+}
+
+void DrawList::Sort()
+{
+	size_t count = m_items.size();
+	if (count < 2)
+	{
+		return;
+	}
+
+	// All eight histograms in one pass over the keys
+	uint32_t histograms[8][256];
+	memset(histograms, 0, sizeof(histograms));
+	for (const Item& item : m_items)
+	{
+		for (int digit = 0; digit < 8; digit++)
+		{
+			histograms[digit][(item.key >> (digit * 8)) & 0xFF]++;
+		}
+	}
+
+	m_scratch.resize(count);
+	Item* pSrc = m_items.data();
+	Item* pDst = m_scratch.data();
+
+	for (int digit = 0; digit < 8; digit++)
+	{
+		uint32_t* histogram = histograms[digit];
+
+		// Every key has the same digit, order would not change
+		if (histogram[(pSrc[0].key >> (digit * 8)) & 0xFF] == count)
+		{
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (int bucket = 0; bucket < 256; bucket++)
+		{
+			uint32_t bucketCount = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucketCount;
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			pDst[histogram[(pSrc[i].key >> (digit * 8)) & 0xFF]++] = pSrc[i];
+		}
+
+		Item* pTemp = pSrc;
+		pSrc = pDst;
+		pDst = pTemp;
+	}
+
+	if (pSrc != m_items.data())
+	{
+		m_items.swap(m_scratch);
+	}
+}
+
+const std::vector<DrawList::Item>& DrawList::GetItems() const
+{
+	return m_items;
+}
+
+uint32_t DrawList::CountChanges(Field field) const
+{
+	uint32_t changes = 0;
+	for (size_t i = 1; i < m_items.size(); i++)
+	{
+		changes += GetField(m_items[i].key, field) != GetField(m_items[i - 1].key, field) ? 1 : 0;
+	}
+	return changes;
+}
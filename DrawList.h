@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Draws of a frame ordered by a 64-bit key, most significant field first:
+//   pass 4 | program 12 | material 12 | texture 12 | depth 24
+// Sorting groups draws by state, depth orders them front to back inside a group.
+class DrawList
+{
+public:
+	enum Field
+	{
+		FIELD_PASS = 0,
+		FIELD_PROGRAM,
+		FIELD_MATERIAL,
+		FIELD_TEXTURE,
+		FIELD_DEPTH,
+		FIELD_COUNT
+	};
+
+	struct Item
+	{
+		uint64_t key;
+		uint32_t draw; // caller's index of the draw
+	};
+
+	static const uint32_t FieldBits[FIELD_COUNT];
+	static const uint32_t FieldShift[FIELD_COUNT];
+
+	// depth in 0..1, farther draws get larger keys
+	static uint64_t MakeKey(uint32_t pass, uint32_t program, uint32_t material, uint32_t texture, float depth);
+	static uint32_t GetField(uint64_t key, Field field);
+
+	void Clear();
+	void Add(uint64_t key, uint32_t draw);
+
+	// LSD radix sort by 8-bit digits, digits equal across all keys are skipped
+	void Sort();
+
+	const std::vector<Item>& GetItems() const;
+
+	// Number of times the given field changes between consecutive items
+	uint32_t CountChanges(Field field) const;
+
+private:
+	std::vector<Item> m_items;
+	std::vector<Item> m_scratch;
+};
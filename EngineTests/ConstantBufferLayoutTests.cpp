@@ -0,0 +1,202 @@
+#include <string.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "ConstantBufferLayout.h"
+#include "TestFramework.h"
+
+typedef std::vector<ConstantBufferShadow::Range> RangeList;
+
+static bool Equal(const RangeList& ranges, const RangeList& expected)
+{
+	if (ranges.size() != expected.size())
+	{
+		return false;
+	}
+	for (size_t i = 0; i < ranges.size(); i++)
+	{
+		if (ranges[i].offset != expected[i].offset || ranges[i].size != expected[i].size)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static RangeList GetRanges(const ConstantBufferShadow& shadow)
+{
+	RangeList ranges;
+	shadow.GetDirtyRanges(ranges);
+	return ranges;
+}
+
+static void TestShadow()
+{
+	ConstantBufferShadow shadow;
+	shadow.Init(40);
+	CHECK(shadow.GetSize() == 48);
+
+	// Everything is uploaded first, in one range
+	CHECK(shadow.IsDirty());
+	CHECK(Equal(GetRanges(shadow), { { 0, 48 } }));
+	shadow.ClearDirty(48);
+	CHECK(!shadow.IsDirty());
+	CHECK(GetRanges(shadow).empty());
+	CHECK(shadow.GetBytesUploaded() == 48);
+
+	// Writing what is there already changes nothing
+	uint8_t zeros[48] = {};
+	shadow.Write(0, zeros, sizeof(zeros));
+	CHECK(!shadow.IsDirty());
+	shadow.CountSkipped();
+	CHECK(shadow.GetUploadsSkipped() == 1);
+
+	// Separate registers stay separate ranges
+	float one = 1.0f;
+	shadow.Write(4, &one, sizeof(one));
+	shadow.Write(40, &one, sizeof(one));
+	CHECK(Equal(GetRanges(shadow), { { 0, 16 }, { 32, 16 } }));
+	CHECK(memcmp(shadow.GetData() + 40, &one, sizeof(one)) == 0);
+	shadow.ClearDirty(32);
+
+	// A write across a register boundary marks both, neighbours merge
+	float pair[2] = { 2.0f, 3.0f };
+	shadow.Write(12, pair, sizeof(pair));
+	CHECK(Equal(GetRanges(shadow), { { 0, 32 } }));
+	shadow.ClearDirty(32);
+
+	// Only registers whose bytes differ are marked by a long write
+	uint8_t block[48];
+	memcpy(block, shadow.GetData(), sizeof(block));
+	block[20] ^= 0xFF;
+	shadow.Write(0, block, sizeof(block));
+	CHECK(Equal(GetRanges(shadow), { { 16, 16 } }));
+	shadow.ClearDirty(16);
+	CHECK(shadow.GetBytesUploaded() == 48 + 32 + 32 + 16);
+
+	// Dirty bits of neighbouring registers in different words still merge
+	ConstantBufferShadow large;
+	large.Init(80 * 16);
+	large.ClearDirty(large.GetSize());
+	uint8_t values[32];
+	memset(values, 7, sizeof(values));
+	large.Write(63 * 16, values, sizeof(values));
+	large.Write(79 * 16 + 15, values, 1);
+	CHECK(Equal(GetRanges(large), { { 63 * 16, 32 }, { 79 * 16, 16 } }));
+	large.ClearDirty(48);
+
+	// Random writes against a reference that compares every write with the
+	// bytes it replaces
+	std::minstd_rand random(1);
+	bool matches = true;
+	for (int round = 0; round < 200; round++)
+	{
+		std::vector<bool> dirty(large.GetSize() / 16, false);
+		int writeCount = 1 + (int)(random() % 8);
+		for (int w = 0; w < writeCount; w++)
+		{
+			uint32_t offset = (uint32_t)(random() % large.GetSize());
+			uint32_t size = 1 + (uint32_t)(random() % 64);
+			size = offset + size > large.GetSize() ? large.GetSize() - offset : size;
+
+			std::vector<uint8_t> data(large.GetData() + offset, large.GetData() + offset + size);
+			for (uint32_t i = 0; i < size; i++)
+			{
+				// Most bytes keep their value
+				if (random() % 4 == 0)
+				{
+					uint8_t byte = (uint8_t)random();
+					dirty[(offset + i) / 16] = dirty[(offset + i) / 16] || byte != data[i];
+					data[i] = byte;
+				}
+			}
+			large.Write(offset, data.data(), size);
+		}
+
+		RangeList expected;
+		for (uint32_t reg = 0; reg < (uint32_t)dirty.size(); reg++)
+		{
+			if (!dirty[reg])
+			{
+				continue;
+			}
+			if (!expected.empty() && expected.back().offset + expected.back().size == reg * 16)
+			{
+				expected.back().size += 16;
+			}
+			else
+			{
+				expected.push_back({ reg * 16, 16 });
+			}
+		}
+		matches = matches && Equal(GetRanges(large), expected) && large.IsDirty() == !expected.empty();
+
+		large.ClearDirty(0);
+	}
+	CHECK(matches);
+}
+
+static void TestLayout()
+{
+	// cbuffer Model { float4x4 world; float3 color; float alpha; float2 uv;
+	// float3 normal; float weights[2]; }
+	ConstantBufferLayout layout("Model");
+	CHECK(layout.AppendPacked("world", 64) == 0);
+	CHECK(layout.AppendPacked("color", 12) == 64);
+	CHECK(layout.AppendPacked("alpha", 4) == 76);
+	CHECK(layout.AppendPacked("uv", 8) == 80);
+	CHECK(layout.AppendPacked("normal", 12) == 96);
+	CHECK(layout.AppendPacked("weights", 20, true) == 112);
+	CHECK(layout.GetSize() == 132);
+	CHECK(ConstantBufferLayout::AlignToRegister(layout.GetSize()) == 144);
+
+	// As reflection reports it, with the size aligned to a register
+	ConstantBufferLayout shader("Model");
+	shader.AddVariable("world", 0, 64);
+	shader.AddVariable("color", 64, 12);
+	shader.AddVariable("alpha", 76, 4);
+	shader.AddVariable("uv", 80, 8);
+	shader.AddVariable("normal", 96, 12);
+	shader.AddVariable("weights", 112, 20);
+	shader.AddVariable("padding", 140, 4);
+	layout.AddVariable("padding", 140, 4);
+
+	std::string error;
+	CHECK(layout.IsCompatible(shader, &error));
+	CHECK(error.empty());
+
+	// Variables the shader does not read may be declared
+	ConstantBufferLayout subset("Model");
+	subset.AddVariable("color", 64, 12);
+	CHECK(layout.IsCompatible(subset));
+
+	// A float3 declared where HLSL packing moves it to the next register
+	ConstantBufferLayout moved("Model");
+	moved.AddVariable("world", 0, 64);
+	moved.AddVariable("color", 64, 12);
+	moved.AddVariable("alpha", 76, 4);
+	moved.AddVariable("uv", 80, 8);
+	moved.AddVariable("normal", 88, 12);
+	CHECK(!moved.IsCompatible(shader, &error));
+	CHECK(error == "Model: 'normal' is at offset 88 size 12, shader expects offset 96 size 12");
+
+	ConstantBufferLayout resized("Model");
+	resized.AddVariable("world", 0, 64);
+	resized.AddVariable("color", 64, 16);
+	CHECK(!resized.IsCompatible(subset, &error));
+	CHECK(error == "Model: 'color' is at offset 64 size 16, shader expects offset 64 size 12");
+
+	ConstantBufferLayout missing("Model");
+	missing.AddVariable("world", 0, 64);
+	CHECK(!missing.IsCompatible(subset, &error));
+	CHECK(error == "Model: 'color' is not declared on the CPU side");
+
+	CHECK(layout.FindVariable("uv") != nullptr && layout.FindVariable("uv")->offset == 80);
+	CHECK(layout.FindVariable("missing") == nullptr);
+}
+
+void TestConstantBufferLayout()
+{
+	TestShadow();
+	TestLayout();
+}
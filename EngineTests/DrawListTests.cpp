@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "DrawList.h"
+#include "TestFramework.h"
+
+static const uint32_t BenchmarkCounts[] = { 1024, 16384, 262144 };
+
+static bool IsKeyLess(const DrawList::Item& a, const DrawList::Item& b)
+{
+	return a.key < b.key;
+}
+
+// The radix sort is stable, so draws with equal keys keep the order they
+// were added in, as with std::stable_sort
+static bool SortsLikeStableSort(const std::vector<uint64_t>& keys)
+{
+	DrawList list;
+	std::vector<DrawList::Item> expected;
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		list.Add(keys[i], (uint32_t)i);
+		DrawList::Item item = { keys[i], (uint32_t)i };
+		expected.push_back(item);
+	}
+	list.Sort();
+	std::stable_sort(expected.begin(), expected.end(), IsKeyLess);
+
+	const std::vector<DrawList::Item>& items = list.GetItems();
+	if (items.size() != expected.size())
+	{
+		return false;
+	}
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		if (items[i].key != expected[i].key || items[i].draw != expected[i].draw)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static uint64_t MakeRandomKey(std::minstd_rand& random, uint32_t distinctStates)
+{
+	uint32_t state = random() % distinctStates;
+	float depth = (random() % 100000) / 100000.0f;
+	return DrawList::MakeKey(state % 3, state % 4095, state / 3 % 4095, state / 7 % 4095, depth);
+}
+
+static void TestKeys()
+{
+	uint64_t key = DrawList::MakeKey(15, 4095, 1234, 17, 1.0f);
+	CHECK(DrawList::GetField(key, DrawList::FIELD_PASS) == 15);
+	CHECK(DrawList::GetField(key, DrawList::FIELD_PROGRAM) == 4095);
+	CHECK(DrawList::GetField(key, DrawList::FIELD_MATERIAL) == 1234);
+	CHECK(DrawList::GetField(key, DrawList::FIELD_TEXTURE) == 17);
+	CHECK(DrawList::GetField(key, DrawList::FIELD_DEPTH) == (1u << 24) - 1);
+
+	// Fields cover the key without overlap
+	uint32_t bits = 0;
+	for (uint32_t field = 0; field < DrawList::FIELD_COUNT; field++)
+	{
+		bits += DrawList::FieldBits[field];
+		CHECK(DrawList::FieldShift[field] == 64 - bits);
+	}
+	CHECK(bits == 64);
+
+	// Depth is clamped and orders draws front to back inside a state
+	CHECK(DrawList::MakeKey(1, 2, 3, 4, -1.0f) == DrawList::MakeKey(1, 2, 3, 4, 0.0f));
+	CHECK(DrawList::MakeKey(1, 2, 3, 4, 2.0f) == DrawList::MakeKey(1, 2, 3, 4, 1.0f));
+	CHECK(DrawList::MakeKey(1, 2, 3, 4, 0.25f) < DrawList::MakeKey(1, 2, 3, 4, 0.5f));
+	CHECK(DrawList::MakeKey(1, 2, 3, 4, 1.0f) < DrawList::MakeKey(1, 2, 3, 5, 0.0f));
+	CHECK(DrawList::MakeKey(0, 4095, 4095, 4095, 1.0f) < DrawList::MakeKey(1, 0, 0, 0, 0.0f));
+}
+
+static void TestSort()
+{
+	CHECK(SortsLikeStableSort(std::vector<uint64_t>()));
+	CHECK(SortsLikeStableSort(std::vector<uint64_t>(1, 42)));
+	CHECK(SortsLikeStableSort({ 2, 1 }));
+
+	// Equal keys skip every digit and keep the order
+	CHECK(SortsLikeStableSort(std::vector<uint64_t>(1000, 0x123456789ABCDEFull)));
+
+	// Keys differing in one digit only, the lowest and the highest, one pass
+	// leaves the result in the scratch buffer
+	std::minstd_rand random(1);
+	std::vector<uint64_t> keys;
+	for (int i = 0; i < 1000; i++)
+	{
+		keys.push_back(0x1122334455667700ull | (random() & 0xFF));
+	}
+	CHECK(SortsLikeStableSort(keys));
+	for (uint64_t& key : keys)
+	{
+		key = (key << 56) | 0x00AABBCCDDEEFF00ull;
+	}
+	CHECK(SortsLikeStableSort(keys));
+
+	// Full width random keys, odd counts and many duplicates
+	for (uint32_t count : { 3u, 255u, 257u, 4099u })
+	{
+		keys.clear();
+		for (uint32_t i = 0; i < count; i++)
+		{
+			keys.push_back(((uint64_t)random() << 33) ^ ((uint64_t)random() << 2) ^ random());
+		}
+		CHECK(SortsLikeStableSort(keys));
+
+		for (uint64_t& key : keys)
+		{
+			key = MakeRandomKey(random, 16);
+		}
+		CHECK(SortsLikeStableSort(keys));
+	}
+
+	// Sorted and reversed input
+	keys.clear();
+	for (uint64_t i = 0; i < 3000; i++)
+	{
+		keys.push_back(i * 0x10101);
+	}
+	CHECK(SortsLikeStableSort(keys));
+	std::reverse(keys.begin(), keys.end());
+	CHECK(SortsLikeStableSort(keys));
+
+	// A list sorts again after Clear() with fewer items than before
+	DrawList list;
+	for (uint32_t i = 0; i < 100; i++)
+	{
+		list.Add(100 - i, i);
+	}
+	list.Sort();
+	list.Clear();
+	CHECK(list.GetItems().empty());
+	list.Add(7, 0);
+	list.Add(3, 1);
+	list.Add(5, 2);
+	list.Sort();
+	CHECK(list.GetItems().size() == 3 && list.GetItems()[0].draw == 1 && list.GetItems()[1].draw == 2 && list.GetItems()[2].draw == 0);
+}
+
+static void TestChanges()
+{
+	DrawList list;
+	CHECK(list.CountChanges(DrawList::FIELD_PROGRAM) == 0);
+
+	list.Add(DrawList::MakeKey(0, 2, 1, 0, 0.5f), 0);
+	list.Add(DrawList::MakeKey(0, 1, 1, 0, 0.5f), 1);
+	list.Add(DrawList::MakeKey(0, 2, 2, 0, 0.1f), 2);
+	list.Add(DrawList::MakeKey(0, 1, 2, 0, 0.9f), 3);
+	CHECK(list.CountChanges(DrawList::FIELD_PROGRAM) == 3);
+	CHECK(list.CountChanges(DrawList::FIELD_MATERIAL) == 1);
+
+	// Sorted, each program and then each material is one run
+	list.Sort();
+	CHECK(list.CountChanges(DrawList::FIELD_PROGRAM) == 1);
+	CHECK(list.CountChanges(DrawList::FIELD_MATERIAL) == 3);
+	CHECK(list.CountChanges(DrawList::FIELD_PASS) == 0);
+}
+
+void TestDrawList()
+{
+	TestKeys();
+	TestSort();
+	TestChanges();
+}
+
+void BenchmarkDrawList(double seconds)
+{
+	printf("%-10s %14s %14s %14s %10s\n", "draws", "radix (ms)", "sort (ms)", "stable (ms)", "speedup");
+	for (uint32_t count : BenchmarkCounts)
+	{
+		std::minstd_rand random(1);
+		std::vector<DrawList::Item> items(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			items[i].key = MakeRandomKey(random, 256);
+			items[i].draw = i;
+		}
+
+		// Every call sorts the same unsorted list
+		DrawList list;
+		double radixMs = TimeWork(seconds / 3, [&]()
+		{
+			list.Clear();
+			for (const DrawList::Item& item : items)
+			{
+				list.Add(item.key, item.draw);
+			}
+			list.Sort();
+		});
+
+		std::vector<DrawList::Item> sorted;
+		double sortMs = TimeWork(seconds / 3, [&]()
+		{
+			sorted = items;
+			std::sort(sorted.begin(), sorted.end(), IsKeyLess);
+		});
+		double stableMs = TimeWork(seconds / 3, [&]()
+		{
+			sorted = items;
+			std::stable_sort(sorted.begin(), sorted.end(), IsKeyLess);
+		});
+
+		printf("%-10u %14.3f %14.3f %14.3f %9.2fx\n", count, radixMs, sortMs, stableMs, sortMs / radixMs);
+	}
+}
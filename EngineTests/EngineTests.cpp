@@ -0,0 +1,227 @@
+// EngineTests : unit tests and micro benchmarks of the engine modules that
+// have no graphics API dependencies, and of StateCache on a recording context.
+//
+// Usage: EngineTests [names]
+//        EngineTests --benchmark [--seconds S] [names]
+//
+// Without names every test runs. Each test prints whether it passed and the
+// failed checks, the exit code is 1 if any check failed. Benchmarks print
+// their own tables and run after the tests of the same names.
+//
+// Only the C++ standard library is used, StateCache is built against the
+// stand-in D3D header in Fake, so the tool builds on any platform,
+// e.g. "c++ -O2 -std=c++14 -mavx2 -mfma -pthread -DEMBED_SHADERS -IFake -I..
+// EngineTests.cpp ConstantBufferLayoutTests.cpp DrawListTests.cpp
+// FrustumCullerTests.cpp HdrImageFileTests.cpp InstanceBatcherTests.cpp
+// LightClustererTests.cpp LightingKernelTests.cpp LightManagerTests.cpp
+// MeshImporterTests.cpp MeshletBuilderTests.cpp MeshOptimizerTests.cpp
+// MeshSimplifierTests.cpp RenderCommandsTests.cpp RingAllocatorTests.cpp
+// ShaderDependencyGraphTests.cpp ShaderPermutationTests.cpp
+// ShaderSchedulerTests.cpp ShaderTableTests.cpp SoftwareRasterizerTests.cpp
+// StateCacheTests.cpp StaticBatcherTests.cpp TlsfAllocatorTests.cpp
+// ToneMapperTests.cpp TransformStoreTests.cpp VertexCompressionTests.cpp
+// ShaderTable.golden.cpp ../BoundingVolumeHierarchy.cpp
+// ../BufferSuballocator.cpp ../BuiltinScene.cpp ../ColorShaderVariants.cpp
+// ../ConstantBufferLayout.cpp ../DrawList.cpp ../FrustumCuller.cpp
+// ../HdrImageFile.cpp ../InstanceBatcher.cpp ../LightClusterer.cpp
+// ../LightingKernel.cpp ../LightManager.cpp ../MappedFile.cpp
+// ../MeshImporter.cpp ../MeshletBuilder.cpp ../MeshOptimizer.cpp
+// ../MeshSimplifier.cpp ../PipelineStateShadow.cpp ../RenderCommands.cpp
+// ../RingAllocator.cpp ../ShaderDependencyGraph.cpp ../ShaderPermutation.cpp
+// ../ShaderTable.cpp ../SoftwareRasterizer.cpp ../StateCache.cpp
+// ../StaticBatcher.cpp ../TlsfAllocator.cpp ../ToneMapper.cpp
+// ../TransformStore.cpp ../VertexCompression.cpp -o EngineTests".
+// EMBED_SHADERS replaces the empty shader table with the golden one.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "TestFramework.h"
+
+void TestConstantBufferLayout();
+void TestDrawList();
+void BenchmarkDrawList(double seconds);
+void TestFrustumCuller();
+void BenchmarkFrustumCuller(double seconds);
+void TestHdrImageFile();
+void TestInstanceBatcher();
+void BenchmarkInstanceBatcher(double seconds);
+void TestLightClusterer();
+void BenchmarkLightClusterer(double seconds);
+void TestLightingKernel();
+void TestLightManager();
+void BenchmarkLightManager(double seconds);
+void TestMeshImporter();
+void TestMeshletBuilder();
+void BenchmarkMeshletBuilder(double seconds);
+void TestMeshOptimizer();
+void BenchmarkMeshOptimizer(double seconds);
+void TestMeshSimplifier();
+void BenchmarkMeshSimplifier(double seconds);
+void TestRenderCommands();
+void BenchmarkRenderCommands(double seconds);
+void TestRingAllocator();
+void TestShaderDependencyGraph();
+void TestShaderPermutation();
+void TestShaderScheduler();
+void BenchmarkShaderScheduler(double seconds);
+void TestShaderTable();
+void TestSoftwareRasterizer();
+void TestStateCache();
+void TestStaticBatcher();
+void BenchmarkStaticBatcher(double seconds);
+void TestTlsfAllocator();
+void BenchmarkTlsfAllocator(double seconds);
+void TestToneMapper();
+void TestTransformStore();
+void BenchmarkTransformStore(double seconds);
+void TestVertexCompression();
+void BenchmarkVertexCompression(double seconds);
+
+struct TestCase
+{
+	const char* pName;
+	void (*pTest)();
+	void (*pBenchmark)(double seconds); // NULL if the module has none
+};
+
+static const TestCase TestCases[] =
+{
+	{ "ConstantBufferLayout", TestConstantBufferLayout, NULL },
+	{ "DrawList", TestDrawList, BenchmarkDrawList },
+	{ "FrustumCuller", TestFrustumCuller, BenchmarkFrustumCuller },
+	{ "HdrImageFile", TestHdrImageFile, NULL },
+	{ "InstanceBatcher", TestInstanceBatcher, BenchmarkInstanceBatcher },
+	{ "LightClusterer", TestLightClusterer, BenchmarkLightClusterer },
+	{ "LightingKernel", TestLightingKernel, NULL },
+	{ "LightManager", TestLightManager, BenchmarkLightManager },
+	{ "MeshImporter", TestMeshImporter, NULL },
+	{ "MeshletBuilder", TestMeshletBuilder, BenchmarkMeshletBuilder },
+	{ "MeshOptimizer", TestMeshOptimizer, BenchmarkMeshOptimizer },
+	{ "MeshSimplifier", TestMeshSimplifier, BenchmarkMeshSimplifier },
+	{ "RenderCommands", TestRenderCommands, BenchmarkRenderCommands },
+	{ "RingAllocator", TestRingAllocator, NULL },
+	{ "ShaderDependencyGraph", TestShaderDependencyGraph, NULL },
+	{ "ShaderPermutation", TestShaderPermutation, NULL },
+	{ "ShaderScheduler", TestShaderScheduler, BenchmarkShaderScheduler },
+	{ "ShaderTable", TestShaderTable, NULL },
+	{ "SoftwareRasterizer", TestSoftwareRasterizer, NULL },
+	{ "StateCache", TestStateCache, NULL },
+	{ "StaticBatcher", TestStaticBatcher, BenchmarkStaticBatcher },
+	{ "TlsfAllocator", TestTlsfAllocator, BenchmarkTlsfAllocator },
+	{ "ToneMapper", TestToneMapper, NULL },
+	{ "TransformStore", TestTransformStore, BenchmarkTransformStore },
+	{ "VertexCompression", TestVertexCompression, BenchmarkVertexCompression },
+};
+
+static uint32_t s_failedChecks = 0;
+
+bool TestCheck(bool condition, const char* pText, const char* pFile, int line)
+{
+	if (!condition)
+	{
+		fprintf(stderr, "%s(%d): check failed: %s\n", pFile, line, pText);
+		s_failedChecks++;
+	}
+	return condition;
+}
+
+bool WriteTestFile(const std::string& path, const std::string& text)
+{
+	FILE* pFile = NULL;
+#ifdef _MSC_VER
+	fopen_s(&pFile, path.c_str(), "wb");
+#else
+	pFile = fopen(path.c_str(), "wb");
+#endif
+	if (pFile == NULL)
+	{
+		return false;
+	}
+
+	size_t written = text.empty() ? 1 : fwrite(text.data(), text.size(), 1, pFile);
+	return fclose(pFile) == 0 && written == 1;
+}
+
+int main(int argc, char** argv)
+{
+	bool benchmark = false;
+	double seconds = 1.0;
+	std::vector<const TestCase*> selected;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		const TestCase* pCase = NULL;
+		for (const TestCase& testCase : TestCases)
+		{
+			if (strcmp(argv[i], testCase.pName) == 0)
+			{
+				pCase = &testCase;
+			}
+		}
+
+		if (pCase != NULL)
+		{
+			selected.push_back(pCase);
+		}
+		else if (strcmp(argv[i], "--benchmark") == 0)
+		{
+			benchmark = true;
+		}
+		else if (strcmp(argv[i], "--seconds") == 0 && hasValue)
+		{
+			seconds = atof(argv[++i]);
+		}
+		else
+		{
+			fprintf(stderr, "Usage: EngineTests [names]\n");
+			fprintf(stderr, "       EngineTests --benchmark [--seconds S] [names]\n");
+			fprintf(stderr, "Tests:");
+			for (const TestCase& testCase : TestCases)
+			{
+				fprintf(stderr, " %s", testCase.pName);
+			}
+			fprintf(stderr, "\n");
+			return 1;
+		}
+	}
+
+	if (selected.empty())
+	{
+		for (const TestCase& testCase : TestCases)
+		{
+			selected.push_back(&testCase);
+		}
+	}
+
+	uint32_t failedTests = 0;
+	for (const TestCase* pCase : selected)
+	{
+		uint32_t failedChecks = s_failedChecks;
+		pCase->pTest();
+		bool passed = s_failedChecks == failedChecks;
+		printf("%-24s %s\n", pCase->pName, passed ? "passed" : "FAILED");
+		failedTests += passed ? 0 : 1;
+	}
+
+	if (benchmark)
+	{
+		for (const TestCase* pCase : selected)
+		{
+			if (pCase->pBenchmark != NULL)
+			{
+				printf("\n%s\n", pCase->pName);
+				pCase->pBenchmark(seconds);
+			}
+		}
+	}
+
+	if (failedTests != 0)
+	{
+		fprintf(stderr, "EngineTests: %u of %u tests failed\n", failedTests, (uint32_t)selected.size());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+// Stand-in for the D3D 11.1 header with just what StateCache uses, so the
+// tests can record its calls on a fake context. Only the EngineTests include
+// path finds it.
+#ifdef _WIN32
+#include <windows.h>
+#include <unknwn.h>
+#else
+#include <stdint.h>
+#include <string.h>
+
+typedef unsigned int UINT;
+typedef int INT;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef float FLOAT;
+typedef int32_t HRESULT;
+
+#define STDMETHODCALLTYPE
+#define DECLSPEC_UUID(x)
+#define S_OK ((HRESULT)0)
+#define E_NOINTERFACE ((HRESULT)0x80004002)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+struct GUID
+{
+	uint32_t Data1;
+	uint16_t Data2;
+	uint16_t Data3;
+	uint8_t Data4[8];
+};
+typedef const GUID& REFIID;
+
+inline bool operator==(const GUID& a, const GUID& b)
+{
+	return memcmp(&a, &b, sizeof(GUID)) == 0;
+}
+
+#define __uuidof(type) IID_##type
+
+struct RECT
+{
+	LONG left;
+	LONG top;
+	LONG right;
+	LONG bottom;
+};
+
+struct IUnknown
+{
+	virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) = 0;
+	virtual ULONG STDMETHODCALLTYPE AddRef() = 0;
+	virtual ULONG STDMETHODCALLTYPE Release() = 0;
+};
+#endif
+
+enum DXGI_FORMAT
+{
+	DXGI_FORMAT_UNKNOWN = 0,
+	DXGI_FORMAT_R32_UINT = 42,
+	DXGI_FORMAT_R16_UINT = 57,
+};
+
+enum D3D_PRIMITIVE_TOPOLOGY
+{
+	D3D_PRIMITIVE_TOPOLOGY_UNDEFINED = 0,
+	D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST = 4,
+	D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP = 5,
+	D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST = 4,
+	D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP = 5,
+};
+typedef D3D_PRIMITIVE_TOPOLOGY D3D11_PRIMITIVE_TOPOLOGY;
+
+struct D3D11_VIEWPORT
+{
+	FLOAT TopLeftX;
+	FLOAT TopLeftY;
+	FLOAT Width;
+	FLOAT Height;
+	FLOAT MinDepth;
+	FLOAT MaxDepth;
+};
+
+typedef RECT D3D11_RECT;
+
+struct ID3D11DeviceChild : IUnknown
+{
+};
+
+// State objects are only passed around by handle
+struct ID3D11Resource : ID3D11DeviceChild
+{
+};
+
+struct ID3D11Buffer : ID3D11Resource
+{
+};
+
+struct ID3D11Texture2D : ID3D11Resource
+{
+};
+
+struct ID3D11InputLayout : ID3D11DeviceChild
+{
+};
+
+struct ID3D11VertexShader : ID3D11DeviceChild
+{
+};
+
+struct ID3D11PixelShader : ID3D11DeviceChild
+{
+};
+
+struct ID3D11ClassInstance : ID3D11DeviceChild
+{
+};
+
+struct ID3D11SamplerState : ID3D11DeviceChild
+{
+};
+
+struct ID3D11RasterizerState : ID3D11DeviceChild
+{
+};
+
+struct ID3D11View : ID3D11DeviceChild
+{
+	// Adds a reference to the resource
+	virtual void STDMETHODCALLTYPE GetResource(ID3D11Resource** ppResource) = 0;
+};
+
+struct ID3D11ShaderResourceView : ID3D11View
+{
+};
+
+struct ID3D11RenderTargetView : ID3D11View
+{
+};
+
+struct ID3D11DepthStencilView : ID3D11View
+{
+};
+
+struct ID3D11DeviceContext : ID3D11DeviceChild
+{
+	virtual void STDMETHODCALLTYPE ClearState() = 0;
+
+	virtual void STDMETHODCALLTYPE IASetVertexBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppVertexBuffers,
+		const UINT* pStrides, const UINT* pOffsets) = 0;
+	virtual void STDMETHODCALLTYPE IASetIndexBuffer(ID3D11Buffer* pIndexBuffer, DXGI_FORMAT Format, UINT Offset) = 0;
+	virtual void STDMETHODCALLTYPE IASetInputLayout(ID3D11InputLayout* pInputLayout) = 0;
+	virtual void STDMETHODCALLTYPE IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY Topology) = 0;
+
+	virtual void STDMETHODCALLTYPE VSSetShader(ID3D11VertexShader* pVertexShader, ID3D11ClassInstance* const* ppClassInstances,
+		UINT NumClassInstances) = 0;
+	virtual void STDMETHODCALLTYPE PSSetShader(ID3D11PixelShader* pPixelShader, ID3D11ClassInstance* const* ppClassInstances,
+		UINT NumClassInstances) = 0;
+	virtual void STDMETHODCALLTYPE VSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppConstantBuffers) = 0;
+	virtual void STDMETHODCALLTYPE PSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppConstantBuffers) = 0;
+	virtual void STDMETHODCALLTYPE PSSetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView* const* ppShaderResourceViews) = 0;
+	virtual void STDMETHODCALLTYPE PSSetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState* const* ppSamplers) = 0;
+
+	virtual void STDMETHODCALLTYPE RSSetState(ID3D11RasterizerState* pRasterizerState) = 0;
+	virtual void STDMETHODCALLTYPE RSSetViewports(UINT NumViewports, const D3D11_VIEWPORT* pViewports) = 0;
+	virtual void STDMETHODCALLTYPE RSSetScissorRects(UINT NumRects, const D3D11_RECT* pRects) = 0;
+
+	virtual void STDMETHODCALLTYPE OMSetRenderTargets(UINT NumViews, ID3D11RenderTargetView* const* ppRenderTargetViews,
+		ID3D11DepthStencilView* pDepthStencilView) = 0;
+};
+
+struct DECLSPEC_UUID("bb2c6faa-b5fb-4082-8e6b-388b8cfa90e1") ID3D11DeviceContext1 : ID3D11DeviceContext
+{
+	virtual void STDMETHODCALLTYPE VSSetConstantBuffers1(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppConstantBuffers,
+		const UINT* pFirstConstant, const UINT* pNumConstants) = 0;
+	virtual void STDMETHODCALLTYPE PSSetConstantBuffers1(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppConstantBuffers,
+		const UINT* pFirstConstant, const UINT* pNumConstants) = 0;
+};
+
+#ifndef _WIN32
+static const GUID IID_ID3D11DeviceContext1 = { 0xbb2c6faa, 0xb5fb, 0x4082, { 0x8e, 0x6b, 0x38, 0x8b, 0x8c, 0xfa, 0x90, 0xe1 } };
+#endif
@@ -0,0 +1,309 @@
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "BoundingVolumeHierarchy.h"
+#include "FrustumCuller.h"
+#include "TestFramework.h"
+
+static const float NearPlane = 0.1f;
+static const float FarPlane = 100.0f;
+static const uint32_t BenchmarkCounts[] = { 1024, 16384, 262144 };
+
+// Elements closer than this to a plane may go either way
+static const double BoundaryTolerance = 1e-4;
+
+struct Matrix
+{
+	float m[16];
+};
+
+static Matrix Multiply(const Matrix& a, const Matrix& b)
+{
+	Matrix result;
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			result.m[i * 4 + j] = a.m[i * 4] * b.m[j] + a.m[i * 4 + 1] * b.m[4 + j] + a.m[i * 4 + 2] * b.m[8 + j] + a.m[i * 4 + 3] * b.m[12 + j];
+		}
+	}
+	return result;
+}
+
+// Camera at the position turned by yaw around Y, looking along +Z before the
+// turn, with a D3D perspective projection, as XMMatrixPerspectiveFovLH
+static Matrix CreateViewProjection(float x, float y, float z, float yaw, float fieldOfView, float aspect)
+{
+	float c = cosf(yaw), s = sinf(yaw);
+
+	// Inverse of the camera transform: translate back, then rotate by -yaw
+	Matrix view = { {
+		c, 0, s, 0,
+		0, 1, 0, 0,
+		-s, 0, c, 0,
+		-(x * c - z * s), -y, -(x * s + z * c), 1
+	} };
+
+	float yScale = 1.0f / tanf(fieldOfView * 0.5f);
+	float range = FarPlane / (FarPlane - NearPlane);
+	Matrix projection = { {
+		yScale / aspect, 0, 0, 0,
+		0, yScale, 0, 0,
+		0, 0, range, 1,
+		0, 0, -range * NearPlane, 0
+	} };
+
+	return Multiply(view, projection);
+}
+
+// Smallest signed distance of the box's furthest corner over all planes,
+// negative when the box is outside
+static double GetMargin(const FrustumCuller& culler, const BoundingBox& box)
+{
+	double margin = 1e30;
+	for (uint32_t p = 0; p < FrustumCuller::PlaneCount; p++)
+	{
+		const float* plane = culler.GetPlane(p);
+		double distance = (double)box.center[0] * plane[0] + (double)box.center[1] * plane[1] + (double)box.center[2] * plane[2] + plane[3];
+		double reach = (double)box.extent[0] * fabs(plane[0]) + (double)box.extent[1] * fabs(plane[1]) + (double)box.extent[2] * fabs(plane[2]);
+		margin = std::min(margin, distance + reach);
+	}
+	return margin;
+}
+
+static std::vector<BoundingBox> CreateBoxes(uint32_t count, float spread, uint32_t seed)
+{
+	std::minstd_rand random(seed);
+	std::uniform_real_distribution<float> position(-spread, spread);
+	std::uniform_real_distribution<float> size(0.05f, 2.0f);
+
+	std::vector<BoundingBox> boxes(count);
+	for (BoundingBox& box : boxes)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			box.center[axis] = position(random);
+			box.extent[axis] = size(random);
+		}
+	}
+	return boxes;
+}
+
+struct BoxStreams
+{
+	std::vector<float> x, y, z, ex, ey, ez;
+
+	explicit BoxStreams(const std::vector<BoundingBox>& boxes)
+	{
+		for (const BoundingBox& box : boxes)
+		{
+			x.push_back(box.center[0]);
+			y.push_back(box.center[1]);
+			z.push_back(box.center[2]);
+			ex.push_back(box.extent[0]);
+			ey.push_back(box.extent[1]);
+			ez.push_back(box.extent[2]);
+		}
+	}
+};
+
+// Visible elements agree with the margin unless they are on a plane
+static bool MatchesMargins(const std::vector<double>& margins, const uint32_t* pVisible, uint32_t visibleCount)
+{
+	std::vector<bool> visible(margins.size(), false);
+	for (uint32_t i = 0; i < visibleCount; i++)
+	{
+		if (pVisible[i] >= margins.size() || visible[pVisible[i]])
+		{
+			return false;
+		}
+		visible[pVisible[i]] = true;
+	}
+	for (size_t i = 0; i < margins.size(); i++)
+	{
+		if (fabs(margins[i]) > BoundaryTolerance && visible[i] != (margins[i] >= 0))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static void TestCuller()
+{
+	// Without a matrix everything is visible
+	FrustumCuller culler;
+	BoundingBox far = { { 1e6f, -1e6f, 1e6f }, { 1, 1, 1 } };
+	uint32_t mask = (1u << FrustumCuller::PlaneCount) - 1;
+	CHECK(culler.TestBox(far, &mask) == FrustumCuller::CULL_INSIDE);
+
+	Matrix viewProj = CreateViewProjection(0, 0, 0, 0, 1.5707963f, 1.0f);
+	culler.SetViewProjection(viewProj.m);
+	bool normalized = true;
+	for (uint32_t p = 0; p < FrustumCuller::PlaneCount; p++)
+	{
+		const float* plane = culler.GetPlane(p);
+		normalized = normalized && fabs(sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]) - 1.0) < 1e-5;
+	}
+	CHECK(normalized);
+
+	// 90 degree frustum along +Z: the near plane at 0.1 and the far one at
+	// 100 bound the depth, x and y are bounded by +-z
+	float centerX[] = { 0, 0, 0, 0, 0, 9, 11, 0 };
+	float centerY[] = { 0, 0, 0, 0, 0, 0, 0, -12 };
+	float centerZ[] = { 5, -1, -1, 101, 101, 10, 10, 10 };
+	float radius[] = { 0.5f, 0.5f, 1.5f, 0.5f, 1.5f, 0.5f, 0.5f, 1.0f };
+	uint32_t visible[8];
+	uint32_t count = culler.CullSpheres(centerX, centerY, centerZ, radius, 8, visible);
+	CHECK(count == 4);
+	CHECK(count == 4 && visible[0] == 0 && visible[1] == 2 && visible[2] == 4 && visible[3] == 5);
+
+	// Classification and the mask of planes a box is fully inside
+	BoundingBox inside = { { 0, 0, 10 }, { 1, 1, 1 } };
+	mask = (1u << FrustumCuller::PlaneCount) - 1;
+	CHECK(culler.TestBox(inside, &mask) == FrustumCuller::CULL_INSIDE);
+	CHECK(mask == 0);
+
+	BoundingBox straddling = { { 0, 0, 100 }, { 1, 1, 1 } };
+	mask = (1u << FrustumCuller::PlaneCount) - 1;
+	CHECK(culler.TestBox(straddling, &mask) == FrustumCuller::CULL_INTERSECT);
+	CHECK(mask == 1u << 5);
+
+	BoundingBox behind = { { 0, 0, -5 }, { 1, 1, 1 } };
+	mask = (1u << FrustumCuller::PlaneCount) - 1;
+	CHECK(culler.TestBox(behind, &mask) == FrustumCuller::CULL_OUTSIDE);
+
+	// Planes cleared from the mask are not tested again, the box is only
+	// in front of the near plane
+	BoundingBox nearOnly = { { 0, 0, 0.05f }, { 0.01f, 0.01f, 0.01f } };
+	mask = (1u << FrustumCuller::PlaneCount) - 1;
+	CHECK(culler.TestBox(nearOnly, &mask) == FrustumCuller::CULL_OUTSIDE);
+	mask = (1u << FrustumCuller::PlaneCount) - 1 - (1u << 4);
+	CHECK(culler.TestBox(nearOnly, &mask) == FrustumCuller::CULL_INSIDE);
+
+	// Random boxes and spheres from a turned camera against the margins, the
+	// counts leave a tail after the SSE blocks
+	Matrix turned = CreateViewProjection(3, 1, -4, 0.7f, 1.0f, 16.0f / 9.0f);
+	culler.SetViewProjection(turned.m);
+	std::vector<BoundingBox> boxes = CreateBoxes(1003, 30.0f, 1);
+	BoxStreams streams(boxes);
+	std::vector<double> boxMargins;
+	std::vector<double> sphereMargins;
+	for (const BoundingBox& box : boxes)
+	{
+		boxMargins.push_back(GetMargin(culler, box));
+
+		BoundingBox point = { { box.center[0], box.center[1], box.center[2] }, { 0, 0, 0 } };
+		sphereMargins.push_back(GetMargin(culler, point) + box.extent[0]);
+	}
+
+	std::vector<uint32_t> visibleBoxes(boxes.size());
+	uint32_t boxCount = culler.CullBoxes(streams.x.data(), streams.y.data(), streams.z.data(), streams.ex.data(),
+		streams.ey.data(), streams.ez.data(), (uint32_t)boxes.size(), visibleBoxes.data());
+	CHECK(MatchesMargins(boxMargins, visibleBoxes.data(), boxCount));
+	CHECK(boxCount > 0 && boxCount < boxes.size());
+	CHECK(std::is_sorted(visibleBoxes.begin(), visibleBoxes.begin() + boxCount));
+
+	uint32_t sphereCount = culler.CullSpheres(streams.x.data(), streams.y.data(), streams.z.data(), streams.ex.data(),
+		(uint32_t)boxes.size(), visibleBoxes.data());
+	CHECK(MatchesMargins(sphereMargins, visibleBoxes.data(), sphereCount));
+	CHECK(sphereCount > 0 && sphereCount < boxes.size());
+}
+
+static void TestHierarchy()
+{
+	BoundingVolumeHierarchy empty;
+	empty.Build(nullptr, 0);
+	FrustumCuller culler;
+	std::vector<uint32_t> visible;
+	CHECK(empty.Cull(culler, visible) == 0);
+	CHECK(empty.GetNodeCount() == 0);
+
+	std::vector<BoundingBox> boxes = CreateBoxes(5000, 60.0f, 2);
+	BoxStreams streams(boxes);
+	std::vector<uint32_t> bruteForce(boxes.size());
+
+	std::minstd_rand random(3);
+	std::uniform_real_distribution<float> position(-40.0f, 40.0f);
+	std::uniform_real_distribution<float> yaw(-3.14159265f, 3.14159265f);
+	for (uint32_t leafSize : { 1u, 4u, 16u, 64u })
+	{
+		BoundingVolumeHierarchy hierarchy;
+		hierarchy.Build(boxes.data(), (uint32_t)boxes.size(), leafSize);
+		CHECK(hierarchy.GetNodeCount() >= 2 * ((uint32_t)boxes.size() / leafSize) - 1);
+		CHECK(hierarchy.GetNodeCount() < 4 * ((uint32_t)boxes.size() / leafSize + 1));
+
+		// Culling through the tree finds what testing every box finds
+		bool matches = true;
+		for (int camera = 0; camera < 20; camera++)
+		{
+			Matrix viewProj = CreateViewProjection(position(random), position(random) * 0.25f, position(random), yaw(random), 1.0f, 1.5f);
+			culler.SetViewProjection(viewProj.m);
+
+			visible.assign(1, 0xFFFFFFFFu);
+			uint32_t count = hierarchy.Cull(culler, visible);
+			matches = matches && count == visible.size() - 1 && visible[0] == 0xFFFFFFFFu;
+			visible.erase(visible.begin());
+			std::sort(visible.begin(), visible.end());
+
+			uint32_t expected = culler.CullBoxes(streams.x.data(), streams.y.data(), streams.z.data(), streams.ex.data(),
+				streams.ey.data(), streams.ez.data(), (uint32_t)boxes.size(), bruteForce.data());
+			matches = matches && std::equal(visible.begin(), visible.end(), bruteForce.begin(), bruteForce.begin() + expected)
+				&& visible.size() == expected;
+		}
+		CHECK(matches);
+	}
+}
+
+void TestFrustumCuller()
+{
+	TestCuller();
+	TestHierarchy();
+}
+
+void BenchmarkFrustumCuller(double seconds)
+{
+	Matrix viewProj = CreateViewProjection(0, 0, 0, 0.3f, 1.0f, 16.0f / 9.0f);
+	FrustumCuller culler;
+	culler.SetViewProjection(viewProj.m);
+
+	printf("%-10s %10s %14s %14s %14s\n", "boxes", "visible", "SSE (M/s)", "scalar (M/s)", "BVH (M/s)");
+	for (uint32_t count : BenchmarkCounts)
+	{
+		// About a tenth of the boxes in view
+		std::vector<BoundingBox> boxes = CreateBoxes(count, 150.0f, 1);
+		BoxStreams streams(boxes);
+		std::vector<uint32_t> visible(count);
+		BoundingVolumeHierarchy hierarchy;
+		hierarchy.Build(boxes.data(), count);
+		std::vector<uint32_t> treeVisible;
+		treeVisible.reserve(count);
+
+		uint32_t visibleCount = 0;
+		double simdMs = TimeWork(seconds / 3, [&]()
+		{
+			visibleCount = culler.CullBoxes(streams.x.data(), streams.y.data(), streams.z.data(), streams.ex.data(),
+				streams.ey.data(), streams.ez.data(), count, visible.data());
+		});
+		double scalarMs = TimeWork(seconds / 3, [&]()
+		{
+			uint32_t scalarCount = 0;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				uint32_t mask = (1u << FrustumCuller::PlaneCount) - 1;
+				visible[scalarCount] = i;
+				scalarCount += culler.TestBox(boxes[i], &mask) != FrustumCuller::CULL_OUTSIDE ? 1 : 0;
+			}
+		});
+		double treeMs = TimeWork(seconds / 3, [&]()
+		{
+			treeVisible.clear();
+			hierarchy.Cull(culler, treeVisible);
+		});
+
+		printf("%-10u %10u %14.1f %14.1f %14.1f\n", count, visibleCount, count / (simdMs * 1000.0), count / (scalarMs * 1000.0),
+			count / (treeMs * 1000.0));
+	}
+}
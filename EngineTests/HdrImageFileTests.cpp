@@ -0,0 +1,329 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "HdrImageFile.h"
+#include "TestFramework.h"
+
+static const char* const PfmFile = "EngineTests_Image.pfm";
+static const char* const RgbeFile = "EngineTests_Image.hdr";
+static const char* const ExrFile = "EngineTests_Image.exr";
+static const char* const BrokenFile = "EngineTests_Broken.bin";
+static const char* const MissingFile = "EngineTests_Missing.hdr";
+
+static std::string ReadTestFile(const char* path)
+{
+	FILE* pFile = NULL;
+#ifdef _MSC_VER
+	fopen_s(&pFile, path, "rb");
+#else
+	pFile = fopen(path, "rb");
+#endif
+	std::string data;
+	if (pFile != NULL)
+	{
+		char chunk[4096];
+		size_t size;
+		while ((size = fread(chunk, 1, sizeof(chunk), pFile)) > 0)
+		{
+			data.append(chunk, size);
+		}
+		fclose(pFile);
+	}
+	return data;
+}
+
+// Replaces the only occurrence of from
+static std::string Replace(const std::string& data, const std::string& from, const std::string& to)
+{
+	size_t pos = data.find(from);
+	if (pos == std::string::npos || data.find(from, pos + 1) != std::string::npos)
+	{
+		CHECK(!"replaced data is not unique");
+		return data;
+	}
+	return data.substr(0, pos) + to + data.substr(pos + from.size());
+}
+
+// The data window attribute of a 2 by 2 EXR image, xMax and yMax at 29 and 33
+static const std::string ExrWindow("dataWindow\0box2i\0\x10\0\0\0\0\0\0\0\0\0\0\0\1\0\0\0\1\0\0\0", 37);
+
+static std::string ResizeExrWindow(const std::string& exr, uint32_t xMax, uint32_t yMax)
+{
+	std::string window = ExrWindow;
+	memcpy(&window[29], &xMax, sizeof(xMax));
+	memcpy(&window[33], &yMax, sizeof(yMax));
+	return Replace(exr, ExrWindow, window);
+}
+
+// Open or reading all rows fails with exactly the given message
+static bool Fails(const std::string& data, const char* pError)
+{
+	if (!WriteTestFile(BrokenFile, data))
+	{
+		return false;
+	}
+	HdrImageReader reader;
+	bool read = reader.Open(BrokenFile);
+	if (read)
+	{
+		std::vector<float> rgb((size_t)reader.GetWidth() * reader.GetHeight() * 3);
+		read = reader.ReadRows(reader.GetHeight(), rgb.data());
+	}
+	return !read && strcmp(reader.GetErrorMessage(), pError) == 0;
+}
+
+// Positive values with runs of equal pixels, so that encoded Radiance rows
+// have runs and literals
+static std::vector<float> CreatePixels(uint32_t width, uint32_t height)
+{
+	std::vector<float> rgb((size_t)width * height * 3);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				float value = x % 9 < 5 ? 1.5f : 0.01f * (x + 1);
+				rgb[((size_t)y * width + x) * 3 + j] = value * (y + 1) + 0.25f * j;
+			}
+		}
+	}
+	return rgb;
+}
+
+static bool WriteImage(const char* path, uint32_t width, uint32_t height, const std::vector<float>& rgb)
+{
+	// Chunks of 3 rows, the last one shorter
+	HdrImageWriter writer;
+	bool written = writer.Open(path, width, height);
+	for (uint32_t y = 0; written && y < height; y += 3)
+	{
+		written = writer.WriteRows(std::min(3u, height - y), rgb.data() + (size_t)y * width * 3);
+	}
+	return writer.Close() && written;
+}
+
+// RGBE keeps 8 bits of mantissa relative to the largest component
+static bool MatchesPixels(const std::vector<float>& expected, const std::vector<float>& rgb, bool rgbe)
+{
+	bool matches = expected.size() == rgb.size();
+	for (size_t i = 0; matches && i < rgb.size(); i += 3)
+	{
+		float maxValue = std::max(expected[i], std::max(expected[i + 1], expected[i + 2]));
+		for (size_t j = 0; j < 3; j++)
+		{
+			matches = matches && (rgbe ? fabsf(rgb[i + j] - expected[i + j]) <= maxValue / 64 : rgb[i + j] == expected[i + j]);
+		}
+	}
+	return matches;
+}
+
+static void TestRoundTrip()
+{
+	// Radiance rows are flat below 8 pixels and encoded from there
+	const char* const paths[] = { PfmFile, RgbeFile, ExrFile };
+	const HdrImageFormat formats[] = { HDR_IMAGE_PFM, HDR_IMAGE_RGBE, HDR_IMAGE_EXR };
+	const uint32_t widths[] = { 5, 37 };
+	const uint32_t height = 7;
+	for (int f = 0; f < 3; f++)
+	{
+		for (uint32_t width : widths)
+		{
+			std::vector<float> expected = CreatePixels(width, height);
+			CHECK(WriteImage(paths[f], width, height, expected));
+
+			// Chunks of 2 rows, then the first row again after a rewind
+			HdrImageReader reader;
+			CHECK(reader.Open(paths[f]));
+			CHECK(reader.GetFormat() == formats[f] && reader.GetWidth() == width && reader.GetHeight() == height);
+			std::vector<float> rgb(expected.size());
+			bool read = true;
+			for (uint32_t y = 0; read && y < height; y += 2)
+			{
+				read = reader.ReadRows(std::min(2u, height - y), rgb.data() + (size_t)y * width * 3);
+			}
+			CHECK(read && reader.GetRow() == height);
+			CHECK(MatchesPixels(expected, rgb, formats[f] == HDR_IMAGE_RGBE));
+
+			CHECK(!reader.ReadRows(1, rgb.data()));
+			CHECK(strcmp(reader.GetErrorMessage(), "reading past the last row") == 0);
+
+			std::vector<float> firstRow(rgb.begin(), rgb.begin() + width * 3);
+			CHECK(reader.Rewind() && reader.GetRow() == 0);
+			CHECK(reader.ReadRows(1, rgb.data()) && std::equal(firstRow.begin(), firstRow.end(), rgb.begin()));
+			reader.Close();
+			remove(paths[f]);
+		}
+	}
+
+	HdrImageWriter writer;
+	CHECK(!writer.Open("EngineTests_Image.png", 4, 4));
+	CHECK(strcmp(writer.GetErrorMessage(), "unknown file extension") == 0);
+	CHECK(!writer.Open(PfmFile, 0x1000000, 1));
+	CHECK(strcmp(writer.GetErrorMessage(), "invalid image size") == 0);
+
+	std::vector<float> rgb = CreatePixels(4, 2);
+	CHECK(writer.Open(PfmFile, 4, 2) && writer.WriteRows(1, rgb.data()));
+	CHECK(!writer.WriteRows(2, rgb.data()));
+	CHECK(strcmp(writer.GetErrorMessage(), "writing past the last row") == 0);
+	CHECK(!writer.Close());
+	CHECK(strcmp(writer.GetErrorMessage(), "rows are missing") == 0);
+	remove(PfmFile);
+}
+
+static void TestTruncated()
+{
+	std::vector<float> rgb = CreatePixels(5, 7);
+	CHECK(WriteImage(PfmFile, 5, 7, rgb) && WriteImage(RgbeFile, 5, 7, rgb) && WriteImage(ExrFile, 5, 7, rgb));
+	std::string pfm = ReadTestFile(PfmFile);
+	std::string rgbe = ReadTestFile(RgbeFile);
+	std::string exr = ReadTestFile(ExrFile);
+	remove(PfmFile);
+	remove(RgbeFile);
+	remove(ExrFile);
+
+	CHECK(Fails("", "unknown file format"));
+	CHECK(Fails("PF", "unknown file format"));
+	CHECK(Fails(pfm.substr(0, 6), "invalid PFM header"));
+	CHECK(Fails(rgbe.substr(0, 20), "invalid Radiance header"));
+	CHECK(Fails(exr.substr(0, 40), "invalid EXR header"));
+
+	// Short data is found by Open, before any row is read
+	CHECK(Fails(pfm.substr(0, pfm.size() - 1), "truncated PFM data"));
+	CHECK(Fails(rgbe.substr(0, rgbe.size() - 1), "truncated Radiance data"));
+	CHECK(Fails(exr.substr(0, exr.size() - 1), "truncated EXR data"));
+
+	// Encoded rows are longer than the minimum Open checks, the last one
+	// fails in a literal or before the value of a run
+	std::vector<float> wide = CreatePixels(37, 7);
+	CHECK(WriteImage(RgbeFile, 37, 7, wide));
+	std::string encoded = ReadTestFile(RgbeFile);
+	remove(RgbeFile);
+	CHECK(Fails(encoded.substr(0, encoded.size() - 1), "truncated Radiance data"));
+	CHECK(Fails(encoded.substr(0, encoded.size() - 2), "invalid Radiance run"));
+}
+
+static void TestHeaders()
+{
+	HdrImageReader reader;
+	CHECK(!reader.Open(MissingFile));
+	CHECK(strcmp(reader.GetErrorMessage(), "can not open the file") == 0);
+
+	std::string pixels(4 * 3 * 4, 0);
+	CHECK(Fails("PX\n2 2\n-1\n" + pixels, "unknown file format"));
+	CHECK(Fails("PF\n2 2\n0\n" + pixels, "invalid PFM header"));
+	CHECK(Fails("PF\n2 x\n-1\n" + pixels, "invalid PFM header"));
+	CHECK(Fails("PF\n2 2 \n-1.0x\n" + pixels, "invalid PFM header"));
+	CHECK(Fails("PF\n16777216 1\n-1\n" + pixels, "invalid PFM header"));
+	CHECK(Fails("PF\n0 2\n-1\n" + pixels, "empty image"));
+
+	std::string header = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n";
+	CHECK(Fails("#?RADIANCE\nFORMAT=32-bit_rle_xyze\n\n-Y 2 +X 2\n" + pixels, "unsupported Radiance pixel format"));
+	CHECK(Fails(header + "+Y 2 +X 2\n" + pixels, "unsupported Radiance orientation, -Y +X is required"));
+	CHECK(Fails(header + "-Y 2 +X 2 x\n" + pixels, "unsupported Radiance orientation, -Y +X is required"));
+	CHECK(Fails(header + "-Y 16777216 +X 1\n" + pixels, "invalid Radiance resolution"));
+	CHECK(Fails(header + "-Y 0 +X 2\n" + pixels, "empty image"));
+
+	std::vector<float> rgb = CreatePixels(2, 2);
+	CHECK(WriteImage(ExrFile, 2, 2, rgb));
+	std::string exr = ReadTestFile(ExrFile);
+	remove(ExrFile);
+
+	std::string version = exr;
+	version[4] = 1;
+	CHECK(Fails(version, "unsupported EXR version"));
+	version[4] = 2;
+	version[5] = 2;
+	CHECK(Fails(version, "tiled, deep and multi part EXR files are not supported"));
+
+	std::string compression("compression\0compression\0\1\0\0\0\0", 29);
+	CHECK(Fails(Replace(exr, compression, compression.substr(0, 28) + "\3"), "compressed EXR files are not supported"));
+	CHECK(Fails(Replace(exr, std::string("R\0\2\0\0\0", 6), std::string("R\0\7\0\0\0", 6)), "invalid EXR pixel type"));
+	std::string noColor = Replace(exr, std::string("R\0\2", 3), std::string("X\0\2", 3));
+	noColor = Replace(noColor, std::string("G\0\2", 3), std::string("X\0\2", 3));
+	noColor = Replace(noColor, std::string("B\0\2", 3), std::string("X\0\2", 3));
+	CHECK(Fails(noColor, "EXR file has no R, G, B or Y channel"));
+
+	CHECK(Fails(ResizeExrWindow(exr, 0xFFFFFFFF, 1), "invalid EXR header"));
+	CHECK(Fails(ResizeExrWindow(exr, 1, 0x1000000), "invalid EXR header"));
+}
+
+// Hand encoded Radiance rows of 8 pixels, padded to the smallest size an
+// encoded image of that height can have
+static std::string CreateRgbe(const std::string& rows, uint32_t height)
+{
+	char resolution[64];
+	snprintf(resolution, sizeof(resolution), "-Y %u +X 8\n", height);
+	std::string padded = rows;
+	padded.resize(std::max<size_t>(rows.size(), 12 * height), 0);
+	return std::string("#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n") + resolution + padded;
+}
+
+static void TestRuns()
+{
+	// A run of 8 for each component, then 8 literals of each
+	std::string runs("\2\2\0\x08\x88\x80\x88\x40\x88\x20\x88\x81", 12);
+	std::string literals("\2\2\0\x08", 4);
+	for (int j = 0; j < 4; j++)
+	{
+		literals += '\x08';
+		for (int x = 0; x < 8; x++)
+		{
+			literals += (char)(j == 3 ? 0x81 : 0x10 * j + x);
+		}
+	}
+	CHECK(WriteTestFile(RgbeFile, CreateRgbe(runs + literals, 2)));
+	HdrImageReader reader;
+	float rgb[2 * 8 * 3];
+	CHECK(reader.Open(RgbeFile) && reader.ReadRows(2, rgb));
+	// Mantissas are centered in their step, exponent 129 scales by 1 / 128
+	CHECK(rgb[0] == 128.5f / 128 && rgb[1] == 64.5f / 128 && rgb[2] == 32.5f / 128 && rgb[7 * 3] == rgb[0]);
+	CHECK(rgb[8 * 3] == 0.5f / 128 && rgb[8 * 3 + 1] == 16.5f / 128 && rgb[15 * 3 + 2] == 39.5f / 128);
+	reader.Close();
+	remove(RgbeFile);
+
+	// Runs and literals past the end of the row
+	CHECK(Fails(CreateRgbe(std::string("\2\2\0\x08\x89\x80", 6), 1), "invalid Radiance run"));
+	CHECK(Fails(CreateRgbe(std::string("\2\2\0\x08\x85\x80\x84\x80", 8), 1), "invalid Radiance run"));
+	CHECK(Fails(CreateRgbe(std::string("\2\2\0\x08\x09", 5) + std::string(9, 1), 1), "invalid Radiance run"));
+	CHECK(Fails(CreateRgbe(std::string("\2\2\0\x08\x00", 5), 1), "invalid Radiance run"));
+	CHECK(Fails(CreateRgbe(std::string("\2\2\0\x09", 4), 1), "Radiance scanline width mismatch"));
+	CHECK(Fails(CreateRgbe(std::string("\1\1\1\x08", 4), 1), "old style Radiance run length encoding is not supported"));
+}
+
+// Headers asking for far more pixels than the file holds fail in Open, so
+// that nothing is allocated for them
+static void TestLimits()
+{
+	std::string pixels(256, 0);
+	CHECK(Fails("PF\n15000000 23\n-1\n" + pixels, "truncated PFM data"));
+	CHECK(Fails("Pf\n16777215 16777215\n-1\n" + pixels, "truncated PFM data"));
+	CHECK(Fails("#?RADIANCE\n\n-Y 23 +X 15000000\n" + pixels, "truncated Radiance data"));
+	CHECK(Fails("#?RADIANCE\n\n-Y 16777215 +X 1000\n" + pixels, "truncated Radiance data"));
+
+	std::vector<float> rgb = CreatePixels(2, 2);
+	CHECK(WriteImage(ExrFile, 2, 2, rgb));
+	std::string exr = ReadTestFile(ExrFile);
+	remove(ExrFile);
+	CHECK(Fails(ResizeExrWindow(exr, 15000000 - 1, 23 - 1), "truncated EXR data"));
+
+	// The largest image the file holds still opens
+	CHECK(WriteTestFile(BrokenFile, "PF\n4 5\n-1\n" + std::string(4 * 5 * 3 * 4, 0)));
+	HdrImageReader reader;
+	CHECK(reader.Open(BrokenFile) && reader.GetWidth() == 4 && reader.GetHeight() == 5);
+	reader.Close();
+	remove(BrokenFile);
+}
+
+void TestHdrImageFile()
+{
+	TestRoundTrip();
+	TestTruncated();
+	TestHeaders();
+	TestRuns();
+	TestLimits();
+	remove(BrokenFile);
+}
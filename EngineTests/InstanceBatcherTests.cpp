@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <vector>
+#include "InstanceBatcher.h"
+#include "TestFramework.h"
+
+static const uint32_t MeshCount = 7;
+static const uint32_t BenchmarkCounts[] = { 1024, 16384, 262144 };
+
+struct SourceInstance
+{
+	float world[16];
+	uint32_t mesh;
+	uint32_t material;
+	uint32_t lights[MaxInstanceLights];
+	bool hasLights;
+};
+
+static std::vector<SourceInstance> CreateInstances(uint32_t count, uint32_t meshCount, uint32_t seed)
+{
+	std::minstd_rand random(seed);
+	std::uniform_real_distribution<float> value(-10.0f, 10.0f);
+
+	std::vector<SourceInstance> instances(count);
+	for (SourceInstance& instance : instances)
+	{
+		for (float& element : instance.world)
+		{
+			element = value(random);
+		}
+		instance.world[3] = instance.world[7] = instance.world[11] = 0.0f;
+		instance.world[15] = 1.0f;
+		instance.mesh = (uint32_t)(random() % meshCount);
+		instance.material = (uint32_t)(random() % 8);
+		for (uint32_t& light : instance.lights)
+		{
+			light = (uint32_t)(random() % 1000);
+		}
+		instance.hasLights = random() % 2 == 0;
+	}
+	return instances;
+}
+
+static void AddInstances(InstanceBatcher& batcher, const std::vector<SourceInstance>& instances)
+{
+	batcher.Clear();
+	for (const SourceInstance& instance : instances)
+	{
+		batcher.Add(instance.world, instance.mesh, instance.material, instance.hasLights ? instance.lights : nullptr);
+	}
+}
+
+// Stable grouping by mesh and a scalar transpose, what Build() has to produce
+static void BuildReference(const std::vector<SourceInstance>& instances, uint32_t meshCount, std::vector<InstanceData>& out)
+{
+	out.clear();
+	for (uint32_t mesh = 0; mesh < meshCount; mesh++)
+	{
+		for (const SourceInstance& instance : instances)
+		{
+			if (instance.mesh != mesh)
+			{
+				continue;
+			}
+
+			InstanceData data;
+			for (int row = 0; row < 3; row++)
+			{
+				for (int column = 0; column < 4; column++)
+				{
+					data.world[row][column] = instance.world[column * 4 + row];
+				}
+			}
+			data.material = instance.material;
+			for (uint32_t i = 0; i < MaxInstanceLights; i++)
+			{
+				data.lights[i] = instance.hasLights ? instance.lights[i] : 0xFFFFFFFFu;
+			}
+			out.push_back(data);
+		}
+	}
+}
+
+void TestInstanceBatcher()
+{
+	InstanceBatcher batcher;
+	batcher.Init(MeshCount, 1);
+
+	// Nothing added, nothing drawn
+	batcher.Build(nullptr);
+	CHECK(batcher.GetInstanceCount() == 0);
+	CHECK(batcher.GetBatches().empty());
+
+	// Mesh 3 gets no instances and no batch
+	std::vector<SourceInstance> instances = CreateInstances(1000, MeshCount, 1);
+	for (SourceInstance& instance : instances)
+	{
+		instance.mesh = instance.mesh == 3 ? 4 : instance.mesh;
+	}
+	AddInstances(batcher, instances);
+	CHECK(batcher.GetInstanceCount() == 1000);
+
+	std::vector<InstanceData> stream(instances.size());
+	batcher.Build(stream.data());
+	std::vector<InstanceData> reference;
+	BuildReference(instances, MeshCount, reference);
+	CHECK(memcmp(stream.data(), reference.data(), stream.size() * sizeof(InstanceData)) == 0);
+
+	// Batches follow mesh order and tile the stream
+	const std::vector<InstanceBatch>& batches = batcher.GetBatches();
+	CHECK(batches.size() == MeshCount - 1);
+	uint32_t first = 0;
+	bool tiled = true;
+	for (size_t i = 0; i < batches.size(); i++)
+	{
+		uint32_t expected = 0;
+		for (const SourceInstance& instance : instances)
+		{
+			expected += instance.mesh == batches[i].mesh ? 1 : 0;
+		}
+		tiled = tiled && batches[i].mesh != 3 && batches[i].firstInstance == first && batches[i].instanceCount == expected;
+		tiled = tiled && (i == 0 || batches[i - 1].mesh < batches[i].mesh);
+		first += batches[i].instanceCount;
+	}
+	CHECK(tiled);
+	CHECK(first == 1000);
+
+	// Clear() starts the next frame from nothing
+	std::vector<SourceInstance> single = CreateInstances(1, MeshCount, 2);
+	AddInstances(batcher, single);
+	batcher.Build(stream.data());
+	CHECK(batcher.GetBatches().size() == 1 && batcher.GetBatches()[0].mesh == single[0].mesh
+		&& batcher.GetBatches()[0].firstInstance == 0 && batcher.GetBatches()[0].instanceCount == 1);
+
+	// Enough instances for the threaded path give the same stream
+	std::vector<SourceInstance> many = CreateInstances(100000, MeshCount, 3);
+	InstanceBatcher threaded;
+	threaded.Init(MeshCount, 4);
+	AddInstances(threaded, many);
+	stream.resize(many.size());
+	threaded.Build(stream.data());
+	BuildReference(many, MeshCount, reference);
+	CHECK(memcmp(stream.data(), reference.data(), stream.size() * sizeof(InstanceData)) == 0);
+}
+
+void BenchmarkInstanceBatcher(double seconds)
+{
+	printf("%-10s %16s %16s %16s\n", "instances", "add (M/s)", "build 1T (M/s)", "build all (M/s)");
+	for (uint32_t count : BenchmarkCounts)
+	{
+		std::vector<SourceInstance> instances = CreateInstances(count, MeshCount, 1);
+		std::vector<InstanceData> stream(count);
+
+		InstanceBatcher single;
+		single.Init(MeshCount, 1);
+		InstanceBatcher parallel;
+		parallel.Init(MeshCount, 0);
+		AddInstances(parallel, instances);
+
+		double addMs = TimeWork(seconds / 3, [&]() { AddInstances(single, instances); });
+		double singleMs = TimeWork(seconds / 3, [&]() { single.Build(stream.data()); });
+		double parallelMs = TimeWork(seconds / 3, [&]() { parallel.Build(stream.data()); });
+
+		printf("%-10u %16.1f %16.1f %16.1f\n", count, count / (addMs * 1000.0), count / (singleMs * 1000.0),
+			count / (parallelMs * 1000.0));
+	}
+}
@@ -0,0 +1,229 @@
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "LightClusterer.h"
+#include "TestFramework.h"
+
+static const uint32_t BenchmarkLightCounts[] = { 256, 2048, 16384 };
+
+// Samples per axis of a cluster when looking for a point inside a light
+static const uint32_t ClusterSamples = 9;
+
+struct TestLights
+{
+	std::vector<float> x, y, z, radius;
+};
+
+struct TestView
+{
+	uint32_t width, height, tileSize, sliceCount;
+	float tanHalfX, tanHalfY, nearZ, farZ;
+};
+
+// Frustum piece of a cluster: tangents of the tile edges and the slice depths
+struct ClusterShape
+{
+	double minTanX, maxTanX, minTanY, maxTanY, nearZ, farZ;
+};
+
+static ClusterShape GetCluster(const TestView& view, uint32_t x, uint32_t y, uint32_t slice)
+{
+	ClusterShape shape;
+	shape.minTanX = (std::min(x * view.tileSize, view.width) / (double)view.width * 2 - 1) * view.tanHalfX;
+	shape.maxTanX = (std::min((x + 1) * view.tileSize, view.width) / (double)view.width * 2 - 1) * view.tanHalfX;
+	shape.maxTanY = (1 - std::min(y * view.tileSize, view.height) / (double)view.height * 2) * view.tanHalfY;
+	shape.minTanY = (1 - std::min((y + 1) * view.tileSize, view.height) / (double)view.height * 2) * view.tanHalfY;
+	shape.nearZ = view.nearZ * pow((double)view.farZ / view.nearZ, (double)slice / view.sliceCount);
+	shape.farZ = view.nearZ * pow((double)view.farZ / view.nearZ, (double)(slice + 1) / view.sliceCount);
+	return shape;
+}
+
+// Squared distance from the light to the box around the cluster's frustum piece
+static double GetBoxDistanceSq(const ClusterShape& c, double x, double y, double z)
+{
+	double minX = std::min(c.minTanX * c.nearZ, c.minTanX * c.farZ), maxX = std::max(c.maxTanX * c.nearZ, c.maxTanX * c.farZ);
+	double minY = std::min(c.minTanY * c.nearZ, c.minTanY * c.farZ), maxY = std::max(c.maxTanY * c.nearZ, c.maxTanY * c.farZ);
+	double dx = std::max(0.0, std::max(minX - x, x - maxX));
+	double dy = std::max(0.0, std::max(minY - y, y - maxY));
+	double dz = std::max(0.0, std::max(c.nearZ - z, z - c.farZ));
+	return dx * dx + dy * dy + dz * dz;
+}
+
+// True if a point of the frustum piece on a grid is well inside the light
+static bool HasPointInside(const ClusterShape& c, double x, double y, double z, double r)
+{
+	for (uint32_t k = 0; k < ClusterSamples; k++)
+	{
+		double depth = c.nearZ + (c.farZ - c.nearZ) * k / (ClusterSamples - 1);
+		for (uint32_t j = 0; j < ClusterSamples; j++)
+		{
+			double py = (c.minTanY + (c.maxTanY - c.minTanY) * j / (ClusterSamples - 1)) * depth;
+			for (uint32_t i = 0; i < ClusterSamples; i++)
+			{
+				double px = (c.minTanX + (c.maxTanX - c.minTanX) * i / (ClusterSamples - 1)) * depth;
+				if ((px - x) * (px - x) + (py - y) * (py - y) + (depth - z) * (depth - z) < r * r * 0.999)
+				{
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+// Lights around the frustum, some crossing the near and far planes or the sides
+static TestLights CreateLights(const TestView& view, uint32_t count, float maxRadius, uint32_t seed)
+{
+	TestLights lights;
+	std::minstd_rand random(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		float z = view.nearZ * 0.5f + unit(random) * (view.farZ * 1.1f - view.nearZ * 0.5f);
+		lights.x.push_back((unit(random) * 2.4f - 1.2f) * view.tanHalfX * z);
+		lights.y.push_back((unit(random) * 2.4f - 1.2f) * view.tanHalfY * z);
+		lights.z.push_back(z);
+		lights.radius.push_back(0.05f + unit(random) * unit(random) * maxRadius);
+	}
+	return lights;
+}
+
+// The lights of each cluster have to include every light with a sampled
+// point of the cluster inside it, and may only hold lights that touch the
+// cluster's box. Returns the number of cluster light pairs.
+static size_t CheckClusters(const TestView& view, const TestLights& lights, uint32_t workerCount)
+{
+	LightClusterer clusterer;
+	clusterer.Init(view.tileSize, view.sliceCount, workerCount);
+	clusterer.SetProjection(view.width, view.height, view.tanHalfX, view.tanHalfY, view.nearZ, view.farZ);
+	uint32_t count = (uint32_t)lights.x.size();
+	clusterer.Bin(lights.x.data(), lights.y.data(), lights.z.data(), lights.radius.data(), count);
+
+	uint32_t tilesX = clusterer.GetTilesX();
+	uint32_t tilesY = clusterer.GetTilesY();
+	CHECK(tilesX == (view.width + view.tileSize - 1) / view.tileSize && tilesY == (view.height + view.tileSize - 1) / view.tileSize);
+	CHECK(clusterer.GetClusterCount() == tilesX * tilesY * view.sliceCount);
+
+	const std::vector<LightClusterer::Range>& ranges = clusterer.GetRanges();
+	const std::vector<uint32_t>& indices = clusterer.GetIndices();
+	bool contiguous = true, sorted = true, conservative = true, bounded = true;
+	uint32_t nextOffset = 0, maxCount = 0;
+	std::vector<bool> binned(count);
+	for (uint32_t slice = 0; slice < view.sliceCount; slice++)
+	{
+		for (uint32_t y = 0; y < tilesY; y++)
+		{
+			for (uint32_t x = 0; x < tilesX; x++)
+			{
+				const LightClusterer::Range& range = ranges[(slice * tilesY + y) * tilesX + x];
+				contiguous = contiguous && range.offset == nextOffset;
+				nextOffset = range.offset + range.count;
+				maxCount = std::max(maxCount, range.count);
+
+				std::fill(binned.begin(), binned.end(), false);
+				for (uint32_t i = range.offset; i < range.offset + range.count && i < indices.size(); i++)
+				{
+					sorted = sorted && (i == range.offset || indices[i - 1] < indices[i]);
+					binned[indices[i]] = true;
+				}
+
+				ClusterShape shape = GetCluster(view, x, y, slice);
+				for (uint32_t light = 0; light < count; light++)
+				{
+					double r = lights.radius[light];
+					double distanceSq = GetBoxDistanceSq(shape, lights.x[light], lights.y[light], lights.z[light]);
+					if (binned[light])
+					{
+						bounded = bounded && distanceSq <= r * r * 1.0001 + 1e-6;
+					}
+					else if (distanceSq < r * r)
+					{
+						conservative = conservative && !HasPointInside(shape, lights.x[light], lights.y[light], lights.z[light], r);
+					}
+				}
+			}
+		}
+	}
+	CHECK(contiguous && nextOffset == indices.size());
+	CHECK(sorted);
+	CHECK(conservative);
+	CHECK(bounded);
+	CHECK(clusterer.GetMaxClusterLights() == maxCount);
+
+	// The shader finds the slice of a depth from the scale and bias
+	bool slices = true;
+	for (uint32_t slice = 0; slice < view.sliceCount; slice++)
+	{
+		ClusterShape shape = GetCluster(view, 0, 0, slice);
+		float middle = (float)sqrt(shape.nearZ * shape.farZ);
+		slices = slices && floorf(logf(middle) * clusterer.GetSliceScale() + clusterer.GetSliceBias()) == (float)slice;
+	}
+	CHECK(slices);
+
+	// Any worker count gives the same list
+	LightClusterer serial;
+	serial.Init(view.tileSize, view.sliceCount, 1);
+	serial.SetProjection(view.width, view.height, view.tanHalfX, view.tanHalfY, view.nearZ, view.farZ);
+	serial.Bin(lights.x.data(), lights.y.data(), lights.z.data(), lights.radius.data(), count);
+	bool same = serial.GetIndices() == indices;
+	for (size_t c = 0; c < ranges.size() && same; c++)
+	{
+		same = serial.GetRanges()[c].offset == ranges[c].offset && serial.GetRanges()[c].count == ranges[c].count;
+	}
+	CHECK(same);
+
+	return indices.size();
+}
+
+void TestLightClusterer()
+{
+	// Tiles cut by the screen edge, wide and narrow views, one slice
+	TestView wide = { 1280, 720, 64, 16, 1.0f, 0.5625f, 0.5f, 200.0f };
+	CHECK(CheckClusters(wide, CreateLights(wide, 300, 20.0f, 1), 8) > 1000);
+	TestView narrow = { 333, 517, 32, 24, 0.3f, 0.47f, 0.1f, 50.0f };
+	CHECK(CheckClusters(narrow, CreateLights(narrow, 200, 4.0f, 2), 3) > 1000);
+	TestView single = { 256, 256, 64, 1, 1.0f, 1.0f, 1.0f, 10.0f };
+	CHECK(CheckClusters(single, CreateLights(single, 50, 2.0f, 3), 0) > 10);
+
+	// Lights in front of the near plane or past the far plane are in no cluster
+	LightClusterer clusterer;
+	clusterer.Init(64, 16, 1);
+	clusterer.SetProjection(wide.width, wide.height, wide.tanHalfX, wide.tanHalfY, wide.nearZ, wide.farZ);
+	const float x[2] = { 0, 0 }, y[2] = { 0, 0 }, z[2] = { 0.2f, 300.0f }, radius[2] = { 0.25f, 50.0f };
+	clusterer.Bin(x, y, z, radius, 2);
+	CHECK(clusterer.GetIndices().empty() && clusterer.GetMaxClusterLights() == 0);
+
+	// Destroyed lights of LightManager have radius 0 and reach no cluster
+	const float z3[3] = { 10, 10, 10 }, radius3[3] = { 0, 1, 0 };
+	clusterer.Bin(x, y, z3, radius3, 3);
+	const std::vector<uint32_t>& indices = clusterer.GetIndices();
+	CHECK(!indices.empty() && (size_t)std::count(indices.begin(), indices.end(), 1u) == indices.size());
+}
+
+void BenchmarkLightClusterer(double seconds)
+{
+	TestView view = { 1920, 1080, 64, 24, 1.0f, 0.5625f, 0.5f, 500.0f };
+	printf("%-8s %12s %14s %14s\n", "lights", "pairs", "1 worker (ms)", "all (ms)");
+	for (uint32_t count : BenchmarkLightCounts)
+	{
+		TestLights lights = CreateLights(view, count, 10.0f, 4);
+		LightClusterer serial, parallel;
+		serial.Init(view.tileSize, view.sliceCount, 1);
+		parallel.Init(view.tileSize, view.sliceCount);
+		serial.SetProjection(view.width, view.height, view.tanHalfX, view.tanHalfY, view.nearZ, view.farZ);
+		parallel.SetProjection(view.width, view.height, view.tanHalfX, view.tanHalfY, view.nearZ, view.farZ);
+
+		double serialMs = TimeWork(seconds / 2, [&]()
+		{
+			serial.Bin(lights.x.data(), lights.y.data(), lights.z.data(), lights.radius.data(), count);
+		});
+		double parallelMs = TimeWork(seconds / 2, [&]()
+		{
+			parallel.Bin(lights.x.data(), lights.y.data(), lights.z.data(), lights.radius.data(), count);
+		});
+
+		printf("%-8u %12zu %14.3f %14.3f\n", count, serial.GetIndices().size(), serialMs, parallelMs);
+	}
+}
@@ -0,0 +1,365 @@
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "BuiltinScene.h"
+#include "LightManager.h"
+#include "TestFramework.h"
+
+static const uint32_t BenchmarkLightCounts[] = { 256, 4096, 32768 };
+
+// Largest maxCount Assign() takes
+static const uint32_t MaxAssignCount = 32;
+
+// The test's own copy of the lights, Destroy() clears alive
+struct TestLight
+{
+	bool alive;
+	LightManager::Light light;
+	float setRange;
+};
+
+static float GetRange(const TestLight& test)
+{
+	return test.setRange > 0 ? test.setRange : LightManager::GetDefaultRange(test.light.power, test.light.color);
+}
+
+// Squared distance from the light to the box, as the manager computes it
+static float GetDistanceSq(const LightManager::Light& light, const float* center, const float* extent)
+{
+	float distanceSq = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		float d = fabsf(light.position[i] - center[i]) - extent[i];
+		d = d > 0 ? d : 0.0f;
+		distanceSq += d * d;
+	}
+	return distanceSq;
+}
+
+// Lights overlapping the box, strongest first and ties by handle
+static std::vector<std::pair<float, uint32_t>> GetContributions(const std::vector<TestLight>& lights, const float* center, const float* extent,
+	std::vector<uint32_t>* pOverlapping)
+{
+	std::vector<std::pair<float, uint32_t>> contributions;
+	pOverlapping->clear();
+	for (uint32_t l = 0; l < (uint32_t)lights.size(); l++)
+	{
+		if (!lights[l].alive)
+		{
+			continue;
+		}
+		const LightManager::Light& light = lights[l].light;
+		float range = GetRange(lights[l]);
+		float distanceSq = GetDistanceSq(light, center, extent);
+		if (distanceSq >= range * range)
+		{
+			continue;
+		}
+		pOverlapping->push_back(l);
+
+		float intensity = std::max(light.color[0], std::max(light.color[1], light.color[2]));
+		float weight = light.power * intensity * LightManager::GetAttenuation(sqrtf(distanceSq), range, light.falloff);
+		if (weight > 0)
+		{
+			contributions.push_back(std::make_pair(-weight, l));
+		}
+	}
+	std::sort(contributions.begin(), contributions.end());
+	return contributions;
+}
+
+static void RandomizeLight(LightManager& manager, std::vector<TestLight>& lights, uint32_t l, std::minstd_rand& random)
+{
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	TestLight& test = lights[l];
+	for (int i = 0; i < 3; i++)
+	{
+		test.light.position[i] = (unit(random) * 2 - 1) * 200.0f;
+		test.light.color[i] = unit(random);
+	}
+	test.light.power = 0.1f + unit(random) * unit(random) * 20.0f;
+	test.light.falloff = random() % 2 == 0 ? LightManager::FALLOFF_INVERSE_SQUARE : LightManager::FALLOFF_WINDOWED;
+
+	// Derived ranges, ranges of any level and a few larger than the coarsest cells
+	uint32_t kind = random() % 8;
+	test.setRange = kind < 3 ? 0.0f : kind < 7 ? 0.5f + unit(random) * unit(random) * 40.0f : 300.0f + unit(random) * 500.0f;
+
+	manager.SetPosition(l, test.light.position[0], test.light.position[1], test.light.position[2]);
+	manager.SetColor(l, test.light.color[0], test.light.color[1], test.light.color[2]);
+	manager.SetPower(l, test.light.power);
+	manager.SetRange(l, test.setRange);
+	manager.SetFalloff(l, test.light.falloff);
+}
+
+// Query() returns the overlapping set and Assign() the strongest maxCount
+// of it in order, for boxes from a point to most of the scene
+static void CheckQueries(const LightManager& manager, const std::vector<TestLight>& lights, std::minstd_rand& random,
+	bool* pQueries, bool* pAssigns, uint32_t* pCapped)
+{
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<uint32_t> overlapping, queried;
+	for (int q = 0; q < 40; q++)
+	{
+		float size = q % 4 == 0 ? 0.0f : q % 4 == 3 ? 150.0f : 10.0f;
+		float center[3] = { (unit(random) * 2 - 1) * 220.0f, (unit(random) * 2 - 1) * 220.0f, (unit(random) * 2 - 1) * 220.0f };
+		float extent[3] = { unit(random) * size, unit(random) * size, unit(random) * size };
+
+		std::vector<std::pair<float, uint32_t>> expected = GetContributions(lights, center, extent, &overlapping);
+		queried.clear();
+		manager.Query(center, extent, &queried);
+		std::sort(queried.begin(), queried.end());
+		*pQueries = *pQueries && queried == overlapping;
+
+		// One slot past maxCount checks nothing is written there
+		for (uint32_t maxCount : { 1u, 4u, 8u, MaxAssignCount })
+		{
+			uint32_t assigned[MaxAssignCount + 1];
+			assigned[maxCount] = 12345;
+			uint32_t count = manager.Assign(center, extent, maxCount, assigned);
+			uint32_t expectedCount = std::min(maxCount, (uint32_t)expected.size());
+			bool same = count == expectedCount && assigned[maxCount] == 12345;
+			for (uint32_t i = 0; i < maxCount && same; i++)
+			{
+				same = assigned[i] == (i < expectedCount ? expected[i].second : LightManager::InvalidLight);
+			}
+			*pAssigns = *pAssigns && same;
+			*pCapped += expected.size() > maxCount ? 1 : 0;
+		}
+	}
+}
+
+static void TestAssignment()
+{
+	LightManager manager;
+	manager.Init(4.0f);
+	std::vector<TestLight> lights;
+	std::minstd_rand random(1);
+
+	bool queries = true, assigns = true, ranges = true;
+	uint32_t capped = 0;
+	for (int round = 0; round < 12; round++)
+	{
+		// Lights created, changed and destroyed between updates
+		for (int change = 0; change < 150; change++)
+		{
+			uint32_t action = random() % 8;
+			std::vector<uint32_t> alive;
+			for (uint32_t l = 0; l < (uint32_t)lights.size(); l++)
+			{
+				if (lights[l].alive)
+				{
+					alive.push_back(l);
+				}
+			}
+
+			if (action < 4 || alive.empty())
+			{
+				uint32_t l = manager.Create();
+				if (l >= lights.size())
+				{
+					lights.resize(l + 1);
+				}
+				lights[l].alive = true;
+				RandomizeLight(manager, lights, l, random);
+			}
+			else if (action < 7)
+			{
+				RandomizeLight(manager, lights, alive[random() % alive.size()], random);
+			}
+			else
+			{
+				uint32_t l = alive[random() % alive.size()];
+				manager.Destroy(l);
+				lights[l].alive = false;
+			}
+		}
+		manager.Update();
+
+		for (uint32_t l = 0; l < (uint32_t)lights.size(); l++)
+		{
+			ranges = ranges && (!lights[l].alive || manager.GetRanges()[l] == GetRange(lights[l]));
+		}
+		CheckQueries(manager, lights, random, &queries, &assigns, &capped);
+	}
+	CHECK(ranges);
+	CHECK(queries);
+	CHECK(assigns);
+
+	// The caps have to be hit, including the largest one
+	CHECK(capped > 100);
+	std::vector<uint32_t> overlapping;
+	const float center[3] = { 0, 0, 0 }, extent[3] = { 200, 200, 200 };
+	uint32_t overlappingCount = (uint32_t)GetContributions(lights, center, extent, &overlapping).size();
+	uint32_t assigned[MaxAssignCount];
+	CHECK(overlappingCount > MaxAssignCount && manager.Assign(center, extent, MaxAssignCount, assigned) == MaxAssignCount);
+}
+
+static void TestTies()
+{
+	// Equal lights at equal distance are ordered by handle, whatever their cells
+	LightManager manager;
+	manager.Init(1.0f);
+	uint32_t handles[6];
+	const float positions[6][3] = { { 3, 0, 0 }, { -3, 0, 0 }, { 0, 3, 0 }, { 0, -3, 0 }, { 0, 0, 3 }, { 0, 0, -3 } };
+	for (int i = 0; i < 6; i++)
+	{
+		handles[i] = manager.Create();
+		manager.SetPosition(handles[i], positions[i][0], positions[i][1], positions[i][2]);
+		manager.SetRange(handles[i], 5.0f);
+	}
+	manager.Update();
+
+	const float center[3] = { 0, 0, 0 }, extent[3] = { 0, 0, 0 };
+	uint32_t assigned[8];
+	CHECK(manager.Assign(center, extent, 8, assigned) == 6);
+	CHECK(assigned[0] == 0 && assigned[3] == 3 && assigned[5] == 5 && assigned[6] == LightManager::InvalidLight && assigned[7] == LightManager::InvalidLight);
+	CHECK(manager.Assign(center, extent, 2, assigned) == 2 && assigned[0] == 0 && assigned[1] == 1);
+
+	// Black lights overlap but contribute nothing, so Assign() leaves them out
+	manager.SetColor(handles[0], 0, 0, 0);
+	manager.SetRange(handles[0], 5.0f);
+	manager.SetPower(handles[5], 2.0f);
+	manager.Update();
+	std::vector<uint32_t> queried;
+	manager.Query(center, extent, &queried);
+	CHECK(queried.size() == 6);
+	CHECK(manager.Assign(center, extent, 8, assigned) == 5);
+	CHECK(assigned[0] == handles[5] && assigned[1] == handles[1] && assigned[4] == handles[4] && assigned[5] == LightManager::InvalidLight);
+}
+
+static void TestDestroy()
+{
+	// A destroyed light is gone from queries and assignment right away, and
+	// its slot reaches nothing for code reading the streams by handle
+	LightManager manager;
+	manager.Init(1.0f);
+	uint32_t handles[3];
+	for (int i = 0; i < 3; i++)
+	{
+		handles[i] = manager.Create();
+		manager.SetPosition(handles[i], (float)i, 0, 0);
+	}
+	manager.Update();
+
+	const float center[3] = { 1, 0, 0 }, extent[3] = { 0.5f, 0.5f, 0.5f };
+	uint32_t assigned[4];
+	CHECK(manager.Assign(center, extent, 4, assigned) == 3);
+
+	manager.Destroy(handles[1]);
+	for (int update = 0; update < 2; update++)
+	{
+		std::vector<uint32_t> queried;
+		manager.Query(center, extent, &queried);
+		CHECK(queried.size() == 2 && std::find(queried.begin(), queried.end(), handles[1]) == queried.end());
+		CHECK(manager.Assign(center, extent, 4, assigned) == 2 && assigned[0] != handles[1] && assigned[1] != handles[1]);
+		CHECK(!manager.IsAlive(handles[1]) && manager.GetCount() == 2 && manager.GetCapacity() == 3);
+		CHECK(manager.GetRanges()[handles[1]] == 0 && manager.GetLight(handles[1]).power == 0);
+		manager.Update();
+	}
+
+	// The slot is reused with the defaults of a new light
+	const float white[3] = { 1, 1, 1 };
+	uint32_t light = manager.Create();
+	manager.Update();
+	CHECK(light == handles[1] && manager.GetRanges()[light] == LightManager::GetDefaultRange(1.0f, white));
+	CHECK(manager.Assign(center, extent, 4, assigned) == 3);
+}
+
+static void TestBuiltinScene()
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+	BuiltinScene::MeshRange meshes[BuiltinScene::MESH_COUNT];
+	BuiltinScene::AddMeshes(&vertices, &indices, meshes);
+
+	for (int i = 0; i < BuiltinScene::LIGHT_SETUP_COUNT; i++)
+	{
+		BuiltinScene::LightSetup setup = (BuiltinScene::LightSetup)i;
+		LightManager manager;
+		manager.Init(1.0f);
+		uint32_t switchLight = BuiltinScene::AddLights(&manager, setup);
+		manager.Update();
+		CHECK(manager.GetCount() == BuiltinScene::GetLightCount(setup));
+		CHECK(switchLight < BuiltinScene::RedLightCount);
+
+		// Every mesh is reached by more lights than an instance holds once
+		// there is a field, so object mode has lights to choose from
+		for (const BoundingBox& bounds : { meshes[BuiltinScene::MESH_CUBE].bounds, meshes[BuiltinScene::MESH_PLANE].bounds })
+		{
+			std::vector<uint32_t> queried;
+			manager.Query(bounds.center, bounds.extent, &queried);
+			uint32_t assigned[4];
+			uint32_t count = manager.Assign(bounds.center, bounds.extent, 4, assigned);
+			CHECK(setup == BuiltinScene::LIGHTS_RED ? count <= BuiltinScene::RedLightCount : queried.size() > 4 && count == 4);
+		}
+	}
+}
+
+void TestLightManager()
+{
+	TestAssignment();
+	TestTies();
+	TestDestroy();
+	TestBuiltinScene();
+}
+
+void BenchmarkLightManager(double seconds)
+{
+	printf("%-8s %16s %16s %16s\n", "lights", "Update (ms)", "Assign (us)", "brute (us)");
+	for (uint32_t count : BenchmarkLightCounts)
+	{
+		LightManager manager;
+		manager.Init(4.0f);
+		std::vector<TestLight> lights(count);
+		std::minstd_rand random(2);
+		for (uint32_t l = 0; l < count; l++)
+		{
+			manager.Create();
+			lights[l].alive = true;
+			RandomizeLight(manager, lights, l, random);
+		}
+		manager.Update();
+
+		// A tenth of the lights moving every frame
+		float offset = 0;
+		double updateMs = TimeWork(seconds / 3, [&]()
+		{
+			offset = offset < 8.0f ? offset + 1.0f : 0.0f;
+			for (uint32_t l = 0; l < count; l += 10)
+			{
+				manager.SetPosition(l, lights[l].light.position[0], lights[l].light.position[1] + offset, lights[l].light.position[2]);
+			}
+			manager.Update();
+		});
+
+		// Object sized boxes over the scene
+		std::uniform_real_distribution<float> unit(-200.0f, 200.0f);
+		std::vector<float> centers(256 * 3);
+		for (float& value : centers)
+		{
+			value = unit(random);
+		}
+		const float extent[3] = { 2, 2, 2 };
+		uint32_t assigned[8];
+		double assignMs = TimeWork(seconds / 3, [&]()
+		{
+			for (size_t i = 0; i < centers.size(); i += 3)
+			{
+				manager.Assign(&centers[i], extent, 8, assigned);
+			}
+		});
+
+		std::vector<uint32_t> overlapping;
+		double bruteMs = TimeWork(seconds / 3, [&]()
+		{
+			for (size_t i = 0; i < centers.size(); i += 3)
+			{
+				GetContributions(lights, &centers[i], extent, &overlapping);
+			}
+		});
+
+		printf("%-8u %16.3f %16.3f %16.3f\n", count, updateMs, assignMs * 1000.0 / 256, bruteMs * 1000.0 / 256);
+	}
+}
@@ -0,0 +1,173 @@
+#include <math.h>
+#include <stdio.h>
+#include <random>
+#include <vector>
+#include "LightingKernel.h"
+#include "TestFramework.h"
+
+// Shade() against ShadeReference(), per color channel. The refined Rsqrt()
+// and Rcp() estimates and the reordered sums stay well inside these for
+// every packet width.
+static const float RelativeTolerance = 1e-4f;
+static const float AbsoluteTolerance = 1e-6f;
+
+// Written past the pixels, Shade() must leave it alone
+static const float Sentinel = -12345.0f;
+
+// Widths the build can target, the test runs for the one it does
+#if defined(__AVX512F__)
+static const uint32_t ExpectedPacketWidth = 16;
+#elif defined(__AVX2__)
+static const uint32_t ExpectedPacketWidth = 8;
+#else
+static const uint32_t ExpectedPacketWidth = 4;
+#endif
+
+struct TestPixels
+{
+	std::vector<float> streams[15];
+	LightingKernel::Pixels pixels;
+	LightingKernel::Pixels reference;
+};
+
+// Random points in a 4 unit cube with unit normals and albedos, the color
+// streams have a sentinel after the last pixel
+static void CreatePixels(uint32_t count, std::minstd_rand& random, TestPixels* pTest)
+{
+	std::uniform_real_distribution<float> coordinate(-2.0f, 2.0f);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (std::vector<float>& stream : pTest->streams)
+	{
+		stream.assign(count + 1, Sentinel);
+	}
+	for (uint32_t i = 0; i < count; i++)
+	{
+		float normal[3] = { coordinate(random), coordinate(random), coordinate(random) };
+		float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		for (int j = 0; j < 3; j++)
+		{
+			pTest->streams[j][i] = coordinate(random);
+			pTest->streams[3 + j][i] = length > 0 ? normal[j] / length : (j == 1 ? 1.0f : 0.0f);
+			pTest->streams[6 + j][i] = unit(random);
+		}
+	}
+
+	for (int j = 0; j < 3; j++)
+	{
+		pTest->pixels.position[j] = pTest->reference.position[j] = pTest->streams[j].data();
+		pTest->pixels.normal[j] = pTest->reference.normal[j] = pTest->streams[3 + j].data();
+		pTest->pixels.albedo[j] = pTest->reference.albedo[j] = pTest->streams[6 + j].data();
+		pTest->pixels.color[j] = pTest->streams[9 + j].data();
+		pTest->reference.color[j] = pTest->streams[12 + j].data();
+	}
+	pTest->pixels.count = pTest->reference.count = count;
+}
+
+// Half of the lights are windowed, ranges from 0.5 to 3 so that some of the
+// pixels are cut off and some are not
+static std::vector<LightManager::Light> CreateLights(uint32_t count, std::minstd_rand& random)
+{
+	std::uniform_real_distribution<float> coordinate(-2.0f, 2.0f);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<LightManager::Light> lights(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		LightManager::Light& light = lights[i];
+		for (int j = 0; j < 3; j++)
+		{
+			light.position[j] = coordinate(random);
+			light.color[j] = 0.2f + 0.8f * unit(random);
+		}
+		light.power = 0.02f + unit(random);
+		light.range = 0.5f + 2.5f * unit(random);
+		light.falloff = i % 2 != 0 ? LightManager::FALLOFF_WINDOWED : LightManager::FALLOFF_INVERSE_SQUARE;
+	}
+	return lights;
+}
+
+static bool MatchesReference(const TestPixels& test)
+{
+	bool matches = true;
+	for (int j = 0; j < 3; j++)
+	{
+		for (uint32_t i = 0; i < test.pixels.count; i++)
+		{
+			float expected = test.reference.color[j][i];
+			matches = matches && fabsf(test.pixels.color[j][i] - expected) <= AbsoluteTolerance + RelativeTolerance * fabsf(expected);
+		}
+		matches = matches && test.pixels.color[j][test.pixels.count] == Sentinel;
+	}
+	return matches;
+}
+
+static void TestReference()
+{
+	CHECK(LightingKernel::GetPacketWidth() == ExpectedPacketWidth);
+
+	// Single pixels, partial, full and several packets with a tail, and
+	// light counts around the chunk size of 64
+	const uint32_t width = LightingKernel::GetPacketWidth();
+	const uint32_t pixelCounts[] = { 1, width - 1, width, width + 1, 3 * width + 5, 1000 };
+	const uint32_t lightCounts[] = { 1, 2, 7, 63, 64, 65, 130 };
+
+	std::minstd_rand random(1);
+	for (uint32_t pixelCount : pixelCounts)
+	{
+		TestPixels test;
+		CreatePixels(pixelCount, random, &test);
+
+		bool matches = true;
+		for (uint32_t lightCount : lightCounts)
+		{
+			std::vector<LightManager::Light> lights = CreateLights(lightCount, random);
+			for (int cutOff = 0; cutOff < 2; cutOff++)
+			{
+				LightingKernel::Shade(test.pixels, lights.data(), lightCount, cutOff != 0);
+				LightingKernel::ShadeReference(test.reference, lights.data(), lightCount, cutOff != 0);
+				matches = matches && MatchesReference(test);
+			}
+		}
+		CHECK(matches);
+	}
+}
+
+static void TestSpecialCases()
+{
+	std::minstd_rand random(2);
+	TestPixels test;
+	CreatePixels(2 * LightingKernel::GetPacketWidth() + 3, random, &test);
+
+	// No lights leave the pixels black
+	LightingKernel::Shade(test.pixels, nullptr, 0, false);
+	bool black = true;
+	for (int j = 0; j < 3; j++)
+	{
+		for (uint32_t i = 0; i < test.pixels.count; i++)
+		{
+			black = black && test.pixels.color[j][i] == 0;
+		}
+	}
+	CHECK(black);
+
+	// A light exactly at a pixel adds nothing there, in the kernel and the reference
+	std::vector<LightManager::Light> lights = CreateLights(3, random);
+	uint32_t pixel = test.pixels.count - 2;
+	for (int j = 0; j < 3; j++)
+	{
+		lights[1].position[j] = test.pixels.position[j][pixel];
+	}
+	LightingKernel::Shade(test.pixels, lights.data(), 3, false);
+	LightingKernel::ShadeReference(test.reference, lights.data(), 3, false);
+	CHECK(MatchesReference(test));
+
+	float withLight = test.pixels.color[0][pixel];
+	lights.erase(lights.begin() + 1);
+	LightingKernel::ShadeReference(test.reference, lights.data(), 2, false);
+	CHECK(fabsf(withLight - test.reference.color[0][pixel]) <= AbsoluteTolerance + RelativeTolerance * fabsf(withLight));
+}
+
+void TestLightingKernel()
+{
+	TestReference();
+	TestSpecialCases();
+}
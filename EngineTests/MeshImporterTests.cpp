@@ -0,0 +1,354 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "MeshImporter.h"
+#include "TestFramework.h"
+
+static const char* const ObjFile = "EngineTests_Mesh.obj";
+static const char* const GlbFile = "EngineTests_Mesh.glb";
+static const char* const MissingFile = "EngineTests_Missing.obj";
+
+// Load fails with exactly the given message
+static bool FailsObj(const std::string& text, const char* pError)
+{
+	MeshImporter importer;
+	MeshData mesh;
+	return !importer.LoadObj(text.data(), text.size(), mesh) && strcmp(importer.GetErrorMessage(), pError) == 0;
+}
+
+static bool FailsGltf(const std::string& json, const char* pError)
+{
+	MeshImporter importer;
+	MeshData mesh;
+	return !importer.LoadGltf(json.data(), json.size(), "", mesh) && strcmp(importer.GetErrorMessage(), pError) == 0;
+}
+
+static bool FailsGlb(const std::string& data, const char* pError)
+{
+	MeshImporter importer;
+	MeshData mesh;
+	return !importer.LoadGlb(data.data(), data.size(), "", mesh) && strcmp(importer.GetErrorMessage(), pError) == 0;
+}
+
+static bool IsVertex(const MeshVertex& vertex, float x, float y, float z, float u, float v)
+{
+	return vertex.position[0] == x && vertex.position[1] == y && vertex.position[2] == z && vertex.uv[0] == u && vertex.uv[1] == v;
+}
+
+// Replaces the only occurrence of from
+static std::string Replace(const std::string& text, const std::string& from, const std::string& to)
+{
+	size_t pos = text.find(from);
+	if (pos == std::string::npos || text.find(from, pos + 1) != std::string::npos)
+	{
+		CHECK(!"replaced text is not unique");
+		return text;
+	}
+	return text.substr(0, pos) + to + text.substr(pos + from.size());
+}
+
+static std::string EncodeBase64(const std::vector<uint8_t>& data)
+{
+	static const char Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string text;
+	for (size_t i = 0; i < data.size(); i += 3)
+	{
+		uint32_t bits = data[i] << 16 | (i + 1 < data.size() ? data[i + 1] << 8 : 0) | (i + 2 < data.size() ? data[i + 2] : 0);
+		for (size_t c = 0; c < 4; c++)
+		{
+			text.push_back(i + c <= data.size() ? Alphabet[(bits >> (18 - 6 * c)) & 63] : '=');
+		}
+	}
+	return text;
+}
+
+// One triangle: three float positions and three 16-bit indices
+static std::vector<uint8_t> CreateTriangleBuffer()
+{
+	const float positions[9] = { 0, 0, 1, 1, 0, 1, 0, 2, 1 };
+	const uint16_t indices[4] = { 0, 1, 2, 0 };
+	std::vector<uint8_t> buffer(sizeof(positions) + sizeof(indices));
+	memcpy(buffer.data(), positions, sizeof(positions));
+	memcpy(buffer.data() + sizeof(positions), indices, sizeof(indices));
+	return buffer;
+}
+
+static std::string CreateTriangleGltf(const std::string& bufferJson)
+{
+	return "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],"
+		"\"nodes\":[{\"mesh\":0,\"translation\":[1,0,0]}],"
+		"\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0},\"indices\":1}]}],"
+		"\"accessors\":[{\"bufferView\":0,\"componentType\":5126,\"count\":3,\"type\":\"VEC3\"},"
+		"{\"bufferView\":1,\"componentType\":5123,\"count\":3,\"type\":\"SCALAR\"}],"
+		"\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":36},{\"buffer\":0,\"byteOffset\":36,\"byteLength\":6}],"
+		"\"buffers\":[" + bufferJson + "]}";
+}
+
+static std::string CreateGlb(const std::string& json, const std::vector<uint8_t>& bin)
+{
+	std::string paddedJson = json;
+	while (paddedJson.size() % 4 != 0)
+	{
+		paddedJson.push_back(' ');
+	}
+
+	uint32_t header[3] = { 0x46546C67, 2, (uint32_t)(12 + 8 + paddedJson.size() + 8 + bin.size()) };
+	uint32_t jsonChunk[2] = { (uint32_t)paddedJson.size(), 0x4E4F534A };
+	uint32_t binChunk[2] = { (uint32_t)bin.size(), 0x004E4942 };
+	std::string data((const char*)header, sizeof(header));
+	data.append((const char*)jsonChunk, sizeof(jsonChunk));
+	data.append(paddedJson);
+	data.append((const char*)binChunk, sizeof(binChunk));
+	data.append((const char*)bin.data(), bin.size());
+	return data;
+}
+
+static void TestObj()
+{
+	// A quad with a shared position, negative indices and a vertex without
+	// normal in the same face
+	std::string obj =
+		"# comment\n"
+		"o quad\n"
+		"v 0 0 0\n"
+		"v 1 0 0\r\n"
+		"v 1 1 0 1.0\n"
+		"v 0 1 0\n"
+		"vt 0 0\n"
+		"vt 1 0\n"
+		"vt 1 1\n"
+		"vt 0.5\n"
+		"vn 0 0 1\n"
+		"usemtl none\n"
+		"f 1/1/1 2/2/1 3/3/1 -1/-1\n";
+	MeshImporter importer;
+	MeshData mesh;
+	CHECK(importer.LoadObj(obj.data(), obj.size(), mesh));
+	CHECK(importer.GetBytesParsed() == obj.size());
+	CHECK(mesh.vertices.size() == 4 && mesh.indices.size() == 6);
+	if (mesh.vertices.size() == 4 && mesh.indices.size() == 6)
+	{
+		// Z and V flipped, the fan reversed to clockwise, vertices in the
+		// order the reversed triangles reference them
+		CHECK(IsVertex(mesh.vertices[0], 0, 0, -0.0f, 0, 1));
+		CHECK(IsVertex(mesh.vertices[1], 1, 1, -0.0f, 1, 0));
+		CHECK(IsVertex(mesh.vertices[2], 1, 0, -0.0f, 1, 1));
+		CHECK(IsVertex(mesh.vertices[3], 0, 1, -0.0f, 0.5f, 1));
+		CHECK(mesh.vertices[0].normal[2] == -1.0f);
+		CHECK(mesh.indices[0] == 0 && mesh.indices[1] == 1 && mesh.indices[2] == 2);
+		CHECK(mesh.indices[3] == 0 && mesh.indices[4] == 3 && mesh.indices[5] == 1);
+
+		// The missing normal comes from the face, facing the same way
+		CHECK(fabsf(mesh.vertices[3].normal[2] + 1.0f) < 1e-6f);
+		CHECK(mesh.boundsMin[0] == 0 && mesh.boundsMax[0] == 1 && mesh.boundsMax[1] == 1);
+	}
+
+	CHECK(importer.LoadObj("", 0, mesh) && mesh.vertices.empty() && mesh.indices.empty());
+
+	std::string vertices = "v 0 0 0\nv 1 0 0\nv 0 1 0\nvt 0 0\n";
+	CHECK(FailsObj("v 1 2\n", "invalid number at line 1"));
+	CHECK(FailsObj("v 1 2 x\n", "invalid number at line 1"));
+	CHECK(FailsObj("vt \n", "invalid number at line 1"));
+	CHECK(FailsObj("vn 1 2 3\nvn 1 , 3\n", "invalid number at line 2"));
+	CHECK(FailsObj(vertices + "f 1 2\n", "face with less than 3 vertices at line 5"));
+	CHECK(FailsObj(vertices + "f \n", "face with less than 3 vertices at line 5"));
+	CHECK(FailsObj(vertices + "f 1 0 2\n", "invalid face index at line 5"));
+	CHECK(FailsObj(vertices + "f 1 2/x 3\n", "invalid face index at line 5"));
+	CHECK(FailsObj(vertices + "f 1/ 2 3\n", "invalid face index at line 5"));
+	CHECK(FailsObj(vertices + "f 1 2 4\n", "face index out of range"));
+	CHECK(FailsObj(vertices + "f -4 -1 -2\n", "face index out of range"));
+	CHECK(FailsObj(vertices + "f 1/2 2/1 3/1\n", "face index out of range"));
+	CHECK(FailsObj(vertices + "f 1/-2 2/1 3/1\n", "face index out of range"));
+	CHECK(FailsObj(vertices + "f 1//1 2//1 3//1\n", "face index out of range"));
+	CHECK(FailsObj("f 1 2 3\n", "face index out of range"));
+}
+
+// Several chunks parse to the same mesh as one, relative indices included
+static void TestObjChunks()
+{
+	const uint32_t gridSize = 300;
+	std::string obj;
+	char line[128];
+	for (uint32_t y = 0; y < gridSize; y++)
+	{
+		for (uint32_t x = 0; x < gridSize; x++)
+		{
+			snprintf(line, sizeof(line), "v %u.25 %u.5 %u.125\nvt %u.5 %u.25\n", x, y, (x * y) % 7, x, y);
+			obj += line;
+			if (x > 0 && y > 0)
+			{
+				// Quad of the newest vertex and its neighbours, half of them relative
+				uint32_t v = y * gridSize + x + 1;
+				if ((x + y) % 2 == 0)
+				{
+					snprintf(line, sizeof(line), "f %u/%u %u/%u %u/%u %u/%u\n", v - gridSize - 1, v - gridSize - 1, v - gridSize, v - gridSize,
+						v, v, v - 1, v - 1);
+				}
+				else
+				{
+					snprintf(line, sizeof(line), "f -%u/-1 -%u/-%u -1/-1 -2/-2\n", gridSize + 2, gridSize + 1, gridSize + 1);
+				}
+				obj += line;
+			}
+		}
+	}
+	CHECK(obj.size() > 4 << 20);
+
+	MeshImporter importer;
+	importer.SetWorkerCount(1);
+	MeshData single;
+	CHECK(importer.LoadObj(obj.data(), obj.size(), single));
+
+	importer.SetWorkerCount(5);
+	MeshData chunked;
+	CHECK(importer.LoadObj(obj.data(), obj.size(), chunked));
+	CHECK(single.indices == chunked.indices);
+	CHECK(single.vertices.size() == chunked.vertices.size()
+		&& memcmp(single.vertices.data(), chunked.vertices.data(), single.vertices.size() * sizeof(MeshVertex)) == 0);
+	CHECK(single.indices.size() == (gridSize - 1) * (gridSize - 1) * 6);
+
+	// Errors in later chunks report lines of the whole file
+	std::string broken = obj + "f 1 2\n";
+	CHECK(!importer.LoadObj(broken.data(), broken.size(), chunked));
+	uint32_t lineCount = 0;
+	for (char c : broken)
+	{
+		lineCount += c == '\n' ? 1 : 0;
+	}
+	snprintf(line, sizeof(line), "face with less than 3 vertices at line %u", lineCount);
+	CHECK(strcmp(importer.GetErrorMessage(), line) == 0);
+
+	broken = obj + "f 1 2 999999\n";
+	CHECK(!importer.LoadObj(broken.data(), broken.size(), chunked));
+	CHECK(strcmp(importer.GetErrorMessage(), "face index out of range") == 0);
+}
+
+static void TestGltf()
+{
+	std::vector<uint8_t> buffer = CreateTriangleBuffer();
+	std::string dataUri = "{\"byteLength\":44,\"uri\":\"data:application/octet-stream;base64," + EncodeBase64(buffer) + "\"}";
+	std::string gltf = CreateTriangleGltf(dataUri);
+
+	MeshImporter importer;
+	MeshData mesh;
+	CHECK(importer.LoadGltf(gltf.data(), gltf.size(), "", mesh));
+	CHECK(importer.GetBytesParsed() == gltf.size() + buffer.size());
+	CHECK(mesh.vertices.size() == 3 && mesh.indices.size() == 3);
+	if (mesh.vertices.size() == 3 && mesh.indices.size() == 3)
+	{
+		// Translated by the node, Z negated and the winding reversed
+		CHECK(IsVertex(mesh.vertices[0], 1, 0, -1, 0, 0));
+		CHECK(IsVertex(mesh.vertices[2], 1, 2, -1, 0, 0));
+		CHECK(mesh.indices[0] == 0 && mesh.indices[1] == 2 && mesh.indices[2] == 1);
+		CHECK(fabsf(mesh.vertices[0].normal[2] + 1.0f) < 1e-6f);
+	}
+
+	CHECK(FailsGltf("", "invalid JSON"));
+	CHECK(FailsGltf(gltf.substr(0, gltf.size() - 1), "invalid JSON"));
+	CHECK(FailsGltf("{\"a\":[1,2,}", "invalid JSON"));
+	CHECK(FailsGltf("{\"a\" 1}", "invalid JSON"));
+	CHECK(FailsGltf(CreateTriangleGltf("{\"byteLength\":44}"), "buffer without data"));
+	CHECK(FailsGltf(CreateTriangleGltf("{\"uri\":\"data:application/octet-stream,abc\"}"), "unsupported data URI"));
+	CHECK(FailsGltf(CreateTriangleGltf("{\"uri\":\"data:application/octet-stream;base64,ab!c\"}"), "unsupported data URI"));
+	CHECK(FailsGltf(CreateTriangleGltf("{\"uri\":\"EngineTests_Missing.bin\"}"), "can not open an external buffer"));
+
+	CHECK(FailsGltf(Replace(gltf, "\"nodes\":[0]", "\"nodes\":[1]"), "node index out of range"));
+	CHECK(FailsGltf(Replace(gltf, "\"nodes\":[0]", "\"nodes\":[-1]"), "node index out of range"));
+	CHECK(FailsGltf(Replace(gltf, "{\"mesh\":0,", "{\"mesh\":0,\"children\":[0],"), "node hierarchy is not a tree"));
+	CHECK(FailsGltf(Replace(gltf, "{\"mesh\":0,", "{\"mesh\":3,"), "mesh index out of range"));
+	CHECK(FailsGltf(Replace(gltf, "\"POSITION\":0", "\"POSITION\":2"), "accessor index out of range"));
+	CHECK(FailsGltf(Replace(gltf, "\"count\":3,\"type\":\"VEC3\"", "\"count\":4,\"type\":\"VEC3\""), "accessor exceeds its buffer"));
+	CHECK(FailsGltf(Replace(gltf, "\"byteOffset\":36,\"byteLength\":6", "\"byteOffset\":36,\"byteLength\":60"), "accessor exceeds its buffer"));
+	CHECK(FailsGltf(Replace(gltf, "\"count\":3,\"type\":\"VEC3\"", "\"count\":3,\"type\":\"MAT3\""), "unsupported accessor type"));
+	CHECK(FailsGltf(Replace(gltf, "\"count\":3,\"type\":\"VEC3\"", "\"count\":3,\"type\":\"VEC2\""), "invalid attribute accessor"));
+	CHECK(FailsGltf(Replace(gltf, "5123", "5120"), "invalid index accessor"));
+	CHECK(FailsGltf(Replace(gltf, "5123", "5122"), "invalid index accessor"));
+	CHECK(FailsGltf(Replace(gltf, "{\"buffer\":0,\"byteOffset\":0", "{\"buffer\":1,\"byteOffset\":0"), "buffer index out of range"));
+	CHECK(FailsGltf(Replace(gltf, "{\"bufferView\":1,", "{\"bufferView\":1,\"sparse\":{},"), "sparse accessors are not supported"));
+	CHECK(FailsGltf(Replace(gltf, "{\"bufferView\":1,", "{"), "accessors without buffer views are not supported"));
+
+	// Index 3 of three vertices
+	std::vector<uint8_t> badIndices = buffer;
+	badIndices[40] = 3;
+	CHECK(FailsGltf(CreateTriangleGltf("{\"uri\":\"data:application/octet-stream;base64," + EncodeBase64(badIndices) + "\"}"),
+		"vertex index out of range"));
+
+	// Lines are skipped, the document is still valid
+	CHECK(importer.LoadGltf(Replace(gltf, "\"indices\":1}", "\"indices\":1,\"mode\":1}").c_str(), gltf.size() + 9, "", mesh));
+	CHECK(mesh.vertices.empty() && mesh.indices.empty());
+}
+
+static void TestGlb()
+{
+	std::vector<uint8_t> buffer = CreateTriangleBuffer();
+	std::string glb = CreateGlb(CreateTriangleGltf("{\"byteLength\":44}"), buffer);
+
+	MeshImporter importer;
+	MeshData mesh;
+	CHECK(importer.LoadGlb(glb.data(), glb.size(), "", mesh));
+	CHECK(mesh.vertices.size() == 3 && mesh.indices.size() == 3);
+
+	CHECK(FailsGlb(glb.substr(0, 19), "file is too small for a binary glTF"));
+	CHECK(FailsGlb(Replace(glb, "glTF", "gltf"), "not a binary glTF 2.0 file"));
+
+	std::string version = glb;
+	version[4] = 1;
+	CHECK(FailsGlb(version, "not a binary glTF 2.0 file"));
+	CHECK(FailsGlb(glb.substr(0, glb.size() - 1), "not a binary glTF 2.0 file"));
+
+	// Chunk lengths past the end of the file
+	std::string longChunk = glb;
+	longChunk[12] = (char)0xFF;
+	longChunk[13] = (char)0xFF;
+	CHECK(FailsGlb(longChunk, "chunk exceeds the file"));
+
+	std::string noJson = glb;
+	memcpy(&noJson[16], "XXXX", 4);
+	CHECK(FailsGlb(noJson, "binary glTF has no JSON chunk"));
+
+	// Without the BIN chunk the buffer has no data
+	std::string json = CreateTriangleGltf("{\"byteLength\":44}");
+	std::string noBin = CreateGlb(json, std::vector<uint8_t>());
+	noBin.resize(noBin.size() - 8);
+	uint32_t size = (uint32_t)noBin.size();
+	memcpy(&noBin[8], &size, sizeof(size));
+	CHECK(FailsGlb(noBin, "buffer without data"));
+
+	// A BIN chunk shorter than the views
+	std::vector<uint8_t> shortBuffer(buffer.begin(), buffer.begin() + 40);
+	CHECK(FailsGlb(CreateGlb(json, shortBuffer), "accessor exceeds its buffer"));
+}
+
+static void TestFiles()
+{
+	MeshImporter importer;
+	MeshData mesh;
+	CHECK(!importer.Load(MissingFile, mesh));
+	CHECK(strcmp(importer.GetErrorMessage(), "can not open the file") == 0);
+
+	std::string glb = CreateGlb(CreateTriangleGltf("{\"byteLength\":44}"), CreateTriangleBuffer());
+	CHECK(WriteTestFile(GlbFile, glb));
+	CHECK(importer.Load(GlbFile, mesh) && mesh.indices.size() == 3);
+
+	CHECK(WriteTestFile(ObjFile, "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3"));
+	CHECK(importer.Load(ObjFile, mesh) && mesh.indices.size() == 3);
+	remove(ObjFile);
+	remove(GlbFile);
+
+	// The extension is checked after the file is opened
+	CHECK(WriteTestFile("EngineTests_Mesh.txt", "v 0 0 0\n"));
+	CHECK(!importer.Load("EngineTests_Mesh.txt", mesh));
+	CHECK(strcmp(importer.GetErrorMessage(), "unknown file extension") == 0);
+	remove("EngineTests_Mesh.txt");
+}
+
+void TestMeshImporter()
+{
+	TestObj();
+	TestObjChunks();
+	TestGltf();
+	TestGlb();
+	TestFiles();
+}
@@ -0,0 +1,270 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <random>
+#include <vector>
+#include "MeshOptimizer.h"
+#include "TestFramework.h"
+
+static const uint32_t BenchmarkGridSizes[] = { 64, 256, 512 };
+
+struct TestMesh
+{
+	std::vector<float> positions; // xyz
+	std::vector<uint32_t> indices;
+
+	uint32_t GetVertexCount() const
+	{
+		return (uint32_t)(positions.size() / 3);
+	}
+};
+
+// Sphere of size x size quads, the seam and pole vertices are duplicated.
+// Shuffled triangles stand in for an exporter's arbitrary order.
+static TestMesh CreateSphere(uint32_t size, bool shuffle)
+{
+	TestMesh mesh;
+	for (uint32_t y = 0; y <= size; y++)
+	{
+		for (uint32_t x = 0; x <= size; x++)
+		{
+			float theta = 3.14159265f * y / size;
+			float phi = 6.28318531f * x / size;
+			mesh.positions.push_back(sinf(theta) * cosf(phi));
+			mesh.positions.push_back(cosf(theta));
+			mesh.positions.push_back(sinf(theta) * sinf(phi));
+		}
+	}
+
+	std::vector<std::array<uint32_t, 3>> triangles;
+	for (uint32_t y = 0; y < size; y++)
+	{
+		for (uint32_t x = 0; x < size; x++)
+		{
+			uint32_t v = y * (size + 1) + x;
+			triangles.push_back({ { v, v + 1, v + size + 1 } });
+			triangles.push_back({ { v + 1, v + size + 2, v + size + 1 } });
+		}
+	}
+	if (shuffle)
+	{
+		std::shuffle(triangles.begin(), triangles.end(), std::minstd_rand(1));
+	}
+	for (const std::array<uint32_t, 3>& triangle : triangles)
+	{
+		mesh.indices.insert(mesh.indices.end(), triangle.begin(), triangle.end());
+	}
+	return mesh;
+}
+
+// Triangles as position triples rotated to start with the smallest corner,
+// winding is kept
+static std::vector<std::array<float, 9>> GetTriangles(const std::vector<float>& positions, const std::vector<uint32_t>& indices)
+{
+	std::vector<std::array<float, 9>> triangles;
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		std::array<float, 9> smallest;
+		for (size_t first = 0; first < 3; first++)
+		{
+			std::array<float, 9> triangle;
+			for (size_t k = 0; k < 3; k++)
+			{
+				memcpy(&triangle[k * 3], &positions[indices[i + (first + k) % 3] * 3], 3 * sizeof(float));
+			}
+			smallest = first == 0 || triangle < smallest ? triangle : smallest;
+		}
+		triangles.push_back(smallest);
+	}
+	std::sort(triangles.begin(), triangles.end());
+	return triangles;
+}
+
+// Numbers the vertices at random, as if nothing had optimized their order
+static void ShuffleVertices(TestMesh& mesh)
+{
+	std::vector<uint32_t> order(mesh.GetVertexCount());
+	for (uint32_t i = 0; i < order.size(); i++)
+	{
+		order[i] = i;
+	}
+	std::shuffle(order.begin(), order.end(), std::minstd_rand(2));
+
+	std::vector<float> positions(mesh.positions.size());
+	for (uint32_t i = 0; i < order.size(); i++)
+	{
+		memcpy(&positions[order[i] * 3], &mesh.positions[i * 3], 3 * sizeof(float));
+	}
+	mesh.positions.swap(positions);
+	for (uint32_t& index : mesh.indices)
+	{
+		index = order[index];
+	}
+}
+
+static float GetAcmr(const TestMesh& mesh, uint32_t cacheSize, MeshOptimizer::CacheModel model)
+{
+	return MeshOptimizer::AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.GetVertexCount(), cacheSize, model).acmr;
+}
+
+static void TestAnalyze()
+{
+	// 0 1 2 0 3 0: the second 0 is evicted by a FIFO but not by an LRU
+	const uint32_t indices[] = { 0, 1, 2, 0, 3, 0 };
+	MeshOptimizer::VertexCacheStats fifo = MeshOptimizer::AnalyzeVertexCache(indices, 6, 4, 3, MeshOptimizer::CACHE_FIFO);
+	MeshOptimizer::VertexCacheStats lru = MeshOptimizer::AnalyzeVertexCache(indices, 6, 4, 3, MeshOptimizer::CACHE_LRU);
+	CHECK(fifo.transformed == 5 && fifo.acmr == 2.5f && fifo.atvr == 1.25f);
+	CHECK(lru.transformed == 4 && lru.acmr == 2.0f && lru.atvr == 1.0f);
+
+	MeshOptimizer::VertexCacheStats empty = MeshOptimizer::AnalyzeVertexCache(nullptr, 0, 0, 16, MeshOptimizer::CACHE_FIFO);
+	CHECK(empty.transformed == 0 && empty.acmr == 0 && empty.atvr == 0);
+
+	// Sequential 16 byte vertices read each line once
+	std::vector<uint32_t> sequential;
+	for (uint32_t i = 0; i < 3000; i++)
+	{
+		sequential.push_back(i);
+	}
+	CHECK(MeshOptimizer::AnalyzeVertexFetch(sequential.data(), sequential.size(), 3000, 16) == 1.0f);
+
+	// A stride of one line per vertex past the cache size misses every time
+	std::vector<uint32_t> strided;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		strided.push_back(0);
+		strided.push_back(256);
+		strided.push_back(512);
+	}
+	CHECK(MeshOptimizer::AnalyzeVertexFetch(strided.data(), strided.size(), 513, 64) == 4.0f);
+}
+
+static void TestVertexCache()
+{
+	// Too few triangles to reorder
+	uint32_t triangle[] = { 2, 0, 1 };
+	MeshOptimizer::OptimizeVertexCache(triangle, 3, 3);
+	CHECK(triangle[0] == 2 && triangle[1] == 0 && triangle[2] == 1);
+	MeshOptimizer::OptimizeVertexCache(nullptr, 0, 0);
+
+	TestMesh mesh = CreateSphere(48, true);
+	std::vector<std::array<float, 9>> triangles = GetTriangles(mesh.positions, mesh.indices);
+	float before = GetAcmr(mesh, 32, MeshOptimizer::CACHE_LRU);
+	float beforeFifo = GetAcmr(mesh, 16, MeshOptimizer::CACHE_FIFO);
+
+	MeshOptimizer::OptimizeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.GetVertexCount());
+	float after = GetAcmr(mesh, 32, MeshOptimizer::CACHE_LRU);
+	float afterFifo = GetAcmr(mesh, 16, MeshOptimizer::CACHE_FIFO);
+	CHECK(GetTriangles(mesh.positions, mesh.indices) == triangles);
+
+	// Random order transforms nearly every corner, the optimized one close to
+	// the 0.5 of an endless grid
+	CHECK(before > 2.5f && beforeFifo > 2.5f);
+	CHECK(after < 0.75f);
+	CHECK(afterFifo < 0.85f);
+
+	// Optimizing the unshuffled grid, already a decent order, helps too
+	TestMesh grid = CreateSphere(48, false);
+	float gridBefore = GetAcmr(grid, 32, MeshOptimizer::CACHE_LRU);
+	MeshOptimizer::OptimizeVertexCache(grid.indices.data(), grid.indices.size(), grid.GetVertexCount());
+	CHECK(GetAcmr(grid, 32, MeshOptimizer::CACHE_LRU) < gridBefore);
+}
+
+static void TestOverdraw()
+{
+	TestMesh mesh = CreateSphere(48, true);
+	MeshOptimizer::OptimizeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.GetVertexCount());
+	std::vector<std::array<float, 9>> triangles = GetTriangles(mesh.positions, mesh.indices);
+	float optimized = GetAcmr(mesh, 16, MeshOptimizer::CACHE_FIFO);
+
+	// Clusters move as a whole, their cache cost stays near the threshold
+	const float threshold = 1.05f;
+	MeshOptimizer::OptimizeOverdraw(mesh.indices.data(), mesh.indices.size(), mesh.positions.data(), 3 * sizeof(float),
+		mesh.GetVertexCount(), threshold);
+	CHECK(GetTriangles(mesh.positions, mesh.indices) == triangles);
+	CHECK(GetAcmr(mesh, 16, MeshOptimizer::CACHE_FIFO) <= optimized * threshold * 1.1f);
+
+	// A threshold of 1 cuts less, more clusters would lose more
+	TestMesh strict = CreateSphere(48, true);
+	MeshOptimizer::OptimizeVertexCache(strict.indices.data(), strict.indices.size(), strict.GetVertexCount());
+	MeshOptimizer::OptimizeOverdraw(strict.indices.data(), strict.indices.size(), strict.positions.data(), 3 * sizeof(float),
+		strict.GetVertexCount(), 1.0f);
+	CHECK(GetTriangles(strict.positions, strict.indices) == triangles);
+	CHECK(GetAcmr(strict, 16, MeshOptimizer::CACHE_FIFO) <= optimized * 1.1f);
+}
+
+static void TestVertexFetch()
+{
+	// 50 KB of positions do not fit the 16 KB the fetch analysis models
+	TestMesh mesh = CreateSphere(64, true);
+	MeshOptimizer::OptimizeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.GetVertexCount());
+	ShuffleVertices(mesh);
+
+	// Two vertices nothing refers to are dropped
+	mesh.positions.insert(mesh.positions.end(), { 9, 9, 9, 8, 8, 8 });
+	std::vector<std::array<float, 9>> triangles = GetTriangles(mesh.positions, mesh.indices);
+	float before = MeshOptimizer::AnalyzeVertexFetch(mesh.indices.data(), mesh.indices.size(), mesh.GetVertexCount(), 3 * sizeof(float));
+
+	uint32_t vertexCount = MeshOptimizer::OptimizeVertexFetch(mesh.positions.data(), mesh.indices.data(), mesh.indices.size(),
+		mesh.GetVertexCount(), 3 * sizeof(float));
+	CHECK(vertexCount == mesh.GetVertexCount() - 2);
+	mesh.positions.resize(vertexCount * 3);
+	CHECK(GetTriangles(mesh.positions, mesh.indices) == triangles);
+
+	// Vertices are numbered by first use
+	uint32_t next = 0;
+	bool ordered = true;
+	for (uint32_t index : mesh.indices)
+	{
+		ordered = ordered && index <= next;
+		next = index == next ? next + 1 : next;
+	}
+	CHECK(ordered && next == vertexCount);
+
+	float after = MeshOptimizer::AnalyzeVertexFetch(mesh.indices.data(), mesh.indices.size(), vertexCount, 3 * sizeof(float));
+	CHECK(before > 2.0f);
+	CHECK(after < 1.5f);
+}
+
+void TestMeshOptimizer()
+{
+	TestAnalyze();
+	TestVertexCache();
+	TestOverdraw();
+	TestVertexFetch();
+}
+
+void BenchmarkMeshOptimizer(double seconds)
+{
+	printf("%-10s %10s %10s %10s %12s %14s %12s\n", "triangles", "ACMR in", "ACMR out", "ATVR out", "cache (ms)", "overdraw (ms)", "fetch (ms)");
+	for (uint32_t size : BenchmarkGridSizes)
+	{
+		TestMesh shuffled = CreateSphere(size, true);
+		TestMesh mesh;
+		double cacheMs = TimeWork(seconds / 3, [&]()
+		{
+			mesh = shuffled;
+			MeshOptimizer::OptimizeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.GetVertexCount());
+		});
+		MeshOptimizer::VertexCacheStats stats = MeshOptimizer::AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(),
+			mesh.GetVertexCount(), 16, MeshOptimizer::CACHE_FIFO);
+
+		TestMesh optimized = mesh;
+		double overdrawMs = TimeWork(seconds / 3, [&]()
+		{
+			mesh.indices = optimized.indices;
+			MeshOptimizer::OptimizeOverdraw(mesh.indices.data(), mesh.indices.size(), mesh.positions.data(), 3 * sizeof(float),
+				mesh.GetVertexCount(), 1.05f);
+		});
+		double fetchMs = TimeWork(seconds / 3, [&]()
+		{
+			mesh = optimized;
+			MeshOptimizer::OptimizeVertexFetch(mesh.positions.data(), mesh.indices.data(), mesh.indices.size(), mesh.GetVertexCount(),
+				3 * sizeof(float));
+		});
+
+		printf("%-10u %10.3f %10.3f %10.3f %12.2f %14.2f %12.2f\n", (uint32_t)(shuffled.indices.size() / 3),
+			GetAcmr(shuffled, 16, MeshOptimizer::CACHE_FIFO), stats.acmr, stats.atvr, cacheMs, overdrawMs, fetchMs);
+	}
+}
@@ -0,0 +1,258 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "MeshSimplifier.h"
+#include "TestFramework.h"
+
+static const uint32_t BenchmarkSphereSizes[] = { 32, 128, 256 };
+
+struct TestMesh
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+};
+
+// Latitude longitude sphere with a UV seam along x = 0, bumped by noise so
+// collapses have different costs
+static TestMesh CreateSphere(uint32_t size, float noise)
+{
+	TestMesh mesh;
+	std::minstd_rand random(size);
+	std::uniform_real_distribution<float> bump(1.0f - noise, 1.0f + noise);
+	for (uint32_t y = 0; y <= size; y++)
+	{
+		for (uint32_t x = 0; x <= size; x++)
+		{
+			float theta = 3.14159265f * y / size;
+			float phi = 6.28318531f * x / size;
+			float radius = y == 0 || y == size ? 1.0f : bump(random);
+			MeshVertex vertex = { { sinf(theta) * cosf(phi) * radius, cosf(theta) * radius, sinf(theta) * sinf(phi) * radius },
+				{ (float)x / size, (float)y / size }, { sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi) } };
+			if (x == size)
+			{
+				// Seam vertex at the position of the first one of the row
+				memcpy(vertex.position, mesh.vertices[y * (size + 1)].position, sizeof(vertex.position));
+				memcpy(vertex.normal, mesh.vertices[y * (size + 1)].normal, sizeof(vertex.normal));
+			}
+			mesh.vertices.push_back(vertex);
+		}
+	}
+
+	// The poles are fans, the first and last row drop the triangle with two corners on the pole
+	for (uint32_t y = 0; y < size; y++)
+	{
+		for (uint32_t x = 0; x < size; x++)
+		{
+			uint32_t v = y * (size + 1) + x;
+			uint32_t triangles[6] = { v, v + 1, v + size + 1, v + 1, v + size + 2, v + size + 1 };
+			mesh.indices.insert(mesh.indices.end(), triangles + (y == 0 ? 3 : 0), triangles + (y == size - 1 ? 3 : 6));
+		}
+	}
+	return mesh;
+}
+
+// Flat square in xy with UVs following the positions
+static TestMesh CreateGrid(uint32_t size)
+{
+	TestMesh mesh;
+	for (uint32_t y = 0; y <= size; y++)
+	{
+		for (uint32_t x = 0; x <= size; x++)
+		{
+			MeshVertex vertex = { { (float)x / size, (float)y / size, 0 }, { (float)x / size, (float)y / size }, { 0, 0, 1 } };
+			mesh.vertices.push_back(vertex);
+		}
+	}
+	for (uint32_t y = 0; y < size; y++)
+	{
+		for (uint32_t x = 0; x < size; x++)
+		{
+			uint32_t v = y * (size + 1) + x;
+			uint32_t triangles[6] = { v, v + 1, v + size + 1, v + 1, v + size + 2, v + size + 1 };
+			mesh.indices.insert(mesh.indices.end(), triangles, triangles + 6);
+		}
+	}
+	return mesh;
+}
+
+// Indices in range and no triangle with two corners at one position
+static bool IsValidLod(const TestMesh& mesh, const std::vector<uint32_t>& indices)
+{
+	if (indices.size() % 3 != 0)
+	{
+		return false;
+	}
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			if (indices[i + k] >= mesh.vertices.size())
+			{
+				return false;
+			}
+			const float* a = mesh.vertices[indices[i + k]].position;
+			const float* b = mesh.vertices[indices[i + (k + 1) % 3]].position;
+			if (a[0] == b[0] && a[1] == b[1] && a[2] == b[2])
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Signed area of the triangles projected on xy
+static double GetArea(const TestMesh& mesh, const std::vector<uint32_t>& indices)
+{
+	double area = 0;
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		const float* a = mesh.vertices[indices[i]].position;
+		const float* b = mesh.vertices[indices[i + 1]].position;
+		const float* c = mesh.vertices[indices[i + 2]].position;
+		area += 0.5 * (((double)b[0] - a[0]) * ((double)c[1] - a[1]) - ((double)b[1] - a[1]) * ((double)c[0] - a[0]));
+	}
+	return area;
+}
+
+static std::vector<uint32_t> Simplify(const TestMesh& mesh, size_t targetIndexCount, float targetError, float* pError)
+{
+	std::vector<uint32_t> lod(mesh.indices.size());
+	lod.resize(MeshSimplifier::Simplify(lod.data(), mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.vertices.size(),
+		targetIndexCount, targetError, pError));
+	return lod;
+}
+
+static void TestSimplify()
+{
+	// Each halving of the triangle count collapses more and costs at least
+	// as much as the one before
+	TestMesh sphere = CreateSphere(64, 0.02f);
+	float previousError = 0;
+	size_t previousCount = sphere.indices.size();
+	bool valid = true, monotonic = true, shrinking = true;
+	for (uint32_t level = 1; level < 6; level++)
+	{
+		size_t targetIndexCount = (sphere.indices.size() / 3 >> level) * 3;
+		float error = -1;
+		std::vector<uint32_t> lod = Simplify(sphere, targetIndexCount, 1.0f, &error);
+		valid = valid && IsValidLod(sphere, lod);
+		monotonic = monotonic && error >= previousError && error > 0;
+		shrinking = shrinking && lod.size() <= targetIndexCount && lod.size() < previousCount;
+		previousError = error;
+		previousCount = lod.size();
+	}
+	CHECK(valid);
+	CHECK(monotonic);
+	CHECK(shrinking);
+
+	// The error limit is relative to the largest extent, about 2 here, and
+	// stops short of the target
+	float error = -1;
+	std::vector<uint32_t> limited = Simplify(sphere, 0, 0.01f, &error);
+	CHECK(IsValidLod(sphere, limited));
+	CHECK(limited.size() > 300 && limited.size() < sphere.indices.size());
+	CHECK(error > 0 && error <= 0.01f * 2.04f);
+
+	// Nothing to do at or above the source count
+	std::vector<uint32_t> same = Simplify(sphere, sphere.indices.size(), 1.0f, &error);
+	CHECK(same == sphere.indices && error == 0);
+
+	// A plane costs nothing and keeps its border, the corners hold the square
+	TestMesh grid = CreateGrid(16);
+	std::vector<uint32_t> flat = Simplify(grid, 0, 0.001f, &error);
+	CHECK(IsValidLod(grid, flat));
+	CHECK(flat.size() <= 3 * 32);
+	CHECK(error < 1e-4f);
+	CHECK(fabs(GetArea(grid, flat) - 1.0) < 1e-5);
+}
+
+static void TestLodChains()
+{
+	TestMesh meshes[3] = { CreateSphere(64, 0.02f), CreateSphere(48, 0.1f), CreateGrid(32) };
+	MeshSimplifier::Source sources[3];
+	for (int m = 0; m < 3; m++)
+	{
+		MeshSimplifier::Source source = { meshes[m].indices.data(), meshes[m].indices.size(), meshes[m].vertices.data(), meshes[m].vertices.size() };
+		sources[m] = source;
+	}
+
+	const float maxError = 0.2f;
+	std::vector<MeshSimplifier::Lod> chains[3], serialChains[3];
+	MeshSimplifier::BuildLodChains(sources, 3, 8, maxError, chains, 8);
+	MeshSimplifier::BuildLodChains(sources, 3, 8, maxError, serialChains, 1);
+
+	// Errors never go down along a chain, every level drops at least a sixth
+	bool valid = true, monotonic = true, reduced = true, bounded = true, deterministic = true;
+	for (int m = 0; m < 3; m++)
+	{
+		float previousError = 0;
+		size_t previousCount = meshes[m].indices.size();
+		for (size_t l = 0; l < chains[m].size(); l++)
+		{
+			const MeshSimplifier::Lod& lod = chains[m][l];
+			valid = valid && IsValidLod(meshes[m], lod.indices) && !lod.indices.empty();
+			monotonic = monotonic && lod.error >= previousError;
+			reduced = reduced && lod.indices.size() * 6 <= previousCount * 5;
+			bounded = bounded && lod.error <= maxError * 2.2f;
+			deterministic = deterministic && l < serialChains[m].size() && serialChains[m][l].indices == lod.indices
+				&& serialChains[m][l].error == lod.error;
+			previousError = lod.error;
+			previousCount = lod.indices.size();
+		}
+		deterministic = deterministic && serialChains[m].size() == chains[m].size();
+	}
+	CHECK(valid);
+	CHECK(monotonic);
+	CHECK(reduced);
+	CHECK(bounded);
+	CHECK(deterministic);
+	CHECK(chains[0].size() >= 4 && chains[1].size() >= 3 && chains[2].size() >= 3);
+
+	// A level is simplified from the source, only its error is raised to the previous one
+	for (int m = 0; m < 2; m++)
+	{
+		const MeshSimplifier::Lod& first = chains[m][0];
+		float error = 0;
+		std::vector<uint32_t> lod = Simplify(meshes[m], (meshes[m].indices.size() / 6) * 3, maxError, &error);
+		CHECK(lod == first.indices && error == first.error);
+	}
+}
+
+void TestMeshSimplifier()
+{
+	TestSimplify();
+	TestLodChains();
+}
+
+void BenchmarkMeshSimplifier(double seconds)
+{
+	printf("%-10s %14s %14s %14s\n", "triangles", "Simplify (ms)", "chain 1 (ms)", "chain all (ms)");
+	for (uint32_t size : BenchmarkSphereSizes)
+	{
+		TestMesh mesh = CreateSphere(size, 0.02f);
+		MeshSimplifier::Source source = { mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.vertices.size() };
+		std::vector<uint32_t> lod(mesh.indices.size());
+		std::vector<MeshSimplifier::Lod> chain;
+
+		double simplifyMs = TimeWork(seconds / 3, [&]()
+		{
+			float error;
+			MeshSimplifier::Simplify(lod.data(), mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.vertices.size(),
+				mesh.indices.size() / 4, 1.0f, &error);
+		});
+		double serialMs = TimeWork(seconds / 3, [&]()
+		{
+			MeshSimplifier::BuildLodChains(&source, 1, 6, 1.0f, &chain, 1);
+		});
+		double parallelMs = TimeWork(seconds / 3, [&]()
+		{
+			MeshSimplifier::BuildLodChains(&source, 1, 6, 1.0f, &chain);
+		});
+
+		printf("%-10zu %14.2f %14.2f %14.2f\n", mesh.indices.size() / 3, simplifyMs, serialMs, parallelMs);
+	}
+}
@@ -0,0 +1,308 @@
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <array>
+#include <random>
+#include <vector>
+#include "MeshletBuilder.h"
+#include "TestFramework.h"
+
+static const uint32_t BenchmarkSphereSizes[] = { 32, 128, 256 };
+
+struct TestMesh
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+};
+
+// Latitude longitude sphere, triangles in random order if shuffled
+static TestMesh CreateSphere(uint32_t size, bool shuffle)
+{
+	TestMesh mesh;
+	for (uint32_t y = 0; y <= size; y++)
+	{
+		for (uint32_t x = 0; x <= size; x++)
+		{
+			float theta = 3.14159265f * y / size;
+			float phi = 6.28318531f * x / size;
+			MeshVertex vertex = { { sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi) }, { (float)x / size, (float)y / size },
+				{ sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi) } };
+			mesh.vertices.push_back(vertex);
+		}
+	}
+
+	std::vector<std::array<uint32_t, 3>> triangles;
+	for (uint32_t y = 0; y < size; y++)
+	{
+		for (uint32_t x = 0; x < size; x++)
+		{
+			uint32_t v = y * (size + 1) + x;
+			triangles.push_back({ { v, v + size + 1, v + 1 } });
+			triangles.push_back({ { v + 1, v + size + 1, v + size + 2 } });
+		}
+	}
+	if (shuffle)
+	{
+		std::shuffle(triangles.begin(), triangles.end(), std::minstd_rand(1));
+	}
+	for (const std::array<uint32_t, 3>& triangle : triangles)
+	{
+		mesh.indices.insert(mesh.indices.end(), triangle.begin(), triangle.end());
+	}
+	return mesh;
+}
+
+// Every triangle of the sphere with its own vertices, moved by up to jitter
+// so they are not welded
+static TestMesh CreateSoup(uint32_t size, float jitter)
+{
+	TestMesh sphere = CreateSphere(size, false);
+	TestMesh mesh;
+	std::minstd_rand random(2);
+	std::uniform_real_distribution<float> offset(-jitter, jitter);
+	for (uint32_t index : sphere.indices)
+	{
+		MeshVertex vertex = sphere.vertices[index];
+		for (int c = 0; c < 3; c++)
+		{
+			vertex.position[c] += offset(random);
+		}
+		mesh.indices.push_back((uint32_t)mesh.vertices.size());
+		mesh.vertices.push_back(vertex);
+	}
+	return mesh;
+}
+
+// The 12 triangles of a cube drawn over and over, only the triangle limit applies
+static TestMesh CreateRepeatedCube(uint32_t triangleCount)
+{
+	static const uint32_t CubeIndices[36] = {
+		0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1,
+		2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3
+	};
+
+	TestMesh mesh;
+	for (uint32_t v = 0; v < 8; v++)
+	{
+		MeshVertex vertex = { { (float)(v & 1), (float)(v >> 1 & 1), (float)(v >> 2) }, { 0, 0 }, { 0, 0, 1 } };
+		mesh.vertices.push_back(vertex);
+	}
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		mesh.indices.insert(mesh.indices.end(), CubeIndices + t % 12 * 3, CubeIndices + t % 12 * 3 + 3);
+	}
+	return mesh;
+}
+
+// One center vertex shared by every triangle of a flat fan
+static TestMesh CreateFan(uint32_t triangleCount)
+{
+	TestMesh mesh;
+	MeshVertex center = { { 0, 0, 0 }, { 0, 0 }, { 0, 0, 1 } };
+	mesh.vertices.push_back(center);
+	for (uint32_t i = 0; i <= triangleCount; i++)
+	{
+		float angle = 6.28318531f * i / triangleCount;
+		MeshVertex vertex = { { cosf(angle), sinf(angle), 0 }, { 0, 0 }, { 0, 0, 1 } };
+		mesh.vertices.push_back(vertex);
+	}
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		mesh.indices.push_back(0);
+		mesh.indices.push_back(i + 2);
+		mesh.indices.push_back(i + 1);
+	}
+	return mesh;
+}
+
+static std::array<float, 3> TriangleNormal(const TestMesh& mesh, const uint32_t* pTriangle)
+{
+	const float* a = mesh.vertices[pTriangle[0]].position;
+	const float* b = mesh.vertices[pTriangle[1]].position;
+	const float* c = mesh.vertices[pTriangle[2]].position;
+	float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	std::array<float, 3> n = { { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] } };
+	float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	for (float& value : n)
+	{
+		value = length > 0 ? value / length : 0;
+	}
+	return n;
+}
+
+// Builds the meshlets of a mesh behind a meshlet of an earlier mesh and
+// checks the limits, the ranges, the spheres and the cones
+static void CheckMeshlets(const TestMesh& mesh, uint32_t minMeshletCount, uint32_t maxMeshletCount)
+{
+	const uint32_t indexBase = 300;
+	MeshletList meshlets;
+	meshlets.firstIndex.push_back(0);
+	meshlets.indexCount.push_back(indexBase);
+	for (std::vector<float>* pArray : { &meshlets.centerX, &meshlets.centerY, &meshlets.centerZ, &meshlets.radius,
+		&meshlets.axisX, &meshlets.axisY, &meshlets.axisZ, &meshlets.cutoff })
+	{
+		pArray->push_back(0);
+	}
+
+	std::vector<uint32_t> indices = mesh.indices;
+	uint32_t count = MeshletBuilder::Build(indices.data(), indices.size(), mesh.vertices.data(), mesh.vertices.size(), indexBase, &meshlets);
+	CHECK(count >= minMeshletCount && count <= maxMeshletCount);
+	CHECK(meshlets.firstIndex.size() == count + 1 && meshlets.cutoff.size() == count + 1);
+
+	// Same triangles with the same winding, in another order
+	std::vector<std::array<uint32_t, 3>> before, after;
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		before.push_back({ { mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2] } });
+		after.push_back({ { indices[i], indices[i + 1], indices[i + 2] } });
+	}
+	std::sort(before.begin(), before.end());
+	std::sort(after.begin(), after.end());
+	CHECK(before == after);
+
+	bool contiguous = true, vertexLimit = true, triangleLimit = true, bounded = true, coned = true;
+	uint32_t nextIndex = indexBase;
+	std::vector<uint32_t> vertices;
+	for (uint32_t m = 1; m <= count; m++)
+	{
+		uint32_t firstIndex = meshlets.firstIndex[m];
+		uint32_t indexCount = meshlets.indexCount[m];
+		contiguous = contiguous && firstIndex == nextIndex && indexCount > 0 && indexCount % 3 == 0;
+		nextIndex = firstIndex + indexCount;
+		triangleLimit = triangleLimit && indexCount / 3 <= MeshletBuilder::MaxTriangles;
+
+		vertices.assign(indices.begin() + (firstIndex - indexBase), indices.begin() + (nextIndex - indexBase));
+		std::sort(vertices.begin(), vertices.end());
+		vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+		vertexLimit = vertexLimit && vertices.size() <= MeshletBuilder::MaxVertices;
+
+		float radius = meshlets.radius[m] * 1.0001f + 1e-6f;
+		for (uint32_t vertex : vertices)
+		{
+			const float* p = mesh.vertices[vertex].position;
+			float dx = p[0] - meshlets.centerX[m], dy = p[1] - meshlets.centerY[m], dz = p[2] - meshlets.centerZ[m];
+			bounded = bounded && dx * dx + dy * dy + dz * dz <= radius * radius;
+		}
+
+		// Every face normal is inside the cone
+		float cutoff = meshlets.cutoff[m];
+		float minCosine = sqrtf(1.0f - cutoff * cutoff) - 1e-4f;
+		for (uint32_t i = firstIndex - indexBase; i < nextIndex - indexBase && cutoff < 1.0f; i += 3)
+		{
+			std::array<float, 3> n = TriangleNormal(mesh, &indices[i]);
+			bool degenerate = n[0] == 0 && n[1] == 0 && n[2] == 0;
+			coned = coned && (degenerate || n[0] * meshlets.axisX[m] + n[1] * meshlets.axisY[m] + n[2] * meshlets.axisZ[m] >= minCosine);
+		}
+	}
+	CHECK(contiguous && nextIndex == indexBase + indices.size());
+	CHECK(vertexLimit);
+	CHECK(triangleLimit);
+	CHECK(bounded);
+	CHECK(coned);
+}
+
+// A meshlet CullBackfacing drops has only triangles facing away from the
+// camera, dot(p - camera, n) >= 0 for their corners. Returns the culled fraction.
+static float CheckBackfacing(const TestMesh& mesh, float cameraDistance)
+{
+	std::vector<uint32_t> indices = mesh.indices;
+	MeshletList meshlets;
+	uint32_t count = MeshletBuilder::Build(indices.data(), indices.size(), mesh.vertices.data(), mesh.vertices.size(), 0, &meshlets);
+
+	std::vector<uint32_t> candidates(count), visible(count);
+	for (uint32_t m = 0; m < count; m++)
+	{
+		candidates[m] = m;
+	}
+
+	std::minstd_rand random(3);
+	std::normal_distribution<float> gaussian;
+	bool conservative = true;
+	size_t culled = 0;
+	for (int c = 0; c < 64; c++)
+	{
+		float direction[3] = { gaussian(random), gaussian(random), gaussian(random) };
+		float length = sqrtf(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+		float camera[3] = { direction[0] / length * cameraDistance, direction[1] / length * cameraDistance, direction[2] / length * cameraDistance };
+
+		uint32_t visibleCount = MeshletBuilder::CullBackfacing(meshlets, 0, candidates.data(), count, camera, visible.data());
+		culled += count - visibleCount;
+
+		std::vector<bool> kept(count, false);
+		for (uint32_t i = 0; i < visibleCount; i++)
+		{
+			kept[visible[i]] = true;
+		}
+		for (uint32_t m = 0; m < count; m++)
+		{
+			for (uint32_t i = meshlets.firstIndex[m]; i < meshlets.firstIndex[m] + meshlets.indexCount[m] && !kept[m]; i += 3)
+			{
+				std::array<float, 3> n = TriangleNormal(mesh, &indices[i]);
+				for (int k = 0; k < 3; k++)
+				{
+					const float* p = mesh.vertices[indices[i + k]].position;
+					conservative = conservative && (p[0] - camera[0]) * n[0] + (p[1] - camera[1]) * n[1] + (p[2] - camera[2]) * n[2] >= -1e-5f;
+				}
+			}
+		}
+	}
+	CHECK(conservative);
+	return (float)culled / (count * 64);
+}
+
+void TestMeshletBuilder()
+{
+	// A 32 sphere has 2048 triangles and about 1100 vertices
+	CheckMeshlets(CreateSphere(32, false), 2048 / MeshletBuilder::MaxTriangles, 64);
+	CheckMeshlets(CreateSphere(32, true), 2048 / MeshletBuilder::MaxTriangles, 64);
+
+	// Soups are limited by vertices, 21 triangles each, welded or joined by distance
+	CheckMeshlets(CreateSoup(32, 0), 2048 / (MeshletBuilder::MaxVertices / 3), 2048 / 8);
+	CheckMeshlets(CreateSoup(32, 1e-3f), 2048 / (MeshletBuilder::MaxVertices / 3), 2048 / 8);
+
+	// A fan holds 62 triangles around its center, the cube fills every meshlet
+	CheckMeshlets(CreateFan(1000), 1000 / (MeshletBuilder::MaxVertices - 2), 1000 / 8);
+	CheckMeshlets(CreateRepeatedCube(1000), 1000 / MeshletBuilder::MaxTriangles + 1, 1000 / MeshletBuilder::MaxTriangles + 1);
+
+	MeshletList empty;
+	uint32_t none = 0;
+	CHECK(MeshletBuilder::Build(&none, 0, nullptr, 0, 0, &empty) == 0 && empty.firstIndex.empty());
+
+	// From outside, a sphere's meshlets on the far side face away, unless
+	// their cones are wider than the view angle allows
+	CHECK(CheckBackfacing(CreateSphere(32, false), 4.0f) > 0.05f);
+	CHECK(CheckBackfacing(CreateSphere(32, true), 4.0f) > 0.05f);
+	CheckBackfacing(CreateSoup(32, 1e-3f), 4.0f);
+}
+
+void BenchmarkMeshletBuilder(double seconds)
+{
+	printf("%-10s %10s %14s %16s\n", "triangles", "meshlets", "Build (ms)", "cull (Mmesh/s)");
+	for (uint32_t size : BenchmarkSphereSizes)
+	{
+		TestMesh mesh = CreateSphere(size, true);
+		std::vector<uint32_t> indices;
+		MeshletList meshlets;
+		uint32_t count = 0;
+		double buildMs = TimeWork(seconds / 2, [&]()
+		{
+			indices = mesh.indices;
+			meshlets = MeshletList();
+			count = MeshletBuilder::Build(indices.data(), indices.size(), mesh.vertices.data(), mesh.vertices.size(), 0, &meshlets);
+		});
+
+		std::vector<uint32_t> candidates(count), visible(count);
+		for (uint32_t m = 0; m < count; m++)
+		{
+			candidates[m] = m;
+		}
+		const float camera[3] = { 0, 1, -4 };
+		double cullMs = TimeWork(seconds / 2, [&]()
+		{
+			MeshletBuilder::CullBackfacing(meshlets, 0, candidates.data(), count, camera, visible.data());
+		});
+
+		printf("%-10zu %10u %14.2f %16.1f\n", mesh.indices.size() / 3, count, buildMs, count / (cullMs * 1000.0));
+	}
+}
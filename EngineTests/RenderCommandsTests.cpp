@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "RenderCommands.h"
+#include "TestFramework.h"
+
+static const uint32_t BenchmarkDrawCounts[] = { 1024, 16384, 262144 };
+static const uint32_t BenchmarkJobCount = 8;
+
+// Replayed command as its type and payload bytes
+struct ReplayedCommand
+{
+	RenderCommandType type;
+	std::vector<uint8_t> payload;
+
+	bool operator==(const ReplayedCommand& other) const
+	{
+		return type == other.type && payload == other.payload;
+	}
+};
+
+class RecordingBackend : public RenderCommandBackend
+{
+public:
+	virtual void ClearTarget(const ClearTargetCommand& command) override
+	{
+		Record(RENDER_COMMAND_CLEAR_TARGET, command);
+	}
+
+	virtual void BindProgram(const BindProgramCommand& command) override
+	{
+		Record(RENDER_COMMAND_BIND_PROGRAM, command);
+	}
+
+	virtual void BindTexture(const BindTextureCommand& command) override
+	{
+		Record(RENDER_COMMAND_BIND_TEXTURE, command);
+	}
+
+	virtual void BindVertexBuffer(const BindVertexBufferCommand& command) override
+	{
+		Record(RENDER_COMMAND_BIND_VERTEX_BUFFER, command);
+	}
+
+	virtual void BindIndexBuffer(const BindIndexBufferCommand& command) override
+	{
+		Record(RENDER_COMMAND_BIND_INDEX_BUFFER, command);
+	}
+
+	virtual void DrawIndexedInstanced(const DrawIndexedInstancedCommand& command) override
+	{
+		Record(RENDER_COMMAND_DRAW_INDEXED_INSTANCED, command);
+	}
+
+	std::vector<ReplayedCommand> commands;
+
+private:
+	template<typename Command>
+	void Record(RenderCommandType type, const Command& command)
+	{
+		ReplayedCommand replayed = { type, std::vector<uint8_t>((const uint8_t*)&command, (const uint8_t*)&command + sizeof(command)) };
+		commands.push_back(replayed);
+	}
+};
+
+// Counts draws, the cost of a replay without a graphics API
+class NullBackend : public RenderCommandBackend
+{
+public:
+	NullBackend()
+		: drawCount(0)
+	{
+	}
+
+	virtual void ClearTarget(const ClearTargetCommand&) override {}
+	virtual void BindProgram(const BindProgramCommand&) override {}
+	virtual void BindTexture(const BindTextureCommand&) override {}
+	virtual void BindVertexBuffer(const BindVertexBufferCommand&) override {}
+	virtual void BindIndexBuffer(const BindIndexBufferCommand&) override {}
+
+	virtual void DrawIndexedInstanced(const DrawIndexedInstancedCommand& command) override
+	{
+		drawCount += command.instanceCount;
+	}
+
+	uint64_t drawCount;
+};
+
+template<typename Command>
+static ReplayedCommand MakeCommand(RenderCommandType type, const Command& command)
+{
+	ReplayedCommand replayed = { type, std::vector<uint8_t>((const uint8_t*)&command, (const uint8_t*)&command + sizeof(command)) };
+	return replayed;
+}
+
+// Commands of one draw of the job, every field depends on both
+static void RecordDraw(RenderCommandBuffer& buffer, uint32_t job, uint32_t draw)
+{
+	if (draw % 4 == 0)
+	{
+		buffer.BindProgram(job);
+		buffer.BindTexture(draw % 3, job * 1000 + draw);
+	}
+	buffer.DrawIndexedInstanced(36, 1 + draw % 5, draw, -(int32_t)job, job * 100000 + draw);
+}
+
+static std::vector<ReplayedCommand> Replay(const RenderCommandBuffer& buffer)
+{
+	RecordingBackend backend;
+	backend.Replay(buffer);
+	return backend.commands;
+}
+
+static void TestBuffer()
+{
+	RenderCommandBuffer buffer;
+	CHECK(buffer.GetSize() == 0 && buffer.GetCommandCount() == 0);
+	CHECK(Replay(buffer).empty());
+
+	const float color[4] = { 0.1f, 0.2f, 0.3f, 1.0f };
+	buffer.ClearTarget(2, color, -1.0f);
+	buffer.BindProgram(7);
+	buffer.BindTexture(3, 11);
+	buffer.BindVertexBuffer(1, 5);
+	buffer.BindIndexBuffer(9);
+	buffer.DrawIndexedInstanced(36, 4, 6, -12, 100);
+
+	ClearTargetCommand clear = { 2, { 0.1f, 0.2f, 0.3f, 1.0f }, -1.0f };
+	BindProgramCommand program = { 7 };
+	BindTextureCommand texture = { 3, 11 };
+	BindVertexBufferCommand vertexBuffer = { 1, 5 };
+	BindIndexBufferCommand indexBuffer = { 9 };
+	DrawIndexedInstancedCommand draw = { 36, 4, 6, -12, 100 };
+	std::vector<ReplayedCommand> expected;
+	expected.push_back(MakeCommand(RENDER_COMMAND_CLEAR_TARGET, clear));
+	expected.push_back(MakeCommand(RENDER_COMMAND_BIND_PROGRAM, program));
+	expected.push_back(MakeCommand(RENDER_COMMAND_BIND_TEXTURE, texture));
+	expected.push_back(MakeCommand(RENDER_COMMAND_BIND_VERTEX_BUFFER, vertexBuffer));
+	expected.push_back(MakeCommand(RENDER_COMMAND_BIND_INDEX_BUFFER, indexBuffer));
+	expected.push_back(MakeCommand(RENDER_COMMAND_DRAW_INDEXED_INSTANCED, draw));
+	CHECK(Replay(buffer) == expected);
+	CHECK(buffer.GetCommandCount() == 6);
+
+	// Packets are a header and the payload back to back, 4-byte aligned
+	uint32_t size = 0;
+	for (const ReplayedCommand& command : expected)
+	{
+		const RenderCommandHeader* pHeader = (const RenderCommandHeader*)(buffer.GetData() + size);
+		CHECK(pHeader->type == command.type && pHeader->size == sizeof(RenderCommandHeader) + command.payload.size());
+		CHECK(pHeader->size % 4 == 0);
+		size += pHeader->size;
+	}
+	CHECK(buffer.GetSize() == size);
+
+	// Appending copies the packets, Reset() keeps the memory
+	RenderCommandBuffer merged;
+	merged.Append(buffer);
+	merged.Append(RenderCommandBuffer());
+	merged.Append(buffer);
+	std::vector<ReplayedCommand> twice = expected;
+	twice.insert(twice.end(), expected.begin(), expected.end());
+	CHECK(Replay(merged) == twice);
+	CHECK(merged.GetSize() == 2 * size && merged.GetCommandCount() == 12);
+
+	const uint8_t* pData = merged.GetData();
+	merged.Reset();
+	CHECK(merged.GetSize() == 0 && merged.GetCommandCount() == 0 && Replay(merged).empty());
+	merged.BindProgram(1);
+	CHECK(merged.GetData() == pData);
+	CHECK(Replay(merged).size() == 1);
+
+	// Growing keeps what was written
+	RenderCommandBuffer large;
+	for (uint32_t i = 0; i < 10000; i++)
+	{
+		large.DrawIndexedInstanced(i, 1, 0, 0, 0);
+	}
+	std::vector<ReplayedCommand> draws = Replay(large);
+	bool inOrder = draws.size() == 10000;
+	for (uint32_t i = 0; i < draws.size() && inOrder; i++)
+	{
+		DrawIndexedInstancedCommand command;
+		memcpy(&command, draws[i].payload.data(), sizeof(command));
+		inOrder = command.indexCount == i;
+	}
+	CHECK(inOrder);
+}
+
+static void TestQueue()
+{
+	RenderCommandQueue queue;
+	std::thread::id callerThread = std::this_thread::get_id();
+
+	// Jobs of different lengths are merged in job order whatever order they finish in
+	for (uint32_t jobCount : { 1u, 2u, 7u, 3u })
+	{
+		bool firstOnCaller = false;
+		queue.Record(jobCount, [&](uint32_t job, RenderCommandBuffer& buffer)
+		{
+			if (job == 0)
+			{
+				firstOnCaller = std::this_thread::get_id() == callerThread;
+			}
+			for (uint32_t draw = 0; draw < 100 * (jobCount - job); draw++)
+			{
+				RecordDraw(buffer, job, draw);
+			}
+		});
+
+		RenderCommandBuffer expected;
+		for (uint32_t job = 0; job < jobCount; job++)
+		{
+			for (uint32_t draw = 0; draw < 100 * (jobCount - job); draw++)
+			{
+				RecordDraw(expected, job, draw);
+			}
+		}
+		const RenderCommandBuffer& merged = queue.GetMerged();
+		CHECK(firstOnCaller);
+		CHECK(merged.GetCommandCount() == expected.GetCommandCount());
+		CHECK(merged.GetSize() == expected.GetSize() && memcmp(merged.GetData(), expected.GetData(), expected.GetSize()) == 0);
+	}
+
+	// Jobs that record nothing leave no trace
+	queue.Record(4, [](uint32_t job, RenderCommandBuffer& buffer)
+	{
+		if (job == 2)
+		{
+			buffer.BindProgram(2);
+		}
+	});
+	std::vector<ReplayedCommand> commands = Replay(queue.GetMerged());
+	BindProgramCommand program = { 2 };
+	CHECK(commands.size() == 1 && commands[0] == MakeCommand(RENDER_COMMAND_BIND_PROGRAM, program));
+}
+
+void TestRenderCommands()
+{
+	TestBuffer();
+	TestQueue();
+}
+
+void BenchmarkRenderCommands(double seconds)
+{
+	printf("%-10s %14s %14s %14s\n", "draws", "1 job (ms)", "8 jobs (ms)", "replay (ms)");
+	for (uint32_t drawCount : BenchmarkDrawCounts)
+	{
+		RenderCommandQueue queue;
+		uint32_t jobCount = 1;
+		auto record = [&](uint32_t job, RenderCommandBuffer& buffer)
+		{
+			uint32_t first = (uint32_t)((uint64_t)drawCount * job / jobCount);
+			uint32_t last = (uint32_t)((uint64_t)drawCount * (job + 1) / jobCount);
+			for (uint32_t draw = first; draw < last; draw++)
+			{
+				RecordDraw(buffer, job, draw);
+			}
+		};
+		double singleMs = TimeWork(seconds / 3, [&]()
+		{
+			queue.Record(jobCount, record);
+		});
+		jobCount = BenchmarkJobCount;
+		double parallelMs = TimeWork(seconds / 3, [&]()
+		{
+			queue.Record(jobCount, record);
+		});
+
+		NullBackend backend;
+		double replayMs = TimeWork(seconds / 3, [&]()
+		{
+			backend.Replay(queue.GetMerged());
+		});
+
+		printf("%-10u %14.3f %14.3f %14.3f\n", drawCount, singleMs, parallelMs, replayMs);
+	}
+}
@@ -0,0 +1,140 @@
+#include <deque>
+#include <random>
+#include <vector>
+#include "RingAllocator.h"
+#include "TestFramework.h"
+
+struct Allocation
+{
+	uint64_t offset;
+	uint64_t size;
+};
+
+static bool Overlaps(const Allocation& a, const Allocation& b)
+{
+	return a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+}
+
+// Frames in flight with random sizes and alignments, retired a few frames
+// late as the GPU would. Live allocations may never overlap.
+static void TestRandomFrames()
+{
+	const uint64_t capacity = 4096;
+	const uint64_t latency = 3;
+
+	RingAllocator ring;
+	ring.Init(capacity);
+
+	std::minstd_rand random(1);
+	std::deque<std::vector<Allocation>> frames;
+	bool valid = true;
+	uint32_t failures = 0;
+	for (uint64_t fence = 1; fence <= 2000; fence++)
+	{
+		std::vector<Allocation> frame;
+		uint32_t count = (uint32_t)(random() % 8);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint64_t size = 1 + random() % 400;
+			uint64_t alignment = 1ull << (random() % 9);
+			uint64_t offset = ring.Allocate(size, alignment);
+			if (offset == RingAllocator::InvalidOffset)
+			{
+				failures++;
+				continue;
+			}
+
+			Allocation allocation = { offset, size };
+			valid = valid && offset % alignment == 0 && offset + size <= capacity;
+			for (const std::vector<Allocation>& live : frames)
+			{
+				for (const Allocation& other : live)
+				{
+					valid = valid && !Overlaps(allocation, other);
+				}
+			}
+			for (const Allocation& other : frame)
+			{
+				valid = valid && !Overlaps(allocation, other);
+			}
+			frame.push_back(allocation);
+		}
+
+		ring.FinishFrame(fence);
+		frames.push_back(frame);
+		valid = valid && ring.GetUsed() <= capacity;
+
+		if (fence > latency)
+		{
+			ring.Retire(fence - latency);
+			frames.pop_front();
+		}
+		valid = valid && ring.GetFramesInFlight() == frames.size();
+	}
+	CHECK(valid);
+
+	// The ring is small enough for frames to run out of space now and then
+	CHECK(failures > 0);
+
+	ring.Retire(~0ull);
+	CHECK(ring.GetUsed() == 0);
+	CHECK(ring.GetFramesInFlight() == 0);
+	CHECK(ring.Allocate(capacity, 256) == 0);
+}
+
+void TestRingAllocator()
+{
+	RingAllocator ring;
+	ring.Init(256);
+	CHECK(ring.GetCapacity() == 256);
+	CHECK(ring.GetOldestFence() == 0);
+
+	// Alignment padding is consumed with the allocation
+	CHECK(ring.Allocate(100, 16) == 0);
+	CHECK(ring.Allocate(50, 64) == 128);
+	CHECK(ring.GetUsed() == 178);
+	ring.FinishFrame(1);
+
+	CHECK(ring.Allocate(60, 16) == 192);
+	CHECK(ring.GetUsed() == 252);
+	ring.FinishFrame(2);
+	CHECK(ring.GetFramesInFlight() == 2);
+	CHECK(ring.GetOldestFence() == 1);
+
+	// Wrapping skips the 4 byte tail, the start is still used by frame 1
+	CHECK(ring.Allocate(40, 16) == RingAllocator::InvalidOffset);
+	ring.Retire(0);
+	CHECK(ring.Allocate(40, 16) == RingAllocator::InvalidOffset);
+	CHECK(ring.GetUsed() == 252);
+
+	// Once frame 1 retires the allocation wraps, the tail gap counts as used
+	ring.Retire(1);
+	CHECK(ring.GetUsed() == 74);
+	CHECK(ring.GetOldestFence() == 2);
+	CHECK(ring.Allocate(40, 16) == 0);
+	CHECK(ring.GetUsed() == 74 + 4 + 40);
+
+	// Space up to frame 2 is free, space of frame 2 is not
+	CHECK(ring.Allocate(100, 16) == 48);
+	CHECK(ring.Allocate(40, 16) == RingAllocator::InvalidOffset);
+	ring.FinishFrame(3);
+	CHECK(ring.GetUsed() == 74 + 152);
+
+	// Retiring frame 2 releases the space the tail gap was skipped for
+	ring.Retire(2);
+	CHECK(ring.GetUsed() == 152);
+	CHECK(ring.Allocate(40, 16) == 160);
+	ring.FinishFrame(4);
+
+	// Everything retired, allocation starts over at 0
+	ring.Retire(4);
+	CHECK(ring.GetUsed() == 0);
+	CHECK(ring.GetFramesInFlight() == 0);
+	CHECK(ring.Allocate(8, 4) == 0);
+
+	// Empty and oversized requests fail
+	CHECK(ring.Allocate(0, 4) == RingAllocator::InvalidOffset);
+	CHECK(ring.Allocate(257, 4) == RingAllocator::InvalidOffset);
+
+	TestRandomFrames();
+}
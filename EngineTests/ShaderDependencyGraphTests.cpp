@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "ShaderDependencyGraph.h"
+#include "TestFramework.h"
+
+// Include resolution prepends the directory of the including file, so roots
+// are given with one to check it
+static const char* CommonFile = "./EngineTests_Common.hlsli";
+static const char* LightingFile = "./EngineTests_Lighting.hlsli";
+static const char* CycleFile = "./EngineTests_Cycle.hlsli";
+static const char* ProgramFiles[] = { "./EngineTests_A.hlsl", "./EngineTests_B.hlsl", "./EngineTests_C.hlsl", "./EngineTests_D.hlsl" };
+
+static bool Contains(const std::vector<std::string>& files, const std::string& file)
+{
+	return std::find(files.begin(), files.end(), file) != files.end();
+}
+
+static void TestParseIncludes()
+{
+	std::vector<std::string> includes = ShaderDependencyGraph::ParseIncludes(
+		"#include \"a.hlsli\"\n"
+		"  \t#  include\t<b.hlsli>\r\n"
+		"// #include \"commented.hlsli\"\n"
+		"float4 x; #include \"not_at_line_start.hlsli\"\n"
+		"#include \"unterminated.hlsli\n"
+		"#includes \"c.hlsli\"\n"
+		"#define INCLUDE \"d.hlsli\"\n"
+		"#include \"sub/e.hlsli\"");
+
+	CHECK(includes.size() == 3);
+	CHECK(includes.size() > 0 && includes[0] == "a.hlsli");
+	CHECK(includes.size() > 1 && includes[1] == "b.hlsli");
+	CHECK(includes.size() > 2 && includes[2] == "sub/e.hlsli");
+
+	CHECK(ShaderDependencyGraph::ParseIncludes("").empty());
+	CHECK(ShaderDependencyGraph::ParseIncludes("#include").empty());
+}
+
+void TestShaderDependencyGraph()
+{
+	TestParseIncludes();
+
+	// A -> Lighting -> Common, B -> Common, C alone, D -> Cycle -> Cycle
+	bool written = WriteTestFile(CommonFile, "float4 Common;\n")
+		&& WriteTestFile(LightingFile, "#include \"EngineTests_Common.hlsli\"\n")
+		&& WriteTestFile(CycleFile, "#include \"EngineTests_Cycle.hlsli\"\n")
+		&& WriteTestFile(ProgramFiles[0], "#include \"EngineTests_Lighting.hlsli\"\nfloat4 A;\n")
+		&& WriteTestFile(ProgramFiles[1], "#include \"EngineTests_Common.hlsli\"\n")
+		&& WriteTestFile(ProgramFiles[2], "float4 C;\n");
+	CHECK(written);
+	remove(ProgramFiles[3]);
+
+	ShaderDependencyGraph graph;
+	for (unsigned int id = 0; id < 4; id++)
+	{
+		graph.AddProgram(id, ProgramFiles[id]);
+	}
+
+	std::vector<std::string> filesA = graph.GetProgramFiles(0);
+	CHECK(filesA.size() == 3);
+	CHECK(Contains(filesA, ProgramFiles[0]) && Contains(filesA, LightingFile) && Contains(filesA, CommonFile));
+	CHECK(graph.GetProgramFiles(2).size() == 1);
+	CHECK(graph.GetProgramFiles(7).empty());
+
+	CHECK(graph.GetAffectedPrograms(CommonFile) == std::vector<unsigned int>({ 0, 1 }));
+	CHECK(graph.GetAffectedPrograms(LightingFile) == std::vector<unsigned int>({ 0 }));
+	CHECK(graph.GetAffectedPrograms(ProgramFiles[2]) == std::vector<unsigned int>({ 2 }));
+	CHECK(graph.GetAffectedPrograms("./EngineTests_Unknown.hlsli").empty());
+
+	// Nothing changed since the programs were added
+	CHECK(graph.Poll().empty());
+
+	// The time has a resolution of a second, the size tells the writes apart
+	CHECK(WriteTestFile(CommonFile, "float4 Common;\nfloat4 Changed;\n"));
+	CHECK(graph.Poll() == std::vector<unsigned int>({ 0, 1 }));
+	CHECK(graph.Poll().empty());
+
+	// and the contents edits of the same size, as 11.2 to 11.3 in a second
+	CHECK(WriteTestFile(CommonFile, "float4 Common;\nfloat4 Changes;\n"));
+	CHECK(graph.Poll() == std::vector<unsigned int>({ 0, 1 }));
+	CHECK(graph.Poll().empty());
+
+	// A changed root is rescanned and picks up its new include
+	CHECK(WriteTestFile(ProgramFiles[2], "#include \"EngineTests_Lighting.hlsli\"\nfloat4 C;\n"));
+	CHECK(graph.Poll() == std::vector<unsigned int>({ 2 }));
+	CHECK(graph.GetAffectedPrograms(CommonFile) == std::vector<unsigned int>({ 0, 1, 2 }));
+	CHECK(graph.GetAffectedPrograms(LightingFile) == std::vector<unsigned int>({ 0, 2 }));
+
+	// A root that did not exist is reported once it is created, a self
+	// include ends the scan
+	CHECK(graph.GetProgramFiles(3).size() == 1);
+	CHECK(WriteTestFile(ProgramFiles[3], "#include \"EngineTests_Cycle.hlsli\"\n"));
+	CHECK(graph.Poll() == std::vector<unsigned int>({ 3 }));
+	CHECK(graph.GetProgramFiles(3).size() == 2);
+	CHECK(graph.GetAffectedPrograms(CycleFile) == std::vector<unsigned int>({ 3 }));
+
+	graph.RemoveProgram(1);
+	CHECK(graph.GetAffectedPrograms(CommonFile) == std::vector<unsigned int>({ 0, 2 }));
+	CHECK(graph.GetProgramFiles(1).empty());
+
+	// Adding an id again rescans it from the new root
+	graph.AddProgram(0, ProgramFiles[2]);
+	CHECK(graph.GetAffectedPrograms(ProgramFiles[0]).empty());
+	CHECK(graph.GetAffectedPrograms(ProgramFiles[2]) == std::vector<unsigned int>({ 0, 2 }));
+
+	remove(CommonFile);
+	remove(LightingFile);
+	remove(CycleFile);
+	for (const char* pFile : ProgramFiles)
+	{
+		remove(pFile);
+	}
+}
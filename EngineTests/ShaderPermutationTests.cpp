@@ -0,0 +1,127 @@
+#include <set>
+#include <string>
+#include <vector>
+#include "ColorShaderVariants.h"
+#include "ShaderPermutation.h"
+#include "TestFramework.h"
+
+static std::string ToString(const ShaderDefines& defines)
+{
+	std::string text;
+	for (const auto& define : defines)
+	{
+		text += text.empty() ? "" : ";";
+		text += define.first + "=" + define.second;
+	}
+	return text;
+}
+
+static void TestTable(const ShaderPermutationSpace& space)
+{
+	ShaderVariantTable table(space);
+	std::vector<uint32_t> keys = space.EnumerateKeys();
+	for (size_t i = 0; i < keys.size(); i += 2)
+	{
+		table.Insert(keys[i], (uint32_t)i);
+	}
+
+	bool found = true;
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		found = found && table.Find(keys[i]) == (i % 2 == 0 ? (uint32_t)i : ShaderVariantTable::Invalid);
+	}
+	CHECK(found);
+
+	table.MarkUsed(keys[0]);
+	table.MarkUsed(keys.back());
+	table.MarkUsed(keys[0]);
+	CHECK(table.GetUsedCount() == 2);
+}
+
+void TestShaderPermutation()
+{
+	ShaderPermutationSpace space = ColorShaderVariants::CreateSpace();
+	CHECK(space.GetAxisCount() == 6);
+	CHECK(space.GetKeyBits() == 9);
+	CHECK(space.GetVariantCount() == 240);
+
+	// Every variant once, each key valid and with its own defines
+	std::vector<uint32_t> keys = space.EnumerateKeys();
+	std::set<uint32_t> uniqueKeys(keys.begin(), keys.end());
+	std::set<std::string> uniqueDefines;
+	bool valid = true;
+	bool roundTrip = true;
+	for (uint32_t key : keys)
+	{
+		valid = valid && space.IsValid(key);
+		uniqueDefines.insert(ToString(space.GetDefines(key)));
+
+		uint32_t rebuilt = 0;
+		for (uint32_t axis = 0; axis < space.GetAxisCount(); axis++)
+		{
+			rebuilt = space.SetValue(rebuilt, axis, space.GetValue(key, axis));
+		}
+		roundTrip = roundTrip && rebuilt == key;
+	}
+	CHECK(keys.size() == 240);
+	CHECK(uniqueKeys.size() == keys.size());
+	CHECK(uniqueDefines.size() == keys.size());
+	CHECK(valid);
+	CHECK(roundTrip);
+
+	// Keys are stable: the same axes give the same keys in the same order,
+	// and the layout is the value index of each axis from the low bits up.
+	// ShaderTableGen items and caches depend on it.
+	CHECK(ColorShaderVariants::CreateSpace().EnumerateKeys() == keys);
+	CHECK(keys[0] == 0 && keys[1] == 1 && keys[5] == 8);
+	uint32_t key = space.SetValue(0, 0, 4);
+	key = space.SetValue(key, 1, 1);
+	key = space.SetValue(key, 2, 1);
+	key = space.SetValue(key, 3, 2);
+	key = space.SetValue(key, 4, 1);
+	key = space.SetValue(key, 5, 1);
+	CHECK(key == (4u | 1u << 3 | 1u << 4 | 2u << 5 | 1u << 7 | 1u << 8));
+	CHECK(space.SetValue(key, 3, 0) == (key & ~(3u << 5)));
+	CHECK(ToString(space.GetDefines(key)) == "LIGHT_COUNT=4;ALPHA_TEST=1;INSTANCED=1;VERTEX_FORMAT=2;CLUSTERED=1;OBJECT_LIGHTS=1");
+	CHECK(ToString(space.GetDefines(0)) == "LIGHT_COUNT=0;ALPHA_TEST=0;INSTANCED=0;VERTEX_FORMAT=0;CLUSTERED=0;OBJECT_LIGHTS=0");
+
+	// Values outside an axis and keys with out of range fields or stray bits
+	// are rejected
+	CHECK(space.HasValue(0, 0) && space.HasValue(0, 4));
+	CHECK(!space.HasValue(0, -1) && !space.HasValue(0, 5));
+	CHECK(!space.HasValue(3, 3));
+	CHECK(!space.IsValid(5));
+	CHECK(!space.IsValid(3u << 5));
+	CHECK(!space.IsValid(1u << 9));
+	CHECK(!space.IsValid(0xFFFFFFFFu));
+
+	// Offset and single valued axes
+	ShaderPermutationSpace offsetSpace;
+	offsetSpace.AddAxis("BIAS", 3, -1);
+	offsetSpace.AddAxis("FIXED", 1, 7);
+	CHECK(offsetSpace.GetKeyBits() == 2);
+	CHECK(offsetSpace.GetVariantCount() == 3);
+	CHECK(offsetSpace.HasValue(0, -1) && offsetSpace.HasValue(0, 1) && !offsetSpace.HasValue(0, 2) && !offsetSpace.HasValue(0, -2));
+	CHECK(offsetSpace.HasValue(1, 7) && !offsetSpace.HasValue(1, 8));
+	CHECK(offsetSpace.SetValue(0, 0, -1) == 0 && offsetSpace.SetValue(0, 0, 1) == 2);
+	CHECK(ToString(offsetSpace.GetDefines(2)) == "BIAS=1;FIXED=7");
+	CHECK(offsetSpace.EnumerateKeys() == std::vector<uint32_t>({ 0, 1, 2 }));
+	CHECK(!offsetSpace.IsValid(3));
+
+	// An empty space has the one variant without defines
+	ShaderPermutationSpace emptySpace;
+	CHECK(emptySpace.EnumerateKeys() == std::vector<uint32_t>({ 0 }));
+	CHECK(emptySpace.GetDefines(0).empty());
+
+	// Dense tables up to 16 key bits, hashed ones above
+	TestTable(space);
+	ShaderPermutationSpace largeSpace;
+	largeSpace.AddAxis("A", 64);
+	largeSpace.AddAxis("B", 40);
+	largeSpace.AddAxis("C", 33);
+	CHECK(largeSpace.GetKeyBits() == 18);
+	TestTable(largeSpace);
+
+	ShaderVariantTable table(space);
+	CHECK(table.Find(1u << 9) == ShaderVariantTable::Invalid);
+}
@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ShaderScheduler.h"
+#include "TestFramework.h"
+
+// Programs created by the stub compiles and not released yet
+static std::atomic<int> s_liveCount(0);
+
+// Stand-in for ShaderProgram, value 0 is the empty program
+struct TestProgram
+{
+	TestProgram()
+		: value(0)
+	{
+	}
+
+	void Release()
+	{
+		if (value != 0)
+		{
+			s_liveCount--;
+			value = 0;
+		}
+	}
+
+	uint32_t value;
+};
+
+static TestProgram MakeProgram(uint32_t value)
+{
+	TestProgram program;
+	program.value = value;
+	s_liveCount++;
+	return program;
+}
+
+typedef ShaderScheduler<TestProgram> TestScheduler;
+
+// Holds compiles until opened
+class Gate
+{
+public:
+	Gate()
+		: m_open(false)
+		, m_waiting(0)
+	{
+	}
+
+	void Wait()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_waiting++;
+		m_condition.notify_all();
+		m_condition.wait(lock, [this]() { return m_open; });
+	}
+
+	void WaitForWaiting(uint32_t count)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_condition.wait(lock, [this, count]() { return m_waiting >= count; });
+	}
+
+	void Open()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_open = true;
+		m_condition.notify_all();
+	}
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_open;
+	uint32_t m_waiting;
+};
+
+// Updates until a compile is published, false after a second
+static bool WaitForPublished(TestScheduler& scheduler, std::vector<TestScheduler::Published>* pPublished)
+{
+	pPublished->clear();
+	for (int i = 0; i < 1000 && pPublished->empty(); i++)
+	{
+		scheduler.Update(pPublished);
+		if (pPublished->empty())
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	return !pPublished->empty();
+}
+
+static void TestPriorityOrder()
+{
+	// The only worker is held in the first compile while the rest is queued
+	Gate gate;
+	std::mutex orderMutex;
+	std::vector<uint32_t> order;
+	TestScheduler scheduler;
+	scheduler.Init(1, [&](uint32_t id, TestProgram* pProgram)
+	{
+		if (id == 0)
+		{
+			gate.Wait();
+		}
+		std::lock_guard<std::mutex> lock(orderMutex);
+		order.push_back(id);
+		*pProgram = MakeProgram(id + 1);
+		return true;
+	}, TestProgram());
+
+	scheduler.Enqueue(scheduler.Add(1));
+	gate.WaitForWaiting(1);
+
+	const uint32_t priorities[] = { 1, 0, 2, 0, 1, 0, 2, 1 };
+	std::vector<uint32_t> expected;
+	for (uint32_t priority : priorities)
+	{
+		uint32_t id = scheduler.Add(priority);
+		scheduler.Enqueue(id);
+		expected.push_back(id);
+	}
+	std::stable_sort(expected.begin(), expected.end(), [&](uint32_t a, uint32_t b) { return priorities[a - 1] < priorities[b - 1]; });
+	expected.insert(expected.begin(), 0);
+
+	CHECK(scheduler.GetPendingCount() == 9);
+	gate.Open();
+	std::vector<TestScheduler::Published> published;
+	scheduler.Flush(&published);
+	CHECK(order == expected);
+	CHECK(published.size() == 9);
+	CHECK(scheduler.GetPendingCount() == 0);
+
+	bool ready = true;
+	for (uint32_t id = 0; id < scheduler.GetCount(); id++)
+	{
+		ready = ready && scheduler.IsReady(id) && scheduler.GetVersion(id) == 1 && scheduler.GetProgram(id).value == id + 1;
+	}
+	CHECK(ready);
+
+	scheduler.Term();
+	CHECK(s_liveCount == 0);
+}
+
+static void TestFallback()
+{
+	Gate gate;
+	std::atomic<bool> fail(false);
+	std::atomic<uint32_t> compileCount(0);
+	std::atomic<uint32_t> nextValue(1);
+	TestScheduler scheduler;
+	scheduler.Init(2, [&](uint32_t id, TestProgram* pProgram)
+	{
+		gate.Wait();
+		compileCount++;
+		if (fail || id == 1)
+		{
+			return false;
+		}
+		*pProgram = MakeProgram(nextValue++);
+		return true;
+	}, MakeProgram(1000));
+
+	// Compiling programs and ones that failed are drawn with the fallback
+	uint32_t good = scheduler.Add(0);
+	uint32_t bad = scheduler.Add(0);
+	scheduler.Enqueue(good);
+	scheduler.Enqueue(bad);
+	gate.WaitForWaiting(2);
+	CHECK(scheduler.Update() == 0);
+	CHECK(!scheduler.IsReady(good) && scheduler.GetProgram(good).value == 1000 && scheduler.GetVersion(good) == 0);
+	CHECK(scheduler.GetPendingCount() == 2);
+
+	gate.Open();
+	std::vector<TestScheduler::Published> published;
+	scheduler.Flush(&published);
+	CHECK(published.size() == 2);
+	CHECK(scheduler.IsReady(good) && scheduler.GetProgram(good).value == 1 && scheduler.GetVersion(good) == 1);
+	CHECK(!scheduler.IsReady(bad) && scheduler.GetProgram(bad).value == 1000 && scheduler.GetVersion(bad) == 0);
+	CHECK(scheduler.GetPendingCount() == 0);
+	for (const TestScheduler::Published& program : published)
+	{
+		CHECK(program.succeeded == (program.id == good));
+	}
+
+	// A failed recompile keeps the previous program
+	fail = true;
+	scheduler.Enqueue(good);
+	CHECK(WaitForPublished(scheduler, &published) && published.size() == 1 && !published[0].succeeded);
+	CHECK(scheduler.GetProgram(good).value == 1 && scheduler.GetVersion(good) == 1);
+
+	// A successful one replaces and releases it
+	fail = false;
+	scheduler.Enqueue(good);
+	CHECK(WaitForPublished(scheduler, &published) && published.size() == 1 && published[0].succeeded);
+	CHECK(scheduler.GetProgram(good).value == 2 && scheduler.GetVersion(good) == 2);
+	CHECK(s_liveCount == 2);
+
+	// Handed over programs are published without a compile
+	uint32_t compiles = compileCount;
+	uint32_t embedded = scheduler.Add(0);
+	scheduler.SetCompiled(embedded, MakeProgram(500));
+	CHECK(scheduler.GetProgram(embedded).value == 1000 && scheduler.GetPendingCount() == 1);
+	CHECK(scheduler.Update() == 1);
+	CHECK(scheduler.GetProgram(embedded).value == 500 && scheduler.GetVersion(embedded) == 1);
+	CHECK(compileCount == compiles);
+	scheduler.Flush();
+
+	scheduler.Term();
+	CHECK(s_liveCount == 0);
+	CHECK(scheduler.GetFallbackProgram().value == 0);
+}
+
+static void TestFlush()
+{
+	// Flush returns with every program published, while workers still compile
+	for (uint32_t workerCount : { 1u, 4u })
+	{
+		TestScheduler scheduler;
+		scheduler.Init(workerCount, [](uint32_t id, TestProgram* pProgram)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(id % 4 * 200));
+			*pProgram = MakeProgram(id + 1);
+			return true;
+		}, TestProgram());
+
+		for (uint32_t i = 0; i < 48; i++)
+		{
+			scheduler.Enqueue(scheduler.Add(i % 3));
+		}
+		scheduler.Flush();
+		CHECK(scheduler.GetPendingCount() == 0);
+
+		bool ready = true;
+		for (uint32_t id = 0; id < scheduler.GetCount(); id++)
+		{
+			ready = ready && scheduler.IsReady(id) && scheduler.GetProgram(id).value == id + 1;
+		}
+		CHECK(ready);
+		CHECK(scheduler.Update() == 0);
+
+		// Flush waits for first compiles only, nothing queued returns at once
+		scheduler.Flush();
+		scheduler.Term();
+		CHECK(s_liveCount == 0);
+	}
+}
+
+void TestShaderScheduler()
+{
+	TestPriorityOrder();
+	TestFallback();
+	TestFlush();
+}
+
+// Startup with stub compiles that sleep: the first frame program is
+// requested after the deferred ones, as a late variant would be
+void BenchmarkShaderScheduler(double seconds)
+{
+	static const uint32_t DeferredCount = 6;
+	static const uint32_t CompileMs = 20;
+
+	printf("%-8s %20s %20s\n", "workers", "first frame (ms)", "all programs (ms)");
+	printf("%-8s %20.1f %20.1f\n", "serial", (double)(DeferredCount + 1) * CompileMs, (double)(DeferredCount + 1) * CompileMs);
+	for (uint32_t workerCount : { 1u, 2u, 4u })
+	{
+		double firstMs = 0;
+		double allMs = TimeWork(seconds / 3, [&]()
+		{
+			auto start = std::chrono::steady_clock::now();
+			TestScheduler scheduler;
+			scheduler.Init(workerCount, [](uint32_t, TestProgram* pProgram)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(CompileMs));
+				*pProgram = MakeProgram(1);
+				return true;
+			}, TestProgram());
+
+			for (uint32_t i = 0; i < DeferredCount; i++)
+			{
+				scheduler.Enqueue(scheduler.Add(1));
+			}
+			uint32_t first = scheduler.Add(0);
+			scheduler.Enqueue(first);
+
+			while (!scheduler.IsReady(first))
+			{
+				scheduler.Update();
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			firstMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			scheduler.Flush();
+			scheduler.Term();
+		});
+		printf("%-8u %20.1f %20.1f\n", workerCount, firstMs, allMs);
+	}
+}
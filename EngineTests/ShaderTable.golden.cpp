@@ -0,0 +1,57 @@
+// Generated by ShaderTableGen, do not edit.
+
+#include "ShaderTable.h"
+
+// ColorShader.hlsl VS LIGHT_COUNT=3;ALPHA_TEST=0;INSTANCED=1;VERTEX_FORMAT=1;CLUSTERED=0;OBJECT_LIGHTS=0
+static constexpr unsigned char Bytecode0[5] = {
+	0x44, 0x58, 0x42, 0x43, 0x04,
+};
+
+// ColorShader.hlsl PS LIGHT_COUNT=3;ALPHA_TEST=0;INSTANCED=1;VERTEX_FORMAT=1;CLUSTERED=0;OBJECT_LIGHTS=0
+static constexpr unsigned char Bytecode1[5] = {
+	0x44, 0x58, 0x42, 0x43, 0x05,
+};
+
+// ColorShader.hlsl VS LIGHT_COUNT=0;ALPHA_TEST=0;INSTANCED=1;VERTEX_FORMAT=1;CLUSTERED=0;OBJECT_LIGHTS=1
+static constexpr unsigned char Bytecode2[5] = {
+	0x44, 0x58, 0x42, 0x43, 0x06,
+};
+
+// ColorShader.hlsl PS LIGHT_COUNT=0;ALPHA_TEST=0;INSTANCED=1;VERTEX_FORMAT=1;CLUSTERED=0;OBJECT_LIGHTS=1
+static constexpr unsigned char Bytecode3[6] = {
+	0x44, 0x58, 0x42, 0x43, 0x07, 0x08,
+};
+
+// ColorShader.hlsl VS LIGHT_COUNT=0;ALPHA_TEST=0;INSTANCED=1;VERTEX_FORMAT=1;CLUSTERED=1;OBJECT_LIGHTS=0
+static constexpr unsigned char Bytecode4[24] = {
+	0x44, 0x58, 0x42, 0x43, 0x0b, 0x30, 0x55, 0x7a, 0x9f, 0xc4, 0xe9, 0x0e, 0x33, 0x58, 0x7d, 0xa2,
+	0xc7, 0xec, 0x11, 0x36, 0x5b, 0x80, 0xa5, 0xca,
+};
+
+// ColorShader.hlsl PS LIGHT_COUNT=0;ALPHA_TEST=0;INSTANCED=1;VERTEX_FORMAT=1;CLUSTERED=1;OBJECT_LIGHTS=0
+static constexpr unsigned char Bytecode5[8] = {
+	0x44, 0x58, 0x42, 0x43, 0x00, 0xff, 0x22, 0x5c,
+};
+
+// U2Shader.hlsl PS TONEMAP_OPERATOR=0
+static constexpr unsigned char Bytecode6[5] = {
+	0x44, 0x58, 0x42, 0x43, 0x01,
+};
+
+// Shaders\AB "Shader".hlsl VS
+static constexpr unsigned char Bytecode7[6] = {
+	0x44, 0x58, 0x42, 0x43, 0x02, 0x03,
+};
+
+const ShaderTableEntry g_shaderTable[] = {
+	{ "ColorShader.hlsl", "VS", "LIGHT_COUNT=3;ALPHA_TEST=0;INSTANCED=1;VERTEX_FORMAT=1;CLUSTERED=0;OBJECT_LIGHTS=0", Bytecode0, sizeof(Bytecode0) },
+	{ "ColorShader.hlsl", "PS", "LIGHT_COUNT=3;ALPHA_TEST=0;INSTANCED=1;VERTEX_FORMAT=1;CLUSTERED=0;OBJECT_LIGHTS=0", Bytecode1, sizeof(Bytecode1) },
+	{ "ColorShader.hlsl", "VS", "LIGHT_COUNT=0;ALPHA_TEST=0;INSTANCED=1;VERTEX_FORMAT=1;CLUSTERED=0;OBJECT_LIGHTS=1", Bytecode2, sizeof(Bytecode2) },
+	{ "ColorShader.hlsl", "PS", "LIGHT_COUNT=0;ALPHA_TEST=0;INSTANCED=1;VERTEX_FORMAT=1;CLUSTERED=0;OBJECT_LIGHTS=1", Bytecode3, sizeof(Bytecode3) },
+	{ "ColorShader.hlsl", "VS", "LIGHT_COUNT=0;ALPHA_TEST=0;INSTANCED=1;VERTEX_FORMAT=1;CLUSTERED=1;OBJECT_LIGHTS=0", Bytecode4, sizeof(Bytecode4) },
+	{ "ColorShader.hlsl", "PS", "LIGHT_COUNT=0;ALPHA_TEST=0;INSTANCED=1;VERTEX_FORMAT=1;CLUSTERED=1;OBJECT_LIGHTS=0", Bytecode5, sizeof(Bytecode5) },
+	{ "U2Shader.hlsl", "PS", "TONEMAP_OPERATOR=0", Bytecode6, sizeof(Bytecode6) },
+	{ "Shaders\\AB \"Shader\".hlsl", "VS", "", Bytecode7, sizeof(Bytecode7) },
+};
+
+const size_t g_shaderTableSize = 8;
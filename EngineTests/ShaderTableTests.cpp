@@ -0,0 +1,87 @@
+#include <string.h>
+#include <string>
+#include "BuiltinScene.h"
+#include "ColorShaderVariants.h"
+#include "ShaderTable.h"
+#include "TestFramework.h"
+
+// ShaderTable.golden.cpp is ShaderTableGen output for blobs with these
+// bytes, regenerated with
+// ShaderTableGen ShaderTable.golden.cpp "ColorShader.hlsl|VS|<array defines>|array_vs.cso"
+//     "ColorShader.hlsl|PS|<array defines>|array_ps.cso" "ColorShader.hlsl|VS|<object defines>|object_vs.cso"
+//     "ColorShader.hlsl|PS|<object defines>|object_ps.cso" "ColorShader.hlsl|VS|<clustered defines>|vs.cso"
+//     "ColorShader.hlsl|PS|<clustered defines>|ps.cso" "U2Shader.hlsl|PS|TONEMAP_OPERATOR=0|u2.cso"
+//     "Shaders\AB \"Shader\".hlsl|VS||ab.cso"
+static const unsigned char ColorArrayVSBytecode[5] = { 0x44, 0x58, 0x42, 0x43, 0x04 };
+static const unsigned char ColorArrayPSBytecode[5] = { 0x44, 0x58, 0x42, 0x43, 0x05 };
+static const unsigned char ColorObjectVSBytecode[5] = { 0x44, 0x58, 0x42, 0x43, 0x06 };
+static const unsigned char ColorObjectPSBytecode[6] = { 0x44, 0x58, 0x42, 0x43, 0x07, 0x08 };
+static const unsigned char ColorVSBytecode[24] = {
+	0x44, 0x58, 0x42, 0x43, 0x0b, 0x30, 0x55, 0x7a, 0x9f, 0xc4, 0xe9, 0x0e, 0x33, 0x58, 0x7d, 0xa2,
+	0xc7, 0xec, 0x11, 0x36, 0x5b, 0x80, 0xa5, 0xca
+};
+static const unsigned char ColorPSBytecode[8] = { 0x44, 0x58, 0x42, 0x43, 0x00, 0xff, 0x22, 0x5c };
+static const unsigned char U2PSBytecode[5] = { 0x44, 0x58, 0x42, 0x43, 0x01 };
+static const unsigned char ABVSBytecode[6] = { 0x44, 0x58, 0x42, 0x43, 0x02, 0x03 };
+
+static const char* ArrayDefines = "LIGHT_COUNT=3;ALPHA_TEST=0;INSTANCED=1;VERTEX_FORMAT=1;CLUSTERED=0;OBJECT_LIGHTS=0";
+static const char* ObjectDefines = "LIGHT_COUNT=0;ALPHA_TEST=0;INSTANCED=1;VERTEX_FORMAT=1;CLUSTERED=0;OBJECT_LIGHTS=1";
+static const char* SceneDefines = "LIGHT_COUNT=0;ALPHA_TEST=0;INSTANCED=1;VERTEX_FORMAT=1;CLUSTERED=1;OBJECT_LIGHTS=0";
+
+static bool Matches(const ShaderTableEntry* pEntry, const unsigned char* pBytecode, size_t size)
+{
+	return pEntry != NULL && pEntry->size == size && memcmp(pEntry->pBytecode, pBytecode, size) == 0;
+}
+
+static std::string GetSceneDefines(uint32_t lightCount)
+{
+	ShaderPermutationSpace space = ColorShaderVariants::CreateSpace();
+	std::string text;
+	for (const auto& define : space.GetDefines(ColorShaderVariants::GetSceneKey(space, lightCount)))
+	{
+		text += text.empty() ? "" : ";";
+		text += define.first + "=" + define.second;
+	}
+	return text;
+}
+
+void TestShaderTable()
+{
+	CHECK(g_shaderTableSize == 8);
+
+	CHECK(Matches(FindShaderBytecode("ColorShader.hlsl", "VS", ArrayDefines), ColorArrayVSBytecode, sizeof(ColorArrayVSBytecode)));
+	CHECK(Matches(FindShaderBytecode("ColorShader.hlsl", "PS", ArrayDefines), ColorArrayPSBytecode, sizeof(ColorArrayPSBytecode)));
+	CHECK(Matches(FindShaderBytecode("ColorShader.hlsl", "VS", ObjectDefines), ColorObjectVSBytecode, sizeof(ColorObjectVSBytecode)));
+	CHECK(Matches(FindShaderBytecode("ColorShader.hlsl", "PS", ObjectDefines), ColorObjectPSBytecode, sizeof(ColorObjectPSBytecode)));
+	CHECK(Matches(FindShaderBytecode("ColorShader.hlsl", "VS", SceneDefines), ColorVSBytecode, sizeof(ColorVSBytecode)));
+	CHECK(Matches(FindShaderBytecode("ColorShader.hlsl", "PS", SceneDefines), ColorPSBytecode, sizeof(ColorPSBytecode)));
+	CHECK(Matches(FindShaderBytecode("U2Shader.hlsl", "PS", "TONEMAP_OPERATOR=0"), U2PSBytecode, sizeof(U2PSBytecode)));
+	CHECK(Matches(FindShaderBytecode("Shaders\\AB \"Shader\".hlsl", "VS", ""), ABVSBytecode, sizeof(ABVSBytecode)));
+
+	// Lookups match file, entry point and defines exactly
+	CHECK(FindShaderBytecode("U2Shader.hlsl", "VS", "TONEMAP_OPERATOR=0") == NULL);
+	CHECK(FindShaderBytecode("U2Shader.hlsl", "PS", "TONEMAP_OPERATOR=1") == NULL);
+	CHECK(FindShaderBytecode("U2Shader.hlsl", "PS", "") == NULL);
+	CHECK(FindShaderBytecode("u2shader.hlsl", "PS", "TONEMAP_OPERATOR=0") == NULL);
+	CHECK(FindShaderBytecode("ColorShader", "VS", SceneDefines) == NULL);
+	CHECK(FindShaderBytecode("ColorShader.hlsl", "VS", "ALPHA_TEST=0;LIGHT_COUNT=0;INSTANCED=1;VERTEX_FORMAT=1;CLUSTERED=1;OBJECT_LIGHTS=0") == NULL);
+	CHECK(FindShaderBytecode("Shaders\\AB \"Shader\".hlsl", "PS", "") == NULL);
+
+	// The variants the renderer requests for the built-in scene light setups,
+	// one per light mode, which is what DirectX11_app.vcxproj embeds and
+	// ShaderTableGen enforces
+	CHECK(GetSceneDefines(BuiltinScene::GetLightCount(BuiltinScene::LIGHTS_RED)) == ArrayDefines);
+	CHECK(GetSceneDefines(BuiltinScene::GetLightCount(BuiltinScene::LIGHTS_SMALL_FIELD)) == ObjectDefines);
+	CHECK(GetSceneDefines(BuiltinScene::GetLightCount(BuiltinScene::LIGHTS_FIELD)) == SceneDefines);
+	CHECK(ColorShaderVariants::GetLightMode(BuiltinScene::GetLightCount(BuiltinScene::LIGHTS_RED)) == LIGHT_MODE_ARRAY);
+	CHECK(ColorShaderVariants::GetLightMode(BuiltinScene::GetLightCount(BuiltinScene::LIGHTS_SMALL_FIELD)) == LIGHT_MODE_OBJECT);
+	CHECK(ColorShaderVariants::GetLightMode(BuiltinScene::GetLightCount(BuiltinScene::LIGHTS_FIELD)) == LIGHT_MODE_CLUSTERED);
+
+	CHECK(ColorShaderVariants::GetLightMode(0) == LIGHT_MODE_ARRAY);
+	CHECK(ColorShaderVariants::GetLightMode(ColorShaderVariants::MaxLightCount) == LIGHT_MODE_ARRAY);
+	CHECK(ColorShaderVariants::GetLightMode(ColorShaderVariants::MaxLightCount + 1) == LIGHT_MODE_OBJECT);
+	CHECK(ColorShaderVariants::GetLightMode(ColorShaderVariants::MaxObjectModeLightCount) == LIGHT_MODE_OBJECT);
+	CHECK(ColorShaderVariants::GetLightMode(ColorShaderVariants::MaxObjectModeLightCount + 1) == LIGHT_MODE_CLUSTERED);
+	CHECK(GetSceneDefines(2) == "LIGHT_COUNT=2;ALPHA_TEST=0;INSTANCED=1;VERTEX_FORMAT=1;CLUSTERED=0;OBJECT_LIGHTS=0");
+	CHECK(GetSceneDefines(20) == ObjectDefines);
+}
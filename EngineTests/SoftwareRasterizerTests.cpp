@@ -0,0 +1,329 @@
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include "SoftwareRasterizer.h"
+#include "TestFramework.h"
+
+static const uint32_t ClearColor = 0xFF000000;
+static const uint32_t Red = 0xFF0000FF;
+static const uint32_t Green = 0xFF00FF00;
+static const uint32_t Blue = 0xFFFF0000;
+
+// Small worker counts split the draws between setup workers
+static const uint32_t WorkerCounts[] = { 1, 3 };
+
+static const float Identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+struct TestVertex
+{
+	float position[3];
+	float color[3];
+};
+
+// Triangles with positions given in pixels, y down, drawn with w = 1. The
+// rasterizer reads the vertices at Flush(), so the scene keeps them.
+class TestScene
+{
+public:
+	TestScene(uint32_t width, uint32_t height)
+		: m_width((float)width)
+		, m_height((float)height)
+	{
+	}
+
+	void Add(float x, float y, float z, uint32_t color)
+	{
+		TestVertex vertex = { { x / m_width * 2 - 1, 1 - y / m_height * 2, z },
+			{ (float)(color & 0xFF) / 255, (float)((color >> 8) & 0xFF) / 255, (float)((color >> 16) & 0xFF) / 255 } };
+		m_vertices.push_back(vertex);
+	}
+
+	void AddTriangle(const float* p0, const float* p1, const float* p2, float z, uint32_t color)
+	{
+		Add(p0[0], p0[1], z, color);
+		Add(p1[0], p1[1], z, color);
+		Add(p2[0], p2[1], z, color);
+	}
+
+	// Every triangle added as its own draw, in order
+	void Draw(SoftwareRasterizer& rasterizer)
+	{
+		m_indices.resize(m_vertices.size());
+		for (uint32_t i = 0; i < (uint32_t)m_indices.size(); i++)
+		{
+			m_indices[i] = i;
+		}
+		for (uint32_t i = 0; i + 3 <= (uint32_t)m_vertices.size(); i += 3)
+		{
+			rasterizer.Draw(Identity, m_vertices[0].position, sizeof(TestVertex), m_vertices[0].color, sizeof(TestVertex),
+				(uint32_t)m_vertices.size(), m_indices.data() + i, 3);
+		}
+	}
+
+private:
+	float m_width;
+	float m_height;
+	std::vector<TestVertex> m_vertices;
+	std::vector<uint32_t> m_indices;
+};
+
+static uint32_t GetPixel(const SoftwareRasterizer& rasterizer, uint32_t x, uint32_t y)
+{
+	return rasterizer.GetColorBuffer()[y * rasterizer.GetPitch() + x];
+}
+
+static uint32_t CountPixels(const SoftwareRasterizer& rasterizer, uint32_t color)
+{
+	uint32_t count = 0;
+	for (uint32_t y = 0; y < rasterizer.GetHeight(); y++)
+	{
+		for (uint32_t x = 0; x < rasterizer.GetWidth(); x++)
+		{
+			count += GetPixel(rasterizer, x, y) == color ? 1 : 0;
+		}
+	}
+	return count;
+}
+
+// Two clockwise triangles covering the whole target
+static void AddFullScreen(TestScene& scene, uint32_t width, uint32_t height, float z, uint32_t color)
+{
+	const float topLeft[2] = { 0, 0 }, topRight[2] = { (float)width, 0 };
+	const float bottomLeft[2] = { 0, (float)height }, bottomRight[2] = { (float)width, (float)height };
+	scene.AddTriangle(topLeft, topRight, bottomLeft, z, color);
+	scene.AddTriangle(topRight, bottomRight, bottomLeft, z, color);
+}
+
+static void TestDepth(uint32_t workerCount)
+{
+	// Later draws only win where they are strictly nearer
+	const uint32_t Size = 8;
+	SoftwareRasterizer rasterizer;
+	rasterizer.Init(Size, Size, workerCount);
+	rasterizer.Clear(ClearColor);
+
+	TestScene scene(Size, Size);
+	AddFullScreen(scene, Size, Size, 0.5f, Red);
+	AddFullScreen(scene, Size, Size, 0.75f, Green);
+	AddFullScreen(scene, Size, Size, 0.5f, Blue);
+	const float a[2] = { 0, 0 }, b[2] = { 8, 0 }, c[2] = { 0, 8 };
+	scene.AddTriangle(a, b, c, 0.25f, Green);
+	scene.Draw(rasterizer);
+	rasterizer.Flush();
+
+	// The green triangle covers the pixel centers above its diagonal, the
+	// ones on it belong to the bottom right triangle of a quad
+	bool depthOk = true;
+	for (uint32_t y = 0; y < Size; y++)
+	{
+		for (uint32_t x = 0; x < Size; x++)
+		{
+			bool near = x + y + 1 < Size;
+			depthOk = depthOk && GetPixel(rasterizer, x, y) == (near ? Green : Red) &&
+				rasterizer.GetDepthBuffer()[y * rasterizer.GetPitch() + x] == (near ? 0.25f : 0.5f);
+		}
+	}
+	CHECK(depthOk);
+
+	SoftwareRasterizer::Stats stats = rasterizer.GetStats();
+	CHECK(stats.triangleCount == 7 && stats.culledCount == 0 && stats.clippedCount == 0);
+	CHECK(stats.pixelCount == Size * Size + (Size * (Size - 1)) / 2);
+
+	// A draw at the cleared depth fails the test
+	rasterizer.Clear(ClearColor, 0.5f);
+	TestScene equal(Size, Size);
+	AddFullScreen(equal, Size, Size, 0.5f, Red);
+	equal.Draw(rasterizer);
+	rasterizer.Flush();
+	CHECK(CountPixels(rasterizer, ClearColor) == Size * Size && rasterizer.GetStats().pixelCount == 0);
+}
+
+static void TestCulling(uint32_t workerCount)
+{
+	const uint32_t Size = 8;
+	SoftwareRasterizer rasterizer;
+	rasterizer.Init(Size, Size, workerCount);
+	rasterizer.Clear(ClearColor);
+
+	// Counterclockwise on screen is a back face
+	const float a[2] = { 0, 0 }, b[2] = { 8, 0 }, c[2] = { 0, 8 };
+	TestScene scene(Size, Size);
+	scene.AddTriangle(a, c, b, 0.5f, Red);
+	scene.Draw(rasterizer);
+	rasterizer.Flush();
+
+	SoftwareRasterizer::Stats stats = rasterizer.GetStats();
+	CHECK(CountPixels(rasterizer, ClearColor) == Size * Size);
+	CHECK(stats.triangleCount == 1 && stats.culledCount == 1 && stats.pixelCount == 0 && stats.binnedCount == 0);
+
+	// The same triangle the other way around is drawn
+	TestScene front(Size, Size);
+	front.AddTriangle(a, b, c, 0.5f, Red);
+	front.Draw(rasterizer);
+	rasterizer.Flush();
+	CHECK(CountPixels(rasterizer, Red) == (Size * (Size - 1)) / 2 && rasterizer.GetStats().culledCount == 0);
+
+	// Triangles covering no pixel center are culled too
+	const float d[2] = { 1.6f, 1.6f }, e[2] = { 1.9f, 1.6f }, f[2] = { 1.6f, 1.9f };
+	TestScene sliver(Size, Size);
+	sliver.AddTriangle(d, e, f, 0.25f, Green);
+	sliver.Draw(rasterizer);
+	rasterizer.Flush();
+	CHECK(CountPixels(rasterizer, Green) == 0 && rasterizer.GetStats().culledCount == 1);
+}
+
+static void TestFillRule(uint32_t workerCount)
+{
+	// Quads of the same depth meeting on pixel centers. The right quad owns
+	// the centers on a vertical edge, as its left edge, and the bottom quad
+	// the ones on a horizontal edge, as its top edge.
+	const uint32_t Size = 8;
+	SoftwareRasterizer rasterizer;
+	rasterizer.Init(Size, Size, workerCount);
+
+	const float topLeft[2] = { 0, 0 }, topRight[2] = { 8, 0 }, bottomLeft[2] = { 0, 8 }, bottomRight[2] = { 8, 8 };
+	const float top[2] = { 4.5f, 0 }, bottom[2] = { 4.5f, 8 };
+	rasterizer.Clear(ClearColor);
+	TestScene vertical(Size, Size);
+	vertical.AddTriangle(topLeft, top, bottomLeft, 0.5f, Red);
+	vertical.AddTriangle(top, bottom, bottomLeft, 0.5f, Red);
+	vertical.AddTriangle(top, topRight, bottom, 0.5f, Green);
+	vertical.AddTriangle(topRight, bottomRight, bottom, 0.5f, Green);
+	vertical.Draw(rasterizer);
+	rasterizer.Flush();
+
+	bool verticalOk = true;
+	for (uint32_t y = 0; y < Size; y++)
+	{
+		for (uint32_t x = 0; x < Size; x++)
+		{
+			verticalOk = verticalOk && GetPixel(rasterizer, x, y) == (x < 4 ? Red : Green);
+		}
+	}
+	CHECK(verticalOk);
+	CHECK(rasterizer.GetStats().pixelCount == Size * Size);
+
+	const float left[2] = { 0, 4.5f }, right[2] = { 8, 4.5f };
+	rasterizer.Clear(ClearColor);
+	TestScene horizontal(Size, Size);
+	horizontal.AddTriangle(topLeft, topRight, left, 0.5f, Red);
+	horizontal.AddTriangle(topRight, right, left, 0.5f, Red);
+	horizontal.AddTriangle(left, right, bottomLeft, 0.5f, Green);
+	horizontal.AddTriangle(right, bottomRight, bottomLeft, 0.5f, Green);
+	horizontal.Draw(rasterizer);
+	rasterizer.Flush();
+
+	bool horizontalOk = true;
+	for (uint32_t y = 0; y < Size; y++)
+	{
+		for (uint32_t x = 0; x < Size; x++)
+		{
+			horizontalOk = horizontalOk && GetPixel(rasterizer, x, y) == (y < 4 ? Red : Green);
+		}
+	}
+	CHECK(horizontalOk);
+	CHECK(rasterizer.GetStats().pixelCount == Size * Size);
+}
+
+static void TestSharedEdges(uint32_t workerCount)
+{
+	// A fan around a center point, each triangle nearer than the previous
+	// one: a pixel covered twice passes the depth test twice, one left out
+	// keeps the clear color. Centers on pixel centers, pixel corners and in
+	// between, on targets smaller and larger than a tile.
+	const uint32_t Sizes[][2] = { { 8, 8 }, { 100, 70 } };
+	const float Centers[][2] = { { 0.5f, 0.5f }, { 0.0f, 0.0f }, { 0.3125f, 0.6875f }, { 0.2f, 0.9f } };
+	for (const uint32_t* size : Sizes)
+	{
+		float w = (float)size[0], h = (float)size[1];
+		const float ring[8][2] = { { 0, 0 }, { w * 0.5f, 0 }, { w, 0 }, { w, h * 0.5f }, { w, h }, { w * 0.5f, h }, { 0, h }, { 0, h * 0.5f } };
+
+		SoftwareRasterizer rasterizer;
+		rasterizer.Init(size[0], size[1], workerCount);
+		bool fanOk = true;
+		for (const float* offset : Centers)
+		{
+			const float center[2] = { floorf(w * 0.37f) + offset[0], floorf(h * 0.61f) + offset[1] };
+			TestScene scene(size[0], size[1]);
+			for (int i = 0; i < 8; i++)
+			{
+				scene.AddTriangle(center, ring[i], ring[(i + 1) % 8], 0.9f - i * 0.1f, i % 2 == 0 ? Red : Green);
+			}
+
+			rasterizer.Clear(ClearColor);
+			scene.Draw(rasterizer);
+			rasterizer.Flush();
+
+			SoftwareRasterizer::Stats stats = rasterizer.GetStats();
+			fanOk = fanOk && stats.culledCount == 0 && stats.pixelCount == size[0] * size[1] &&
+				CountPixels(rasterizer, ClearColor) == 0;
+		}
+		CHECK(fanOk);
+	}
+}
+
+static void TestClipping(uint32_t workerCount)
+{
+	const uint32_t Size = 8;
+	SoftwareRasterizer rasterizer;
+	rasterizer.Init(Size, Size, workerCount);
+
+	// Far beyond the guard band on every side, clipped to a polygon that
+	// still covers every pixel once
+	rasterizer.Clear(ClearColor);
+	const float a[2] = { -20000, -20000 }, b[2] = { 60000, -20000 }, c[2] = { -20000, 60000 };
+	TestScene large(Size, Size);
+	large.AddTriangle(a, b, c, 0.5f, Red);
+	large.Draw(rasterizer);
+	rasterizer.Flush();
+
+	SoftwareRasterizer::Stats stats = rasterizer.GetStats();
+	CHECK(CountPixels(rasterizer, Red) == Size * Size);
+	CHECK(stats.clippedCount == 1 && stats.pixelCount == Size * Size);
+
+	// Entirely outside one plane is culled without clipping
+	rasterizer.Clear(ClearColor);
+	const float d[2] = { -30000, 0 }, e[2] = { -20000, 0 }, f[2] = { -30000, 8 };
+	TestScene outside(Size, Size);
+	outside.AddTriangle(d, e, f, 0.5f, Red);
+	outside.Draw(rasterizer);
+	rasterizer.Flush();
+	CHECK(CountPixels(rasterizer, ClearColor) == Size * Size);
+	CHECK(rasterizer.GetStats().clippedCount == 0 && rasterizer.GetStats().culledCount == 1);
+
+	// Crossing the near plane: z runs from -0.5 on the left to 0.5 on the
+	// right, so the columns left of the middle are cut off
+	rasterizer.Clear(ClearColor);
+	TestScene near(Size, Size);
+	near.Add(0, 0, -0.5f, Green);
+	near.Add(8, 0, 0.5f, Green);
+	near.Add(0, 8, -0.5f, Green);
+	near.Add(8, 0, 0.5f, Green);
+	near.Add(8, 8, 0.5f, Green);
+	near.Add(0, 8, -0.5f, Green);
+	near.Draw(rasterizer);
+	rasterizer.Flush();
+
+	bool nearOk = true;
+	for (uint32_t y = 0; y < Size; y++)
+	{
+		for (uint32_t x = 0; x < Size; x++)
+		{
+			nearOk = nearOk && GetPixel(rasterizer, x, y) == (x < Size / 2 ? ClearColor : Green);
+		}
+	}
+	CHECK(nearOk);
+	CHECK(rasterizer.GetStats().clippedCount == 2 && rasterizer.GetStats().pixelCount == Size * Size / 2);
+}
+
+void TestSoftwareRasterizer()
+{
+	for (uint32_t workerCount : WorkerCounts)
+	{
+		TestDepth(workerCount);
+		TestCulling(workerCount);
+		TestFillRule(workerCount);
+		TestSharedEdges(workerCount);
+		TestClipping(workerCount);
+	}
+}
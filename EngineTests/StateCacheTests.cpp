@@ -0,0 +1,454 @@
+#include <string.h>
+#include <vector>
+#include <d3d11_1.h>
+#include "StateCache.h"
+#include "TestFramework.h"
+
+// Objects of the fake header count their references, nothing else
+template<typename Interface>
+class FakeObject : public Interface
+{
+public:
+	FakeObject()
+		: m_references(1)
+	{
+	}
+
+	virtual ~FakeObject()
+	{
+	}
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, void** ppObject) override
+	{
+		*ppObject = nullptr;
+		return E_NOINTERFACE;
+	}
+
+	ULONG STDMETHODCALLTYPE AddRef() override
+	{
+		return ++m_references;
+	}
+
+	ULONG STDMETHODCALLTYPE Release() override
+	{
+		return --m_references;
+	}
+
+	ULONG GetReferences() const
+	{
+		return m_references;
+	}
+
+private:
+	ULONG m_references;
+};
+
+template<typename Interface>
+class FakeView : public FakeObject<Interface>
+{
+public:
+	explicit FakeView(ID3D11Resource* pResource)
+		: m_pResource(pResource)
+	{
+	}
+
+	void STDMETHODCALLTYPE GetResource(ID3D11Resource** ppResource) override
+	{
+		m_pResource->AddRef();
+		*ppResource = m_pResource;
+	}
+
+private:
+	ID3D11Resource* m_pResource;
+};
+
+// One call that reached the context, slots and handles as passed
+struct RecordedCall
+{
+	std::string name;
+	UINT start;
+	std::vector<const void*> handles;
+	std::vector<UINT> a;
+	std::vector<UINT> b;
+};
+
+class RecordingContext : public FakeObject<ID3D11DeviceContext1>
+{
+public:
+	explicit RecordingContext(bool offsetBinds)
+		: m_offsetBinds(offsetBinds)
+	{
+	}
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppObject) override
+	{
+		if (m_offsetBinds && riid == __uuidof(ID3D11DeviceContext1))
+		{
+			AddRef();
+			*ppObject = static_cast<ID3D11DeviceContext1*>(this);
+			return S_OK;
+		}
+		*ppObject = nullptr;
+		return E_NOINTERFACE;
+	}
+
+	void STDMETHODCALLTYPE ClearState() override
+	{
+		Record("ClearState", 0, 0, nullptr);
+	}
+
+	void STDMETHODCALLTYPE IASetVertexBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers, const UINT* pStrides,
+		const UINT* pOffsets) override
+	{
+		Record("IASetVertexBuffers", startSlot, count, ppBuffers, pStrides, pOffsets);
+	}
+
+	void STDMETHODCALLTYPE IASetIndexBuffer(ID3D11Buffer* pBuffer, DXGI_FORMAT format, UINT offset) override
+	{
+		UINT value = format;
+		Record("IASetIndexBuffer", 0, 1, &pBuffer, &value, &offset);
+	}
+
+	void STDMETHODCALLTYPE IASetInputLayout(ID3D11InputLayout* pLayout) override
+	{
+		Record("IASetInputLayout", 0, 1, &pLayout);
+	}
+
+	void STDMETHODCALLTYPE IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) override
+	{
+		UINT value = topology;
+		Record("IASetPrimitiveTopology", 0, 0, nullptr, &value);
+	}
+
+	void STDMETHODCALLTYPE VSSetShader(ID3D11VertexShader* pShader, ID3D11ClassInstance* const*, UINT) override
+	{
+		Record("VSSetShader", 0, 1, &pShader);
+	}
+
+	void STDMETHODCALLTYPE PSSetShader(ID3D11PixelShader* pShader, ID3D11ClassInstance* const*, UINT) override
+	{
+		Record("PSSetShader", 0, 1, &pShader);
+	}
+
+	void STDMETHODCALLTYPE VSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers) override
+	{
+		Record("VSSetConstantBuffers", startSlot, count, ppBuffers);
+	}
+
+	void STDMETHODCALLTYPE PSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers) override
+	{
+		Record("PSSetConstantBuffers", startSlot, count, ppBuffers);
+	}
+
+	void STDMETHODCALLTYPE VSSetConstantBuffers1(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant,
+		const UINT* pNumConstants) override
+	{
+		Record("VSSetConstantBuffers1", startSlot, count, ppBuffers, pFirstConstant, pNumConstants);
+	}
+
+	void STDMETHODCALLTYPE PSSetConstantBuffers1(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant,
+		const UINT* pNumConstants) override
+	{
+		Record("PSSetConstantBuffers1", startSlot, count, ppBuffers, pFirstConstant, pNumConstants);
+	}
+
+	void STDMETHODCALLTYPE PSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* ppViews) override
+	{
+		Record("PSSetShaderResources", startSlot, count, ppViews);
+	}
+
+	void STDMETHODCALLTYPE PSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const* ppSamplers) override
+	{
+		Record("PSSetSamplers", startSlot, count, ppSamplers);
+	}
+
+	void STDMETHODCALLTYPE RSSetState(ID3D11RasterizerState* pState) override
+	{
+		Record("RSSetState", 0, 1, &pState);
+	}
+
+	void STDMETHODCALLTYPE RSSetViewports(UINT count, const D3D11_VIEWPORT*) override
+	{
+		Record("RSSetViewports", 0, 0, nullptr, &count);
+	}
+
+	void STDMETHODCALLTYPE RSSetScissorRects(UINT count, const D3D11_RECT*) override
+	{
+		Record("RSSetScissorRects", 0, 0, nullptr, &count);
+	}
+
+	void STDMETHODCALLTYPE OMSetRenderTargets(UINT count, ID3D11RenderTargetView* const* ppViews, ID3D11DepthStencilView* pDepthView) override
+	{
+		Record("OMSetRenderTargets", 0, count, ppViews);
+		m_calls.back().handles.push_back(pDepthView);
+	}
+
+	// Returns the calls since the last TakeCalls()
+	std::vector<RecordedCall> TakeCalls()
+	{
+		std::vector<RecordedCall> calls;
+		calls.swap(m_calls);
+		return calls;
+	}
+
+private:
+	template<typename Handle>
+	void Record(const char* pName, UINT start, UINT count, Handle* const* ppHandles, const UINT* pA = nullptr, const UINT* pB = nullptr)
+	{
+		RecordedCall call;
+		call.name = pName;
+		call.start = start;
+		for (UINT i = 0; i < count; i++)
+		{
+			call.handles.push_back(ppHandles[i]);
+		}
+		// Per slot values, or the one value of calls without slots
+		for (UINT i = 0; i < (count > 0 ? count : 1) && pA != nullptr; i++)
+		{
+			call.a.push_back(pA[i]);
+		}
+		for (UINT i = 0; i < count && pB != nullptr; i++)
+		{
+			call.b.push_back(pB[i]);
+		}
+		m_calls.push_back(call);
+	}
+
+	void Record(const char* pName, UINT start, UINT count, std::nullptr_t, const UINT* pA = nullptr)
+	{
+		Record<IUnknown>(pName, start, count, nullptr, pA);
+	}
+
+private:
+	bool m_offsetBinds;
+	std::vector<RecordedCall> m_calls;
+};
+
+static bool IsCall(const std::vector<RecordedCall>& calls, size_t index, const char* pName, UINT start,
+	std::vector<const void*> handles)
+{
+	return index < calls.size() && calls[index].name == pName && calls[index].start == start && calls[index].handles == handles;
+}
+
+static void TestSkippedBinds()
+{
+	RecordingContext context(true);
+	StateCache cache;
+	cache.Init(&context);
+	CHECK(context.GetReferences() == 2);
+
+	FakeObject<ID3D11InputLayout> layout;
+	FakeObject<ID3D11VertexShader> vertexShader;
+	FakeObject<ID3D11PixelShader> pixelShader;
+	FakeObject<ID3D11RasterizerState> rasterizerState;
+	FakeObject<ID3D11Buffer> indexBuffer;
+	D3D11_VIEWPORT viewport = { 0, 0, 640, 480, 0, 1 };
+	D3D11_RECT rect = { 0, 0, 640, 480 };
+
+	// Everything is unknown after Init(), the first round is issued and the
+	// second skipped
+	for (int round = 0; round < 2; round++)
+	{
+		cache.IASetInputLayout(&layout);
+		cache.IASetIndexBuffer(&indexBuffer, DXGI_FORMAT_R16_UINT, 0);
+		cache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		cache.VSSetShader(&vertexShader);
+		cache.PSSetShader(&pixelShader);
+		cache.RSSetState(&rasterizerState);
+		cache.RSSetViewport(viewport);
+		cache.RSSetScissorRect(rect);
+	}
+	std::vector<RecordedCall> calls = context.TakeCalls();
+	CHECK(calls.size() == 8);
+	CHECK(IsCall(calls, 0, "IASetInputLayout", 0, { &layout }));
+	CHECK(IsCall(calls, 1, "IASetIndexBuffer", 0, { &indexBuffer }));
+	CHECK(IsCall(calls, 7, "RSSetScissorRects", 0, {}));
+	CHECK(cache.GetShadow().GetIssued() == 8 && cache.GetShadow().GetSkipped() == 8);
+
+	// Any difference of a value is a new bind
+	cache.IASetIndexBuffer(&indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	cache.IASetIndexBuffer(&indexBuffer, DXGI_FORMAT_R32_UINT, 64);
+	viewport.MaxDepth = 0.5f;
+	cache.RSSetViewport(viewport);
+	cache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	calls = context.TakeCalls();
+	CHECK(calls.size() == 4);
+	CHECK(calls.size() == 4 && calls[1].a == std::vector<UINT>({ DXGI_FORMAT_R32_UINT }) && calls[1].b == std::vector<UINT>({ 64 }));
+	CHECK(calls.size() == 4 && calls[3].a == std::vector<UINT>({ D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP }));
+
+	// After ClearState() null binds match the defaults, after Invalidate()
+	// nothing is known
+	cache.ClearState();
+	cache.IASetInputLayout(nullptr);
+	cache.VSSetShader(nullptr);
+	cache.RSSetViewport(viewport);
+	calls = context.TakeCalls();
+	CHECK(calls.size() == 2 && IsCall(calls, 0, "ClearState", 0, {}) && IsCall(calls, 1, "RSSetViewports", 0, {}));
+
+	cache.Invalidate();
+	cache.IASetInputLayout(nullptr);
+	cache.RSSetViewport(viewport);
+	calls = context.TakeCalls();
+	CHECK(calls.size() == 2 && IsCall(calls, 0, "IASetInputLayout", 0, { nullptr }));
+
+	cache.ResetCounters();
+	CHECK(cache.GetShadow().GetIssued() == 0 && cache.GetShadow().GetSkipped() == 0);
+
+	cache.Term();
+	CHECK(context.GetReferences() == 1);
+}
+
+static void TestRanges()
+{
+	RecordingContext context(true);
+	StateCache cache;
+	cache.Init(&context);
+
+	FakeObject<ID3D11Buffer> buffers[6];
+	ID3D11Buffer* first[] = { &buffers[0], &buffers[1], &buffers[2], &buffers[3] };
+	UINT strides[] = { 16, 16, 32, 32 };
+	UINT offsets[] = { 0, 0, 0, 0 };
+	cache.IASetVertexBuffers(0, 4, first, strides, offsets);
+	context.TakeCalls();
+
+	// Only the changed slots and those between them are bound, with their
+	// strides and offsets
+	ID3D11Buffer* second[] = { &buffers[0], &buffers[4], &buffers[2], &buffers[5] };
+	UINT secondOffsets[] = { 0, 0, 0, 256 };
+	cache.IASetVertexBuffers(0, 4, second, strides, secondOffsets);
+	std::vector<RecordedCall> calls = context.TakeCalls();
+	CHECK(calls.size() == 1 && IsCall(calls, 0, "IASetVertexBuffers", 1, { &buffers[4], &buffers[2], &buffers[5] }));
+	CHECK(calls.size() == 1 && calls[0].a == std::vector<UINT>({ 16, 32, 32 }) && calls[0].b == std::vector<UINT>({ 0, 0, 256 }));
+
+	// A changed stride or offset alone is a change
+	UINT thirdStrides[] = { 16, 16, 32, 48 };
+	cache.IASetVertexBuffers(0, 4, second, thirdStrides, secondOffsets);
+	cache.IASetVertexBuffers(2, 2, second + 2, thirdStrides + 2, secondOffsets + 2);
+	calls = context.TakeCalls();
+	CHECK(calls.size() == 1 && IsCall(calls, 0, "IASetVertexBuffers", 3, { &buffers[5] }));
+	CHECK(calls.size() == 1 && calls[0].a == std::vector<UINT>({ 48 }));
+
+	// Whole buffer binds go to the stage of the call
+	ID3D11Buffer* constants[] = { &buffers[0], &buffers[1], &buffers[2] };
+	cache.VSSetConstantBuffers(0, 3, constants);
+	cache.PSSetConstantBuffers(0, 3, constants);
+	constants[2] = &buffers[3];
+	cache.PSSetConstantBuffers(0, 3, constants);
+	calls = context.TakeCalls();
+	CHECK(calls.size() == 3);
+	CHECK(IsCall(calls, 0, "VSSetConstantBuffers", 0, { &buffers[0], &buffers[1], &buffers[2] }));
+	CHECK(IsCall(calls, 1, "PSSetConstantBuffers", 0, { &buffers[0], &buffers[1], &buffers[2] }));
+	CHECK(IsCall(calls, 2, "PSSetConstantBuffers", 2, { &buffers[3] }));
+
+	// Offset binds compare the constant ranges too and trim them with the buffers
+	UINT firstConstants[] = { 0, 16, 32 };
+	UINT numConstants[] = { 16, 16, 16 };
+	cache.VSSetConstantBuffers1(0, 3, constants, firstConstants, numConstants);
+	firstConstants[1] = 48;
+	cache.VSSetConstantBuffers1(0, 3, constants, firstConstants, numConstants);
+	cache.PSSetConstantBuffers1(1, 2, constants + 1, firstConstants + 1, numConstants + 1);
+	calls = context.TakeCalls();
+	CHECK(calls.size() == 3);
+	CHECK(IsCall(calls, 0, "VSSetConstantBuffers1", 0, { &buffers[0], &buffers[1], &buffers[3] }));
+	CHECK(IsCall(calls, 1, "VSSetConstantBuffers1", 1, { &buffers[1] }));
+	CHECK(calls.size() == 3 && calls[1].a == std::vector<UINT>({ 48 }) && calls[1].b == std::vector<UINT>({ 16 }));
+	CHECK(IsCall(calls, 2, "PSSetConstantBuffers1", 1, { &buffers[1], &buffers[3] }));
+	CHECK(calls.size() == 3 && calls[2].a == std::vector<UINT>({ 48, 32 }));
+
+	// A whole buffer bind differs from an offset bind of the same buffer
+	cache.PSSetConstantBuffers(1, 1, constants + 1);
+	calls = context.TakeCalls();
+	CHECK(calls.size() == 1 && IsCall(calls, 0, "PSSetConstantBuffers", 1, { &buffers[1] }));
+
+	FakeObject<ID3D11SamplerState> samplers[2];
+	ID3D11SamplerState* samplerSlots[] = { &samplers[0], &samplers[1] };
+	cache.PSSetSamplers(0, 2, samplerSlots);
+	cache.PSSetSamplers(1, 1, samplerSlots + 1);
+	calls = context.TakeCalls();
+	CHECK(calls.size() == 1 && IsCall(calls, 0, "PSSetSamplers", 0, { &samplers[0], &samplers[1] }));
+
+	cache.Term();
+}
+
+static void TestOutputHazards()
+{
+	RecordingContext context(false);
+	StateCache cache;
+	cache.Init(&context);
+
+	// The scene renders into a texture that is read in the tone map pass
+	FakeObject<ID3D11Texture2D> sceneTexture;
+	FakeObject<ID3D11Texture2D> depthTexture;
+	FakeObject<ID3D11Texture2D> backBuffer;
+	FakeObject<ID3D11Buffer> lightBuffer;
+	FakeView<ID3D11RenderTargetView> sceneRTV(&sceneTexture);
+	FakeView<ID3D11ShaderResourceView> sceneSRV(&sceneTexture);
+	FakeView<ID3D11DepthStencilView> depthDSV(&depthTexture);
+	FakeView<ID3D11ShaderResourceView> depthSRV(&depthTexture);
+	FakeView<ID3D11RenderTargetView> backBufferRTV(&backBuffer);
+	FakeView<ID3D11ShaderResourceView> lightSRV(&lightBuffer);
+
+	ID3D11RenderTargetView* pSceneRTV = &sceneRTV;
+	ID3D11RenderTargetView* pBackBufferRTV = &backBufferRTV;
+	ID3D11ShaderResourceView* pSceneSRV = &sceneSRV;
+	ID3D11ShaderResourceView* pDepthSRV = &depthSRV;
+	ID3D11ShaderResourceView* pLightSRV = &lightSRV;
+	ID3D11ShaderResourceView* pNull = nullptr;
+
+	for (int frame = 0; frame < 2; frame++)
+	{
+		cache.OMSetRenderTargets(1, &pSceneRTV, &depthDSV);
+		cache.PSSetShaderResources(1, 1, &pLightSRV);
+		cache.OMSetRenderTargets(1, &pBackBufferRTV, nullptr);
+		cache.PSSetShaderResources(0, 1, &pSceneSRV);
+	}
+	std::vector<RecordedCall> calls = context.TakeCalls();
+
+	// Slot 0 still holds the scene in the second frame and is unbound before
+	// the scene is bound as output again, the light buffer stays
+	CHECK(calls.size() == 8);
+	CHECK(IsCall(calls, 0, "OMSetRenderTargets", 0, { &sceneRTV, &depthDSV }));
+	CHECK(IsCall(calls, 1, "PSSetShaderResources", 1, { &lightSRV }));
+	CHECK(IsCall(calls, 2, "OMSetRenderTargets", 0, { &backBufferRTV, nullptr }));
+	CHECK(IsCall(calls, 3, "PSSetShaderResources", 0, { &sceneSRV }));
+	CHECK(IsCall(calls, 4, "PSSetShaderResources", 0, { nullptr }));
+	CHECK(IsCall(calls, 5, "OMSetRenderTargets", 0, { &sceneRTV, &depthDSV }));
+	CHECK(IsCall(calls, 6, "OMSetRenderTargets", 0, { &backBufferRTV, nullptr }));
+	CHECK(IsCall(calls, 7, "PSSetShaderResources", 0, { &sceneSRV }));
+	CHECK(cache.GetShadow().GetShaderResource(PipelineStateShadow::STAGE_PS, 1) == &lightSRV);
+
+	// Views of the depth buffer are found through the depth view, several
+	// slots at once
+	ID3D11ShaderResourceView* inputs[] = { pDepthSRV, pNull, pSceneSRV };
+	cache.PSSetShaderResources(2, 3, inputs);
+	context.TakeCalls();
+	cache.OMSetRenderTargets(1, &pSceneRTV, &depthDSV);
+	calls = context.TakeCalls();
+	CHECK(calls.size() == 4);
+	CHECK(IsCall(calls, 0, "PSSetShaderResources", 0, { nullptr }));
+	CHECK(IsCall(calls, 1, "PSSetShaderResources", 2, { nullptr }));
+	CHECK(IsCall(calls, 2, "PSSetShaderResources", 4, { nullptr }));
+	CHECK(IsCall(calls, 3, "OMSetRenderTargets", 0, { &sceneRTV, &depthDSV }));
+
+	// Unknown slots can not be checked and are left to the runtime
+	cache.PSSetShaderResources(0, 1, &pSceneSRV);
+	cache.OMSetRenderTargets(1, &pBackBufferRTV, nullptr);
+	cache.Invalidate();
+	context.TakeCalls();
+	cache.OMSetRenderTargets(1, &pSceneRTV, &depthDSV);
+	calls = context.TakeCalls();
+	CHECK(calls.size() == 1 && IsCall(calls, 0, "OMSetRenderTargets", 0, { &sceneRTV, &depthDSV }));
+
+	// References taken to compare resources are all given back
+	CHECK(sceneTexture.GetReferences() == 1 && depthTexture.GetReferences() == 1);
+	CHECK(backBuffer.GetReferences() == 1 && lightBuffer.GetReferences() == 1);
+
+	cache.Term();
+}
+
+void TestStateCache()
+{
+	TestSkippedBinds();
+	TestRanges();
+	TestOutputHazards();
+}
@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "BufferSuballocator.h"
+#include "StaticBatcher.h"
+#include "TestFramework.h"
+
+static const uint32_t BenchmarkMeshCounts[] = { 256, 4096, 16384 };
+
+// Every allocation is checked against a map of owned elements, first fit
+// has to return the lowest free offset that fits
+static void TestSuballocator()
+{
+	const uint32_t capacity = 4096;
+	BufferSuballocator allocator;
+	allocator.Init(capacity);
+	CHECK(allocator.GetFreeSize() == capacity && allocator.GetLargestFreeSize() == capacity && allocator.GetFreeRangeCount() == 1);
+
+	std::vector<uint32_t> owner(capacity, 0); // allocation offset + 1, 0 if free
+	std::vector<std::pair<uint32_t, uint32_t>> live; // offset and size
+	std::minstd_rand random(1);
+	bool firstFit = true, consistent = true;
+	for (int step = 0; step < 20000; step++)
+	{
+		if (live.empty() || random() % 5 < 3)
+		{
+			uint32_t size = 1 + random() % (random() % 8 == 0 ? 256 : 16);
+			uint32_t expected = BufferSuballocator::InvalidOffset;
+			for (uint32_t offset = 0, run = 0; offset < capacity; offset++)
+			{
+				run = owner[offset] == 0 ? run + 1 : 0;
+				if (run == size)
+				{
+					expected = offset + 1 - size;
+					break;
+				}
+			}
+
+			uint32_t offset = allocator.Allocate(size);
+			firstFit = firstFit && offset == expected;
+			if (offset != BufferSuballocator::InvalidOffset)
+			{
+				std::fill(owner.begin() + offset, owner.begin() + offset + size, offset + 1);
+				live.push_back(std::make_pair(offset, size));
+			}
+		}
+		else
+		{
+			size_t i = random() % live.size();
+			allocator.Free(live[i].first);
+			std::fill(owner.begin() + live[i].first, owner.begin() + live[i].first + live[i].second, 0);
+			live[i] = live.back();
+			live.pop_back();
+		}
+
+		// Free ranges are maximal, so their count and the largest one follow from the map
+		uint32_t freeSize = 0, largest = 0, ranges = 0;
+		for (uint32_t offset = 0, run = 0; offset < capacity; offset++)
+		{
+			run = owner[offset] == 0 ? run + 1 : 0;
+			freeSize += owner[offset] == 0 ? 1 : 0;
+			ranges += run == 1 ? 1 : 0;
+			largest = std::max(largest, run);
+		}
+		consistent = consistent && allocator.GetFreeSize() == freeSize && allocator.GetAllocatedSize() == capacity - freeSize
+			&& allocator.GetLargestFreeSize() == largest && allocator.GetFreeRangeCount() == ranges;
+	}
+	CHECK(firstFit);
+	CHECK(consistent);
+
+	// Compact keeps the order, packs from 0 and moves in increasing offset order
+	std::sort(live.begin(), live.end());
+	std::vector<BufferSuballocator::Move> moves;
+	allocator.Compact(&moves);
+	bool packed = true;
+	uint32_t end = 0;
+	size_t m = 0;
+	for (const std::pair<uint32_t, uint32_t>& allocation : live)
+	{
+		if (allocation.first != end)
+		{
+			packed = packed && m < moves.size() && moves[m].from == allocation.first && moves[m].to == end && moves[m].size == allocation.second;
+			m++;
+		}
+		end += allocation.second;
+	}
+	CHECK(packed && m == moves.size());
+	CHECK(allocator.GetFreeRangeCount() == (end < capacity ? 1u : 0u) && allocator.GetLargestFreeSize() == capacity - end);
+
+	// Moved allocations are freed at their new offsets
+	end = 0;
+	for (const std::pair<uint32_t, uint32_t>& allocation : live)
+	{
+		allocator.Free(end);
+		end += allocation.second;
+	}
+	CHECK(allocator.GetFreeSize() == capacity && allocator.GetFreeRangeCount() == 1);
+	CHECK(allocator.Allocate(capacity) == 0 && allocator.Allocate(1) == BufferSuballocator::InvalidOffset);
+}
+
+struct TestMesh
+{
+	uint32_t id;
+	std::vector<uint8_t> vertices;
+	std::vector<uint32_t> indices;
+};
+
+// Vertex bytes and indices unique to the mesh, indices are local to it
+static TestMesh CreateMesh(std::minstd_rand& random, size_t vertexSize, uint32_t vertexCount, uint32_t indexCount)
+{
+	TestMesh mesh;
+	mesh.id = StaticBatcher::InvalidMesh;
+	mesh.vertices.resize(vertexCount * vertexSize);
+	for (uint8_t& byte : mesh.vertices)
+	{
+		byte = (uint8_t)random();
+	}
+	for (uint32_t i = 0; i < indexCount; i++)
+	{
+		mesh.indices.push_back((uint32_t)(random() % vertexCount));
+	}
+	return mesh;
+}
+
+// Contents of every live mesh in the given page copies, and no two live
+// meshes of a page share an element
+static bool CheckMeshes(const StaticBatcher& batcher, const std::vector<TestMesh>& meshes,
+	const std::vector<std::vector<uint8_t>>& vertexPages, const std::vector<std::vector<uint32_t>>& indexPages)
+{
+	size_t vertexSize = batcher.GetVertexSize();
+	std::vector<std::vector<bool>> usedVertices(batcher.GetPageCount()), usedIndices(batcher.GetPageCount());
+	for (uint32_t page = 0; page < batcher.GetPageCount(); page++)
+	{
+		usedVertices[page].resize(batcher.GetPageVertexCapacity(page), false);
+		usedIndices[page].resize(batcher.GetPageIndexCapacity(page), false);
+	}
+
+	for (const TestMesh& testMesh : meshes)
+	{
+		const StaticBatcher::Mesh& mesh = batcher.GetMesh(testMesh.id);
+		if (mesh.page >= batcher.GetPageCount() || mesh.vertexCount * vertexSize != testMesh.vertices.size() || mesh.indexCount != testMesh.indices.size()
+			|| mesh.baseVertex + mesh.vertexCount > batcher.GetPageVertexCapacity(mesh.page)
+			|| mesh.startIndex + mesh.indexCount > batcher.GetPageIndexCapacity(mesh.page))
+		{
+			return false;
+		}
+		if (memcmp(vertexPages[mesh.page].data() + mesh.baseVertex * vertexSize, testMesh.vertices.data(), testMesh.vertices.size()) != 0
+			|| memcmp(indexPages[mesh.page].data() + mesh.startIndex, testMesh.indices.data(), testMesh.indices.size() * sizeof(uint32_t)) != 0)
+		{
+			return false;
+		}
+		for (uint32_t v = mesh.baseVertex; v < mesh.baseVertex + mesh.vertexCount; v++)
+		{
+			if (usedVertices[mesh.page][v])
+			{
+				return false;
+			}
+			usedVertices[mesh.page][v] = true;
+		}
+		for (uint32_t i = mesh.startIndex; i < mesh.startIndex + mesh.indexCount; i++)
+		{
+			if (usedIndices[mesh.page][i])
+			{
+				return false;
+			}
+			usedIndices[mesh.page][i] = true;
+		}
+	}
+	return true;
+}
+
+// Random adds and removes against copies of the pages that only receive the
+// dirty ranges, as the API buffers would
+static void TestBatcherChurn()
+{
+	const size_t vertexSize = 12;
+	StaticBatcher batcher;
+	batcher.Init(vertexSize, 1024, 3072);
+
+	std::minstd_rand random(2);
+	std::vector<TestMesh> meshes;
+	std::vector<std::vector<uint8_t>> vertexPages;
+	std::vector<std::vector<uint32_t>> indexPages;
+	bool cpuMatches = true, uploadMatches = true;
+	for (int step = 0; step < 3000; step++)
+	{
+		uint32_t action = random() % 16;
+		if (meshes.empty() || action < 9)
+		{
+			uint32_t vertexCount = 1 + random() % (action == 0 ? 1500 : 120);
+			TestMesh mesh = CreateMesh(random, vertexSize, vertexCount, vertexCount * 3 / 2 + random() % 64);
+			mesh.id = batcher.Add(mesh.vertices.data(), vertexCount, mesh.indices.data(), (uint32_t)mesh.indices.size());
+			meshes.push_back(mesh);
+		}
+		else if (action < 15)
+		{
+			size_t i = random() % meshes.size();
+			batcher.Remove(meshes[i].id);
+			meshes[i] = meshes.back();
+			meshes.pop_back();
+		}
+		else
+		{
+			batcher.Compact();
+		}
+
+		std::vector<std::vector<uint8_t>> cpuVertices(batcher.GetPageCount());
+		std::vector<std::vector<uint32_t>> cpuIndices(batcher.GetPageCount());
+		for (uint32_t page = 0; page < batcher.GetPageCount(); page++)
+		{
+			const uint8_t* pVertices = (const uint8_t*)batcher.GetPageVertices(page);
+			const uint32_t* pIndices = batcher.GetPageIndices(page);
+			cpuVertices[page].assign(pVertices, pVertices + batcher.GetPageVertexCapacity(page) * vertexSize);
+			cpuIndices[page].assign(pIndices, pIndices + batcher.GetPageIndexCapacity(page));
+
+			// New pages start out as zeros, then only dirty ranges are copied
+			if (page >= vertexPages.size())
+			{
+				vertexPages.push_back(std::vector<uint8_t>(cpuVertices[page].size(), 0));
+				indexPages.push_back(std::vector<uint32_t>(cpuIndices[page].size(), 0));
+			}
+			const StaticBatcher::DirtyRanges& dirty = batcher.GetDirtyRanges(page);
+			memcpy(vertexPages[page].data() + dirty.vertexBegin * vertexSize, pVertices + dirty.vertexBegin * vertexSize,
+				(dirty.vertexEnd - dirty.vertexBegin) * vertexSize);
+			memcpy(indexPages[page].data() + dirty.indexBegin, pIndices + dirty.indexBegin, (dirty.indexEnd - dirty.indexBegin) * sizeof(uint32_t));
+		}
+		batcher.ClearDirtyRanges();
+
+		cpuMatches = cpuMatches && CheckMeshes(batcher, meshes, cpuVertices, cpuIndices);
+		uploadMatches = uploadMatches && CheckMeshes(batcher, meshes, vertexPages, indexPages);
+	}
+	CHECK(cpuMatches);
+	CHECK(uploadMatches);
+	CHECK(batcher.GetPageCount() > 2);
+
+	// Clean pages stay clean
+	bool clean = true;
+	for (uint32_t page = 0; page < batcher.GetPageCount(); page++)
+	{
+		const StaticBatcher::DirtyRanges& dirty = batcher.GetDirtyRanges(page);
+		clean = clean && dirty.vertexBegin == dirty.vertexEnd && dirty.indexBegin == dirty.indexEnd;
+	}
+	CHECK(clean);
+}
+
+static void TestBatcherPages()
+{
+	const size_t vertexSize = 4;
+	StaticBatcher batcher;
+	batcher.Init(vertexSize, 100, 300);
+	std::minstd_rand random(3);
+
+	// Ten meshes fill the page, removing every other one leaves holes of 10
+	std::vector<TestMesh> meshes;
+	for (int i = 0; i < 10; i++)
+	{
+		meshes.push_back(CreateMesh(random, vertexSize, 10, 30));
+		meshes.back().id = batcher.Add(meshes.back().vertices.data(), 10, meshes.back().indices.data(), 30);
+	}
+	CHECK(batcher.GetPageCount() == 1);
+	for (int i = 0; i < 10; i += 2)
+	{
+		batcher.Remove(meshes[i].id);
+	}
+	std::vector<TestMesh> kept;
+	for (int i = 1; i < 10; i += 2)
+	{
+		kept.push_back(meshes[i]);
+	}
+
+	// A mesh of 40 only fits after compacting, which Add does by itself
+	batcher.ClearDirtyRanges();
+	kept.push_back(CreateMesh(random, vertexSize, 40, 120));
+	kept.back().id = batcher.Add(kept.back().vertices.data(), 40, kept.back().indices.data(), 120);
+	const StaticBatcher::Mesh& added = batcher.GetMesh(kept.back().id);
+	CHECK(batcher.GetPageCount() == 1 && added.page == 0 && added.baseVertex == 50 && added.startIndex == 150);
+	const StaticBatcher::DirtyRanges& dirty = batcher.GetDirtyRanges(0);
+	CHECK(dirty.vertexBegin == 0 && dirty.vertexEnd == 90 && dirty.indexBegin == 0 && dirty.indexEnd == 270);
+
+	std::vector<std::vector<uint8_t>> vertexPages(1);
+	std::vector<std::vector<uint32_t>> indexPages(1);
+	const uint8_t* pVertices = (const uint8_t*)batcher.GetPageVertices(0);
+	vertexPages[0].assign(pVertices, pVertices + 100 * vertexSize);
+	indexPages[0].assign(batcher.GetPageIndices(0), batcher.GetPageIndices(0) + 300);
+	CHECK(CheckMeshes(batcher, kept, vertexPages, indexPages));
+
+	// Nothing left to compact, freed ids are reused
+	CHECK(batcher.Compact() == 0);
+	batcher.Remove(kept[0].id);
+	TestMesh small = CreateMesh(random, vertexSize, 5, 6);
+	CHECK(batcher.Add(small.vertices.data(), 5, small.indices.data(), 6) == kept[0].id);
+
+	// Too many indices for the free space opens a page, meshes larger than a page get their own
+	TestMesh wide = CreateMesh(random, vertexSize, 5, 100);
+	CHECK(batcher.GetMesh(batcher.Add(wide.vertices.data(), 5, wide.indices.data(), 100)).page == 1);
+	TestMesh large = CreateMesh(random, vertexSize, 500, 30);
+	uint32_t largeId = batcher.Add(large.vertices.data(), 500, large.indices.data(), 30);
+	CHECK(batcher.GetMesh(largeId).page == 2 && batcher.GetPageVertexCapacity(2) == 500 && batcher.GetPageIndexCapacity(2) == 300);
+}
+
+void TestStaticBatcher()
+{
+	TestSuballocator();
+	TestBatcherChurn();
+	TestBatcherPages();
+}
+
+void BenchmarkStaticBatcher(double seconds)
+{
+	printf("%-10s %16s %16s %14s\n", "meshes", "add (Mmesh/s)", "churn (Mops/s)", "refill (ms)");
+	for (uint32_t count : BenchmarkMeshCounts)
+	{
+		std::minstd_rand random(4);
+		std::vector<TestMesh> meshes;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t vertexCount = 16 + random() % 240;
+			meshes.push_back(CreateMesh(random, 32, vertexCount, vertexCount * 3 / 2));
+		}
+
+		StaticBatcher batcher;
+		std::vector<uint32_t> ids(count);
+		double addMs = TimeWork(seconds / 3, [&]()
+		{
+			batcher.Init(32, 65536, 98304);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				ids[i] = batcher.Add(meshes[i].vertices.data(), (uint32_t)meshes[i].vertices.size() / 32, meshes[i].indices.data(), (uint32_t)meshes[i].indices.size());
+			}
+		});
+
+		// Replaces random meshes, Add compacts as pages fragment
+		double churnMs = TimeWork(seconds / 3, [&]()
+		{
+			for (uint32_t n = 0; n < count; n++)
+			{
+				uint32_t i = random() % count;
+				batcher.Remove(ids[i]);
+				ids[i] = batcher.Add(meshes[i].vertices.data(), (uint32_t)meshes[i].vertices.size() / 32, meshes[i].indices.data(), (uint32_t)meshes[i].indices.size());
+			}
+		});
+
+		// Every other mesh removed, the pages compacted and the meshes added back
+		double refillMs = TimeWork(seconds / 3, [&]()
+		{
+			for (uint32_t i = 0; i < count; i += 2)
+			{
+				batcher.Remove(ids[i]);
+			}
+			batcher.Compact();
+			for (uint32_t i = 0; i < count; i += 2)
+			{
+				ids[i] = batcher.Add(meshes[i].vertices.data(), (uint32_t)meshes[i].vertices.size() / 32, meshes[i].indices.data(), (uint32_t)meshes[i].indices.size());
+			}
+		});
+
+		printf("%-10u %16.2f %16.2f %14.2f\n", count, count / (addMs * 1000.0), count / (churnMs * 1000.0), refillMs);
+	}
+}
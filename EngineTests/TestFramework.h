@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <string>
+
+// Checks of EngineTests. A failed CHECK prints the expression and where it
+// is and fails the run, the test goes on with the next statement.
+#define CHECK(condition) TestCheck((condition), #condition, __FILE__, __LINE__)
+
+bool TestCheck(bool condition, const char* pText, const char* pFile, int line);
+
+// Writes a file the test reads back, returns false if it could not
+bool WriteTestFile(const std::string& path, const std::string& text);
+
+// Average milliseconds of a call, timed over at least 3 calls and until the
+// given time is used up
+template<typename Work>
+double TimeWork(double seconds, const Work& work)
+{
+	uint32_t calls = 0;
+	double totalMs = 0;
+	while (calls < 3 || totalMs < seconds * 1000.0)
+	{
+		auto start = std::chrono::steady_clock::now();
+		work();
+		totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		calls++;
+	}
+	return totalMs / calls;
+}
@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+#include "BufferSuballocator.h"
+#include "TlsfAllocator.h"
+#include "TestFramework.h"
+
+static const uint32_t BenchmarkAllocationCounts[] = { 1024, 8192, 32768 };
+
+struct TestAllocation
+{
+	uint32_t offset;
+	uint32_t size;
+	uint32_t alignment;
+};
+
+// Free gaps between the allocations, sorted by offset
+static std::vector<TestAllocation> GetGaps(const std::map<uint32_t, TestAllocation>& allocations, uint32_t capacity)
+{
+	std::vector<TestAllocation> used;
+	for (const std::pair<const uint32_t, TestAllocation>& allocation : allocations)
+	{
+		used.push_back(allocation.second);
+	}
+	std::sort(used.begin(), used.end(), [](const TestAllocation& a, const TestAllocation& b) { return a.offset < b.offset; });
+
+	std::vector<TestAllocation> gaps;
+	uint32_t end = 0;
+	for (const TestAllocation& allocation : used)
+	{
+		if (allocation.offset > end)
+		{
+			TestAllocation gap = { end, allocation.offset - end, 1 };
+			gaps.push_back(gap);
+		}
+		end = allocation.offset + allocation.size;
+	}
+	if (end < capacity)
+	{
+		TestAllocation gap = { end, capacity - end, 1 };
+		gaps.push_back(gap);
+	}
+	return gaps;
+}
+
+// Allocations inside the buffer, aligned and apart, and the stats match them.
+// Free blocks merge with their neighbours, so they are exactly the gaps.
+static bool CheckAllocator(const TlsfAllocator& allocator, const std::map<uint32_t, TestAllocation>& allocations, uint32_t capacity)
+{
+	std::vector<TestAllocation> used;
+	uint32_t allocatedSize = 0;
+	for (const std::pair<const uint32_t, TestAllocation>& allocation : allocations)
+	{
+		const TestAllocation& a = allocation.second;
+		if (allocator.GetOffset(allocation.first) != a.offset || allocator.GetSize(allocation.first) != a.size
+			|| a.offset % a.alignment != 0 || (uint64_t)a.offset + a.size > capacity)
+		{
+			return false;
+		}
+		used.push_back(a);
+		allocatedSize += a.size;
+	}
+	std::sort(used.begin(), used.end(), [](const TestAllocation& a, const TestAllocation& b) { return a.offset < b.offset; });
+	for (size_t i = 1; i < used.size(); i++)
+	{
+		if (used[i - 1].offset + used[i - 1].size > used[i].offset)
+		{
+			return false;
+		}
+	}
+
+	std::vector<TestAllocation> gaps = GetGaps(allocations, capacity);
+	uint32_t largest = 0;
+	for (const TestAllocation& gap : gaps)
+	{
+		largest = std::max(largest, gap.size);
+	}
+	uint32_t freeSize = capacity - allocatedSize;
+	float fragmentation = freeSize > 0 ? 1.0f - (float)largest / freeSize : 0.0f;
+
+	TlsfAllocator::Stats stats = allocator.GetStats();
+	return stats.capacity == capacity && stats.allocatedSize == allocatedSize && stats.allocationCount == allocations.size()
+		&& stats.freeSize == freeSize && stats.freeBlockCount == gaps.size() && stats.largestFreeSize == largest
+		&& stats.fragmentation == fragmentation;
+}
+
+// Good fit rounds the request up to the next list, so a block may only be
+// missed if it is smaller than that
+static bool CheckFailure(const std::map<uint32_t, TestAllocation>& allocations, uint32_t capacity, uint32_t size, uint32_t alignment)
+{
+	uint64_t needed = (uint64_t)size + alignment - 1;
+	uint64_t rounded = needed;
+	for (uint32_t bit = 31; bit >= 5; bit--)
+	{
+		if (needed >> bit != 0)
+		{
+			rounded = needed + (1ull << (bit - 5)) - 1;
+			break;
+		}
+	}
+	for (const TestAllocation& gap : GetGaps(allocations, capacity))
+	{
+		if (gap.size >= rounded)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Moves are replayed in order on the test's copy, each target has to be
+// free at that point and aligned for the allocation
+static bool CheckMoves(const std::vector<TlsfAllocator::Move>& moves, uint32_t movedBytes, uint32_t maxBytes,
+	std::map<uint32_t, TestAllocation>& allocations)
+{
+	uint32_t total = 0;
+	for (const TlsfAllocator::Move& move : moves)
+	{
+		std::map<uint32_t, TestAllocation>::iterator allocation = allocations.find(move.handle);
+		if (allocation == allocations.end() || allocation->second.offset != move.from || allocation->second.size != move.size
+			|| move.to >= move.from || move.to % allocation->second.alignment != 0)
+		{
+			return false;
+		}
+		for (const std::pair<const uint32_t, TestAllocation>& other : allocations)
+		{
+			if (other.first != move.handle && other.second.offset < move.to + move.size && move.to < other.second.offset + other.second.size)
+			{
+				return false;
+			}
+		}
+		allocation->second.offset = move.to;
+		total += move.size;
+	}
+	return total == movedBytes && movedBytes <= maxBytes;
+}
+
+static void TestFuzz(uint32_t seed, uint32_t capacity, uint32_t maxSize)
+{
+	TlsfAllocator allocator;
+	allocator.Init(capacity);
+
+	std::minstd_rand random(seed);
+	std::map<uint32_t, TestAllocation> allocations; // by handle
+	std::vector<uint32_t> handles;
+	bool valid = true, failures = true, moves = true;
+	uint32_t allocated = 0, failed = 0, moved = 0;
+	for (int step = 0; step < 20000; step++)
+	{
+		uint32_t action = random() % 64;
+		if (action < 36 || handles.empty())
+		{
+			// Mostly small sizes with a long tail, alignments up to 256
+			uint32_t size = 1 + random() % (random() % 8 == 0 ? maxSize : maxSize / 16);
+			uint32_t alignment = 1u << (random() % 9);
+			TlsfAllocator::Allocation allocation = allocator.Allocate(size, alignment);
+			if (allocation.handle != TlsfAllocator::InvalidHandle)
+			{
+				valid = valid && allocations.find(allocation.handle) == allocations.end();
+				TestAllocation a = { allocation.offset, size, alignment };
+				allocations[allocation.handle] = a;
+				handles.push_back(allocation.handle);
+				allocated++;
+			}
+			else
+			{
+				failures = failures && CheckFailure(allocations, capacity, size, alignment);
+				failed++;
+			}
+		}
+		else if (action < 63)
+		{
+			size_t i = random() % handles.size();
+			allocator.Free(handles[i]);
+			allocations.erase(handles[i]);
+			handles[i] = handles.back();
+			handles.pop_back();
+		}
+		else
+		{
+			uint32_t maxBytes = random() % 2 == 0 ? 0xFFFFFFFF : random() % (capacity / 4);
+			std::vector<TlsfAllocator::Move> plan;
+			uint32_t movedBytes = allocator.PlanDefragmentation(maxBytes, &plan);
+			moves = moves && CheckMoves(plan, movedBytes, maxBytes, allocations);
+			moved += (uint32_t)plan.size();
+		}
+
+		// The full check every few steps, a broken state does not heal
+		if (step % 8 == 0 || action == 63)
+		{
+			valid = valid && CheckAllocator(allocator, allocations, capacity);
+		}
+	}
+	CHECK(valid);
+	CHECK(failures);
+	CHECK(moves);
+
+	// The workload has to reach both full and fragmented states
+	CHECK(allocated > 5000 && failed > 100 && moved > 100);
+
+	// Everything freed is one block again
+	for (uint32_t handle : handles)
+	{
+		allocator.Free(handle);
+	}
+	TlsfAllocator::Stats stats = allocator.GetStats();
+	CHECK(stats.allocationCount == 0 && stats.freeBlockCount == 1 && stats.largestFreeSize == capacity && stats.fragmentation == 0);
+}
+
+static void TestDefragmentation()
+{
+	// Ten blocks of 100, freeing the even ones leaves five holes
+	TlsfAllocator allocator;
+	allocator.Init(1000);
+	uint32_t handles[10];
+	for (uint32_t i = 0; i < 10; i++)
+	{
+		handles[i] = allocator.Allocate(100).handle;
+	}
+	CHECK(allocator.Allocate(1).handle == TlsfAllocator::InvalidHandle);
+	for (uint32_t i = 0; i < 10; i += 2)
+	{
+		allocator.Free(handles[i]);
+	}
+	CHECK(allocator.GetStats().fragmentation == 0.8f);
+
+	// The last allocations move into the first holes, within the budget
+	std::vector<TlsfAllocator::Move> moves;
+	CHECK(allocator.PlanDefragmentation(250, &moves) == 200);
+	CHECK(moves.size() == 2 && moves[0].handle == handles[9] && moves[0].from == 900 && moves[0].to == 0
+		&& moves[1].handle == handles[7] && moves[1].from == 700 && moves[1].to == 200);
+	CHECK(allocator.GetOffset(handles[9]) == 0 && allocator.GetOffset(handles[7]) == 200);
+
+	// Without a budget the rest is packed
+	CHECK(allocator.PlanDefragmentation(0xFFFFFFFF, &moves) == 100);
+	CHECK(moves.size() == 1 && moves[0].handle == handles[5] && moves[0].to == 400);
+	TlsfAllocator::Stats stats = allocator.GetStats();
+	CHECK(stats.freeBlockCount == 1 && stats.largestFreeSize == 500 && stats.fragmentation == 0);
+	CHECK(allocator.PlanDefragmentation(0xFFFFFFFF, &moves) == 0 && moves.empty());
+
+	// Alignment padding goes back to the free lists
+	allocator.Init(1024);
+	TlsfAllocator::Allocation first = allocator.Allocate(3);
+	TlsfAllocator::Allocation aligned = allocator.Allocate(10, 64);
+	CHECK(first.offset == 0 && aligned.offset == 64);
+	stats = allocator.GetStats();
+	CHECK(stats.freeBlockCount == 2 && stats.freeSize == 1024 - 13);
+	allocator.Free(aligned.handle);
+	allocator.Free(first.handle);
+	CHECK(allocator.GetStats().freeBlockCount == 1);
+
+	// An empty allocator has nothing to give
+	allocator.Init(0);
+	CHECK(allocator.Allocate(1).handle == TlsfAllocator::InvalidHandle);
+	stats = allocator.GetStats();
+	CHECK(stats.capacity == 0 && stats.freeBlockCount == 0 && stats.largestFreeSize == 0 && stats.fragmentation == 0);
+}
+
+void TestTlsfAllocator()
+{
+	TestFuzz(1, 1 << 16, 1024);
+	TestFuzz(2, 1 << 24, 1 << 20);
+	TestFuzz(3, 100000, 4096);
+	TestDefragmentation();
+}
+
+void BenchmarkTlsfAllocator(double seconds)
+{
+	// The same random sizes for both, half of them freed and allocated again
+	printf("%-12s %16s %18s %16s\n", "allocations", "TLSF (Mop/s)", "first fit (Mop/s)", "defrag (ms)");
+	for (uint32_t count : BenchmarkAllocationCounts)
+	{
+		std::minstd_rand random(4);
+		std::vector<uint32_t> sizes(count);
+		std::vector<uint32_t> order(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			sizes[i] = 16 + random() % 4096;
+			order[i] = i;
+		}
+		std::shuffle(order.begin(), order.end(), random);
+		uint32_t capacity = count * 4096;
+
+		TlsfAllocator tlsf;
+		std::vector<uint32_t> handles(count);
+		double tlsfMs = TimeWork(seconds / 3, [&]()
+		{
+			tlsf.Init(capacity);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				handles[i] = tlsf.Allocate(sizes[i], 16).handle;
+			}
+			for (uint32_t i = 0; i < count / 2; i++)
+			{
+				tlsf.Free(handles[order[i]]);
+			}
+			for (uint32_t i = 0; i < count / 2; i++)
+			{
+				handles[order[i]] = tlsf.Allocate(sizes[order[i]], 16).handle;
+			}
+		});
+
+		BufferSuballocator firstFit;
+		std::vector<uint32_t> offsets(count);
+		double firstFitMs = TimeWork(seconds / 3, [&]()
+		{
+			firstFit.Init(capacity);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				offsets[i] = firstFit.Allocate(sizes[i]);
+			}
+			for (uint32_t i = 0; i < count / 2; i++)
+			{
+				firstFit.Free(offsets[order[i]]);
+			}
+			for (uint32_t i = 0; i < count / 2; i++)
+			{
+				offsets[order[i]] = firstFit.Allocate(sizes[order[i]]);
+			}
+		});
+
+		// Half freed, then everything packed in one plan
+		std::vector<TlsfAllocator::Move> moves;
+		double defragMs = TimeWork(seconds / 3, [&]()
+		{
+			tlsf.Init(capacity);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				handles[i] = tlsf.Allocate(sizes[i], 16).handle;
+			}
+			for (uint32_t i = 0; i < count / 2; i++)
+			{
+				tlsf.Free(handles[order[i]]);
+			}
+			tlsf.PlanDefragmentation(0xFFFFFFFF, &moves);
+		});
+
+		double operations = count * 2.0;
+		printf("%-12u %16.2f %18.2f %16.2f\n", count, operations / (tlsfMs * 1000.0), operations / (firstFitMs * 1000.0), defragMs);
+	}
+}
@@ -0,0 +1,136 @@
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "TestFramework.h"
+#include "ToneMapper.h"
+
+// Known values are the shader math in double precision rounded to 6
+// digits, float evaluation stays well inside this
+static const float Tolerance = 1e-5f;
+
+// Written past the pixels, Map() must leave it alone
+static const float Sentinel = -12345.0f;
+
+// U2Shader output for exposure * input, both operators at the same point
+struct KnownValue
+{
+	float exposure;
+	float input;
+	float uncharted2;
+	float reinhard;
+};
+
+static const KnownValue KnownValues[] =
+{
+	{ 1.0f, 0.0f, 0.0f, 0.0f },
+	{ 1.0f, 0.25f, 0.080024f, 0.200399f },
+	{ 1.0f, 1.0f, 0.255078f, 0.503986f },
+	{ 1.0f, 4.0f, 0.652331f, 0.825510f },
+	{ 1.0f, 11.2f, 1.0f, 1.0f }, // the white point
+	{ 1.0f, 100.0f, 1.362768f, 1.779400f }, // not clamped
+	{ 0.5f, 2.0f, 0.255078f, 0.503986f },
+	{ 2.0f, 1.0f, 0.426295f, 0.677296f },
+};
+
+static bool IsNear(float value, float expected)
+{
+	return fabsf(value - expected) <= Tolerance * std::max(1.0f, fabsf(expected));
+}
+
+static void TestKnownValues()
+{
+	for (int op = 0; op < 2; op++)
+	{
+		bool matches = true;
+		for (const KnownValue& known : KnownValues)
+		{
+			float expected = op == ToneMapper::OPERATOR_REINHARD ? known.reinhard : known.uncharted2;
+
+			// The value in each channel, and next to others in one pixel
+			float in[6] = { known.input, known.input, known.input, known.input, 0.5f, 3.0f };
+			float out[6];
+			float reference[6];
+			ToneMapper mapper;
+			mapper.Init((ToneMapper::Operator)op, known.exposure, 1);
+			mapper.Map(in, out, 2);
+			ToneMapper::MapReference((ToneMapper::Operator)op, known.exposure, in, reference, 2);
+			for (int i = 0; i < 4; i++)
+			{
+				matches = matches && IsNear(out[i], expected) && IsNear(reference[i], expected);
+			}
+		}
+		CHECK(matches);
+	}
+
+	// Same input, same output whatever the channel
+	ToneMapper mapper;
+	mapper.Init(ToneMapper::OPERATOR_UNCHARTED2, 1.0f, 1);
+	CHECK(mapper.GetOperator() == ToneMapper::OPERATOR_UNCHARTED2 && mapper.GetExposure() == 1.0f);
+	float in[3] = { 4.0f, 1.0f, 0.25f };
+	float out[3];
+	mapper.Map(in, out, 1);
+	CHECK(IsNear(out[0], 0.652331f) && IsNear(out[1], 0.255078f) && IsNear(out[2], 0.080024f));
+}
+
+// Map() against MapReference() for tails of every length, several packets
+// and batches large enough to be split across workers
+static void TestBatches()
+{
+	const size_t pixelCounts[] = { 1, 2, 3, 5, 6, 7, 1000, 3 * 64 * 1024 + 7 };
+	std::minstd_rand random(1);
+	std::uniform_real_distribution<float> radiance(0.0f, 20.0f);
+	for (int op = 0; op < 2; op++)
+	{
+		for (uint32_t workerCount : { 1u, 4u })
+		{
+			ToneMapper mapper;
+			mapper.Init((ToneMapper::Operator)op, 0.75f, workerCount);
+			bool matches = true;
+			for (size_t pixelCount : pixelCounts)
+			{
+				std::vector<float> in(pixelCount * 3);
+				for (float& value : in)
+				{
+					value = radiance(random);
+				}
+				std::vector<float> out(pixelCount * 3 + 1, Sentinel);
+				std::vector<float> reference(pixelCount * 3);
+				mapper.Map(in.data(), out.data(), pixelCount);
+				ToneMapper::MapReference(mapper.GetOperator(), mapper.GetExposure(), in.data(), reference.data(), pixelCount);
+				for (size_t i = 0; i < reference.size(); i++)
+				{
+					matches = matches && IsNear(out[i], reference[i]);
+				}
+				matches = matches && out[pixelCount * 3] == Sentinel;
+
+				// In place
+				mapper.Map(in.data(), in.data(), pixelCount);
+				for (size_t i = 0; i < reference.size(); i++)
+				{
+					matches = matches && in[i] == out[i];
+				}
+			}
+			CHECK(matches);
+		}
+	}
+}
+
+static void TestBrightness()
+{
+	// log10(red + 1), green and blue are ignored
+	const float pixels[] = { 9.0f, 5.0f, 5.0f, 0.0f, 7.0f, 7.0f, 99.0f, 0.0f, 0.0f };
+	CHECK(fabs(ToneMapper::SumLogBrightness(pixels, 3) - 3.0) < 1e-6);
+
+	// RenderWindow's exposure, (1.03 - 2 / (2 + log10(10 * adapted + 1))) / average
+	CHECK(IsNear(ToneMapper::GetExposure(0.9f, 0.9f), (1.03f - 2.0f / 3.0f) / 0.9f));
+	CHECK(IsNear(ToneMapper::GetExposure(0.5f, 9.9f), (1.03f - 2.0f / 4.0f) / 0.5f));
+}
+
+void TestToneMapper()
+{
+	TestKnownValues();
+	TestBatches();
+	TestBrightness();
+}
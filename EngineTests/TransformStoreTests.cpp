@@ -0,0 +1,325 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <vector>
+#include "TransformStore.h"
+#include "TestFramework.h"
+
+static const uint32_t BenchmarkCounts[] = { 1024, 65536, 1048576 };
+
+struct Pose
+{
+	float position[3];
+	float rotation[4];
+	float scale[3];
+};
+
+struct ReferenceMatrix
+{
+	double m[16];
+};
+
+static std::vector<Pose> CreatePoses(uint32_t count, uint32_t seed)
+{
+	std::minstd_rand random(seed);
+	std::uniform_real_distribution<float> position(-5.0f, 5.0f);
+	std::uniform_real_distribution<float> component(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+
+	std::vector<Pose> poses(count);
+	for (Pose& pose : poses)
+	{
+		float length = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			pose.rotation[i] = component(random);
+			length += pose.rotation[i] * pose.rotation[i];
+		}
+		for (int i = 0; i < 4; i++)
+		{
+			pose.rotation[i] /= sqrtf(length);
+		}
+		for (int i = 0; i < 3; i++)
+		{
+			pose.position[i] = position(random);
+			pose.scale[i] = scale(random) * (random() % 8 == 0 ? -1.0f : 1.0f);
+		}
+	}
+	return poses;
+}
+
+static void SetPose(TransformStore& store, uint32_t entity, const Pose& pose)
+{
+	store.SetPosition(entity, pose.position[0], pose.position[1], pose.position[2]);
+	store.SetRotation(entity, pose.rotation[0], pose.rotation[1], pose.rotation[2], pose.rotation[3]);
+	store.SetScale(entity, pose.scale[0], pose.scale[1], pose.scale[2]);
+}
+
+// S * R + T one element at a time, as XMMatrixAffineTransformation composes it
+static ReferenceMatrix ComposeReference(const Pose& pose)
+{
+	double x = pose.rotation[0], y = pose.rotation[1], z = pose.rotation[2], w = pose.rotation[3];
+	double r[3][3] = {
+		{ 1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w) },
+		{ 2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w) },
+		{ 2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y) }
+	};
+
+	ReferenceMatrix result = {};
+	for (int row = 0; row < 3; row++)
+	{
+		for (int column = 0; column < 3; column++)
+		{
+			result.m[row * 4 + column] = r[row][column] * pose.scale[row];
+		}
+		result.m[12 + row] = pose.position[row];
+	}
+	result.m[15] = 1;
+	return result;
+}
+
+static ReferenceMatrix Multiply(const ReferenceMatrix& a, const ReferenceMatrix& b)
+{
+	ReferenceMatrix result;
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			result.m[i * 4 + j] = a.m[i * 4] * b.m[j] + a.m[i * 4 + 1] * b.m[4 + j] + a.m[i * 4 + 2] * b.m[8 + j] + a.m[i * 4 + 3] * b.m[12 + j];
+		}
+	}
+	return result;
+}
+
+// Inverse transpose of the upper 3x3 through the cofactors
+static ReferenceMatrix InverseTranspose3x3(const ReferenceMatrix& a)
+{
+	const double* m = a.m;
+	double cofactors[9] = {
+		m[5] * m[10] - m[6] * m[9], m[6] * m[8] - m[4] * m[10], m[4] * m[9] - m[5] * m[8],
+		m[2] * m[9] - m[1] * m[10], m[0] * m[10] - m[2] * m[8], m[1] * m[8] - m[0] * m[9],
+		m[1] * m[6] - m[2] * m[5], m[2] * m[4] - m[0] * m[6], m[0] * m[5] - m[1] * m[4]
+	};
+	double determinant = m[0] * cofactors[0] + m[1] * cofactors[1] + m[2] * cofactors[2];
+
+	ReferenceMatrix result = {};
+	for (int row = 0; row < 3; row++)
+	{
+		for (int column = 0; column < 3; column++)
+		{
+			result.m[row * 4 + column] = cofactors[row * 3 + column] / determinant;
+		}
+	}
+	result.m[15] = 1;
+	return result;
+}
+
+// Relative to the largest element, hierarchies multiply the magnitudes up
+static bool Near(const TransformStore::Matrix& matrix, const ReferenceMatrix& reference, bool upper3x3)
+{
+	double largest = 1;
+	for (int i = 0; i < 16; i++)
+	{
+		largest = fabs(reference.m[i]) > largest ? fabs(reference.m[i]) : largest;
+	}
+	for (int i = 0; i < 16; i++)
+	{
+		bool checked = !upper3x3 || (i % 4 < 3 && i < 12);
+		if (checked && fabs(matrix.m[i] - reference.m[i]) > 1e-4 * largest)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void TestTransformStore()
+{
+	const uint32_t count = 1003;
+
+	// Every entity picks an earlier parent or none
+	std::minstd_rand random(1);
+	std::vector<Pose> poses = CreatePoses(count, 1);
+	std::vector<uint32_t> parents(count);
+	TransformStore store;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		parents[i] = i == 0 || random() % 4 == 0 ? TransformStore::InvalidEntity : (uint32_t)(random() % i);
+		CHECK(store.Create(parents[i]) == i);
+	}
+	CHECK(store.GetCount() == count);
+
+	// Defaults are the identity
+	store.Update();
+	bool identity = true;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const TransformStore::Matrix& world = store.GetWorld(i);
+		for (int e = 0; e < 16; e++)
+		{
+			identity = identity && world.m[e] == (e % 5 == 0 ? 1.0f : 0.0f);
+		}
+	}
+	CHECK(identity);
+	CHECK(store.GetUpdatedCount() == count);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		SetPose(store, i, poses[i]);
+	}
+	store.Update();
+
+	std::vector<ReferenceMatrix> worlds(count);
+	bool worldsMatch = true;
+	bool normalsMatch = true;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		ReferenceMatrix local = ComposeReference(poses[i]);
+		worlds[i] = parents[i] == TransformStore::InvalidEntity ? local : Multiply(local, worlds[parents[i]]);
+		worldsMatch = worldsMatch && Near(store.GetWorld(i), worlds[i], false);
+		normalsMatch = normalsMatch && Near(store.GetNormal(i), InverseTranspose3x3(worlds[i]), true);
+		CHECK(store.GetParent(i) == parents[i]);
+	}
+	CHECK(worldsMatch);
+	CHECK(normalsMatch);
+
+	// A clean store updates nothing and reports nothing changed
+	store.Update();
+	CHECK(store.GetUpdatedCount() == 0);
+	store.Update();
+	bool unchanged = true;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		unchanged = unchanged && !store.WasChanged(i);
+	}
+	CHECK(unchanged);
+
+	// Moving one entity updates exactly its subtree
+	uint32_t moved = 0;
+	while (parents[moved] != TransformStore::InvalidEntity)
+	{
+		moved++;
+	}
+	std::vector<bool> inSubtree(count, false);
+	uint32_t subtreeSize = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		inSubtree[i] = i == moved || (parents[i] != TransformStore::InvalidEntity && inSubtree[parents[i]]);
+		subtreeSize += inSubtree[i] ? 1 : 0;
+	}
+	CHECK(subtreeSize > 1);
+
+	poses[moved].position[1] += 1.0f;
+	SetPose(store, moved, poses[moved]);
+	store.Update();
+	CHECK(store.GetUpdatedCount() == subtreeSize);
+	bool subtreeChanged = true;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		subtreeChanged = subtreeChanged && store.WasChanged(i) == inSubtree[i];
+		if (inSubtree[i])
+		{
+			ReferenceMatrix local = ComposeReference(poses[i]);
+			worlds[i] = parents[i] == TransformStore::InvalidEntity ? local : Multiply(local, worlds[parents[i]]);
+			subtreeChanged = subtreeChanged && Near(store.GetWorld(i), worlds[i], false);
+		}
+	}
+	CHECK(subtreeChanged);
+
+	// The threaded composition gives the same matrices
+	const uint32_t largeCount = 40000;
+	std::vector<Pose> largePoses = CreatePoses(largeCount, 2);
+	TransformStore single;
+	TransformStore threaded;
+	for (uint32_t i = 0; i < largeCount; i++)
+	{
+		uint32_t parent = i > 0 && i % 3 == 0 ? i / 2 : TransformStore::InvalidEntity;
+		single.Create(parent);
+		threaded.Create(parent);
+		SetPose(single, i, largePoses[i]);
+		SetPose(threaded, i, largePoses[i]);
+	}
+	single.Update(1);
+	threaded.Update(4);
+	bool same = true;
+	for (uint32_t i = 0; i < largeCount; i++)
+	{
+		same = same && memcmp(&single.GetWorld(i), &threaded.GetWorld(i), sizeof(TransformStore::Matrix)) == 0
+			&& memcmp(&single.GetNormal(i), &threaded.GetNormal(i), sizeof(TransformStore::Matrix)) == 0;
+	}
+	CHECK(same);
+
+	store.Clear();
+	CHECK(store.GetCount() == 0);
+}
+
+// One entity at a time in floats, the world and normal matrices Update()
+// writes for entities without a parent
+static void ComposeScalar(const std::vector<Pose>& poses, std::vector<TransformStore::Matrix>& worlds,
+	std::vector<TransformStore::Matrix>& normals)
+{
+	for (size_t i = 0; i < poses.size(); i++)
+	{
+		const Pose& pose = poses[i];
+		float x = pose.rotation[0], y = pose.rotation[1], z = pose.rotation[2], w = pose.rotation[3];
+		float r[3][3] = {
+			{ 1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w) },
+			{ 2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w) },
+			{ 2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y) }
+		};
+
+		float* pWorld = worlds[i].m;
+		float* pNormal = normals[i].m;
+		for (int row = 0; row < 3; row++)
+		{
+			float inverseScale = 1.0f / pose.scale[row];
+			for (int column = 0; column < 3; column++)
+			{
+				pWorld[row * 4 + column] = r[row][column] * pose.scale[row];
+				pNormal[row * 4 + column] = r[row][column] * inverseScale;
+			}
+			pWorld[row * 4 + 3] = 0;
+			pNormal[row * 4 + 3] = 0;
+			pWorld[12 + row] = pose.position[row];
+			pNormal[12 + row] = 0;
+		}
+		pWorld[15] = 1;
+		pNormal[15] = 1;
+	}
+}
+
+void BenchmarkTransformStore(double seconds)
+{
+	// Update() is timed as the difference of setting every pose with and
+	// without the update that follows
+	printf("%-10s %14s %14s %14s %10s\n", "entities", "set (M/s)", "update (M/s)", "scalar (M/s)", "speedup");
+	for (uint32_t count : BenchmarkCounts)
+	{
+		std::vector<Pose> poses = CreatePoses(count, 1);
+		std::vector<TransformStore::Matrix> worlds(count);
+		std::vector<TransformStore::Matrix> normals(count);
+
+		// Every entity moves every frame, without a hierarchy
+		TransformStore store;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			store.Create();
+		}
+		auto setPoses = [&]()
+		{
+			for (uint32_t i = 0; i < count; i++)
+			{
+				SetPose(store, i, poses[i]);
+			}
+		};
+
+		double setMs = TimeWork(seconds / 3, setPoses);
+		double setUpdateMs = TimeWork(seconds / 3, [&]() { setPoses(); store.Update(1); });
+		double scalarMs = TimeWork(seconds / 3, [&]() { ComposeScalar(poses, worlds, normals); });
+		double updateMs = setUpdateMs - setMs > 1e-6 ? setUpdateMs - setMs : 1e-6;
+
+		printf("%-10u %14.1f %14.1f %14.1f %10.2f\n", count, count / (setMs * 1000.0), count / (updateMs * 1000.0),
+			count / (scalarMs * 1000.0), scalarMs / updateMs);
+	}
+}
@@ -0,0 +1,288 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <vector>
+#include "VertexCompression.h"
+#include "TestFramework.h"
+
+static const size_t BenchmarkVertexCounts[] = { 1024, 65536, 1048576 };
+
+// Largest angle in degrees between an encoded and its decoded normal. The
+// octahedral grid step is 2 / range, about 1.6 / range radians on the sphere
+// at worst, rounding halves it.
+static const double MaxOct16ErrorDegrees = 0.005;
+static const double MaxOct8ErrorDegrees = 1.2;
+
+static double GetAngleDegrees(const float* a, const float* b)
+{
+	double dot = (double)a[0] * b[0] + (double)a[1] * b[1] + (double)a[2] * b[2];
+	double cross[3] = {
+		(double)a[1] * b[2] - (double)a[2] * b[1],
+		(double)a[2] * b[0] - (double)a[0] * b[2],
+		(double)a[0] * b[1] - (double)a[1] * b[0]
+	};
+	return atan2(sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]), dot) * 180.0 / 3.14159265358979;
+}
+
+// Uniform on the sphere, plus the axes and diagonals where the octahedral
+// map folds
+static std::vector<MeshVertex> CreateNormals(size_t randomCount)
+{
+	std::vector<MeshVertex> vertices;
+	for (int x = -1; x <= 1; x++)
+	{
+		for (int y = -1; y <= 1; y++)
+		{
+			for (int z = -1; z <= 1; z++)
+			{
+				if (x != 0 || y != 0 || z != 0)
+				{
+					float length = sqrtf((float)(x * x + y * y + z * z));
+					MeshVertex vertex = { { 0, 0, 0 }, { 0, 0 }, { x / length, y / length, z / length } };
+					vertices.push_back(vertex);
+				}
+			}
+		}
+	}
+
+	std::minstd_rand random(1);
+	std::normal_distribution<float> gaussian;
+	while (vertices.size() < 26 + randomCount)
+	{
+		float n[3] = { gaussian(random), gaussian(random), gaussian(random) };
+		float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length > 1e-3f)
+		{
+			MeshVertex vertex = { { 0, 0, 0 }, { 0, 0 }, { n[0] / length, n[1] / length, n[2] / length } };
+			vertices.push_back(vertex);
+		}
+	}
+	return vertices;
+}
+
+static double GetMaxNormalError(VertexFormat format, const std::vector<MeshVertex>& vertices, bool* pUnitLength)
+{
+	PositionQuantization quantization = { 1, { 0, 0, 0 } };
+	std::vector<uint8_t> packed(vertices.size() * VertexCompression::GetVertexSize(format));
+	std::vector<MeshVertex> decoded(vertices.size());
+	VertexCompression::Encode(format, vertices.data(), vertices.size(), quantization, packed.data());
+	VertexCompression::Decode(format, packed.data(), vertices.size(), quantization, decoded.data());
+
+	double maxError = 0;
+	*pUnitLength = true;
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		const float* n = decoded[i].normal;
+		maxError = fmax(maxError, GetAngleDegrees(vertices[i].normal, n));
+		*pUnitLength = *pUnitLength && fabs(sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) - 1.0) < 1e-5;
+	}
+	return maxError;
+}
+
+static void TestNormals()
+{
+	std::vector<MeshVertex> vertices = CreateNormals(200000);
+
+	bool unitLength = false;
+	double oct16Error = GetMaxNormalError(VERTEX_FORMAT_PACKED_OCT16, vertices, &unitLength);
+	CHECK(oct16Error < MaxOct16ErrorDegrees);
+	CHECK(unitLength);
+
+	double oct8Error = GetMaxNormalError(VERTEX_FORMAT_PACKED_OCT8, vertices, &unitLength);
+	CHECK(oct8Error < MaxOct8ErrorDegrees);
+	CHECK(unitLength);
+
+	// The axes are corners and edge midpoints of the octahedron, exact in both
+	for (VertexFormat format : { VERTEX_FORMAT_PACKED_OCT16, VERTEX_FORMAT_PACKED_OCT8 })
+	{
+		std::vector<MeshVertex> axes;
+		for (const MeshVertex& vertex : std::vector<MeshVertex>(vertices.begin(), vertices.begin() + 26))
+		{
+			if (fabsf(vertex.normal[0]) + fabsf(vertex.normal[1]) + fabsf(vertex.normal[2]) == 1)
+			{
+				axes.push_back(vertex);
+			}
+		}
+		CHECK(axes.size() == 6 && GetMaxNormalError(format, axes, &unitLength) == 0);
+	}
+
+	// Oct8 keeps x in the low byte of w and y in the high one
+	MeshVertex up = { { 0, 0, 0 }, { 0, 0 }, { 0, 0, 1 } };
+	MeshVertex right = { { 0, 0, 0 }, { 0, 0 }, { 1, 0, 0 } };
+	MeshVertex down = { { 0, 0, 0 }, { 0, 0 }, { 0, -1, 0 } };
+	PositionQuantization quantization = { 1, { 0, 0, 0 } };
+	PackedVertexOct8 packed;
+	VertexCompression::Encode(VERTEX_FORMAT_PACKED_OCT8, &up, 1, quantization, &packed);
+	CHECK(packed.position[3] == 0);
+	VertexCompression::Encode(VERTEX_FORMAT_PACKED_OCT8, &right, 1, quantization, &packed);
+	CHECK(packed.position[3] == 0x007F);
+	VertexCompression::Encode(VERTEX_FORMAT_PACKED_OCT8, &down, 1, quantization, &packed);
+	CHECK(packed.position[3] == 0x8100);
+}
+
+static void TestPositions()
+{
+	const float boundsMin[3] = { -3, 10, -0.5f };
+	const float boundsMax[3] = { 5, 11, 0.5f };
+	PositionQuantization quantization = VertexCompression::ComputeQuantization(boundsMin, boundsMax);
+	CHECK(quantization.scale == 8 && quantization.offset[0] == -3 && quantization.offset[1] == 10 && quantization.offset[2] == -0.5f);
+
+	std::minstd_rand random(2);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<MeshVertex> vertices(10007);
+	for (MeshVertex& vertex : vertices)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			vertex.position[c] = boundsMin[c] + unit(random) * (boundsMax[c] - boundsMin[c]);
+		}
+		vertex.uv[0] = unit(random) * 4 - 2;
+		vertex.uv[1] = unit(random);
+		vertex.normal[0] = 0;
+		vertex.normal[1] = 0;
+		vertex.normal[2] = 1;
+	}
+	for (int c = 0; c < 3; c++)
+	{
+		vertices[0].position[c] = boundsMin[c];
+		vertices[1].position[c] = boundsMax[c];
+	}
+
+	// Half a quantization step plus float rounding of the decode
+	const double maxPositionError = quantization.scale / 65535.0 * 0.5 + 1e-5;
+	for (VertexFormat format : { VERTEX_FORMAT_PACKED_OCT16, VERTEX_FORMAT_PACKED_OCT8 })
+	{
+		std::vector<uint8_t> packed(vertices.size() * VertexCompression::GetVertexSize(format));
+		std::vector<MeshVertex> decoded(vertices.size());
+		VertexCompression::Encode(format, vertices.data(), vertices.size(), quantization, packed.data());
+		VertexCompression::Decode(format, packed.data(), vertices.size(), quantization, decoded.data());
+
+		double positionError = 0;
+		bool uvsMatch = true;
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				positionError = fmax(positionError, fabs((double)decoded[i].position[c] - vertices[i].position[c]));
+			}
+			for (int c = 0; c < 2; c++)
+			{
+				uvsMatch = uvsMatch && decoded[i].uv[c] == VertexCompression::HalfToFloat(VertexCompression::FloatToHalf(vertices[i].uv[c]));
+			}
+		}
+		CHECK(positionError <= maxPositionError);
+		CHECK(uvsMatch);
+		CHECK(decoded[0].position[0] == boundsMin[0] && decoded[1].position[0] == boundsMax[0]);
+
+		// Every tail length encodes the same bytes as a full block
+		size_t vertexSize = VertexCompression::GetVertexSize(format);
+		bool tailsMatch = true;
+		for (size_t count = 1; count < 8; count++)
+		{
+			std::vector<uint8_t> tail(count * vertexSize);
+			VertexCompression::Encode(format, vertices.data() + 100, count, quantization, tail.data());
+			tailsMatch = tailsMatch && memcmp(tail.data(), packed.data() + 100 * vertexSize, tail.size()) == 0;
+		}
+		CHECK(tailsMatch);
+	}
+
+	// Outside the bounds clamps instead of wrapping, flat bounds collapse to the offset
+	MeshVertex outside = { { -100, 100, 0 }, { 0, 0 }, { 0, 0, 1 } };
+	PackedVertexOct16 packed;
+	VertexCompression::Encode(VERTEX_FORMAT_PACKED_OCT16, &outside, 1, quantization, &packed);
+	CHECK(packed.position[0] == 0 && packed.position[1] == 65535);
+
+	const float flat[3] = { 1, 2, 3 };
+	PositionQuantization point = VertexCompression::ComputeQuantization(flat, flat);
+	MeshVertex decoded;
+	VertexCompression::Encode(VERTEX_FORMAT_PACKED_OCT16, &outside, 1, point, &packed);
+	VertexCompression::Decode(VERTEX_FORMAT_PACKED_OCT16, &packed, 1, point, &decoded);
+	CHECK(point.scale == 0 && decoded.position[0] == 1 && decoded.position[1] == 2 && decoded.position[2] == 3);
+}
+
+static void TestHalves()
+{
+	// Every half survives the round trip, NaNs stay NaN
+	bool roundTrip = true;
+	for (uint32_t bits = 0; bits < 0x10000; bits++)
+	{
+		float value = VertexCompression::HalfToFloat((uint16_t)bits);
+		uint16_t half = VertexCompression::FloatToHalf(value);
+		bool isNan = (bits & 0x7C00) == 0x7C00 && (bits & 0x3FF) != 0;
+		roundTrip = roundTrip && (isNan ? value != value && (half & 0x7C00) == 0x7C00 && (half & 0x3FF) != 0 : half == bits);
+	}
+	CHECK(roundTrip);
+
+	// Rounding to nearest even, overflow and underflow
+	CHECK(VertexCompression::FloatToHalf(1.0f) == 0x3C00);
+	CHECK(VertexCompression::FloatToHalf(-2.0f) == 0xC000);
+	CHECK(VertexCompression::FloatToHalf(1.0f + 1.0f / 2048) == 0x3C00);
+	CHECK(VertexCompression::FloatToHalf(1.0f + 3.0f / 2048) == 0x3C02);
+	CHECK(VertexCompression::FloatToHalf(65504.0f) == 0x7BFF);
+	CHECK(VertexCompression::FloatToHalf(65520.0f) == 0x7C00);
+	CHECK(VertexCompression::FloatToHalf(5.96046448e-8f) == 0x0001);
+	CHECK(VertexCompression::FloatToHalf(2.0e-8f) == 0x0000);
+	CHECK(VertexCompression::FloatToHalf(-1e10f) == 0xFC00);
+
+	// The SSE encoder rounds like the scalar one, subnormals and all
+	std::minstd_rand random(3);
+	std::vector<MeshVertex> vertices(4096);
+	for (MeshVertex& vertex : vertices)
+	{
+		memset(&vertex, 0, sizeof(vertex));
+		for (int c = 0; c < 2; c++)
+		{
+			uint32_t bits = (uint32_t)random() & 0x7FFFFFFF;
+			// Exponents around the half range
+			bits = (bits & 0x807FFFFF) | ((uint32_t)(95 + random() % 50) << 23);
+			memcpy(&vertex.uv[c], &bits, sizeof(bits));
+			vertex.uv[c] = random() % 2 ? -vertex.uv[c] : vertex.uv[c];
+		}
+		vertex.normal[2] = 1;
+	}
+	std::vector<PackedVertexOct16> packed(vertices.size());
+	PositionQuantization quantization = { 1, { 0, 0, 0 } };
+	VertexCompression::Encode(VERTEX_FORMAT_PACKED_OCT16, vertices.data(), vertices.size(), quantization, packed.data());
+	bool matches = true;
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		matches = matches && packed[i].uv[0] == VertexCompression::FloatToHalf(vertices[i].uv[0])
+			&& packed[i].uv[1] == VertexCompression::FloatToHalf(vertices[i].uv[1]);
+	}
+	CHECK(matches);
+}
+
+void TestVertexCompression()
+{
+	TestNormals();
+	TestPositions();
+	TestHalves();
+}
+
+void BenchmarkVertexCompression(double seconds)
+{
+	printf("%-10s %18s %18s %18s\n", "vertices", "Oct16 (Mvert/s)", "Oct8 (Mvert/s)", "decode (Mvert/s)");
+	for (size_t count : BenchmarkVertexCounts)
+	{
+		std::vector<MeshVertex> vertices = CreateNormals(count - 26);
+		PositionQuantization quantization = { 1, { 0, 0, 0 } };
+		std::vector<uint8_t> packed(count * sizeof(PackedVertexOct16));
+		std::vector<MeshVertex> decoded(count);
+
+		double oct16Ms = TimeWork(seconds / 3, [&]()
+		{
+			VertexCompression::Encode(VERTEX_FORMAT_PACKED_OCT16, vertices.data(), count, quantization, packed.data());
+		});
+		double oct8Ms = TimeWork(seconds / 3, [&]()
+		{
+			VertexCompression::Encode(VERTEX_FORMAT_PACKED_OCT8, vertices.data(), count, quantization, packed.data());
+		});
+		double decodeMs = TimeWork(seconds / 3, [&]()
+		{
+			VertexCompression::Decode(VERTEX_FORMAT_PACKED_OCT8, packed.data(), count, quantization, decoded.data());
+		});
+
+		printf("%-10zu %18.1f %18.1f %18.1f\n", count, count / (oct16Ms * 1000.0), count / (oct8Ms * 1000.0), count / (decodeMs * 1000.0));
+	}
+}
@@ -0,0 +1,183 @@
+#include "FrustumCuller.h"
+
+#include <assert.h>
+#include <math.h>
+#include <xmmintrin.h>
+
+const uint32_t FrustumCuller::PlaneCount;
+
+static __m128 Abs(__m128 value)
+{
+	return _mm_andnot_ps(_mm_set1_ps(-0.0f), value);
+}
+
+FrustumCuller::FrustumCuller()
+{
+	// Everything is visible until a matrix is set
+	for (uint32_t i = 0; i < PlaneCount; i++)
+	{
+		m_planes[i][0] = m_planes[i][1] = m_planes[i][2] = 0.0f;
+		m_planes[i][3] = 1.0f;
+	}
+}
+
+void FrustumCuller::SetViewProjection(const float* viewProj)
+{
+	// clip = v * M, so the planes are combinations of the matrix columns
+	float column[4][4];
+	for (int c = 0; c < 4; c++)
+	{
+		for (int r = 0; r < 4; r++)
+		{
+			column[c][r] = viewProj[r * 4 + c];
+		}
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		m_planes[0][i] = column[3][i] + column[0][i]; // left
+		m_planes[1][i] = column[3][i] - column[0][i]; // right
+		m_planes[2][i] = column[3][i] + column[1][i]; // bottom
+		m_planes[3][i] = column[3][i] - column[1][i]; // top
+		m_planes[4][i] = column[2][i];                // near
+		m_planes[5][i] = column[3][i] - column[2][i]; // far
+	}
+
+	for (uint32_t p = 0; p < PlaneCount; p++)
+	{
+		float length = sqrtf(m_planes[p][0] * m_planes[p][0] + m_planes[p][1] * m_planes[p][1] + m_planes[p][2] * m_planes[p][2]);
+		if (length > 0.0f)
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				m_planes[p][i] /= length;
+			}
+		}
+	}
+}
+
+const float* FrustumCuller::GetPlane(uint32_t plane) const
+{
+	assert(plane < PlaneCount);
+	return m_planes[plane];
+}
+
+uint32_t FrustumCuller::CullSpheres(const float* centerX, const float* centerY, const float* centerZ, const float* radius,
+	uint32_t count, uint32_t* pVisible) const
+{
+	uint32_t visible = 0;
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(centerX + i);
+		__m128 y = _mm_loadu_ps(centerY + i);
+		__m128 z = _mm_loadu_ps(centerZ + i);
+		__m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+
+		__m128 outside = _mm_setzero_ps();
+		for (uint32_t p = 0; p < PlaneCount; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m_planes[p][0])), _mm_mul_ps(y, _mm_set1_ps(m_planes[p][1]))),
+				_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(m_planes[p][2])), _mm_set1_ps(m_planes[p][3])));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negRadius));
+		}
+
+		int mask = ~_mm_movemask_ps(outside) & 0xF;
+		for (uint32_t lane = 0; mask != 0; lane++, mask >>= 1)
+		{
+			pVisible[visible] = i + lane;
+			visible += mask & 1;
+		}
+	}
+
+	for (; i < count; i++)
+	{
+		bool inside = true;
+		for (uint32_t p = 0; p < PlaneCount && inside; p++)
+		{
+			float distance = centerX[i] * m_planes[p][0] + centerY[i] * m_planes[p][1] + centerZ[i] * m_planes[p][2] + m_planes[p][3];
+			inside = distance >= -radius[i];
+		}
+		if (inside)
+		{
+			pVisible[visible++] = i;
+		}
+	}
+
+	return visible;
+}
+
+uint32_t FrustumCuller::CullBoxes(const float* centerX, const float* centerY, const float* centerZ,
+	const float* extentX, const float* extentY, const float* extentZ,
+	uint32_t count, uint32_t* pVisible) const
+{
+	uint32_t visible = 0;
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(centerX + i);
+		__m128 y = _mm_loadu_ps(centerY + i);
+		__m128 z = _mm_loadu_ps(centerZ + i);
+		__m128 ex = _mm_loadu_ps(extentX + i);
+		__m128 ey = _mm_loadu_ps(extentY + i);
+		__m128 ez = _mm_loadu_ps(extentZ + i);
+
+		__m128 outside = _mm_setzero_ps();
+		for (uint32_t p = 0; p < PlaneCount; p++)
+		{
+			__m128 a = _mm_set1_ps(m_planes[p][0]);
+			__m128 b = _mm_set1_ps(m_planes[p][1]);
+			__m128 c = _mm_set1_ps(m_planes[p][2]);
+
+			// Box is outside when even its corner furthest along the normal is behind the plane
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, a), _mm_mul_ps(y, b)), _mm_add_ps(_mm_mul_ps(z, c), _mm_set1_ps(m_planes[p][3])));
+			__m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, Abs(a)), _mm_mul_ps(ey, Abs(b))), _mm_mul_ps(ez, Abs(c)));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+		}
+
+		int mask = ~_mm_movemask_ps(outside) & 0xF;
+		for (uint32_t lane = 0; mask != 0; lane++, mask >>= 1)
+		{
+			pVisible[visible] = i + lane;
+			visible += mask & 1;
+		}
+	}
+
+	for (; i < count; i++)
+	{
+		BoundingBox box = { { centerX[i], centerY[i], centerZ[i] }, { extentX[i], extentY[i], extentZ[i] } };
+		uint32_t planeMask = (1u << PlaneCount) - 1;
+		if (TestBox(box, &planeMask) != CULL_OUTSIDE)
+		{
+			pVisible[visible++] = i;
+		}
+	}
+
+	return visible;
+}
+
+FrustumCuller::Result FrustumCuller::TestBox(const BoundingBox& box, uint32_t* pPlaneMask) const
+{
+	for (uint32_t p = 0; p < PlaneCount; p++)
+	{
+		if ((*pPlaneMask & (1u << p)) == 0)
+		{
+			continue;
+		}
+
+		const float* plane = m_planes[p];
+		float distance = box.center[0] * plane[0] + box.center[1] * plane[1] + box.center[2] * plane[2] + plane[3];
+		float reach = box.extent[0] * fabsf(plane[0]) + box.extent[1] * fabsf(plane[1]) + box.extent[2] * fabsf(plane[2]);
+
+		if (distance + reach < 0.0f)
+		{
+			return CULL_OUTSIDE;
+		}
+		if (distance - reach >= 0.0f)
+		{
+			*pPlaneMask &= ~(1u << p);
+		}
+	}
+
+	return *pPlaneMask == 0 ? CULL_INSIDE : CULL_INTERSECT;
+}
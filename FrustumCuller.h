@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+// Axis aligned box as center and half size
+struct BoundingBox
+{
+	float center[3];
+	float extent[3];
+};
+
+// Frustum planes extracted from a view-projection matrix. Bounds are tested
+// four at a time with SSE, the Cull* functions write indices of visible
+// elements to a compact list and return their count.
+class FrustumCuller
+{
+public:
+	enum Result
+	{
+		CULL_OUTSIDE = 0,
+		CULL_INTERSECT,
+		CULL_INSIDE
+	};
+
+	static const uint32_t PlaneCount = 6;
+
+	FrustumCuller();
+
+	// Row-major matrix in the DirectXMath row-vector convention, D3D clip depth 0..w
+	void SetViewProjection(const float* viewProj);
+
+	// Plane a, b, c, d with the normal pointing inside, normalized
+	const float* GetPlane(uint32_t plane) const;
+
+	uint32_t CullSpheres(const float* centerX, const float* centerY, const float* centerZ, const float* radius,
+		uint32_t count, uint32_t* pVisible) const;
+	uint32_t CullBoxes(const float* centerX, const float* centerY, const float* centerZ,
+		const float* extentX, const float* extentY, const float* extentZ,
+		uint32_t count, uint32_t* pVisible) const;
+
+	// Classifies one box against the planes set in planeMask, clears bits of
+	// planes the box is fully inside so children can skip them
+	Result TestBox(const BoundingBox& box, uint32_t* pPlaneMask) const;
+
+private:
+	float m_planes[PlaneCount][4];
+};
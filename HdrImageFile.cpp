@@ -0,0 +1,1251 @@
+#include "HdrImageFile.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "VertexCompression.h"
+
+// Pixel data is copied as is, the hosts are little endian
+
+static const size_t ReadBufferSize = 64 * 1024;
+
+// Radiance scanlines of these widths may be run length encoded
+static const uint32_t MinRgbeRunWidth = 8;
+static const uint32_t MaxRgbeRunWidth = 0x7FFF;
+
+static const uint32_t ExrMagic = 20000630;
+static const uint32_t ExrVersion = 2;
+static const uint32_t ExrTiledFlag = 0x200;
+static const uint32_t ExrDeepFlag = 0x800;
+static const uint32_t ExrMultipartFlag = 0x1000;
+
+enum ExrPixelType
+{
+	EXR_PIXEL_UINT = 0,
+	EXR_PIXEL_HALF = 1,
+	EXR_PIXEL_FLOAT = 2,
+};
+
+static FILE* OpenFile(const char* path, const char* mode)
+{
+	FILE* pFile = NULL;
+#ifdef _MSC_VER
+	fopen_s(&pFile, path, mode);
+#else
+	pFile = fopen(path, mode);
+#endif
+	return pFile;
+}
+
+static bool SeekFile(FILE* pFile, uint64_t offset)
+{
+#ifdef _MSC_VER
+	return _fseeki64(pFile, (__int64)offset, SEEK_SET) == 0;
+#else
+	return fseeko(pFile, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static bool GetFileSize(FILE* pFile, uint64_t* pSize)
+{
+#ifdef _MSC_VER
+	if (_fseeki64(pFile, 0, SEEK_END) != 0)
+	{
+		return false;
+	}
+	__int64 size = _ftelli64(pFile);
+#else
+	if (fseeko(pFile, 0, SEEK_END) != 0)
+	{
+		return false;
+	}
+	off_t size = ftello(pFile);
+#endif
+	*pSize = (uint64_t)size;
+	return size >= 0 && SeekFile(pFile, 0);
+}
+
+static bool HasExtension(const char* path, const char* extension)
+{
+	const char* pDot = strrchr(path, '.');
+	if (pDot == nullptr)
+	{
+		return false;
+	}
+	for (pDot++; *pDot != 0 && *extension != 0; pDot++, extension++)
+	{
+		char c = *pDot >= 'A' && *pDot <= 'Z' ? *pDot - 'A' + 'a' : *pDot;
+		if (c != *extension)
+		{
+			return false;
+		}
+	}
+	return *pDot == 0 && *extension == 0;
+}
+
+static bool IsSpace(int c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static uint32_t GetU32(const uint8_t* p)
+{
+	return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void AppendU32(std::vector<uint8_t>& bytes, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		bytes.push_back((uint8_t)(value >> (i * 8)));
+	}
+}
+
+static void AppendU64(std::vector<uint8_t>& bytes, uint64_t value)
+{
+	for (int i = 0; i < 8; i++)
+	{
+		bytes.push_back((uint8_t)(value >> (i * 8)));
+	}
+}
+
+static void AppendFloat(std::vector<uint8_t>& bytes, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	AppendU32(bytes, bits);
+}
+
+// Null terminated
+static void AppendString(std::vector<uint8_t>& bytes, const char* text)
+{
+	bytes.insert(bytes.end(), text, text + strlen(text) + 1);
+}
+
+static void AppendExrAttribute(std::vector<uint8_t>& bytes, const char* name, const char* type, uint32_t size)
+{
+	AppendString(bytes, name);
+	AppendString(bytes, type);
+	AppendU32(bytes, size);
+}
+
+static void SwapBytes(float* pValues, size_t count)
+{
+	uint8_t* p = reinterpret_cast<uint8_t*>(pValues);
+	for (size_t i = 0; i < count; i++, p += 4)
+	{
+		std::swap(p[0], p[3]);
+		std::swap(p[1], p[2]);
+	}
+}
+
+// Radiance's colr_color(), the mantissa is taken at the center of its step
+static void RgbeToFloat(const uint8_t* pRgbe, float* pRgb)
+{
+	if (pRgbe[3] == 0)
+	{
+		pRgb[0] = pRgb[1] = pRgb[2] = 0;
+		return;
+	}
+	// 2^(e - 136), built from the bits unless it is subnormal
+	int exponent = (int)pRgbe[3] - (128 + 8);
+	float scale;
+	if (exponent >= -126)
+	{
+		uint32_t bits = (uint32_t)(exponent + 127) << 23;
+		memcpy(&scale, &bits, sizeof(scale));
+	}
+	else
+	{
+		scale = ldexpf(1.0f, exponent);
+	}
+	for (int j = 0; j < 3; j++)
+	{
+		pRgb[j] = (pRgbe[j] + 0.5f) * scale;
+	}
+}
+
+// Radiance's setcolr()
+static void FloatToRgbe(const float* pRgb, uint8_t* pRgbe)
+{
+	// Negative and NaN values become 0
+	float rgb[3];
+	for (int j = 0; j < 3; j++)
+	{
+		rgb[j] = pRgb[j] > 0 ? pRgb[j] : 0.0f;
+	}
+	float maxValue = std::max(rgb[0], std::max(rgb[1], rgb[2]));
+	if (maxValue < 1e-32f)
+	{
+		pRgbe[0] = pRgbe[1] = pRgbe[2] = pRgbe[3] = 0;
+		return;
+	}
+
+	// frexp(max) * 256 / max is 2^(8 - exponent), built from the bits for
+	// normal values
+	maxValue = std::min(maxValue, 1e38f);
+	uint32_t maxBits;
+	memcpy(&maxBits, &maxValue, sizeof(maxBits));
+	int exponent = (int)(maxBits >> 23) - 126;
+	float scale;
+	if ((maxBits >> 23) != 0 && 8 - exponent <= 127)
+	{
+		uint32_t bits = (uint32_t)(8 - exponent + 127) << 23;
+		memcpy(&scale, &bits, sizeof(scale));
+	}
+	else
+	{
+		scale = frexpf(maxValue, &exponent) * 256.0f / maxValue;
+	}
+	for (int j = 0; j < 3; j++)
+	{
+		pRgbe[j] = (uint8_t)std::min(rgb[j] * scale, 255.0f);
+	}
+	pRgbe[3] = (uint8_t)(exponent + 128);
+}
+
+// One component of a new style run length encoded scanline. Runs shorter
+// than 4 are stored as literals unless they start the remaining data.
+static void EncodeRgbeRuns(const uint8_t* pData, uint32_t count, std::vector<uint8_t>& bytes)
+{
+	uint32_t cur = 0;
+	while (cur < count)
+	{
+		uint32_t runStart = cur;
+		uint32_t runCount = 0;
+		uint32_t previousRunCount = 0;
+		while (runCount < 4 && runStart < count)
+		{
+			runStart += runCount;
+			previousRunCount = runCount;
+			runCount = 1;
+			while (runStart + runCount < count && runCount < 127 && pData[runStart] == pData[runStart + runCount])
+			{
+				runCount++;
+			}
+		}
+
+		// Short run before the long one
+		if (previousRunCount > 1 && previousRunCount == runStart - cur)
+		{
+			bytes.push_back((uint8_t)(128 + previousRunCount));
+			bytes.push_back(pData[cur]);
+			cur = runStart;
+		}
+
+		while (cur < runStart)
+		{
+			uint32_t literalCount = std::min(runStart - cur, 128u);
+			bytes.push_back((uint8_t)literalCount);
+			bytes.insert(bytes.end(), pData + cur, pData + cur + literalCount);
+			cur += literalCount;
+		}
+
+		if (runCount >= 4)
+		{
+			bytes.push_back((uint8_t)(128 + runCount));
+			bytes.push_back(pData[runStart]);
+			cur += runCount;
+		}
+	}
+}
+
+//
+// HdrImageReader
+//
+
+HdrImageReader::HdrImageReader()
+	: m_pFile(NULL)
+	, m_format(HDR_IMAGE_UNKNOWN)
+	, m_width(0)
+	, m_height(0)
+	, m_row(0)
+	, m_bufferOffset(0)
+	, m_bufferPos(0)
+	, m_bufferSize(0)
+	, m_fileSize(0)
+	, m_dataOffset(0)
+	, m_channelCount(0)
+	, m_bigEndian(false)
+	, m_lineSize(0)
+	, m_hasColor(false)
+{
+	m_error[0] = 0;
+}
+
+HdrImageReader::~HdrImageReader()
+{
+	Close();
+}
+
+bool HdrImageReader::Open(const char* path)
+{
+	Close();
+	m_error[0] = 0;
+
+	m_pFile = OpenFile(path, "rb");
+	if (m_pFile == NULL)
+	{
+		return SetError("can not open the file");
+	}
+	if (!GetFileSize(m_pFile, &m_fileSize))
+	{
+		Close();
+		return SetError("can not open the file");
+	}
+	m_buffer.resize(ReadBufferSize);
+
+	uint8_t magic[4];
+	if (!ReadBytes(magic, sizeof(magic)) || !Seek(0))
+	{
+		Close();
+		return SetError("unknown file format");
+	}
+
+	bool opened;
+	if (magic[0] == 'P' && (magic[1] == 'F' || magic[1] == 'f'))
+	{
+		opened = OpenPfm();
+	}
+	else if (magic[0] == '#' && magic[1] == '?')
+	{
+		opened = OpenRgbe();
+	}
+	else if (GetU32(magic) == ExrMagic)
+	{
+		opened = OpenExr();
+	}
+	else
+	{
+		opened = SetError("unknown file format");
+	}
+
+	if (opened && (m_width == 0 || m_height == 0))
+	{
+		opened = SetError("empty image");
+	}
+	if (!opened)
+	{
+		Close();
+	}
+	return opened;
+}
+
+void HdrImageReader::Close()
+{
+	if (m_pFile != NULL)
+	{
+		fclose(m_pFile);
+		m_pFile = NULL;
+	}
+	m_format = HDR_IMAGE_UNKNOWN;
+	m_width = 0;
+	m_height = 0;
+	m_row = 0;
+	m_bufferOffset = 0;
+	m_bufferPos = 0;
+	m_bufferSize = 0;
+	m_fileSize = 0;
+	m_lineOffsets.clear();
+	m_channels.clear();
+	std::vector<uint8_t>().swap(m_buffer);
+	std::vector<uint8_t>().swap(m_line);
+}
+
+bool HdrImageReader::OpenPfm()
+{
+	// "PF" or "Pf", width, height and scale separated by white space, then
+	// a single white space character before the data
+	char tokens[4][32];
+	for (int t = 0; t < 4; t++)
+	{
+		int c = ReadByte();
+		while (IsSpace(c))
+		{
+			c = ReadByte();
+		}
+		size_t length = 0;
+		for (; c >= 0 && !IsSpace(c) && length + 1 < sizeof(tokens[t]); c = ReadByte())
+		{
+			tokens[t][length++] = (char)c;
+		}
+		tokens[t][length] = 0;
+		if (!IsSpace(c))
+		{
+			return SetError("invalid PFM header");
+		}
+	}
+
+	if (strcmp(tokens[0], "PF") != 0 && strcmp(tokens[0], "Pf") != 0)
+	{
+		return SetError("invalid PFM header");
+	}
+	char* pEnd;
+	unsigned long width = strtoul(tokens[1], &pEnd, 10);
+	unsigned long height = *pEnd == 0 ? strtoul(tokens[2], &pEnd, 10) : 0;
+	float scale = *pEnd == 0 ? strtof(tokens[3], &pEnd) : 0.0f;
+	if (*pEnd != 0 || scale == 0 || width > 0xFFFFFF || height > 0xFFFFFF)
+	{
+		return SetError("invalid PFM header");
+	}
+	m_channelCount = tokens[0][1] == 'F' ? 3 : 1;
+	if (!FitsInFile((uint64_t)width * height * m_channelCount * sizeof(float)))
+	{
+		return SetError("truncated PFM data");
+	}
+
+	m_format = HDR_IMAGE_PFM;
+	m_width = (uint32_t)width;
+	m_height = (uint32_t)height;
+	m_bigEndian = scale > 0;
+	m_dataOffset = Tell();
+	return true;
+}
+
+bool HdrImageReader::OpenRgbe()
+{
+	// Header lines up to an empty one, then the resolution line
+	char line[256];
+	bool header = true;
+	while (true)
+	{
+		size_t length = 0;
+		int c = ReadByte();
+		for (; c >= 0 && c != '\n'; c = ReadByte())
+		{
+			if (length + 1 < sizeof(line))
+			{
+				line[length++] = (char)c;
+			}
+		}
+		line[length] = 0;
+		if (c < 0)
+		{
+			return SetError("invalid Radiance header");
+		}
+
+		if (!header)
+		{
+			break;
+		}
+		if (length == 0)
+		{
+			header = false;
+		}
+		else if (strncmp(line, "FORMAT=", 7) == 0 && strcmp(line + 7, "32-bit_rle_rgbe") != 0)
+		{
+			return SetError("unsupported Radiance pixel format");
+		}
+	}
+
+	unsigned int width = 0;
+	unsigned int height = 0;
+	char extra = 0;
+#ifdef _MSC_VER
+	int fields = sscanf_s(line, "-Y %u +X %u %c", &height, &width, &extra, 1);
+#else
+	int fields = sscanf(line, "-Y %u +X %u %c", &height, &width, &extra);
+#endif
+	if (fields != 2)
+	{
+		return SetError("unsupported Radiance orientation, -Y +X is required");
+	}
+	if (width > 0xFFFFFF || height > 0xFFFFFF)
+	{
+		return SetError("invalid Radiance resolution");
+	}
+
+	// Flat rows take 4 bytes a pixel, encoded ones at least a 4 byte header
+	// and a 2 byte run for each 127 pixels of every component
+	uint64_t minRowSize = (uint64_t)width * 4;
+	if (width >= MinRgbeRunWidth && width <= MaxRgbeRunWidth)
+	{
+		minRowSize = std::min(minRowSize, 4 + 4 * 2 * (((uint64_t)width + 126) / 127));
+	}
+	if (!FitsInFile(minRowSize * height))
+	{
+		return SetError("truncated Radiance data");
+	}
+
+	m_format = HDR_IMAGE_RGBE;
+	m_width = width;
+	m_height = height;
+	m_dataOffset = Tell();
+	m_line.resize((size_t)m_width * 4);
+	return true;
+}
+
+bool HdrImageReader::OpenExr()
+{
+	uint8_t version[8];
+	if (!ReadBytes(version, sizeof(version)) || (GetU32(version + 4) & 0xFF) != ExrVersion)
+	{
+		return SetError("unsupported EXR version");
+	}
+	uint32_t flags = GetU32(version + 4);
+	if ((flags & (ExrTiledFlag | ExrDeepFlag | ExrMultipartFlag)) != 0)
+	{
+		return SetError("tiled, deep and multi part EXR files are not supported");
+	}
+
+	// Attributes are name, type, size and value, an empty name ends the header
+	bool hasDataWindow = false;
+	int32_t window[4] = {};
+	while (true)
+	{
+		char name[256];
+		char type[256];
+		char* strings[2] = { name, type };
+		for (int s = 0; s < 2; s++)
+		{
+			size_t length = 0;
+			int c = ReadByte();
+			for (; c > 0 && length + 1 < sizeof(name); c = ReadByte())
+			{
+				strings[s][length++] = (char)c;
+			}
+			strings[s][length] = 0;
+			if (c != 0)
+			{
+				return SetError("invalid EXR header");
+			}
+			if (s == 0 && length == 0)
+			{
+				break;
+			}
+		}
+		if (name[0] == 0)
+		{
+			break;
+		}
+
+		uint8_t sizeBytes[4];
+		if (!ReadBytes(sizeBytes, sizeof(sizeBytes)))
+		{
+			return SetError("invalid EXR header");
+		}
+		uint32_t size = GetU32(sizeBytes);
+		if (size > (1u << 24))
+		{
+			return SetError("invalid EXR header");
+		}
+		std::vector<uint8_t> value(size);
+		if (!ReadBytes(value.data(), size))
+		{
+			return SetError("invalid EXR header");
+		}
+
+		if (strcmp(name, "channels") == 0 && strcmp(type, "chlist") == 0)
+		{
+			// Name, pixel type, pLinear, 3 reserved bytes, x and y sampling
+			size_t pos = 0;
+			while (pos < size && value[pos] != 0)
+			{
+				const char* pName = reinterpret_cast<const char*>(&value[pos]);
+				size_t nameLength = strnlen(pName, size - pos);
+				pos += nameLength + 1;
+				if (pos + 16 > size)
+				{
+					return SetError("invalid EXR channel list");
+				}
+				ExrChannel channel;
+				channel.type = GetU32(&value[pos]);
+				if (channel.type > EXR_PIXEL_FLOAT)
+				{
+					return SetError("invalid EXR pixel type");
+				}
+				if (GetU32(&value[pos + 8]) != 1 || GetU32(&value[pos + 12]) != 1)
+				{
+					return SetError("subsampled EXR channels are not supported");
+				}
+				channel.offset = 0;
+				channel.target = -1;
+				if (nameLength == 1)
+				{
+					const char* targets = "RGBY";
+					const char* pTarget = strchr(targets, pName[0]);
+					channel.target = pTarget != nullptr ? (int32_t)(pTarget - targets) : -1;
+				}
+				m_channels.push_back(channel);
+				pos += 16;
+			}
+		}
+		else if (strcmp(name, "compression") == 0)
+		{
+			if (size != 1 || value[0] != 0)
+			{
+				return SetError("compressed EXR files are not supported");
+			}
+		}
+		else if (strcmp(name, "dataWindow") == 0 && size == 16)
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				window[i] = (int32_t)GetU32(&value[i * 4]);
+			}
+			hasDataWindow = true;
+		}
+	}
+
+	if (!hasDataWindow || m_channels.empty() || window[2] < window[0] || window[3] < window[1]
+		|| (int64_t)window[2] - window[0] >= 0xFFFFFF || (int64_t)window[3] - window[1] >= 0xFFFFFF)
+	{
+		return SetError("invalid EXR header");
+	}
+	m_width = (uint32_t)(window[2] - window[0] + 1);
+	m_height = (uint32_t)(window[3] - window[1] + 1);
+
+	// Channels are stored one after the other in each line
+	uint64_t lineSize = 0;
+	bool hasLuminance = false;
+	m_hasColor = false;
+	for (ExrChannel& channel : m_channels)
+	{
+		channel.offset = (uint32_t)lineSize;
+		lineSize += (uint64_t)m_width * (channel.type == EXR_PIXEL_HALF ? 2 : 4);
+		m_hasColor |= channel.target >= 0 && channel.target < 3;
+		hasLuminance |= channel.target == 3;
+		if (lineSize > 0xFFFFFFFF)
+		{
+			return SetError("invalid EXR header");
+		}
+	}
+	m_lineSize = (uint32_t)lineSize;
+	if (!m_hasColor && !hasLuminance)
+	{
+		return SetError("EXR file has no R, G, B or Y channel");
+	}
+
+	// An offset, then the y coordinate and size ahead of each line
+	if (!FitsInFile(((uint64_t)m_lineSize + 16) * m_height))
+	{
+		return SetError("truncated EXR data");
+	}
+
+	// Without compression each chunk is one line
+	m_lineOffsets.resize(m_height);
+	for (uint32_t y = 0; y < m_height; y++)
+	{
+		uint8_t offset[8];
+		if (!ReadBytes(offset, sizeof(offset)))
+		{
+			return SetError("truncated EXR line offsets");
+		}
+		m_lineOffsets[y] = GetU32(offset) | (uint64_t)GetU32(offset + 4) << 32;
+	}
+
+	m_format = HDR_IMAGE_EXR;
+	m_line.resize((size_t)m_lineSize + 8);
+	return true;
+}
+
+bool HdrImageReader::ReadRows(uint32_t rowCount, float* pRgb)
+{
+	if (m_pFile == NULL)
+	{
+		return SetError("no file is open");
+	}
+	if (rowCount > m_height - m_row)
+	{
+		return SetError("reading past the last row");
+	}
+
+	if (m_format == HDR_IMAGE_PFM)
+	{
+		if (!ReadPfmRows(rowCount, pRgb))
+		{
+			return false;
+		}
+		m_row += rowCount;
+		return true;
+	}
+
+	for (uint32_t y = 0; y < rowCount; y++)
+	{
+		float* pRow = pRgb + (size_t)y * m_width * 3;
+		if (!(m_format == HDR_IMAGE_RGBE ? ReadRgbeRow(pRow) : ReadExrRow(pRow)))
+		{
+			return false;
+		}
+		m_row++;
+	}
+	return true;
+}
+
+bool HdrImageReader::ReadPfmRows(uint32_t rowCount, float* pRgb)
+{
+	// The rows are stored bottom to top, the chunk is one block in reverse order
+	size_t rowValues = (size_t)m_width * m_channelCount;
+	uint64_t firstRow = m_height - m_row - rowCount;
+	if (!Seek(m_dataOffset + firstRow * rowValues * sizeof(float)))
+	{
+		return SetError("seek failed");
+	}
+
+	float* pValues = pRgb;
+	std::vector<float> gray;
+	if (m_channelCount == 1)
+	{
+		gray.resize(rowValues * rowCount);
+		pValues = gray.data();
+	}
+	if (!ReadBytes(pValues, rowValues * rowCount * sizeof(float)))
+	{
+		return SetError("truncated PFM data");
+	}
+	if (m_bigEndian)
+	{
+		SwapBytes(pValues, rowValues * rowCount);
+	}
+
+	for (uint32_t y = 0; y < rowCount / 2; y++)
+	{
+		std::swap_ranges(pValues + y * rowValues, pValues + (y + 1) * rowValues, pValues + (rowCount - 1 - y) * rowValues);
+	}
+	if (m_channelCount == 1)
+	{
+		for (size_t i = 0; i < gray.size(); i++)
+		{
+			pRgb[i * 3] = pRgb[i * 3 + 1] = pRgb[i * 3 + 2] = gray[i];
+		}
+	}
+	return true;
+}
+
+bool HdrImageReader::ReadRgbeRow(float* pRgb)
+{
+	uint8_t* pLine = m_line.data();
+	if (!ReadBytes(pLine, 4))
+	{
+		return SetError("truncated Radiance data");
+	}
+
+	bool encoded = m_width >= MinRgbeRunWidth && m_width <= MaxRgbeRunWidth
+		&& pLine[0] == 2 && pLine[1] == 2 && (pLine[2] & 0x80) == 0;
+	if (!encoded)
+	{
+		if (pLine[0] == 1 && pLine[1] == 1 && pLine[2] == 1)
+		{
+			return SetError("old style Radiance run length encoding is not supported");
+		}
+		if (!ReadBytes(pLine + 4, ((size_t)m_width - 1) * 4))
+		{
+			return SetError("truncated Radiance data");
+		}
+		for (uint32_t x = 0; x < m_width; x++)
+		{
+			RgbeToFloat(pLine + x * 4, pRgb + x * 3);
+		}
+		return true;
+	}
+
+	if (((uint32_t)pLine[2] << 8 | pLine[3]) != m_width)
+	{
+		return SetError("Radiance scanline width mismatch");
+	}
+
+	// Components are encoded one after the other, each as runs and literals
+	for (uint32_t j = 0; j < 4; j++)
+	{
+		uint32_t x = 0;
+		while (x < m_width)
+		{
+			int count = ReadByte();
+			if (count <= 0)
+			{
+				return SetError("invalid Radiance run");
+			}
+			if (count > 128)
+			{
+				count -= 128;
+				int value = ReadByte();
+				if (value < 0 || (uint32_t)count > m_width - x)
+				{
+					return SetError("invalid Radiance run");
+				}
+				for (; count > 0; count--, x++)
+				{
+					pLine[x * 4 + j] = (uint8_t)value;
+				}
+			}
+			else
+			{
+				uint8_t literals[128];
+				if ((uint32_t)count > m_width - x)
+				{
+					return SetError("invalid Radiance run");
+				}
+				if (!ReadBytes(literals, count))
+				{
+					return SetError("truncated Radiance data");
+				}
+				for (int i = 0; i < count; i++, x++)
+				{
+					pLine[x * 4 + j] = literals[i];
+				}
+			}
+		}
+	}
+
+	for (uint32_t x = 0; x < m_width; x++)
+	{
+		RgbeToFloat(pLine + x * 4, pRgb + x * 3);
+	}
+	return true;
+}
+
+bool HdrImageReader::ReadExrRow(float* pRgb)
+{
+	// Line number and size precede the data
+	uint8_t* pLine = m_line.data();
+	if (!Seek(m_lineOffsets[m_row]) || !ReadBytes(pLine, (size_t)m_lineSize + 8))
+	{
+		return SetError("truncated EXR data");
+	}
+	if (GetU32(pLine + 4) != m_lineSize)
+	{
+		return SetError("unexpected EXR line size");
+	}
+	pLine += 8;
+
+	if (m_hasColor)
+	{
+		memset(pRgb, 0, (size_t)m_width * 3 * sizeof(float));
+	}
+	for (const ExrChannel& channel : m_channels)
+	{
+		if (channel.target < 0 || (channel.target == 3 && m_hasColor))
+		{
+			continue;
+		}
+
+		const uint8_t* pData = pLine + channel.offset;
+		uint32_t first = channel.target == 3 ? 0 : channel.target;
+		uint32_t last = channel.target == 3 ? 2 : channel.target;
+		for (uint32_t x = 0; x < m_width; x++)
+		{
+			float value;
+			if (channel.type == EXR_PIXEL_HALF)
+			{
+				uint16_t half;
+				memcpy(&half, pData + x * 2, sizeof(half));
+				value = VertexCompression::HalfToFloat(half);
+			}
+			else if (channel.type == EXR_PIXEL_FLOAT)
+			{
+				memcpy(&value, pData + x * 4, sizeof(value));
+			}
+			else
+			{
+				value = (float)GetU32(pData + x * 4);
+			}
+			for (uint32_t j = first; j <= last; j++)
+			{
+				pRgb[x * 3 + j] = value;
+			}
+		}
+	}
+	return true;
+}
+
+bool HdrImageReader::Rewind()
+{
+	if (m_pFile == NULL)
+	{
+		return SetError("no file is open");
+	}
+	m_row = 0;
+	if (m_format == HDR_IMAGE_RGBE && !Seek(m_dataOffset))
+	{
+		return SetError("seek failed");
+	}
+	return true;
+}
+
+int HdrImageReader::ReadByte()
+{
+	if (m_bufferPos == m_bufferSize)
+	{
+		m_bufferOffset += m_bufferSize;
+		m_bufferPos = 0;
+		m_bufferSize = fread(m_buffer.data(), 1, m_buffer.size(), m_pFile);
+		if (m_bufferSize == 0)
+		{
+			return -1;
+		}
+	}
+	return m_buffer[m_bufferPos++];
+}
+
+bool HdrImageReader::ReadBytes(void* pData, size_t size)
+{
+	uint8_t* pOut = static_cast<uint8_t*>(pData);
+	size_t buffered = std::min(size, m_bufferSize - m_bufferPos);
+	if (buffered > 0)
+	{
+		memcpy(pOut, m_buffer.data() + m_bufferPos, buffered);
+		m_bufferPos += buffered;
+		pOut += buffered;
+		size -= buffered;
+		if (size == 0)
+		{
+			return true;
+		}
+	}
+
+	// Large reads bypass the buffer
+	m_bufferOffset += m_bufferSize;
+	m_bufferPos = 0;
+	m_bufferSize = 0;
+	if (size >= m_buffer.size())
+	{
+		size_t read = fread(pOut, 1, size, m_pFile);
+		m_bufferOffset += read;
+		return read == size;
+	}
+
+	m_bufferSize = fread(m_buffer.data(), 1, m_buffer.size(), m_pFile);
+	if (m_bufferSize < size)
+	{
+		return false;
+	}
+	memcpy(pOut, m_buffer.data(), size);
+	m_bufferPos = size;
+	return true;
+}
+
+bool HdrImageReader::Seek(uint64_t offset)
+{
+	// Within the buffer no file access is needed
+	if (offset >= m_bufferOffset && offset <= m_bufferOffset + m_bufferSize)
+	{
+		m_bufferPos = (size_t)(offset - m_bufferOffset);
+		return true;
+	}
+	m_bufferOffset = offset;
+	m_bufferPos = 0;
+	m_bufferSize = 0;
+	return SeekFile(m_pFile, offset);
+}
+
+bool HdrImageReader::FitsInFile(uint64_t size) const
+{
+	uint64_t offset = Tell();
+	return offset <= m_fileSize && size <= m_fileSize - offset;
+}
+
+uint64_t HdrImageReader::Tell() const
+{
+	return m_bufferOffset + m_bufferPos;
+}
+
+HdrImageFormat HdrImageReader::GetFormat() const
+{
+	return m_format;
+}
+
+uint32_t HdrImageReader::GetWidth() const
+{
+	return m_width;
+}
+
+uint32_t HdrImageReader::GetHeight() const
+{
+	return m_height;
+}
+
+uint32_t HdrImageReader::GetRow() const
+{
+	return m_row;
+}
+
+const char* HdrImageReader::GetErrorMessage() const
+{
+	return m_error;
+}
+
+bool HdrImageReader::SetError(const char* message)
+{
+	snprintf(m_error, sizeof(m_error), "%s", message);
+	return false;
+}
+
+//
+// HdrImageWriter
+//
+
+HdrImageWriter::HdrImageWriter()
+	: m_pFile(NULL)
+	, m_format(HDR_IMAGE_UNKNOWN)
+	, m_width(0)
+	, m_height(0)
+	, m_row(0)
+	, m_dataOffset(0)
+	, m_failed(false)
+{
+	m_error[0] = 0;
+}
+
+HdrImageWriter::~HdrImageWriter()
+{
+	if (m_pFile != NULL)
+	{
+		fclose(m_pFile);
+	}
+}
+
+bool HdrImageWriter::Open(const char* path, uint32_t width, uint32_t height)
+{
+	if (m_pFile != NULL)
+	{
+		fclose(m_pFile);
+		m_pFile = NULL;
+	}
+	m_error[0] = 0;
+	m_failed = false;
+	m_row = 0;
+
+	if (HasExtension(path, "pfm"))
+	{
+		m_format = HDR_IMAGE_PFM;
+	}
+	else if (HasExtension(path, "hdr"))
+	{
+		m_format = HDR_IMAGE_RGBE;
+	}
+	else if (HasExtension(path, "exr"))
+	{
+		m_format = HDR_IMAGE_EXR;
+	}
+	else
+	{
+		return SetError("unknown file extension");
+	}
+	if (width == 0 || height == 0 || width > 0xFFFFFF || height > 0xFFFFFF)
+	{
+		return SetError("invalid image size");
+	}
+
+	m_pFile = OpenFile(path, "wb");
+	if (m_pFile == NULL)
+	{
+		return SetError("can not create the file");
+	}
+	m_width = width;
+	m_height = height;
+
+	std::vector<uint8_t>& header = m_bytes;
+	header.clear();
+	if (m_format == HDR_IMAGE_PFM)
+	{
+		// A negative scale marks little endian data
+		char text[64];
+		snprintf(text, sizeof(text), "PF\n%u %u\n-1.0\n", width, height);
+		header.insert(header.end(), text, text + strlen(text));
+	}
+	else if (m_format == HDR_IMAGE_RGBE)
+	{
+		char text[128];
+		snprintf(text, sizeof(text), "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %u +X %u\n", height, width);
+		header.insert(header.end(), text, text + strlen(text));
+		m_scanline.resize((size_t)width * 5);
+	}
+	else
+	{
+		AppendU32(header, ExrMagic);
+		AppendU32(header, ExrVersion);
+
+		// Channels in alphabetical order, as the data
+		AppendExrAttribute(header, "channels", "chlist", 3 * 18 + 1);
+		for (const char* name : { "B", "G", "R" })
+		{
+			AppendString(header, name);
+			AppendU32(header, EXR_PIXEL_FLOAT);
+			AppendU32(header, 0); // pLinear and reserved
+			AppendU32(header, 1);
+			AppendU32(header, 1);
+		}
+		header.push_back(0);
+
+		AppendExrAttribute(header, "compression", "compression", 1);
+		header.push_back(0);
+		for (const char* name : { "dataWindow", "displayWindow" })
+		{
+			AppendExrAttribute(header, name, "box2i", 16);
+			AppendU32(header, 0);
+			AppendU32(header, 0);
+			AppendU32(header, width - 1);
+			AppendU32(header, height - 1);
+		}
+		AppendExrAttribute(header, "lineOrder", "lineOrder", 1);
+		header.push_back(0); // increasing y
+		AppendExrAttribute(header, "pixelAspectRatio", "float", 4);
+		AppendFloat(header, 1.0f);
+		AppendExrAttribute(header, "screenWindowCenter", "v2f", 8);
+		AppendFloat(header, 0.0f);
+		AppendFloat(header, 0.0f);
+		AppendExrAttribute(header, "screenWindowWidth", "float", 4);
+		AppendFloat(header, 1.0f);
+		header.push_back(0);
+
+		// Lines have a fixed size, so the offset table is known up front
+		uint64_t lineSize = 8 + (uint64_t)width * 3 * sizeof(float);
+		uint64_t firstLine = header.size() + (uint64_t)height * 8;
+		for (uint32_t y = 0; y < height; y++)
+		{
+			AppendU64(header, firstLine + y * lineSize);
+		}
+	}
+
+	m_dataOffset = header.size();
+	if (fwrite(header.data(), 1, header.size(), m_pFile) != header.size())
+	{
+		m_failed = true;
+		return SetError("write failed");
+	}
+	return true;
+}
+
+bool HdrImageWriter::WriteRows(uint32_t rowCount, const float* pRgb)
+{
+	if (m_pFile == NULL || m_failed)
+	{
+		return SetError("no file is open");
+	}
+	if (rowCount > m_height - m_row)
+	{
+		return SetError("writing past the last row");
+	}
+
+	size_t rowValues = (size_t)m_width * 3;
+	m_bytes.clear();
+	if (m_format == HDR_IMAGE_PFM)
+	{
+		// Rows go bottom to top, the chunk is one block in reverse order
+		m_bytes.resize(rowValues * rowCount * sizeof(float));
+		for (uint32_t y = 0; y < rowCount; y++)
+		{
+			memcpy(&m_bytes[(size_t)(rowCount - 1 - y) * rowValues * sizeof(float)], pRgb + y * rowValues, rowValues * sizeof(float));
+		}
+		uint64_t firstRow = m_height - m_row - rowCount;
+		if (!SeekFile(m_pFile, m_dataOffset + firstRow * rowValues * sizeof(float)))
+		{
+			m_failed = true;
+			return SetError("seek failed");
+		}
+	}
+	else
+	{
+		for (uint32_t y = 0; y < rowCount; y++)
+		{
+			if (m_format == HDR_IMAGE_RGBE)
+			{
+				EncodeRgbeRow(pRgb + y * rowValues);
+			}
+			else
+			{
+				EncodeExrRow(m_row + y, pRgb + y * rowValues);
+			}
+		}
+	}
+
+	if (fwrite(m_bytes.data(), 1, m_bytes.size(), m_pFile) != m_bytes.size())
+	{
+		m_failed = true;
+		return SetError("write failed");
+	}
+	m_row += rowCount;
+	return true;
+}
+
+void HdrImageWriter::EncodeRgbeRow(const float* pRgb)
+{
+	uint8_t* pLine = m_scanline.data();
+	for (uint32_t x = 0; x < m_width; x++)
+	{
+		FloatToRgbe(pRgb + x * 3, pLine + x * 4);
+	}
+
+	if (m_width < MinRgbeRunWidth || m_width > MaxRgbeRunWidth)
+	{
+		m_bytes.insert(m_bytes.end(), pLine, pLine + (size_t)m_width * 4);
+		return;
+	}
+
+	m_bytes.push_back(2);
+	m_bytes.push_back(2);
+	m_bytes.push_back((uint8_t)(m_width >> 8));
+	m_bytes.push_back((uint8_t)m_width);
+
+	// Components one after the other
+	uint8_t* pComponent = pLine + (size_t)m_width * 4;
+	for (uint32_t j = 0; j < 4; j++)
+	{
+		for (uint32_t x = 0; x < m_width; x++)
+		{
+			pComponent[x] = pLine[x * 4 + j];
+		}
+		EncodeRgbeRuns(pComponent, m_width, m_bytes);
+	}
+}
+
+void HdrImageWriter::EncodeExrRow(uint32_t y, const float* pRgb)
+{
+	AppendU32(m_bytes, y);
+	AppendU32(m_bytes, m_width * 3 * sizeof(float));
+
+	// B, G, R planes
+	size_t start = m_bytes.size();
+	m_bytes.resize(start + (size_t)m_width * 3 * sizeof(float));
+	float* pOut = reinterpret_cast<float*>(&m_bytes[start]);
+	for (int plane = 0; plane < 3; plane++)
+	{
+		for (uint32_t x = 0; x < m_width; x++)
+		{
+			pOut[plane * m_width + x] = pRgb[x * 3 + 2 - plane];
+		}
+	}
+}
+
+bool HdrImageWriter::Close()
+{
+	if (m_pFile == NULL)
+	{
+		return SetError("no file is open");
+	}
+	bool complete = !m_failed && m_row == m_height;
+	bool closed = fclose(m_pFile) == 0;
+	m_pFile = NULL;
+	std::vector<uint8_t>().swap(m_bytes);
+	std::vector<uint8_t>().swap(m_scanline);
+
+	if (m_failed)
+	{
+		return false;
+	}
+	if (!complete)
+	{
+		return SetError("rows are missing");
+	}
+	if (!closed)
+	{
+		return SetError("write failed");
+	}
+	return true;
+}
+
+HdrImageFormat HdrImageWriter::GetFormat() const
+{
+	return m_format;
+}
+
+const char* HdrImageWriter::GetErrorMessage() const
+{
+	return m_error;
+}
+
+bool HdrImageWriter::SetError(const char* message)
+{
+	snprintf(m_error, sizeof(m_error), "%s", message);
+	return false;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+enum HdrImageFormat
+{
+	HDR_IMAGE_UNKNOWN = 0,
+	HDR_IMAGE_PFM, // Portable float map, RGB or grayscale
+	HDR_IMAGE_RGBE, // Radiance .hdr, flat or run length encoded scanlines
+	HDR_IMAGE_EXR, // OpenEXR scanlines without compression
+};
+
+// Streaming reader of floating point images. Rows are returned top to bottom
+// as interleaved RGB floats, in chunks of the caller's size, so only the
+// chunk and one scanline of the file are held in memory. The format is
+// detected from the file contents.
+//
+// PFM rows are stored bottom to top and read with seeks. Radiance files have
+// to be oriented -Y +X, the common layout; old style run length encoding is
+// not supported. EXR channels R, G and B of type UINT, HALF or FLOAT are read,
+// a luminance only Y channel is replicated and missing color channels are 0.
+// Tiled, deep, multi part and compressed EXR files are rejected.
+class HdrImageReader
+{
+public:
+	HdrImageReader();
+	~HdrImageReader();
+
+	bool Open(const char* path);
+	void Close();
+
+	// Reads the next rowCount rows into width * rowCount * 3 floats
+	bool ReadRows(uint32_t rowCount, float* pRgb);
+
+	// Starts over at the top row
+	bool Rewind();
+
+	HdrImageFormat GetFormat() const;
+	uint32_t GetWidth() const;
+	uint32_t GetHeight() const;
+
+	// Rows read since Open() or Rewind()
+	uint32_t GetRow() const;
+
+	// Reason of the last failure
+	const char* GetErrorMessage() const;
+
+private:
+	struct ExrChannel
+	{
+		uint32_t type; // 0 UINT, 1 HALF, 2 FLOAT
+		uint32_t offset; // in bytes from the start of the line data
+		int32_t target; // 0 red, 1 green, 2 blue, 3 luminance, -1 ignored
+	};
+
+	HdrImageReader(const HdrImageReader&);
+	HdrImageReader& operator=(const HdrImageReader&);
+
+	bool OpenPfm();
+	bool OpenRgbe();
+	bool OpenExr();
+	bool ReadPfmRows(uint32_t rowCount, float* pRgb);
+	bool ReadRgbeRow(float* pRgb);
+	bool ReadExrRow(float* pRgb);
+
+	// Buffered input, ReadByte() returns -1 at the end of the file
+	int ReadByte();
+	bool ReadBytes(void* pData, size_t size);
+	bool Seek(uint64_t offset);
+	uint64_t Tell() const;
+
+	// Whether size bytes are left after the current position, checked
+	// before a header is trusted to allocate or read that much
+	bool FitsInFile(uint64_t size) const;
+
+	bool SetError(const char* message);
+
+private:
+	FILE* m_pFile;
+	HdrImageFormat m_format;
+	uint32_t m_width;
+	uint32_t m_height;
+	uint32_t m_row;
+
+	std::vector<uint8_t> m_buffer;
+	uint64_t m_bufferOffset; // file offset of m_buffer[0]
+	size_t m_bufferPos;
+	size_t m_bufferSize;
+	uint64_t m_fileSize;
+
+	uint64_t m_dataOffset; // first pixel byte of PFM and Radiance files
+	uint32_t m_channelCount; // 3 for PF, 1 for Pf
+	bool m_bigEndian;
+
+	std::vector<uint64_t> m_lineOffsets;
+	std::vector<ExrChannel> m_channels;
+	uint32_t m_lineSize;
+	bool m_hasColor;
+
+	std::vector<uint8_t> m_line; // one scanline of the file
+	char m_error[256];
+};
+
+// Streaming writer of floating point images, the counterpart of
+// HdrImageReader. Rows are passed top to bottom as interleaved RGB floats in
+// chunks of the caller's size. The format is chosen by the extension: .pfm
+// writes little endian RGB, .hdr run length encoded RGBE and .exr
+// uncompressed FLOAT channels in increasing line order. Radiance files can not
+// store negative values, they are written as 0.
+class HdrImageWriter
+{
+public:
+	HdrImageWriter();
+	~HdrImageWriter();
+
+	bool Open(const char* path, uint32_t width, uint32_t height);
+
+	// Writes the next rowCount rows from width * rowCount * 3 floats
+	bool WriteRows(uint32_t rowCount, const float* pRgb);
+
+	// Fails if rows are missing or the file could not be written
+	bool Close();
+
+	HdrImageFormat GetFormat() const;
+
+	// Reason of the last failure
+	const char* GetErrorMessage() const;
+
+private:
+	HdrImageWriter(const HdrImageWriter&);
+	HdrImageWriter& operator=(const HdrImageWriter&);
+
+	void EncodeRgbeRow(const float* pRgb);
+	void EncodeExrRow(uint32_t y, const float* pRgb);
+
+	bool SetError(const char* message);
+
+private:
+	FILE* m_pFile;
+	HdrImageFormat m_format;
+	uint32_t m_width;
+	uint32_t m_height;
+	uint32_t m_row;
+	uint64_t m_dataOffset;
+	bool m_failed;
+
+	std::vector<uint8_t> m_bytes; // encoded rows of a chunk
+	std::vector<uint8_t> m_scanline; // RGBE of one row and one of its components
+	char m_error[256];
+};
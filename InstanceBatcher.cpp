@@ -0,0 +1,145 @@
+#include "InstanceBatcher.h"
+
+#include <assert.h>
+#include <string.h>
+#include <xmmintrin.h>
+#include <thread>
+
+// Below this a single thread is faster than starting workers
+static const uint32_t MinInstancesPerWorker = 16384;
+
+InstanceBatcher::InstanceBatcher()
+	: m_meshCount(0)
+	, m_workerCount(1)
+{
+}
+
+void InstanceBatcher::Init(uint32_t meshCount, uint32_t workerCount)
+{
+	m_meshCount = meshCount;
+	m_workerCount = workerCount != 0 ? workerCount : std::thread::hardware_concurrency();
+	if (m_workerCount == 0)
+	{
+		m_workerCount = 1;
+	}
+
+	m_meshCounts.assign(meshCount, 0);
+	Clear();
+}
+
+void InstanceBatcher::Clear()
+{
+	m_instances.clear();
+	m_batches.clear();
+	for (uint32_t& count : m_meshCounts)
+	{
+		count = 0;
+	}
+}
+
+uint32_t InstanceBatcher::Add(const float* world, uint32_t mesh, uint32_t material, const uint32_t* lights)
+{
+	assert(mesh < m_meshCount);
+
+	Instance instance;
+	memcpy(instance.world, world, sizeof(instance.world));
+	instance.mesh = mesh;
+	instance.material = material;
+	if (lights != nullptr)
+	{
+		memcpy(instance.lights, lights, sizeof(instance.lights));
+	}
+	else
+	{
+		memset(instance.lights, 0xFF, sizeof(instance.lights));
+	}
+	m_instances.push_back(instance);
+
+	m_meshCounts[mesh]++;
+
+	return (uint32_t)m_instances.size() - 1;
+}
+
+void InstanceBatcher::Build(InstanceData* pOut)
+{
+	// Counting sort by mesh, instances keep their insertion order inside a batch
+	m_batches.clear();
+	std::vector<uint32_t> offsets(m_meshCount);
+	uint32_t first = 0;
+	for (uint32_t mesh = 0; mesh < m_meshCount; mesh++)
+	{
+		offsets[mesh] = first;
+		if (m_meshCounts[mesh] > 0)
+		{
+			InstanceBatch batch = { mesh, first, m_meshCounts[mesh] };
+			m_batches.push_back(batch);
+		}
+		first += m_meshCounts[mesh];
+	}
+
+	uint32_t count = (uint32_t)m_instances.size();
+	m_destination.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		m_destination[i] = offsets[m_instances[i].mesh]++;
+	}
+
+	uint32_t workers = count / MinInstancesPerWorker;
+	if (workers > m_workerCount)
+	{
+		workers = m_workerCount;
+	}
+
+	if (workers <= 1)
+	{
+		WriteRange(pOut, 0, count);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	uint32_t chunk = (count + workers - 1) / workers;
+	for (uint32_t w = 1; w < workers; w++)
+	{
+		uint32_t begin = w * chunk;
+		uint32_t end = begin + chunk < count ? begin + chunk : count;
+		threads.push_back(std::thread(&InstanceBatcher::WriteRange, this, pOut, begin, end));
+	}
+	WriteRange(pOut, 0, chunk);
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+uint32_t InstanceBatcher::GetInstanceCount() const
+{
+	return (uint32_t)m_instances.size();
+}
+
+const std::vector<InstanceBatch>& InstanceBatcher::GetBatches() const
+{
+	return m_batches;
+}
+
+void InstanceBatcher::WriteRange(InstanceData* pOut, uint32_t first, uint32_t last) const
+{
+	for (uint32_t i = first; i < last; i++)
+	{
+		const Instance& instance = m_instances[i];
+		InstanceData& data = pOut[m_destination[i]];
+
+		__m128 row0 = _mm_loadu_ps(instance.world + 0);
+		__m128 row1 = _mm_loadu_ps(instance.world + 4);
+		__m128 row2 = _mm_loadu_ps(instance.world + 8);
+		__m128 row3 = _mm_loadu_ps(instance.world + 12);
+		_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+		// The fourth column of an affine transform is constant
+		_mm_storeu_ps(data.world[0], row0);
+		_mm_storeu_ps(data.world[1], row1);
+		_mm_storeu_ps(data.world[2], row2);
+		data.material = instance.material;
+		memcpy(data.lights, instance.lights, sizeof(data.lights));
+	}
+}
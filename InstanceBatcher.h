@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Lights assigned to an instance, unused slots are 0xFFFFFFFF
+static const uint32_t MaxInstanceLights = 4;
+
+// Per-instance vertex stream element: the first three columns of the
+// row-vector world matrix, so the shader computes world.x = dot(pos, world[0])
+struct InstanceData
+{
+	float world[3][4];
+	uint32_t material;
+	uint32_t lights[MaxInstanceLights];
+};
+
+// Instances of one mesh, drawn with a single DrawIndexedInstanced
+struct InstanceBatch
+{
+	uint32_t mesh;
+	uint32_t firstInstance;
+	uint32_t instanceCount;
+};
+
+// Collects instances and lays them out grouped by mesh. Transposing the
+// matrices into the stream is SSE and split over threads for large counts.
+class InstanceBatcher
+{
+public:
+	InstanceBatcher();
+
+	// workerCount 0 picks hardware concurrency
+	void Init(uint32_t meshCount, uint32_t workerCount = 0);
+
+	void Clear();
+
+	// world is a row-major 4x4 matrix in the DirectXMath row-vector convention,
+	// lights holds MaxInstanceLights entries or is null for none
+	uint32_t Add(const float* world, uint32_t mesh, uint32_t material, const uint32_t* lights = nullptr);
+
+	// Writes GetInstanceCount() elements to pOut and rebuilds the batch list
+	void Build(InstanceData* pOut);
+
+	uint32_t GetInstanceCount() const;
+	const std::vector<InstanceBatch>& GetBatches() const;
+
+private:
+	void WriteRange(InstanceData* pOut, uint32_t first, uint32_t last) const;
+
+private:
+	struct Instance
+	{
+		float world[16];
+		uint32_t mesh;
+		uint32_t material;
+		uint32_t lights[MaxInstanceLights];
+	};
+
+	uint32_t m_meshCount;
+	uint32_t m_workerCount;
+
+	std::vector<Instance> m_instances;
+	std::vector<uint32_t> m_destination;
+	std::vector<uint32_t> m_meshCounts;
+	std::vector<InstanceBatch> m_batches;
+};
@@ -0,0 +1,405 @@
+#include "LightClusterer.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <xmmintrin.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+// Below this many light slice pairs per worker a single thread is faster than starting workers
+static const uint32_t MinSliceLightsPerWorker = 1024;
+
+LightClusterer::LightClusterer()
+	: m_tileSize(64)
+	, m_sliceCount(1)
+	, m_workerCount(1)
+	, m_width(0)
+	, m_height(0)
+	, m_tanHalfX(0)
+	, m_tanHalfY(0)
+	, m_nearZ(0)
+	, m_farZ(0)
+	, m_tilesX(0)
+	, m_tilesY(0)
+	, m_sliceScale(0)
+	, m_sliceBias(0)
+	, m_pX(nullptr)
+	, m_pY(nullptr)
+	, m_pZ(nullptr)
+	, m_pRadius(nullptr)
+	, m_maxClusterLights(0)
+{
+}
+
+void LightClusterer::Init(uint32_t tileSize, uint32_t sliceCount, uint32_t workerCount)
+{
+	assert(tileSize > 0 && sliceCount > 0);
+
+	m_tileSize = tileSize;
+	m_sliceCount = sliceCount;
+	m_workerCount = workerCount != 0 ? workerCount : std::thread::hardware_concurrency();
+	if (m_workerCount == 0)
+	{
+		m_workerCount = 1;
+	}
+
+	// Forces the boxes to be rebuilt by the next SetProjection()
+	m_width = 0;
+	m_height = 0;
+	m_tilesX = 0;
+	m_tilesY = 0;
+	m_slices.clear();
+	m_ranges.clear();
+	m_indices.clear();
+	m_maxClusterLights = 0;
+}
+
+void LightClusterer::SetProjection(uint32_t width, uint32_t height, float tanHalfX, float tanHalfY, float nearZ, float farZ)
+{
+	assert(width > 0 && height > 0 && nearZ > 0 && farZ > nearZ);
+
+	if (width == m_width && height == m_height && tanHalfX == m_tanHalfX && tanHalfY == m_tanHalfY && nearZ == m_nearZ && farZ == m_farZ)
+	{
+		return;
+	}
+
+	m_width = width;
+	m_height = height;
+	m_tanHalfX = tanHalfX;
+	m_tanHalfY = tanHalfY;
+	m_nearZ = nearZ;
+	m_farZ = farZ;
+
+	m_tilesX = (width + m_tileSize - 1) / m_tileSize;
+	m_tilesY = (height + m_tileSize - 1) / m_tileSize;
+	m_sliceScale = m_sliceCount / logf(farZ / nearZ);
+	m_sliceBias = -logf(nearZ) * m_sliceScale;
+
+	// Tile edges as tangents, the last tile may be cut by the screen edge
+	m_tanX.resize(m_tilesX + 1);
+	for (uint32_t x = 0; x <= m_tilesX; x++)
+	{
+		float pixel = (float)std::min(x * m_tileSize, width);
+		m_tanX[x] = (pixel / width * 2.0f - 1.0f) * tanHalfX;
+	}
+	m_tanY.resize(m_tilesY + 1);
+	for (uint32_t y = 0; y <= m_tilesY; y++)
+	{
+		float pixel = (float)std::min(y * m_tileSize, height);
+		m_tanY[y] = (1.0f - pixel / height * 2.0f) * tanHalfY;
+	}
+
+	// Boxes around the frustum pieces, padding columns never intersect
+	uint32_t paddedX = (m_tilesX + 3) & ~3u;
+	m_slices.resize(m_sliceCount);
+	for (uint32_t s = 0; s < m_sliceCount; s++)
+	{
+		Slice& slice = m_slices[s];
+		slice.nearZ = nearZ * powf(farZ / nearZ, (float)s / m_sliceCount);
+		slice.farZ = s + 1 < m_sliceCount ? nearZ * powf(farZ / nearZ, (float)(s + 1) / m_sliceCount) : farZ;
+
+		slice.minX.assign(paddedX, FLT_MAX);
+		slice.maxX.assign(paddedX, FLT_MAX);
+		for (uint32_t x = 0; x < m_tilesX; x++)
+		{
+			slice.minX[x] = std::min(m_tanX[x] * slice.nearZ, m_tanX[x] * slice.farZ);
+			slice.maxX[x] = std::max(m_tanX[x + 1] * slice.nearZ, m_tanX[x + 1] * slice.farZ);
+		}
+
+		slice.minY.resize(m_tilesY);
+		slice.maxY.resize(m_tilesY);
+		for (uint32_t y = 0; y < m_tilesY; y++)
+		{
+			slice.minY[y] = std::min(m_tanY[y + 1] * slice.nearZ, m_tanY[y + 1] * slice.farZ);
+			slice.maxY[y] = std::max(m_tanY[y] * slice.nearZ, m_tanY[y] * slice.farZ);
+		}
+	}
+
+	m_ranges.assign(GetClusterCount(), Range());
+	m_indices.clear();
+	m_maxClusterLights = 0;
+}
+
+void LightClusterer::Bin(const float* x, const float* y, const float* z, const float* radius, uint32_t count)
+{
+	assert(!m_slices.empty());
+
+	m_pX = x;
+	m_pY = y;
+	m_pZ = z;
+	m_pRadius = radius;
+
+	// Counting sort of the lights into the slices their depth range covers,
+	// lights keep increasing order inside a slice
+	std::vector<uint32_t> firstSlice(count);
+	std::vector<uint32_t> lastSlice(count);
+	m_sliceLightOffsets.assign(m_sliceCount + 1, 0);
+	for (uint32_t light = 0; light < count; light++)
+	{
+		float nearest = z[light] - radius[light];
+		float farthest = z[light] + radius[light];
+		if (radius[light] <= 0 || farthest < m_nearZ || nearest > m_farZ)
+		{
+			firstSlice[light] = 1;
+			lastSlice[light] = 0;
+			continue;
+		}
+
+		nearest = std::max(nearest, m_nearZ);
+		farthest = std::min(farthest, m_farZ);
+		uint32_t first = GetSlice(nearest);
+		uint32_t last = GetSlice(farthest);
+		if (first > 0 && m_slices[first].nearZ > nearest)
+		{
+			first--;
+		}
+		if (last + 1 < m_sliceCount && m_slices[last].farZ < farthest)
+		{
+			last++;
+		}
+
+		firstSlice[light] = first;
+		lastSlice[light] = last;
+		for (uint32_t slice = first; slice <= last; slice++)
+		{
+			m_sliceLightOffsets[slice + 1]++;
+		}
+	}
+
+	for (uint32_t slice = 0; slice < m_sliceCount; slice++)
+	{
+		m_sliceLightOffsets[slice + 1] += m_sliceLightOffsets[slice];
+	}
+	m_sliceLights.resize(m_sliceLightOffsets[m_sliceCount]);
+
+	std::vector<uint32_t> cursors(m_sliceLightOffsets.begin(), m_sliceLightOffsets.end() - 1);
+	for (uint32_t light = 0; light < count; light++)
+	{
+		for (uint32_t slice = firstSlice[light]; slice <= lastSlice[light]; slice++)
+		{
+			m_sliceLights[cursors[slice]++] = light;
+		}
+	}
+
+	// Slices are independent tasks taken in order by the workers
+	uint32_t workers = std::min(m_workerCount, 1 + (uint32_t)m_sliceLights.size() / MinSliceLightsPerWorker);
+	workers = std::min(workers, m_sliceCount);
+
+	std::atomic<uint32_t> nextSlice(0);
+	auto work = [this, &nextSlice]()
+	{
+		for (uint32_t slice = nextSlice++; slice < m_sliceCount; slice = nextSlice++)
+		{
+			BinSlice(slice);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (uint32_t w = 1; w < workers; w++)
+	{
+		threads.push_back(std::thread(work));
+	}
+	work();
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	// Slice lists are concatenated, their ranges were relative to the slice
+	uint32_t total = 0;
+	for (const Slice& slice : m_slices)
+	{
+		total += (uint32_t)slice.indices.size();
+	}
+	m_indices.resize(total);
+
+	uint32_t clustersPerSlice = m_tilesX * m_tilesY;
+	uint32_t first = 0;
+	m_maxClusterLights = 0;
+	for (uint32_t slice = 0; slice < m_sliceCount; slice++)
+	{
+		Range* pRanges = &m_ranges[slice * clustersPerSlice];
+		for (uint32_t cluster = 0; cluster < clustersPerSlice; cluster++)
+		{
+			pRanges[cluster].offset += first;
+			m_maxClusterLights = std::max(m_maxClusterLights, pRanges[cluster].count);
+		}
+
+		const std::vector<uint32_t>& indices = m_slices[slice].indices;
+		if (!indices.empty())
+		{
+			memcpy(m_indices.data() + first, indices.data(), indices.size() * sizeof(uint32_t));
+		}
+		first += (uint32_t)indices.size();
+	}
+}
+
+uint32_t LightClusterer::GetTileSize() const
+{
+	return m_tileSize;
+}
+
+uint32_t LightClusterer::GetTilesX() const
+{
+	return m_tilesX;
+}
+
+uint32_t LightClusterer::GetTilesY() const
+{
+	return m_tilesY;
+}
+
+uint32_t LightClusterer::GetSliceCount() const
+{
+	return m_sliceCount;
+}
+
+uint32_t LightClusterer::GetClusterCount() const
+{
+	return m_tilesX * m_tilesY * m_sliceCount;
+}
+
+float LightClusterer::GetSliceScale() const
+{
+	return m_sliceScale;
+}
+
+float LightClusterer::GetSliceBias() const
+{
+	return m_sliceBias;
+}
+
+const std::vector<LightClusterer::Range>& LightClusterer::GetRanges() const
+{
+	return m_ranges;
+}
+
+const std::vector<uint32_t>& LightClusterer::GetIndices() const
+{
+	return m_indices;
+}
+
+uint32_t LightClusterer::GetMaxClusterLights() const
+{
+	return m_maxClusterLights;
+}
+
+uint32_t LightClusterer::GetSlice(float z) const
+{
+	float slice = floorf(logf(z) * m_sliceScale + m_sliceBias);
+	return (uint32_t)std::min(std::max(slice, 0.0f), (float)(m_sliceCount - 1));
+}
+
+void LightClusterer::BinSlice(uint32_t s)
+{
+	Slice& slice = m_slices[s];
+	slice.hitTiles.clear();
+	slice.hitLights.clear();
+
+	float tilesPerTanX = 0.5f / m_tanHalfX * m_width / m_tileSize;
+	float tilesPerTanY = 0.5f / m_tanHalfY * m_height / m_tileSize;
+	float maxTileX = (float)(m_tilesX - 1);
+	float maxTileY = (float)(m_tilesY - 1);
+
+	const __m128 zero = _mm_setzero_ps();
+	for (uint32_t i = m_sliceLightOffsets[s]; i < m_sliceLightOffsets[s + 1]; i++)
+	{
+		uint32_t light = m_sliceLights[i];
+		float x = m_pX[light];
+		float y = m_pY[light];
+		float z = m_pZ[light];
+		float r = m_pRadius[light];
+
+		// Tangent range of the light's box inside the slice, the nearest
+		// depth widens the sides facing away from the view axis
+		float nearest = std::max(z - r, slice.nearZ);
+		float farthest = std::min(z + r, slice.farZ);
+		float left = x - r;
+		float right = x + r;
+		float bottom = y - r;
+		float top = y + r;
+		float minTanX = left / (left >= 0 ? farthest : nearest);
+		float maxTanX = right / (right >= 0 ? nearest : farthest);
+		float minTanY = bottom / (bottom >= 0 ? farthest : nearest);
+		float maxTanY = top / (top >= 0 ? nearest : farthest);
+		if (maxTanX < -m_tanHalfX || minTanX > m_tanHalfX || maxTanY < -m_tanHalfY || minTanY > m_tanHalfY)
+		{
+			continue;
+		}
+
+		uint32_t firstX = (uint32_t)std::min(std::max(floorf((minTanX + m_tanHalfX) * tilesPerTanX), 0.0f), maxTileX);
+		uint32_t lastX = (uint32_t)std::min(std::max(floorf((maxTanX + m_tanHalfX) * tilesPerTanX), 0.0f), maxTileX);
+		uint32_t firstY = (uint32_t)std::min(std::max(floorf((m_tanHalfY - maxTanY) * tilesPerTanY), 0.0f), maxTileY);
+		uint32_t lastY = (uint32_t)std::min(std::max(floorf((m_tanHalfY - minTanY) * tilesPerTanY), 0.0f), maxTileY);
+
+		// Sphere against box: squared distance per axis, x four tiles at a time
+		float dz = std::max(0.0f, std::max(slice.nearZ - z, z - slice.farZ));
+		float restZ = r * r - dz * dz;
+		__m128 lightX = _mm_set1_ps(x);
+		for (uint32_t row = firstY; row <= lastY; row++)
+		{
+			float dy = std::max(0.0f, std::max(slice.minY[row] - y, y - slice.maxY[row]));
+			float rest = restZ - dy * dy;
+			if (rest < 0)
+			{
+				continue;
+			}
+
+			__m128 restX = _mm_set1_ps(rest);
+			uint32_t rowTile = row * m_tilesX;
+			for (uint32_t column = firstX & ~3u; column <= lastX; column += 4)
+			{
+				__m128 dx = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&slice.minX[column]), lightX), _mm_sub_ps(lightX, _mm_loadu_ps(&slice.maxX[column])));
+				dx = _mm_max_ps(dx, zero);
+				uint32_t mask = (uint32_t)_mm_movemask_ps(_mm_cmple_ps(_mm_mul_ps(dx, dx), restX));
+
+				// Lanes outside the light's tile range are dropped
+				if (column < firstX)
+				{
+					mask &= 0xFu << (firstX - column);
+				}
+				if (column + 3 > lastX)
+				{
+					mask &= 0xFu >> (column + 3 - lastX);
+				}
+				for (uint32_t lane = 0; mask != 0; lane++, mask >>= 1)
+				{
+					if ((mask & 1) != 0)
+					{
+						slice.hitTiles.push_back(rowTile + column + lane);
+						slice.hitLights.push_back(light);
+					}
+				}
+			}
+		}
+	}
+
+	// Counting sort by cluster. Filling from the back, starting at the end
+	// of each range, leaves the offsets at the range starts.
+	uint32_t clustersPerSlice = m_tilesX * m_tilesY;
+	Range* pRanges = &m_ranges[s * clustersPerSlice];
+	for (uint32_t cluster = 0; cluster < clustersPerSlice; cluster++)
+	{
+		pRanges[cluster].count = 0;
+	}
+	for (uint32_t tile : slice.hitTiles)
+	{
+		pRanges[tile].count++;
+	}
+
+	uint32_t end = 0;
+	for (uint32_t cluster = 0; cluster < clustersPerSlice; cluster++)
+	{
+		end += pRanges[cluster].count;
+		pRanges[cluster].offset = end;
+	}
+
+	slice.indices.resize(slice.hitTiles.size());
+	for (size_t hit = slice.hitTiles.size(); hit-- > 0;)
+	{
+		slice.indices[--pRanges[slice.hitTiles[hit]].offset] = slice.hitLights[hit];
+	}
+}
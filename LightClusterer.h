@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Clustered light grid: the view frustum split into screen tiles and depth
+// slices spaced exponentially between the near and far planes. Bin() tests
+// light spheres against the cluster boxes, four tiles of a row at a time with
+// SSE, one depth slice per task on a pool of threads, and writes the lights of
+// every cluster as one range of a compact index list.
+//
+// Coordinates are view space, left-handed with x right, y up and z forward.
+// Cluster (x, y, slice) is element (slice * tilesY + y) * tilesX + x, tile
+// row 0 is at the top of the screen.
+class LightClusterer
+{
+public:
+	// Offset and count of a cluster's lights in the index list
+	struct Range
+	{
+		uint32_t offset;
+		uint32_t count;
+	};
+
+	LightClusterer();
+
+	// workerCount 0 picks hardware concurrency
+	void Init(uint32_t tileSize, uint32_t sliceCount, uint32_t workerCount = 0);
+
+	// tanHalfX and tanHalfY are the half extents of the view at depth 1,
+	// cluster boxes are only rebuilt when something changed
+	void SetProjection(uint32_t width, uint32_t height, float tanHalfX, float tanHalfY, float nearZ, float farZ);
+
+	// Light spheres in view space, indices in the list refer to this order.
+	// Spheres of radius 0 or less are skipped.
+	void Bin(const float* x, const float* y, const float* z, const float* radius, uint32_t count);
+
+	uint32_t GetTileSize() const;
+	uint32_t GetTilesX() const;
+	uint32_t GetTilesY() const;
+	uint32_t GetSliceCount() const;
+	uint32_t GetClusterCount() const;
+
+	// Slice of view depth z is floor(log(z) * scale + bias)
+	float GetSliceScale() const;
+	float GetSliceBias() const;
+
+	const std::vector<Range>& GetRanges() const;
+	const std::vector<uint32_t>& GetIndices() const;
+	uint32_t GetMaxClusterLights() const;
+
+private:
+	// Cluster boxes of one slice and the scratch of the task binning it
+	struct Slice
+	{
+		float nearZ;
+		float farZ;
+		std::vector<float> minX; // per tile column, padded to a multiple of four
+		std::vector<float> maxX;
+		std::vector<float> minY; // per tile row
+		std::vector<float> maxY;
+
+		std::vector<uint32_t> hitTiles;
+		std::vector<uint32_t> hitLights;
+		std::vector<uint32_t> indices;
+	};
+
+	uint32_t GetSlice(float z) const;
+	void BinSlice(uint32_t slice);
+
+private:
+	uint32_t m_tileSize;
+	uint32_t m_sliceCount;
+	uint32_t m_workerCount;
+
+	uint32_t m_width;
+	uint32_t m_height;
+	float m_tanHalfX;
+	float m_tanHalfY;
+	float m_nearZ;
+	float m_farZ;
+
+	uint32_t m_tilesX;
+	uint32_t m_tilesY;
+	float m_sliceScale;
+	float m_sliceBias;
+	std::vector<float> m_tanX; // tile column edges, tilesX + 1
+	std::vector<float> m_tanY; // tile row edges from the top, tilesY + 1
+	std::vector<Slice> m_slices;
+
+	// Lights of the frame, bucketed by the slices their depth range covers
+	const float* m_pX;
+	const float* m_pY;
+	const float* m_pZ;
+	const float* m_pRadius;
+	std::vector<uint32_t> m_sliceLightOffsets;
+	std::vector<uint32_t> m_sliceLights;
+
+	std::vector<Range> m_ranges;
+	std::vector<uint32_t> m_indices;
+	uint32_t m_maxClusterLights;
+};
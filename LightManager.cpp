@@ -0,0 +1,605 @@
+#include "LightManager.h"
+
+#include <assert.h>
+#include <math.h>
+
+const uint32_t LightManager::InvalidLight;
+const uint32_t LightManager::LevelCount;
+
+// Assign() keeps its candidates on the stack
+static const uint32_t MaxAssignCount = 32;
+
+// Cell keys hold the level in the top four bits and 20 bits per coordinate,
+// lights not linked into a cell have one of the keys with all level bits set
+static const int32_t CellCoordBias = 1 << 19;
+static const int32_t MaxCellCoord = (1 << 19) - 1;
+static const uint64_t UnlinkedKey = 0xFFFFFFFFFFFFFFFFull;
+static const uint64_t LargeKey = 0xFFFFFFFFFFFFFFFEull;
+
+static int32_t ToCell(float value, float invCellSize)
+{
+	float cell = floorf(value * invCellSize);
+	cell = cell < (float)-CellCoordBias ? (float)-CellCoordBias : cell;
+	cell = cell > (float)MaxCellCoord ? (float)MaxCellCoord : cell;
+	return (int32_t)cell;
+}
+
+// Power of two, grown by doubling
+static const uint32_t InitialCellSlots = 1024;
+
+// murmur3 64-bit finalizer
+static uint32_t HashKey(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdull;
+	key ^= key >> 33;
+	key *= 0xc4ceb3c0f63e59e3ull;
+	key ^= key >> 33;
+	return (uint32_t)key;
+}
+
+LightManager::LightManager()
+	: m_cellSize(1.0f)
+	, m_invCellSize(1.0f)
+	, m_count(0)
+	, m_version(0)
+	, m_updatedCount(0)
+{
+	for (uint32_t level = 0; level < LevelCount; level++)
+	{
+		m_levelLightCounts[level] = 0;
+	}
+}
+
+void LightManager::Init(float cellSize)
+{
+	assert(cellSize > 0);
+
+	Clear();
+	m_cellSize = cellSize;
+	m_invCellSize = 1.0f / cellSize;
+}
+
+uint32_t LightManager::Create()
+{
+	uint32_t light;
+	if (!m_freeLights.empty())
+	{
+		light = m_freeLights.back();
+		m_freeLights.pop_back();
+	}
+	else
+	{
+		light = (uint32_t)m_alive.size();
+		m_posX.push_back(0.0f);
+		m_posY.push_back(0.0f);
+		m_posZ.push_back(0.0f);
+		m_colorR.push_back(0.0f);
+		m_colorG.push_back(0.0f);
+		m_colorB.push_back(0.0f);
+		m_power.push_back(0.0f);
+		m_range.push_back(0.0f);
+		m_setRange.push_back(0.0f);
+		m_falloff.push_back(0);
+		m_alive.push_back(0);
+		m_dirty.push_back(0);
+		m_linkedKey.push_back(UnlinkedKey);
+		m_linkedCell.push_back(InvalidLight);
+		m_linkedPosition.push_back(0);
+	}
+
+	// White unit power light at the origin
+	m_posX[light] = m_posY[light] = m_posZ[light] = 0.0f;
+	m_colorR[light] = m_colorG[light] = m_colorB[light] = 1.0f;
+	m_power[light] = 1.0f;
+	m_setRange[light] = 0.0f;
+	m_range[light] = GetEffectiveRange(light);
+	m_falloff[light] = FALLOFF_INVERSE_SQUARE;
+	m_alive[light] = 1;
+	m_count++;
+
+	MarkDirty(light);
+
+	return light;
+}
+
+void LightManager::Destroy(uint32_t light)
+{
+	assert(IsAlive(light));
+
+	// Streams indexed by handle are passed on whole, a dead slot reaches nothing
+	Unlink(light);
+	m_power[light] = 0.0f;
+	m_range[light] = 0.0f;
+	m_alive[light] = 0;
+	m_count--;
+	m_freeLights.push_back(light);
+
+	// Version has to change even if nothing else does
+	MarkDirty(light);
+}
+
+void LightManager::Clear()
+{
+	m_posX.clear();
+	m_posY.clear();
+	m_posZ.clear();
+	m_colorR.clear();
+	m_colorG.clear();
+	m_colorB.clear();
+	m_power.clear();
+	m_range.clear();
+	m_setRange.clear();
+	m_falloff.clear();
+	m_alive.clear();
+	m_dirty.clear();
+	m_linkedKey.clear();
+	m_linkedCell.clear();
+	m_linkedPosition.clear();
+
+	m_cellKeys.clear();
+	m_cellSlots.clear();
+	m_cellLights.clear();
+	for (uint32_t level = 0; level < LevelCount; level++)
+	{
+		m_levelLightCounts[level] = 0;
+	}
+	m_largeLights.clear();
+	m_dirtyLights.clear();
+	m_freeLights.clear();
+	m_count = 0;
+	m_version++;
+	m_updatedCount = 0;
+}
+
+void LightManager::SetPosition(uint32_t light, float x, float y, float z)
+{
+	assert(IsAlive(light));
+
+	m_posX[light] = x;
+	m_posY[light] = y;
+	m_posZ[light] = z;
+	MarkDirty(light);
+}
+
+void LightManager::SetColor(uint32_t light, float r, float g, float b)
+{
+	assert(IsAlive(light));
+
+	m_colorR[light] = r;
+	m_colorG[light] = g;
+	m_colorB[light] = b;
+	m_range[light] = GetEffectiveRange(light);
+	MarkDirty(light);
+}
+
+void LightManager::SetPower(uint32_t light, float power)
+{
+	assert(IsAlive(light));
+
+	m_power[light] = power;
+	m_range[light] = GetEffectiveRange(light);
+	MarkDirty(light);
+}
+
+void LightManager::SetRange(uint32_t light, float range)
+{
+	assert(IsAlive(light));
+
+	m_setRange[light] = range;
+	m_range[light] = GetEffectiveRange(light);
+	MarkDirty(light);
+}
+
+void LightManager::SetFalloff(uint32_t light, Falloff falloff)
+{
+	assert(IsAlive(light));
+
+	m_falloff[light] = (uint8_t)falloff;
+	MarkDirty(light);
+}
+
+void LightManager::Update()
+{
+	m_updatedCount = (uint32_t)m_dirtyLights.size();
+	if (m_dirtyLights.empty())
+	{
+		return;
+	}
+
+	// Lights moving inside their cells are not relinked
+	for (uint32_t light : m_dirtyLights)
+	{
+		m_dirty[light] = 0;
+		if (m_alive[light] != 0)
+		{
+			uint64_t key = GetLightKey(light);
+			if (key != m_linkedKey[light])
+			{
+				Unlink(light);
+				Link(light, key);
+			}
+		}
+	}
+	m_dirtyLights.clear();
+	m_version++;
+}
+
+void LightManager::Query(const float* center, const float* extent, std::vector<uint32_t>* pLights) const
+{
+	struct Collector
+	{
+		std::vector<uint32_t>* pLights;
+
+		void operator()(uint32_t light, float)
+		{
+			pLights->push_back(light);
+		}
+	};
+
+	Collector collector = { pLights };
+	VisitOverlapping(center, extent, collector);
+}
+
+uint32_t LightManager::Assign(const float* center, const float* extent, uint32_t maxCount, uint32_t* pLights) const
+{
+	assert(maxCount <= MaxAssignCount);
+
+	// Insertion into the strongest maxCount, ties broken by handle so the
+	// result does not depend on the cell order
+	struct Selector
+	{
+		const LightManager* pManager;
+		uint32_t maxCount;
+		uint32_t count;
+		uint32_t lights[MaxAssignCount];
+		float weights[MaxAssignCount];
+
+		void operator()(uint32_t light, float distanceSq)
+		{
+			const LightManager& manager = *pManager;
+			float intensity = manager.m_colorR[light] > manager.m_colorG[light] ? manager.m_colorR[light] : manager.m_colorG[light];
+			intensity = manager.m_colorB[light] > intensity ? manager.m_colorB[light] : intensity;
+			float weight = manager.m_power[light] * intensity * GetAttenuation(sqrtf(distanceSq), manager.m_range[light], (Falloff)manager.m_falloff[light]);
+			if (weight <= 0)
+			{
+				return;
+			}
+
+			uint32_t slot = count < maxCount ? count++ : maxCount;
+			while (slot > 0 && (weights[slot - 1] < weight || (weights[slot - 1] == weight && lights[slot - 1] > light)))
+			{
+				if (slot < maxCount)
+				{
+					lights[slot] = lights[slot - 1];
+					weights[slot] = weights[slot - 1];
+				}
+				slot--;
+			}
+			if (slot < maxCount)
+			{
+				lights[slot] = light;
+				weights[slot] = weight;
+			}
+		}
+	};
+
+	Selector selector;
+	selector.pManager = this;
+	selector.maxCount = maxCount;
+	selector.count = 0;
+	VisitOverlapping(center, extent, selector);
+
+	for (uint32_t i = 0; i < maxCount; i++)
+	{
+		pLights[i] = i < selector.count ? selector.lights[i] : InvalidLight;
+	}
+	return selector.count;
+}
+
+float LightManager::GetAttenuation(float distance, float range, Falloff falloff)
+{
+	float distanceSq = distance * distance;
+	float attenuation = distance > 1.0f ? 1.0f / (100.0f + distanceSq) : 1.0f / (0.2f + distanceSq);
+	if (falloff == FALLOFF_WINDOWED)
+	{
+		float ratioSq = range > 0 ? distanceSq / (range * range) : 1.0f;
+		float window = 1.0f - ratioSq * ratioSq;
+		window = window > 0 ? window : 0.0f;
+		attenuation *= window * window;
+	}
+	return attenuation;
+}
+
+float LightManager::GetDefaultRange(float power, const float* color)
+{
+	// power * color / (100 + d * d) falls under 1/256 at this distance
+	float maxColor = color[0] > color[1] ? color[0] : color[1];
+	maxColor = color[2] > maxColor ? color[2] : maxColor;
+	float range = 256.0f * power * maxColor - 100.0f;
+	return range > 1.0f ? sqrtf(range) : 1.0f;
+}
+
+bool LightManager::IsAlive(uint32_t light) const
+{
+	return light < (uint32_t)m_alive.size() && m_alive[light] != 0;
+}
+
+LightManager::Light LightManager::GetLight(uint32_t light) const
+{
+	assert(light < GetCapacity());
+
+	Light result;
+	result.position[0] = m_posX[light];
+	result.position[1] = m_posY[light];
+	result.position[2] = m_posZ[light];
+	result.range = m_range[light];
+	result.color[0] = m_colorR[light];
+	result.color[1] = m_colorG[light];
+	result.color[2] = m_colorB[light];
+	result.power = m_power[light];
+	result.falloff = (Falloff)m_falloff[light];
+	return result;
+}
+
+const float* LightManager::GetPositionsX() const
+{
+	return m_posX.data();
+}
+
+const float* LightManager::GetPositionsY() const
+{
+	return m_posY.data();
+}
+
+const float* LightManager::GetPositionsZ() const
+{
+	return m_posZ.data();
+}
+
+const float* LightManager::GetRanges() const
+{
+	return m_range.data();
+}
+
+uint32_t LightManager::GetCapacity() const
+{
+	return (uint32_t)m_alive.size();
+}
+
+uint32_t LightManager::GetCount() const
+{
+	return m_count;
+}
+
+uint32_t LightManager::GetVersion() const
+{
+	return m_version;
+}
+
+uint32_t LightManager::GetUpdatedCount() const
+{
+	return m_updatedCount;
+}
+
+uint64_t LightManager::CellKey(uint32_t level, int32_t x, int32_t y, int32_t z)
+{
+	return (uint64_t)(x + CellCoordBias) | ((uint64_t)(y + CellCoordBias) << 20) | ((uint64_t)(z + CellCoordBias) << 40) | ((uint64_t)level << 60);
+}
+
+uint32_t LightManager::FindCell(uint64_t key) const
+{
+	if (m_cellKeys.empty())
+	{
+		return InvalidLight;
+	}
+
+	// Linear probing, the table is at most half full
+	uint32_t mask = (uint32_t)m_cellKeys.size() - 1;
+	for (uint32_t slot = HashKey(key) & mask; ; slot = (slot + 1) & mask)
+	{
+		if (m_cellSlots[slot] == InvalidLight || m_cellKeys[slot] == key)
+		{
+			return m_cellSlots[slot];
+		}
+	}
+}
+
+uint32_t LightManager::GetCell(uint64_t key)
+{
+	if (m_cellLights.size() * 2 >= m_cellKeys.size())
+	{
+		// Rehash into twice the slots, cell indices stay the same
+		std::vector<uint64_t> keys(m_cellKeys.empty() ? InitialCellSlots : m_cellKeys.size() * 2);
+		std::vector<uint32_t> slots(keys.size(), InvalidLight);
+		uint32_t mask = (uint32_t)keys.size() - 1;
+		for (size_t i = 0; i < m_cellKeys.size(); i++)
+		{
+			if (m_cellSlots[i] != InvalidLight)
+			{
+				uint32_t slot = HashKey(m_cellKeys[i]) & mask;
+				while (slots[slot] != InvalidLight)
+				{
+					slot = (slot + 1) & mask;
+				}
+				keys[slot] = m_cellKeys[i];
+				slots[slot] = m_cellSlots[i];
+			}
+		}
+		m_cellKeys.swap(keys);
+		m_cellSlots.swap(slots);
+	}
+
+	uint32_t mask = (uint32_t)m_cellKeys.size() - 1;
+	uint32_t slot = HashKey(key) & mask;
+	while (m_cellSlots[slot] != InvalidLight)
+	{
+		if (m_cellKeys[slot] == key)
+		{
+			return m_cellSlots[slot];
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	m_cellKeys[slot] = key;
+	m_cellSlots[slot] = (uint32_t)m_cellLights.size();
+	m_cellLights.push_back(std::vector<uint32_t>());
+	return m_cellSlots[slot];
+}
+
+float LightManager::GetEffectiveRange(uint32_t light) const
+{
+	if (m_setRange[light] > 0)
+	{
+		return m_setRange[light];
+	}
+	float color[3] = { m_colorR[light], m_colorG[light], m_colorB[light] };
+	return GetDefaultRange(m_power[light], color);
+}
+
+uint64_t LightManager::GetLightKey(uint32_t light) const
+{
+	// First level whose cells cover the range
+	uint32_t level = 0;
+	float cellSize = m_cellSize;
+	while (level < LevelCount && m_range[light] > cellSize)
+	{
+		level++;
+		cellSize *= 2;
+	}
+	if (level == LevelCount)
+	{
+		return LargeKey;
+	}
+
+	float invCellSize = 1.0f / cellSize;
+	return CellKey(level, ToCell(m_posX[light], invCellSize), ToCell(m_posY[light], invCellSize), ToCell(m_posZ[light], invCellSize));
+}
+
+void LightManager::MarkDirty(uint32_t light)
+{
+	if (m_dirty[light] == 0)
+	{
+		m_dirty[light] = 1;
+		m_dirtyLights.push_back(light);
+	}
+}
+
+void LightManager::Link(uint32_t light, uint64_t key)
+{
+	if (key == LargeKey)
+	{
+		m_linkedCell[light] = InvalidLight;
+		m_linkedPosition[light] = (uint32_t)m_largeLights.size();
+		m_largeLights.push_back(light);
+	}
+	else
+	{
+		uint32_t cell = GetCell(key);
+		m_linkedCell[light] = cell;
+		m_linkedPosition[light] = (uint32_t)m_cellLights[cell].size();
+		m_cellLights[cell].push_back(light);
+		m_levelLightCounts[key >> 60]++;
+	}
+	m_linkedKey[light] = key;
+}
+
+void LightManager::Unlink(uint32_t light)
+{
+	if (m_linkedKey[light] == UnlinkedKey)
+	{
+		return;
+	}
+
+	// Swap with the last light of the list
+	std::vector<uint32_t>& lights = m_linkedKey[light] == LargeKey ? m_largeLights : m_cellLights[m_linkedCell[light]];
+	uint32_t position = m_linkedPosition[light];
+	lights[position] = lights.back();
+	m_linkedPosition[lights[position]] = position;
+	lights.pop_back();
+
+	if (m_linkedKey[light] != LargeKey)
+	{
+		m_levelLightCounts[m_linkedKey[light] >> 60]--;
+	}
+	m_linkedKey[light] = UnlinkedKey;
+	m_linkedCell[light] = InvalidLight;
+}
+
+template <typename Visitor>
+void LightManager::VisitOverlapping(const float* center, const float* extent, Visitor& visitor) const
+{
+	// Squared distance from the light to the box against its range
+	auto test = [&](uint32_t light)
+	{
+		float dx = fabsf(m_posX[light] - center[0]) - extent[0];
+		float dy = fabsf(m_posY[light] - center[1]) - extent[1];
+		float dz = fabsf(m_posZ[light] - center[2]) - extent[2];
+		dx = dx > 0 ? dx : 0.0f;
+		dy = dy > 0 ? dy : 0.0f;
+		dz = dz > 0 ? dz : 0.0f;
+		float distanceSq = dx * dx + dy * dy + dz * dz;
+		if (distanceSq < m_range[light] * m_range[light])
+		{
+			visitor(light, distanceSq);
+		}
+	};
+
+	for (uint32_t light : m_largeLights)
+	{
+		test(light);
+	}
+
+	float cellSize = m_cellSize;
+	for (uint32_t level = 0; level < LevelCount; level++, cellSize *= 2)
+	{
+		if (m_levelLightCounts[level] == 0)
+		{
+			continue;
+		}
+
+		// Ranges on this level are at most one cell, so overlapping lights
+		// have their center within one cell of the box
+		float invCellSize = 1.0f / cellSize;
+		int32_t minCell[3];
+		int32_t maxCell[3];
+		uint64_t cellCount = 1;
+		for (int i = 0; i < 3; i++)
+		{
+			minCell[i] = ToCell(center[i] - extent[i] - cellSize, invCellSize);
+			maxCell[i] = ToCell(center[i] + extent[i] + cellSize, invCellSize);
+			cellCount *= (uint64_t)(maxCell[i] - minCell[i] + 1);
+		}
+
+		// Boxes covering more cells than the level has lights test them all
+		if (cellCount > m_levelLightCounts[level])
+		{
+			for (uint32_t light = 0; light < GetCapacity(); light++)
+			{
+				if (m_linkedKey[light] >> 60 == level)
+				{
+					test(light);
+				}
+			}
+			continue;
+		}
+
+		for (int32_t z = minCell[2]; z <= maxCell[2]; z++)
+		{
+			for (int32_t y = minCell[1]; y <= maxCell[1]; y++)
+			{
+				for (int32_t x = minCell[0]; x <= maxCell[0]; x++)
+				{
+					uint32_t cell = FindCell(CellKey(level, x, y, z));
+					if (cell != InvalidLight)
+					{
+						for (uint32_t light : m_cellLights[cell])
+						{
+							test(light);
+						}
+					}
+				}
+			}
+		}
+	}
+}
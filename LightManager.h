@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Point lights stored as structure of arrays. Lights changed since the last
+// Update() are relinked into a loose hierarchical grid: each light sits in the
+// cell of its center on the first level whose cells are at least as large as
+// its range, so a query only visits the cells within one cell of its box on
+// every level. Lights too large for the coarsest level are tested by every
+// query. Queries see the lights as of the last Update().
+//
+// Attenuation mirrors ColorShader: power * color / (100 + d * d), or
+// 1 / (0.2 + d * d) closer than 1. The range defaults to the distance where
+// that falls under 1/256 of the light intensity, windowed lights also fade to
+// zero there.
+class LightManager
+{
+public:
+	static const uint32_t InvalidLight = 0xFFFFFFFF;
+
+	// Cell size doubles per level
+	static const uint32_t LevelCount = 8;
+
+	enum Falloff
+	{
+		FALLOFF_INVERSE_SQUARE = 0, // Range only bounds the queries
+		FALLOFF_WINDOWED = 1 // Multiplied by (1 - (d / range)^4)^2
+	};
+
+	struct Light
+	{
+		float position[3];
+		float range;
+		float color[3];
+		float power;
+		Falloff falloff;
+	};
+
+	LightManager();
+
+	// Size of the finest cells, about the typical light range
+	void Init(float cellSize);
+
+	uint32_t Create();
+	void Destroy(uint32_t light);
+	void Clear();
+
+	void SetPosition(uint32_t light, float x, float y, float z);
+	void SetColor(uint32_t light, float r, float g, float b);
+	void SetPower(uint32_t light, float power);
+	// Range 0 derives it from power and color
+	void SetRange(uint32_t light, float range);
+	void SetFalloff(uint32_t light, Falloff falloff);
+
+	// Relinks lights changed since the last call
+	void Update();
+
+	// Appends the lights whose range overlaps the box
+	void Query(const float* center, const float* extent, std::vector<uint32_t>* pLights) const;
+
+	// Writes the maxCount lights contributing most at the nearest point of
+	// the box, strongest first, and fills the remaining slots with
+	// InvalidLight. Returns the count found.
+	uint32_t Assign(const float* center, const float* extent, uint32_t maxCount, uint32_t* pLights) const;
+
+	static float GetAttenuation(float distance, float range, Falloff falloff);
+	static float GetDefaultRange(float power, const float* color);
+
+	bool IsAlive(uint32_t light) const;
+	Light GetLight(uint32_t light) const;
+
+	// Indexed by light, destroyed slots keep their position and have power
+	// and range 0
+	const float* GetPositionsX() const;
+	const float* GetPositionsY() const;
+	const float* GetPositionsZ() const;
+	const float* GetRanges() const;
+
+	// Slots including destroyed lights, handles are below this
+	uint32_t GetCapacity() const;
+	uint32_t GetCount() const;
+
+	// Incremented by Update() when any light changed
+	uint32_t GetVersion() const;
+	uint32_t GetUpdatedCount() const;
+
+private:
+	static uint64_t CellKey(uint32_t level, int32_t x, int32_t y, int32_t z);
+
+	// Index into m_cellLights, FindCell() returns InvalidLight for cells never used
+	uint32_t FindCell(uint64_t key) const;
+	uint32_t GetCell(uint64_t key);
+
+	float GetEffectiveRange(uint32_t light) const;
+	uint64_t GetLightKey(uint32_t light) const;
+	void MarkDirty(uint32_t light);
+	void Link(uint32_t light, uint64_t key);
+	void Unlink(uint32_t light);
+
+	template <typename Visitor>
+	void VisitOverlapping(const float* center, const float* extent, Visitor& visitor) const;
+
+private:
+	float m_cellSize;
+	float m_invCellSize;
+
+	std::vector<float> m_posX, m_posY, m_posZ;
+	std::vector<float> m_colorR, m_colorG, m_colorB;
+	std::vector<float> m_power;
+	std::vector<float> m_range; // Effective, derived when set to 0
+	std::vector<float> m_setRange;
+	std::vector<uint8_t> m_falloff;
+	std::vector<uint8_t> m_alive;
+	std::vector<uint8_t> m_dirty;
+
+	// Where each light is linked: its key, the cell and the position in the
+	// cell's list, or in m_largeLights
+	std::vector<uint64_t> m_linkedKey;
+	std::vector<uint32_t> m_linkedCell;
+	std::vector<uint32_t> m_linkedPosition;
+
+	// Open addressing table of the cells lights were ever linked into
+	std::vector<uint64_t> m_cellKeys;
+	std::vector<uint32_t> m_cellSlots;
+	std::vector<std::vector<uint32_t>> m_cellLights;
+	uint32_t m_levelLightCounts[LevelCount];
+	std::vector<uint32_t> m_largeLights;
+
+	std::vector<uint32_t> m_dirtyLights;
+	std::vector<uint32_t> m_freeLights;
+	uint32_t m_count;
+	uint32_t m_version;
+	uint32_t m_updatedCount;
+};
@@ -0,0 +1,189 @@
+#include "LightingKernel.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "SimdPacket.h"
+
+// Lights are converted to packet constants in chunks of this many
+static const uint32_t LightChunkSize = 64;
+
+// Keeps the inverse distance of a light at the shaded point finite
+static const float MinDistanceSquared = 1e-12f;
+
+// Per light terms of a chunk. Power is folded into the color, a light that
+// is not cut off has an infinite cut off distance.
+struct LightChunk
+{
+	float x[LightChunkSize];
+	float y[LightChunkSize];
+	float z[LightChunkSize];
+	float invRangeSquared[LightChunkSize];
+	float cutOffSquared[LightChunkSize];
+	float windowed[LightChunkSize];
+	float r[LightChunkSize];
+	float g[LightChunkSize];
+	float b[LightChunkSize];
+	uint32_t count;
+};
+
+// Adds the chunk's lights to the packet at offset, the last chunk applies the albedo
+static void ShadePacket(const LightingKernel::Pixels& pixels, uint32_t offset, const LightChunk& chunk, bool first, bool last)
+{
+	Packet px = Load(pixels.position[0] + offset);
+	Packet py = Load(pixels.position[1] + offset);
+	Packet pz = Load(pixels.position[2] + offset);
+	Packet nx = Load(pixels.normal[0] + offset);
+	Packet ny = Load(pixels.normal[1] + offset);
+	Packet nz = Load(pixels.normal[2] + offset);
+
+	Packet zero = Set(0.0f);
+	Packet one = Set(1.0f);
+	Packet nearConstant = Set(0.2f);
+	Packet farConstant = Set(100.0f);
+	Packet minDistanceSquared = Set(MinDistanceSquared);
+
+	Packet r = first ? zero : Load(pixels.color[0] + offset);
+	Packet g = first ? zero : Load(pixels.color[1] + offset);
+	Packet b = first ? zero : Load(pixels.color[2] + offset);
+	for (uint32_t i = 0; i < chunk.count; i++)
+	{
+		Packet lx = Sub(Set(chunk.x[i]), px);
+		Packet ly = Sub(Set(chunk.y[i]), py);
+		Packet lz = Sub(Set(chunk.z[i]), pz);
+		Packet distanceSquared = MulAdd(lx, lx, MulAdd(ly, ly, Mul(lz, lz)));
+		Packet invDistance = Rsqrt(Max(distanceSquared, minDistanceSquared));
+		Packet ndotl = Max(Mul(MulAdd(lx, nx, MulAdd(ly, ny, Mul(lz, nz))), invDistance), zero);
+
+		// 1 / (100 + d * d) beyond 1, 1 / (0.2 + d * d) within
+		Packet atten = Rcp(Add(Select(Greater(distanceSquared, one), farConstant, nearConstant), distanceSquared));
+
+		// saturate(1 - (d / range)^4)^2 for windowed lights, 1 for the others
+		Packet ratioSquared = Mul(distanceSquared, Set(chunk.invRangeSquared[i]));
+		Packet window = Max(Sub(one, Mul(ratioSquared, ratioSquared)), zero);
+		Packet falloff = MulAdd(Set(chunk.windowed[i]), Sub(Mul(window, window), one), one);
+		falloff = Select(Greater(Set(chunk.cutOffSquared[i]), distanceSquared), falloff, zero);
+
+		Packet intensity = Mul(Mul(ndotl, atten), falloff);
+		r = MulAdd(intensity, Set(chunk.r[i]), r);
+		g = MulAdd(intensity, Set(chunk.g[i]), g);
+		b = MulAdd(intensity, Set(chunk.b[i]), b);
+	}
+
+	if (last)
+	{
+		r = Mul(r, Load(pixels.albedo[0] + offset));
+		g = Mul(g, Load(pixels.albedo[1] + offset));
+		b = Mul(b, Load(pixels.albedo[2] + offset));
+	}
+	Store(pixels.color[0] + offset, r);
+	Store(pixels.color[1] + offset, g);
+	Store(pixels.color[2] + offset, b);
+}
+
+void LightingKernel::Shade(const Pixels& pixels, const LightManager::Light* pLights, uint32_t lightCount, bool cutOff)
+{
+	uint32_t fullCount = pixels.count / PacketWidth * PacketWidth;
+	uint32_t tailCount = pixels.count - fullCount;
+
+	// Remaining pixels are shaded in a zero padded packet
+	float tail[12][PacketWidth];
+	memset(tail, 0, sizeof(tail));
+	Pixels tailPixels;
+	for (int j = 0; j < 3; j++)
+	{
+		memcpy(tail[j], pixels.position[j] + fullCount, tailCount * sizeof(float));
+		memcpy(tail[3 + j], pixels.normal[j] + fullCount, tailCount * sizeof(float));
+		memcpy(tail[6 + j], pixels.albedo[j] + fullCount, tailCount * sizeof(float));
+		tailPixels.position[j] = tail[j];
+		tailPixels.normal[j] = tail[3 + j];
+		tailPixels.albedo[j] = tail[6 + j];
+		tailPixels.color[j] = tail[9 + j];
+	}
+	tailPixels.count = PacketWidth;
+
+	LightChunk chunk;
+	uint32_t start = 0;
+	do
+	{
+		chunk.count = std::min(lightCount - start, LightChunkSize);
+		for (uint32_t i = 0; i < chunk.count; i++)
+		{
+			const LightManager::Light& light = pLights[start + i];
+			chunk.x[i] = light.position[0];
+			chunk.y[i] = light.position[1];
+			chunk.z[i] = light.position[2];
+			chunk.invRangeSquared[i] = 1.0f / (light.range * light.range);
+			chunk.cutOffSquared[i] = cutOff ? light.range * light.range : INFINITY;
+			chunk.windowed[i] = light.falloff == LightManager::FALLOFF_WINDOWED ? 1.0f : 0.0f;
+			chunk.r[i] = light.power * light.color[0];
+			chunk.g[i] = light.power * light.color[1];
+			chunk.b[i] = light.power * light.color[2];
+		}
+
+		bool first = start == 0;
+		bool last = start + chunk.count == lightCount;
+		for (uint32_t offset = 0; offset < fullCount; offset += PacketWidth)
+		{
+			ShadePacket(pixels, offset, chunk, first, last);
+		}
+		if (tailCount > 0)
+		{
+			ShadePacket(tailPixels, 0, chunk, first, last);
+		}
+		start += chunk.count;
+	}
+	while (start < lightCount);
+
+	for (int j = 0; j < 3; j++)
+	{
+		memcpy(pixels.color[j] + fullCount, tail[9 + j], tailCount * sizeof(float));
+	}
+}
+
+void LightingKernel::ShadeReference(const Pixels& pixels, const LightManager::Light* pLights, uint32_t lightCount, bool cutOff)
+{
+	for (uint32_t p = 0; p < pixels.count; p++)
+	{
+		float position[3] = { pixels.position[0][p], pixels.position[1][p], pixels.position[2][p] };
+		float normal[3] = { pixels.normal[0][p], pixels.normal[1][p], pixels.normal[2][p] };
+		float matColor[3] = { pixels.albedo[0][p], pixels.albedo[1][p], pixels.albedo[2][p] };
+		float color[3] = { 0, 0, 0 };
+		for (uint32_t i = 0; i < lightCount; i++)
+		{
+			const LightManager::Light& light = pLights[i];
+			float l[3] = { light.position[0] - position[0], light.position[1] - position[1], light.position[2] - position[2] };
+			float lengthSquared = l[0] * l[0] + l[1] * l[1] + l[2] * l[2];
+			if ((cutOff && lengthSquared >= light.range * light.range) || lengthSquared == 0)
+			{
+				continue;
+			}
+
+			float dist = sqrtf(lengthSquared);
+			l[0] /= dist;
+			l[1] /= dist;
+			l[2] /= dist;
+
+			float ndotl = std::max(l[0] * normal[0] + l[1] * normal[1] + l[2] * normal[2], 0.0f);
+			float atten = dist > 1 ? 1.0f / (100 + dist * dist) : 1.0f / (0.2f + dist * dist);
+
+			float ratio = dist / light.range;
+			float window = std::min(std::max(1 - ratio * ratio * ratio * ratio, 0.0f), 1.0f);
+			float windowed = light.falloff == LightManager::FALLOFF_WINDOWED ? 1.0f : 0.0f;
+			atten *= 1 + (window * window - 1) * windowed;
+
+			for (int j = 0; j < 3; j++)
+			{
+				color[j] += light.power * matColor[j] * light.color[j] * ndotl * atten;
+			}
+		}
+		pixels.color[0][p] = color[0];
+		pixels.color[1][p] = color[1];
+		pixels.color[2][p] = color[2];
+	}
+}
+
+uint32_t LightingKernel::GetPacketWidth()
+{
+	return PacketWidth;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include "LightManager.h"
+
+// ColorShader's point light model on the CPU. Pixels are passed as structure
+// of arrays and shaded in packets of 16, 8 or 4 with AVX-512, AVX2 or SSE,
+// whichever the compiler targets, one light at a time across the packet.
+// The attenuation is branchless: the distance test selects the constant of
+// the denominator and the window works on squared distances.
+//
+// A light exactly at the shaded point contributes nothing, where the shader
+// divides by zero.
+class LightingKernel
+{
+public:
+	struct Pixels
+	{
+		const float* position[3]; // world space
+		const float* normal[3]; // unit length
+		const float* albedo[3]; // texture times material color
+		float* color[3]; // overwritten with the sum of the lights
+		uint32_t count;
+	};
+
+	// cutOff skips lights farther than their range, as the CLUSTERED variant does
+	static void Shade(const Pixels& pixels, const LightManager::Light* pLights, uint32_t lightCount, bool cutOff);
+
+	// One pixel and one light at a time, statement by statement as in the shader
+	static void ShadeReference(const Pixels& pixels, const LightManager::Light* pLights, uint32_t lightCount, bool cutOff);
+
+	// Pixels per packet of Shade()
+	static uint32_t GetPacketWidth();
+};
@@ -0,0 +1,154 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+	: m_pData(nullptr)
+	, m_size(0)
+	, m_file(INVALID_HANDLE_VALUE)
+	, m_mapping(NULL)
+{
+}
+
+bool MappedFile::Open(const char* path)
+{
+	Close();
+
+	m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size))
+	{
+		Close();
+		return false;
+	}
+
+	// Empty files can not be mapped
+	m_size = (size_t)size.QuadPart;
+	if (m_size == 0)
+	{
+		return true;
+	}
+
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mapping != NULL)
+	{
+		m_pData = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (m_pData == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_pData != nullptr)
+	{
+		UnmapViewOfFile(m_pData);
+		m_pData = nullptr;
+	}
+	if (m_mapping != NULL)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = NULL;
+	}
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+	m_size = 0;
+}
+
+#else
+
+MappedFile::MappedFile()
+	: m_pData(nullptr)
+	, m_size(0)
+	, m_file(-1)
+{
+}
+
+bool MappedFile::Open(const char* path)
+{
+	Close();
+
+	m_file = open(path, O_RDONLY);
+	if (m_file < 0)
+	{
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(m_file, &info) != 0)
+	{
+		Close();
+		return false;
+	}
+
+	m_size = (size_t)info.st_size;
+	if (m_size == 0)
+	{
+		return true;
+	}
+
+	void* pData = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+	if (pData == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	madvise(pData, m_size, MADV_SEQUENTIAL);
+	m_pData = (const char*)pData;
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_pData != nullptr)
+	{
+		munmap((void*)m_pData, m_size);
+		m_pData = nullptr;
+	}
+	if (m_file >= 0)
+	{
+		close(m_file);
+		m_file = -1;
+	}
+	m_size = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+const char* MappedFile::GetData() const
+{
+	return m_pData;
+}
+
+size_t MappedFile::GetSize() const
+{
+	return m_size;
+}
@@ -0,0 +1,1604 @@
+#include "MeshImporter.h"
+#include "MappedFile.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+
+// Below these a single thread is faster than starting workers
+static const size_t MinObjBytesPerWorker = 1 << 20;
+static const size_t MinGltfVerticesPerWorker = 1 << 16;
+
+static const uint32_t EmptySlot = 0xFFFFFFFF;
+
+void MeshData::Clear()
+{
+	vertices.clear();
+	indices.clear();
+	for (int i = 0; i < 3; i++)
+	{
+		boundsMin[i] = 0;
+		boundsMax[i] = 0;
+	}
+}
+
+//
+// Text parsing, works on ranges of the mapped file without copies
+//
+
+static inline bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline const char* SkipSpaces(const char* p, const char* pEnd)
+{
+	while (p < pEnd && IsSpace(*p))
+	{
+		p++;
+	}
+	return p;
+}
+
+static const double PowersOf10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Decimal float with optional exponent, nullptr if there is no number
+static const char* ParseFloat(const char* p, const char* pEnd, float* pValue)
+{
+	bool negative = false;
+	if (p < pEnd && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+
+	// 19 significant digits fit into the mantissa, the rest only scales
+	uint64_t mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool any = false;
+	for (; p < pEnd && IsDigit(*p); p++)
+	{
+		any = true;
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa != 0 ? 1 : 0;
+		}
+		else
+		{
+			exponent++;
+		}
+	}
+	if (p < pEnd && *p == '.')
+	{
+		for (p++; p < pEnd && IsDigit(*p); p++)
+		{
+			any = true;
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0 ? 1 : 0;
+				exponent--;
+			}
+		}
+	}
+	if (!any)
+	{
+		return nullptr;
+	}
+
+	if (p < pEnd && (*p == 'e' || *p == 'E'))
+	{
+		const char* pExponent = p + 1;
+		bool negativeExponent = false;
+		if (pExponent < pEnd && (*pExponent == '-' || *pExponent == '+'))
+		{
+			negativeExponent = *pExponent == '-';
+			pExponent++;
+		}
+		if (pExponent < pEnd && IsDigit(*pExponent))
+		{
+			int value = 0;
+			for (; pExponent < pEnd && IsDigit(*pExponent); pExponent++)
+			{
+				value = value < 10000 ? value * 10 + (*pExponent - '0') : value;
+			}
+			exponent += negativeExponent ? -value : value;
+			p = pExponent;
+		}
+	}
+
+	double value = (double)mantissa;
+	if (exponent > 0)
+	{
+		value *= exponent <= 22 ? PowersOf10[exponent] : pow(10.0, exponent);
+	}
+	else if (exponent < 0)
+	{
+		value /= exponent >= -22 ? PowersOf10[-exponent] : pow(10.0, -exponent);
+	}
+
+	*pValue = (float)(negative ? -value : value);
+	return p;
+}
+
+static const char* ParseInt(const char* p, const char* pEnd, int32_t* pValue)
+{
+	bool negative = false;
+	if (p < pEnd && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+	if (p >= pEnd || !IsDigit(*p))
+	{
+		return nullptr;
+	}
+
+	int64_t value = 0;
+	for (; p < pEnd && IsDigit(*p); p++)
+	{
+		value = value * 10 + (*p - '0');
+		if (value > 0x7FFFFFFF)
+		{
+			return nullptr;
+		}
+	}
+
+	*pValue = (int32_t)(negative ? -value : value);
+	return p;
+}
+
+static bool HasExtension(const char* path, const char* extension)
+{
+	const char* pDot = strrchr(path, '.');
+	if (pDot == nullptr)
+	{
+		return false;
+	}
+	for (pDot++; *pDot != 0 && *extension != 0; pDot++, extension++)
+	{
+		char c = *pDot >= 'A' && *pDot <= 'Z' ? *pDot - 'A' + 'a' : *pDot;
+		if (c != *extension)
+		{
+			return false;
+		}
+	}
+	return *pDot == 0 && *extension == 0;
+}
+
+//
+// Minimal JSON tokenizer for glTF: a flat token array over the source text
+//
+
+enum JsonType
+{
+	JSON_OBJECT = 0,
+	JSON_ARRAY,
+	JSON_STRING,
+	JSON_PRIMITIVE
+};
+
+struct JsonToken
+{
+	uint32_t type;
+	uint32_t start;
+	uint32_t end;
+	uint32_t size; // pairs of an object, items of an array
+	uint32_t next; // first token after the value
+};
+
+class JsonDocument
+{
+public:
+	bool Parse(const char* pText, size_t size)
+	{
+		m_pText = pText;
+		m_tokens.clear();
+		m_tokens.reserve(size / 16 + 16);
+
+		const char* p = pText;
+		const char* pEnd = pText + size;
+		if (!ParseValue(p, pEnd, 0))
+		{
+			return false;
+		}
+		p = SkipJsonSpaces(p, pEnd);
+		return p == pEnd && m_tokens[0].type == JSON_OBJECT;
+	}
+
+	// Value of the key, -1 if the token is not an object or has no such key
+	int Find(int object, const char* key) const
+	{
+		if (object < 0 || m_tokens[object].type != JSON_OBJECT)
+		{
+			return -1;
+		}
+		uint32_t token = object + 1;
+		for (uint32_t i = 0; i < m_tokens[object].size; i++)
+		{
+			if (Equals(token, key))
+			{
+				return token + 1;
+			}
+			token = m_tokens[token + 1].next;
+		}
+		return -1;
+	}
+
+	// Array item, -1 if out of range
+	int At(int array, uint32_t index) const
+	{
+		if (array < 0 || m_tokens[array].type != JSON_ARRAY || index >= m_tokens[array].size)
+		{
+			return -1;
+		}
+		uint32_t token = array + 1;
+		for (uint32_t i = 0; i < index; i++)
+		{
+			token = m_tokens[token].next;
+		}
+		return token;
+	}
+
+	uint32_t GetSize(int token) const
+	{
+		return token >= 0 && m_tokens[token].type == JSON_ARRAY ? m_tokens[token].size : 0;
+	}
+
+	bool Equals(int token, const char* str) const
+	{
+		const JsonToken& t = m_tokens[token];
+		size_t length = strlen(str);
+		return t.type == JSON_STRING && t.end - t.start == length && memcmp(m_pText + t.start, str, length) == 0;
+	}
+
+	double GetNumber(int token, double defaultValue) const
+	{
+		if (token < 0 || m_tokens[token].type != JSON_PRIMITIVE)
+		{
+			return defaultValue;
+		}
+		char text[64];
+		uint32_t length = m_tokens[token].end - m_tokens[token].start;
+		if (length >= sizeof(text))
+		{
+			return defaultValue;
+		}
+		memcpy(text, m_pText + m_tokens[token].start, length);
+		text[length] = 0;
+
+		char* pEnd = nullptr;
+		double value = strtod(text, &pEnd);
+		return pEnd == text + length ? value : defaultValue;
+	}
+
+	bool IsTrue(int token) const
+	{
+		return token >= 0 && m_tokens[token].type == JSON_PRIMITIVE && m_tokens[token].end - m_tokens[token].start == 4
+			&& memcmp(m_pText + m_tokens[token].start, "true", 4) == 0;
+	}
+
+	// Non-negative integer, -1 if absent or not one
+	int64_t GetIndex(int token) const
+	{
+		double value = GetNumber(token, -1.0);
+		return value >= 0 && value <= 4294967295.0 && value == floor(value) ? (int64_t)value : -1;
+	}
+
+	// Raw string contents, escapes are not decoded
+	std::string GetString(int token) const
+	{
+		if (token < 0 || m_tokens[token].type != JSON_STRING)
+		{
+			return std::string();
+		}
+		return std::string(m_pText + m_tokens[token].start, m_tokens[token].end - m_tokens[token].start);
+	}
+
+private:
+	static const char* SkipJsonSpaces(const char* p, const char* pEnd)
+	{
+		while (p < pEnd && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+		{
+			p++;
+		}
+		return p;
+	}
+
+	bool ParseValue(const char*& p, const char* pEnd, uint32_t depth)
+	{
+		p = SkipJsonSpaces(p, pEnd);
+		if (p >= pEnd || depth > 64)
+		{
+			return false;
+		}
+
+		uint32_t index = (uint32_t)m_tokens.size();
+		JsonToken token = { JSON_PRIMITIVE, (uint32_t)(p - m_pText), 0, 0, 0 };
+		m_tokens.push_back(token);
+
+		if (*p == '{' || *p == '[')
+		{
+			bool object = *p == '{';
+			char close = object ? '}' : ']';
+			m_tokens[index].type = object ? JSON_OBJECT : JSON_ARRAY;
+
+			uint32_t size = 0;
+			p = SkipJsonSpaces(p + 1, pEnd);
+			if (p < pEnd && *p == close)
+			{
+				p++;
+			}
+			else
+			{
+				for (;;)
+				{
+					if (object)
+					{
+						p = SkipJsonSpaces(p, pEnd);
+						if (p >= pEnd || *p != '"' || !ParseValue(p, pEnd, depth + 1))
+						{
+							return false;
+						}
+						p = SkipJsonSpaces(p, pEnd);
+						if (p >= pEnd || *p != ':')
+						{
+							return false;
+						}
+						p++;
+					}
+					if (!ParseValue(p, pEnd, depth + 1))
+					{
+						return false;
+					}
+					size++;
+
+					p = SkipJsonSpaces(p, pEnd);
+					if (p < pEnd && *p == ',')
+					{
+						p++;
+						continue;
+					}
+					if (p < pEnd && *p == close)
+					{
+						p++;
+						break;
+					}
+					return false;
+				}
+			}
+			m_tokens[index].size = size;
+			m_tokens[index].end = (uint32_t)(p - m_pText);
+		}
+		else if (*p == '"')
+		{
+			m_tokens[index].type = JSON_STRING;
+			m_tokens[index].start++;
+			for (p++; p < pEnd && *p != '"'; p++)
+			{
+				if (*p == '\\')
+				{
+					p++;
+				}
+			}
+			if (p >= pEnd)
+			{
+				return false;
+			}
+			m_tokens[index].end = (uint32_t)(p - m_pText);
+			p++;
+		}
+		else
+		{
+			while (p < pEnd && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+			{
+				p++;
+			}
+			m_tokens[index].end = (uint32_t)(p - m_pText);
+			if (m_tokens[index].end == m_tokens[index].start)
+			{
+				return false;
+			}
+		}
+
+		m_tokens[index].next = (uint32_t)m_tokens.size();
+		return true;
+	}
+
+private:
+	const char* m_pText;
+	std::vector<JsonToken> m_tokens;
+};
+
+//
+// glTF helpers
+//
+
+enum GltfComponentType
+{
+	GLTF_BYTE = 5120,
+	GLTF_UNSIGNED_BYTE = 5121,
+	GLTF_SHORT = 5122,
+	GLTF_UNSIGNED_SHORT = 5123,
+	GLTF_UNSIGNED_INT = 5125,
+	GLTF_FLOAT = 5126
+};
+
+static const uint32_t GltfModeTriangles = 4;
+static const uint32_t GlbMagic = 0x46546C67; // "glTF"
+static const uint32_t GlbChunkJson = 0x4E4F534A;
+static const uint32_t GlbChunkBin = 0x004E4942;
+
+struct GltfBuffer
+{
+	const uint8_t* pData;
+	size_t size;
+};
+
+struct GltfAccessor
+{
+	const uint8_t* pData; // nullptr if the attribute is absent
+	uint32_t count;
+	uint32_t stride;
+	uint32_t componentType;
+	uint32_t componentCount;
+	bool normalized;
+};
+
+// One primitive placed by a node, decoded by a worker into its output range
+struct GltfDraw
+{
+	GltfAccessor position;
+	GltfAccessor normal;
+	GltfAccessor uv;
+	GltfAccessor indices;
+
+	float matrix[16]; // column-major
+	float normalMatrix[9]; // cofactors of the upper 3x3, row-major
+	bool flipWinding;
+
+	uint32_t firstVertex;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	const char* error;
+};
+
+static uint32_t GetComponentSize(uint32_t componentType)
+{
+	switch (componentType)
+	{
+	case GLTF_BYTE:
+	case GLTF_UNSIGNED_BYTE:
+		return 1;
+	case GLTF_SHORT:
+	case GLTF_UNSIGNED_SHORT:
+		return 2;
+	case GLTF_UNSIGNED_INT:
+	case GLTF_FLOAT:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+static float ReadComponent(const uint8_t* p, uint32_t componentType, bool normalized)
+{
+	switch (componentType)
+	{
+	case GLTF_FLOAT:
+	{
+		float value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+	case GLTF_UNSIGNED_BYTE:
+		return normalized ? *p / 255.0f : (float)*p;
+	case GLTF_BYTE:
+	{
+		float value = (float)(int8_t)*p;
+		return normalized ? (value / 127.0f < -1.0f ? -1.0f : value / 127.0f) : value;
+	}
+	case GLTF_UNSIGNED_SHORT:
+	{
+		uint16_t value;
+		memcpy(&value, p, sizeof(value));
+		return normalized ? value / 65535.0f : (float)value;
+	}
+	case GLTF_SHORT:
+	{
+		int16_t value;
+		memcpy(&value, p, sizeof(value));
+		return normalized ? (value / 32767.0f < -1.0f ? -1.0f : value / 32767.0f) : (float)value;
+	}
+	case GLTF_UNSIGNED_INT:
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return (float)value;
+	}
+	default:
+		return 0.0f;
+	}
+}
+
+static uint32_t ReadIndex(const uint8_t* p, uint32_t componentType)
+{
+	switch (componentType)
+	{
+	case GLTF_UNSIGNED_BYTE:
+		return *p;
+	case GLTF_UNSIGNED_SHORT:
+	{
+		uint16_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+	default:
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+	}
+}
+
+static const char* ReadAccessor(const JsonDocument& doc, int root, const std::vector<GltfBuffer>& buffers, int64_t index, GltfAccessor* pAccessor)
+{
+	int accessor = doc.At(doc.Find(root, "accessors"), (uint32_t)index);
+	if (index < 0 || accessor < 0)
+	{
+		return "accessor index out of range";
+	}
+	if (doc.Find(accessor, "sparse") >= 0)
+	{
+		return "sparse accessors are not supported";
+	}
+
+	int64_t viewIndex = doc.GetIndex(doc.Find(accessor, "bufferView"));
+	int view = viewIndex >= 0 ? doc.At(doc.Find(root, "bufferViews"), (uint32_t)viewIndex) : -1;
+	if (view < 0)
+	{
+		return "accessors without buffer views are not supported";
+	}
+
+	int type = doc.Find(accessor, "type");
+	uint32_t componentCount = doc.Equals(type, "SCALAR") ? 1 : doc.Equals(type, "VEC2") ? 2
+		: doc.Equals(type, "VEC3") ? 3 : doc.Equals(type, "VEC4") ? 4 : 0;
+	uint32_t componentType = (uint32_t)doc.GetIndex(doc.Find(accessor, "componentType"));
+	uint32_t componentSize = GetComponentSize(componentType);
+	int64_t count = doc.GetIndex(doc.Find(accessor, "count"));
+	if (componentCount == 0 || componentSize == 0 || count < 0)
+	{
+		return "unsupported accessor type";
+	}
+
+	int64_t bufferIndex = doc.GetIndex(doc.Find(view, "buffer"));
+	if (bufferIndex < 0 || bufferIndex >= (int64_t)buffers.size())
+	{
+		return "buffer index out of range";
+	}
+	const GltfBuffer& buffer = buffers[(size_t)bufferIndex];
+
+	uint64_t elementSize = componentSize * componentCount;
+	uint64_t offset = (uint64_t)doc.GetNumber(doc.Find(view, "byteOffset"), 0) + (uint64_t)doc.GetNumber(doc.Find(accessor, "byteOffset"), 0);
+	uint64_t stride = (uint64_t)doc.GetNumber(doc.Find(view, "byteStride"), 0);
+	stride = stride != 0 ? stride : elementSize;
+	uint64_t viewEnd = (uint64_t)doc.GetNumber(doc.Find(view, "byteOffset"), 0) + (uint64_t)doc.GetNumber(doc.Find(view, "byteLength"), 0);
+	if (count > 0 && (offset + stride * (count - 1) + elementSize > viewEnd || viewEnd > buffer.size))
+	{
+		return "accessor exceeds its buffer";
+	}
+
+	pAccessor->pData = buffer.pData + offset;
+	pAccessor->count = (uint32_t)count;
+	pAccessor->stride = (uint32_t)stride;
+	pAccessor->componentType = componentType;
+	pAccessor->componentCount = componentCount;
+	pAccessor->normalized = doc.IsTrue(doc.Find(accessor, "normalized"));
+	return nullptr;
+}
+
+static void MultiplyMatrix(const float* a, const float* b, float* pOut)
+{
+	for (int c = 0; c < 4; c++)
+	{
+		for (int r = 0; r < 4; r++)
+		{
+			pOut[c * 4 + r] = a[r] * b[c * 4] + a[4 + r] * b[c * 4 + 1] + a[8 + r] * b[c * 4 + 2] + a[12 + r] * b[c * 4 + 3];
+		}
+	}
+}
+
+static void GetNodeMatrix(const JsonDocument& doc, int node, float* pMatrix)
+{
+	int matrix = doc.Find(node, "matrix");
+	if (doc.GetSize(matrix) == 16)
+	{
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			pMatrix[i] = (float)doc.GetNumber(doc.At(matrix, i), i % 5 == 0 ? 1.0 : 0.0);
+		}
+		return;
+	}
+
+	float t[3] = { 0, 0, 0 };
+	float q[4] = { 0, 0, 0, 1 };
+	float s[3] = { 1, 1, 1 };
+	int translation = doc.Find(node, "translation");
+	int rotation = doc.Find(node, "rotation");
+	int scale = doc.Find(node, "scale");
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		if (i < 3)
+		{
+			t[i] = (float)doc.GetNumber(doc.At(translation, i), t[i]);
+			s[i] = (float)doc.GetNumber(doc.At(scale, i), s[i]);
+		}
+		q[i] = (float)doc.GetNumber(doc.At(rotation, i), q[i]);
+	}
+
+	float x = q[0], y = q[1], z = q[2], w = q[3];
+	float r[3][3] = {
+		{ 1 - 2 * (y * y + z * z), 2 * (x * y - z * w), 2 * (x * z + y * w) },
+		{ 2 * (x * y + z * w), 1 - 2 * (x * x + z * z), 2 * (y * z - x * w) },
+		{ 2 * (x * z - y * w), 2 * (y * z + x * w), 1 - 2 * (x * x + y * y) }
+	};
+
+	for (int c = 0; c < 3; c++)
+	{
+		for (int row = 0; row < 3; row++)
+		{
+			pMatrix[c * 4 + row] = r[row][c] * s[c];
+		}
+		pMatrix[c * 4 + 3] = 0;
+		pMatrix[12 + c] = t[c];
+	}
+	pMatrix[15] = 1;
+}
+
+static void DecodeDraw(GltfDraw& draw, MeshData& mesh, std::vector<uint8_t>& hasNormal)
+{
+	const float* m = draw.matrix;
+	const float* n = draw.normalMatrix;
+	uint32_t vertexCount = draw.position.count;
+
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		MeshVertex& vertex = mesh.vertices[draw.firstVertex + i];
+
+		float p[3];
+		const uint8_t* pPosition = draw.position.pData + (size_t)i * draw.position.stride;
+		for (int c = 0; c < 3; c++)
+		{
+			p[c] = ReadComponent(pPosition + c * GetComponentSize(draw.position.componentType), draw.position.componentType, draw.position.normalized);
+		}
+		for (int row = 0; row < 3; row++)
+		{
+			vertex.position[row] = m[row] * p[0] + m[4 + row] * p[1] + m[8 + row] * p[2] + m[12 + row];
+		}
+		vertex.position[2] = -vertex.position[2];
+
+		if (draw.uv.pData != nullptr && i < draw.uv.count)
+		{
+			const uint8_t* pUV = draw.uv.pData + (size_t)i * draw.uv.stride;
+			uint32_t componentSize = GetComponentSize(draw.uv.componentType);
+			vertex.uv[0] = ReadComponent(pUV, draw.uv.componentType, draw.uv.normalized);
+			vertex.uv[1] = ReadComponent(pUV + componentSize, draw.uv.componentType, draw.uv.normalized);
+		}
+		else
+		{
+			vertex.uv[0] = 0;
+			vertex.uv[1] = 0;
+		}
+
+		if (draw.normal.pData != nullptr && i < draw.normal.count)
+		{
+			float v[3];
+			const uint8_t* pNormal = draw.normal.pData + (size_t)i * draw.normal.stride;
+			for (int c = 0; c < 3; c++)
+			{
+				v[c] = ReadComponent(pNormal + c * GetComponentSize(draw.normal.componentType), draw.normal.componentType, draw.normal.normalized);
+			}
+			float world[3];
+			for (int row = 0; row < 3; row++)
+			{
+				world[row] = n[row * 3] * v[0] + n[row * 3 + 1] * v[1] + n[row * 3 + 2] * v[2];
+			}
+			float length = sqrtf(world[0] * world[0] + world[1] * world[1] + world[2] * world[2]);
+			float scale = length > 0 ? 1.0f / length : 0.0f;
+			vertex.normal[0] = world[0] * scale;
+			vertex.normal[1] = world[1] * scale;
+			vertex.normal[2] = -world[2] * scale;
+			hasNormal[draw.firstVertex + i] = 1;
+		}
+		else
+		{
+			vertex.normal[0] = 0;
+			vertex.normal[1] = 0;
+			vertex.normal[2] = 0;
+			hasNormal[draw.firstVertex + i] = 0;
+		}
+	}
+
+	uint32_t* pIndices = mesh.indices.data() + draw.firstIndex;
+	for (uint32_t i = 0; i < draw.indexCount; i++)
+	{
+		uint32_t index = i;
+		if (draw.indices.pData != nullptr)
+		{
+			index = ReadIndex(draw.indices.pData + (size_t)i * draw.indices.stride, draw.indices.componentType);
+		}
+		if (index >= vertexCount)
+		{
+			draw.error = "vertex index out of range";
+			return;
+		}
+		pIndices[i] = draw.firstVertex + index;
+	}
+
+	// Counter-clockwise source order reversed to clockwise, unless a mirroring
+	// node transform has already reversed it
+	if (draw.flipWinding)
+	{
+		for (uint32_t i = 0; i + 2 < draw.indexCount; i += 3)
+		{
+			uint32_t temp = pIndices[i + 1];
+			pIndices[i + 1] = pIndices[i + 2];
+			pIndices[i + 2] = temp;
+		}
+	}
+}
+
+static bool DecodeBase64(const char* p, const char* pEnd, std::vector<uint8_t>& out)
+{
+	out.clear();
+	out.reserve((pEnd - p) / 4 * 3);
+
+	uint32_t bits = 0;
+	int bitCount = 0;
+	for (; p < pEnd && *p != '='; p++)
+	{
+		char c = *p;
+		int value = c >= 'A' && c <= 'Z' ? c - 'A' : c >= 'a' && c <= 'z' ? c - 'a' + 26
+			: c >= '0' && c <= '9' ? c - '0' + 52 : c == '+' ? 62 : c == '/' ? 63 : -1;
+		if (value < 0)
+		{
+			return false;
+		}
+		bits = (bits << 6) | value;
+		bitCount += 6;
+		if (bitCount >= 8)
+		{
+			bitCount -= 8;
+			out.push_back((uint8_t)(bits >> bitCount));
+		}
+	}
+	return true;
+}
+
+static std::string DecodeUri(const std::string& uri)
+{
+	std::string path;
+	for (size_t i = 0; i < uri.size(); i++)
+	{
+		if (uri[i] == '%' && i + 2 < uri.size())
+		{
+			path.push_back((char)strtol(uri.substr(i + 1, 2).c_str(), nullptr, 16));
+			i += 2;
+		}
+		else
+		{
+			path.push_back(uri[i]);
+		}
+	}
+	return path;
+}
+
+//
+// MeshImporter
+//
+
+MeshImporter::MeshImporter()
+	: m_workerCount(0)
+	, m_bytesParsed(0)
+{
+	m_error[0] = 0;
+	SetWorkerCount(0);
+}
+
+void MeshImporter::SetWorkerCount(uint32_t workerCount)
+{
+	m_workerCount = workerCount != 0 ? workerCount : std::thread::hardware_concurrency();
+	if (m_workerCount == 0)
+	{
+		m_workerCount = 1;
+	}
+}
+
+bool MeshImporter::Load(const char* path, MeshData& mesh)
+{
+	mesh.Clear();
+	m_error[0] = 0;
+	m_bytesParsed = 0;
+
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		return SetError("can not open the file");
+	}
+
+	std::string baseDir = path;
+	size_t slash = baseDir.find_last_of("/\\");
+	baseDir = slash != std::string::npos ? baseDir.substr(0, slash + 1) : std::string();
+
+	if (HasExtension(path, "obj"))
+	{
+		return LoadObj(file.GetData(), file.GetSize(), mesh);
+	}
+	if (HasExtension(path, "gltf"))
+	{
+		return LoadGltf(file.GetData(), file.GetSize(), baseDir.c_str(), mesh);
+	}
+	if (HasExtension(path, "glb"))
+	{
+		return LoadGlb(file.GetData(), file.GetSize(), baseDir.c_str(), mesh);
+	}
+	return SetError("unknown file extension");
+}
+
+void MeshImporter::ParseObjChunk(ObjChunk& chunk)
+{
+	const char* p = chunk.pBegin;
+	const char* pEnd = chunk.pEnd;
+
+	while (p < pEnd)
+	{
+		const char* pLineEnd = (const char*)memchr(p, '\n', pEnd - p);
+		pLineEnd = pLineEnd != nullptr ? pLineEnd : pEnd;
+
+		const char* pLine = SkipSpaces(p, pLineEnd);
+		p = pLineEnd + 1;
+
+		// Comments, groups, materials and everything else not needed are skipped
+		size_t length = pLineEnd - pLine;
+		if (length >= 2 && pLine[0] == 'v')
+		{
+			std::vector<float>* pTarget = &chunk.positions;
+			int count = 3;
+			if (length >= 3 && pLine[1] == 't' && IsSpace(pLine[2]))
+			{
+				pTarget = &chunk.uvs;
+				count = 2;
+			}
+			else if (length >= 3 && pLine[1] == 'n' && IsSpace(pLine[2]))
+			{
+				pTarget = &chunk.normals;
+			}
+			else if (!IsSpace(pLine[1]))
+			{
+				continue;
+			}
+
+			// Extra components like w or vertex colors are ignored, a missing texture v is 0
+			const char* pValue = pLine + 2;
+			for (int i = 0; i < count; i++)
+			{
+				float value = 0;
+				pValue = SkipSpaces(pValue, pLineEnd);
+				const char* pNext = ParseFloat(pValue, pLineEnd, &value);
+				if (pNext == nullptr && !(pTarget == &chunk.uvs && i == 1))
+				{
+					chunk.pErrorPos = pLine;
+					chunk.error = "invalid number";
+					return;
+				}
+				pValue = pNext != nullptr ? pNext : pValue;
+				pTarget->push_back(value);
+			}
+		}
+		else if (length >= 2 && pLine[0] == 'f' && IsSpace(pLine[1]))
+		{
+			const int32_t counts[3] = {
+				(int32_t)(chunk.positions.size() / 3),
+				(int32_t)(chunk.uvs.size() / 2),
+				(int32_t)(chunk.normals.size() / 3)
+			};
+
+			// Polygons are triangulated as fans
+			ObjCorner first = {};
+			ObjCorner prev = {};
+			uint32_t cornerCount = 0;
+			const char* pValue = pLine + 1;
+			for (;;)
+			{
+				pValue = SkipSpaces(pValue, pLineEnd);
+				if (pValue >= pLineEnd)
+				{
+					break;
+				}
+
+				ObjCorner corner = { { -1, -1, -1 }, 0 };
+				for (int a = 0; a < 3; a++)
+				{
+					if (a > 0)
+					{
+						if (pValue >= pLineEnd || *pValue != '/')
+						{
+							break;
+						}
+						pValue++;
+						if (a == 1 && pValue < pLineEnd && *pValue == '/')
+						{
+							continue;
+						}
+					}
+
+					int32_t value = 0;
+					const char* pNext = ParseInt(pValue, pLineEnd, &value);
+					if (pNext == nullptr || value == 0)
+					{
+						chunk.pErrorPos = pLine;
+						chunk.error = "invalid face index";
+						return;
+					}
+					if (value > 0)
+					{
+						corner.index[a] = value - 1;
+					}
+					else
+					{
+						// Relative to the end of the chunk so far, rebased after all chunks are parsed
+						corner.index[a] = counts[a] + value;
+						corner.relativeMask |= 1u << a;
+						chunk.hasRelative = true;
+					}
+					pValue = pNext;
+				}
+
+				if (cornerCount == 0)
+				{
+					first = corner;
+				}
+				else if (cornerCount >= 2)
+				{
+					// Counter-clockwise source order reversed to clockwise
+					chunk.corners.push_back(first);
+					chunk.corners.push_back(corner);
+					chunk.corners.push_back(prev);
+				}
+				prev = corner;
+				cornerCount++;
+			}
+
+			if (cornerCount < 3)
+			{
+				chunk.pErrorPos = pLine;
+				chunk.error = "face with less than 3 vertices";
+				return;
+			}
+		}
+	}
+}
+
+bool MeshImporter::LoadObj(const char* pData, size_t size, MeshData& mesh)
+{
+	mesh.Clear();
+	m_error[0] = 0;
+	m_bytesParsed = size;
+
+	// Chunks end right after a line break so no line is split
+	uint32_t workers = GetWorkerCount(size, MinObjBytesPerWorker);
+	std::vector<ObjChunk> chunks(workers);
+	const char* pBegin = pData;
+	const char* pEnd = pData + size;
+	for (uint32_t w = 0; w < workers; w++)
+	{
+		const char* pSplit = w + 1 == workers ? pEnd : pData + size / workers * (w + 1);
+		pSplit = pSplit > pBegin ? pSplit : pBegin;
+		if (pSplit < pEnd)
+		{
+			const char* pLineEnd = (const char*)memchr(pSplit, '\n', pEnd - pSplit);
+			pSplit = pLineEnd != nullptr ? pLineEnd + 1 : pEnd;
+		}
+
+		chunks[w].pBegin = pBegin;
+		chunks[w].pEnd = pSplit;
+		chunks[w].hasRelative = false;
+		chunks[w].pErrorPos = nullptr;
+		chunks[w].error = nullptr;
+		pBegin = pSplit;
+	}
+
+	std::vector<std::thread> threads;
+	for (uint32_t w = 1; w < workers; w++)
+	{
+		threads.push_back(std::thread(&MeshImporter::ParseObjChunk, this, std::ref(chunks[w])));
+	}
+	ParseObjChunk(chunks[0]);
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	for (const ObjChunk& chunk : chunks)
+	{
+		if (chunk.pErrorPos != nullptr)
+		{
+			// Lines are only counted for the message
+			uint32_t line = 1;
+			for (const char* p = pData; (p = (const char*)memchr(p, '\n', chunk.pErrorPos - p)) != nullptr; p++)
+			{
+				line++;
+			}
+			char message[128];
+			snprintf(message, sizeof(message), "%s at line %u", chunk.error, line);
+			return SetError(message);
+		}
+	}
+
+	// Concatenate attributes and rebase relative indices
+	size_t totals[3] = { 0, 0, 0 };
+	size_t cornerCount = 0;
+	for (const ObjChunk& chunk : chunks)
+	{
+		totals[0] += chunk.positions.size();
+		totals[1] += chunk.uvs.size();
+		totals[2] += chunk.normals.size();
+		cornerCount += chunk.corners.size();
+	}
+	if (totals[0] / 3 > 0x7FFFFFFF || totals[1] / 2 > 0x7FFFFFFF || totals[2] / 3 > 0x7FFFFFFF || cornerCount > 0xFFFFFFFF)
+	{
+		return SetError("mesh is too large");
+	}
+
+	std::vector<float> positions;
+	std::vector<float> uvs;
+	std::vector<float> normals;
+	positions.reserve(totals[0]);
+	uvs.reserve(totals[1]);
+	normals.reserve(totals[2]);
+	for (ObjChunk& chunk : chunks)
+	{
+		if (chunk.hasRelative)
+		{
+			const int32_t bases[3] = { (int32_t)(positions.size() / 3), (int32_t)(uvs.size() / 2), (int32_t)(normals.size() / 3) };
+			for (ObjCorner& corner : chunk.corners)
+			{
+				for (int a = 0; a < 3; a++)
+				{
+					corner.index[a] += (corner.relativeMask >> a) & 1 ? bases[a] : 0;
+				}
+			}
+		}
+
+		positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+		uvs.insert(uvs.end(), chunk.uvs.begin(), chunk.uvs.end());
+		normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+		std::vector<float>().swap(chunk.positions);
+		std::vector<float>().swap(chunk.uvs);
+		std::vector<float>().swap(chunk.normals);
+	}
+
+	const int32_t counts[3] = { (int32_t)(positions.size() / 3), (int32_t)(uvs.size() / 2), (int32_t)(normals.size() / 3) };
+
+	// Deduplicate corners into vertices. The hash map buckets are indexed by
+	// the position index itself and chain the vertices sharing it, faces
+	// reference nearby positions so bucket accesses stay mostly in cache.
+	std::vector<ObjCorner> keys;
+	std::vector<uint32_t> chain;
+	std::vector<uint32_t> buckets(counts[0], EmptySlot);
+	keys.reserve(counts[0] + 16);
+	chain.reserve(counts[0] + 16);
+
+	mesh.indices.resize(cornerCount);
+	size_t written = 0;
+	for (const ObjChunk& chunk : chunks)
+	{
+		for (const ObjCorner& corner : chunk.corners)
+		{
+			if (corner.index[0] < 0 || corner.index[0] >= counts[0]
+				|| corner.index[1] >= counts[1] || corner.index[2] >= counts[2]
+				|| (corner.index[1] < 0 && (corner.relativeMask & 2)) || (corner.index[2] < 0 && (corner.relativeMask & 4)))
+			{
+				return SetError("face index out of range");
+			}
+
+			uint32_t& bucket = buckets[corner.index[0]];
+			uint32_t vertex = bucket;
+			while (vertex != EmptySlot && (keys[vertex].index[1] != corner.index[1] || keys[vertex].index[2] != corner.index[2]))
+			{
+				vertex = chain[vertex];
+			}
+
+			if (vertex == EmptySlot)
+			{
+				vertex = (uint32_t)keys.size();
+				keys.push_back(corner);
+				chain.push_back(bucket);
+				bucket = vertex;
+			}
+			mesh.indices[written++] = vertex;
+		}
+	}
+
+	// Vertices in the order they were first referenced
+	mesh.vertices.resize(keys.size());
+	std::vector<uint8_t> hasNormal(keys.size());
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		const ObjCorner& key = keys[i];
+		MeshVertex& vertex = mesh.vertices[i];
+
+		const float* p = &positions[(size_t)key.index[0] * 3];
+		vertex.position[0] = p[0];
+		vertex.position[1] = p[1];
+		vertex.position[2] = -p[2];
+
+		if (key.index[1] >= 0)
+		{
+			vertex.uv[0] = uvs[(size_t)key.index[1] * 2];
+			vertex.uv[1] = 1.0f - uvs[(size_t)key.index[1] * 2 + 1];
+		}
+		else
+		{
+			vertex.uv[0] = 0;
+			vertex.uv[1] = 0;
+		}
+
+		hasNormal[i] = key.index[2] >= 0 ? 1 : 0;
+		if (hasNormal[i])
+		{
+			const float* n = &normals[(size_t)key.index[2] * 3];
+			vertex.normal[0] = n[0];
+			vertex.normal[1] = n[1];
+			vertex.normal[2] = -n[2];
+		}
+		else
+		{
+			vertex.normal[0] = 0;
+			vertex.normal[1] = 0;
+			vertex.normal[2] = 0;
+		}
+	}
+
+	FinishMesh(mesh, hasNormal);
+	return true;
+}
+
+bool MeshImporter::LoadGltf(const char* pJson, size_t size, const char* baseDir, MeshData& mesh)
+{
+	mesh.Clear();
+	m_error[0] = 0;
+	m_bytesParsed = size;
+
+	return LoadGltfDocument(pJson, size, baseDir, nullptr, 0, mesh);
+}
+
+bool MeshImporter::LoadGlb(const char* pData, size_t size, const char* baseDir, MeshData& mesh)
+{
+	mesh.Clear();
+	m_error[0] = 0;
+	m_bytesParsed = size;
+
+	uint32_t header[3];
+	if (size < sizeof(header) + 8)
+	{
+		return SetError("file is too small for a binary glTF");
+	}
+	memcpy(header, pData, sizeof(header));
+	if (header[0] != GlbMagic || header[1] != 2 || header[2] > size)
+	{
+		return SetError("not a binary glTF 2.0 file");
+	}
+
+	// JSON chunk comes first, an optional BIN chunk follows
+	const char* pJson = nullptr;
+	uint32_t jsonSize = 0;
+	const uint8_t* pBin = nullptr;
+	uint32_t binSize = 0;
+	size_t offset = sizeof(header);
+	while (offset + 8 <= header[2])
+	{
+		uint32_t chunk[2];
+		memcpy(chunk, pData + offset, sizeof(chunk));
+		offset += sizeof(chunk);
+		if (chunk[0] > header[2] - offset)
+		{
+			return SetError("chunk exceeds the file");
+		}
+
+		if (chunk[1] == GlbChunkJson && pJson == nullptr)
+		{
+			pJson = pData + offset;
+			jsonSize = chunk[0];
+		}
+		else if (chunk[1] == GlbChunkBin && pBin == nullptr)
+		{
+			pBin = (const uint8_t*)pData + offset;
+			binSize = chunk[0];
+		}
+		offset += (chunk[0] + 3) & ~3u;
+	}
+	if (pJson == nullptr)
+	{
+		return SetError("binary glTF has no JSON chunk");
+	}
+
+	return LoadGltfDocument(pJson, jsonSize, baseDir, pBin, binSize, mesh);
+}
+
+bool MeshImporter::LoadGltfDocument(const char* pJson, size_t size, const char* baseDir, const uint8_t* pBin, size_t binSize, MeshData& mesh)
+{
+	JsonDocument doc;
+	if (!doc.Parse(pJson, size))
+	{
+		return SetError("invalid JSON");
+	}
+	const int root = 0;
+
+	// Resolve buffers: the GLB chunk, external files or base64 data URIs
+	int bufferArray = doc.Find(root, "buffers");
+	std::vector<GltfBuffer> buffers(doc.GetSize(bufferArray));
+	std::vector<std::unique_ptr<MappedFile>> files;
+	std::vector<std::vector<uint8_t>> decoded;
+	decoded.reserve(buffers.size());
+	for (uint32_t i = 0; i < buffers.size(); i++)
+	{
+		int buffer = doc.At(bufferArray, i);
+		int uri = doc.Find(buffer, "uri");
+		if (uri < 0)
+		{
+			if (i != 0 || pBin == nullptr)
+			{
+				return SetError("buffer without data");
+			}
+			buffers[i].pData = pBin;
+			buffers[i].size = binSize;
+			continue;
+		}
+
+		std::string path = doc.GetString(uri);
+		if (path.compare(0, 5, "data:") == 0)
+		{
+			size_t comma = path.find(";base64,");
+			decoded.push_back(std::vector<uint8_t>());
+			if (comma == std::string::npos || !DecodeBase64(path.c_str() + comma + 8, path.c_str() + path.size(), decoded.back()))
+			{
+				return SetError("unsupported data URI");
+			}
+			buffers[i].pData = decoded.back().data();
+			buffers[i].size = decoded.back().size();
+		}
+		else
+		{
+			files.push_back(std::unique_ptr<MappedFile>(new MappedFile()));
+			if (!files.back()->Open((std::string(baseDir) + DecodeUri(path)).c_str()))
+			{
+				return SetError("can not open an external buffer");
+			}
+			buffers[i].pData = (const uint8_t*)files.back()->GetData();
+			buffers[i].size = files.back()->GetSize();
+		}
+		m_bytesParsed += buffers[i].size;
+	}
+
+	// Walk the default scene, node transforms are accumulated on an explicit stack
+	struct NodeEntry
+	{
+		int node;
+		float matrix[16];
+	};
+	std::vector<NodeEntry> stack;
+	std::vector<std::pair<int, NodeEntry>> placedMeshes;
+
+	int meshArray = doc.Find(root, "meshes");
+	int nodeArray = doc.Find(root, "nodes");
+	int sceneArray = doc.Find(root, "scenes");
+	int64_t sceneIndex = doc.GetIndex(doc.Find(root, "scene"));
+	int scene = doc.At(sceneArray, sceneIndex >= 0 ? (uint32_t)sceneIndex : 0);
+
+	static const float Identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+	if (scene >= 0)
+	{
+		int roots = doc.Find(scene, "nodes");
+		for (uint32_t i = 0; i < doc.GetSize(roots); i++)
+		{
+			NodeEntry entry;
+			int64_t nodeIndex = doc.GetIndex(doc.At(roots, i));
+			entry.node = nodeIndex >= 0 ? doc.At(nodeArray, (uint32_t)nodeIndex) : -1;
+			memcpy(entry.matrix, Identity, sizeof(Identity));
+			stack.push_back(entry);
+		}
+
+		uint32_t visited = 0;
+		while (!stack.empty())
+		{
+			NodeEntry parent = stack.back();
+			stack.pop_back();
+			if (parent.node < 0)
+			{
+				return SetError("node index out of range");
+			}
+			if (++visited > doc.GetSize(nodeArray))
+			{
+				return SetError("node hierarchy is not a tree");
+			}
+
+			float local[16];
+			NodeEntry entry;
+			entry.node = parent.node;
+			GetNodeMatrix(doc, parent.node, local);
+			MultiplyMatrix(parent.matrix, local, entry.matrix);
+
+			int64_t meshIndex = doc.GetIndex(doc.Find(parent.node, "mesh"));
+			if (meshIndex >= 0)
+			{
+				placedMeshes.push_back(std::make_pair(doc.At(meshArray, (uint32_t)meshIndex), entry));
+			}
+
+			int children = doc.Find(parent.node, "children");
+			for (uint32_t i = 0; i < doc.GetSize(children); i++)
+			{
+				NodeEntry child;
+				int64_t childIndex = doc.GetIndex(doc.At(children, i));
+				child.node = childIndex >= 0 ? doc.At(nodeArray, (uint32_t)childIndex) : -1;
+				memcpy(child.matrix, entry.matrix, sizeof(entry.matrix));
+				stack.push_back(child);
+			}
+		}
+	}
+	else
+	{
+		// No scene, every mesh once in its own space
+		for (uint32_t i = 0; i < doc.GetSize(meshArray); i++)
+		{
+			NodeEntry entry;
+			entry.node = -1;
+			memcpy(entry.matrix, Identity, sizeof(Identity));
+			placedMeshes.push_back(std::make_pair(doc.At(meshArray, i), entry));
+		}
+	}
+
+	// Resolve accessors and output ranges of every placed triangle primitive
+	std::vector<GltfDraw> draws;
+	uint64_t vertexTotal = 0;
+	uint64_t indexTotal = 0;
+	for (const std::pair<int, NodeEntry>& placed : placedMeshes)
+	{
+		if (placed.first < 0)
+		{
+			return SetError("mesh index out of range");
+		}
+
+		int primitives = doc.Find(placed.first, "primitives");
+		for (uint32_t p = 0; p < doc.GetSize(primitives); p++)
+		{
+			int primitive = doc.At(primitives, p);
+			if (doc.GetNumber(doc.Find(primitive, "mode"), GltfModeTriangles) != GltfModeTriangles)
+			{
+				// Points, lines and strips are skipped
+				continue;
+			}
+
+			GltfDraw draw;
+			memset(&draw, 0, sizeof(draw));
+
+			int attributes = doc.Find(primitive, "attributes");
+			int position = doc.Find(attributes, "POSITION");
+			if (position < 0)
+			{
+				continue;
+			}
+
+			const char* error = ReadAccessor(doc, root, buffers, doc.GetIndex(position), &draw.position);
+			if (error == nullptr && doc.Find(attributes, "NORMAL") >= 0)
+			{
+				error = ReadAccessor(doc, root, buffers, doc.GetIndex(doc.Find(attributes, "NORMAL")), &draw.normal);
+			}
+			if (error == nullptr && doc.Find(attributes, "TEXCOORD_0") >= 0)
+			{
+				error = ReadAccessor(doc, root, buffers, doc.GetIndex(doc.Find(attributes, "TEXCOORD_0")), &draw.uv);
+			}
+			if (error == nullptr && doc.Find(primitive, "indices") >= 0)
+			{
+				error = ReadAccessor(doc, root, buffers, doc.GetIndex(doc.Find(primitive, "indices")), &draw.indices);
+				if (error == nullptr && (draw.indices.componentCount != 1 || draw.indices.componentType == GLTF_FLOAT
+					|| draw.indices.componentType == GLTF_BYTE || draw.indices.componentType == GLTF_SHORT))
+				{
+					error = "invalid index accessor";
+				}
+			}
+			if (error == nullptr && (draw.position.componentCount < 3 || (draw.normal.pData != nullptr && draw.normal.componentCount < 3)
+				|| (draw.uv.pData != nullptr && draw.uv.componentCount < 2)))
+			{
+				error = "invalid attribute accessor";
+			}
+			if (error != nullptr)
+			{
+				return SetError(error);
+			}
+
+			memcpy(draw.matrix, placed.second.matrix, sizeof(draw.matrix));
+
+			// Normals go through the cofactor matrix, same as the inverse
+			// transpose up to a scale that normalization removes
+			const float* m = draw.matrix;
+			float a[3][3] = {
+				{ m[0], m[4], m[8] },
+				{ m[1], m[5], m[9] },
+				{ m[2], m[6], m[10] }
+			};
+			for (int r = 0; r < 3; r++)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					int r1 = (r + 1) % 3, r2 = (r + 2) % 3;
+					int c1 = (c + 1) % 3, c2 = (c + 2) % 3;
+					draw.normalMatrix[r * 3 + c] = a[r1][c1] * a[r2][c2] - a[r1][c2] * a[r2][c1];
+				}
+			}
+			float determinant = a[0][0] * draw.normalMatrix[0] + a[0][1] * draw.normalMatrix[1] + a[0][2] * draw.normalMatrix[2];
+			draw.flipWinding = determinant >= 0;
+			if (determinant < 0)
+			{
+				for (int i = 0; i < 9; i++)
+				{
+					draw.normalMatrix[i] = -draw.normalMatrix[i];
+				}
+			}
+
+			draw.indexCount = draw.indices.pData != nullptr ? draw.indices.count : draw.position.count;
+			draw.indexCount -= draw.indexCount % 3;
+			draw.firstVertex = (uint32_t)vertexTotal;
+			draw.firstIndex = (uint32_t)indexTotal;
+			vertexTotal += draw.position.count;
+			indexTotal += draw.indexCount;
+			if (vertexTotal > 0xFFFFFFFF || indexTotal > 0xFFFFFFFF)
+			{
+				return SetError("mesh is too large");
+			}
+
+			draws.push_back(draw);
+		}
+	}
+
+	mesh.vertices.resize((size_t)vertexTotal);
+	mesh.indices.resize((size_t)indexTotal);
+	std::vector<uint8_t> hasNormal((size_t)vertexTotal);
+
+	// Workers take primitives one by one, output ranges do not overlap
+	uint32_t workers = GetWorkerCount((size_t)vertexTotal, MinGltfVerticesPerWorker);
+	workers = workers < draws.size() ? workers : (uint32_t)(draws.size() > 0 ? draws.size() : 1);
+	std::atomic<uint32_t> nextDraw(0);
+	auto decode = [&]()
+	{
+		for (uint32_t i = nextDraw++; i < draws.size(); i = nextDraw++)
+		{
+			DecodeDraw(draws[i], mesh, hasNormal);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (uint32_t w = 1; w < workers; w++)
+	{
+		threads.push_back(std::thread(decode));
+	}
+	decode();
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	for (const GltfDraw& draw : draws)
+	{
+		if (draw.error != nullptr)
+		{
+			return SetError(draw.error);
+		}
+	}
+
+	FinishMesh(mesh, hasNormal);
+	return true;
+}
+
+const char* MeshImporter::GetErrorMessage() const
+{
+	return m_error;
+}
+
+uint64_t MeshImporter::GetBytesParsed() const
+{
+	return m_bytesParsed;
+}
+
+bool MeshImporter::SetError(const char* message)
+{
+	snprintf(m_error, sizeof(m_error), "%s", message);
+	return false;
+}
+
+uint32_t MeshImporter::GetWorkerCount(size_t items, size_t minItemsPerWorker) const
+{
+	size_t workers = items / minItemsPerWorker;
+	workers = workers < m_workerCount ? workers : m_workerCount;
+	return workers > 1 ? (uint32_t)workers : 1;
+}
+
+void MeshImporter::FinishMesh(MeshData& mesh, const std::vector<uint8_t>& hasNormal)
+{
+	// Vertices without normals get the area weighted sum of their faces,
+	// clockwise front faces in the left-handed output space
+	bool missing = false;
+	for (uint8_t has : hasNormal)
+	{
+		missing = missing || has == 0;
+	}
+	if (missing)
+	{
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+		{
+			MeshVertex* v[3] = { &mesh.vertices[mesh.indices[i]], &mesh.vertices[mesh.indices[i + 1]], &mesh.vertices[mesh.indices[i + 2]] };
+			float e1[3], e2[3];
+			for (int c = 0; c < 3; c++)
+			{
+				e1[c] = v[1]->position[c] - v[0]->position[c];
+				e2[c] = v[2]->position[c] - v[0]->position[c];
+			}
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			for (int k = 0; k < 3; k++)
+			{
+				if (!hasNormal[mesh.indices[i + k]])
+				{
+					v[k]->normal[0] += n[0];
+					v[k]->normal[1] += n[1];
+					v[k]->normal[2] += n[2];
+				}
+			}
+		}
+		for (size_t i = 0; i < mesh.vertices.size(); i++)
+		{
+			if (!hasNormal[i])
+			{
+				float* n = mesh.vertices[i].normal;
+				float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				float scale = length > 0 ? 1.0f / length : 0.0f;
+				n[0] *= scale;
+				n[1] *= scale;
+				n[2] *= scale;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < mesh.vertices.size(); i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			float value = mesh.vertices[i].position[c];
+			if (i == 0 || value < mesh.boundsMin[c])
+			{
+				mesh.boundsMin[c] = value;
+			}
+			if (i == 0 || value > mesh.boundsMax[c])
+			{
+				mesh.boundsMax[c] = value;
+			}
+		}
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Vertex in the renderer's TextureVertex attribute order
+struct MeshVertex
+{
+	float position[3];
+	float uv[2];
+	float normal[3];
+};
+
+struct MeshData
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices; // triangle list
+
+	float boundsMin[3];
+	float boundsMax[3];
+
+	void Clear();
+};
+
+// Loads OBJ and glTF 2.0 (.gltf with external or data URI buffers, .glb)
+// triangle meshes from memory mapped files. OBJ text is parsed in parallel
+// chunks split at line ends, glTF primitives are decoded in parallel.
+// Output is converted to the renderer's conventions: left-handed with Z
+// negated and triangles reversed to clockwise, texture V pointing down. glTF node
+// transforms of the default scene are applied. Materials are ignored.
+class MeshImporter
+{
+public:
+	MeshImporter();
+
+	// 0 uses the hardware thread count
+	void SetWorkerCount(uint32_t workerCount);
+
+	// Format is chosen by the extension
+	bool Load(const char* path, MeshData& mesh);
+
+	bool LoadObj(const char* pData, size_t size, MeshData& mesh);
+	// baseDir is prepended to external buffer URIs, may be empty
+	bool LoadGltf(const char* pJson, size_t size, const char* baseDir, MeshData& mesh);
+	bool LoadGlb(const char* pData, size_t size, const char* baseDir, MeshData& mesh);
+
+	// Reason of the last failed load
+	const char* GetErrorMessage() const;
+
+	// Source bytes read by the last load, external glTF buffers included
+	uint64_t GetBytesParsed() const;
+
+private:
+	struct ObjCorner
+	{
+		int32_t index[3]; // position, uv, normal, -1 if absent
+		uint32_t relativeMask; // indices relative to the chunk start
+	};
+
+	struct ObjChunk
+	{
+		const char* pBegin;
+		const char* pEnd;
+
+		std::vector<float> positions;
+		std::vector<float> uvs;
+		std::vector<float> normals;
+		std::vector<ObjCorner> corners;
+		bool hasRelative;
+
+		const char* pErrorPos; // nullptr when parsed
+		const char* error;
+	};
+
+	void ParseObjChunk(ObjChunk& chunk);
+	bool LoadGltfDocument(const char* pJson, size_t size, const char* baseDir, const uint8_t* pBin, size_t binSize, MeshData& mesh);
+	bool SetError(const char* message);
+	uint32_t GetWorkerCount(size_t items, size_t minItemsPerWorker) const;
+
+	static void FinishMesh(MeshData& mesh, const std::vector<uint8_t>& hasNormal);
+
+private:
+	uint32_t m_workerCount;
+	uint64_t m_bytesParsed;
+	char m_error[256];
+};
@@ -0,0 +1,487 @@
+#include "MeshOptimizer.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+// Forsyth's scoring, tuned for a 32 entry LRU
+static const uint32_t OptimizerCacheSize = 32;
+static const uint32_t MaxScoredValence = 32;
+static const float CacheDecayPower = 1.5f;
+static const float LastTriangleScore = 0.75f;
+static const float ValenceBoostScale = 2.0f;
+static const float ValenceBoostPower = 0.5f;
+
+// Cache used to find cluster boundaries, close to common post-transform caches
+static const uint32_t OverdrawCacheSize = 16;
+
+static const uint32_t InvalidIndex = 0xFFFFFFFF;
+
+struct VertexScoreTable
+{
+	float cache[OptimizerCacheSize];
+	float valence[MaxScoredValence + 1];
+
+	VertexScoreTable()
+	{
+		for (uint32_t i = 0; i < OptimizerCacheSize; i++)
+		{
+			// The last triangle's vertices get a fixed score so it is not simply continued as a strip
+			cache[i] = i < 3 ? LastTriangleScore
+				: powf(1.0f - (float)(i - 3) / (OptimizerCacheSize - 3), CacheDecayPower);
+		}
+		valence[0] = 0;
+		for (uint32_t i = 1; i <= MaxScoredValence; i++)
+		{
+			valence[i] = ValenceBoostScale * powf((float)i, -ValenceBoostPower);
+		}
+	}
+
+	float Score(int32_t cachePosition, uint32_t remainingValence) const
+	{
+		if (remainingValence == 0)
+		{
+			return -1.0f;
+		}
+		float score = cachePosition >= 0 ? cache[cachePosition] : 0.0f;
+		return score + valence[remainingValence < MaxScoredValence ? remainingValence : MaxScoredValence];
+	}
+};
+
+void MeshOptimizer::OptimizeVertexCache(uint32_t* pIndices, size_t indexCount, uint32_t vertexCount)
+{
+	assert(indexCount % 3 == 0);
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount < 2)
+	{
+		return;
+	}
+
+	static const VertexScoreTable scores;
+
+	// Triangles of each vertex, the live ones are kept at the front of the range
+	std::vector<uint32_t> valence(vertexCount, 0);
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		assert(pIndices[i] < vertexCount);
+		valence[pIndices[i]]++;
+	}
+	std::vector<uint32_t> offsets(vertexCount);
+	uint32_t offset = 0;
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		offsets[v] = offset;
+		offset += valence[v];
+	}
+	std::vector<uint32_t> adjacency(indexCount);
+	std::vector<uint32_t> fill(offsets);
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		adjacency[fill[pIndices[i]]++] = (uint32_t)(i / 3);
+	}
+
+	std::vector<int32_t> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		vertexScore[v] = scores.Score(-1, valence[v]);
+	}
+
+	std::vector<float> triangleScore(triangleCount);
+	uint32_t best = 0;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		const uint32_t* tri = pIndices + t * 3;
+		triangleScore[t] = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+		best = triangleScore[t] > triangleScore[best] ? (uint32_t)t : best;
+	}
+
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint32_t> output(indexCount);
+
+	uint32_t cache[OptimizerCacheSize + 3];
+	uint32_t cacheCount = 0;
+	size_t deadEndCursor = 0;
+
+	for (size_t written = 0; written < triangleCount; written++)
+	{
+		if (best == InvalidIndex)
+		{
+			// Nothing left next to the cache, restart from the next triangle in input order
+			while (emitted[deadEndCursor])
+			{
+				deadEndCursor++;
+			}
+			best = (uint32_t)deadEndCursor;
+		}
+
+		const uint32_t* tri = pIndices + (size_t)best * 3;
+		memcpy(&output[written * 3], tri, 3 * sizeof(uint32_t));
+		emitted[best] = 1;
+
+		// Retire the triangle from its vertices
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t v = tri[k];
+			uint32_t* pBegin = &adjacency[offsets[v]];
+			uint32_t* pLast = pBegin + valence[v] - 1;
+			for (uint32_t* p = pBegin; p <= pLast; p++)
+			{
+				if (*p == best)
+				{
+					*p = *pLast;
+					*pLast = best;
+					valence[v]--;
+					break;
+				}
+			}
+		}
+
+		// Move the triangle's vertices to the front, overflowing entries fall out
+		uint32_t newCache[OptimizerCacheSize + 3];
+		uint32_t newCount = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			if (newCount == 0 || (tri[k] != newCache[0] && (newCount < 2 || tri[k] != newCache[1])))
+			{
+				newCache[newCount++] = tri[k];
+			}
+		}
+		for (uint32_t i = 0; i < cacheCount; i++)
+		{
+			uint32_t v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+			{
+				newCache[newCount++] = v;
+			}
+		}
+
+		for (uint32_t i = 0; i < newCount; i++)
+		{
+			cachePosition[newCache[i]] = i < OptimizerCacheSize ? (int32_t)i : -1;
+		}
+
+		// Rescore touched vertices and their live triangles
+		for (uint32_t i = 0; i < newCount; i++)
+		{
+			uint32_t v = newCache[i];
+			float score = scores.Score(cachePosition[v], valence[v]);
+			float delta = score - vertexScore[v];
+			vertexScore[v] = score;
+
+			const uint32_t* pTriangles = &adjacency[offsets[v]];
+			for (uint32_t j = 0; j < valence[v]; j++)
+			{
+				triangleScore[pTriangles[j]] += delta;
+			}
+		}
+
+		cacheCount = newCount < OptimizerCacheSize ? newCount : OptimizerCacheSize;
+		memcpy(cache, newCache, cacheCount * sizeof(uint32_t));
+
+		// Next triangle is the best one touching the cache
+		best = InvalidIndex;
+		float bestScore = -1e30f;
+		for (uint32_t i = 0; i < cacheCount; i++)
+		{
+			uint32_t v = cache[i];
+			const uint32_t* pTriangles = &adjacency[offsets[v]];
+			for (uint32_t j = 0; j < valence[v]; j++)
+			{
+				if (triangleScore[pTriangles[j]] > bestScore)
+				{
+					bestScore = triangleScore[pTriangles[j]];
+					best = pTriangles[j];
+				}
+			}
+		}
+	}
+
+	memcpy(pIndices, output.data(), indexCount * sizeof(uint32_t));
+}
+
+// Misses of a FIFO cache over triangles [begin, end), the cache starts cold
+static uint32_t CountFifoMisses(const uint32_t* pIndices, size_t begin, size_t end, std::vector<uint32_t>& timestamps, uint32_t& time)
+{
+	// Starting far ahead makes every earlier stamp a miss
+	time += OverdrawCacheSize + 1;
+	uint32_t misses = 0;
+	for (size_t i = begin * 3; i < end * 3; i++)
+	{
+		uint32_t v = pIndices[i];
+		if (time - timestamps[v] >= OverdrawCacheSize)
+		{
+			timestamps[v] = ++time;
+			misses++;
+		}
+	}
+	return misses;
+}
+
+void MeshOptimizer::OptimizeOverdraw(uint32_t* pIndices, size_t indexCount, const float* pPositions, size_t positionStride,
+	uint32_t vertexCount, float threshold)
+{
+	assert(indexCount % 3 == 0);
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount < 2)
+	{
+		return;
+	}
+
+	// Hard boundaries: triangles with all three vertices missing in the cache
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time = OverdrawCacheSize + 1;
+	std::vector<size_t> hard;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		uint32_t misses = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t v = pIndices[t * 3 + k];
+			if (time - timestamps[v] >= OverdrawCacheSize)
+			{
+				timestamps[v] = ++time;
+				misses++;
+			}
+		}
+		if (misses == 3 || t == 0)
+		{
+			hard.push_back(t);
+		}
+	}
+	hard.push_back(triangleCount);
+
+	// Soft boundaries: cut a hard cluster as soon as the run so far, started
+	// with a cold cache, is within threshold of the whole cluster's ACMR
+	std::vector<size_t> clusters;
+	for (size_t h = 0; h + 1 < hard.size(); h++)
+	{
+		size_t begin = hard[h];
+		size_t end = hard[h + 1];
+		float clusterAcmr = (float)CountFifoMisses(pIndices, begin, end, timestamps, time) / (end - begin);
+
+		time += OverdrawCacheSize + 1;
+		size_t start = begin;
+		uint32_t misses = 0;
+		for (size_t t = begin; t < end; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t v = pIndices[t * 3 + k];
+				if (time - timestamps[v] >= OverdrawCacheSize)
+				{
+					timestamps[v] = ++time;
+					misses++;
+				}
+			}
+
+			if ((float)misses / (t + 1 - start) <= clusterAcmr * threshold && t + 1 < end)
+			{
+				clusters.push_back(start);
+				start = t + 1;
+				misses = 0;
+				time += OverdrawCacheSize + 1;
+			}
+		}
+		clusters.push_back(start);
+	}
+	clusters.push_back(triangleCount);
+
+	// Area weighted centroid and normal of each cluster
+	struct Cluster
+	{
+		size_t begin;
+		size_t end;
+		float centroid[3];
+		float normal[3];
+		float area;
+		float sortKey;
+	};
+	std::vector<Cluster> sorted(clusters.size() - 1);
+
+	float meshCentroid[3] = { 0, 0, 0 };
+	float meshArea = 0;
+	for (size_t c = 0; c + 1 < clusters.size(); c++)
+	{
+		Cluster& cluster = sorted[c];
+		cluster.begin = clusters[c];
+		cluster.end = clusters[c + 1];
+		cluster.area = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			cluster.centroid[i] = 0;
+			cluster.normal[i] = 0;
+		}
+
+		for (size_t t = cluster.begin; t < cluster.end; t++)
+		{
+			const float* p[3];
+			for (int k = 0; k < 3; k++)
+			{
+				p[k] = (const float*)((const uint8_t*)pPositions + pIndices[t * 3 + k] * positionStride);
+			}
+			float e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+			float e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			float area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+			for (int i = 0; i < 3; i++)
+			{
+				cluster.centroid[i] += (p[0][i] + p[1][i] + p[2][i]) * (area / 3.0f);
+				cluster.normal[i] += n[i];
+			}
+			cluster.area += area;
+		}
+
+		float invArea = cluster.area > 0 ? 1.0f / cluster.area : 0.0f;
+		for (int i = 0; i < 3; i++)
+		{
+			meshCentroid[i] += cluster.centroid[i];
+			cluster.centroid[i] *= invArea;
+		}
+		meshArea += cluster.area;
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		meshCentroid[i] = meshArea > 0 ? meshCentroid[i] / meshArea : 0.0f;
+	}
+
+	// Clusters facing away from the center are more likely to occlude others
+	for (Cluster& cluster : sorted)
+	{
+		float length = sqrtf(cluster.normal[0] * cluster.normal[0] + cluster.normal[1] * cluster.normal[1] + cluster.normal[2] * cluster.normal[2]);
+		float invLength = length > 0 ? 1.0f / length : 0.0f;
+		cluster.sortKey = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			cluster.sortKey += (cluster.centroid[i] - meshCentroid[i]) * cluster.normal[i] * invLength;
+		}
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b)
+	{
+		return a.sortKey > b.sortKey;
+	});
+
+	std::vector<uint32_t> output;
+	output.reserve(indexCount);
+	for (const Cluster& cluster : sorted)
+	{
+		output.insert(output.end(), pIndices + cluster.begin * 3, pIndices + cluster.end * 3);
+	}
+	memcpy(pIndices, output.data(), indexCount * sizeof(uint32_t));
+}
+
+uint32_t MeshOptimizer::OptimizeVertexFetch(void* pVertices, uint32_t* pIndices, size_t indexCount, uint32_t vertexCount, size_t vertexSize)
+{
+	std::vector<uint32_t> remap(vertexCount, InvalidIndex);
+	std::vector<uint8_t> reordered((size_t)vertexCount * vertexSize);
+
+	uint32_t next = 0;
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		uint32_t v = pIndices[i];
+		assert(v < vertexCount);
+		if (remap[v] == InvalidIndex)
+		{
+			memcpy(&reordered[(size_t)next * vertexSize], (const uint8_t*)pVertices + (size_t)v * vertexSize, vertexSize);
+			remap[v] = next++;
+		}
+		pIndices[i] = remap[v];
+	}
+
+	memcpy(pVertices, reordered.data(), (size_t)next * vertexSize);
+	return next;
+}
+
+MeshOptimizer::VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const uint32_t* pIndices, size_t indexCount, uint32_t vertexCount,
+	uint32_t cacheSize, CacheModel model)
+{
+	VertexCacheStats stats = { 0, 0, 0 };
+
+	std::vector<uint8_t> referenced(vertexCount, 0);
+	uint32_t referencedCount = 0;
+
+	// FIFO by insertion stamps, the last cacheSize stamps are cached, LRU by
+	// moving hits to the front
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time = cacheSize + 1;
+	std::vector<uint32_t> lru;
+	lru.reserve(cacheSize + 1);
+
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		uint32_t v = pIndices[i];
+		assert(v < vertexCount);
+
+		referencedCount += referenced[v] ? 0 : 1;
+		referenced[v] = 1;
+
+		if (model == CACHE_FIFO)
+		{
+			if (time - timestamps[v] >= cacheSize)
+			{
+				timestamps[v] = ++time;
+				stats.transformed++;
+			}
+		}
+		else
+		{
+			std::vector<uint32_t>::iterator it = std::find(lru.begin(), lru.end(), v);
+			if (it == lru.end())
+			{
+				stats.transformed++;
+				if (lru.size() == cacheSize)
+				{
+					lru.pop_back();
+				}
+				lru.insert(lru.begin(), v);
+			}
+			else
+			{
+				std::rotate(lru.begin(), it, it + 1);
+			}
+		}
+	}
+
+	size_t triangleCount = indexCount / 3;
+	stats.acmr = triangleCount > 0 ? (float)stats.transformed / triangleCount : 0.0f;
+	stats.atvr = referencedCount > 0 ? (float)stats.transformed / referencedCount : 0.0f;
+	return stats;
+}
+
+float MeshOptimizer::AnalyzeVertexFetch(const uint32_t* pIndices, size_t indexCount, uint32_t vertexCount, size_t vertexSize)
+{
+	static const uint32_t LineSize = 64;
+	static const uint32_t LineCount = 256;
+
+	uint64_t tags[LineCount];
+	for (uint32_t i = 0; i < LineCount; i++)
+	{
+		tags[i] = ~0ull;
+	}
+
+	std::vector<uint8_t> referenced(vertexCount, 0);
+	uint64_t referencedBytes = 0;
+	uint64_t fetchedBytes = 0;
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		uint32_t v = pIndices[i];
+		referencedBytes += referenced[v] ? 0 : vertexSize;
+		referenced[v] = 1;
+
+		uint64_t first = (uint64_t)v * vertexSize / LineSize;
+		uint64_t last = ((uint64_t)v * vertexSize + vertexSize - 1) / LineSize;
+		for (uint64_t line = first; line <= last; line++)
+		{
+			if (tags[line % LineCount] != line)
+			{
+				tags[line % LineCount] = line;
+				fetchedBytes += LineSize;
+			}
+		}
+	}
+
+	return referencedBytes > 0 ? (float)fetchedBytes / referencedBytes : 0.0f;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Index and vertex order optimizations for triangle lists. Typical use is
+// vertex cache, then overdraw, then vertex fetch, each step keeps most of
+// what the previous one gained.
+class MeshOptimizer
+{
+public:
+	enum CacheModel
+	{
+		CACHE_FIFO = 0,
+		CACHE_LRU
+	};
+
+	struct VertexCacheStats
+	{
+		uint32_t transformed; // vertex shader invocations
+		float acmr; // transformed per triangle, 0.5 is ideal for large grids
+		float atvr; // transformed per referenced vertex, 1.0 is ideal
+	};
+
+	// Forsyth's linear-speed reordering against a 32 entry LRU cache
+	static void OptimizeVertexCache(uint32_t* pIndices, size_t indexCount, uint32_t vertexCount);
+
+	// Splits the cache optimized order into clusters at points where the cache
+	// would be mostly cold anyway, keeping each cluster's ACMR within threshold
+	// (1.05 is 5% worse) of its uncut run, and draws outward-facing clusters
+	// first so they occlude the rest. positionStride is in bytes.
+	static void OptimizeOverdraw(uint32_t* pIndices, size_t indexCount, const float* pPositions, size_t positionStride,
+		uint32_t vertexCount, float threshold);
+
+	// Orders vertices by first use and remaps the indices, unreferenced
+	// vertices are dropped. Returns the new vertex count.
+	static uint32_t OptimizeVertexFetch(void* pVertices, uint32_t* pIndices, size_t indexCount, uint32_t vertexCount, size_t vertexSize);
+
+	static VertexCacheStats AnalyzeVertexCache(const uint32_t* pIndices, size_t indexCount, uint32_t vertexCount,
+		uint32_t cacheSize, CacheModel model);
+
+	// Bytes read through a 16 KB direct mapped cache of 64 byte lines per referenced vertex byte
+	static float AnalyzeVertexFetch(const uint32_t* pIndices, size_t indexCount, uint32_t vertexCount, size_t vertexSize);
+};
@@ -0,0 +1,816 @@
+#include "MeshSimplifier.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+// Attributes weighed against positions normalized to a unit cube: normal xyz and uv
+static const uint32_t AttributeCount = 5;
+static const float NormalWeight = 0.5f;
+static const float UvWeight = 0.5f;
+
+// Border and seam edges also keep a plane through them perpendicular to the surface
+static const float BorderWeight = 10.0f;
+
+// A collapse is rejected if it turns a remaining triangle by more than about 75 degrees
+static const float MinNormalCosine = 0.25f;
+
+// Collapses of a pass may cost this much more than the one at the pass goal
+static const float PassErrorSlack = 1.5f;
+
+// Levels saving less than this fraction of the previous one are dropped
+static const float MinLodReduction = 1.0f / 6;
+
+static const uint32_t InvalidIndex = 0xFFFFFFFF;
+
+// Seams are UV or normal discontinuities, two vertices at one position
+// that only move together along the seam
+enum VertexKind
+{
+	VERTEX_MANIFOLD = 0,
+	VERTEX_BORDER,
+	VERTEX_SEAM,
+	VERTEX_LOCKED
+};
+
+struct Vector3
+{
+	float x, y, z;
+};
+
+// Symmetric 3x3 matrix, vector and constant of sum(w * (n.p + d)^2)
+struct Quadric
+{
+	float a00, a11, a22, a10, a20, a21;
+	float b0, b1, b2;
+	float c;
+	float w;
+};
+
+// Squared difference between vertex attributes and the attribute planes of
+// the surrounding triangles, gradients hold the attribute dependent terms
+struct AttributeQuadric
+{
+	Quadric quadric;
+	float gradient[AttributeCount][4];
+};
+
+struct Collapse
+{
+	uint32_t from;
+	uint32_t to;
+	float error;
+};
+
+// Half-edges leaving each vertex
+struct EdgeAdjacency
+{
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> targets;
+};
+
+static Vector3 Sub(const Vector3& a, const Vector3& b)
+{
+	Vector3 result = { a.x - b.x, a.y - b.y, a.z - b.z };
+	return result;
+}
+
+static float Dot(const Vector3& a, const Vector3& b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static Vector3 Cross(const Vector3& a, const Vector3& b)
+{
+	Vector3 result = { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	return result;
+}
+
+static bool IsDegenerate(const uint32_t* pTriangle, const uint32_t* pRemap)
+{
+	uint32_t r0 = pRemap[pTriangle[0]];
+	uint32_t r1 = pRemap[pTriangle[1]];
+	uint32_t r2 = pRemap[pTriangle[2]];
+	return r0 == r1 || r1 == r2 || r2 == r0;
+}
+
+static void AddPlane(Quadric& q, const Vector3& n, float d, float w)
+{
+	q.a00 += w * n.x * n.x;
+	q.a11 += w * n.y * n.y;
+	q.a22 += w * n.z * n.z;
+	q.a10 += w * n.y * n.x;
+	q.a20 += w * n.z * n.x;
+	q.a21 += w * n.z * n.y;
+	q.b0 += w * n.x * d;
+	q.b1 += w * n.y * d;
+	q.b2 += w * n.z * d;
+	q.c += w * d * d;
+	q.w += w;
+}
+
+static void AddQuadric(Quadric& q, const Quadric& other)
+{
+	q.a00 += other.a00;
+	q.a11 += other.a11;
+	q.a22 += other.a22;
+	q.a10 += other.a10;
+	q.a20 += other.a20;
+	q.a21 += other.a21;
+	q.b0 += other.b0;
+	q.b1 += other.b1;
+	q.b2 += other.b2;
+	q.c += other.c;
+	q.w += other.w;
+}
+
+static void AddAttributeQuadric(AttributeQuadric& q, const AttributeQuadric& other)
+{
+	AddQuadric(q.quadric, other.quadric);
+	for (uint32_t k = 0; k < AttributeCount; k++)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			q.gradient[k][i] += other.gradient[k][i];
+		}
+	}
+}
+
+// p^T A p + 2 b.p + c
+static float QuadricSum(const Quadric& q, const Vector3& p)
+{
+	float ax = q.a00 * p.x + q.a10 * p.y + q.a20 * p.z;
+	float ay = q.a10 * p.x + q.a11 * p.y + q.a21 * p.z;
+	float az = q.a20 * p.x + q.a21 * p.y + q.a22 * p.z;
+	return p.x * ax + p.y * ay + p.z * az + 2 * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+}
+
+static float QuadricError(const Quadric& q, const Vector3& p)
+{
+	return q.w > 0 ? fabsf(QuadricSum(q, p)) / q.w : 0.0f;
+}
+
+static float AttributeError(const AttributeQuadric& q, const Vector3& p, const float* pAttributes)
+{
+	float sum = QuadricSum(q.quadric, p);
+	for (uint32_t k = 0; k < AttributeCount; k++)
+	{
+		const float* g = q.gradient[k];
+		float s = pAttributes[k];
+		sum += s * s * q.quadric.w - 2 * s * (g[0] * p.x + g[1] * p.y + g[2] * p.z + g[3]);
+	}
+	return q.quadric.w > 0 ? fabsf(sum) / q.quadric.w : 0.0f;
+}
+
+// Linear attribute fields over the triangle plane, weighted by the area
+static void MakeAttributeQuadric(AttributeQuadric& q, const Vector3& p0, const Vector3& p1, const Vector3& p2,
+	const float* a0, const float* a1, const float* a2)
+{
+	memset(&q, 0, sizeof(q));
+
+	Vector3 p10 = Sub(p1, p0);
+	Vector3 p20 = Sub(p2, p0);
+	float d00 = Dot(p10, p10);
+	float d01 = Dot(p10, p20);
+	float d11 = Dot(p20, p20);
+	float denom = d00 * d11 - d01 * d01;
+	if (denom <= 0)
+	{
+		return;
+	}
+	float invDenom = 1.0f / denom;
+	float w = sqrtf(denom) * 0.5f;
+
+	// Gradient = g1 * (a1 - a0) + g2 * (a2 - a0)
+	Vector3 g1 = { (d11 * p10.x - d01 * p20.x) * invDenom, (d11 * p10.y - d01 * p20.y) * invDenom, (d11 * p10.z - d01 * p20.z) * invDenom };
+	Vector3 g2 = { (d00 * p20.x - d01 * p10.x) * invDenom, (d00 * p20.y - d01 * p10.y) * invDenom, (d00 * p20.z - d01 * p10.z) * invDenom };
+
+	for (uint32_t k = 0; k < AttributeCount; k++)
+	{
+		float da1 = a1[k] - a0[k];
+		float da2 = a2[k] - a0[k];
+		Vector3 g = { g1.x * da1 + g2.x * da2, g1.y * da1 + g2.y * da2, g1.z * da1 + g2.z * da2 };
+		float gw = a0[k] - Dot(p0, g);
+
+		q.quadric.a00 += w * g.x * g.x;
+		q.quadric.a11 += w * g.y * g.y;
+		q.quadric.a22 += w * g.z * g.z;
+		q.quadric.a10 += w * g.y * g.x;
+		q.quadric.a20 += w * g.z * g.x;
+		q.quadric.a21 += w * g.z * g.y;
+		q.quadric.b0 += w * g.x * gw;
+		q.quadric.b1 += w * g.y * gw;
+		q.quadric.b2 += w * g.z * gw;
+		q.quadric.c += w * gw * gw;
+
+		q.gradient[k][0] = w * g.x;
+		q.gradient[k][1] = w * g.y;
+		q.gradient[k][2] = w * g.z;
+		q.gradient[k][3] = w * gw;
+	}
+	q.quadric.w = w;
+}
+
+// remap points each vertex at the first one with the same position, wedge
+// links the vertices of a position in a cycle
+static void BuildPositionRemap(const MeshVertex* pVertices, size_t vertexCount, std::vector<uint32_t>& remap, std::vector<uint32_t>& wedge)
+{
+	// Open addressing over the position bits, at most half full
+	size_t tableSize = 1;
+	while (tableSize < vertexCount * 2)
+	{
+		tableSize *= 2;
+	}
+	std::vector<uint32_t> table(tableSize, InvalidIndex);
+
+	remap.resize(vertexCount);
+	wedge.resize(vertexCount);
+	for (uint32_t v = 0; v < (uint32_t)vertexCount; v++)
+	{
+		uint32_t bits[3];
+		memcpy(bits, pVertices[v].position, sizeof(bits));
+		uint32_t hash = (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		hash ^= hash >> 16;
+		hash *= 0x85EBCA6Bu;
+		hash ^= hash >> 13;
+		size_t slot = hash & (tableSize - 1);
+		while (table[slot] != InvalidIndex && memcmp(pVertices[table[slot]].position, bits, sizeof(bits)) != 0)
+		{
+			slot = (slot + 1) & (tableSize - 1);
+		}
+
+		if (table[slot] == InvalidIndex)
+		{
+			table[slot] = v;
+			remap[v] = v;
+			wedge[v] = v;
+		}
+		else
+		{
+			// Insert into the cycle after the first vertex
+			uint32_t first = table[slot];
+			remap[v] = first;
+			wedge[v] = wedge[first];
+			wedge[first] = v;
+		}
+	}
+}
+
+static void BuildEdges(EdgeAdjacency& adjacency, const uint32_t* pIndices, size_t indexCount, size_t vertexCount, const uint32_t* pRemap)
+{
+	adjacency.offsets.assign(vertexCount + 1, 0);
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		adjacency.offsets[pRemap[pIndices[i]] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		adjacency.offsets[v + 1] += adjacency.offsets[v];
+	}
+
+	std::vector<uint32_t> cursor(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+	adjacency.targets.resize(indexCount);
+	for (size_t i = 0; i < indexCount; i += 3)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t a = pRemap[pIndices[i + k]];
+			uint32_t b = pRemap[pIndices[i + (k + 1) % 3]];
+			adjacency.targets[cursor[a]++] = b;
+		}
+	}
+}
+
+static bool HasEdge(const EdgeAdjacency& adjacency, uint32_t a, uint32_t b)
+{
+	for (uint32_t i = adjacency.offsets[a]; i < adjacency.offsets[a + 1]; i++)
+	{
+		if (adjacency.targets[i] == b)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool HasLoop(const std::vector<uint32_t>& loop, uint32_t v)
+{
+	return loop[v] != InvalidIndex && loop[v] != v;
+}
+
+// Triangles touching each position, for the flip test
+static void BuildVertexTriangles(const uint32_t* pIndices, size_t indexCount, size_t vertexCount, const uint32_t* pRemap,
+	std::vector<uint32_t>& offsets, std::vector<uint32_t>& triangles)
+{
+	offsets.assign(vertexCount + 1, 0);
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		offsets[pRemap[pIndices[i]] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		offsets[v + 1] += offsets[v];
+	}
+
+	std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+	triangles.resize(indexCount);
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		triangles[cursor[pRemap[pIndices[i]]]++] = (uint32_t)(i / 3);
+	}
+}
+
+// True if moving from onto to turns a remaining triangle too far,
+// *pRemoved counts the triangles that collapse
+static bool CollapseFlips(const Vector3* pPositions, const uint32_t* pIndices, const uint32_t* pRemap,
+	const std::vector<uint32_t>& offsets, const std::vector<uint32_t>& triangles, uint32_t from, uint32_t to, size_t* pRemoved)
+{
+	uint32_t fromPosition = pRemap[from];
+	uint32_t toPosition = pRemap[to];
+	const Vector3& target = pPositions[to];
+
+	size_t removed = 0;
+	for (uint32_t i = offsets[fromPosition]; i < offsets[fromPosition + 1]; i++)
+	{
+		const uint32_t* pTriangle = pIndices + triangles[i] * 3;
+		int corner = 0;
+		bool shared = false;
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t r = pRemap[pTriangle[k]];
+			corner = r == fromPosition ? k : corner;
+			shared = shared || r == toPosition;
+		}
+		if (shared)
+		{
+			removed++;
+			continue;
+		}
+
+		const Vector3& p0 = pPositions[pTriangle[corner]];
+		const Vector3& p1 = pPositions[pTriangle[(corner + 1) % 3]];
+		const Vector3& p2 = pPositions[pTriangle[(corner + 2) % 3]];
+		Vector3 before = Cross(Sub(p1, p0), Sub(p2, p0));
+		Vector3 after = Cross(Sub(p1, target), Sub(p2, target));
+		if (Dot(before, after) < MinNormalCosine * sqrtf(Dot(before, before) * Dot(after, after)))
+		{
+			return true;
+		}
+	}
+
+	*pRemoved = removed;
+	return false;
+}
+
+size_t MeshSimplifier::Simplify(uint32_t* pDestination, const uint32_t* pIndices, size_t indexCount,
+	const MeshVertex* pVertices, size_t vertexCount, size_t targetIndexCount, float targetError, float* pResultError)
+{
+	assert(indexCount % 3 == 0);
+
+	std::vector<uint32_t> remap, wedge;
+	BuildPositionRemap(pVertices, vertexCount, remap, wedge);
+
+	// Working copy without degenerate triangles
+	size_t count = 0;
+	for (size_t i = 0; i < indexCount; i += 3)
+	{
+		if (!IsDegenerate(pIndices + i, remap.data()))
+		{
+			memcpy(pDestination + count, pIndices + i, 3 * sizeof(uint32_t));
+			count += 3;
+		}
+	}
+
+	if (pResultError != nullptr)
+	{
+		*pResultError = 0;
+	}
+	if (count <= targetIndexCount || vertexCount == 0)
+	{
+		return count;
+	}
+
+	// Positions in a unit cube so errors and attribute weights do not depend on the mesh size
+	float boundsMin[3] = { pVertices[0].position[0], pVertices[0].position[1], pVertices[0].position[2] };
+	float boundsMax[3] = { boundsMin[0], boundsMin[1], boundsMin[2] };
+	for (size_t v = 1; v < vertexCount; v++)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			boundsMin[i] = pVertices[v].position[i] < boundsMin[i] ? pVertices[v].position[i] : boundsMin[i];
+			boundsMax[i] = pVertices[v].position[i] > boundsMax[i] ? pVertices[v].position[i] : boundsMax[i];
+		}
+	}
+	float scale = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		scale = boundsMax[i] - boundsMin[i] > scale ? boundsMax[i] - boundsMin[i] : scale;
+	}
+	float invScale = scale > 0 ? 1.0f / scale : 0.0f;
+
+	std::vector<Vector3> positions(vertexCount);
+	std::vector<float> attributes(vertexCount * AttributeCount);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		const MeshVertex& vertex = pVertices[v];
+		Vector3 position = { (vertex.position[0] - boundsMin[0]) * invScale, (vertex.position[1] - boundsMin[1]) * invScale,
+			(vertex.position[2] - boundsMin[2]) * invScale };
+		positions[v] = position;
+
+		float* pAttributes = &attributes[v * AttributeCount];
+		pAttributes[0] = vertex.normal[0] * NormalWeight;
+		pAttributes[1] = vertex.normal[1] * NormalWeight;
+		pAttributes[2] = vertex.normal[2] * NormalWeight;
+		pAttributes[3] = vertex.uv[0] * UvWeight;
+		pAttributes[4] = vertex.uv[1] * UvWeight;
+	}
+
+	// Open edges by vertex and by position
+	std::vector<uint32_t> identity(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		identity[v] = (uint32_t)v;
+	}
+	EdgeAdjacency edges, positionEdges;
+	BuildEdges(edges, pDestination, count, vertexCount, identity.data());
+	BuildEdges(positionEdges, pDestination, count, vertexCount, remap.data());
+
+	// loop is the end of the one open edge leaving a vertex and loopback the
+	// start of the one arriving, a vertex with several points at itself
+	std::vector<uint32_t> loop(vertexCount, InvalidIndex);
+	std::vector<uint32_t> loopback(vertexCount, InvalidIndex);
+	for (size_t i = 0; i < count; i += 3)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t a = pDestination[i + k];
+			uint32_t b = pDestination[i + (k + 1) % 3];
+			if (!HasEdge(edges, b, a))
+			{
+				loop[a] = loop[a] == InvalidIndex || loop[a] == b ? b : a;
+				loopback[b] = loopback[b] == InvalidIndex || loopback[b] == a ? a : b;
+			}
+		}
+	}
+
+	std::vector<uint8_t> kinds(vertexCount);
+	for (uint32_t v = 0; v < (uint32_t)vertexCount; v++)
+	{
+		uint32_t sibling = wedge[v];
+		bool open = loop[v] != InvalidIndex || loopback[v] != InvalidIndex;
+		bool chained = HasLoop(loop, v) && HasLoop(loopback, v);
+		bool positionOpen = chained
+			&& !HasEdge(positionEdges, remap[loop[v]], remap[v]) && !HasEdge(positionEdges, remap[v], remap[loopback[v]]);
+
+		VertexKind kind = VERTEX_LOCKED;
+		if (sibling == v)
+		{
+			kind = !open ? VERTEX_MANIFOLD : positionOpen ? VERTEX_BORDER : VERTEX_LOCKED;
+		}
+		else if (wedge[sibling] == v && chained && !positionOpen && HasLoop(loop, sibling) && HasLoop(loopback, sibling))
+		{
+			// Both sides of the seam run between the same two positions
+			bool paired = remap[loop[v]] == remap[loopback[sibling]] && remap[loopback[v]] == remap[loop[sibling]];
+			bool closed = HasEdge(positionEdges, remap[loop[v]], remap[v]) && HasEdge(positionEdges, remap[v], remap[loopback[v]]);
+			kind = paired && closed ? VERTEX_SEAM : VERTEX_LOCKED;
+		}
+		kinds[v] = (uint8_t)kind;
+	}
+
+	// Plane quadrics by position, attribute quadrics by vertex
+	std::vector<Quadric> quadrics(vertexCount);
+	std::vector<AttributeQuadric> attributeQuadrics(vertexCount);
+	memset(quadrics.data(), 0, vertexCount * sizeof(Quadric));
+	memset(attributeQuadrics.data(), 0, vertexCount * sizeof(AttributeQuadric));
+	for (size_t i = 0; i < count; i += 3)
+	{
+		const uint32_t* pTriangle = pDestination + i;
+		const Vector3& p0 = positions[pTriangle[0]];
+		const Vector3& p1 = positions[pTriangle[1]];
+		const Vector3& p2 = positions[pTriangle[2]];
+
+		Vector3 normal = Cross(Sub(p1, p0), Sub(p2, p0));
+		float length = sqrtf(Dot(normal, normal));
+		if (length > 0)
+		{
+			normal.x /= length;
+			normal.y /= length;
+			normal.z /= length;
+			for (int k = 0; k < 3; k++)
+			{
+				AddPlane(quadrics[remap[pTriangle[k]]], normal, -Dot(normal, p0), length * 0.5f);
+			}
+		}
+
+		AttributeQuadric attributeQuadric;
+		MakeAttributeQuadric(attributeQuadric, p0, p1, p2, &attributes[pTriangle[0] * AttributeCount],
+			&attributes[pTriangle[1] * AttributeCount], &attributes[pTriangle[2] * AttributeCount]);
+		for (int k = 0; k < 3; k++)
+		{
+			AddAttributeQuadric(attributeQuadrics[pTriangle[k]], attributeQuadric);
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t a = pTriangle[k];
+			uint32_t b = pTriangle[(k + 1) % 3];
+			if (HasEdge(edges, b, a))
+			{
+				continue;
+			}
+
+			// Plane through the open edge, perpendicular to the triangle
+			const Vector3& pa = positions[a];
+			Vector3 edge = Sub(positions[b], pa);
+			float edgeLength = Dot(edge, edge);
+			if (edgeLength <= 0)
+			{
+				continue;
+			}
+			Vector3 side = Sub(positions[pTriangle[(k + 2) % 3]], pa);
+			float along = Dot(side, edge) / edgeLength;
+			Vector3 perpendicular = { side.x - edge.x * along, side.y - edge.y * along, side.z - edge.z * along };
+			float perpendicularLength = sqrtf(Dot(perpendicular, perpendicular));
+			if (perpendicularLength <= 0)
+			{
+				continue;
+			}
+			perpendicular.x /= perpendicularLength;
+			perpendicular.y /= perpendicularLength;
+			perpendicular.z /= perpendicularLength;
+			AddPlane(quadrics[remap[a]], perpendicular, -Dot(perpendicular, pa), edgeLength * BorderWeight);
+			AddPlane(quadrics[remap[b]], perpendicular, -Dot(perpendicular, pa), edgeLength * BorderWeight);
+		}
+	}
+
+	std::vector<uint32_t> collapseRemap(vertexCount);
+	std::vector<uint8_t> collapseLocked(vertexCount);
+	std::vector<uint32_t> triangleOffsets, triangles;
+	std::vector<uint32_t> nextLoop(vertexCount), nextLoopback(vertexCount);
+	std::vector<Collapse> bestCollapses(vertexCount);
+	std::vector<Collapse> collapses;
+	float errorLimit = targetError * targetError;
+	float resultError = 0;
+	bool limitPass = true;
+
+	// Seam vertices take their sibling along, onto the sibling of the target
+	auto siblingTarget = [&](uint32_t from, uint32_t to) -> uint32_t
+	{
+		uint32_t sibling = wedge[from];
+		return to == loop[from] ? loopback[sibling] : loop[sibling];
+	};
+
+	auto addCollapse = [&](uint32_t from, uint32_t to)
+	{
+		if (remap[from] == remap[to])
+		{
+			return;
+		}
+
+		uint8_t kind = kinds[from];
+		if (kind == VERTEX_LOCKED || (kind != VERTEX_MANIFOLD && (kinds[to] != kind || (to != loop[from] && to != loopback[from]))))
+		{
+			return;
+		}
+
+		const Vector3& target = positions[to];
+		float error = QuadricError(quadrics[remap[from]], target)
+			+ AttributeError(attributeQuadrics[from], target, &attributes[to * AttributeCount]);
+		if (kind == VERTEX_SEAM)
+		{
+			uint32_t sibling = wedge[from];
+			uint32_t siblingTo = siblingTarget(from, to);
+			if (siblingTo == InvalidIndex || remap[siblingTo] != remap[to] || kinds[siblingTo] != VERTEX_SEAM)
+			{
+				return;
+			}
+			error += AttributeError(attributeQuadrics[sibling], target, &attributes[siblingTo * AttributeCount]);
+		}
+
+		// Only the cheapest collapse of each vertex is ranked
+		Collapse& best = bestCollapses[from];
+		if (best.to == InvalidIndex || error < best.error)
+		{
+			best.to = to;
+			best.error = error;
+		}
+	};
+
+	while (count > targetIndexCount)
+	{
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			bestCollapses[v].from = (uint32_t)v;
+			bestCollapses[v].to = InvalidIndex;
+		}
+		for (size_t i = 0; i < count; i += 3)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t a = pDestination[i + k];
+				uint32_t b = pDestination[i + (k + 1) % 3];
+				addCollapse(a, b);
+
+				// Closed edges come back as the other triangle's half-edge
+				if (loopback[b] == a)
+				{
+					addCollapse(b, a);
+				}
+			}
+		}
+
+		collapses.clear();
+		for (const Collapse& collapse : bestCollapses)
+		{
+			if (collapse.to != InvalidIndex)
+			{
+				collapses.push_back(collapse);
+			}
+		}
+		if (collapses.empty())
+		{
+			break;
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b)
+		{
+			return a.error < b.error;
+		});
+
+		// Collapses touching the same position wait for the next pass, most
+		// remove two triangles
+		size_t triangleGoal = (count - targetIndexCount) / 3;
+		size_t goalIndex = triangleGoal / 2 < collapses.size() ? triangleGoal / 2 : collapses.size() - 1;
+		float passLimit = collapses[goalIndex].error * PassErrorSlack;
+
+		BuildVertexTriangles(pDestination, count, vertexCount, remap.data(), triangleOffsets, triangles);
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			collapseRemap[v] = (uint32_t)v;
+			collapseLocked[v] = 0;
+		}
+
+		size_t removed = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (collapse.error > errorLimit || removed >= triangleGoal)
+			{
+				break;
+			}
+			if (collapse.error > passLimit && limitPass)
+			{
+				break;
+			}
+
+			uint32_t fromPosition = remap[collapse.from];
+			uint32_t toPosition = remap[collapse.to];
+			if (collapseLocked[fromPosition] || collapseLocked[toPosition])
+			{
+				continue;
+			}
+
+			size_t collapseRemoved = 0;
+			if (CollapseFlips(positions.data(), pDestination, remap.data(), triangleOffsets, triangles, collapse.from, collapse.to, &collapseRemoved))
+			{
+				continue;
+			}
+
+			collapseRemap[collapse.from] = collapse.to;
+			AddQuadric(quadrics[toPosition], quadrics[fromPosition]);
+			AddAttributeQuadric(attributeQuadrics[collapse.to], attributeQuadrics[collapse.from]);
+			if (kinds[collapse.from] == VERTEX_SEAM)
+			{
+				uint32_t sibling = wedge[collapse.from];
+				uint32_t siblingTo = siblingTarget(collapse.from, collapse.to);
+				collapseRemap[sibling] = siblingTo;
+				AddAttributeQuadric(attributeQuadrics[siblingTo], attributeQuadrics[sibling]);
+			}
+
+			collapseLocked[fromPosition] = 1;
+			collapseLocked[toPosition] = 1;
+			resultError = collapse.error > resultError ? collapse.error : resultError;
+			removed += collapseRemoved;
+		}
+
+		if (removed == 0 && !limitPass)
+		{
+			break;
+		}
+
+		// Cheap candidates that keep failing the flip test hold the limit down,
+		// a pass that got little done lets the next one run to the goal
+		limitPass = removed * 10 >= triangleGoal;
+		if (removed == 0)
+		{
+			continue;
+		}
+
+		// Open edges leading into a collapsed vertex now lead into its target,
+		// the target continues along the collapsed vertex's edge
+		for (uint32_t v = 0; v < (uint32_t)vertexCount; v++)
+		{
+			nextLoop[v] = loop[v];
+			nextLoopback[v] = loopback[v];
+			if (HasLoop(loop, v))
+			{
+				uint32_t target = collapseRemap[loop[v]];
+				nextLoop[v] = target != v ? target : HasLoop(loop, loop[v]) ? collapseRemap[loop[loop[v]]] : InvalidIndex;
+			}
+			if (HasLoop(loopback, v))
+			{
+				uint32_t target = collapseRemap[loopback[v]];
+				nextLoopback[v] = target != v ? target : HasLoop(loopback, loopback[v]) ? collapseRemap[loopback[loopback[v]]] : InvalidIndex;
+			}
+		}
+		loop.swap(nextLoop);
+		loopback.swap(nextLoopback);
+
+		size_t write = 0;
+		for (size_t i = 0; i < count; i += 3)
+		{
+			uint32_t triangle[3] = { collapseRemap[pDestination[i]], collapseRemap[pDestination[i + 1]], collapseRemap[pDestination[i + 2]] };
+			if (!IsDegenerate(triangle, remap.data()))
+			{
+				memcpy(pDestination + write, triangle, sizeof(triangle));
+				write += 3;
+			}
+		}
+		count = write;
+	}
+
+	if (pResultError != nullptr)
+	{
+		*pResultError = sqrtf(resultError) * scale;
+	}
+	return count;
+}
+
+void MeshSimplifier::BuildLodChains(const Source* pSources, size_t sourceCount, uint32_t maxLevels, float maxError,
+	std::vector<Lod>* pChains, uint32_t workerCount)
+{
+	struct Task
+	{
+		size_t source;
+		uint32_t level;
+	};
+
+	std::vector<Task> tasks;
+	for (size_t s = 0; s < sourceCount; s++)
+	{
+		pChains[s].clear();
+		for (uint32_t level = 1; level < maxLevels; level++)
+		{
+			Task task = { s, level };
+			tasks.push_back(task);
+		}
+	}
+
+	// Workers take levels one by one, every level starts from its source
+	std::vector<Lod> levels(tasks.size());
+	std::atomic<size_t> nextTask(0);
+	auto simplify = [&]()
+	{
+		for (size_t i = nextTask++; i < tasks.size(); i = nextTask++)
+		{
+			const Source& source = pSources[tasks[i].source];
+			size_t targetIndexCount = (source.indexCount / 3 >> tasks[i].level) * 3;
+
+			Lod& lod = levels[i];
+			lod.indices.resize(source.indexCount);
+			size_t indexCount = Simplify(lod.indices.data(), source.pIndices, source.indexCount, source.pVertices, source.vertexCount,
+				targetIndexCount, maxError, &lod.error);
+			lod.indices.resize(indexCount);
+		}
+	};
+
+	uint32_t workers = workerCount != 0 ? workerCount : std::thread::hardware_concurrency();
+	workers = workers < tasks.size() ? workers : (uint32_t)tasks.size();
+	std::vector<std::thread> threads;
+	for (uint32_t w = 1; w < workers; w++)
+	{
+		threads.push_back(std::thread(simplify));
+	}
+	simplify();
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	// Tasks are ordered by source, then level
+	for (size_t i = 0; i < tasks.size(); i++)
+	{
+		std::vector<Lod>& chain = pChains[tasks[i].source];
+		size_t previousCount = chain.empty() ? pSources[tasks[i].source].indexCount : chain.back().indices.size();
+		float previousError = chain.empty() ? 0.0f : chain.back().error;
+
+		Lod& lod = levels[i];
+		if (lod.indices.empty() || lod.indices.size() > previousCount * (1.0f - MinLodReduction))
+		{
+			continue;
+		}
+		lod.error = lod.error > previousError ? lod.error : previousError;
+		chain.push_back(std::move(lod));
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "MeshImporter.h"
+
+// Edge collapse simplification under a quadric error metric. Vertices are
+// collapsed onto their neighbours, so every level indexes the source vertex
+// buffer. Normal and UV changes are weighed by attribute quadrics. UV seams
+// and open borders only collapse along themselves, and vertices where they
+// meet are kept.
+class MeshSimplifier
+{
+public:
+	// Index buffer over vertices shared by all levels of a mesh
+	struct Source
+	{
+		const uint32_t* pIndices;
+		size_t indexCount;
+		const MeshVertex* pVertices;
+		size_t vertexCount;
+	};
+
+	struct Lod
+	{
+		std::vector<uint32_t> indices;
+		float error; // in mesh units
+	};
+
+	// Writes at most indexCount indices to pDestination and returns their count.
+	// Stops at targetIndexCount or before the error would exceed targetError,
+	// which is relative to the largest mesh extent. *pResultError is in mesh units.
+	static size_t Simplify(uint32_t* pDestination, const uint32_t* pIndices, size_t indexCount,
+		const MeshVertex* pVertices, size_t vertexCount, size_t targetIndexCount, float targetError, float* pResultError);
+
+	// Levels at 1/2, 1/4... of the source triangles, each simplified from the
+	// source. Levels that save less than a sixth of the previous one are
+	// dropped, so pChains[i] holds up to maxLevels - 1 levels after the source
+	// itself. All levels of all meshes are spread over workerCount threads,
+	// 0 uses the hardware thread count.
+	static void BuildLodChains(const Source* pSources, size_t sourceCount, uint32_t maxLevels, float maxError,
+		std::vector<Lod>* pChains, uint32_t workerCount = 0);
+};
@@ -0,0 +1,338 @@
+#include "MeshletBuilder.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+const uint32_t MeshletBuilder::MaxVertices;
+const uint32_t MeshletBuilder::MaxTriangles;
+
+// A triangle not touching the meshlet still joins it if its centroid is this
+// close, relative to the meshlet's half diagonal, so triangle soups are not
+// split into single triangles
+static const float MaxJoinDistance = 2.0f;
+
+// Cones wider than about 84 degrees are left to the frustum test
+static const float MinConeCosine = 0.1f;
+
+static const uint32_t InvalidIndex = 0xFFFFFFFF;
+
+struct Vector3
+{
+	float x, y, z;
+};
+
+static Vector3 Position(const MeshVertex& vertex)
+{
+	Vector3 result = { vertex.position[0], vertex.position[1], vertex.position[2] };
+	return result;
+}
+
+static float Dot(const Vector3& a, const Vector3& b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// Unit normal along the cross product of the edges, zero for degenerate triangles.
+// It points out of the front face of the scene's clockwise triangles.
+static Vector3 TriangleNormal(const Vector3& a, const Vector3& b, const Vector3& c)
+{
+	Vector3 e1 = { b.x - a.x, b.y - a.y, b.z - a.z };
+	Vector3 e2 = { c.x - a.x, c.y - a.y, c.z - a.z };
+	Vector3 n = { e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x };
+	float length = sqrtf(Dot(n, n));
+	float scale = length > 0.0f ? 1.0f / length : 0.0f;
+	Vector3 result = { n.x * scale, n.y * scale, n.z * scale };
+	return result;
+}
+
+// Same id for vertices at bitwise equal positions, so UV and normal seams do not cut meshlets apart
+static void WeldPositions(const MeshVertex* pVertices, size_t vertexCount, std::vector<uint32_t>& weld)
+{
+	std::vector<uint32_t> order(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		order[i] = (uint32_t)i;
+	}
+	std::sort(order.begin(), order.end(), [pVertices](uint32_t a, uint32_t b)
+	{
+		return memcmp(pVertices[a].position, pVertices[b].position, sizeof(pVertices[a].position)) < 0;
+	});
+
+	weld.resize(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		uint32_t vertex = order[i];
+		bool same = i > 0 && memcmp(pVertices[order[i - 1]].position, pVertices[vertex].position, sizeof(pVertices[vertex].position)) == 0;
+		weld[vertex] = same ? weld[order[i - 1]] : vertex;
+	}
+}
+
+uint32_t MeshletBuilder::Build(uint32_t* pIndices, size_t indexCount, const MeshVertex* pVertices, size_t vertexCount,
+	uint32_t indexBase, MeshletList* pMeshlets)
+{
+	assert(indexCount % 3 == 0);
+	size_t triangleCount = indexCount / 3;
+
+	std::vector<uint32_t> weld;
+	WeldPositions(pVertices, vertexCount, weld);
+
+	// Triangles around each welded position
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		offsets[weld[pIndices[i]] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		offsets[v + 1] += offsets[v];
+	}
+	std::vector<uint32_t> adjacency(indexCount);
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		adjacency[fill[weld[pIndices[i]]]++] = (uint32_t)(i / 3);
+	}
+
+	std::vector<Vector3> normals(triangleCount);
+	std::vector<Vector3> centroids(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		Vector3 a = Position(pVertices[pIndices[t * 3 + 0]]);
+		Vector3 b = Position(pVertices[pIndices[t * 3 + 1]]);
+		Vector3 c = Position(pVertices[pIndices[t * 3 + 2]]);
+		normals[t] = TriangleNormal(a, b, c);
+		centroids[t].x = (a.x + b.x + c.x) / 3;
+		centroids[t].y = (a.y + b.y + c.y) / 3;
+		centroids[t].z = (a.z + b.z + c.z) / 3;
+	}
+
+	std::vector<bool> used(triangleCount, false);
+	std::vector<uint32_t> vertexMeshlet(vertexCount, InvalidIndex);
+	std::vector<uint32_t> weldMeshlet(vertexCount, InvalidIndex);
+	std::vector<uint32_t> result;
+	result.reserve(indexCount);
+
+	// Current meshlet
+	uint32_t meshletCount = 0;
+	std::vector<uint32_t> vertices;
+	std::vector<uint32_t> welded;
+	std::vector<uint32_t> triangles;
+	Vector3 normalSum = { 0, 0, 0 };
+	Vector3 boundsMin = { 0, 0, 0 };
+	Vector3 boundsMax = { 0, 0, 0 };
+
+	auto newVertices = [&](uint32_t triangle)
+	{
+		const uint32_t* pTriangle = pIndices + triangle * 3;
+		uint32_t count = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			bool repeated = (k > 0 && pTriangle[k] == pTriangle[0]) || (k > 1 && pTriangle[k] == pTriangle[1]);
+			count += vertexMeshlet[pTriangle[k]] != meshletCount && !repeated ? 1 : 0;
+		}
+		return count;
+	};
+
+	auto flush = [&]()
+	{
+		if (triangles.empty())
+		{
+			return;
+		}
+
+		// Sphere around the box center, cone around the average normal
+		Vector3 center = { (boundsMin.x + boundsMax.x) / 2, (boundsMin.y + boundsMax.y) / 2, (boundsMin.z + boundsMax.z) / 2 };
+		float radiusSq = 0.0f;
+		for (uint32_t vertex : vertices)
+		{
+			Vector3 p = Position(pVertices[vertex]);
+			Vector3 d = { p.x - center.x, p.y - center.y, p.z - center.z };
+			radiusSq = std::max(radiusSq, Dot(d, d));
+		}
+
+		float axisLength = sqrtf(Dot(normalSum, normalSum));
+		Vector3 axis = { 0, 0, 0 };
+		float minCosine = -1.0f;
+		if (axisLength > 0.0f)
+		{
+			axis.x = normalSum.x / axisLength;
+			axis.y = normalSum.y / axisLength;
+			axis.z = normalSum.z / axisLength;
+			minCosine = 1.0f;
+			for (uint32_t triangle : triangles)
+			{
+				// Degenerate triangles cover no pixels and do not widen the cone
+				if (Dot(normals[triangle], normals[triangle]) > 0.0f)
+				{
+					minCosine = std::min(minCosine, Dot(normals[triangle], axis));
+				}
+			}
+		}
+
+		pMeshlets->firstIndex.push_back(indexBase + (uint32_t)result.size());
+		pMeshlets->indexCount.push_back((uint32_t)triangles.size() * 3);
+		pMeshlets->centerX.push_back(center.x);
+		pMeshlets->centerY.push_back(center.y);
+		pMeshlets->centerZ.push_back(center.z);
+		pMeshlets->radius.push_back(sqrtf(radiusSq));
+		pMeshlets->axisX.push_back(axis.x);
+		pMeshlets->axisY.push_back(axis.y);
+		pMeshlets->axisZ.push_back(axis.z);
+		pMeshlets->cutoff.push_back(minCosine < MinConeCosine ? 1.0f : sqrtf(1.0f - minCosine * minCosine));
+
+		for (uint32_t triangle : triangles)
+		{
+			result.insert(result.end(), pIndices + triangle * 3, pIndices + triangle * 3 + 3);
+		}
+
+		meshletCount++;
+		vertices.clear();
+		welded.clear();
+		triangles.clear();
+		normalSum.x = normalSum.y = normalSum.z = 0.0f;
+	};
+
+	auto add = [&](uint32_t triangle)
+	{
+		used[triangle] = true;
+		triangles.push_back(triangle);
+
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t vertex = pIndices[triangle * 3 + k];
+			if (vertexMeshlet[vertex] != meshletCount)
+			{
+				vertexMeshlet[vertex] = meshletCount;
+				vertices.push_back(vertex);
+
+				Vector3 p = Position(pVertices[vertex]);
+				if (vertices.size() == 1)
+				{
+					boundsMin = boundsMax = p;
+				}
+				boundsMin.x = std::min(boundsMin.x, p.x);
+				boundsMin.y = std::min(boundsMin.y, p.y);
+				boundsMin.z = std::min(boundsMin.z, p.z);
+				boundsMax.x = std::max(boundsMax.x, p.x);
+				boundsMax.y = std::max(boundsMax.y, p.y);
+				boundsMax.z = std::max(boundsMax.z, p.z);
+			}
+			if (weldMeshlet[weld[vertex]] != meshletCount)
+			{
+				weldMeshlet[weld[vertex]] = meshletCount;
+				welded.push_back(weld[vertex]);
+			}
+		}
+
+		normalSum.x += normals[triangle].x;
+		normalSum.y += normals[triangle].y;
+		normalSum.z += normals[triangle].z;
+	};
+
+	// Grows the meshlet by the triangle around its positions adding the fewest
+	// vertices, ties go to the one closest to the average normal and to the
+	// meshlet center so it stays round. When none fits, the next unused
+	// triangle in index order joins if it is close or starts the next meshlet.
+	size_t seed = 0;
+	for (;;)
+	{
+		uint32_t best = InvalidIndex;
+		float bestScore = 0.0f;
+
+		float axisLength = sqrtf(Dot(normalSum, normalSum));
+		float axisScale = axisLength > 0.0f ? 1.0f / axisLength : 0.0f;
+		Vector3 axis = { normalSum.x * axisScale, normalSum.y * axisScale, normalSum.z * axisScale };
+		Vector3 center = { (boundsMin.x + boundsMax.x) / 2, (boundsMin.y + boundsMax.y) / 2, (boundsMin.z + boundsMax.z) / 2 };
+		Vector3 half = { boundsMax.x - center.x, boundsMax.y - center.y, boundsMax.z - center.z };
+		float halfSq = Dot(half, half);
+		float distanceScale = halfSq > 0.0f ? 1.0f / halfSq : 0.0f;
+
+		for (uint32_t position : welded)
+		{
+			for (uint32_t a = offsets[position]; a < offsets[position + 1]; a++)
+			{
+				uint32_t triangle = adjacency[a];
+				if (used[triangle])
+				{
+					continue;
+				}
+
+				uint32_t extra = newVertices(triangle);
+				if (vertices.size() + extra > MaxVertices)
+				{
+					continue;
+				}
+
+				Vector3 d = { centroids[triangle].x - center.x, centroids[triangle].y - center.y, centroids[triangle].z - center.z };
+				float score = extra + (1.0f - Dot(normals[triangle], axis)) + Dot(d, d) * distanceScale;
+				if (best == InvalidIndex || score < bestScore)
+				{
+					best = triangle;
+					bestScore = score;
+				}
+			}
+		}
+
+		if (best == InvalidIndex)
+		{
+			while (seed < triangleCount && used[seed])
+			{
+				seed++;
+			}
+			if (seed == triangleCount)
+			{
+				break;
+			}
+
+			best = (uint32_t)seed;
+			if (!triangles.empty())
+			{
+				Vector3 d = { centroids[best].x - center.x, centroids[best].y - center.y, centroids[best].z - center.z };
+				bool close = Dot(d, d) <= MaxJoinDistance * MaxJoinDistance * halfSq;
+				if (!close || vertices.size() + newVertices(best) > MaxVertices)
+				{
+					flush();
+				}
+			}
+		}
+
+		add(best);
+		if (triangles.size() == MaxTriangles)
+		{
+			flush();
+		}
+	}
+	flush();
+
+	assert(result.size() == indexCount);
+	memcpy(pIndices, result.data(), indexCount * sizeof(uint32_t));
+
+	return meshletCount;
+}
+
+uint32_t MeshletBuilder::CullBackfacing(const MeshletList& meshlets, uint32_t firstMeshlet, const uint32_t* pCandidates, uint32_t count,
+	const float* cameraPosition, uint32_t* pVisible)
+{
+	// Every point p of the sphere sees every normal n of the cone from behind,
+	// dot(p - camera, n) > 0, when the view direction to the sphere is inside
+	// the cone's dual: dot(c - camera, axis) >= cutoff * (|c - camera| + r) + r
+	uint32_t visible = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t m = firstMeshlet + pCandidates[i];
+		float dx = meshlets.centerX[m] - cameraPosition[0];
+		float dy = meshlets.centerY[m] - cameraPosition[1];
+		float dz = meshlets.centerZ[m] - cameraPosition[2];
+		float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+		float along = dx * meshlets.axisX[m] + dy * meshlets.axisY[m] + dz * meshlets.axisZ[m];
+		float radius = meshlets.radius[m];
+
+		if (along < meshlets.cutoff[m] * (distance + radius) + radius)
+		{
+			pVisible[visible++] = pCandidates[i];
+		}
+	}
+	return visible;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "MeshImporter.h"
+
+// Meshlets of any number of meshes as parallel arrays, the bounding spheres
+// are laid out for FrustumCuller::CullSpheres
+struct MeshletList
+{
+	std::vector<uint32_t> firstIndex;
+	std::vector<uint32_t> indexCount;
+
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;
+
+	// Normal cone, cutoff is the sine of its half angle, 1 if it can not be backface culled
+	std::vector<float> axisX;
+	std::vector<float> axisY;
+	std::vector<float> axisZ;
+	std::vector<float> cutoff;
+};
+
+// Splits triangle lists into small clusters grown over shared vertices, so
+// each one is compact enough to be culled on its own
+class MeshletBuilder
+{
+public:
+	static const uint32_t MaxVertices = 64;
+	static const uint32_t MaxTriangles = 124;
+
+	// Reorders the triangles of pIndices so every meshlet is a contiguous range
+	// and appends the meshlets to pMeshlets, their firstIndex is the position in
+	// pIndices plus indexBase. Returns the number of meshlets added.
+	static uint32_t Build(uint32_t* pIndices, size_t indexCount, const MeshVertex* pVertices, size_t vertexCount,
+		uint32_t indexBase, MeshletList* pMeshlets);
+
+	// Keeps the meshlets firstMeshlet + pCandidates[i] with at least one triangle
+	// that may face cameraPosition, in place is fine. Returns the count kept.
+	static uint32_t CullBackfacing(const MeshletList& meshlets, uint32_t firstMeshlet, const uint32_t* pCandidates, uint32_t count,
+		const float* cameraPosition, uint32_t* pVisible);
+};
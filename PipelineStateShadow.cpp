@@ -0,0 +1,294 @@
+#include "PipelineStateShadow.h"
+
+#include <assert.h>
+#include <string.h>
+
+const uint32_t PipelineStateShadow::MaxVertexBuffers;
+const uint32_t PipelineStateShadow::MaxConstantBuffers;
+const uint32_t PipelineStateShadow::MaxShaderResources;
+const uint32_t PipelineStateShadow::MaxSamplers;
+const uint32_t PipelineStateShadow::MaxRenderTargets;
+
+// Never a valid object, so the next bind of anything differs
+static const void* const Unknown = (const void*)~(uintptr_t)0;
+static const uint32_t UnknownValue = 0xFFFFFFFF;
+
+PipelineStateShadow::PipelineStateShadow()
+	: m_issued(0)
+	, m_skipped(0)
+{
+	Invalidate();
+}
+
+void PipelineStateShadow::Invalidate()
+{
+	Slot unknown = { Unknown, UnknownValue, UnknownValue };
+
+	for (Slot& slot : m_vertexBuffers)
+	{
+		slot = unknown;
+	}
+	m_indexBuffer = unknown;
+	m_inputLayout = Unknown;
+	m_topology = UnknownValue;
+
+	for (uint32_t stage = 0; stage < STAGE_COUNT; stage++)
+	{
+		m_shaders[stage] = Unknown;
+		for (Slot& slot : m_constantBuffers[stage])
+		{
+			slot = unknown;
+		}
+		for (Slot& slot : m_samplers[stage])
+		{
+			slot = unknown;
+		}
+	}
+	ResetShaderResources(Unknown);
+
+	m_rasterizerState = Unknown;
+	m_viewportValid = false;
+	m_scissorRectValid = false;
+
+	m_renderTargetCount = UnknownValue;
+	for (const void*& view : m_renderTargets)
+	{
+		view = Unknown;
+	}
+	m_depthView = Unknown;
+}
+
+void PipelineStateShadow::Clear()
+{
+	Slot empty = { nullptr, 0, 0 };
+
+	for (Slot& slot : m_vertexBuffers)
+	{
+		slot = empty;
+	}
+	m_indexBuffer = empty;
+	m_inputLayout = nullptr;
+	m_topology = 0;
+
+	for (uint32_t stage = 0; stage < STAGE_COUNT; stage++)
+	{
+		m_shaders[stage] = nullptr;
+		for (Slot& slot : m_constantBuffers[stage])
+		{
+			slot = empty;
+		}
+		for (Slot& slot : m_samplers[stage])
+		{
+			slot = empty;
+		}
+	}
+	ResetShaderResources(nullptr);
+
+	m_rasterizerState = nullptr;
+	// No viewports are set after a reset, keep the next one from being skipped
+	m_viewportValid = false;
+	m_scissorRectValid = false;
+
+	m_renderTargetCount = 0;
+	for (const void*& view : m_renderTargets)
+	{
+		view = nullptr;
+	}
+	m_depthView = nullptr;
+}
+
+PipelineStateShadow::Range PipelineStateShadow::SetVertexBuffers(uint32_t start, uint32_t count, const void* const* buffers,
+	const uint32_t* strides, const uint32_t* offsets)
+{
+	assert(start + count <= MaxVertexBuffers);
+	return UpdateSlots(m_vertexBuffers, start, count, buffers, strides, offsets);
+}
+
+bool PipelineStateShadow::SetIndexBuffer(const void* buffer, uint32_t format, uint32_t offset)
+{
+	bool changed = m_indexBuffer.handle != buffer || m_indexBuffer.a != format || m_indexBuffer.b != offset;
+	if (changed)
+	{
+		m_indexBuffer.handle = buffer;
+		m_indexBuffer.a = format;
+		m_indexBuffer.b = offset;
+	}
+	Count(changed);
+	return changed;
+}
+
+bool PipelineStateShadow::SetInputLayout(const void* layout)
+{
+	return UpdateValue(&m_inputLayout, layout);
+}
+
+bool PipelineStateShadow::SetTopology(uint32_t topology)
+{
+	bool changed = m_topology != topology;
+	m_topology = topology;
+	Count(changed);
+	return changed;
+}
+
+bool PipelineStateShadow::SetShader(Stage stage, const void* shader)
+{
+	return UpdateValue(&m_shaders[stage], shader);
+}
+
+PipelineStateShadow::Range PipelineStateShadow::SetConstantBuffers(Stage stage, uint32_t start, uint32_t count, const void* const* buffers,
+	const uint32_t* firstConstants, const uint32_t* numConstants)
+{
+	assert(start + count <= MaxConstantBuffers);
+	return UpdateSlots(m_constantBuffers[stage], start, count, buffers, firstConstants, numConstants);
+}
+
+PipelineStateShadow::Range PipelineStateShadow::SetShaderResources(Stage stage, uint32_t start, uint32_t count, const void* const* views)
+{
+	assert(start + count <= MaxShaderResources);
+	return UpdateSlots(m_shaderResources[stage], start, count, views, nullptr, nullptr);
+}
+
+PipelineStateShadow::Range PipelineStateShadow::SetSamplers(Stage stage, uint32_t start, uint32_t count, const void* const* samplers)
+{
+	assert(start + count <= MaxSamplers);
+	return UpdateSlots(m_samplers[stage], start, count, samplers, nullptr, nullptr);
+}
+
+bool PipelineStateShadow::SetRasterizerState(const void* state)
+{
+	return UpdateValue(&m_rasterizerState, state);
+}
+
+bool PipelineStateShadow::SetViewport(const float* viewport)
+{
+	bool changed = !m_viewportValid || memcmp(m_viewport, viewport, sizeof(m_viewport)) != 0;
+	if (changed)
+	{
+		memcpy(m_viewport, viewport, sizeof(m_viewport));
+		m_viewportValid = true;
+	}
+	Count(changed);
+	return changed;
+}
+
+bool PipelineStateShadow::SetScissorRect(const int32_t* rect)
+{
+	bool changed = !m_scissorRectValid || memcmp(m_scissorRect, rect, sizeof(m_scissorRect)) != 0;
+	if (changed)
+	{
+		memcpy(m_scissorRect, rect, sizeof(m_scissorRect));
+		m_scissorRectValid = true;
+	}
+	Count(changed);
+	return changed;
+}
+
+bool PipelineStateShadow::SetRenderTargets(uint32_t count, const void* const* views, const void* depthView)
+{
+	assert(count <= MaxRenderTargets);
+
+	bool changed = m_renderTargetCount != count || m_depthView != depthView;
+	for (uint32_t i = 0; i < count && !changed; i++)
+	{
+		changed = m_renderTargets[i] != views[i];
+	}
+
+	if (changed)
+	{
+		m_renderTargetCount = count;
+		for (uint32_t i = 0; i < MaxRenderTargets; i++)
+		{
+			m_renderTargets[i] = i < count ? views[i] : nullptr;
+		}
+		m_depthView = depthView;
+	}
+	Count(changed);
+	return changed;
+}
+
+const void* PipelineStateShadow::GetShaderResource(Stage stage, uint32_t slot) const
+{
+	assert(slot < MaxShaderResources);
+	const void* view = m_shaderResources[stage][slot].handle;
+	return view != Unknown ? view : nullptr;
+}
+
+uint64_t PipelineStateShadow::GetIssued() const
+{
+	return m_issued;
+}
+
+uint64_t PipelineStateShadow::GetSkipped() const
+{
+	return m_skipped;
+}
+
+void PipelineStateShadow::ResetCounters()
+{
+	m_issued = 0;
+	m_skipped = 0;
+}
+
+PipelineStateShadow::Range PipelineStateShadow::UpdateSlots(Slot* slots, uint32_t start, uint32_t count, const void* const* handles,
+	const uint32_t* a, const uint32_t* b)
+{
+	Range range = { start, 0 };
+
+	uint32_t first = count;
+	uint32_t last = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Slot slot = { handles[i], a != nullptr ? a[i] : 0, b != nullptr ? b[i] : 0 };
+		Slot& current = slots[start + i];
+		if (current.handle != slot.handle || current.a != slot.a || current.b != slot.b)
+		{
+			current = slot;
+			first = first < i ? first : i;
+			last = i;
+		}
+	}
+
+	// One call covers the changed slots and whatever unchanged ones lie between
+	if (first < count)
+	{
+		range.first = start + first;
+		range.count = last - first + 1;
+	}
+
+	m_issued += range.count;
+	m_skipped += count - range.count;
+
+	return range;
+}
+
+bool PipelineStateShadow::UpdateValue(const void** pValue, const void* value)
+{
+	bool changed = *pValue != value;
+	*pValue = value;
+	Count(changed);
+	return changed;
+}
+
+void PipelineStateShadow::Count(bool issued)
+{
+	if (issued)
+	{
+		m_issued++;
+	}
+	else
+	{
+		m_skipped++;
+	}
+}
+
+void PipelineStateShadow::ResetShaderResources(const void* handle)
+{
+	Slot slot = { handle, 0, 0 };
+	for (uint32_t stage = 0; stage < STAGE_COUNT; stage++)
+	{
+		for (Slot& view : m_shaderResources[stage])
+		{
+			view = slot;
+		}
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+
+// CPU copy of the bound pipeline state. Every Set* call records the new
+// value and reports what actually has to be sent to the device, binds are
+// compared by object handle so no graphics API types are involved.
+class PipelineStateShadow
+{
+public:
+	enum Stage
+	{
+		STAGE_VS = 0,
+		STAGE_PS,
+		STAGE_COUNT
+	};
+
+	static const uint32_t MaxVertexBuffers = 16;
+	static const uint32_t MaxConstantBuffers = 14;
+	static const uint32_t MaxShaderResources = 16;
+	static const uint32_t MaxSamplers = 16;
+	static const uint32_t MaxRenderTargets = 8;
+
+	// Slots [first, first + count) changed and have to be bound, count 0 if none
+	struct Range
+	{
+		uint32_t first;
+		uint32_t count;
+	};
+
+	PipelineStateShadow();
+
+	// Device state is unknown, every following bind is issued
+	void Invalidate();
+	// Device state was reset to defaults, e.g. by ClearState()
+	void Clear();
+
+	Range SetVertexBuffers(uint32_t start, uint32_t count, const void* const* buffers, const uint32_t* strides, const uint32_t* offsets);
+	bool SetIndexBuffer(const void* buffer, uint32_t format, uint32_t offset);
+	bool SetInputLayout(const void* layout);
+	bool SetTopology(uint32_t topology);
+
+	bool SetShader(Stage stage, const void* shader);
+	// firstConstants and numConstants may be null for whole-buffer binds
+	Range SetConstantBuffers(Stage stage, uint32_t start, uint32_t count, const void* const* buffers,
+		const uint32_t* firstConstants, const uint32_t* numConstants);
+	Range SetShaderResources(Stage stage, uint32_t start, uint32_t count, const void* const* views);
+	Range SetSamplers(Stage stage, uint32_t start, uint32_t count, const void* const* samplers);
+
+	bool SetRasterizerState(const void* state);
+	// x, y, width, height, minDepth, maxDepth
+	bool SetViewport(const float* viewport);
+	// left, top, right, bottom
+	bool SetScissorRect(const int32_t* rect);
+
+	// Shader resources are kept, views of resources that become outputs have
+	// to be unbound first or the device drops them unseen
+	bool SetRenderTargets(uint32_t count, const void* const* views, const void* depthView);
+
+	// Null when the slot is empty or its view is unknown
+	const void* GetShaderResource(Stage stage, uint32_t slot) const;
+
+	uint64_t GetIssued() const;
+	uint64_t GetSkipped() const;
+	void ResetCounters();
+
+private:
+	struct Slot
+	{
+		const void* handle;
+		uint32_t a;
+		uint32_t b;
+	};
+
+	Range UpdateSlots(Slot* slots, uint32_t start, uint32_t count, const void* const* handles, const uint32_t* a, const uint32_t* b);
+	bool UpdateValue(const void** pValue, const void* value);
+	void Count(bool issued);
+	void ResetShaderResources(const void* handle);
+
+private:
+	Slot m_vertexBuffers[MaxVertexBuffers];
+	Slot m_indexBuffer;
+	const void* m_inputLayout;
+	uint32_t m_topology;
+
+	const void* m_shaders[STAGE_COUNT];
+	Slot m_constantBuffers[STAGE_COUNT][MaxConstantBuffers];
+	Slot m_shaderResources[STAGE_COUNT][MaxShaderResources];
+	Slot m_samplers[STAGE_COUNT][MaxSamplers];
+
+	const void* m_rasterizerState;
+	float m_viewport[6];
+	bool m_viewportValid;
+	int32_t m_scissorRect[4];
+	bool m_scissorRectValid;
+
+	uint32_t m_renderTargetCount;
+	const void* m_renderTargets[MaxRenderTargets];
+	const void* m_depthView;
+
+	uint64_t m_issued;
+	uint64_t m_skipped;
+};
@@ -0,0 +1,173 @@
+#include "RenderCommands.h"
+
+#include <assert.h>
+#include <string.h>
+#include <future>
+
+RenderCommandBuffer::RenderCommandBuffer()
+	: m_size(0)
+	, m_commandCount(0)
+{
+}
+
+void RenderCommandBuffer::Reset()
+{
+	m_size = 0;
+	m_commandCount = 0;
+}
+
+void RenderCommandBuffer::ClearTarget(uint32_t target, const float* color, float depth)
+{
+	ClearTargetCommand command = { target, { color[0], color[1], color[2], color[3] }, depth };
+	Write(RENDER_COMMAND_CLEAR_TARGET, &command, sizeof(command));
+}
+
+void RenderCommandBuffer::BindProgram(uint32_t program)
+{
+	BindProgramCommand command = { program };
+	Write(RENDER_COMMAND_BIND_PROGRAM, &command, sizeof(command));
+}
+
+void RenderCommandBuffer::BindTexture(uint32_t slot, uint32_t texture)
+{
+	BindTextureCommand command = { slot, texture };
+	Write(RENDER_COMMAND_BIND_TEXTURE, &command, sizeof(command));
+}
+
+void RenderCommandBuffer::BindVertexBuffer(uint32_t slot, uint32_t buffer)
+{
+	BindVertexBufferCommand command = { slot, buffer };
+	Write(RENDER_COMMAND_BIND_VERTEX_BUFFER, &command, sizeof(command));
+}
+
+void RenderCommandBuffer::BindIndexBuffer(uint32_t buffer)
+{
+	BindIndexBufferCommand command = { buffer };
+	Write(RENDER_COMMAND_BIND_INDEX_BUFFER, &command, sizeof(command));
+}
+
+void RenderCommandBuffer::DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex, uint32_t startInstance)
+{
+	DrawIndexedInstancedCommand command = { indexCount, instanceCount, startIndex, baseVertex, startInstance };
+	Write(RENDER_COMMAND_DRAW_INDEXED_INSTANCED, &command, sizeof(command));
+}
+
+void RenderCommandBuffer::Append(const RenderCommandBuffer& buffer)
+{
+	if (m_size + buffer.m_size > m_data.size())
+	{
+		m_data.resize((m_size + buffer.m_size) * 2);
+	}
+	memcpy(m_data.data() + m_size, buffer.m_data.data(), buffer.m_size);
+	m_size += buffer.m_size;
+	m_commandCount += buffer.m_commandCount;
+}
+
+const uint8_t* RenderCommandBuffer::GetData() const
+{
+	return m_data.data();
+}
+
+uint32_t RenderCommandBuffer::GetSize() const
+{
+	return m_size;
+}
+
+uint32_t RenderCommandBuffer::GetCommandCount() const
+{
+	return m_commandCount;
+}
+
+void RenderCommandBuffer::Write(RenderCommandType type, const void* pPayload, uint32_t payloadSize)
+{
+	// Payloads are made of 4-byte fields, packets stay 4-byte aligned
+	uint32_t size = sizeof(RenderCommandHeader) + payloadSize;
+	assert(size % 4 == 0 && size <= 0xFFFF);
+
+	if (m_size + size > m_data.size())
+	{
+		m_data.resize((m_size + size) * 2);
+	}
+
+	RenderCommandHeader header = { (uint16_t)type, (uint16_t)size };
+	memcpy(m_data.data() + m_size, &header, sizeof(header));
+	memcpy(m_data.data() + m_size + sizeof(header), pPayload, payloadSize);
+
+	m_size += size;
+	m_commandCount++;
+}
+
+void RenderCommandBackend::Replay(const RenderCommandBuffer& buffer)
+{
+	const uint8_t* pData = buffer.GetData();
+	const uint8_t* pEnd = pData + buffer.GetSize();
+	while (pData < pEnd)
+	{
+		const RenderCommandHeader* pHeader = (const RenderCommandHeader*)pData;
+		const void* pPayload = pData + sizeof(RenderCommandHeader);
+
+		switch (pHeader->type)
+		{
+		case RENDER_COMMAND_CLEAR_TARGET:
+			ClearTarget(*(const ClearTargetCommand*)pPayload);
+			break;
+		case RENDER_COMMAND_BIND_PROGRAM:
+			BindProgram(*(const BindProgramCommand*)pPayload);
+			break;
+		case RENDER_COMMAND_BIND_TEXTURE:
+			BindTexture(*(const BindTextureCommand*)pPayload);
+			break;
+		case RENDER_COMMAND_BIND_VERTEX_BUFFER:
+			BindVertexBuffer(*(const BindVertexBufferCommand*)pPayload);
+			break;
+		case RENDER_COMMAND_BIND_INDEX_BUFFER:
+			BindIndexBuffer(*(const BindIndexBufferCommand*)pPayload);
+			break;
+		case RENDER_COMMAND_DRAW_INDEXED_INSTANCED:
+			DrawIndexedInstanced(*(const DrawIndexedInstancedCommand*)pPayload);
+			break;
+		default:
+			assert(false);
+			break;
+		}
+
+		pData += pHeader->size;
+	}
+}
+
+void RenderCommandQueue::Record(uint32_t jobCount, const RecordJob& job)
+{
+	assert(jobCount > 0);
+
+	if (m_jobBuffers.size() < jobCount)
+	{
+		m_jobBuffers.resize(jobCount);
+	}
+	for (uint32_t i = 0; i < jobCount; i++)
+	{
+		m_jobBuffers[i].Reset();
+	}
+
+	std::vector<std::future<void>> workers;
+	for (uint32_t i = 1; i < jobCount; i++)
+	{
+		workers.push_back(std::async(std::launch::async, job, i, std::ref(m_jobBuffers[i])));
+	}
+	job(0, m_jobBuffers[0]);
+
+	for (std::future<void>& worker : workers)
+	{
+		worker.get();
+	}
+
+	m_merged.Reset();
+	for (uint32_t i = 0; i < jobCount; i++)
+	{
+		m_merged.Append(m_jobBuffers[i]);
+	}
+}
+
+const RenderCommandBuffer& RenderCommandQueue::GetMerged() const
+{
+	return m_merged;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+// Render commands as compact POD packets. Resources are referred to by
+// indices into tables owned by the backend, so recording needs no API objects
+// and can run on any thread.
+enum RenderCommandType
+{
+	RENDER_COMMAND_CLEAR_TARGET = 0,
+	RENDER_COMMAND_BIND_PROGRAM,
+	RENDER_COMMAND_BIND_TEXTURE,
+	RENDER_COMMAND_BIND_VERTEX_BUFFER,
+	RENDER_COMMAND_BIND_INDEX_BUFFER,
+	RENDER_COMMAND_DRAW_INDEXED_INSTANCED,
+	RENDER_COMMAND_COUNT
+};
+
+struct RenderCommandHeader
+{
+	uint16_t type;
+	uint16_t size; // including the header
+};
+
+struct ClearTargetCommand
+{
+	uint32_t target;
+	float color[4];
+	float depth; // negative keeps depth
+};
+
+struct BindProgramCommand
+{
+	uint32_t program;
+};
+
+struct BindTextureCommand
+{
+	uint32_t slot;
+	uint32_t texture;
+};
+
+struct BindVertexBufferCommand
+{
+	uint32_t slot;
+	uint32_t buffer;
+};
+
+struct BindIndexBufferCommand
+{
+	uint32_t buffer;
+};
+
+struct DrawIndexedInstancedCommand
+{
+	uint32_t indexCount;
+	uint32_t instanceCount;
+	uint32_t startIndex;
+	int32_t baseVertex;
+	uint32_t startInstance;
+};
+
+// Linear packet buffer, keeps its memory between Reset() calls
+class RenderCommandBuffer
+{
+public:
+	RenderCommandBuffer();
+
+	void Reset();
+
+	void ClearTarget(uint32_t target, const float* color, float depth);
+	void BindProgram(uint32_t program);
+	void BindTexture(uint32_t slot, uint32_t texture);
+	void BindVertexBuffer(uint32_t slot, uint32_t buffer);
+	void BindIndexBuffer(uint32_t buffer);
+	void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex, uint32_t startInstance);
+
+	void Append(const RenderCommandBuffer& buffer);
+
+	const uint8_t* GetData() const;
+	uint32_t GetSize() const;
+	uint32_t GetCommandCount() const;
+
+private:
+	void Write(RenderCommandType type, const void* pPayload, uint32_t payloadSize);
+
+private:
+	std::vector<uint8_t> m_data;
+	uint32_t m_size;
+	uint32_t m_commandCount;
+};
+
+// Executes packets, implemented once per graphics API
+class RenderCommandBackend
+{
+public:
+	virtual ~RenderCommandBackend() {}
+
+	virtual void ClearTarget(const ClearTargetCommand& command) = 0;
+	virtual void BindProgram(const BindProgramCommand& command) = 0;
+	virtual void BindTexture(const BindTextureCommand& command) = 0;
+	virtual void BindVertexBuffer(const BindVertexBufferCommand& command) = 0;
+	virtual void BindIndexBuffer(const BindIndexBufferCommand& command) = 0;
+	virtual void DrawIndexedInstanced(const DrawIndexedInstancedCommand& command) = 0;
+
+	void Replay(const RenderCommandBuffer& buffer);
+};
+
+// Per-job buffers recorded in parallel and merged in job order
+class RenderCommandQueue
+{
+public:
+	typedef std::function<void(uint32_t job, RenderCommandBuffer& buffer)> RecordJob;
+
+	// Job 0 runs on the calling thread
+	void Record(uint32_t jobCount, const RecordJob& job);
+
+	const RenderCommandBuffer& GetMerged() const;
+
+private:
+	std::vector<RenderCommandBuffer> m_jobBuffers;
+	RenderCommandBuffer m_merged;
+};
@@ -1,6 +1,8 @@
 #include "RenderWindow.h"
 #include <cassert>
 #include <chrono>
+#include <cstddef>
+#include "ToneMapper.h"
 
 #define SAFE_RELEASE(p) \
 if (p != nullptr) { \
@@ -18,16 +20,15 @@ RenderWindow::RenderWindow() :
 	, m_renderTargetTexture(nullptr)
 	, m_shaderResourceView(nullptr)
 	, m_pRasterizerState(nullptr)
-	, m_pAB_VS(nullptr)
-	, m_pAB_PS(nullptr)
-	, m_pDS_VS(nullptr)
-	, m_pDS_PS(nullptr)
-	, m_pU2_VS(nullptr)
-	, m_pU2_PS(nullptr)
+	, m_pShaderManager(nullptr)
+	, m_abProgramId(0)
+	, m_dsProgramId(0)
+	, m_u2ProgramId(0)
+	, m_pU2Variants(nullptr)
 	, m_pSamplerState(nullptr)
-	, m_pExposureBuffer(nullptr)
 	, m_pDevice(nullptr)
 	, m_pContext(nullptr)
+	, m_pStateCache(nullptr)
 	, m_downSamplingTexture(nullptr)
 	, m_screenWidth(0)
 	, m_screenHeight(0)
@@ -37,7 +38,7 @@ RenderWindow::RenderWindow() :
 {
 }
 
-bool RenderWindow::Init(ID3D11Device* device, ID3D11DeviceContext* context, int width, int height)
+bool RenderWindow::Init(ID3D11Device* device, StateCache* stateCache, ShaderManager* shaderManager, int width, int height)
 {
 	CalculateMinPower2(width, height);
 
@@ -46,7 +47,9 @@ bool RenderWindow::Init(ID3D11Device* device, ID3D11DeviceContext* context, int
 	D3D11_SHADER_RESOURCE_VIEW_DESC shaderResourceViewDesc;
 
 	m_pDevice = device;
-	m_pContext = context;
+	m_pStateCache = stateCache;
+	m_pContext = stateCache->GetContext();
+	m_pShaderManager = shaderManager;
 
 	// Initialize the render target texture description.
 	ZeroMemory(&textureDesc, sizeof(textureDesc));
@@ -72,15 +75,9 @@ bool RenderWindow::Init(ID3D11Device* device, ID3D11DeviceContext* context, int
 		return false;
 	}
 
-	D3D11_BUFFER_DESC constantBufferDesc = {};
-	constantBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	constantBufferDesc.ByteWidth = sizeof(ExposureBuffer);
-	constantBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	constantBufferDesc.CPUAccessFlags = 0;
-	constantBufferDesc.MiscFlags = 0;
-	constantBufferDesc.StructureByteStride = 0;
-
-	HRESULT hr = m_pDevice->CreateBuffer(&constantBufferDesc, nullptr, &m_pExposureBuffer);
+	ConstantBufferLayout exposureLayout("exposureBuffer");
+	exposureLayout.AddVariable("exposure", offsetof(ExposureBuffer, exposure), sizeof(XMFLOAT4));
+	HRESULT hr = m_exposureBuffer.Init(m_pDevice, exposureLayout);
 
 	D3D11_TEXTURE2D_DESC dsTextureDesc;
 	ZeroMemory(&dsTextureDesc, sizeof(dsTextureDesc));
@@ -187,47 +184,14 @@ bool RenderWindow::Init(ID3D11Device* device, ID3D11DeviceContext* context, int
 		}
 	}
 
-	// Create vertex shader
-	ShaderCompiler shaderCompiler;
-
-	ID3DBlob * pBlob = NULL;
-	m_pAB_VS = shaderCompiler.CreateVertexShader(m_pDevice, _T("ABShader.hlsl"), &pBlob);
-	// Create pixel shader
-	if (m_pAB_VS)
-	{
-		m_pAB_PS = shaderCompiler.CreatePixelShader(m_pDevice, _T("ABShader.hlsl"));
-	}
-	assert(m_pAB_VS != NULL && m_pAB_PS != NULL);
-	if (m_pAB_VS == NULL || m_pAB_PS == NULL)
-	{
-		result = E_FAIL;
-	}
+	// Request shader programs, ToneMap uses the fallback blit until they are compiled
+	m_abProgramId = m_pShaderManager->Request(_T("ABShader.hlsl"), SHADER_PRIORITY_DEFERRED);
+	m_dsProgramId = m_pShaderManager->Request(_T("DSShader.hlsl"), SHADER_PRIORITY_DEFERRED);
 
-	pBlob = nullptr;
-	m_pDS_VS = shaderCompiler.CreateVertexShader(m_pDevice, _T("DSShader.hlsl"), &pBlob);
-	// Create pixel shader
-	if (m_pDS_VS)
-	{
-		m_pDS_PS = shaderCompiler.CreatePixelShader(m_pDevice, _T("DSShader.hlsl"));
-	}
-	assert(m_pDS_VS != NULL && m_pDS_PS != NULL);
-	if (m_pDS_VS == NULL || m_pDS_PS == NULL)
-	{
-		result = E_FAIL;
-	}
-
-	pBlob = nullptr;
-	m_pU2_VS = shaderCompiler.CreateVertexShader(m_pDevice, _T("U2Shader.hlsl"), &pBlob);
-	// Create pixel shader
-	if (m_pU2_VS)
-	{
-		m_pU2_PS = shaderCompiler.CreatePixelShader(m_pDevice, _T("U2Shader.hlsl"));
-	}
-	assert(m_pU2_VS != NULL && m_pU2_PS != NULL);
-	if (m_pU2_VS == NULL || m_pU2_PS == NULL)
-	{
-		result = E_FAIL;
-	}
+	ShaderPermutationSpace u2Space;
+	UINT tonemapAxis = u2Space.AddAxis("TONEMAP_OPERATOR", 2);
+	m_pU2Variants = new ShaderVariantTable(u2Space);
+	m_u2ProgramId = m_pShaderManager->RequestVariant(*m_pU2Variants, _T("U2Shader.hlsl"), u2Space.SetValue(0, tonemapAxis, 0), SHADER_PRIORITY_DEFERRED);
 
 	return true;
 }
@@ -239,16 +203,12 @@ void RenderWindow::Term()
 	SAFE_RELEASE(m_renderTargetTexture);
 	SAFE_RELEASE(m_pRasterizerState);
 
-	SAFE_RELEASE(m_pAB_VS);
-	SAFE_RELEASE(m_pAB_PS);
-	SAFE_RELEASE(m_pDS_VS);
-	SAFE_RELEASE(m_pDS_PS);
-	SAFE_RELEASE(m_pU2_VS);
-	SAFE_RELEASE(m_pU2_PS);
+	delete m_pU2Variants;
+	m_pU2Variants = nullptr;
 
 	SAFE_RELEASE(m_pSamplerState);
 
-	SAFE_RELEASE(m_pExposureBuffer);
+	m_exposureBuffer.Term();
 
 	SAFE_RELEASE(m_pContext);
 	SAFE_RELEASE(m_pDevice);
@@ -285,9 +245,7 @@ float RenderWindow::CalculateAverageBrightness(ID3D11ShaderResourceView* srv)
 {
 	UINT textureSize = m_minPower2Value;
 
-	m_pContext->ClearState();
-
-	m_pContext->OMSetRenderTargets(1, &m_downSamplingRTVs[0], nullptr);
+	m_pStateCache->OMSetRenderTargets(1, &m_downSamplingRTVs[0], nullptr);
 
 	D3D11_VIEWPORT viewport = {};
 	viewport.TopLeftY = 0;
@@ -303,23 +261,25 @@ float RenderWindow::CalculateAverageBrightness(ID3D11ShaderResourceView* srv)
 	rect.right = textureSize;
 	rect.bottom = textureSize;
 
-	m_pContext->RSSetViewports(1, &viewport);
-	m_pContext->RSSetScissorRects(1, &rect);
-	m_pContext->RSSetState(m_pRasterizerState);
+	m_pStateCache->RSSetViewport(viewport);
+	m_pStateCache->RSSetScissorRect(rect);
+	m_pStateCache->RSSetState(m_pRasterizerState);
 
-	m_pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
-	m_pContext->IASetInputLayout(nullptr);
+	m_pStateCache->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	m_pStateCache->IASetInputLayout(nullptr);
 
-	m_pContext->VSSetShader(m_pAB_VS, nullptr, 0);
-	m_pContext->PSSetShader(m_pAB_PS, nullptr, 0);
+	const ShaderProgram& abProgram = m_pShaderManager->GetProgram(m_abProgramId);
+	m_pStateCache->VSSetShader(abProgram.pVertexShader);
+	m_pStateCache->PSSetShader(abProgram.pPixelShader);
 
-	m_pContext->PSSetSamplers(0, 1, &m_pSamplerState);
-	m_pContext->PSSetShaderResources(0, 1, &srv);
+	m_pStateCache->PSSetSamplers(0, 1, &m_pSamplerState);
+	m_pStateCache->PSSetShaderResources(0, 1, &srv);
 
 	m_pContext->Draw(4, 0);
 
-	m_pContext->VSSetShader(m_pDS_VS, nullptr, 0);
-	m_pContext->PSSetShader(m_pDS_PS, nullptr, 0);
+	const ShaderProgram& dsProgram = m_pShaderManager->GetProgram(m_dsProgramId);
+	m_pStateCache->VSSetShader(dsProgram.pVertexShader);
+	m_pStateCache->PSSetShader(dsProgram.pPixelShader);
 
 	int i = 0;
 	for (int n = textureSize >> 1; n > 0; n >>= 1, i++)
@@ -330,12 +290,12 @@ float RenderWindow::CalculateAverageBrightness(ID3D11ShaderResourceView* srv)
 		rect.right = n;
 		rect.bottom = n;
 
-		m_pContext->OMSetRenderTargets(1, &m_downSamplingRTVs[(size_t)i + 1], nullptr);
+		m_pStateCache->OMSetRenderTargets(1, &m_downSamplingRTVs[(size_t)i + 1], nullptr);
 
-		m_pContext->RSSetViewports(1, &viewport);
-		m_pContext->RSSetScissorRects(1, &rect);
+		m_pStateCache->RSSetViewport(viewport);
+		m_pStateCache->RSSetScissorRect(rect);
 
-		m_pContext->PSSetShaderResources(0, 1, &m_downSamplingSRVs[i]);
+		m_pStateCache->PSSetShaderResources(0, 1, &m_downSamplingSRVs[i]);
 
 		m_pContext->Draw(4, 0);
 	}
@@ -360,11 +320,15 @@ void RenderWindow::ToneMap(
 	float deltaTime,
 	FLOAT eyeAdaptationSpeed)
 {
-	Update(CalculateAverageBrightness(pSrcTextureSRV), deltaTime, eyeAdaptationSpeed);
-
-	m_pContext->ClearState();
+	bool programsReady = m_pShaderManager->IsReady(m_abProgramId)
+		&& m_pShaderManager->IsReady(m_dsProgramId)
+		&& m_pShaderManager->IsReady(m_u2ProgramId);
+	if (programsReady)
+	{
+		Update(CalculateAverageBrightness(pSrcTextureSRV), deltaTime, eyeAdaptationSpeed);
+	}
 
-	m_pContext->OMSetRenderTargets(1, &pDstTextureRTV, nullptr);
+	m_pStateCache->OMSetRenderTargets(1, &pDstTextureRTV, nullptr);
 
 	D3D11_VIEWPORT viewport = {};
 	viewport.TopLeftY = 0;
@@ -380,19 +344,21 @@ void RenderWindow::ToneMap(
 	rect.right = renderTargetWidth;
 	rect.bottom = renderTargetHeight;
 
-	m_pContext->RSSetViewports(1, &viewport);
-	m_pContext->RSSetScissorRects(1, &rect);
-	m_pContext->RSSetState(m_pRasterizerState);
+	m_pStateCache->RSSetViewport(viewport);
+	m_pStateCache->RSSetScissorRect(rect);
+	m_pStateCache->RSSetState(m_pRasterizerState);
 
-	m_pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
-	m_pContext->IASetInputLayout(nullptr);
+	m_pStateCache->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	m_pStateCache->IASetInputLayout(nullptr);
 
-	m_pContext->VSSetShader(m_pU2_VS, nullptr, 0);
-	m_pContext->PSSetShader(m_pU2_PS, nullptr, 0);
+	const ShaderProgram& program = programsReady ? m_pShaderManager->GetProgram(m_u2ProgramId) : m_pShaderManager->GetFallbackProgram();
+	m_pStateCache->VSSetShader(program.pVertexShader);
+	m_pStateCache->PSSetShader(program.pPixelShader);
 
-	m_pContext->PSSetSamplers(0, 1, &m_pSamplerState);
-	m_pContext->PSSetShaderResources(0, 1, &pSrcTextureSRV);
-	m_pContext->PSSetConstantBuffers(0, 1, &m_pExposureBuffer);
+	m_pStateCache->PSSetSamplers(0, 1, &m_pSamplerState);
+	m_pStateCache->PSSetShaderResources(0, 1, &pSrcTextureSRV);
+	ID3D11Buffer* constBuffers[] = { m_exposureBuffer.GetBuffer() };
+	m_pStateCache->PSSetConstantBuffers(0, 1, constBuffers);
 
 	m_pContext->Draw(4, 0);
 }
@@ -402,9 +368,10 @@ void RenderWindow::Update(float avgBrightness, float deltaTime, float eyeAdaptat
 	
 	EyeAdaptation(avgBrightness, deltaTime, eyeAdaptationSpeed);
 	static ExposureBuffer exposureBuffer = {};
-	exposureBuffer.exposure = { (1.03f - (2.0f / (2 + log10f(10 * m_adpBrightness + 1)))) / avgBrightness, 0.0f, 0.0f, 0.0f};
+	exposureBuffer.exposure = { ToneMapper::GetExposure(avgBrightness, m_adpBrightness), 0.0f, 0.0f, 0.0f};
 
-	m_pContext->UpdateSubresource(m_pExposureBuffer, 0, nullptr, &exposureBuffer, 0, 0);
+	m_exposureBuffer.Write(&exposureBuffer, sizeof(exposureBuffer));
+	m_exposureBuffer.Upload(m_pContext);
 }
 
 void RenderWindow::CalculateMinPower2(int a, int b)
@@ -5,7 +5,9 @@
 #include <DirectXMath.h>
 #include <d3dcompiler.h>
 #include <vector>
-#include "ShaderCompiler.h"
+#include "ShaderManager.h"
+#include "ConstantBuffer.h"
+#include "StateCache.h"
 
 using std::vector;
 
@@ -19,7 +21,7 @@ class RenderWindow
 	};
 public:
 	RenderWindow();
-	bool Init(ID3D11Device*, ID3D11DeviceContext*, int, int);
+	bool Init(ID3D11Device*, StateCache*, ShaderManager*, int, int);
 	void Term();
 	void SetRenderTarget(ID3D11DeviceContext* deviceContext, ID3D11DepthStencilView* depthStencilView);
 	void ClearRenderTarget(ID3D11DeviceContext* deviceContext, ID3D11DepthStencilView* depthStencilView);
@@ -45,21 +47,19 @@ private:
 	ID3D11ShaderResourceView* m_shaderResourceView;
 	ID3D11RasterizerState* m_pRasterizerState;
 
-	ID3D11VertexShader* m_pAB_VS;
-	ID3D11PixelShader* m_pAB_PS;
-
-	ID3D11VertexShader* m_pDS_VS;
-	ID3D11PixelShader* m_pDS_PS;
-
-	ID3D11VertexShader* m_pU2_VS;
-	ID3D11PixelShader* m_pU2_PS;
+	ShaderManager* m_pShaderManager;
+	UINT m_abProgramId;
+	UINT m_dsProgramId;
+	UINT m_u2ProgramId;
+	ShaderVariantTable* m_pU2Variants;
 
 	ID3D11SamplerState* m_pSamplerState;
 
-	ID3D11Buffer* m_pExposureBuffer;
+	ConstantBuffer m_exposureBuffer;
 
 	ID3D11Device* m_pDevice;
 	ID3D11DeviceContext* m_pContext;
+	StateCache* m_pStateCache;
 	
 	ID3D11Texture2D* m_downSamplingTexture;
 	vector<ID3D11ShaderResourceView*> m_downSamplingSRVs;
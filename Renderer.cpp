@@ -1,19 +1,119 @@
 #include "Renderer.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <tchar.h>
 #include <assert.h>
 #include <DirectXMath.h>
 #include <d3dcompiler.h>
+#include "BuiltinScene.h"
 #include "DDSTextureLoader11.h"
+#include "MeshImporter.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "VertexCompression.h"
 
 #include <chrono>
+#include <thread>
+#include <cstddef>
 #define _USE_MATH_DEFINES
 #include <math.h>
 
 using namespace DirectX;
 
-static const UINT IndicesCount = 42;
+static const UINT MaxMaterialCount = 8;
+static const UINT InitialInstanceCapacity = 1024;
+static const UINT InitialShaderBufferCapacity = 1024;
+
+// Ranges of the shared index buffer drawn as separate meshes,
+// the model is only present if a scene file was loaded
+enum SceneMesh
+{
+	SCENE_MESH_CUBE = 0,
+	SCENE_MESH_PLANE,
+	SCENE_MESH_MODEL,
+	SCENE_MESH_COUNT
+};
+
+static_assert(SCENE_MESH_MODEL == BuiltinScene::MESH_COUNT, "Built-in meshes come first in the scene mesh list");
+
+// First one found is loaded next to the cube
+static const char* SceneModelPaths[] = { "scene.glb", "scene.gltf", "scene.obj" };
+
+// Loaded meshes are reordered for a FIFO cache of this size, overdraw
+// clusters may cost up to 5% of the cache efficiency
+static const uint32_t PostTransformCacheSize = 16;
+static const float OverdrawThreshold = 1.05f;
+
+// Meshes get up to four reduced levels deviating at most 5% of their size.
+// The coarsest level whose error projects under LodPixelError is drawn, a
+// change has to clear that by LodHysteresis so levels do not pop back and forth.
+static const uint32_t MaxLodCount = 5;
+static const float LodMaxError = 0.05f;
+static const float LodPixelError = 1.0f;
+static const float LodHysteresis = 0.25f;
+
+// Levels with fewer triangles are drawn whole, culling their meshlets costs
+// more than it saves
+static const UINT MinMeshletTriangles = 4 * MeshletBuilder::MaxTriangles;
+
+// Default size of a static geometry page, larger meshes get a page of their own
+static const uint32_t StaticPageVertexCount = 1 << 20;
+static const uint32_t StaticPageIndexCount = 1 << 22;
+
+// Draw list passes and texture table indices
+enum DrawPass
+{
+	DRAW_PASS_OPAQUE = 0
+};
+
+enum SceneTexture
+{
+	SCENE_TEXTURE_WOOD = 0,
+	SCENE_TEXTURE_COUNT
+};
+
+// Command backend target table indices
+enum SceneTarget
+{
+	SCENE_TARGET_BACK_BUFFER = 0,
+	SCENE_TARGET_HDR
+};
+
+// Vertex buffer table indices are the geometry pages
+enum SceneIndexBuffer
+{
+	SCENE_INDEX_BUFFER_MESHLETS = 0,
+	SCENE_INDEX_BUFFER_FIRST_PAGE
+};
+
+// Finest light grid cells, about the range of the field lights
+static const float LightCellSize = 1.0f;
+
+// Cluster grid of the scene lights, 64 pixel tiles and exponential depth slices
+static const uint32_t ClusterTileSize = 64;
+static const uint32_t ClusterSliceCount = 32;
+
+// Sorted draws recorded per job, smaller lists are recorded on the render thread alone
+static const size_t MinDrawsPerRecordJob = 512;
+
+// Bounds of a box after an affine transform, row-vector convention
+static BoundingBox TransformBox(const BoundingBox& box, const TransformStore::Matrix& world)
+{
+	BoundingBox result;
+	for (int j = 0; j < 3; j++)
+	{
+		result.center[j] = world.m[12 + j];
+		result.extent[j] = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			result.center[j] += box.center[i] * world.m[i * 4 + j];
+			result.extent[j] += box.extent[i] * fabsf(world.m[i * 4 + j]);
+		}
+	}
+	return result;
+}
 
 struct TextureVertex
 {
@@ -22,6 +122,23 @@ struct TextureVertex
 	XMFLOAT3 normal;
 };
 
+static_assert(sizeof(TextureVertex) == 36, "VertexCompression::GetVertexSize expects 36 byte float vertices");
+
+// Instance transform that also decodes packed positions, the basis is scaled
+// by the quantization scale and the offset is moved into the translation
+static void DequantizeWorld(const TransformStore::Matrix& world, const PositionQuantization& quantization, float* pWorld)
+{
+	for (int j = 0; j < 4; j++)
+	{
+		pWorld[12 + j] = world.m[12 + j];
+		for (int i = 0; i < 3; i++)
+		{
+			pWorld[i * 4 + j] = world.m[i * 4 + j] * quantization.scale;
+			pWorld[12 + j] += quantization.offset[i] * world.m[i * 4 + j];
+		}
+	}
+}
+
 struct ModelBuffer
 {
 	XMMATRIX modelMatrix;
@@ -35,14 +152,57 @@ struct Light
 	XMVECTORF32 power; // mb another type?
 };
 
+// Range in position w, power y selects the windowed falloff
+static Light MakeShaderLight(const LightManager::Light& light)
+{
+	Light result;
+	result.pos = XMVECTORF32{ light.position[0], light.position[1], light.position[2], light.range };
+	result.color = XMVECTORF32{ light.color[0], light.color[1], light.color[2], 0 };
+	result.power = XMVECTORF32{ light.power, light.falloff == LightManager::FALLOFF_WINDOWED ? 1.0f : 0.0f, 0, 0 };
+	return result;
+}
+
 struct SceneBuffer
 {
 	XMMATRIX VP;
 	XMVECTORI32 lightParams; // x - lights count
 
 	Light lights[4];
+	XMVECTORF32 clusterParams; // x - 1 / tile size, y - slice scale, z - slice bias
+	XMVECTORI32 clusterGrid; // x, y - tiles, z - slices
 };
 
+struct MaterialBuffer
+{
+	XMFLOAT4 colors[MaxMaterialCount];
+};
+
+static ConstantBufferLayout ModelBufferLayout()
+{
+	ConstantBufferLayout layout("ModelBuffer");
+	layout.AddVariable("modelMatrix", offsetof(ModelBuffer, modelMatrix), sizeof(XMMATRIX));
+	layout.AddVariable("normalMatrix", offsetof(ModelBuffer, normalMatrix), sizeof(XMMATRIX));
+	return layout;
+}
+
+static ConstantBufferLayout SceneBufferLayout()
+{
+	ConstantBufferLayout layout("SceneBuffer");
+	layout.AddVariable("VP", offsetof(SceneBuffer, VP), sizeof(XMMATRIX));
+	layout.AddVariable("lightParams", offsetof(SceneBuffer, lightParams), sizeof(XMVECTORI32));
+	layout.AddVariable("lights", offsetof(SceneBuffer, lights), sizeof(SceneBuffer::lights));
+	layout.AddVariable("clusterParams", offsetof(SceneBuffer, clusterParams), sizeof(XMVECTORF32));
+	layout.AddVariable("clusterGrid", offsetof(SceneBuffer, clusterGrid), sizeof(XMVECTORI32));
+	return layout;
+}
+
+static ConstantBufferLayout MaterialBufferLayout()
+{
+	ConstantBufferLayout layout("MaterialBuffer");
+	layout.AddVariable("materialColors", offsetof(MaterialBuffer, colors), sizeof(MaterialBuffer::colors));
+	return layout;
+}
+
 #define SAFE_RELEASE(p) \
 if (p != NULL) { \
 	p->Release(); \
@@ -61,18 +221,34 @@ Renderer::Renderer()
 	, m_pDepthDSV(nullptr)
 	, m_width(0)
 	, m_height(0)
-	, m_pVertexBuffer(nullptr)
-	, m_pIndexBuffer(nullptr)
-	, m_pVertexShader(nullptr)
-	, m_pPixelShader(nullptr)
+	, m_pInstanceBuffer(nullptr)
+	, m_instanceCapacity(0)
+	, m_instancesDirty(false)
+	, m_pMeshletIndexBuffer(nullptr)
+	, m_meshletsDirty(false)
+	, m_meshletStats()
+	, m_lightSetup(BuiltinScene::LIGHTS_RED)
+	, m_switchLight(LightManager::InvalidLight)
+	, m_lightMode(LIGHT_MODE_ARRAY)
+	, m_instanceLightVersion(0)
+	, m_lightBufferVersion(0)
+	, m_lightStats()
+	, m_lightBuffer()
+	, m_clusterRangeBuffer()
+	, m_clusterIndexBuffer()
+	, m_modelEntity(0)
+	, m_pColorVariants(nullptr)
+	, m_colorProgramId(0)
+	, m_colorProgramVersion(0)
 	, m_pInputLayout(nullptr)
 	, m_pTexture(nullptr)
 	, m_pTextureSRV(nullptr)
 	, m_pSamplerState(nullptr)
-	, m_pModelBuffer(nullptr)
-	, m_pSceneBuffer(nullptr)
+	, m_constantBytesUploaded(0)
+	, m_modelAllocation()
 	, m_pRasterizerState(nullptr)
-	, m_pShaderCompiler(nullptr)
+	, m_pShaderManager(nullptr)
+	, m_pStateCache(nullptr)
 	, m_usec(0)
 	, m_currSec(0)
 	, m_lon(0.0f)
@@ -83,13 +259,17 @@ Renderer::Renderer()
 	, m_pRenderWindow(nullptr)
 	, m_lightPower(1)
 	, m_elapsedSec(0)
+	, m_firstFrameTraced(false)
+	, m_completeFrameTraced(false)
 {
 }
 
-bool Renderer::Init(HWND hWnd)
+bool Renderer::Init(HWND hWnd, BuiltinScene::LightSetup lightSetup)
 {
 	HRESULT result;
 
+	m_lightSetup = lightSetup;
+
 	// Create a DirectX graphics interface factory.
 	IDXGIFactory* pFactory = NULL;
 	result = CreateDXGIFactory(__uuidof(IDXGIFactory), (void**)&pFactory);
@@ -168,6 +348,17 @@ bool Renderer::Init(HWND hWnd)
 	// Create scene for render
 	if (SUCCEEDED(result))
 	{
+		m_pStateCache = new StateCache();
+		m_pStateCache->Init(m_pContext);
+
+		m_pShaderManager = new ShaderManager();
+		m_pShaderManager->Init(m_pDevice);
+
+		m_commandBackend.Init(m_pStateCache, m_pShaderManager);
+#ifdef _DEBUG
+		m_pShaderManager->EnableHotReload();
+#endif
+
 		result = CreateScene();
 	}
 
@@ -190,7 +381,12 @@ bool Renderer::Init(HWND hWnd)
 	}
 
 	m_pRenderWindow = new RenderWindow();
-	m_pRenderWindow->Init(m_pDevice, m_pContext, m_width, m_height);
+	m_pRenderWindow->Init(m_pDevice, m_pStateCache, m_pShaderManager, m_width, m_height);
+
+#ifdef SHADER_STARTUP_BLOCKING
+	// Reference path for startup traces: wait for every program before the first frame
+	m_pShaderManager->Flush();
+#endif
 
 	SAFE_RELEASE(pSelectedAdapter);
 	SAFE_RELEASE(pFactory);
@@ -202,6 +398,12 @@ void Renderer::Term()
 {
 	DestroyScene();
 
+	m_commandBackend.Term();
+
+	m_pShaderManager->Term();
+	delete m_pShaderManager;
+	m_pShaderManager = nullptr;
+
 	SAFE_RELEASE(m_pDepthDSV);
 	SAFE_RELEASE(m_pDepth);
 	SAFE_RELEASE(m_pBackBufferRTV);
@@ -213,21 +415,25 @@ void Renderer::Term()
 
 	SAFE_RELEASE(m_pRasterizerState);
 
-	delete m_pShaderCompiler;
-	m_pShaderCompiler = nullptr;
-
 	SAFE_RELEASE(m_pRenderSRV);
 	SAFE_RELEASE(m_pRenderTexture);
 
 	m_pRenderWindow->Term();
 	delete m_pRenderWindow;
 	m_pRenderWindow = nullptr;
+
+	m_pStateCache->Term();
+	delete m_pStateCache;
+	m_pStateCache = nullptr;
 }
 
 void Renderer::Resize(UINT width, UINT height)
 {
 	if (width != m_width || height != m_height)
 	{
+		// Bound views keep the swap chain buffers alive
+		m_pStateCache->ClearState();
+
 		SAFE_RELEASE(m_pDepthDSV);
 		SAFE_RELEASE(m_pDepth);
 		SAFE_RELEASE(m_pBackBufferRTV);
@@ -256,15 +462,70 @@ bool Renderer::Update()
 	m_elapsedSec = (usec - m_currSec) / 1000000.0f;
 	m_currSec = usec;
 
-	ModelBuffer cb;
-	XMMATRIX m = XMMatrixRotationAxis({ 0,1,0 }, 0);
+	m_constantRing.BeginFrame();
+
+	// Publish programs compiled in background between frames
+	m_pShaderManager->Update();
+	if (m_pShaderManager->GetVersion(m_colorProgramId) != m_colorProgramVersion)
+	{
+		// Input signature may have changed with a reloaded program
+		m_colorProgramVersion = m_pShaderManager->GetVersion(m_colorProgramId);
+		SAFE_RELEASE(m_pInputLayout);
+		CreateInputLayout();
+
+		// Check the hand-mirrored structs against the shader reflection
+		const ShaderProgram& program = m_pShaderManager->GetProgram(m_colorProgramId);
+		bool layoutsMatch = m_modelBuffer.Validate(program.pVSBlob)
+			&& m_sceneBuffer.Validate(program.pVSBlob)
+			&& m_sceneBuffer.Validate(program.pPSBlob)
+			&& m_materialBuffer.Validate(program.pPSBlob);
+		assert(layoutsMatch);
+	}
+
+	// Recompose world and normal matrices of entities moved since the last frame
+	m_transforms.Update();
 
-	cb.modelMatrix = XMMatrixTranspose(m);
-	cb.normalMatrix = XMMatrixInverse(NULL, m);
-	m_pContext->UpdateSubresource(m_pModelBuffer, 0, NULL, &cb, 0, 0);
+	bool objectsMoved = false;
+	for (const SceneObject& object : m_objects)
+	{
+		objectsMoved = objectsMoved || m_transforms.WasChanged(object.entity);
+	}
+	if (objectsMoved)
+	{
+		std::vector<BoundingBox> bounds;
+		for (const SceneObject& object : m_objects)
+		{
+			bounds.push_back(TransformBox(m_meshes[object.mesh].bounds, m_transforms.GetWorld(object.entity)));
+		}
+		m_objectTree.Build(bounds.data(), (uint32_t)bounds.size());
+	}
+
+	// Store keeps the inverse transpose, the shader expects it transposed like the model matrix
+	XMMATRIX model = XMMatrixTranspose(XMLoadFloat4x4((const XMFLOAT4X4*)m_transforms.GetWorld(m_modelEntity).m));
+	XMMATRIX normal = XMMatrixTranspose(XMLoadFloat4x4((const XMFLOAT4X4*)m_transforms.GetNormal(m_modelEntity).m));
+
+	// Per-object constants go straight into the mapped ring memory
+	if (m_constantRing.IsSupported())
+	{
+		ModelBuffer* pModel = (ModelBuffer*)m_constantRing.Map(sizeof(ModelBuffer), &m_modelAllocation);
+		if (pModel != nullptr)
+		{
+			pModel->modelMatrix = model;
+			pModel->normalMatrix = normal;
+			m_constantRing.Unmap();
+		}
+	}
+	else
+	{
+		ModelBuffer cb;
+		cb.modelMatrix = model;
+		cb.normalMatrix = normal;
+		m_modelBuffer.Write(&cb, sizeof(cb));
+	}
 
 	// Setup scene buffer
 	SceneBuffer scb;
+	ZeroMemory(&scb, sizeof(scb));
 
 	static const float nearPlane = 0.001f;
 	static const float farPlane = 100.0f;
@@ -276,23 +537,162 @@ bool Renderer::Update()
 
 	float width = nearPlane / tanf(fov / 2.0);
 	float height = ((float)m_height / m_width) * width;
-	scb.VP = XMMatrixTranspose(view * XMMatrixPerspectiveLH(width, height, nearPlane, farPlane));
+	XMMATRIX viewProj = view * XMMatrixPerspectiveLH(width, height, nearPlane, farPlane);
+	scb.VP = XMMatrixTranspose(viewProj);
+
+	// Object bounds are relative to the model transform like the instances
+	XMFLOAT4X4 cullMatrix;
+	XMStoreFloat4x4(&cullMatrix, XMLoadFloat4x4((const XMFLOAT4X4*)m_transforms.GetWorld(m_modelEntity).m) * viewProj);
+	m_culler.SetViewProjection(&cullMatrix.m[0][0]);
+
+	m_visibleObjects.swap(m_prevVisibleObjects);
+	m_visibleObjects.clear();
+	m_objectTree.Cull(m_culler, m_visibleObjects);
+
+	// Levels of detail by projected error, a unit at view depth z covers
+	// m_height * nearPlane / (height * z) pixels. Batches are ordered front to
+	// back by the nearest visible object of each level.
+	float lodDepth[SCENE_MESH_COUNT * MaxLodCount];
+	for (UINT lod = 0; lod < (UINT)m_lods.size(); lod++)
+	{
+		lodDepth[lod] = 1.0f;
+	}
+
+	bool lodsChanged = false;
+	float pixelsPerUnit = m_height * nearPlane / height;
+	for (uint32_t index : m_visibleObjects)
+	{
+		SceneObject& object = m_objects[index];
+		const MeshRange& mesh = m_meshes[object.mesh];
+		const TransformStore::Matrix& world = m_transforms.GetWorld(object.entity);
+		BoundingBox box = TransformBox(mesh.bounds, world);
+		XMVECTOR clipPos = XMVector3Transform(XMVectorSet(box.center[0], box.center[1], box.center[2], 1.0f), XMLoadFloat4x4(&cullMatrix));
+
+		float radius = sqrtf(box.extent[0] * box.extent[0] + box.extent[1] * box.extent[1] + box.extent[2] * box.extent[2]);
+		float nearest = XMVectorGetW(clipPos) - radius;
+		float scale = sqrtf(world.m[0] * world.m[0] + world.m[1] * world.m[1] + world.m[2] * world.m[2]);
+		float pixels = scale * pixelsPerUnit / (nearest > nearPlane ? nearest : nearPlane);
+
+		const MeshLod* pLods = &m_lods[mesh.firstLod];
+		UINT lod = object.lod;
+		while (lod > 0 && pLods[lod].error * pixels > LodPixelError * (1.0f + LodHysteresis))
+		{
+			lod--;
+		}
+		while (lod + 1 < mesh.lodCount && pLods[lod + 1].error * pixels < LodPixelError * (1.0f - LodHysteresis))
+		{
+			lod++;
+		}
+		lodsChanged = lodsChanged || lod != object.lod;
+		object.lod = lod;
+
+		float depth = XMVectorGetW(clipPos) / farPlane;
+		if (depth < lodDepth[mesh.firstLod + lod])
+		{
+			lodDepth[mesh.firstLod + lod] = depth;
+		}
+	}
+
+	// Only lights changed since the last frame are relinked
+	if (m_lightManager.IsAlive(m_switchLight) && m_lightManager.GetLight(m_switchLight).power != m_lightPower)
+	{
+		m_lightManager.SetPower(m_switchLight, m_lightPower);
+	}
+	m_lightManager.Update();
+	bool instanceLightsChanged = m_lightMode == LIGHT_MODE_OBJECT && m_lightManager.GetVersion() != m_instanceLightVersion;
+	m_instanceLightVersion = m_lightManager.GetVersion();
+
+	// Instance stream holds only visible objects, batched by level
+	if (objectsMoved || lodsChanged || instanceLightsChanged || m_visibleObjects != m_prevVisibleObjects)
+	{
+		m_instanceBatcher.Clear();
+		for (uint32_t index : m_visibleObjects)
+		{
+			const SceneObject& object = m_objects[index];
+			const MeshRange& mesh = m_meshes[object.mesh];
+			float world[16];
+			DequantizeWorld(m_transforms.GetWorld(object.entity), mesh.quantization, world);
+
+			// Lights are in world space, object bounds relative to the model transform
+			uint32_t lights[MaxInstanceLights];
+			if (m_lightMode == LIGHT_MODE_OBJECT)
+			{
+				BoundingBox box = TransformBox(TransformBox(mesh.bounds, m_transforms.GetWorld(object.entity)), m_transforms.GetWorld(m_modelEntity));
+				m_lightManager.Assign(box.center, box.extent, MaxInstanceLights, lights);
+			}
+			m_instanceBatcher.Add(world, mesh.firstLod + object.lod, object.material, m_lightMode == LIGHT_MODE_OBJECT ? lights : nullptr);
+		}
+		m_instancesDirty = true;
+	}
+
+	// Camera relative to the model transform, like the culled bounds
+	XMFLOAT3 cameraPosition;
+	XMMATRIX modelWorld = XMLoadFloat4x4((const XMFLOAT4X4*)m_transforms.GetWorld(m_modelEntity).m);
+	XMStoreFloat3(&cameraPosition, XMVector3Transform(XMVector3Transform(XMVectorZero(), shift * rot), XMMatrixInverse(nullptr, modelWorld)));
+	CullMeshlets(&cullMatrix.m[0][0], &cameraPosition.x);
 	
-	scb.lightParams.i[0] = 3;
-	scb.lights[0].pos = XMVECTORF32{ 2.5f, 0.2f, -0.289f, 0.f };
-	scb.lights[0].color = XMVECTORF32{ 0.75f, 0, 0, 0 };
-	scb.lights[0].power = XMVECTORF32{ 1, 0, 0, 0 };
+	// Handles of destroyed lights are skipped, the live ones packed to the front
+	if (m_lightMode == LIGHT_MODE_ARRAY)
+	{
+		UINT count = 0;
+		for (uint32_t light = 0; light < m_lightManager.GetCapacity() && count < ColorShaderVariants::MaxLightCount; light++)
+		{
+			if (m_lightManager.IsAlive(light))
+			{
+				scb.lights[count++] = MakeShaderLight(m_lightManager.GetLight(light));
+			}
+		}
+		scb.lightParams.i[0] = count;
+	}
+
+	// Lights of every cluster of the view frustum
+	m_lightStats = LightClusterStats();
+	if (m_lightMode == LIGHT_MODE_CLUSTERED)
+	{
+		XMFLOAT4X4 viewMatrix;
+		XMStoreFloat4x4(&viewMatrix, view);
+		BinLights(&viewMatrix.m[0][0], width * 0.5f / nearPlane, height * 0.5f / nearPlane, nearPlane, farPlane);
+
+		scb.clusterParams = XMVECTORF32{ 1.0f / m_lightClusterer.GetTileSize(), m_lightClusterer.GetSliceScale(), m_lightClusterer.GetSliceBias(), 0 };
+		scb.clusterGrid = XMVECTORI32{ (int)m_lightClusterer.GetTilesX(), (int)m_lightClusterer.GetTilesY(), (int)m_lightClusterer.GetSliceCount(), 0 };
+	}
+	if (m_lightMode != LIGHT_MODE_ARRAY)
+	{
+		UpdateLightBuffers();
+	}
 
-	scb.lights[1].pos = XMVECTORF32{ 2.5f, 0.2f, 0.289f, 0 };
-	scb.lights[1].color = XMVECTORF32{ 0.75f, 0, 0, 0 };
-	scb.lights[1].power = XMVECTORF32{ 1, 0, 0, 0 };
 
-	scb.lights[2].pos = XMVECTORF32{ 2, 0.2f, 0, 0 };
-	scb.lights[2].color = XMVECTORF32{ 0.75f, 0, 0, 0 };
-	scb.lights[2].power = XMVECTORF32{ m_lightPower, 0, 0, 0 };
+	m_sceneBuffer.Write(&scb, sizeof(scb));
 
+	if (m_instancesDirty)
+	{
+		m_instancesDirty = FAILED(UpdateInstanceBuffer());
+	}
+	if (m_meshletsDirty)
+	{
+		m_meshletsDirty = FAILED(UpdateMeshletIndexBuffer());
+	}
+
+	// Batches are ordered by state, then by depth
+	m_drawList.Clear();
+	const std::vector<InstanceBatch>& batches = m_instanceBatcher.GetBatches();
+	for (UINT i = 0; i < (UINT)batches.size(); i++)
+	{
+		const MeshLod& lod = m_lods[batches[i].mesh];
+		if (lod.meshletCount > 0 && lod.visibleIndexCount == 0)
+		{
+			continue;
+		}
+		m_drawList.Add(DrawList::MakeKey(DRAW_PASS_OPAQUE, m_colorProgramId, 0, SCENE_TEXTURE_WOOD, lodDepth[batches[i].mesh]), i);
+	}
+	m_drawList.Sort();
 
-	m_pContext->UpdateSubresource(m_pSceneBuffer, 0, NULL, &scb, 0, 0);
+	// Only registers that changed since the last frame are uploaded
+	m_constantBytesUploaded = m_sceneBuffer.Upload(m_pContext) + m_materialBuffer.Upload(m_pContext) + m_constantRing.GetBytesAllocated();
+	if (!m_constantRing.IsSupported())
+	{
+		m_constantBytesUploaded += m_modelBuffer.Upload(m_pContext);
+	}
 
 	return true;
 }
@@ -332,6 +732,26 @@ void Renderer::SwitchLightMode(float value)
 	m_lightPower = value;
 }
 
+const StateCache* Renderer::GetStateCache() const
+{
+	return m_pStateCache;
+}
+
+UINT Renderer::GetConstantBytesUploaded() const
+{
+	return m_constantBytesUploaded;
+}
+
+const Renderer::MeshletStats& Renderer::GetMeshletStats() const
+{
+	return m_meshletStats;
+}
+
+const Renderer::LightClusterStats& Renderer::GetLightClusterStats() const
+{
+	return m_lightStats;
+}
+
 HRESULT Renderer::SetupBackBuffer()
 {
 	ID3D11Texture2D* pBackBuffer = NULL;
@@ -396,151 +816,337 @@ HRESULT Renderer::SetupBackBuffer()
 	return result;
 }
 
-HRESULT Renderer::CreateScene()
+// Appends the first scene file found, its index range starts at the end of indices
+static bool LoadSceneModel(std::vector<MeshVertex>& vertices, std::vector<UINT32>& indices, BoundingBox* pBounds)
 {
-	// Textured cube
-	static const TextureVertex Vertices[28] = {
-		// Bottom face
-		{{-0.5, -0.5,  0.5, 1}, {0,1}, {0,-1,0}},
-		{{ 0.5, -0.5,  0.5, 1}, {1,1}, {0,-1,0}},
-		{{ 0.5, -0.5, -0.5, 1}, {1,0}, {0,-1,0}},
-		{{-0.5, -0.5, -0.5, 1}, {0,0}, {0,-1,0}},
-		// Top face
-		{{-0.5,  0.5, -0.5, 1}, {0,1}, {0,1,0}},
-		{{ 0.5,  0.5, -0.5, 1}, {1,1}, {0,1,0}},
-		{{ 0.5,  0.5,  0.5, 1}, {1,0}, {0,1,0}},
-		{{-0.5,  0.5,  0.5, 1}, {0,0}, {0,1,0}},
-		// Front face
-		{{ 0.5, -0.5, -0.5, 1}, {0,1}, {1,0,0}},
-		{{ 0.5, -0.5,  0.5, 1}, {1,1}, {1,0,0}},
-		{{ 0.5,  0.5,  0.5, 1}, {1,0}, {1,0,0}},
-		{{ 0.5,  0.5, -0.5, 1}, {0,0}, {1,0,0}},
-		// Back face
-		{{-0.5, -0.5,  0.5, 1}, {0,1}, {-1,0,0}},
-		{{-0.5, -0.5, -0.5, 1}, {1,1}, {-1,0,0}},
-		{{-0.5,  0.5, -0.5, 1}, {1,0}, {-1,0,0}},
-		{{-0.5,  0.5,  0.5, 1}, {0,0}, {-1,0,0}},
-		// Left face
-		{{ 0.5, -0.5,  0.5, 1}, {0,1}, {0,0,1}},
-		{{-0.5, -0.5,  0.5, 1}, {1,1}, {0,0,1}},
-		{{-0.5,  0.5,  0.5, 1}, {1,0}, {0,0,1}},
-		{{ 0.5,  0.5,  0.5, 1}, {0,0}, {0,0,1}},
-		// Right face
-		{{-0.5, -0.5, -0.5, 1}, {0,1}, {0,0,-1}},
-		{{ 0.5, -0.5, -0.5, 1}, {1,1}, {0,0,-1}},
-		{{ 0.5,  0.5, -0.5, 1}, {1,0}, {0,0,-1}},
-		{{-0.5,  0.5, -0.5, 1}, {0,0}, {0,0,-1}},
-
-		// Plane
-		{{ 4.5, -0.5,-2,  1}, {0,1}, {0,1,0}},
-		{{  4.5,  -0.5,2, 1}, {1,1}, {0,1,0}},
-		{{ 0.75,  -0.5, 2,  1}, {1,0}, {0,1,0}},
-		{{ 0.75, -0.5, -2, 1}, {0,0}, {0,1,0}},
+	for (const char* path : SceneModelPaths)
+	{
+		if (GetFileAttributesA(path) == INVALID_FILE_ATTRIBUTES)
+		{
+			continue;
+		}
 
+		auto start = std::chrono::steady_clock::now();
 
+		MeshImporter importer;
+		MeshData mesh;
+		char msg[256];
+		bool loaded = importer.Load(path, mesh);
+		if (!loaded || mesh.indices.empty())
+		{
+			sprintf_s(msg, "[Scene] %s is not loaded: %s\n", path, loaded ? "no triangles" : importer.GetErrorMessage());
+			OutputDebugStringA(msg);
+			continue;
+		}
+
+		// Reorder for the post-transform cache, then for overdraw, then for vertex fetch
+		uint32_t vertexCount = (uint32_t)mesh.vertices.size();
+		MeshOptimizer::VertexCacheStats before = MeshOptimizer::AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(),
+			vertexCount, PostTransformCacheSize, MeshOptimizer::CACHE_FIFO);
+
+		MeshOptimizer::OptimizeVertexCache(mesh.indices.data(), mesh.indices.size(), vertexCount);
+		MeshOptimizer::OptimizeOverdraw(mesh.indices.data(), mesh.indices.size(), mesh.vertices[0].position, sizeof(MeshVertex),
+			vertexCount, OverdrawThreshold);
+		vertexCount = MeshOptimizer::OptimizeVertexFetch(mesh.vertices.data(), mesh.indices.data(), mesh.indices.size(),
+			vertexCount, sizeof(MeshVertex));
+		mesh.vertices.resize(vertexCount);
+
+		MeshOptimizer::VertexCacheStats after = MeshOptimizer::AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(),
+			vertexCount, PostTransformCacheSize, MeshOptimizer::CACHE_FIFO);
+
+		UINT32 baseVertex = (UINT32)vertices.size();
+		vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+		indices.reserve(indices.size() + mesh.indices.size());
+		for (uint32_t index : mesh.indices)
+		{
+			indices.push_back(baseVertex + index);
+		}
+
+		for (int i = 0; i < 3; i++)
+		{
+			pBounds->center[i] = (mesh.boundsMin[i] + mesh.boundsMax[i]) * 0.5f;
+			pBounds->extent[i] = (mesh.boundsMax[i] - mesh.boundsMin[i]) * 0.5f;
+		}
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		sprintf_s(msg, "[Scene] %s: %u vertices, %u triangles, %.1f ms, %.1f MB/s\n", path,
+			(UINT)mesh.vertices.size(), (UINT)mesh.indices.size() / 3, ms, importer.GetBytesParsed() / (ms * 1000.0));
+		OutputDebugStringA(msg);
+		sprintf_s(msg, "[Scene] ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", before.acmr, after.acmr, before.atvr, after.atvr);
+		OutputDebugStringA(msg);
+		return true;
+	}
+	return false;
+}
+
+HRESULT Renderer::CreateScene()
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<UINT32> indices;
+	BuiltinScene::MeshRange builtinRanges[BuiltinScene::MESH_COUNT];
+	BuiltinScene::AddMeshes(&vertices, &indices, builtinRanges);
+
+	// Full detail index ranges of the meshes in the loaded lists
+	struct IndexRange
+	{
+		UINT startIndex;
+		UINT indexCount;
 	};
-	static const UINT16 Indices[IndicesCount] = {
-		0, 2, 1, 0, 3, 2,
-		4, 6, 5, 4, 7, 6,
-		8, 10, 9, 8, 11, 10,
-		12, 14, 13, 12, 15, 14, 
-		16, 18, 17, 16, 19, 18,
-		20, 22, 21, 20, 23, 22,
-
-		24, 27, 26, 24, 26, 25
+	m_meshes.clear();
+	std::vector<IndexRange> fullRanges;
+	for (const BuiltinScene::MeshRange& builtin : builtinRanges)
+	{
+		MeshRange mesh = { builtin.bounds, builtin.firstVertex, builtin.vertexCount };
+		IndexRange range = { builtin.startIndex, builtin.indexCount };
+		m_meshes.push_back(mesh);
+		fullRanges.push_back(range);
+	}
+
+	MeshRange model = { {}, (UINT)vertices.size() };
+	UINT modelStartIndex = (UINT)indices.size();
+	if (LoadSceneModel(vertices, indices, &model.bounds))
+	{
+		IndexRange modelRange = { modelStartIndex, (UINT)indices.size() - modelStartIndex };
+		model.vertexCount = (UINT)vertices.size() - model.firstVertex;
+		m_meshes.push_back(model);
+		fullRanges.push_back(modelRange);
+	}
+
+	// Simplified levels of all meshes are built in parallel on mesh-local indices
+	auto lodStart = std::chrono::steady_clock::now();
+	std::vector<std::vector<UINT32>> meshIndices(m_meshes.size());
+	std::vector<MeshSimplifier::Source> lodSources(m_meshes.size());
+	for (size_t i = 0; i < m_meshes.size(); i++)
+	{
+		const MeshRange& mesh = m_meshes[i];
+		meshIndices[i].assign(indices.begin() + fullRanges[i].startIndex, indices.begin() + fullRanges[i].startIndex + fullRanges[i].indexCount);
+		for (UINT32& index : meshIndices[i])
+		{
+			index -= mesh.firstVertex;
+		}
+		MeshSimplifier::Source source = { meshIndices[i].data(), meshIndices[i].size(), vertices.data() + mesh.firstVertex, mesh.vertexCount };
+		lodSources[i] = source;
+	}
+	std::vector<std::vector<MeshSimplifier::Lod>> lodChains(m_meshes.size());
+	MeshSimplifier::BuildLodChains(lodSources.data(), lodSources.size(), MaxLodCount, LodMaxError, lodChains.data());
+
+	double lodMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - lodStart).count();
+
+	// Levels of a mesh are stored back to back in one block of mesh-local
+	// indices, dense levels are reordered into meshlets
+	auto meshletStart = std::chrono::steady_clock::now();
+	std::vector<std::vector<UINT32>> meshBlocks(m_meshes.size());
+	auto addLevel = [&](UINT mesh, std::vector<UINT32>& levelIndices, float error)
+	{
+		const MeshRange& range = m_meshes[mesh];
+		std::vector<UINT32>& block = meshBlocks[mesh];
+		MeshLod lod = { mesh, (UINT)levelIndices.size(), (UINT)block.size(), error, (UINT)m_meshlets.firstIndex.size() };
+		if (lod.indexCount / 3 >= MinMeshletTriangles)
+		{
+			lod.meshletCount = MeshletBuilder::Build(levelIndices.data(), levelIndices.size(), vertices.data() + range.firstVertex, range.vertexCount,
+				lod.startIndex, &m_meshlets);
+		}
+		block.insert(block.end(), levelIndices.begin(), levelIndices.end());
+		m_lods.push_back(lod);
 	};
 
-	// Create vertex buffer
-	D3D11_BUFFER_DESC vertexBufferDesc = { 0 };
-	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	vertexBufferDesc.ByteWidth = sizeof(Vertices);
-	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	vertexBufferDesc.CPUAccessFlags = 0;
-	vertexBufferDesc.MiscFlags = 0;
-	vertexBufferDesc.StructureByteStride = 0;
-
-	D3D11_SUBRESOURCE_DATA vertexData = { 0 };
-	vertexData.pSysMem = Vertices;
-	vertexData.SysMemPitch = 0;
-	vertexData.SysMemSlicePitch = 0;
-
-	HRESULT result = m_pDevice->CreateBuffer(&vertexBufferDesc, &vertexData, &m_pVertexBuffer);
-	assert(SUCCEEDED(result));
+	m_lods.clear();
+	m_meshlets = MeshletList();
+	for (UINT i = 0; i < (UINT)m_meshes.size(); i++)
+	{
+		MeshRange& mesh = m_meshes[i];
+		mesh.firstLod = (UINT)m_lods.size();
+		addLevel(i, meshIndices[i], 0.0f);
+		for (MeshSimplifier::Lod& level : lodChains[i])
+		{
+			MeshOptimizer::OptimizeVertexCache(level.indices.data(), level.indices.size(), mesh.vertexCount);
+			addLevel(i, level.indices, level.error);
+		}
+		mesh.lodCount = (UINT)m_lods.size() - mesh.firstLod;
+	}
+	double meshletMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - meshletStart).count();
 
-	// Create index buffer
-	if (SUCCEEDED(result))
+	char msg[128];
+	sprintf_s(msg, "[Scene] %u levels of detail for %u meshes, %.1f ms\n", (UINT)m_lods.size(), (UINT)m_meshes.size(), lodMs);
+	OutputDebugStringA(msg);
+	for (const MeshRange& mesh : m_meshes)
+	{
+		for (UINT lod = 1; lod < mesh.lodCount; lod++)
+		{
+			const MeshLod& level = m_lods[mesh.firstLod + lod];
+			sprintf_s(msg, "[Scene]   level %u: %u triangles, error %.4f\n", lod, level.indexCount / 3, level.error);
+			OutputDebugStringA(msg);
+		}
+	}
+
+	UINT meshletCount = (UINT)m_meshlets.firstIndex.size();
+	UINT meshletTriangles = 0;
+	for (UINT count : m_meshlets.indexCount)
+	{
+		meshletTriangles += count / 3;
+	}
+	sprintf_s(msg, "[Scene] %u meshlets, %.1f triangles each, %.1f ms\n", meshletCount,
+		meshletCount > 0 ? (float)meshletTriangles / meshletCount : 0.0f, meshletMs);
+	OutputDebugStringA(msg);
+
+	// Vertex stream in the scene format, packed meshes are quantized to their own bounds
+	size_t vertexSize = VertexCompression::GetVertexSize(SceneVertexFormat);
+	std::vector<BYTE> vertexStream(vertices.size() * vertexSize);
+	for (MeshRange& mesh : m_meshes)
+	{
+		if (SceneVertexFormat == VERTEX_FORMAT_FLOAT)
+		{
+			mesh.quantization = { 1, { 0, 0, 0 } };
+			TextureVertex* pVertices = (TextureVertex*)vertexStream.data() + mesh.firstVertex;
+			for (UINT i = 0; i < mesh.vertexCount; i++)
+			{
+				const MeshVertex& v = vertices[mesh.firstVertex + i];
+				TextureVertex vertex = {
+					{ v.position[0], v.position[1], v.position[2], 1 },
+					{ v.uv[0], v.uv[1] },
+					{ v.normal[0], v.normal[1], v.normal[2] }
+				};
+				pVertices[i] = vertex;
+			}
+			continue;
+		}
+
+		float boundsMin[3], boundsMax[3];
+		for (int i = 0; i < 3; i++)
+		{
+			boundsMin[i] = mesh.bounds.center[i] - mesh.bounds.extent[i];
+			boundsMax[i] = mesh.bounds.center[i] + mesh.bounds.extent[i];
+		}
+		mesh.quantization = VertexCompression::ComputeQuantization(boundsMin, boundsMax);
+		VertexCompression::Encode(SceneVertexFormat, vertices.data() + mesh.firstVertex, mesh.vertexCount, mesh.quantization,
+			vertexStream.data() + mesh.firstVertex * vertexSize);
+	}
+
+	sprintf_s(msg, "[Scene] %u vertices, %u bytes each, %u KB\n", (UINT)vertices.size(), (UINT)vertexSize,
+		(UINT)(vertexStream.size() / 1024));
+	OutputDebugStringA(msg);
+
+	// Static meshes are merged into shared geometry pages
+	m_staticBatcher.Init(vertexSize, StaticPageVertexCount, StaticPageIndexCount);
+	for (UINT i = 0; i < (UINT)m_meshes.size(); i++)
+	{
+		MeshRange& mesh = m_meshes[i];
+		mesh.batch = m_staticBatcher.Add(vertexStream.data() + mesh.firstVertex * vertexSize, mesh.vertexCount,
+			meshBlocks[i].data(), (UINT)meshBlocks[i].size());
+	}
+
+	sprintf_s(msg, "[Scene] %u static meshes in %u geometry pages\n", (UINT)m_meshes.size(), m_staticBatcher.GetPageCount());
+	OutputDebugStringA(msg);
+
+	HRESULT result = UpdateGeometryPages();
+
+	// Create meshlet index buffer, large enough for all meshlets to be visible
+	m_meshletVisible.clear();
+	m_prevMeshletVisible.clear();
+	if (SUCCEEDED(result) && meshletCount > 0)
 	{
 		D3D11_BUFFER_DESC indexBufferDesc = { 0 };
-		indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-		indexBufferDesc.ByteWidth = sizeof(Indices);
+		indexBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+		indexBufferDesc.ByteWidth = meshletTriangles * 3 * sizeof(UINT32);
 		indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-		indexBufferDesc.CPUAccessFlags = 0;
+		indexBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 		indexBufferDesc.MiscFlags = 0;
 		indexBufferDesc.StructureByteStride = 0;
 
-		D3D11_SUBRESOURCE_DATA indexData = { 0 };
-		indexData.pSysMem = Indices;
-		indexData.SysMemPitch = 0;
-		indexData.SysMemSlicePitch = 0;
-
-		result = m_pDevice->CreateBuffer(&indexBufferDesc, &indexData, &m_pIndexBuffer);
+		result = m_pDevice->CreateBuffer(&indexBufferDesc, NULL, &m_pMeshletIndexBuffer);
 		assert(SUCCEEDED(result));
+
+		m_meshletVisible.assign(meshletCount, 0);
+		m_meshletScratch.resize(meshletCount);
+		m_meshletsDirty = true;
 	}
 
-	// Create vertex shader
-	ID3DBlob* pBlob = NULL;
-	m_pVertexShader = m_pShaderCompiler->CreateVertexShader(m_pDevice, _T("ColorShader.hlsl"), &pBlob);
-	// Create pixel shader
-	if (m_pVertexShader)
+	// Scene lights, the red ones next to the cube and the seeded field of dim
+	// colored ones above the plane if it was asked for
+	if (SUCCEEDED(result))
 	{
-		m_pPixelShader = m_pShaderCompiler->CreatePixelShader(m_pDevice, _T("ColorShader.hlsl"));
+		m_lightManager.Init(LightCellSize);
+		m_switchLight = BuiltinScene::AddLights(&m_lightManager, m_lightSetup);
+		m_lightManager.Update();
+
+		m_lightMode = ColorShaderVariants::GetLightMode(m_lightManager.GetCount());
+		m_lightClusterer.Init(ClusterTileSize, ClusterSliceCount);
 	}
-	assert(m_pVertexShader != NULL && m_pPixelShader != NULL);
-	if (m_pVertexShader == NULL || m_pPixelShader == NULL)
+
+	// Request shader program specialized for the scene light count, scenes
+	// with more lights than the array holds read them from the cluster grid.
+	// Input layout is created once it is compiled.
+	ShaderPermutationSpace colorSpace = ColorShaderVariants::CreateSpace();
+	m_pColorVariants = new ShaderVariantTable(colorSpace);
+
+	uint32_t colorKey = ColorShaderVariants::GetSceneKey(colorSpace, m_lightManager.GetCount());
+	m_colorProgramId = m_pShaderManager->RequestVariant(*m_pColorVariants, _T("ColorShader.hlsl"), colorKey, SHADER_PRIORITY_FIRST_FRAME);
+
+	// Create model constant buffer
+	if (SUCCEEDED(result))
 	{
-		result = E_FAIL;
+		result = m_modelBuffer.Init(m_pDevice, ModelBufferLayout());
 	}
 
-	// Create input layout
+	// Create material constant buffer, uploaded once and skipped afterwards
 	if (SUCCEEDED(result))
 	{
-		D3D11_INPUT_ELEMENT_DESC inputLayoutDesc[3] = {
-			D3D11_INPUT_ELEMENT_DESC{"POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
-			D3D11_INPUT_ELEMENT_DESC{"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, sizeof(XMVECTORF32), D3D11_INPUT_PER_VERTEX_DATA, 0},
-			D3D11_INPUT_ELEMENT_DESC{"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, sizeof(XMVECTORF32) + sizeof(XMFLOAT2), D3D11_INPUT_PER_VERTEX_DATA, 0}
-		};
-
-		result = m_pDevice->CreateInputLayout(inputLayoutDesc, 3, pBlob->GetBufferPointer(), pBlob->GetBufferSize(), &m_pInputLayout);
-		assert(SUCCEEDED(result));
+		result = m_materialBuffer.Init(m_pDevice, MaterialBufferLayout());
+	}
+	if (SUCCEEDED(result))
+	{
+		MaterialBuffer mb;
+		for (UINT i = 0; i < MaxMaterialCount; i++)
+		{
+			mb.colors[i] = XMFLOAT4(1, 1, 1, 1);
+		}
+		mb.colors[1] = XMFLOAT4(1.0f, 0.6f, 0.4f, 1);
+		mb.colors[2] = XMFLOAT4(0.5f, 0.7f, 1.0f, 1);
+		m_materialBuffer.Write(&mb, sizeof(mb));
 	}
-	SAFE_RELEASE(pBlob);
 
-	// Create model constant buffer
+	// Scene entities, the model transform is shared by all instances
 	if (SUCCEEDED(result))
 	{
-		D3D11_BUFFER_DESC cbDesc = { 0 };
-		cbDesc.ByteWidth = sizeof(ModelBuffer);
-		cbDesc.Usage = D3D11_USAGE_DEFAULT;
-		cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-		cbDesc.CPUAccessFlags = 0;
-		cbDesc.MiscFlags = 0;
-		cbDesc.StructureByteStride = 0;
+		XMFLOAT4 rotation;
+		XMStoreFloat4(&rotation, XMQuaternionRotationAxis({ 0, 1, 0 }, 0));
+
+		m_transforms.Clear();
+		m_modelEntity = m_transforms.Create();
+		m_transforms.SetRotation(m_modelEntity, rotation.x, rotation.y, rotation.z, rotation.w);
+
+		SceneObject cube = { m_transforms.Create(), SCENE_MESH_CUBE, 0 };
+		SceneObject plane = { m_transforms.Create(), SCENE_MESH_PLANE, 0 };
+		m_objects.clear();
+		m_objects.push_back(cube);
+		m_objects.push_back(plane);
+
+		// Loaded model is scaled to the cube size and placed on its left
+		if (m_meshes.size() > SCENE_MESH_MODEL)
+		{
+			float scale, position[3];
+			BuiltinScene::PlaceModel(m_meshes[SCENE_MESH_MODEL].bounds, &scale, position);
+
+			SceneObject model = { m_transforms.Create(), SCENE_MESH_MODEL, 1 };
+			m_transforms.SetScale(model.entity, scale, scale, scale);
+			m_transforms.SetPosition(model.entity, position[0], position[1], position[2]);
+			m_objects.push_back(model);
+		}
 
-		result = m_pDevice->CreateBuffer(&cbDesc, NULL, &m_pModelBuffer);
+		// Instances are filled on the first Update()
+		m_instanceBatcher.Init((uint32_t)m_lods.size());
 	}
 
-	// Create scene constant buffer
+	// Create ring for per-frame constants
 	if (SUCCEEDED(result))
 	{
-		D3D11_BUFFER_DESC cbDesc = { 0 };
-		cbDesc.ByteWidth = sizeof(SceneBuffer);
-		cbDesc.Usage = D3D11_USAGE_DEFAULT;
-		cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-		cbDesc.CPUAccessFlags = 0;
-		cbDesc.MiscFlags = 0;
-		cbDesc.StructureByteStride = 0;
+		result = m_constantRing.Init(m_pDevice);
+	}
 
-		result = m_pDevice->CreateBuffer(&cbDesc, NULL, &m_pSceneBuffer);
+	// Create scene constant buffer
+	if (SUCCEEDED(result))
+	{
+		result = m_sceneBuffer.Init(m_pDevice, SceneBufferLayout());
 	}
 
 	// Create rasterizer state
@@ -570,6 +1176,392 @@ HRESULT Renderer::CreateScene()
 	return result;
 }
 
+HRESULT Renderer::CreateInputLayout()
+{
+	const ShaderProgram& program = m_pShaderManager->GetProgram(m_colorProgramId);
+
+	// Per-vertex elements of each scene vertex format, the 8-bit normal is decoded from POSITION.w
+	static const D3D11_INPUT_ELEMENT_DESC FloatElements[] = {
+		D3D11_INPUT_ELEMENT_DESC{"POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+		D3D11_INPUT_ELEMENT_DESC{"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, sizeof(XMVECTORF32), D3D11_INPUT_PER_VERTEX_DATA, 0},
+		D3D11_INPUT_ELEMENT_DESC{"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, sizeof(XMVECTORF32) + sizeof(XMFLOAT2), D3D11_INPUT_PER_VERTEX_DATA, 0}
+	};
+	static const D3D11_INPUT_ELEMENT_DESC Oct16Elements[] = {
+		D3D11_INPUT_ELEMENT_DESC{"POSITION", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, offsetof(PackedVertexOct16, position), D3D11_INPUT_PER_VERTEX_DATA, 0},
+		D3D11_INPUT_ELEMENT_DESC{"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, offsetof(PackedVertexOct16, uv), D3D11_INPUT_PER_VERTEX_DATA, 0},
+		D3D11_INPUT_ELEMENT_DESC{"NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, offsetof(PackedVertexOct16, normal), D3D11_INPUT_PER_VERTEX_DATA, 0}
+	};
+	static const D3D11_INPUT_ELEMENT_DESC Oct8Elements[] = {
+		D3D11_INPUT_ELEMENT_DESC{"POSITION", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, offsetof(PackedVertexOct8, position), D3D11_INPUT_PER_VERTEX_DATA, 0},
+		D3D11_INPUT_ELEMENT_DESC{"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, offsetof(PackedVertexOct8, uv), D3D11_INPUT_PER_VERTEX_DATA, 0}
+	};
+
+	D3D11_INPUT_ELEMENT_DESC inputLayoutDesc[8];
+	UINT elementCount = 0;
+	switch (SceneVertexFormat)
+	{
+	case VERTEX_FORMAT_PACKED_OCT16:
+		memcpy(inputLayoutDesc, Oct16Elements, sizeof(Oct16Elements));
+		elementCount = _countof(Oct16Elements);
+		break;
+	case VERTEX_FORMAT_PACKED_OCT8:
+		memcpy(inputLayoutDesc, Oct8Elements, sizeof(Oct8Elements));
+		elementCount = _countof(Oct8Elements);
+		break;
+	default:
+		memcpy(inputLayoutDesc, FloatElements, sizeof(FloatElements));
+		elementCount = _countof(FloatElements);
+		break;
+	}
+
+	static const D3D11_INPUT_ELEMENT_DESC InstanceElements[] = {
+		D3D11_INPUT_ELEMENT_DESC{"INSTANCE_WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(InstanceData, world[0]), D3D11_INPUT_PER_INSTANCE_DATA, 1},
+		D3D11_INPUT_ELEMENT_DESC{"INSTANCE_WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(InstanceData, world[1]), D3D11_INPUT_PER_INSTANCE_DATA, 1},
+		D3D11_INPUT_ELEMENT_DESC{"INSTANCE_WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(InstanceData, world[2]), D3D11_INPUT_PER_INSTANCE_DATA, 1},
+		D3D11_INPUT_ELEMENT_DESC{"INSTANCE_MATERIAL", 0, DXGI_FORMAT_R32_UINT, 1, offsetof(InstanceData, material), D3D11_INPUT_PER_INSTANCE_DATA, 1},
+		D3D11_INPUT_ELEMENT_DESC{"INSTANCE_LIGHTS", 0, DXGI_FORMAT_R32G32B32A32_UINT, 1, offsetof(InstanceData, lights), D3D11_INPUT_PER_INSTANCE_DATA, 1}
+	};
+	memcpy(inputLayoutDesc + elementCount, InstanceElements, sizeof(InstanceElements));
+	elementCount += _countof(InstanceElements);
+
+	HRESULT result = m_pDevice->CreateInputLayout(inputLayoutDesc, elementCount, program.pVSBlob->GetBufferPointer(), program.pVSBlob->GetBufferSize(), &m_pInputLayout);
+	assert(SUCCEEDED(result));
+
+	return result;
+}
+
+HRESULT Renderer::UpdateGeometryPages()
+{
+	HRESULT result = S_OK;
+	size_t vertexSize = m_staticBatcher.GetVertexSize();
+	for (uint32_t page = 0; page < m_staticBatcher.GetPageCount() && SUCCEEDED(result); page++)
+	{
+		// New pages are created from their whole CPU copy
+		if (page >= m_geometryPages.size())
+		{
+			GeometryPage buffers = { nullptr, nullptr };
+
+			D3D11_BUFFER_DESC vertexBufferDesc = { 0 };
+			vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+			vertexBufferDesc.ByteWidth = (UINT)(m_staticBatcher.GetPageVertexCapacity(page) * vertexSize);
+			vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+
+			D3D11_SUBRESOURCE_DATA vertexData = { 0 };
+			vertexData.pSysMem = m_staticBatcher.GetPageVertices(page);
+
+			result = m_pDevice->CreateBuffer(&vertexBufferDesc, &vertexData, &buffers.pVertexBuffer);
+			assert(SUCCEEDED(result));
+
+			if (SUCCEEDED(result))
+			{
+				D3D11_BUFFER_DESC indexBufferDesc = { 0 };
+				indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+				indexBufferDesc.ByteWidth = m_staticBatcher.GetPageIndexCapacity(page) * sizeof(UINT32);
+				indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+
+				D3D11_SUBRESOURCE_DATA indexData = { 0 };
+				indexData.pSysMem = m_staticBatcher.GetPageIndices(page);
+
+				result = m_pDevice->CreateBuffer(&indexBufferDesc, &indexData, &buffers.pIndexBuffer);
+				assert(SUCCEEDED(result));
+			}
+
+			m_geometryPages.push_back(buffers);
+			continue;
+		}
+
+		// Existing pages only get the ranges that changed since the last upload
+		const StaticBatcher::DirtyRanges& dirty = m_staticBatcher.GetDirtyRanges(page);
+		if (dirty.vertexBegin != dirty.vertexEnd)
+		{
+			D3D11_BOX box = { (UINT)(dirty.vertexBegin * vertexSize), 0, 0, (UINT)(dirty.vertexEnd * vertexSize), 1, 1 };
+			m_pContext->UpdateSubresource(m_geometryPages[page].pVertexBuffer, 0, &box,
+				(const BYTE*)m_staticBatcher.GetPageVertices(page) + dirty.vertexBegin * vertexSize, 0, 0);
+		}
+		if (dirty.indexBegin != dirty.indexEnd)
+		{
+			D3D11_BOX box = { dirty.indexBegin * (UINT)sizeof(UINT32), 0, 0, dirty.indexEnd * (UINT)sizeof(UINT32), 1, 1 };
+			m_pContext->UpdateSubresource(m_geometryPages[page].pIndexBuffer, 0, &box,
+				m_staticBatcher.GetPageIndices(page) + dirty.indexBegin, 0, 0);
+		}
+	}
+
+	if (SUCCEEDED(result))
+	{
+		m_staticBatcher.ClearDirtyRanges();
+	}
+
+	return result;
+}
+
+HRESULT Renderer::UpdateInstanceBuffer()
+{
+	HRESULT result = S_OK;
+
+	UINT count = m_instanceBatcher.GetInstanceCount();
+	if (m_pInstanceBuffer == nullptr || count > m_instanceCapacity)
+	{
+		SAFE_RELEASE(m_pInstanceBuffer);
+
+		UINT capacity = m_instanceCapacity > 0 ? m_instanceCapacity : InitialInstanceCapacity;
+		while (capacity < count)
+		{
+			capacity *= 2;
+		}
+
+		D3D11_BUFFER_DESC instanceBufferDesc = { 0 };
+		instanceBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+		instanceBufferDesc.ByteWidth = capacity * sizeof(InstanceData);
+		instanceBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		instanceBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		instanceBufferDesc.MiscFlags = 0;
+		instanceBufferDesc.StructureByteStride = 0;
+
+		result = m_pDevice->CreateBuffer(&instanceBufferDesc, NULL, &m_pInstanceBuffer);
+		assert(SUCCEEDED(result));
+
+		m_instanceCapacity = SUCCEEDED(result) ? capacity : 0;
+	}
+
+	if (SUCCEEDED(result))
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		result = m_pContext->Map(m_pInstanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+		assert(SUCCEEDED(result));
+		if (SUCCEEDED(result))
+		{
+			m_instanceBatcher.Build((InstanceData*)mapped.pData);
+			m_pContext->Unmap(m_pInstanceBuffer, 0);
+		}
+	}
+
+	return result;
+}
+
+void Renderer::CullMeshlets(const float* cullMatrix, const float* cameraPosition)
+{
+	if (m_meshletVisible.empty())
+	{
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	m_meshletVisible.swap(m_prevMeshletVisible);
+	m_meshletVisible.assign(m_prevMeshletVisible.size(), 0);
+	m_meshletStats = MeshletStats();
+
+	// Every instance is tested in its own space, the frustum planes and the
+	// camera are moved there instead of the meshlets. A meshlet is drawn for
+	// all instances of its level if any of them sees it.
+	XMMATRIX cull = XMLoadFloat4x4((const XMFLOAT4X4*)cullMatrix);
+	XMVECTOR camera = XMLoadFloat3((const XMFLOAT3*)cameraPosition);
+	FrustumCuller culler;
+	uint32_t* pVisible = m_meshletScratch.data();
+	std::vector<bool> lodTested(m_lods.size(), false);
+	UINT testedTriangles = 0;
+	UINT keptTriangles = 0;
+	for (uint32_t index : m_visibleObjects)
+	{
+		const SceneObject& object = m_objects[index];
+		UINT lodIndex = m_meshes[object.mesh].firstLod + object.lod;
+		const MeshLod& lod = m_lods[lodIndex];
+		if (lod.meshletCount == 0)
+		{
+			continue;
+		}
+		if (!lodTested[lodIndex])
+		{
+			lodTested[lodIndex] = true;
+			testedTriangles += lod.indexCount / 3;
+		}
+
+		XMMATRIX world = XMLoadFloat4x4((const XMFLOAT4X4*)m_transforms.GetWorld(object.entity).m);
+		XMFLOAT4X4 objectCull;
+		XMStoreFloat4x4(&objectCull, world * cull);
+		culler.SetViewProjection(&objectCull.m[0][0]);
+		XMFLOAT3 objectCamera;
+		XMStoreFloat3(&objectCamera, XMVector3Transform(camera, XMMatrixInverse(nullptr, world)));
+
+		UINT first = lod.firstMeshlet;
+		uint32_t inside = culler.CullSpheres(&m_meshlets.centerX[first], &m_meshlets.centerY[first], &m_meshlets.centerZ[first],
+			&m_meshlets.radius[first], lod.meshletCount, pVisible);
+		uint32_t facing = MeshletBuilder::CullBackfacing(m_meshlets, first, pVisible, inside, &objectCamera.x, pVisible);
+		for (uint32_t i = 0; i < facing; i++)
+		{
+			uint32_t meshlet = first + pVisible[i];
+			if (m_meshletVisible[meshlet] == 0)
+			{
+				m_meshletVisible[meshlet] = 1;
+				keptTriangles += m_meshlets.indexCount[meshlet] / 3;
+			}
+		}
+
+		m_meshletStats.tested += lod.meshletCount;
+		m_meshletStats.frustumCulled += lod.meshletCount - inside;
+		m_meshletStats.backfaceCulled += inside - facing;
+	}
+
+	m_meshletStats.trianglesRejected = testedTriangles - keptTriangles;
+	m_meshletStats.cullMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	// The compacted indices are only rewritten when the set changes
+	m_meshletsDirty = m_meshletsDirty || m_meshletVisible != m_prevMeshletVisible;
+}
+
+HRESULT Renderer::UpdateMeshletIndexBuffer()
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	HRESULT result = m_pContext->Map(m_pMeshletIndexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	assert(SUCCEEDED(result));
+	if (SUCCEEDED(result))
+	{
+		// Surviving meshlets of each level are copied back to back
+		UINT32* pIndices = (UINT32*)mapped.pData;
+		UINT count = 0;
+		for (MeshLod& lod : m_lods)
+		{
+			const StaticBatcher::Mesh& geometry = m_staticBatcher.GetMesh(m_meshes[lod.mesh].batch);
+			const UINT32* pMeshIndices = m_staticBatcher.GetPageIndices(geometry.page) + geometry.startIndex;
+			lod.visibleStartIndex = count;
+			for (UINT meshlet = lod.firstMeshlet; meshlet < lod.firstMeshlet + lod.meshletCount; meshlet++)
+			{
+				if (m_meshletVisible[meshlet] != 0)
+				{
+					memcpy(pIndices + count, pMeshIndices + m_meshlets.firstIndex[meshlet], m_meshlets.indexCount[meshlet] * sizeof(UINT32));
+					count += m_meshlets.indexCount[meshlet];
+				}
+			}
+			lod.visibleIndexCount = count - lod.visibleStartIndex;
+		}
+		m_pContext->Unmap(m_pMeshletIndexBuffer, 0);
+	}
+
+	return result;
+}
+
+void Renderer::BinLights(const float* view, float tanHalfX, float tanHalfY, float nearZ, float farZ)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// Clusterer takes view space spheres as separate streams, indices are light
+	// handles. Destroyed lights have range 0 and are skipped.
+	UINT count = m_lightManager.GetCapacity();
+	m_lightViewX.resize(count);
+	m_lightViewY.resize(count);
+	m_lightViewZ.resize(count);
+
+	const float* positionsX = m_lightManager.GetPositionsX();
+	const float* positionsY = m_lightManager.GetPositionsY();
+	const float* positionsZ = m_lightManager.GetPositionsZ();
+	XMMATRIX viewMatrix = XMLoadFloat4x4((const XMFLOAT4X4*)view);
+	for (UINT i = 0; i < count; i++)
+	{
+		XMFLOAT3 viewPos;
+		XMStoreFloat3(&viewPos, XMVector3Transform(XMVectorSet(positionsX[i], positionsY[i], positionsZ[i], 1.0f), viewMatrix));
+		m_lightViewX[i] = viewPos.x;
+		m_lightViewY[i] = viewPos.y;
+		m_lightViewZ[i] = viewPos.z;
+	}
+
+	m_lightClusterer.SetProjection(m_width, m_height, tanHalfX, tanHalfY, nearZ, farZ);
+	m_lightClusterer.Bin(m_lightViewX.data(), m_lightViewY.data(), m_lightViewZ.data(), m_lightManager.GetRanges(), count);
+
+	m_lightStats.lightCount = m_lightManager.GetCount();
+	m_lightStats.indexCount = (UINT)m_lightClusterer.GetIndices().size();
+	m_lightStats.maxClusterLights = m_lightClusterer.GetMaxClusterLights();
+	m_lightStats.binMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+HRESULT Renderer::UpdateLightBuffers()
+{
+	HRESULT result = S_OK;
+
+	// Light table indexed by handle, only uploaded when a light changed.
+	// Destroyed lights are never binned or assigned, and have power 0.
+	if (m_lightBuffer.pBuffer == nullptr || m_lightManager.GetVersion() != m_lightBufferVersion)
+	{
+		std::vector<Light> lights(m_lightManager.GetCapacity());
+		for (UINT i = 0; i < (UINT)lights.size(); i++)
+		{
+			lights[i] = MakeShaderLight(m_lightManager.GetLight(i));
+		}
+
+		result = WriteShaderBuffer(&m_lightBuffer, lights.data(), (UINT)lights.size(), sizeof(Light), DXGI_FORMAT_UNKNOWN);
+		m_lightBufferVersion = SUCCEEDED(result) ? m_lightManager.GetVersion() : m_lightBufferVersion;
+	}
+
+	if (SUCCEEDED(result) && m_lightMode == LIGHT_MODE_CLUSTERED)
+	{
+		const std::vector<LightClusterer::Range>& ranges = m_lightClusterer.GetRanges();
+		result = WriteShaderBuffer(&m_clusterRangeBuffer, ranges.data(), (UINT)ranges.size(), sizeof(LightClusterer::Range), DXGI_FORMAT_R32G32_UINT);
+	}
+	if (SUCCEEDED(result) && m_lightMode == LIGHT_MODE_CLUSTERED)
+	{
+		const std::vector<uint32_t>& indices = m_lightClusterer.GetIndices();
+		result = WriteShaderBuffer(&m_clusterIndexBuffer, indices.data(), (UINT)indices.size(), sizeof(uint32_t), DXGI_FORMAT_R32_UINT);
+	}
+
+	return result;
+}
+
+HRESULT Renderer::WriteShaderBuffer(ShaderBuffer* pBuffer, const void* pData, UINT count, UINT stride, DXGI_FORMAT format)
+{
+	HRESULT result = S_OK;
+
+	// Unknown format makes a structured buffer
+	if (pBuffer->pBuffer == nullptr || count > pBuffer->capacity)
+	{
+		SAFE_RELEASE(pBuffer->pSRV);
+		SAFE_RELEASE(pBuffer->pBuffer);
+
+		UINT capacity = pBuffer->capacity > 0 ? pBuffer->capacity : InitialShaderBufferCapacity;
+		while (capacity < count)
+		{
+			capacity *= 2;
+		}
+
+		D3D11_BUFFER_DESC bufferDesc = { 0 };
+		bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+		bufferDesc.ByteWidth = capacity * stride;
+		bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		bufferDesc.MiscFlags = format == DXGI_FORMAT_UNKNOWN ? D3D11_RESOURCE_MISC_BUFFER_STRUCTURED : 0;
+		bufferDesc.StructureByteStride = format == DXGI_FORMAT_UNKNOWN ? stride : 0;
+
+		result = m_pDevice->CreateBuffer(&bufferDesc, NULL, &pBuffer->pBuffer);
+		assert(SUCCEEDED(result));
+
+		if (SUCCEEDED(result))
+		{
+			D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+			ZeroMemory(&srvDesc, sizeof(srvDesc));
+			srvDesc.Format = format;
+			srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+			srvDesc.Buffer.FirstElement = 0;
+			srvDesc.Buffer.NumElements = capacity;
+
+			result = m_pDevice->CreateShaderResourceView(pBuffer->pBuffer, &srvDesc, &pBuffer->pSRV);
+			assert(SUCCEEDED(result));
+		}
+
+		pBuffer->capacity = SUCCEEDED(result) ? capacity : 0;
+	}
+
+	if (SUCCEEDED(result) && count > 0)
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		result = m_pContext->Map(pBuffer->pBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+		assert(SUCCEEDED(result));
+		if (SUCCEEDED(result))
+		{
+			memcpy(mapped.pData, pData, count * stride);
+			m_pContext->Unmap(pBuffer->pBuffer, 0);
+		}
+	}
+
+	return result;
+}
+
 void Renderer::DestroyScene()
 {
 	SAFE_RELEASE(m_pSamplerState);
@@ -578,16 +1570,35 @@ void Renderer::DestroyScene()
 	SAFE_RELEASE(m_pTexture);
 
 	SAFE_RELEASE(m_pRasterizerState);
-	SAFE_RELEASE(m_pModelBuffer);
-	SAFE_RELEASE(m_pSceneBuffer);
+	m_constantRing.Term();
+	m_modelBuffer.Term();
+	m_sceneBuffer.Term();
+	m_materialBuffer.Term();
 
 	SAFE_RELEASE(m_pInputLayout);
 
-	SAFE_RELEASE(m_pPixelShader);
-	SAFE_RELEASE(m_pVertexShader);
+	delete m_pColorVariants;
+	m_pColorVariants = nullptr;
+
+	SAFE_RELEASE(m_pInstanceBuffer);
+	m_instanceCapacity = 0;
+	SAFE_RELEASE(m_pMeshletIndexBuffer);
+	for (GeometryPage& page : m_geometryPages)
+	{
+		SAFE_RELEASE(page.pIndexBuffer);
+		SAFE_RELEASE(page.pVertexBuffer);
+	}
+	m_geometryPages.clear();
 
-	SAFE_RELEASE(m_pIndexBuffer);
-	SAFE_RELEASE(m_pVertexBuffer);
+	ShaderBuffer* shaderBuffers[] = { &m_lightBuffer, &m_clusterRangeBuffer, &m_clusterIndexBuffer };
+	for (ShaderBuffer* pBuffer : shaderBuffers)
+	{
+		SAFE_RELEASE(pBuffer->pSRV);
+		SAFE_RELEASE(pBuffer->pBuffer);
+		pBuffer->capacity = 0;
+	}
+	m_lightManager.Clear();
+	m_switchLight = LightManager::InvalidLight;
 }
 
 bool Renderer::Render()
@@ -599,39 +1610,174 @@ bool Renderer::Render()
 	HRESULT result = m_pSwapChain->Present(1, 0);
 	assert(SUCCEEDED(result));
 
+	m_constantRing.EndFrame();
+
+	// Startup trace
+	if (!m_firstFrameTraced || !m_completeFrameTraced)
+	{
+		char msg[128];
+		if (!m_firstFrameTraced)
+		{
+			m_firstFrameTraced = true;
+			sprintf_s(msg, "[Startup] first frame at %.2f ms, %u shader programs pending\n",
+				m_pShaderManager->GetElapsedMs(), m_pShaderManager->GetPendingCount());
+			OutputDebugStringA(msg);
+		}
+		if (m_pShaderManager->GetPendingCount() == 0)
+		{
+			m_completeFrameTraced = true;
+			sprintf_s(msg, "[Startup] first complete frame at %.2f ms, %u of %u ColorShader variants used\n",
+				m_pShaderManager->GetElapsedMs(), m_pColorVariants->GetUsedCount(), m_pColorVariants->GetSpace().GetVariantCount());
+			OutputDebugStringA(msg);
+		}
+	}
+
 	return SUCCEEDED(result);
 }
 
 void Renderer::RenderScene()
 {
-	ID3D11Buffer* vertexBuffers[] = {m_pVertexBuffer};
-	UINT stride = sizeof(TextureVertex);
-	UINT offset = 0;
+	// Scene program still compiling, only the clear color is shown
+	bool ready = m_pInputLayout != nullptr && m_pInstanceBuffer != nullptr;
+	if (ready)
+	{
+		// Geometry page buffers are bound per draw
+		UINT instanceStride = sizeof(InstanceData);
+		UINT instanceOffset = 0;
+		m_pStateCache->IASetVertexBuffers(1, 1, &m_pInstanceBuffer, &instanceStride, &instanceOffset);
+
+		m_pStateCache->IASetInputLayout(m_pInputLayout);
+
+		ID3D11Buffer* constBuffers[] = { m_sceneBuffer.GetBuffer() };
+		m_pStateCache->VSSetConstantBuffers(1, 1, constBuffers);
+		m_pStateCache->PSSetConstantBuffers(1, 1, constBuffers);
 
-	m_pContext->IASetVertexBuffers(0, 1, vertexBuffers, &stride, &offset);
-	m_pContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+		ID3D11Buffer* materialBuffers[] = { m_materialBuffer.GetBuffer() };
+		m_pStateCache->PSSetConstantBuffers(2, 1, materialBuffers);
 
-	m_pContext->IASetInputLayout(m_pInputLayout);
+		m_pStateCache->RSSetState(m_pRasterizerState);
+		m_pStateCache->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-	m_pContext->VSSetShader(m_pVertexShader, NULL, 0);
-	m_pContext->PSSetShader(m_pPixelShader, NULL, 0);
+		ID3D11SamplerState* samplers[] = {m_pSamplerState};
+		m_pStateCache->PSSetSamplers(0, 1, samplers);
 
-	ID3D11Buffer* constBuffers[] = { m_pSceneBuffer };
-	m_pContext->VSSetConstantBuffers(1, 1, constBuffers);
-	m_pContext->PSSetConstantBuffers(1, 1, constBuffers);
+		if (m_lightMode == LIGHT_MODE_OBJECT)
+		{
+			m_pStateCache->PSSetShaderResources(1, 1, &m_lightBuffer.pSRV);
+		}
+		else if (m_lightMode == LIGHT_MODE_CLUSTERED)
+		{
+			ID3D11ShaderResourceView* lightViews[] = { m_lightBuffer.pSRV, m_clusterRangeBuffer.pSRV, m_clusterIndexBuffer.pSRV };
+			m_pStateCache->PSSetShaderResources(1, 3, lightViews);
+		}
 
-	m_pContext->RSSetState(m_pRasterizerState);
-	m_pContext->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		if (m_constantRing.IsSupported())
+		{
+			m_pStateCache->VSSetConstantBuffers1(0, 1, &m_modelAllocation.pBuffer, &m_modelAllocation.firstConstant, &m_modelAllocation.numConstants);
+		}
+		else
+		{
+			ID3D11Buffer* modelBuffers[] = { m_modelBuffer.GetBuffer() };
+			m_pStateCache->VSSetConstantBuffers(0, 1, modelBuffers);
+		}
+	}
 
-	ID3D11ShaderResourceView* textures[] = {m_pTextureSRV};
-	m_pContext->PSSetShaderResources(0, 1, textures);
+	// Views are recreated on resize, the tables are refreshed every frame
+	m_commandBackend.SetTarget(SCENE_TARGET_BACK_BUFFER, m_pBackBufferRTV, nullptr);
+	m_commandBackend.SetTarget(SCENE_TARGET_HDR, m_pRenderRTV, m_pDepthDSV);
+	m_commandBackend.SetTexture(SCENE_TEXTURE_WOOD, m_pTextureSRV);
+	m_commandBackend.SetIndexBuffer(SCENE_INDEX_BUFFER_MESHLETS, m_pMeshletIndexBuffer, DXGI_FORMAT_R32_UINT);
+	for (uint32_t page = 0; page < (uint32_t)m_geometryPages.size(); page++)
+	{
+		m_commandBackend.SetVertexBuffer(page, m_geometryPages[page].pVertexBuffer, (UINT)m_staticBatcher.GetVertexSize());
+		m_commandBackend.SetIndexBuffer(SCENE_INDEX_BUFFER_FIRST_PAGE + page, m_geometryPages[page].pIndexBuffer, DXGI_FORMAT_R32_UINT);
+	}
 
-	ID3D11SamplerState* samplers[] = {m_pSamplerState};
-	m_pContext->PSSetSamplers(0, 1, samplers);
+	const std::vector<DrawList::Item>& items = m_drawList.GetItems();
+	const std::vector<InstanceBatch>& batches = m_instanceBatcher.GetBatches();
+	size_t drawCount = ready ? items.size() : 0;
 
-	m_pContext->VSSetConstantBuffers(0, 1, { &m_pModelBuffer });
+	size_t jobCount = (drawCount + MinDrawsPerRecordJob - 1) / MinDrawsPerRecordJob;
+	size_t threadCount = std::thread::hardware_concurrency();
+	if (jobCount > threadCount)
+	{
+		jobCount = threadCount;
+	}
+	if (jobCount == 0)
+	{
+		jobCount = 1;
+	}
+	size_t drawsPerJob = (drawCount + jobCount - 1) / jobCount;
 
-	m_pContext->DrawIndexed(IndicesCount, 0, 0);
+	// Jobs record sorted ranges of the draw list, only the key fields that differ
+	// from the previous draw are bound. A job starts by binding everything, the
+	// state cache drops what the previous job already left in place.
+	m_commandQueue.Record((uint32_t)jobCount, [&](uint32_t job, RenderCommandBuffer& buffer)
+	{
+		if (job == 0)
+		{
+			const float BackColor[4] = { 0.25f, 0.25f, 0.25f, 1.0f };
+			buffer.ClearTarget(SCENE_TARGET_BACK_BUFFER, BackColor, -1.0f);
+			buffer.ClearTarget(SCENE_TARGET_HDR, BackColor, 1.0f);
+		}
+
+		size_t begin = job * drawsPerJob;
+		size_t end = begin + drawsPerJob;
+		if (end > drawCount)
+		{
+			end = drawCount;
+		}
+
+		uint32_t boundVertexBuffer = 0;
+		uint32_t boundIndexBuffer = 0;
+		for (size_t i = begin; i < end; i++)
+		{
+			uint64_t key = items[i].key;
+
+			uint32_t program = DrawList::GetField(key, DrawList::FIELD_PROGRAM);
+			if (i == begin || program != DrawList::GetField(items[i - 1].key, DrawList::FIELD_PROGRAM))
+			{
+				buffer.BindProgram(program);
+			}
+
+			uint32_t texture = DrawList::GetField(key, DrawList::FIELD_TEXTURE);
+			if (i == begin || texture != DrawList::GetField(items[i - 1].key, DrawList::FIELD_TEXTURE))
+			{
+				buffer.BindTexture(0, texture);
+			}
+
+			// Meshes sharing a geometry page draw without rebinding, levels split into
+			// meshlets draw what survived culling from the meshlet index buffer
+			const InstanceBatch& batch = batches[items[i].draw];
+			const MeshLod& lod = m_lods[batch.mesh];
+			const StaticBatcher::Mesh& geometry = m_staticBatcher.GetMesh(m_meshes[lod.mesh].batch);
+			if (i == begin || geometry.page != boundVertexBuffer)
+			{
+				buffer.BindVertexBuffer(0, geometry.page);
+				boundVertexBuffer = geometry.page;
+			}
+
+			uint32_t indexBuffer = lod.meshletCount > 0 ? SCENE_INDEX_BUFFER_MESHLETS : SCENE_INDEX_BUFFER_FIRST_PAGE + geometry.page;
+			if (i == begin || indexBuffer != boundIndexBuffer)
+			{
+				buffer.BindIndexBuffer(indexBuffer);
+				boundIndexBuffer = indexBuffer;
+			}
+
+			if (lod.meshletCount > 0)
+			{
+				buffer.DrawIndexedInstanced(lod.visibleIndexCount, batch.instanceCount, lod.visibleStartIndex, geometry.baseVertex, batch.firstInstance);
+			}
+			else
+			{
+				buffer.DrawIndexedInstanced(lod.indexCount, batch.instanceCount, geometry.startIndex + lod.startIndex, geometry.baseVertex,
+					batch.firstInstance);
+			}
+		}
+	});
+
+	// Submission stays on the thread owning the immediate context
+	m_commandBackend.Replay(m_commandQueue.GetMerged());
 }
 
 void Renderer::RenderToTexture()
@@ -643,19 +1789,13 @@ void Renderer::RenderToTexture()
 
 void Renderer::RenderToBackBuffer()
 {
-	m_pContext->ClearState();
-
-	m_pContext->OMSetRenderTargets(1, &m_pRenderRTV, m_pDepthDSV);
-
-	const FLOAT BackColor[4] = { 0.25f, 0.25f, 0.25f, 1.0f };
-	m_pContext->ClearRenderTargetView(m_pBackBufferRTV, BackColor);
-	m_pContext->ClearRenderTargetView(m_pRenderRTV, BackColor);
-	m_pContext->ClearDepthStencilView(m_pDepthDSV, D3D11_CLEAR_DEPTH, 1.0f, 0);
+	// Bound state is kept across frames, the cache drops binds already in place
+	m_pStateCache->OMSetRenderTargets(1, &m_pRenderRTV, m_pDepthDSV);
 
 	D3D11_VIEWPORT viewport{ 0, 0, (float)m_width, (float)m_height, 0.0f, 1.0f };
-	m_pContext->RSSetViewports(1, &viewport);
+	m_pStateCache->RSSetViewport(viewport);
 	D3D11_RECT rect{ 0, 0, (LONG)m_width, (LONG)m_height };
-	m_pContext->RSSetScissorRects(1, &rect);
+	m_pStateCache->RSSetScissorRect(rect);
 
 	RenderScene();
 }
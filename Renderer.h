@@ -2,15 +2,49 @@
 
 #include <d3d11.h>
 #include <dxgi.h>
-#include "ShaderCompiler.h"
+#include "ShaderManager.h"
+#include "BuiltinScene.h"
+#include "ColorShaderVariants.h"
+#include "ConstantBuffer.h"
+#include "ConstantRing.h"
+#include "StateCache.h"
+#include "InstanceBatcher.h"
+#include "TransformStore.h"
+#include "BoundingVolumeHierarchy.h"
+#include "DrawList.h"
+#include "D3DCommandBackend.h"
+#include "VertexCompression.h"
+#include "MeshletBuilder.h"
+#include "StaticBatcher.h"
+#include "LightClusterer.h"
+#include "LightManager.h"
 #include "RenderWindow.h"
 
 class Renderer
 {
 public:
+	// Meshlet culling of the last Update(), per drawn instance
+	struct MeshletStats
+	{
+		UINT tested;
+		UINT frustumCulled;
+		UINT backfaceCulled;
+		UINT trianglesRejected; // of the drawn levels, after merging instances
+		float cullMs;
+	};
+
+	// Light binning of the last Update(), zero unless the scene is shaded through the cluster grid
+	struct LightClusterStats
+	{
+		UINT lightCount;
+		UINT indexCount;
+		UINT maxClusterLights;
+		float binMs;
+	};
+
 	Renderer();
 
-	bool Init(HWND hWnd);
+	bool Init(HWND hWnd, BuiltinScene::LightSetup lightSetup = BuiltinScene::LIGHTS_RED);
 	void Term();
 
 	void Resize(UINT width, UINT height);
@@ -25,10 +59,29 @@ public:
 
 	void SwitchLightMode(float value);
 
+	// Constant buffer bytes sent to the GPU by the last Update()
+	UINT GetConstantBytesUploaded() const;
+
+	// Binds issued and skipped as redundant
+	const StateCache* GetStateCache() const;
+
+	const MeshletStats& GetMeshletStats() const;
+	const LightClusterStats& GetLightClusterStats() const;
+
 private:
+	struct ShaderBuffer;
+
 	HRESULT SetupBackBuffer();
 
 	HRESULT CreateScene();
+	HRESULT CreateInputLayout();
+	HRESULT UpdateGeometryPages();
+	HRESULT UpdateInstanceBuffer();
+	void CullMeshlets(const float* cullMatrix, const float* cameraPosition);
+	HRESULT UpdateMeshletIndexBuffer();
+	void BinLights(const float* view, float tanHalfX, float tanHalfY, float nearZ, float farZ);
+	HRESULT UpdateLightBuffers();
+	HRESULT WriteShaderBuffer(ShaderBuffer* pBuffer, const void* pData, UINT count, UINT stride, DXGI_FORMAT format);
 	void DestroyScene();
 	void RenderScene();
 	
@@ -49,10 +102,106 @@ private:
 	ID3D11Texture2D* m_pDepth;
 	ID3D11DepthStencilView* m_pDepthDSV;
 
-	ID3D11Buffer* m_pVertexBuffer;
-	ID3D11Buffer* m_pIndexBuffer;
-	ID3D11VertexShader* m_pVertexShader;
-	ID3D11PixelShader* m_pPixelShader;
+	// API buffers of the static batcher pages
+	struct GeometryPage
+	{
+		ID3D11Buffer* pVertexBuffer;
+		ID3D11Buffer* pIndexBuffer;
+	};
+	StaticBatcher m_staticBatcher;
+	std::vector<GeometryPage> m_geometryPages;
+
+	ID3D11Buffer* m_pInstanceBuffer;
+	UINT m_instanceCapacity;
+	InstanceBatcher m_instanceBatcher;
+	bool m_instancesDirty;
+
+	TransformStore m_transforms;
+	uint32_t m_modelEntity;
+
+	// Vertices of one mesh, packed against its bounds, its levels of detail
+	// and where the static batcher placed it
+	struct MeshRange
+	{
+		BoundingBox bounds;
+		UINT firstVertex;
+		UINT vertexCount;
+		PositionQuantization quantization;
+		UINT firstLod;
+		UINT lodCount;
+		uint32_t batch;
+	};
+	std::vector<MeshRange> m_meshes;
+
+	// Range of the mesh's indices in its geometry page drawn as one level, the
+	// error is the largest deviation from the full mesh in mesh units. Dense
+	// levels are split into meshlets, the ones that survived culling are
+	// compacted into the meshlet index buffer every frame.
+	struct MeshLod
+	{
+		UINT mesh;
+		UINT indexCount;
+		UINT startIndex;
+		float error;
+		UINT firstMeshlet;
+		UINT meshletCount;
+		UINT visibleIndexCount;
+		UINT visibleStartIndex;
+	};
+	std::vector<MeshLod> m_lods;
+
+	MeshletList m_meshlets;
+	std::vector<uint8_t> m_meshletVisible;
+	std::vector<uint8_t> m_prevMeshletVisible;
+	std::vector<uint32_t> m_meshletScratch;
+	ID3D11Buffer* m_pMeshletIndexBuffer;
+	bool m_meshletsDirty;
+	MeshletStats m_meshletStats;
+
+	// Point lights in world space, the switchable one is a handle into the manager
+	LightManager m_lightManager;
+	BuiltinScene::LightSetup m_lightSetup;
+	uint32_t m_switchLight;
+	LightMode m_lightMode;
+	uint32_t m_instanceLightVersion;
+	uint32_t m_lightBufferVersion;
+	LightClusterer m_lightClusterer;
+	std::vector<float> m_lightViewX;
+	std::vector<float> m_lightViewY;
+	std::vector<float> m_lightViewZ;
+	LightClusterStats m_lightStats;
+
+	// Dynamic buffer read by shaders, grown by doubling
+	struct ShaderBuffer
+	{
+		ID3D11Buffer* pBuffer;
+		ID3D11ShaderResourceView* pSRV;
+		UINT capacity;
+	};
+	ShaderBuffer m_lightBuffer;
+	ShaderBuffer m_clusterRangeBuffer;
+	ShaderBuffer m_clusterIndexBuffer;
+
+	struct SceneObject
+	{
+		uint32_t entity;
+		uint32_t mesh;
+		uint32_t material;
+		uint32_t lod; // kept between frames for the hysteresis
+	};
+	std::vector<SceneObject> m_objects;
+
+	FrustumCuller m_culler;
+	BoundingVolumeHierarchy m_objectTree;
+	std::vector<uint32_t> m_visibleObjects;
+	std::vector<uint32_t> m_prevVisibleObjects;
+
+	DrawList m_drawList;
+	RenderCommandQueue m_commandQueue;
+	D3DCommandBackend m_commandBackend;
+	ShaderVariantTable* m_pColorVariants;
+	UINT m_colorProgramId;
+	UINT m_colorProgramVersion;
 	ID3D11InputLayout* m_pInputLayout;
 
 	ID3D11Resource* m_pTexture;
@@ -60,12 +209,17 @@ private:
 
 	ID3D11SamplerState* m_pSamplerState;
 
-	ID3D11Buffer* m_pModelBuffer;
-	ID3D11Buffer* m_pSceneBuffer;
+	ConstantBuffer m_modelBuffer;
+	ConstantBuffer m_sceneBuffer;
+	ConstantBuffer m_materialBuffer;
+	UINT m_constantBytesUploaded;
+	ConstantRing m_constantRing;
+	ConstantRing::Allocation m_modelAllocation;
 
 	ID3D11RasterizerState* m_pRasterizerState;
 
-	ShaderCompiler* m_pShaderCompiler;
+	ShaderManager* m_pShaderManager;
+	StateCache* m_pStateCache;
 
 	RenderWindow* m_pRenderWindow;
 
@@ -85,4 +239,7 @@ private:
 
 	float m_lightPower;
 
+	bool m_firstFrameTraced;
+	bool m_completeFrameTraced;
+
 };
@@ -0,0 +1,96 @@
+#include "RingAllocator.h"
+
+#include <assert.h>
+
+const uint64_t RingAllocator::InvalidOffset;
+
+RingAllocator::RingAllocator()
+	: m_capacity(0)
+	, m_head(0)
+	, m_used(0)
+	, m_frameSize(0)
+{
+}
+
+void RingAllocator::Init(uint64_t capacity)
+{
+	m_capacity = capacity;
+	m_head = 0;
+	m_used = 0;
+	m_frameSize = 0;
+	m_frames.clear();
+}
+
+uint64_t RingAllocator::Allocate(uint64_t size, uint64_t alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	if (size == 0 || size > m_capacity)
+	{
+		return InvalidOffset;
+	}
+
+	// Nothing alive, restart from the beginning to avoid needless wraps
+	if (m_used == 0)
+	{
+		m_head = 0;
+	}
+
+	uint64_t offset = (m_head + alignment - 1) & ~(alignment - 1);
+	uint64_t consumed = offset - m_head + size;
+	if (offset + size > m_capacity)
+	{
+		// The tail of the range is skipped and counted as used until retired
+		offset = 0;
+		consumed = m_capacity - m_head + size;
+	}
+
+	if (m_used + consumed > m_capacity)
+	{
+		return InvalidOffset;
+	}
+
+	m_head = offset + size;
+	m_used += consumed;
+	m_frameSize += consumed;
+
+	return offset;
+}
+
+void RingAllocator::FinishFrame(uint64_t fence)
+{
+	assert(m_frames.empty() || m_frames.back().fence < fence);
+
+	Frame frame = { fence, m_frameSize };
+	m_frames.push_back(frame);
+	m_frameSize = 0;
+}
+
+void RingAllocator::Retire(uint64_t completedFence)
+{
+	while (!m_frames.empty() && m_frames.front().fence <= completedFence)
+	{
+		m_used -= m_frames.front().size;
+		m_frames.pop_front();
+	}
+}
+
+uint64_t RingAllocator::GetCapacity() const
+{
+	return m_capacity;
+}
+
+uint64_t RingAllocator::GetUsed() const
+{
+	return m_used;
+}
+
+size_t RingAllocator::GetFramesInFlight() const
+{
+	return m_frames.size();
+}
+
+uint64_t RingAllocator::GetOldestFence() const
+{
+	return m_frames.empty() ? 0 : m_frames.front().fence;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+
+// Linear allocator over a circular range of offsets. Allocations made between
+// FinishFrame() calls are released together once the frame's fence value is
+// passed to Retire(). Knows nothing about the memory it hands out offsets for.
+class RingAllocator
+{
+public:
+	static const uint64_t InvalidOffset = ~0ull;
+
+	RingAllocator();
+
+	void Init(uint64_t capacity);
+
+	// Returns InvalidOffset when the space is still used by frames in flight
+	uint64_t Allocate(uint64_t size, uint64_t alignment);
+
+	// Closes the current frame, its allocations stay alive until Retire(fence)
+	void FinishFrame(uint64_t fence);
+
+	// Releases every frame whose fence is less than or equal to completedFence
+	void Retire(uint64_t completedFence);
+
+	uint64_t GetCapacity() const;
+	uint64_t GetUsed() const;
+	size_t GetFramesInFlight() const;
+
+	// Fence of the oldest frame in flight, 0 when there is none
+	uint64_t GetOldestFence() const;
+
+private:
+	struct Frame
+	{
+		uint64_t fence;
+		uint64_t size;
+	};
+
+	uint64_t m_capacity;
+	uint64_t m_head;
+	uint64_t m_used;
+	uint64_t m_frameSize;
+
+	std::deque<Frame> m_frames;
+};
@@ -1,4 +1,8 @@
 #include "ShaderCompiler.h"
+#include "ShaderTable.h"
+
+#include <future>
+#include <string.h>
 
 #define SAFE_RELEASE(p) \
 if (p != NULL) { \
@@ -6,6 +10,33 @@ if (p != NULL) { \
 	p = NULL;\
 }
 
+// Source names and table keys are plain ASCII
+static std::string ToNarrow(LPCTSTR text)
+{
+	std::string narrow;
+	for (const TCHAR* p = text; *p != 0; p++)
+	{
+		narrow.push_back((char)*p);
+	}
+	return narrow;
+}
+
+ShaderProgram::ShaderProgram()
+	: pVertexShader(NULL)
+	, pPixelShader(NULL)
+	, pVSBlob(NULL)
+	, pPSBlob(NULL)
+{
+}
+
+void ShaderProgram::Release()
+{
+	SAFE_RELEASE(pVertexShader);
+	SAFE_RELEASE(pPixelShader);
+	SAFE_RELEASE(pVSBlob);
+	SAFE_RELEASE(pPSBlob);
+}
+
 ShaderCompiler::ShaderCompiler()
 {
 }
@@ -14,80 +45,168 @@ ShaderCompiler::~ShaderCompiler()
 {
 }
 
-ID3D11VertexShader* ShaderCompiler::CreateVertexShader(ID3D11Device* m_pDevice, LPCTSTR shaderSource, ID3DBlob** ppBlob)
+ShaderSource ShaderCompiler::LoadSource(LPCTSTR shaderSource)
 {
-	ID3D11VertexShader* pVertexShader = NULL;
-
 	FILE* pFile = NULL;
 
 	_tfopen_s(&pFile, shaderSource, _T("rb"));
+
+	// A failed or short read fails the program instead of compiling a partial file
+	long size = -1;
+	std::string* pSourceCode = NULL;
+	if (pFile != NULL && fseek(pFile, 0, SEEK_END) == 0)
+	{
+		size = ftell(pFile);
+	}
+	if (size >= 0 && fseek(pFile, 0, SEEK_SET) == 0)
+	{
+		pSourceCode = new std::string((size_t)size, '\0');
+		if (fread(&(*pSourceCode)[0], 1, (size_t)size, pFile) != (size_t)size)
+		{
+			delete pSourceCode;
+			pSourceCode = NULL;
+		}
+	}
+
 	if (pFile != NULL)
 	{
-		fseek(pFile, 0, SEEK_END);
-		int size = ftell(pFile);
-		fseek(pFile, 0, SEEK_SET);
+		fclose(pFile);
+	}
 
-		char* pSourceCode = (char*)malloc((size_t)size + 1);
-		fread(pSourceCode, size, 1, pFile);
-		pSourceCode[size] = 0;
+	if (pSourceCode == NULL)
+	{
+		TCHAR msg[512];
+		_stprintf_s(msg, _T("[ShaderCompiler] could not read %s\n"), shaderSource);
+		OutputDebugString(msg);
+		return ShaderSource();
+	}
 
-		fclose(pFile);
+	return ShaderSource(pSourceCode);
+}
 
-		ID3DBlob* pError = NULL;
-		HRESULT result = D3DCompile(pSourceCode, size, "", NULL, NULL, "VS", "vs_5_0", 0, 0, ppBlob, &pError);
-		if (!SUCCEEDED(result))
-		{
-			const char* pMsg = (const char*)pError->GetBufferPointer();
-			OutputDebugStringA(pMsg);
-		}
-		else
-		{
-			result = m_pDevice->CreateVertexShader((*ppBlob)->GetBufferPointer(), (*ppBlob)->GetBufferSize(), NULL, &pVertexShader);
-			assert(SUCCEEDED(result));
-		}
+HRESULT ShaderCompiler::Compile(const ShaderSource& source, LPCSTR sourceName, LPCSTR entryPoint, LPCSTR target, ID3DBlob** ppBlob,
+	const D3D_SHADER_MACRO* pDefines)
+{
+	if (!source)
+	{
+		return E_FAIL;
+	}
 
-		SAFE_RELEASE(pError);
+	ID3DBlob* pError = NULL;
+	HRESULT result = D3DCompile(source->data(), source->size(), sourceName, pDefines, D3D_COMPILE_STANDARD_FILE_INCLUDE, entryPoint, target, 0, 0, ppBlob, &pError);
+	if (!SUCCEEDED(result) && pError != NULL)
+	{
+		const char* pMsg = (const char*)pError->GetBufferPointer();
+		OutputDebugStringA(pMsg);
 	}
 
-	return pVertexShader;
+	SAFE_RELEASE(pError);
+
+	return result;
 }
 
-ID3D11PixelShader* ShaderCompiler::CreatePixelShader(ID3D11Device* m_pDevice, LPCTSTR shaderSource)
+HRESULT ShaderCompiler::CreateProgram(ID3D11Device* m_pDevice, LPCTSTR shaderSource, ShaderProgram* pProgram,
+	const D3D_SHADER_MACRO* pDefines)
 {
-	ID3D11PixelShader* pPixelShader = NULL;
+	return CreateProgram(m_pDevice, LoadSource(shaderSource), ToNarrow(shaderSource).c_str(), pProgram, pDefines);
+}
 
-	FILE* pFile = NULL;
+HRESULT ShaderCompiler::CreateProgram(ID3D11Device* m_pDevice, const ShaderSource& source, LPCSTR sourceName, ShaderProgram* pProgram,
+	const D3D_SHADER_MACRO* pDefines)
+{
+	if (!source)
+	{
+		return E_FAIL;
+	}
 
-	_tfopen_s(&pFile, shaderSource, _T("rb"));
-	if (pFile != NULL)
+	// D3DCompile is thread safe, so the pixel stage compiles on a worker
+	// while the vertex stage compiles here
+	ID3DBlob* pPSBlob = NULL;
+	std::future<HRESULT> psResult = std::async(std::launch::async, [source, sourceName, pDefines, &pPSBlob]()
 	{
-		fseek(pFile, 0, SEEK_END);
-		int size = ftell(pFile);
-		fseek(pFile, 0, SEEK_SET);
+		return Compile(source, sourceName, "PS", "ps_5_0", &pPSBlob, pDefines);
+	});
 
-		char* pSourceCode = (char*)malloc((size_t)size + 1);
-		fread(pSourceCode, size, 1, pFile);
-		pSourceCode[size] = 0;
+	ID3DBlob* pVSBlob = NULL;
+	HRESULT result = Compile(source, sourceName, "VS", "vs_5_0", &pVSBlob, pDefines);
+	HRESULT resultPS = psResult.get();
+	if (SUCCEEDED(result))
+	{
+		result = resultPS;
+	}
 
-		fclose(pFile);
+	if (SUCCEEDED(result))
+	{
+		result = m_pDevice->CreateVertexShader(pVSBlob->GetBufferPointer(), pVSBlob->GetBufferSize(), NULL, &pProgram->pVertexShader);
+		assert(SUCCEEDED(result));
+	}
+	if (SUCCEEDED(result))
+	{
+		result = m_pDevice->CreatePixelShader(pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(), NULL, &pProgram->pPixelShader);
+		assert(SUCCEEDED(result));
+	}
 
-		ID3DBlob* pBlob = NULL;
-		ID3DBlob* pError = NULL;
-		HRESULT result = D3DCompile(pSourceCode, size, "", NULL, NULL, "PS", "ps_5_0", 0, 0, &pBlob, &pError);
-		if (!SUCCEEDED(result))
-		{
-			const char* pMsg = (const char*)pError->GetBufferPointer();
-			OutputDebugStringA(pMsg);
-		}
-		else
+	pProgram->pVSBlob = pVSBlob;
+	pProgram->pPSBlob = pPSBlob;
+	if (!SUCCEEDED(result))
+	{
+		pProgram->Release();
+	}
+
+	return result;
+}
+
+HRESULT ShaderCompiler::CreateEmbeddedProgram(ID3D11Device* m_pDevice, LPCTSTR shaderSource, ShaderProgram* pProgram,
+	const D3D_SHADER_MACRO* pDefines)
+{
+	std::string file = ToNarrow(shaderSource);
+
+	std::string defines;
+	for (const D3D_SHADER_MACRO* pDefine = pDefines; pDefine != NULL && pDefine->Name != NULL; pDefine++)
+	{
+		if (!defines.empty())
 		{
-			result = m_pDevice->CreatePixelShader(pBlob->GetBufferPointer(), pBlob->GetBufferSize(), NULL, &pPixelShader);
-			assert(SUCCEEDED(result));
+			defines.push_back(';');
 		}
+		defines += pDefine->Name;
+		defines.push_back('=');
+		defines += pDefine->Definition != NULL ? pDefine->Definition : "";
+	}
+
+	const ShaderTableEntry* pVS = FindShaderBytecode(file.c_str(), "VS", defines.c_str());
+	const ShaderTableEntry* pPS = FindShaderBytecode(file.c_str(), "PS", defines.c_str());
+	if (pVS == NULL || pPS == NULL)
+	{
+		return E_FAIL;
+	}
+
+	HRESULT result = m_pDevice->CreateVertexShader(pVS->pBytecode, pVS->size, NULL, &pProgram->pVertexShader);
+	assert(SUCCEEDED(result));
+	if (SUCCEEDED(result))
+	{
+		result = m_pDevice->CreatePixelShader(pPS->pBytecode, pPS->size, NULL, &pProgram->pPixelShader);
+		assert(SUCCEEDED(result));
+	}
 
-		SAFE_RELEASE(pError);
-		SAFE_RELEASE(pBlob);
+	// Input layouts are created from the VS blob, so it is copied into one
+	if (SUCCEEDED(result))
+	{
+		result = D3DCreateBlob(pVS->size, &pProgram->pVSBlob);
+	}
+	if (SUCCEEDED(result))
+	{
+		memcpy(pProgram->pVSBlob->GetBufferPointer(), pVS->pBytecode, pVS->size);
+		result = D3DCreateBlob(pPS->size, &pProgram->pPSBlob);
+	}
+	if (SUCCEEDED(result))
+	{
+		memcpy(pProgram->pPSBlob->GetBufferPointer(), pPS->pBytecode, pPS->size);
+	}
+
+	if (!SUCCEEDED(result))
+	{
+		pProgram->Release();
 	}
 
-	return pPixelShader;
+	return result;
 }
@@ -4,6 +4,24 @@
 #include <tchar.h>
 #include <d3dcompiler.h>
 #include <cassert>
+#include <memory>
+#include <string>
+
+// Shader source loaded once and shared read-only between concurrent compiles
+typedef std::shared_ptr<const std::string> ShaderSource;
+
+struct ShaderProgram
+{
+	ShaderProgram();
+
+	void Release();
+
+	ID3D11VertexShader* pVertexShader;
+	ID3D11PixelShader* pPixelShader;
+
+	ID3DBlob* pVSBlob; // input signature for CreateInputLayout
+	ID3DBlob* pPSBlob;
+};
 
 class ShaderCompiler
 {
@@ -12,8 +30,25 @@ public:
 
 	~ShaderCompiler();
 
-	ID3D11VertexShader* CreateVertexShader(ID3D11Device* m_pDevice, LPCTSTR shaderSource, ID3DBlob** ppBlob);
+	// Empty if the file can not be read completely, the reason is traced
+	static ShaderSource LoadSource(LPCTSTR shaderSource);
 
-	ID3D11PixelShader* CreatePixelShader(ID3D11Device* m_pDevice, LPCTSTR shaderSource);
-};
+	// sourceName appears in error messages and includes are resolved against
+	// its directory
+	static HRESULT Compile(const ShaderSource& source, LPCSTR sourceName, LPCSTR entryPoint, LPCSTR target, ID3DBlob** ppBlob,
+		const D3D_SHADER_MACRO* pDefines = NULL);
+
+	// Reads the file once and compiles the VS and PS entry points in parallel.
+	// Every shader of the renderer has exactly these two stages, programs with
+	// other stages are not supported.
+	HRESULT CreateProgram(ID3D11Device* m_pDevice, LPCTSTR shaderSource, ShaderProgram* pProgram,
+		const D3D_SHADER_MACRO* pDefines = NULL);
 
+	HRESULT CreateProgram(ID3D11Device* m_pDevice, const ShaderSource& source, LPCSTR sourceName, ShaderProgram* pProgram,
+		const D3D_SHADER_MACRO* pDefines = NULL);
+
+	// Creates the program from bytecode embedded by ShaderTableGen, fails if the
+	// file and defines were not precompiled
+	HRESULT CreateEmbeddedProgram(ID3D11Device* m_pDevice, LPCTSTR shaderSource, ShaderProgram* pProgram,
+		const D3D_SHADER_MACRO* pDefines = NULL);
+};
@@ -0,0 +1,238 @@
+#include "ShaderDependencyGraph.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+ShaderDependencyGraph::ShaderDependencyGraph()
+{
+}
+
+void ShaderDependencyGraph::AddProgram(unsigned int programId, const std::string& file)
+{
+	m_programRoots[programId] = file;
+	ScanProgram(programId);
+	RebuildReverseEdges();
+}
+
+void ShaderDependencyGraph::RemoveProgram(unsigned int programId)
+{
+	m_programRoots.erase(programId);
+	m_programFiles.erase(programId);
+	RebuildReverseEdges();
+}
+
+std::vector<unsigned int> ShaderDependencyGraph::Poll()
+{
+	std::set<unsigned int> affected;
+	for (auto& fileStamp : m_fileStamps)
+	{
+		FileStamp stamp = GetFileStamp(fileStamp.first);
+		if (stamp != fileStamp.second)
+		{
+			fileStamp.second = stamp;
+
+			auto users = m_fileUsers.find(fileStamp.first);
+			if (users != m_fileUsers.end())
+			{
+				affected.insert(users->second.begin(), users->second.end());
+			}
+		}
+	}
+
+	// A changed file may have gained or lost includes
+	for (unsigned int programId : affected)
+	{
+		ScanProgram(programId);
+	}
+	if (!affected.empty())
+	{
+		RebuildReverseEdges();
+	}
+
+	return std::vector<unsigned int>(affected.begin(), affected.end());
+}
+
+std::vector<unsigned int> ShaderDependencyGraph::GetAffectedPrograms(const std::string& file) const
+{
+	auto users = m_fileUsers.find(file);
+	if (users == m_fileUsers.end())
+	{
+		return std::vector<unsigned int>();
+	}
+	return std::vector<unsigned int>(users->second.begin(), users->second.end());
+}
+
+std::vector<std::string> ShaderDependencyGraph::GetProgramFiles(unsigned int programId) const
+{
+	auto files = m_programFiles.find(programId);
+	if (files == m_programFiles.end())
+	{
+		return std::vector<std::string>();
+	}
+	return std::vector<std::string>(files->second.begin(), files->second.end());
+}
+
+std::vector<std::string> ShaderDependencyGraph::ParseIncludes(const std::string& source)
+{
+	std::vector<std::string> includes;
+
+	size_t pos = 0;
+	while (pos < source.size())
+	{
+		size_t lineEnd = source.find('\n', pos);
+		if (lineEnd == std::string::npos)
+		{
+			lineEnd = source.size();
+		}
+
+		size_t i = pos;
+		while (i < lineEnd && (source[i] == ' ' || source[i] == '\t'))
+		{
+			i++;
+		}
+
+		if (i < lineEnd && source[i] == '#')
+		{
+			i++;
+			while (i < lineEnd && (source[i] == ' ' || source[i] == '\t'))
+			{
+				i++;
+			}
+
+			if (source.compare(i, 7, "include") == 0)
+			{
+				i += 7;
+				while (i < lineEnd && (source[i] == ' ' || source[i] == '\t'))
+				{
+					i++;
+				}
+
+				if (i < lineEnd && (source[i] == '"' || source[i] == '<'))
+				{
+					char closing = source[i] == '"' ? '"' : '>';
+					size_t end = source.find(closing, i + 1);
+					if (end != std::string::npos && end < lineEnd)
+					{
+						includes.push_back(source.substr(i + 1, end - i - 1));
+					}
+				}
+			}
+		}
+
+		pos = lineEnd + 1;
+	}
+
+	return includes;
+}
+
+bool ShaderDependencyGraph::ReadFile(const std::string& file, std::string& text)
+{
+	FILE* pFile = NULL;
+#ifdef _MSC_VER
+	fopen_s(&pFile, file.c_str(), "rb");
+#else
+	pFile = fopen(file.c_str(), "rb");
+#endif
+	if (pFile == NULL)
+	{
+		return false;
+	}
+
+	fseek(pFile, 0, SEEK_END);
+	long size = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+
+	text.assign((size_t)size, '\0');
+	size_t read = size > 0 ? fread(&text[0], size, 1, pFile) : 1;
+	fclose(pFile);
+
+	return read == 1;
+}
+
+long long ShaderDependencyGraph::GetModificationTime(const std::string& file)
+{
+#ifdef _MSC_VER
+	struct _stat64 info;
+	if (_stat64(file.c_str(), &info) != 0)
+#else
+	struct stat info;
+	if (stat(file.c_str(), &info) != 0)
+#endif
+	{
+		return -1;
+	}
+	return (long long)info.st_mtime;
+}
+
+ShaderDependencyGraph::FileStamp ShaderDependencyGraph::GetFileStamp(const std::string& file)
+{
+	FileStamp stamp = { GetModificationTime(file), -1, 0 };
+
+	// FNV-1a of the contents
+	std::string text;
+	if (stamp.time != -1 && ReadFile(file, text))
+	{
+		stamp.size = (long long)text.size();
+		stamp.hash = 14695981039346656037ull;
+		for (char c : text)
+		{
+			stamp.hash = (stamp.hash ^ (unsigned char)c) * 1099511628211ull;
+		}
+	}
+	return stamp;
+}
+
+void ShaderDependencyGraph::ScanProgram(unsigned int programId)
+{
+	std::set<std::string>& files = m_programFiles[programId];
+	files.clear();
+
+	std::vector<std::string> stack;
+	stack.push_back(m_programRoots[programId]);
+	while (!stack.empty())
+	{
+		std::string file = stack.back();
+		stack.pop_back();
+
+		if (!files.insert(file).second)
+		{
+			continue;
+		}
+
+		if (m_fileStamps.find(file) == m_fileStamps.end())
+		{
+			m_fileStamps[file] = GetFileStamp(file);
+		}
+
+		std::string text;
+		if (!ReadFile(file, text))
+		{
+			continue;
+		}
+
+		std::string directory = GetDirectory(file);
+		for (const std::string& include : ParseIncludes(text))
+		{
+			stack.push_back(directory + include);
+		}
+	}
+}
+
+void ShaderDependencyGraph::RebuildReverseEdges()
+{
+	m_fileUsers.clear();
+	for (auto& program : m_programFiles)
+	{
+		for (const std::string& file : program.second)
+		{
+			m_fileUsers[file].insert(program.first);
+		}
+	}
+}
+
+std::string ShaderDependencyGraph::GetDirectory(const std::string& file)
+{
+	size_t slash = file.find_last_of("/\\");
+	return slash == std::string::npos ? std::string() : file.substr(0, slash + 1);
+}
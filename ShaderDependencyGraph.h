@@ -0,0 +1,67 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// Tracks which shader programs depend on which files through #include and
+// reports the programs affected by file changes. Has no graphics API
+// dependencies, so it can be exercised without a GPU.
+class ShaderDependencyGraph
+{
+public:
+	ShaderDependencyGraph();
+
+	// Registers (or rescans) a program rooted at the given source file
+	void AddProgram(unsigned int programId, const std::string& file);
+
+	void RemoveProgram(unsigned int programId);
+
+	// Checks all tracked files for changes and returns the ids of programs
+	// that have to be recompiled, rescanning their include trees
+	std::vector<unsigned int> Poll();
+
+	// Programs depending on the file directly or through includes
+	std::vector<unsigned int> GetAffectedPrograms(const std::string& file) const;
+
+	std::vector<std::string> GetProgramFiles(unsigned int programId) const;
+
+	static std::vector<std::string> ParseIncludes(const std::string& source);
+
+	static bool ReadFile(const std::string& file, std::string& text);
+
+	// Seconds since the epoch, -1 if the file does not exist
+	static long long GetModificationTime(const std::string& file);
+
+private:
+	// Edits within the second the time resolves keep time and size, so the
+	// contents are compared too. Sources are small enough to read each poll.
+	struct FileStamp
+	{
+		long long time;
+		long long size;
+		unsigned long long hash;
+
+		bool operator!=(const FileStamp& other) const
+		{
+			return time != other.time || size != other.size || hash != other.hash;
+		}
+	};
+
+	static FileStamp GetFileStamp(const std::string& file);
+	void ScanProgram(unsigned int programId);
+	void RebuildReverseEdges();
+
+	static std::string GetDirectory(const std::string& file);
+
+private:
+	// program id -> root file
+	std::map<unsigned int, std::string> m_programRoots;
+	// program id -> every file the program reads, root included
+	std::map<unsigned int, std::set<std::string>> m_programFiles;
+	// file -> programs reading it
+	std::map<std::string, std::set<unsigned int>> m_fileUsers;
+	// file -> last seen state
+	std::map<std::string, FileStamp> m_fileStamps;
+};
@@ -0,0 +1,249 @@
+#include "ShaderManager.h"
+
+static const char* FallbackShaderSource =
+	"Texture2D colorTexture : register(t0);\n"
+	"SamplerState samplerState : register(s0);\n"
+	"struct VSOut { float4 position : SV_POSITION; float2 texCoord : TEXCOORD; };\n"
+	"VSOut VS(uint vertexId : SV_VERTEXID)\n"
+	"{\n"
+	"    VSOut output;\n"
+	"    output.texCoord = float2(vertexId & 1, vertexId >> 1);\n"
+	"    output.position = float4(output.texCoord * float2(2, -2) + float2(-1, 1), 0, 1);\n"
+	"    return output;\n"
+	"}\n"
+	"float4 PS(VSOut input) : SV_TARGET\n"
+	"{\n"
+	"    float3 color = colorTexture.Sample(samplerState, input.texCoord).rgb;\n"
+	"    return float4(saturate(color), 1);\n"
+	"}\n";
+
+ShaderManager::ShaderManager()
+	: m_pDevice(nullptr)
+	, m_stop(false)
+	, m_hotReload(false)
+{
+}
+
+bool ShaderManager::Init(ID3D11Device* pDevice, UINT workerCount)
+{
+	m_pDevice = pDevice;
+	m_startTime = std::chrono::steady_clock::now();
+
+	// The fallback is tiny, so it is compiled synchronously
+	ShaderProgram fallbackProgram;
+	ShaderCompiler shaderCompiler;
+	HRESULT result = shaderCompiler.CreateProgram(m_pDevice, ShaderSource(new std::string(FallbackShaderSource)), "Fallback", &fallbackProgram);
+	assert(SUCCEEDED(result));
+
+	m_stop = false;
+	m_scheduler.Init(workerCount, [this](uint32_t id, ShaderProgram* pProgram) { return CompileEntry(id, pProgram); }, fallbackProgram);
+
+	return SUCCEEDED(result);
+}
+
+void ShaderManager::Term()
+{
+	{
+		// Wake the watcher out of its poll interval
+		std::lock_guard<std::mutex> lock(m_dependenciesMutex);
+		m_stop = true;
+	}
+	m_watcherCondition.notify_all();
+
+	if (m_watcher.joinable())
+	{
+		m_watcher.join();
+	}
+
+	m_scheduler.Term();
+
+	std::lock_guard<std::mutex> lock(m_entriesMutex);
+	m_entries.clear();
+}
+
+UINT ShaderManager::Request(LPCTSTR shaderSource, UINT priority, const ShaderDefines& defines)
+{
+	Entry* pEntry = new Entry();
+	pEntry->file = shaderSource;
+	pEntry->defines = defines;
+	{
+		std::lock_guard<std::mutex> lock(m_entriesMutex);
+		m_entries.push_back(std::unique_ptr<Entry>(pEntry));
+	}
+
+	UINT id = m_scheduler.Add(priority);
+	assert(id + 1 == m_entries.size());
+
+	if (m_hotReload)
+	{
+		std::lock_guard<std::mutex> lock(m_dependenciesMutex);
+		m_dependencies.AddProgram(id, ToNarrow(pEntry->file));
+	}
+
+	// Embedded bytecode needs no compilation, it is published on the next Update
+	ShaderProgram program;
+	ShaderCompiler shaderCompiler;
+	if (SUCCEEDED(shaderCompiler.CreateEmbeddedProgram(m_pDevice, pEntry->file.c_str(), &program, BuildMacros(defines).data())))
+	{
+		m_scheduler.SetCompiled(id, program);
+	}
+	else
+	{
+		m_scheduler.Enqueue(id);
+	}
+
+	return id;
+}
+
+UINT ShaderManager::RequestVariant(ShaderVariantTable& table, LPCTSTR shaderSource, uint32_t key, UINT priority)
+{
+	table.MarkUsed(key);
+
+	uint32_t id = table.Find(key);
+	if (id == ShaderVariantTable::Invalid)
+	{
+		id = Request(shaderSource, priority, table.GetSpace().GetDefines(key));
+		table.Insert(key, id);
+	}
+
+	return id;
+}
+
+UINT ShaderManager::Update()
+{
+	// Recompile programs whose sources changed on disk
+	std::vector<UINT> reloadIds;
+	{
+		std::lock_guard<std::mutex> lock(m_dependenciesMutex);
+		reloadIds.swap(m_reloadIds);
+	}
+	for (UINT id : reloadIds)
+	{
+		m_scheduler.Enqueue(id);
+	}
+
+	std::vector<ShaderScheduler<ShaderProgram>::Published> published;
+	UINT count = m_scheduler.Update(&published);
+	TracePublished(published);
+
+	return count;
+}
+
+void ShaderManager::Flush()
+{
+	std::vector<ShaderScheduler<ShaderProgram>::Published> published;
+	m_scheduler.Flush(&published);
+	TracePublished(published);
+}
+
+void ShaderManager::EnableHotReload(UINT pollIntervalMs)
+{
+	if (m_hotReload)
+	{
+		return;
+	}
+
+	m_hotReload = true;
+	{
+		std::lock_guard<std::mutex> lock(m_dependenciesMutex);
+		for (UINT id = 0; id < (UINT)m_entries.size(); id++)
+		{
+			m_dependencies.AddProgram(id, ToNarrow(m_entries[id]->file));
+		}
+	}
+	m_watcher = std::thread(&ShaderManager::WatcherLoop, this, pollIntervalMs);
+}
+
+bool ShaderManager::IsReady(UINT id) const
+{
+	return m_scheduler.IsReady(id);
+}
+
+const ShaderProgram& ShaderManager::GetProgram(UINT id) const
+{
+	return m_scheduler.GetProgram(id);
+}
+
+UINT ShaderManager::GetVersion(UINT id) const
+{
+	return m_scheduler.GetVersion(id);
+}
+
+const ShaderProgram& ShaderManager::GetFallbackProgram() const
+{
+	return m_scheduler.GetFallbackProgram();
+}
+
+UINT ShaderManager::GetPendingCount() const
+{
+	return m_scheduler.GetPendingCount();
+}
+
+float ShaderManager::GetElapsedMs() const
+{
+	return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_startTime).count();
+}
+
+void ShaderManager::WatcherLoop(UINT pollIntervalMs)
+{
+	std::unique_lock<std::mutex> lock(m_dependenciesMutex);
+	while (!m_stop)
+	{
+		std::vector<UINT> changed = m_dependencies.Poll();
+		m_reloadIds.insert(m_reloadIds.end(), changed.begin(), changed.end());
+
+		m_watcherCondition.wait_for(lock, std::chrono::milliseconds(pollIntervalMs));
+	}
+}
+
+bool ShaderManager::CompileEntry(uint32_t id, ShaderProgram* pProgram)
+{
+	std::basic_string<TCHAR> file;
+	ShaderDefines defines;
+	{
+		std::lock_guard<std::mutex> lock(m_entriesMutex);
+		file = m_entries[id]->file;
+		defines = m_entries[id]->defines;
+	}
+
+	// Device object creation is free threaded, so shaders are created here too
+	std::vector<D3D_SHADER_MACRO> macros = BuildMacros(defines);
+
+	ShaderCompiler shaderCompiler;
+	return SUCCEEDED(shaderCompiler.CreateProgram(m_pDevice, file.c_str(), pProgram, macros.data()));
+}
+
+void ShaderManager::TracePublished(const std::vector<ShaderScheduler<ShaderProgram>::Published>& published) const
+{
+	for (const ShaderScheduler<ShaderProgram>::Published& program : published)
+	{
+		TCHAR msg[256];
+		_stprintf_s(msg, _T("[ShaderManager] %s %s at %.2f ms (compile %.2f ms)\n"), m_entries[program.id]->file.c_str(),
+			program.succeeded ? (m_scheduler.GetVersion(program.id) > 1 ? _T("reloaded") : _T("ready")) : _T("FAILED"),
+			GetElapsedMs(), program.compileMs);
+		OutputDebugString(msg);
+	}
+}
+
+std::string ShaderManager::ToNarrow(const std::basic_string<TCHAR>& str)
+{
+	// Shader file names are plain ASCII
+	std::string narrow;
+	narrow.reserve(str.size());
+	for (TCHAR c : str)
+	{
+		narrow.push_back((char)c);
+	}
+	return narrow;
+}
+
+std::vector<D3D_SHADER_MACRO> ShaderManager::BuildMacros(const ShaderDefines& defines)
+{
+	std::vector<D3D_SHADER_MACRO> macros;
+	for (auto& define : defines)
+	{
+		macros.push_back(D3D_SHADER_MACRO{ define.first.c_str(), define.second.c_str() });
+	}
+	macros.push_back(D3D_SHADER_MACRO{ NULL, NULL });
+	return macros;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <d3d11.h>
+#include <tchar.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ShaderCompiler.h"
+#include "ShaderDependencyGraph.h"
+#include "ShaderPermutation.h"
+#include "ShaderScheduler.h"
+
+// Lower value is compiled first
+enum ShaderPriority
+{
+	SHADER_PRIORITY_FIRST_FRAME = 0,
+	SHADER_PRIORITY_DEFERRED = 1
+};
+
+// Compiles shader programs on a worker pool. Finished programs are published
+// by Update() between frames, until then GetProgram() returns the fallback.
+// The queue and publishing are ShaderScheduler's, this adds the files,
+// embedded bytecode, hot reload and the startup trace.
+class ShaderManager
+{
+public:
+	ShaderManager();
+
+	bool Init(ID3D11Device* pDevice, UINT workerCount = 0);
+	void Term();
+
+	UINT Request(LPCTSTR shaderSource, UINT priority, const ShaderDefines& defines = ShaderDefines());
+
+	// Returns the program id of a variant, requesting its compilation on first use
+	UINT RequestVariant(ShaderVariantTable& table, LPCTSTR shaderSource, uint32_t key, UINT priority);
+
+	// Swap in programs finished since the last call, returns count published
+	UINT Update();
+
+	// Block until every requested program has been compiled and published
+	void Flush();
+
+	// Watch program sources and their includes, recompiling changed programs
+	void EnableHotReload(UINT pollIntervalMs = 250);
+
+	bool IsReady(UINT id) const;
+	const ShaderProgram& GetProgram(UINT id) const;
+
+	// Incremented each time a new program is swapped in for the id
+	UINT GetVersion(UINT id) const;
+
+	// Fullscreen textured blit, usable while post-process programs compile
+	const ShaderProgram& GetFallbackProgram() const;
+
+	UINT GetPendingCount() const;
+	float GetElapsedMs() const;
+
+private:
+	struct Entry
+	{
+		std::basic_string<TCHAR> file;
+		ShaderDefines defines;
+	};
+
+	void WatcherLoop(UINT pollIntervalMs);
+	bool CompileEntry(uint32_t id, ShaderProgram* pProgram);
+	void TracePublished(const std::vector<ShaderScheduler<ShaderProgram>::Published>& published) const;
+
+	static std::string ToNarrow(const std::basic_string<TCHAR>& str);
+	static std::vector<D3D_SHADER_MACRO> BuildMacros(const ShaderDefines& defines);
+
+private:
+	ID3D11Device* m_pDevice;
+	ShaderScheduler<ShaderProgram> m_scheduler;
+
+	// Grown by the render thread, read by the workers
+	std::vector<std::unique_ptr<Entry>> m_entries;
+	mutable std::mutex m_entriesMutex;
+	std::atomic<bool> m_stop;
+
+	bool m_hotReload;
+	std::thread m_watcher;
+	std::condition_variable m_watcherCondition;
+	ShaderDependencyGraph m_dependencies;
+	std::vector<UINT> m_reloadIds;
+	std::mutex m_dependenciesMutex;
+
+	std::chrono::steady_clock::time_point m_startTime;
+};
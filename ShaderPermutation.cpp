@@ -0,0 +1,213 @@
+#include "ShaderPermutation.h"
+
+#include <assert.h>
+
+ShaderPermutationSpace::ShaderPermutationSpace()
+	: m_keyBits(0)
+{
+}
+
+uint32_t ShaderPermutationSpace::AddAxis(const std::string& name, uint32_t valueCount, int firstValue)
+{
+	assert(valueCount > 0);
+
+	uint32_t bits = 0;
+	while ((1u << bits) < valueCount)
+	{
+		bits++;
+	}
+	assert(m_keyBits + bits <= 32);
+
+	Axis axis = { name, valueCount, firstValue, m_keyBits, bits };
+	m_axes.push_back(axis);
+	m_keyBits += bits;
+
+	return (uint32_t)m_axes.size() - 1;
+}
+
+bool ShaderPermutationSpace::HasValue(uint32_t axis, int value) const
+{
+	const Axis& a = m_axes[axis];
+	return value >= a.firstValue && (int64_t)value - a.firstValue < (int64_t)a.valueCount;
+}
+
+uint32_t ShaderPermutationSpace::SetValue(uint32_t key, uint32_t axis, int value) const
+{
+	assert(HasValue(axis, value));
+
+	const Axis& a = m_axes[axis];
+	uint32_t index = (uint32_t)(value - a.firstValue);
+
+	uint32_t mask = a.bits == 32 ? 0xFFFFFFFFu : ((1u << a.bits) - 1) << a.shift;
+	return (key & ~mask) | ((index << a.shift) & mask);
+}
+
+int ShaderPermutationSpace::GetValue(uint32_t key, uint32_t axis) const
+{
+	const Axis& a = m_axes[axis];
+	if (a.bits == 0)
+	{
+		return a.firstValue;
+	}
+	uint32_t index = (key >> a.shift) & ((1u << a.bits) - 1);
+	return a.firstValue + (int)index;
+}
+
+bool ShaderPermutationSpace::IsValid(uint32_t key) const
+{
+	if (m_keyBits < 32 && (key >> m_keyBits) != 0)
+	{
+		return false;
+	}
+	for (const Axis& a : m_axes)
+	{
+		uint32_t index = a.bits == 0 ? 0 : (key >> a.shift) & ((1u << a.bits) - 1);
+		if (index >= a.valueCount)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+uint32_t ShaderPermutationSpace::GetAxisCount() const
+{
+	return (uint32_t)m_axes.size();
+}
+
+const ShaderPermutationSpace::Axis& ShaderPermutationSpace::GetAxis(uint32_t axis) const
+{
+	return m_axes[axis];
+}
+
+uint32_t ShaderPermutationSpace::GetKeyBits() const
+{
+	return m_keyBits;
+}
+
+uint32_t ShaderPermutationSpace::GetVariantCount() const
+{
+	uint32_t count = 1;
+	for (const Axis& a : m_axes)
+	{
+		count *= a.valueCount;
+	}
+	return count;
+}
+
+std::vector<uint32_t> ShaderPermutationSpace::EnumerateKeys() const
+{
+	std::vector<uint32_t> keys;
+	keys.reserve(GetVariantCount());
+
+	// Odometer over per-axis value indices
+	std::vector<uint32_t> indices(m_axes.size(), 0);
+	for (;;)
+	{
+		uint32_t key = 0;
+		for (size_t i = 0; i < m_axes.size(); i++)
+		{
+			key |= indices[i] << m_axes[i].shift;
+		}
+		keys.push_back(key);
+
+		size_t axis = 0;
+		while (axis < m_axes.size() && ++indices[axis] == m_axes[axis].valueCount)
+		{
+			indices[axis] = 0;
+			axis++;
+		}
+		if (axis == m_axes.size())
+		{
+			break;
+		}
+	}
+
+	return keys;
+}
+
+ShaderDefines ShaderPermutationSpace::GetDefines(uint32_t key) const
+{
+	ShaderDefines defines;
+	for (uint32_t i = 0; i < (uint32_t)m_axes.size(); i++)
+	{
+		defines.push_back(std::make_pair(m_axes[i].name, std::to_string(GetValue(key, i))));
+	}
+	return defines;
+}
+
+uint32_t ShaderPermutationSpace::Hash(uint32_t key)
+{
+	// murmur3 finalizer
+	key ^= key >> 16;
+	key *= 0x85ebca6bu;
+	key ^= key >> 13;
+	key *= 0xc2b2ae35u;
+	key ^= key >> 16;
+	return key;
+}
+
+const uint32_t ShaderVariantTable::Invalid;
+const uint32_t ShaderVariantTable::MaxDenseBits;
+
+ShaderVariantTable::ShaderVariantTable(const ShaderPermutationSpace& space)
+	: m_space(space)
+	, m_usedCount(0)
+{
+	if (m_space.GetKeyBits() <= MaxDenseBits)
+	{
+		m_dense.assign((size_t)1 << m_space.GetKeyBits(), Invalid);
+		m_denseUsed.assign(m_dense.size(), false);
+	}
+}
+
+const ShaderPermutationSpace& ShaderVariantTable::GetSpace() const
+{
+	return m_space;
+}
+
+uint32_t ShaderVariantTable::Find(uint32_t key) const
+{
+	if (!m_dense.empty())
+	{
+		return key < m_dense.size() ? m_dense[key] : Invalid;
+	}
+
+	auto it = m_sparse.find(key);
+	return it == m_sparse.end() ? Invalid : it->second;
+}
+
+void ShaderVariantTable::Insert(uint32_t key, uint32_t id)
+{
+	assert(m_space.IsValid(key));
+
+	if (!m_dense.empty())
+	{
+		m_dense[key] = id;
+	}
+	else
+	{
+		m_sparse[key] = id;
+	}
+}
+
+void ShaderVariantTable::MarkUsed(uint32_t key)
+{
+	if (!m_dense.empty())
+	{
+		if (!m_denseUsed[key])
+		{
+			m_denseUsed[key] = true;
+			m_usedCount++;
+		}
+	}
+	else if (m_sparseUsed.insert(std::make_pair(key, true)).second)
+	{
+		m_usedCount++;
+	}
+}
+
+uint32_t ShaderVariantTable::GetUsedCount() const
+{
+	return m_usedCount;
+}
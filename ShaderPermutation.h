@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+typedef std::vector<std::pair<std::string, std::string>> ShaderDefines;
+
+// Set of define axes a shader can be specialized on. A variant key packs the
+// value index of every axis into its own bitfield.
+class ShaderPermutationSpace
+{
+public:
+	struct Axis
+	{
+		std::string name;
+		uint32_t valueCount;
+		int firstValue;
+		uint32_t shift;
+		uint32_t bits;
+	};
+
+	ShaderPermutationSpace();
+
+	// Axis takes values firstValue .. firstValue + valueCount - 1, returns axis index
+	uint32_t AddAxis(const std::string& name, uint32_t valueCount, int firstValue = 0);
+
+	// Whether the axis takes the value, SetValue() requires it
+	bool HasValue(uint32_t axis, int value) const;
+
+	uint32_t SetValue(uint32_t key, uint32_t axis, int value) const;
+	int GetValue(uint32_t key, uint32_t axis) const;
+
+	bool IsValid(uint32_t key) const;
+
+	uint32_t GetAxisCount() const;
+	const Axis& GetAxis(uint32_t axis) const;
+
+	uint32_t GetKeyBits() const;
+	uint32_t GetVariantCount() const;
+
+	std::vector<uint32_t> EnumerateKeys() const;
+
+	ShaderDefines GetDefines(uint32_t key) const;
+
+	static uint32_t Hash(uint32_t key);
+
+private:
+	std::vector<Axis> m_axes;
+	uint32_t m_keyBits;
+};
+
+// Maps variant keys to compiled program ids in O(1). Small spaces use a
+// table indexed by key, larger ones a hash map.
+class ShaderVariantTable
+{
+public:
+	static const uint32_t Invalid = 0xFFFFFFFFu;
+	static const uint32_t MaxDenseBits = 16;
+
+	explicit ShaderVariantTable(const ShaderPermutationSpace& space);
+
+	const ShaderPermutationSpace& GetSpace() const;
+
+	uint32_t Find(uint32_t key) const;
+	void Insert(uint32_t key, uint32_t id);
+
+	// Counts distinct variants actually requested for rendering
+	void MarkUsed(uint32_t key);
+	uint32_t GetUsedCount() const;
+
+private:
+	struct KeyHash
+	{
+		size_t operator()(uint32_t key) const { return ShaderPermutationSpace::Hash(key); }
+	};
+
+	ShaderPermutationSpace m_space;
+
+	std::vector<uint32_t> m_dense;
+	std::vector<bool> m_denseUsed;
+	std::unordered_map<uint32_t, uint32_t, KeyHash> m_sparse;
+	std::unordered_map<uint32_t, bool, KeyHash> m_sparseUsed;
+
+	uint32_t m_usedCount;
+};
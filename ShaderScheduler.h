@@ -0,0 +1,370 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Compiles programs on a worker pool, lower priority values first and equal
+// values in the order they were queued. Finished programs are published by
+// Update() between frames, until then GetProgram() returns the fallback. A
+// failed recompile keeps the previous program.
+//
+// Nothing here depends on the graphics API, so ShaderManager and the tests
+// share it. Program is a handle whose default value is empty, it is copied
+// around and freed with Release().
+template<typename Program>
+class ShaderScheduler
+{
+public:
+	// Runs on a worker, returns false if the program could not be created
+	typedef std::function<bool(uint32_t id, Program* pProgram)> CompileFunction;
+
+	// A compile finished since the previous Update()
+	struct Published
+	{
+		uint32_t id;
+		bool succeeded;
+		float compileMs;
+	};
+
+	ShaderScheduler();
+
+	// The fallback is owned by the scheduler from here on
+	void Init(uint32_t workerCount, const CompileFunction& compile, const Program& fallback);
+	void Term();
+
+	// Adds a program without queueing it
+	uint32_t Add(uint32_t priority);
+
+	// Queues a compile of the program, also to recompile it
+	void Enqueue(uint32_t id);
+
+	// Hands over a program created without compiling, such as embedded bytecode
+	void SetCompiled(uint32_t id, const Program& program);
+
+	// Swaps in programs finished since the last call and appends them to
+	// pPublished if given. Returns the count published successfully.
+	uint32_t Update(std::vector<Published>* pPublished = nullptr);
+
+	// Blocks until every program added has been compiled once, then publishes
+	// them. Each of them has to be queued or handed over.
+	void Flush(std::vector<Published>* pPublished = nullptr);
+
+	bool IsReady(uint32_t id) const;
+	const Program& GetProgram(uint32_t id) const;
+
+	// Incremented each time a new program is swapped in for the id
+	uint32_t GetVersion(uint32_t id) const;
+
+	const Program& GetFallbackProgram() const;
+
+	uint32_t GetCount() const;
+
+	// Programs whose first compile has not been published, failed or not
+	uint32_t GetPendingCount() const;
+
+private:
+	struct Entry
+	{
+		uint32_t priority;
+
+		// Owned by the render thread
+		Program program;
+		uint32_t version;
+		uint32_t publishedGeneration;
+
+		// Written by workers under m_publishMutex
+		Program pending;
+		bool pendingSucceeded;
+		float compileMs;
+		std::atomic<uint32_t> compiledGeneration;
+	};
+
+	struct Job
+	{
+		uint32_t priority;
+		uint32_t sequence;
+		uint32_t id;
+		Entry* pEntry;
+
+		bool operator<(const Job& other) const
+		{
+			return priority != other.priority ? priority > other.priority : sequence > other.sequence;
+		}
+	};
+
+	void WorkerLoop();
+
+private:
+	CompileFunction m_compile;
+	std::vector<std::unique_ptr<Entry>> m_entries;
+	Program m_fallbackProgram;
+	std::mutex m_publishMutex;
+
+	std::vector<std::thread> m_workers;
+	std::priority_queue<Job> m_jobs;
+	std::mutex m_jobsMutex;
+	std::condition_variable m_jobsCondition;
+	std::condition_variable m_doneCondition;
+	bool m_stop;
+	uint32_t m_sequence;
+};
+
+template<typename Program>
+ShaderScheduler<Program>::ShaderScheduler()
+	: m_stop(false)
+	, m_sequence(0)
+{
+}
+
+template<typename Program>
+void ShaderScheduler<Program>::Init(uint32_t workerCount, const CompileFunction& compile, const Program& fallback)
+{
+	m_compile = compile;
+	m_fallbackProgram = fallback;
+
+	if (workerCount == 0)
+	{
+		workerCount = std::thread::hardware_concurrency();
+		if (workerCount == 0)
+		{
+			workerCount = 2;
+		}
+	}
+
+	m_stop = false;
+	for (uint32_t i = 0; i < workerCount; i++)
+	{
+		m_workers.push_back(std::thread(&ShaderScheduler::WorkerLoop, this));
+	}
+}
+
+template<typename Program>
+void ShaderScheduler<Program>::Term()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_jobsMutex);
+		m_stop = true;
+	}
+	m_jobsCondition.notify_all();
+
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+	m_workers.clear();
+	m_jobs = std::priority_queue<Job>();
+
+	for (auto& pEntry : m_entries)
+	{
+		pEntry->program.Release();
+		pEntry->pending.Release();
+	}
+	m_entries.clear();
+
+	m_fallbackProgram.Release();
+	m_fallbackProgram = Program();
+}
+
+template<typename Program>
+uint32_t ShaderScheduler<Program>::Add(uint32_t priority)
+{
+	Entry* pEntry = new Entry();
+	pEntry->priority = priority;
+	pEntry->version = 0;
+	pEntry->publishedGeneration = 0;
+	pEntry->pendingSucceeded = false;
+	pEntry->compileMs = 0;
+	pEntry->compiledGeneration = 0;
+
+	// Workers only see entries through their jobs, so growing the vector is safe
+	std::lock_guard<std::mutex> lock(m_jobsMutex);
+	m_entries.push_back(std::unique_ptr<Entry>(pEntry));
+	return (uint32_t)m_entries.size() - 1;
+}
+
+template<typename Program>
+void ShaderScheduler<Program>::Enqueue(uint32_t id)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_jobsMutex);
+		Entry* pEntry = m_entries[id].get();
+		m_jobs.push(Job{ pEntry->priority, m_sequence++, id, pEntry });
+	}
+	m_jobsCondition.notify_one();
+}
+
+template<typename Program>
+void ShaderScheduler<Program>::SetCompiled(uint32_t id, const Program& program)
+{
+	Entry* pEntry = m_entries[id].get();
+	{
+		std::lock_guard<std::mutex> lock(m_publishMutex);
+		pEntry->pending.Release();
+		pEntry->pending = program;
+		pEntry->pendingSucceeded = true;
+		pEntry->compileMs = 0;
+		pEntry->compiledGeneration.fetch_add(1, std::memory_order_release);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_jobsMutex);
+	}
+	m_doneCondition.notify_all();
+}
+
+template<typename Program>
+uint32_t ShaderScheduler<Program>::Update(std::vector<Published>* pPublished)
+{
+	uint32_t published = 0;
+	for (uint32_t id = 0; id < (uint32_t)m_entries.size(); id++)
+	{
+		Entry* pEntry = m_entries[id].get();
+		if (pEntry->compiledGeneration.load(std::memory_order_acquire) == pEntry->publishedGeneration)
+		{
+			continue;
+		}
+
+		Program program;
+		bool succeeded;
+		float compileMs;
+		{
+			std::lock_guard<std::mutex> lock(m_publishMutex);
+			pEntry->publishedGeneration = pEntry->compiledGeneration.load(std::memory_order_relaxed);
+			program = pEntry->pending;
+			pEntry->pending = Program();
+			succeeded = pEntry->pendingSucceeded;
+			compileMs = pEntry->compileMs;
+		}
+
+		if (succeeded)
+		{
+			pEntry->program.Release();
+			pEntry->program = program;
+			pEntry->version++;
+			published++;
+		}
+		else
+		{
+			program.Release();
+		}
+
+		if (pPublished != nullptr)
+		{
+			pPublished->push_back(Published{ id, succeeded, compileMs });
+		}
+	}
+
+	return published;
+}
+
+template<typename Program>
+void ShaderScheduler<Program>::Flush(std::vector<Published>* pPublished)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_jobsMutex);
+		m_doneCondition.wait(lock, [this]()
+		{
+			for (auto& pEntry : m_entries)
+			{
+				if (pEntry->compiledGeneration.load(std::memory_order_acquire) == 0)
+				{
+					return false;
+				}
+			}
+			return true;
+		});
+	}
+
+	Update(pPublished);
+}
+
+template<typename Program>
+bool ShaderScheduler<Program>::IsReady(uint32_t id) const
+{
+	return id < m_entries.size() && m_entries[id]->version != 0;
+}
+
+template<typename Program>
+const Program& ShaderScheduler<Program>::GetProgram(uint32_t id) const
+{
+	return IsReady(id) ? m_entries[id]->program : m_fallbackProgram;
+}
+
+template<typename Program>
+uint32_t ShaderScheduler<Program>::GetVersion(uint32_t id) const
+{
+	return id < m_entries.size() ? m_entries[id]->version : 0;
+}
+
+template<typename Program>
+const Program& ShaderScheduler<Program>::GetFallbackProgram() const
+{
+	return m_fallbackProgram;
+}
+
+template<typename Program>
+uint32_t ShaderScheduler<Program>::GetCount() const
+{
+	return (uint32_t)m_entries.size();
+}
+
+template<typename Program>
+uint32_t ShaderScheduler<Program>::GetPendingCount() const
+{
+	uint32_t count = 0;
+	for (auto& pEntry : m_entries)
+	{
+		if (pEntry->publishedGeneration == 0)
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+template<typename Program>
+void ShaderScheduler<Program>::WorkerLoop()
+{
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_jobsMutex);
+			m_jobsCondition.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+			if (m_stop)
+			{
+				return;
+			}
+
+			job = m_jobs.top();
+			m_jobs.pop();
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		Program program;
+		bool succeeded = m_compile(job.id, &program);
+		float compileMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		{
+			std::lock_guard<std::mutex> lock(m_publishMutex);
+			job.pEntry->pending.Release();
+			job.pEntry->pending = program;
+			job.pEntry->pendingSucceeded = succeeded;
+			job.pEntry->compileMs = compileMs;
+			job.pEntry->compiledGeneration.fetch_add(1, std::memory_order_release);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_jobsMutex);
+		}
+		m_doneCondition.notify_all();
+	}
+}
@@ -0,0 +1,22 @@
+#include "ShaderTable.h"
+
+#include <string.h>
+
+#ifndef EMBED_SHADERS
+// Shaders are compiled at runtime, ShaderTable.generated.cpp is not part of the build
+const ShaderTableEntry g_shaderTable[] = { { "", "", "", NULL, 0 } };
+const size_t g_shaderTableSize = 0;
+#endif
+
+const ShaderTableEntry* FindShaderBytecode(const char* file, const char* entryPoint, const char* defines)
+{
+	for (size_t i = 0; i < g_shaderTableSize; i++)
+	{
+		const ShaderTableEntry& entry = g_shaderTable[i];
+		if (strcmp(entry.file, file) == 0 && strcmp(entry.entryPoint, entryPoint) == 0 && strcmp(entry.defines, defines) == 0)
+		{
+			return &entry;
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+
+// Precompiled shader bytecode embedded into the binary. The table is produced
+// by ShaderTableGen when the project is built with EmbedShaders=true,
+// otherwise it is empty and shaders are compiled from source.
+struct ShaderTableEntry
+{
+	const char* file;
+	const char* entryPoint;
+	const char* defines; // "NAME=VALUE;NAME=VALUE" in axis order, empty for none
+	const unsigned char* pBytecode;
+	size_t size;
+};
+
+extern const ShaderTableEntry g_shaderTable[];
+extern const size_t g_shaderTableSize;
+
+const ShaderTableEntry* FindShaderBytecode(const char* file, const char* entryPoint, const char* defines);
@@ -0,0 +1,248 @@
+// ShaderTableGen : writes precompiled shader blobs into a C++ translation unit
+// with constexpr byte arrays and the g_shaderTable lookup table.
+//
+// Usage: ShaderTableGen <output.cpp> <file|entry|defines|blob> ...
+//
+// ColorShader items have to carry the defines of the variant the renderer
+// requests for one of the built-in scene light setups, otherwise the tool
+// fails and so does the build: an embedded variant that is never looked up
+// would silently fall back to compiling at runtime. Once any ColorShader
+// entry point is embedded, it has to be for every light setup, so none of
+// the scene's light modes goes unbuilt.
+//
+// Only the C++ standard library is used, so the tool builds on any platform,
+// e.g. "c++ -std=c++14 -I.. ShaderTableGen.cpp ../ColorShaderVariants.cpp
+// ../ShaderPermutation.cpp -o ShaderTableGen".
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "BuiltinScene.h"
+#include "ColorShaderVariants.h"
+
+struct TableItem
+{
+	std::string file;
+	std::string entryPoint;
+	std::string defines;
+	std::string blobPath;
+	std::vector<unsigned char> bytecode;
+};
+
+static bool ParseItem(const std::string& arg, TableItem& item)
+{
+	std::vector<std::string> parts;
+	size_t start = 0;
+	for (;;)
+	{
+		size_t bar = arg.find('|', start);
+		parts.push_back(arg.substr(start, bar == std::string::npos ? std::string::npos : bar - start));
+		if (bar == std::string::npos)
+		{
+			break;
+		}
+		start = bar + 1;
+	}
+
+	if (parts.size() != 4 || parts[0].empty() || parts[1].empty() || parts[3].empty())
+	{
+		return false;
+	}
+
+	item.file = parts[0];
+	item.entryPoint = parts[1];
+	item.defines = parts[2];
+	item.blobPath = parts[3];
+	return true;
+}
+
+static bool ReadBlob(const std::string& path, std::vector<unsigned char>& data)
+{
+	FILE* pFile = NULL;
+#ifdef _MSC_VER
+	fopen_s(&pFile, path.c_str(), "rb");
+#else
+	pFile = fopen(path.c_str(), "rb");
+#endif
+	if (pFile == NULL)
+	{
+		return false;
+	}
+
+	fseek(pFile, 0, SEEK_END);
+	long size = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+
+	data.resize(size > 0 ? (size_t)size : 0);
+	bool ok = size > 0 && fread(data.data(), data.size(), 1, pFile) == 1;
+	fclose(pFile);
+
+	return ok;
+}
+
+// Defines as ShaderCompiler::CreateEmbeddedProgram() looks them up
+static std::string FormatDefines(const ShaderDefines& defines)
+{
+	std::string text;
+	for (const auto& define : defines)
+	{
+		if (!text.empty())
+		{
+			text.push_back(';');
+		}
+		text += define.first + "=" + define.second;
+	}
+	return text;
+}
+
+static bool CheckVariant(const TableItem& item)
+{
+	if (item.file != "ColorShader.hlsl")
+	{
+		return true;
+	}
+
+	ShaderPermutationSpace space = ColorShaderVariants::CreateSpace();
+	std::string expected;
+	for (int i = 0; i < BuiltinScene::LIGHT_SETUP_COUNT; i++)
+	{
+		uint32_t lightCount = BuiltinScene::GetLightCount((BuiltinScene::LightSetup)i);
+		std::string defines = FormatDefines(space.GetDefines(ColorShaderVariants::GetSceneKey(space, lightCount)));
+		if (item.defines == defines)
+		{
+			return true;
+		}
+		expected += expected.empty() ? "'" : " or '";
+		expected += defines + "'";
+	}
+
+	fprintf(stderr, "ShaderTableGen: %s %s is embedded with '%s', the built-in scene requests %s\n",
+		item.file.c_str(), item.entryPoint.c_str(), item.defines.c_str(), expected.c_str());
+	return false;
+}
+
+static bool CheckSetups(const std::vector<TableItem>& items)
+{
+	ShaderPermutationSpace space = ColorShaderVariants::CreateSpace();
+	for (const TableItem& item : items)
+	{
+		if (item.file != "ColorShader.hlsl")
+		{
+			continue;
+		}
+
+		for (int i = 0; i < BuiltinScene::LIGHT_SETUP_COUNT; i++)
+		{
+			uint32_t lightCount = BuiltinScene::GetLightCount((BuiltinScene::LightSetup)i);
+			std::string defines = FormatDefines(space.GetDefines(ColorShaderVariants::GetSceneKey(space, lightCount)));
+			bool found = false;
+			for (const TableItem& other : items)
+			{
+				found = found || (other.file == item.file && other.entryPoint == item.entryPoint && other.defines == defines);
+			}
+			if (!found)
+			{
+				fprintf(stderr, "ShaderTableGen: %s %s is not embedded with '%s' for the scene with %u lights\n",
+					item.file.c_str(), item.entryPoint.c_str(), defines.c_str(), (unsigned)lightCount);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static std::string Quote(const std::string& str)
+{
+	std::string quoted = "\"";
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\')
+		{
+			quoted.push_back('\\');
+		}
+		quoted.push_back(c);
+	}
+	quoted.push_back('"');
+	return quoted;
+}
+
+static void WriteTable(FILE* pOut, const std::vector<TableItem>& items)
+{
+	fprintf(pOut, "// Generated by ShaderTableGen, do not edit.\n\n");
+	fprintf(pOut, "#include \"ShaderTable.h\"\n\n");
+
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		const TableItem& item = items[i];
+
+		fprintf(pOut, "// %s %s%s%s\n", item.file.c_str(), item.entryPoint.c_str(),
+			item.defines.empty() ? "" : " ", item.defines.c_str());
+		fprintf(pOut, "static constexpr unsigned char Bytecode%u[%u] = {", (unsigned)i, (unsigned)item.bytecode.size());
+		for (size_t b = 0; b < item.bytecode.size(); b++)
+		{
+			fprintf(pOut, "%s0x%02x,", b % 16 == 0 ? "\n\t" : " ", item.bytecode[b]);
+		}
+		fprintf(pOut, "\n};\n\n");
+	}
+
+	fprintf(pOut, "const ShaderTableEntry g_shaderTable[] = {\n");
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		const TableItem& item = items[i];
+		fprintf(pOut, "\t{ %s, %s, %s, Bytecode%u, sizeof(Bytecode%u) },\n", Quote(item.file).c_str(),
+			Quote(item.entryPoint).c_str(), Quote(item.defines).c_str(), (unsigned)i, (unsigned)i);
+	}
+	fprintf(pOut, "};\n\n");
+	fprintf(pOut, "const size_t g_shaderTableSize = %u;\n", (unsigned)items.size());
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "Usage: ShaderTableGen <output.cpp> <file|entry|defines|blob> ...\n");
+		return 1;
+	}
+
+	std::vector<TableItem> items;
+	for (int i = 2; i < argc; i++)
+	{
+		TableItem item;
+		if (!ParseItem(argv[i], item))
+		{
+			fprintf(stderr, "ShaderTableGen: malformed item '%s'\n", argv[i]);
+			return 1;
+		}
+		if (!CheckVariant(item))
+		{
+			return 1;
+		}
+		if (!ReadBlob(item.blobPath, item.bytecode))
+		{
+			fprintf(stderr, "ShaderTableGen: cannot read blob '%s'\n", item.blobPath.c_str());
+			return 1;
+		}
+		items.push_back(item);
+	}
+	if (!CheckSetups(items))
+	{
+		return 1;
+	}
+
+	FILE* pOut = NULL;
+#ifdef _MSC_VER
+	fopen_s(&pOut, argv[1], "wb");
+#else
+	pOut = fopen(argv[1], "wb");
+#endif
+	if (pOut == NULL)
+	{
+		fprintf(stderr, "ShaderTableGen: cannot write '%s'\n", argv[1]);
+		return 1;
+	}
+
+	WriteTable(pOut, items);
+	fclose(pOut);
+
+	return 0;
+}
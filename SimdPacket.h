@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#else
+#include <xmmintrin.h>
+#endif
+
+// Float packets of the widest instruction set compiled for: 16 lanes with
+// AVX-512, 8 with AVX2, 4 with SSE. MulAdd() is fused where FMA is enabled,
+// which MSVC's /arch:AVX2 implies and GCC and Clang need -mfma for. Rcp()
+// and Rsqrt() refine the hardware estimates with one Newton-Raphson step,
+// Div() is exact.
+#if defined(__AVX512F__)
+typedef __m512 Packet;
+typedef __mmask16 Mask;
+static const uint32_t PacketWidth = 16;
+
+static inline Packet Load(const float* p) { return _mm512_loadu_ps(p); }
+static inline void Store(float* p, Packet a) { _mm512_storeu_ps(p, a); }
+static inline Packet Set(float a) { return _mm512_set1_ps(a); }
+static inline Packet Add(Packet a, Packet b) { return _mm512_add_ps(a, b); }
+static inline Packet Sub(Packet a, Packet b) { return _mm512_sub_ps(a, b); }
+static inline Packet Mul(Packet a, Packet b) { return _mm512_mul_ps(a, b); }
+static inline Packet MulAdd(Packet a, Packet b, Packet c) { return _mm512_fmadd_ps(a, b, c); }
+static inline Packet Div(Packet a, Packet b) { return _mm512_div_ps(a, b); }
+static inline Packet Min(Packet a, Packet b) { return _mm512_min_ps(a, b); }
+static inline Packet Max(Packet a, Packet b) { return _mm512_max_ps(a, b); }
+static inline Mask Greater(Packet a, Packet b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+static inline Packet Select(Mask mask, Packet a, Packet b) { return _mm512_mask_blend_ps(mask, b, a); }
+static inline Packet RcpEstimate(Packet a) { return _mm512_rcp14_ps(a); }
+static inline Packet RsqrtEstimate(Packet a) { return _mm512_rsqrt14_ps(a); }
+#elif defined(__AVX2__)
+typedef __m256 Packet;
+typedef __m256 Mask;
+static const uint32_t PacketWidth = 8;
+
+static inline Packet Load(const float* p) { return _mm256_loadu_ps(p); }
+static inline void Store(float* p, Packet a) { _mm256_storeu_ps(p, a); }
+static inline Packet Set(float a) { return _mm256_set1_ps(a); }
+static inline Packet Add(Packet a, Packet b) { return _mm256_add_ps(a, b); }
+static inline Packet Sub(Packet a, Packet b) { return _mm256_sub_ps(a, b); }
+static inline Packet Mul(Packet a, Packet b) { return _mm256_mul_ps(a, b); }
+#if defined(__FMA__) || defined(_MSC_VER)
+static inline Packet MulAdd(Packet a, Packet b, Packet c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+static inline Packet MulAdd(Packet a, Packet b, Packet c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+static inline Packet Div(Packet a, Packet b) { return _mm256_div_ps(a, b); }
+static inline Packet Min(Packet a, Packet b) { return _mm256_min_ps(a, b); }
+static inline Packet Max(Packet a, Packet b) { return _mm256_max_ps(a, b); }
+static inline Mask Greater(Packet a, Packet b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline Packet Select(Mask mask, Packet a, Packet b) { return _mm256_blendv_ps(b, a, mask); }
+static inline Packet RcpEstimate(Packet a) { return _mm256_rcp_ps(a); }
+static inline Packet RsqrtEstimate(Packet a) { return _mm256_rsqrt_ps(a); }
+#else
+typedef __m128 Packet;
+typedef __m128 Mask;
+static const uint32_t PacketWidth = 4;
+
+static inline Packet Load(const float* p) { return _mm_loadu_ps(p); }
+static inline void Store(float* p, Packet a) { _mm_storeu_ps(p, a); }
+static inline Packet Set(float a) { return _mm_set1_ps(a); }
+static inline Packet Add(Packet a, Packet b) { return _mm_add_ps(a, b); }
+static inline Packet Sub(Packet a, Packet b) { return _mm_sub_ps(a, b); }
+static inline Packet Mul(Packet a, Packet b) { return _mm_mul_ps(a, b); }
+static inline Packet MulAdd(Packet a, Packet b, Packet c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+static inline Packet Div(Packet a, Packet b) { return _mm_div_ps(a, b); }
+static inline Packet Min(Packet a, Packet b) { return _mm_min_ps(a, b); }
+static inline Packet Max(Packet a, Packet b) { return _mm_max_ps(a, b); }
+static inline Mask Greater(Packet a, Packet b) { return _mm_cmpgt_ps(a, b); }
+static inline Packet Select(Mask mask, Packet a, Packet b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+static inline Packet RcpEstimate(Packet a) { return _mm_rcp_ps(a); }
+static inline Packet RsqrtEstimate(Packet a) { return _mm_rsqrt_ps(a); }
+#endif
+
+static inline Packet Rcp(Packet a)
+{
+	Packet x = RcpEstimate(a);
+	return Mul(x, Sub(Set(2.0f), Mul(a, x)));
+}
+
+static inline Packet Rsqrt(Packet a)
+{
+	Packet x = RsqrtEstimate(a);
+	return Mul(Mul(Set(0.5f), x), Sub(Set(3.0f), Mul(Mul(a, x), x)));
+}
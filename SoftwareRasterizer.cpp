@@ -0,0 +1,700 @@
+#include "SoftwareRasterizer.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Below this many triangles per worker a single thread is faster than starting workers
+static const uint32_t MinTrianglesPerWorker = 2048;
+
+// Screen positions stay within this many pixels of the viewport center, so
+// edge deltas fit 18 bits in 28.4 and a tile of edge steps fits 29 bits
+static const float GuardBandPixels = 4096.0f;
+
+static const int32_t SubPixelBits = 4;
+static const int32_t SubPixelScale = 1 << SubPixelBits;
+
+// Edge values at a tile start are clamped to this, the steps inside a tile
+// are smaller, so clamped values keep their sign and never overflow
+static const int64_t EdgeClamp = 1 << 30;
+
+static const uint32_t AttributeCount = 5;
+
+// Clip space vertices outside the guard band or in front of the near plane
+enum OutsideBits
+{
+	OUTSIDE_RIGHT = 1,
+	OUTSIDE_LEFT = 2,
+	OUTSIDE_TOP = 4,
+	OUTSIDE_BOTTOM = 8,
+	OUTSIDE_NEAR = 16,
+	OUTSIDE_PLANE_COUNT = 5
+};
+
+// Runs work(worker) on workerCount threads, the calling one included
+template <typename Work>
+static void RunWorkers(uint32_t workerCount, const Work& work)
+{
+	std::vector<std::thread> threads;
+	for (uint32_t w = 1; w < workerCount; w++)
+	{
+		threads.push_back(std::thread(work, w));
+	}
+	work(0);
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+#if defined(__AVX2__)
+static uint32_t CountBits(uint32_t mask)
+{
+	uint32_t count = 0;
+	for (; mask != 0; mask &= mask - 1)
+	{
+		count++;
+	}
+	return count;
+}
+#else
+static uint32_t PackColor(float r, float g, float b)
+{
+	uint32_t red = (uint32_t)(std::max(0.0f, std::min(1.0f, r)) * 255.0f + 0.5f);
+	uint32_t green = (uint32_t)(std::max(0.0f, std::min(1.0f, g)) * 255.0f + 0.5f);
+	uint32_t blue = (uint32_t)(std::max(0.0f, std::min(1.0f, b)) * 255.0f + 0.5f);
+	return red | (green << 8) | (blue << 16) | 0xFF000000;
+}
+#endif
+
+static int32_t ClampEdge(int64_t value)
+{
+	return (int32_t)std::max(-EdgeClamp, std::min(EdgeClamp, value));
+}
+
+SoftwareRasterizer::SoftwareRasterizer()
+	: m_width(0)
+	, m_height(0)
+	, m_pitch(0)
+	, m_workerCount(1)
+	, m_tilesX(0)
+	, m_tilesY(0)
+	, m_guardX(1)
+	, m_guardY(1)
+	, m_clearPending(false)
+	, m_clearColor(0)
+	, m_clearDepth(1)
+	, m_triangleCount(0)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void SoftwareRasterizer::Init(uint32_t width, uint32_t height, uint32_t workerCount)
+{
+	assert(width > 0 && height > 0 && width <= 2 * (uint32_t)GuardBandPixels && height <= 2 * (uint32_t)GuardBandPixels);
+
+	m_width = width;
+	m_height = height;
+	m_pitch = (width + 7) & ~7;
+	m_workerCount = std::max(1u, workerCount != 0 ? workerCount : std::thread::hardware_concurrency());
+	m_tilesX = (width + TileSize - 1) / TileSize;
+	m_tilesY = (height + TileSize - 1) / TileSize;
+	m_guardX = 2.0f * GuardBandPixels / width;
+	m_guardY = 2.0f * GuardBandPixels / height;
+
+	m_color.assign((size_t)m_pitch * height, 0);
+	m_depth.assign((size_t)m_pitch * height, 1.0f);
+	m_clearPending = false;
+
+	m_workers.resize(m_workerCount);
+	for (Worker& worker : m_workers)
+	{
+		worker.bins.clear();
+		worker.bins.resize(m_tilesX * m_tilesY);
+	}
+
+	m_draws.clear();
+	m_triangleCount = 0;
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void SoftwareRasterizer::Clear(uint32_t color, float depth)
+{
+	m_clearPending = true;
+	m_clearColor = color;
+	m_clearDepth = depth;
+}
+
+void SoftwareRasterizer::Draw(const float* pWorldViewProj, const float* pPositions, size_t positionStride, const float* pColors,
+	size_t colorStride, uint32_t vertexCount, const uint32_t* pIndices, uint32_t indexCount)
+{
+	assert(indexCount % 3 == 0);
+
+	DrawCall draw;
+	memcpy(draw.worldViewProj, pWorldViewProj, sizeof(draw.worldViewProj));
+	draw.pPositions = pPositions;
+	draw.positionStride = positionStride;
+	draw.pColors = pColors;
+	draw.colorStride = colorStride;
+	draw.vertexCount = vertexCount;
+	draw.pIndices = pIndices;
+	draw.firstTriangle = m_triangleCount;
+	draw.triangleCount = indexCount / 3;
+	m_draws.push_back(draw);
+
+	m_triangleCount += draw.triangleCount;
+}
+
+void SoftwareRasterizer::Flush()
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_stats.drawCount = (uint32_t)m_draws.size();
+	m_stats.triangleCount = m_triangleCount;
+
+	// Each worker sets up a contiguous run of triangles into its own bins
+	auto start = std::chrono::steady_clock::now();
+	for (Worker& worker : m_workers)
+	{
+		worker.triangles.clear();
+		for (std::vector<uint32_t>& bin : worker.bins)
+		{
+			bin.clear();
+		}
+		worker.culledCount = 0;
+		worker.clippedCount = 0;
+		worker.binnedCount = 0;
+		worker.pixelCount = 0;
+	}
+	uint32_t workers = std::min(m_workerCount, 1 + m_triangleCount / MinTrianglesPerWorker);
+	RunWorkers(workers, [this, workers](uint32_t worker)
+	{
+		SetupTriangles(worker, (uint32_t)((uint64_t)m_triangleCount * worker / workers), (uint32_t)((uint64_t)m_triangleCount * (worker + 1) / workers));
+	});
+	m_stats.setupMs = MillisecondsSince(start);
+
+	// Tiles are independent tasks taken in order by the workers
+	start = std::chrono::steady_clock::now();
+	uint32_t tileCount = m_tilesX * m_tilesY;
+	std::atomic<uint32_t> nextTile(0);
+	RunWorkers(std::min(m_workerCount, tileCount), [this, tileCount, &nextTile](uint32_t worker)
+	{
+		for (uint32_t tile = nextTile++; tile < tileCount; tile = nextTile++)
+		{
+			RasterizeTile(worker, tile);
+		}
+	});
+	m_stats.rasterMs = MillisecondsSince(start);
+
+	for (const Worker& worker : m_workers)
+	{
+		m_stats.culledCount += worker.culledCount;
+		m_stats.clippedCount += worker.clippedCount;
+		m_stats.binnedCount += worker.binnedCount;
+		m_stats.pixelCount += worker.pixelCount;
+	}
+
+	m_clearPending = false;
+	m_draws.clear();
+	m_triangleCount = 0;
+}
+
+uint32_t SoftwareRasterizer::GetWidth() const
+{
+	return m_width;
+}
+
+uint32_t SoftwareRasterizer::GetHeight() const
+{
+	return m_height;
+}
+
+uint32_t SoftwareRasterizer::GetPitch() const
+{
+	return m_pitch;
+}
+
+const uint32_t* SoftwareRasterizer::GetColorBuffer() const
+{
+	return m_color.data();
+}
+
+const float* SoftwareRasterizer::GetDepthBuffer() const
+{
+	return m_depth.data();
+}
+
+SoftwareRasterizer::Stats SoftwareRasterizer::GetStats() const
+{
+	return m_stats;
+}
+
+void SoftwareRasterizer::TransformVertices(const DrawCall& draw, uint32_t first, uint32_t count, ClipVertex* pVertices)
+{
+	const float* m = draw.worldViewProj;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const float* p = (const float*)((const char*)draw.pPositions + (first + i) * draw.positionStride);
+		const float* c = (const float*)((const char*)draw.pColors + (first + i) * draw.colorStride);
+		ClipVertex& v = pVertices[i];
+		for (int j = 0; j < 4; j++)
+		{
+			v.position[j] = p[0] * m[j] + p[1] * m[4 + j] + p[2] * m[8 + j] + m[12 + j];
+		}
+		v.color[0] = c[0];
+		v.color[1] = c[1];
+		v.color[2] = c[2];
+	}
+}
+
+void SoftwareRasterizer::SetupTriangles(uint32_t worker, uint32_t begin, uint32_t end)
+{
+	Worker& state = m_workers[worker];
+
+	size_t d = 0;
+	while (d < m_draws.size() && m_draws[d].firstTriangle + m_draws[d].triangleCount <= begin)
+	{
+		d++;
+	}
+
+	for (; d < m_draws.size() && m_draws[d].firstTriangle < end; d++)
+	{
+		const DrawCall& draw = m_draws[d];
+		uint32_t first = std::max(begin, draw.firstTriangle) - draw.firstTriangle;
+		uint32_t last = std::min(end, draw.firstTriangle + draw.triangleCount) - draw.firstTriangle;
+		if (first >= last)
+		{
+			continue;
+		}
+
+		// Only the referenced vertex range is transformed, a draw split
+		// between workers is mostly transformed once
+		uint32_t minIndex = UINT32_MAX, maxIndex = 0;
+		for (uint32_t i = first * 3; i < last * 3; i++)
+		{
+			minIndex = std::min(minIndex, draw.pIndices[i]);
+			maxIndex = std::max(maxIndex, draw.pIndices[i]);
+		}
+		assert(maxIndex < draw.vertexCount);
+		state.vertices.resize(maxIndex - minIndex + 1);
+		TransformVertices(draw, minIndex, maxIndex - minIndex + 1, state.vertices.data());
+
+		for (uint32_t i = first; i < last; i++)
+		{
+			const uint32_t* pIndices = draw.pIndices + i * 3;
+			const ClipVertex* pVertices = state.vertices.data() - minIndex;
+			ClipVertex v[3] = { pVertices[pIndices[0]], pVertices[pIndices[1]], pVertices[pIndices[2]] };
+
+			uint32_t outside[3];
+			for (int j = 0; j < 3; j++)
+			{
+				const float* p = v[j].position;
+				float guardX = m_guardX * p[3];
+				float guardY = m_guardY * p[3];
+				outside[j] = (p[0] > guardX ? OUTSIDE_RIGHT : 0) | (p[0] < -guardX ? OUTSIDE_LEFT : 0) |
+					(p[1] > guardY ? OUTSIDE_TOP : 0) | (p[1] < -guardY ? OUTSIDE_BOTTOM : 0) |
+					(p[2] < 0 ? OUTSIDE_NEAR : 0);
+			}
+
+			if ((outside[0] & outside[1] & outside[2]) != 0)
+			{
+				state.culledCount++;
+			}
+			else if ((outside[0] | outside[1] | outside[2]) == 0)
+			{
+				SetupTriangle(state, v[0], v[1], v[2]);
+			}
+			else
+			{
+				state.clippedCount++;
+				ClipTriangle(state, v, outside[0] | outside[1] | outside[2]);
+			}
+		}
+	}
+}
+
+void SoftwareRasterizer::ClipTriangle(Worker& worker, const ClipVertex* pVertices, uint32_t outside)
+{
+	// Each plane adds at most one vertex to the polygon
+	ClipVertex buffers[2][3 + OUTSIDE_PLANE_COUNT];
+	ClipVertex* pIn = buffers[0];
+	ClipVertex* pOut = buffers[1];
+	uint32_t count = 3;
+	pIn[0] = pVertices[0];
+	pIn[1] = pVertices[1];
+	pIn[2] = pVertices[2];
+
+	for (uint32_t plane = 0; plane < OUTSIDE_PLANE_COUNT && count >= 3; plane++)
+	{
+		if ((outside & (1 << plane)) == 0)
+		{
+			continue;
+		}
+
+		// Signed distance inside the plane
+		float distances[3 + OUTSIDE_PLANE_COUNT];
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const float* p = pIn[i].position;
+			switch (1 << plane)
+			{
+			case OUTSIDE_RIGHT: distances[i] = m_guardX * p[3] - p[0]; break;
+			case OUTSIDE_LEFT: distances[i] = m_guardX * p[3] + p[0]; break;
+			case OUTSIDE_TOP: distances[i] = m_guardY * p[3] - p[1]; break;
+			case OUTSIDE_BOTTOM: distances[i] = m_guardY * p[3] + p[1]; break;
+			default: distances[i] = p[2]; break;
+			}
+		}
+
+		uint32_t outCount = 0;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t j = i + 1 < count ? i + 1 : 0;
+			if (distances[i] >= 0)
+			{
+				pOut[outCount++] = pIn[i];
+			}
+			if ((distances[i] >= 0) != (distances[j] >= 0))
+			{
+				float t = distances[i] / (distances[i] - distances[j]);
+				ClipVertex& v = pOut[outCount++];
+				for (int k = 0; k < 4; k++)
+				{
+					v.position[k] = pIn[i].position[k] + (pIn[j].position[k] - pIn[i].position[k]) * t;
+				}
+				for (int k = 0; k < 3; k++)
+				{
+					v.color[k] = pIn[i].color[k] + (pIn[j].color[k] - pIn[i].color[k]) * t;
+				}
+			}
+		}
+		count = outCount;
+		std::swap(pIn, pOut);
+	}
+
+	// Convex polygon as a fan
+	for (uint32_t i = 2; i < count; i++)
+	{
+		SetupTriangle(worker, pIn[0], pIn[i - 1], pIn[i]);
+	}
+}
+
+void SoftwareRasterizer::SetupTriangle(Worker& worker, const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2)
+{
+	// Back faces are culled before the projection, with w > 0 the
+	// homogeneous determinant has the opposite sign of the screen area
+	const float* p0 = v0.position;
+	const float* p1 = v1.position;
+	const float* p2 = v2.position;
+	float determinant = p0[0] * (p1[1] * p2[3] - p2[1] * p1[3]) - p0[1] * (p1[0] * p2[3] - p2[0] * p1[3]) +
+		p0[3] * (p1[0] * p2[1] - p2[0] * p1[1]);
+	if (p0[3] <= 0 || p1[3] <= 0 || p2[3] <= 0 || determinant >= 0)
+	{
+		worker.culledCount++;
+		return;
+	}
+
+	const ClipVertex* v[3] = { &v0, &v1, &v2 };
+	int32_t x[3], y[3];
+	float attributes[3][AttributeCount];
+	for (int i = 0; i < 3; i++)
+	{
+		const float* p = v[i]->position;
+		// Snapped to the sub-pixel grid, y down
+		float invW = 1.0f / p[3];
+		float screenX = (p[0] * invW * 0.5f + 0.5f) * m_width;
+		float screenY = (0.5f - p[1] * invW * 0.5f) * m_height;
+		x[i] = (int32_t)floorf(screenX * SubPixelScale + 0.5f);
+		y[i] = (int32_t)floorf(screenY * SubPixelScale + 0.5f);
+
+		attributes[i][0] = p[2] * invW;
+		attributes[i][1] = invW;
+		attributes[i][2] = v[i]->color[0] * invW;
+		attributes[i][3] = v[i]->color[1] * invW;
+		attributes[i][4] = v[i]->color[2] * invW;
+	}
+
+	// Clockwise on screen is positive, triangles snapped to zero area are culled
+	int64_t area = (int64_t)(x[1] - x[0]) * (y[2] - y[0]) - (int64_t)(x[2] - x[0]) * (y[1] - y[0]);
+	if (area <= 0)
+	{
+		worker.culledCount++;
+		return;
+	}
+
+	// Pixels whose center lies in the bounds
+	Triangle triangle;
+	int32_t half = SubPixelScale / 2;
+	triangle.minX = std::max(0, (std::min(x[0], std::min(x[1], x[2])) - half + SubPixelScale - 1) >> SubPixelBits);
+	triangle.minY = std::max(0, (std::min(y[0], std::min(y[1], y[2])) - half + SubPixelScale - 1) >> SubPixelBits);
+	triangle.maxX = std::min((int32_t)m_width - 1, (std::max(x[0], std::max(x[1], x[2])) - half) >> SubPixelBits);
+	triangle.maxY = std::min((int32_t)m_height - 1, (std::max(y[0], std::max(y[1], y[2])) - half) >> SubPixelBits);
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+	{
+		worker.culledCount++;
+		return;
+	}
+
+	// Top and left edges own the pixel centers exactly on them
+	for (int i = 0; i < 3; i++)
+	{
+		int j = i < 2 ? i + 1 : 0;
+		int32_t a = y[i] - y[j];
+		int32_t b = x[j] - x[i];
+		bool topLeft = a > 0 || (a == 0 && b > 0);
+		triangle.edgeA[i] = a;
+		triangle.edgeB[i] = b;
+		triangle.edgeC[i] = -(int64_t)a * x[i] - (int64_t)b * y[i] - (topLeft ? 0 : 1);
+	}
+
+	// Attribute gradients over the snapped positions
+	double x1 = (double)(x[1] - x[0]) / SubPixelScale;
+	double y1 = (double)(y[1] - y[0]) / SubPixelScale;
+	double x2 = (double)(x[2] - x[0]) / SubPixelScale;
+	double y2 = (double)(y[2] - y[0]) / SubPixelScale;
+	double invArea = 1.0 / (x1 * y2 - x2 * y1);
+	triangle.originX = (float)x[0] / SubPixelScale;
+	triangle.originY = (float)y[0] / SubPixelScale;
+	for (uint32_t k = 0; k < AttributeCount; k++)
+	{
+		double d1 = (double)attributes[1][k] - attributes[0][k];
+		double d2 = (double)attributes[2][k] - attributes[0][k];
+		triangle.value[k] = attributes[0][k];
+		triangle.dx[k] = (float)((d1 * y2 - d2 * y1) * invArea);
+		triangle.dy[k] = (float)((d2 * x1 - d1 * x2) * invArea);
+	}
+
+	uint32_t index = (uint32_t)worker.triangles.size();
+	worker.triangles.push_back(triangle);
+
+	// Tiles of the bounds, larger triangles skip tiles outside one of their edges
+	uint32_t tileMinX = triangle.minX / TileSize;
+	uint32_t tileMinY = triangle.minY / TileSize;
+	uint32_t tileMaxX = triangle.maxX / TileSize;
+	uint32_t tileMaxY = triangle.maxY / TileSize;
+	bool testTiles = tileMinX != tileMaxX || tileMinY != tileMaxY;
+	for (uint32_t ty = tileMinY; ty <= tileMaxY; ty++)
+	{
+		for (uint32_t tx = tileMinX; tx <= tileMaxX; tx++)
+		{
+			if (testTiles)
+			{
+				// Pixel centers of the tile corners maximizing each edge
+				int64_t left = (int64_t)tx * TileSize * SubPixelScale + half;
+				int64_t top = (int64_t)ty * TileSize * SubPixelScale + half;
+				int64_t right = left + (TileSize - 1) * SubPixelScale;
+				int64_t bottom = top + (TileSize - 1) * SubPixelScale;
+				bool outside = false;
+				for (int i = 0; i < 3 && !outside; i++)
+				{
+					int64_t px = triangle.edgeA[i] > 0 ? right : left;
+					int64_t py = triangle.edgeB[i] > 0 ? bottom : top;
+					outside = triangle.edgeA[i] * px + triangle.edgeB[i] * py + triangle.edgeC[i] < 0;
+				}
+				if (outside)
+				{
+					continue;
+				}
+			}
+			worker.bins[ty * m_tilesX + tx].push_back(index);
+			worker.binnedCount++;
+		}
+	}
+}
+
+void SoftwareRasterizer::RasterizeTile(uint32_t worker, uint32_t tile)
+{
+	int32_t tileX = (int32_t)(tile % m_tilesX * TileSize);
+	int32_t tileY = (int32_t)(tile / m_tilesX * TileSize);
+	int32_t tileEndX = std::min(tileX + (int32_t)TileSize, (int32_t)m_width);
+	int32_t tileEndY = std::min(tileY + (int32_t)TileSize, (int32_t)m_height);
+
+	if (m_clearPending)
+	{
+		for (int32_t y = tileY; y < tileEndY; y++)
+		{
+			std::fill_n(m_color.data() + (size_t)y * m_pitch + tileX, tileEndX - tileX, m_clearColor);
+			std::fill_n(m_depth.data() + (size_t)y * m_pitch + tileX, tileEndX - tileX, m_clearDepth);
+		}
+	}
+
+	uint64_t pixelCount = 0;
+	for (const Worker& setup : m_workers)
+	{
+		for (uint32_t index : setup.bins[tile])
+		{
+			pixelCount += RasterizeTriangle(setup.triangles[index], tileX, tileY, tileEndX, tileEndY);
+		}
+	}
+	m_workers[worker].pixelCount += pixelCount;
+}
+
+uint64_t SoftwareRasterizer::RasterizeTriangle(const Triangle& triangle, int32_t tileX, int32_t tileY, int32_t tileEndX, int32_t tileEndY)
+{
+	int32_t startX = std::max(triangle.minX, tileX) & ~7;
+	int32_t endX = std::min(triangle.maxX, tileEndX - 1);
+	int32_t startY = std::max(triangle.minY, tileY);
+	int32_t endY = std::min(triangle.maxY, tileEndY - 1);
+	if (startX > endX || startY > endY)
+	{
+		return 0;
+	}
+
+	// Edge values at the first pixel center, then per pixel and per row
+	int64_t centerX = (int64_t)startX * SubPixelScale + SubPixelScale / 2;
+	int64_t centerY = (int64_t)startY * SubPixelScale + SubPixelScale / 2;
+	int32_t edgeRow[3], stepX[3], stepY[3];
+	for (int i = 0; i < 3; i++)
+	{
+		edgeRow[i] = ClampEdge(triangle.edgeA[i] * centerX + triangle.edgeB[i] * centerY + triangle.edgeC[i]);
+		stepX[i] = triangle.edgeA[i] * SubPixelScale;
+		stepY[i] = triangle.edgeB[i] * SubPixelScale;
+	}
+
+	float valueRow[AttributeCount];
+	for (uint32_t k = 0; k < AttributeCount; k++)
+	{
+		valueRow[k] = triangle.value[k] + triangle.dx[k] * (startX + 0.5f - triangle.originX) + triangle.dy[k] * (startY + 0.5f - triangle.originY);
+	}
+
+	uint64_t pixelCount = 0;
+#if defined(__AVX2__)
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256 laneOffsets = _mm256_cvtepi32_ps(lanes);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 scale = _mm256_set1_ps(255.0f);
+	const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+
+	// Columns past the end are masked like a fourth edge
+	__m256i columnStart = _mm256_sub_epi32(_mm256_set1_epi32(endX - startX), lanes);
+
+	__m256i edgeLaneStep[3], edgeGroupStep[3];
+	for (int i = 0; i < 3; i++)
+	{
+		edgeLaneStep[i] = _mm256_mullo_epi32(_mm256_set1_epi32(stepX[i]), lanes);
+		edgeGroupStep[i] = _mm256_set1_epi32(stepX[i] * 8);
+	}
+	__m256 valueGroupStep[AttributeCount], valueLaneStep[AttributeCount];
+	for (uint32_t k = 0; k < AttributeCount; k++)
+	{
+		valueLaneStep[k] = _mm256_mul_ps(_mm256_set1_ps(triangle.dx[k]), laneOffsets);
+		valueGroupStep[k] = _mm256_set1_ps(triangle.dx[k] * 8);
+	}
+
+	for (int32_t y = startY; y <= endY; y++)
+	{
+		uint32_t* pColor = m_color.data() + (size_t)y * m_pitch;
+		float* pDepth = m_depth.data() + (size_t)y * m_pitch;
+
+		__m256i e0 = _mm256_add_epi32(_mm256_set1_epi32(edgeRow[0]), edgeLaneStep[0]);
+		__m256i e1 = _mm256_add_epi32(_mm256_set1_epi32(edgeRow[1]), edgeLaneStep[1]);
+		__m256i e2 = _mm256_add_epi32(_mm256_set1_epi32(edgeRow[2]), edgeLaneStep[2]);
+		__m256i column = columnStart;
+		__m256 z = _mm256_add_ps(_mm256_set1_ps(valueRow[0]), valueLaneStep[0]);
+		__m256 invW = _mm256_add_ps(_mm256_set1_ps(valueRow[1]), valueLaneStep[1]);
+		__m256 r = _mm256_add_ps(_mm256_set1_ps(valueRow[2]), valueLaneStep[2]);
+		__m256 g = _mm256_add_ps(_mm256_set1_ps(valueRow[3]), valueLaneStep[3]);
+		__m256 b = _mm256_add_ps(_mm256_set1_ps(valueRow[4]), valueLaneStep[4]);
+
+		for (int32_t x = startX; x <= endX; x += 8)
+		{
+			// Sign bits of any edge mark uncovered pixels
+			__m256i outside = _mm256_or_si256(_mm256_or_si256(e0, e1), _mm256_or_si256(e2, column));
+			if (_mm256_movemask_ps(_mm256_castsi256_ps(outside)) != 0xFF)
+			{
+				__m256 depth = _mm256_loadu_ps(pDepth + x);
+				__m256 pass = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_srai_epi32(outside, 31)),
+					_mm256_and_ps(_mm256_cmp_ps(z, depth, _CMP_LT_OQ), _mm256_cmp_ps(z, one, _CMP_LE_OQ)));
+				int passMask = _mm256_movemask_ps(pass);
+				if (passMask != 0)
+				{
+					_mm256_storeu_ps(pDepth + x, _mm256_blendv_ps(depth, z, pass));
+
+					__m256 w = _mm256_div_ps(scale, invW);
+					__m256i red = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(r, w), zero), scale));
+					__m256i green = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(g, w), zero), scale));
+					__m256i blue = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(b, w), zero), scale));
+					__m256i color = _mm256_or_si256(_mm256_or_si256(red, alpha),
+						_mm256_or_si256(_mm256_slli_epi32(green, 8), _mm256_slli_epi32(blue, 16)));
+
+					__m256i* pTarget = (__m256i*)(pColor + x);
+					_mm256_storeu_si256(pTarget, _mm256_blendv_epi8(_mm256_loadu_si256(pTarget), color, _mm256_castps_si256(pass)));
+					pixelCount += CountBits(passMask);
+				}
+			}
+
+			e0 = _mm256_add_epi32(e0, edgeGroupStep[0]);
+			e1 = _mm256_add_epi32(e1, edgeGroupStep[1]);
+			e2 = _mm256_add_epi32(e2, edgeGroupStep[2]);
+			column = _mm256_sub_epi32(column, _mm256_set1_epi32(8));
+			z = _mm256_add_ps(z, valueGroupStep[0]);
+			invW = _mm256_add_ps(invW, valueGroupStep[1]);
+			r = _mm256_add_ps(r, valueGroupStep[2]);
+			g = _mm256_add_ps(g, valueGroupStep[3]);
+			b = _mm256_add_ps(b, valueGroupStep[4]);
+		}
+
+		for (int i = 0; i < 3; i++)
+		{
+			edgeRow[i] += stepY[i];
+		}
+		for (uint32_t k = 0; k < AttributeCount; k++)
+		{
+			valueRow[k] += triangle.dy[k];
+		}
+	}
+#else
+	for (int32_t y = startY; y <= endY; y++)
+	{
+		uint32_t* pColor = m_color.data() + (size_t)y * m_pitch;
+		float* pDepth = m_depth.data() + (size_t)y * m_pitch;
+
+		int32_t e0 = edgeRow[0];
+		int32_t e1 = edgeRow[1];
+		int32_t e2 = edgeRow[2];
+		float value[AttributeCount];
+		memcpy(value, valueRow, sizeof(value));
+		for (int32_t x = startX; x <= endX; x++)
+		{
+			float z = value[0];
+			if ((e0 | e1 | e2) >= 0 && z < pDepth[x] && z <= 1.0f)
+			{
+				pDepth[x] = z;
+				float w = 1.0f / value[1];
+				pColor[x] = PackColor(value[2] * w, value[3] * w, value[4] * w);
+				pixelCount++;
+			}
+
+			e0 += stepX[0];
+			e1 += stepX[1];
+			e2 += stepX[2];
+			for (uint32_t k = 0; k < AttributeCount; k++)
+			{
+				value[k] += triangle.dx[k];
+			}
+		}
+
+		for (int i = 0; i < 3; i++)
+		{
+			edgeRow[i] += stepY[i];
+		}
+		for (uint32_t k = 0; k < AttributeCount; k++)
+		{
+			valueRow[k] += triangle.dy[k];
+		}
+	}
+#endif
+	return pixelCount;
+}
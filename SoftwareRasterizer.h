@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Tile based triangle rasterizer drawing into memory. Flush() transforms the
+// vertices, clips, sets up and bins the triangles into 64x64 pixel tiles on a
+// pool of threads, then rasterizes the tiles in parallel. A tile walks the
+// bins of the setup workers in order, so draws keep their order. Edge
+// functions are evaluated in 28.4 fixed point, eight pixels at a time when
+// compiled with AVX2.
+//
+// Follows the pipeline state of the renderer: row-vector matrices, clip space
+// z in [0, w], clockwise front faces with back faces culled, top-left fill
+// rule and a LESS depth test with depth writes. Vertex colors are
+// interpolated perspective correct.
+class SoftwareRasterizer
+{
+public:
+	static const uint32_t TileSize = 64;
+
+	struct Stats
+	{
+		uint32_t drawCount;
+		uint32_t triangleCount; // submitted
+		uint32_t culledCount; // back facing, outside or covering no pixel center
+		uint32_t clippedCount; // crossing the near plane or the guard band
+		uint64_t binnedCount; // triangle tile pairs
+		uint64_t pixelCount; // passed the depth test
+		double setupMs; // vertex transform included
+		double rasterMs;
+	};
+
+	SoftwareRasterizer();
+
+	// Up to 8192 pixels on each side, workerCount 0 picks hardware concurrency
+	void Init(uint32_t width, uint32_t height, uint32_t workerCount = 0);
+
+	// Applied to every tile when the next Flush() rasterizes it. Color is
+	// RGBA8 with red in the low byte.
+	void Clear(uint32_t color, float depth = 1.0f);
+
+	// Positions are xyz and colors rgb floats, strides in bytes. The arrays
+	// are read by Flush() and have to stay valid until then.
+	void Draw(const float* pWorldViewProj, const float* pPositions, size_t positionStride, const float* pColors, size_t colorStride,
+		uint32_t vertexCount, const uint32_t* pIndices, uint32_t indexCount);
+
+	// Renders the draws since the last call
+	void Flush();
+
+	uint32_t GetWidth() const;
+	uint32_t GetHeight() const;
+
+	// Rows are GetPitch() pixels apart
+	uint32_t GetPitch() const;
+	const uint32_t* GetColorBuffer() const;
+	const float* GetDepthBuffer() const;
+
+	// Of the last Flush()
+	Stats GetStats() const;
+
+private:
+	struct DrawCall
+	{
+		float worldViewProj[16];
+		const float* pPositions;
+		size_t positionStride;
+		const float* pColors;
+		size_t colorStride;
+		uint32_t vertexCount;
+		const uint32_t* pIndices;
+		uint32_t firstTriangle;
+		uint32_t triangleCount;
+	};
+
+	struct ClipVertex
+	{
+		float position[4];
+		float color[3];
+	};
+
+	// Edge i runs from vertex i to vertex i + 1, a pixel center p is covered
+	// when a * p.x + b * p.y + c >= 0 for all three, in 28.4 units. Attribute
+	// planes give the value at pixel center (x, y) as
+	// value + dx * (x + 0.5 - originX) + dy * (y + 0.5 - originY).
+	struct Triangle
+	{
+		int32_t edgeA[3];
+		int32_t edgeB[3];
+		int64_t edgeC[3];
+		int32_t minX;
+		int32_t minY;
+		int32_t maxX;
+		int32_t maxY;
+		float originX;
+		float originY;
+		float value[5]; // z / w, 1 / w, color / w
+		float dx[5];
+		float dy[5];
+	};
+
+	// Triangles set up by one worker and their bins, indexed by tile. Each
+	// worker transforms the vertices its triangles reference.
+	struct Worker
+	{
+		std::vector<ClipVertex> vertices;
+		std::vector<Triangle> triangles;
+		std::vector<std::vector<uint32_t>> bins;
+		uint32_t culledCount;
+		uint32_t clippedCount;
+		uint64_t binnedCount;
+		uint64_t pixelCount;
+	};
+
+	static void TransformVertices(const DrawCall& draw, uint32_t first, uint32_t count, ClipVertex* pVertices);
+	void SetupTriangles(uint32_t worker, uint32_t begin, uint32_t end);
+	void ClipTriangle(Worker& worker, const ClipVertex* pVertices, uint32_t outside);
+	void SetupTriangle(Worker& worker, const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2);
+	void RasterizeTile(uint32_t worker, uint32_t tile);
+	uint64_t RasterizeTriangle(const Triangle& triangle, int32_t tileX, int32_t tileY, int32_t tileEndX, int32_t tileEndY);
+
+private:
+	uint32_t m_width;
+	uint32_t m_height;
+	uint32_t m_pitch;
+	uint32_t m_workerCount;
+	uint32_t m_tilesX;
+	uint32_t m_tilesY;
+
+	// Clip space half extents of the guard band, in units of w
+	float m_guardX;
+	float m_guardY;
+
+	std::vector<uint32_t> m_color;
+	std::vector<float> m_depth;
+	bool m_clearPending;
+	uint32_t m_clearColor;
+	float m_clearDepth;
+
+	std::vector<DrawCall> m_draws;
+	uint32_t m_triangleCount;
+	std::vector<Worker> m_workers;
+	Stats m_stats;
+};
@@ -0,0 +1,575 @@
+// SoftwareRender : draws the built-in scene with SoftwareRasterizer, without
+// a window or a GPU, and measures the rasterizer on generated scenes.
+//
+// Usage: SoftwareRender [--size WxH] [--workers N] [--model path] [--lights red|small|field] [--exposure E] [--output image.ppm]
+//        SoftwareRender --benchmark [--workers N] [--seconds S]
+//        SoftwareRender --shading-benchmark [--seconds S]
+//
+// The scene matches the renderer's default view: camera, projection, meshes
+// and lights. ColorShader lighting is evaluated per vertex and interpolated,
+// textures are not sampled, and the colors are scaled by a fixed exposure
+// instead of being tone mapped. The benchmark draws grids of cubes at
+// increasing triangle counts and resolutions and prints frames per second,
+// the shading benchmark runs LightingKernel on random pixels and lights and
+// checks it against the scalar reference.
+//
+// Only the C++ standard library is used, so the tool builds on any platform,
+// e.g. "c++ -O2 -std=c++14 -mavx2 -mfma -pthread -I.. SoftwareRender.cpp
+// ../SoftwareRasterizer.cpp ../BuiltinScene.cpp ../LightManager.cpp
+// ../LightingKernel.cpp ../MeshImporter.cpp ../MappedFile.cpp -o SoftwareRender".
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "BuiltinScene.h"
+#include "LightManager.h"
+#include "LightingKernel.h"
+#include "MeshImporter.h"
+#include "SoftwareRasterizer.h"
+
+// Renderer defaults
+static const float CameraDistance = 10.0f;
+static const float NearPlane = 0.001f;
+static const float FarPlane = 100.0f;
+static const float FieldOfView = 2.0f * 3.14159265f / 3.0f;
+static const float LightCellSize = 1.0f;
+static const float ModelColor[3] = { 1.0f, 0.6f, 0.4f };
+
+static const uint32_t ClearColor = 0xFF000000;
+
+static const uint32_t BenchmarkSizes[][2] = { { 640, 360 }, { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+static const uint32_t BenchmarkTriangles[] = { 1000, 10000, 100000, 1000000 };
+
+// Shaded pixels stay in the cache, the results are compared to the reference
+// within a relative and an absolute tolerance
+static const uint32_t ShadingPixelCount = 16384;
+static const uint32_t ShadingLightCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+static const float ShadingRelativeTolerance = 1e-4f;
+static const float ShadingAbsoluteTolerance = 1e-6f;
+
+// Row-major matrices for row vectors, as in DirectXMath
+struct Matrix
+{
+	float m[16];
+};
+
+static Matrix Multiply(const Matrix& a, const Matrix& b)
+{
+	Matrix result;
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			result.m[i * 4 + j] = a.m[i * 4] * b.m[j] + a.m[i * 4 + 1] * b.m[4 + j] + a.m[i * 4 + 2] * b.m[8 + j] + a.m[i * 4 + 3] * b.m[12 + j];
+		}
+	}
+	return result;
+}
+
+static Matrix ScaleTranslation(float scale, float x, float y, float z)
+{
+	Matrix result = { {
+		scale, 0, 0, 0,
+		0, scale, 0, 0,
+		0, 0, scale, 0,
+		x, y, z, 1
+	} };
+	return result;
+}
+
+static Matrix RotationYX(float yaw, float pitch)
+{
+	float cy = cosf(yaw), sy = sinf(yaw);
+	float cp = cosf(pitch), sp = sinf(pitch);
+	Matrix rotationY = { { cy, 0, -sy, 0, 0, 1, 0, 0, sy, 0, cy, 0, 0, 0, 0, 1 } };
+	Matrix rotationX = { { 1, 0, 0, 0, 0, cp, sp, 0, 0, -sp, cp, 0, 0, 0, 0, 1 } };
+	return Multiply(rotationY, rotationX);
+}
+
+// Default camera at (0, 0, -CameraDistance) looking along z and the
+// renderer's projection, XMMatrixPerspectiveLH of the near plane size
+static Matrix ViewProjection(uint32_t width, uint32_t height)
+{
+	float viewWidth = NearPlane / tanf(FieldOfView / 2);
+	float viewHeight = (float)height / width * viewWidth;
+	float range = FarPlane / (FarPlane - NearPlane);
+	Matrix projection = { {
+		2 * NearPlane / viewWidth, 0, 0, 0,
+		0, 2 * NearPlane / viewHeight, 0, 0,
+		0, 0, range, 1,
+		0, 0, -range * NearPlane, 0
+	} };
+	return Multiply(ScaleTranslation(1, 0, 0, CameraDistance), projection);
+}
+
+static bool ParseSize(const char* text, uint32_t* pWidth, uint32_t* pHeight)
+{
+	unsigned width = 0, height = 0;
+#ifdef _MSC_VER
+	int parsed = sscanf_s(text, "%ux%u", &width, &height);
+#else
+	int parsed = sscanf(text, "%ux%u", &width, &height);
+#endif
+	if (parsed != 2 || width == 0 || height == 0 || width > 8192 || height > 8192)
+	{
+		return false;
+	}
+	*pWidth = width;
+	*pHeight = height;
+	return true;
+}
+
+static bool ParseLightSetup(const char* text, BuiltinScene::LightSetup* pSetup)
+{
+	for (int i = 0; i < BuiltinScene::LIGHT_SETUP_COUNT; i++)
+	{
+		if (strcmp(text, BuiltinScene::GetLightSetupName((BuiltinScene::LightSetup)i)) == 0)
+		{
+			*pSetup = (BuiltinScene::LightSetup)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool WriteImage(const char* path, const SoftwareRasterizer& rasterizer)
+{
+	FILE* pFile = NULL;
+#ifdef _MSC_VER
+	fopen_s(&pFile, path, "wb");
+#else
+	pFile = fopen(path, "wb");
+#endif
+	if (pFile == NULL)
+	{
+		return false;
+	}
+
+	uint32_t width = rasterizer.GetWidth();
+	uint32_t height = rasterizer.GetHeight();
+	fprintf(pFile, "P6\n%u %u\n255\n", width, height);
+	std::vector<unsigned char> row(width * 3);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const uint32_t* pPixels = rasterizer.GetColorBuffer() + (size_t)y * rasterizer.GetPitch();
+		for (uint32_t x = 0; x < width; x++)
+		{
+			row[x * 3] = (unsigned char)pPixels[x];
+			row[x * 3 + 1] = (unsigned char)(pPixels[x] >> 8);
+			row[x * 3 + 2] = (unsigned char)(pPixels[x] >> 16);
+		}
+		fwrite(row.data(), 1, row.size(), pFile);
+	}
+	bool written = ferror(pFile) == 0;
+	fclose(pFile);
+	return written;
+}
+
+static void PrintStats(const SoftwareRasterizer::Stats& stats, double ms)
+{
+	printf("  %u draws, %u triangles: %u culled, %u clipped, %llu tile bins, %llu pixels\n", stats.drawCount, stats.triangleCount,
+		stats.culledCount, stats.clippedCount, (unsigned long long)stats.binnedCount, (unsigned long long)stats.pixelCount);
+	printf("  %.2f ms: setup %.2f, raster %.2f\n", ms, stats.setupMs, stats.rasterMs);
+}
+
+static int RenderScene(uint32_t width, uint32_t height, uint32_t workers, float exposure, const char* pModelPath, BuiltinScene::LightSetup lightSetup, const char* pOutputPath)
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+	BuiltinScene::MeshRange ranges[BuiltinScene::MESH_COUNT];
+	BuiltinScene::AddMeshes(&vertices, &indices, ranges);
+
+	struct Object
+	{
+		Matrix world;
+		float scale;
+		uint32_t firstVertex;
+		uint32_t vertexCount;
+		uint32_t startIndex;
+		uint32_t indexCount;
+		const float* pMatColor;
+	};
+	static const float White[3] = { 1, 1, 1 };
+	std::vector<Object> objects;
+	for (const BuiltinScene::MeshRange& range : ranges)
+	{
+		Object object = { ScaleTranslation(1, 0, 0, 0), 1, range.firstVertex, range.vertexCount, range.startIndex, range.indexCount, White };
+		objects.push_back(object);
+	}
+
+	if (pModelPath != NULL)
+	{
+		MeshImporter importer;
+		MeshData mesh;
+		if (!importer.Load(pModelPath, mesh) || mesh.indices.empty())
+		{
+			fprintf(stderr, "SoftwareRender: cannot load '%s': %s\n", pModelPath, mesh.indices.empty() ? "no triangles" : importer.GetErrorMessage());
+			return 1;
+		}
+
+		BoundingBox bounds;
+		for (int i = 0; i < 3; i++)
+		{
+			bounds.center[i] = (mesh.boundsMin[i] + mesh.boundsMax[i]) * 0.5f;
+			bounds.extent[i] = (mesh.boundsMax[i] - mesh.boundsMin[i]) * 0.5f;
+		}
+		float scale, position[3];
+		BuiltinScene::PlaceModel(bounds, &scale, position);
+
+		Object model = { ScaleTranslation(scale, position[0], position[1], position[2]), scale, (uint32_t)vertices.size(),
+			(uint32_t)mesh.vertices.size(), (uint32_t)indices.size(), (uint32_t)mesh.indices.size(), ModelColor };
+		for (uint32_t index : mesh.indices)
+		{
+			indices.push_back(model.firstVertex + index);
+		}
+		vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+		objects.push_back(model);
+	}
+
+	LightManager lights;
+	lights.Init(LightCellSize);
+	BuiltinScene::AddLights(&lights, lightSetup);
+	lights.Update();
+
+	// Lit colors per vertex with the lights reaching the object bounds,
+	// objects are only scaled and translated
+	auto start = std::chrono::steady_clock::now();
+	std::vector<float> colors(vertices.size() * 3);
+	std::vector<float> soa[12];
+	std::vector<uint32_t> handles;
+	std::vector<LightManager::Light> objectLights;
+	for (const Object& object : objects)
+	{
+		for (std::vector<float>& stream : soa)
+		{
+			stream.resize(object.vertexCount);
+		}
+
+		float boundsMin[3] = { INFINITY, INFINITY, INFINITY };
+		float boundsMax[3] = { -INFINITY, -INFINITY, -INFINITY };
+		for (uint32_t i = 0; i < object.vertexCount; i++)
+		{
+			const MeshVertex& vertex = vertices[object.firstVertex + i];
+			for (int j = 0; j < 3; j++)
+			{
+				float world = vertex.position[j] * object.scale + object.world.m[12 + j];
+				boundsMin[j] = world < boundsMin[j] ? world : boundsMin[j];
+				boundsMax[j] = world > boundsMax[j] ? world : boundsMax[j];
+				soa[j][i] = world;
+				soa[3 + j][i] = vertex.normal[j];
+				soa[6 + j][i] = object.pMatColor[j] * exposure;
+			}
+		}
+
+		float center[3], extent[3];
+		for (int j = 0; j < 3; j++)
+		{
+			center[j] = (boundsMin[j] + boundsMax[j]) * 0.5f;
+			extent[j] = (boundsMax[j] - boundsMin[j]) * 0.5f;
+		}
+		handles.clear();
+		lights.Query(center, extent, &handles);
+		objectLights.clear();
+		for (uint32_t handle : handles)
+		{
+			objectLights.push_back(lights.GetLight(handle));
+		}
+
+		LightingKernel::Pixels pixels;
+		for (int j = 0; j < 3; j++)
+		{
+			pixels.position[j] = soa[j].data();
+			pixels.normal[j] = soa[3 + j].data();
+			pixels.albedo[j] = soa[6 + j].data();
+			pixels.color[j] = soa[9 + j].data();
+		}
+		pixels.count = object.vertexCount;
+		LightingKernel::Shade(pixels, objectLights.data(), (uint32_t)objectLights.size(), false);
+
+		for (uint32_t i = 0; i < object.vertexCount; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				colors[(object.firstVertex + i) * 3 + j] = soa[9 + j][i];
+			}
+		}
+	}
+	double shadeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	// Draws use mesh-local indices
+	std::vector<uint32_t> localIndices(indices.size());
+	for (const Object& object : objects)
+	{
+		for (uint32_t i = object.startIndex; i < object.startIndex + object.indexCount; i++)
+		{
+			localIndices[i] = indices[i] - object.firstVertex;
+		}
+	}
+
+	SoftwareRasterizer rasterizer;
+	rasterizer.Init(width, height, workers);
+	Matrix viewProjection = ViewProjection(width, height);
+
+	start = std::chrono::steady_clock::now();
+	rasterizer.Clear(ClearColor);
+	for (const Object& object : objects)
+	{
+		Matrix worldViewProjection = Multiply(object.world, viewProjection);
+		rasterizer.Draw(worldViewProjection.m, vertices[object.firstVertex].position, sizeof(MeshVertex), &colors[object.firstVertex * 3],
+			3 * sizeof(float), object.vertexCount, &localIndices[object.startIndex], object.indexCount);
+	}
+	rasterizer.Flush();
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	printf("%ux%u, %u lights, lighting %.2f ms\n", width, height, lights.GetCount(), shadeMs);
+	PrintStats(rasterizer.GetStats(), ms);
+
+	if (pOutputPath != NULL && !WriteImage(pOutputPath, rasterizer))
+	{
+		fprintf(stderr, "SoftwareRender: cannot write '%s'\n", pOutputPath);
+		return 1;
+	}
+	return 0;
+}
+
+static int RunBenchmark(uint32_t workers, double seconds)
+{
+	// One cube mesh colored by its normals, drawn once per grid cell
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+	BuiltinScene::MeshRange ranges[BuiltinScene::MESH_COUNT];
+	BuiltinScene::AddMeshes(&vertices, &indices, ranges);
+	const BuiltinScene::MeshRange& cube = ranges[BuiltinScene::MESH_CUBE];
+
+	std::vector<float> colors(cube.vertexCount * 3);
+	for (uint32_t i = 0; i < cube.vertexCount; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			colors[i * 3 + j] = vertices[cube.firstVertex + i].normal[j] * 0.4f + 0.6f;
+		}
+	}
+
+	printf("%-10s %10s %10s %10s %10s %10s\n", "size", "triangles", "ms", "fps", "setup ms", "raster ms");
+	for (uint32_t triangles : BenchmarkTriangles)
+	{
+		// Square grid of rotated cubes filling most of the view
+		uint32_t cubeCount = triangles / 12;
+		uint32_t side = (uint32_t)ceilf(sqrtf((float)cubeCount));
+		float spacing = 16.0f / side;
+		Matrix rotation = RotationYX(0.6f, 0.5f);
+		std::vector<Matrix> worlds;
+		for (uint32_t i = 0; i < cubeCount; i++)
+		{
+			float x = ((i % side) + 0.5f) * spacing - 8.0f;
+			float y = ((i / side) + 0.5f) * spacing - 8.0f;
+			worlds.push_back(Multiply(rotation, ScaleTranslation(spacing * 0.6f, x, y * 0.5f, 0)));
+		}
+
+		for (const uint32_t* pSize : BenchmarkSizes)
+		{
+			SoftwareRasterizer rasterizer;
+			rasterizer.Init(pSize[0], pSize[1], workers);
+			Matrix viewProjection = ViewProjection(pSize[0], pSize[1]);
+
+			// Frames until the time is up, at least three
+			uint32_t frames = 0;
+			double totalMs = 0, setupMs = 0, rasterMs = 0;
+			while (frames < 3 || totalMs < seconds * 1000.0)
+			{
+				auto start = std::chrono::steady_clock::now();
+				rasterizer.Clear(ClearColor);
+				for (const Matrix& world : worlds)
+				{
+					Matrix worldViewProjection = Multiply(world, viewProjection);
+					rasterizer.Draw(worldViewProjection.m, vertices[cube.firstVertex].position, sizeof(MeshVertex), colors.data(),
+						3 * sizeof(float), cube.vertexCount, &indices[cube.startIndex], cube.indexCount);
+				}
+				rasterizer.Flush();
+				totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				setupMs += rasterizer.GetStats().setupMs;
+				rasterMs += rasterizer.GetStats().rasterMs;
+				frames++;
+			}
+
+			char size[32];
+			snprintf(size, sizeof(size), "%ux%u", pSize[0], pSize[1]);
+			printf("%-10s %10u %10.2f %10.1f %10.2f %10.2f\n", size, cubeCount * 12, totalMs / frames, frames * 1000.0 / totalMs,
+				setupMs / frames, rasterMs / frames);
+		}
+	}
+	return 0;
+}
+
+// Milliseconds per call of shade, called at least three times and until the time is up
+template <typename Shade>
+static double TimeShading(double seconds, const Shade& shade)
+{
+	uint32_t calls = 0;
+	double totalMs = 0;
+	while (calls < 3 || totalMs < seconds * 1000.0)
+	{
+		auto start = std::chrono::steady_clock::now();
+		shade();
+		totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		calls++;
+	}
+	return totalMs / calls;
+}
+
+static int RunShadingBenchmark(double seconds)
+{
+	std::minstd_rand random(1);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::uniform_real_distribution<float> coordinate(-2.0f, 2.0f);
+
+	// Positions, normals, albedo, kernel and reference colors
+	std::vector<float> streams[15];
+	for (std::vector<float>& stream : streams)
+	{
+		stream.resize(ShadingPixelCount);
+	}
+	for (uint32_t i = 0; i < ShadingPixelCount; i++)
+	{
+		float normal[3] = { coordinate(random), coordinate(random), coordinate(random) };
+		float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		for (int j = 0; j < 3; j++)
+		{
+			streams[j][i] = coordinate(random);
+			streams[3 + j][i] = length > 0 ? normal[j] / length : (j == 1 ? 1.0f : 0.0f);
+			streams[6 + j][i] = unit(random);
+		}
+	}
+
+	LightingKernel::Pixels pixels, reference;
+	for (int j = 0; j < 3; j++)
+	{
+		pixels.position[j] = reference.position[j] = streams[j].data();
+		pixels.normal[j] = reference.normal[j] = streams[3 + j].data();
+		pixels.albedo[j] = reference.albedo[j] = streams[6 + j].data();
+		pixels.color[j] = streams[9 + j].data();
+		reference.color[j] = streams[12 + j].data();
+	}
+	pixels.count = reference.count = ShadingPixelCount;
+
+	// Half of the lights are windowed, every other run cuts them off at their range
+	std::vector<LightManager::Light> lights(ShadingLightCounts[sizeof(ShadingLightCounts) / sizeof(ShadingLightCounts[0]) - 1]);
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		LightManager::Light& light = lights[i];
+		for (int j = 0; j < 3; j++)
+		{
+			light.position[j] = coordinate(random);
+			light.color[j] = 0.2f + 0.8f * unit(random);
+		}
+		light.power = 0.02f + unit(random);
+		light.range = 0.5f + 2.5f * unit(random);
+		light.falloff = i % 2 != 0 ? LightManager::FALLOFF_WINDOWED : LightManager::FALLOFF_INVERSE_SQUARE;
+	}
+
+	printf("%u pixels, %u wide packets\n", ShadingPixelCount, LightingKernel::GetPacketWidth());
+	printf("%-8s %14s %14s %14s %12s\n", "lights", "Mpixels/s", "reference", "Mlights/s", "max error");
+	bool passed = true;
+	for (uint32_t lightCount : ShadingLightCounts)
+	{
+		double kernelMs = TimeShading(seconds / 2, [&]() { LightingKernel::Shade(pixels, lights.data(), lightCount, false); });
+		double referenceMs = TimeShading(seconds / 2, [&]() { LightingKernel::ShadeReference(reference, lights.data(), lightCount, false); });
+
+		float maxError = 0;
+		for (int cutOff = 0; cutOff < 2; cutOff++)
+		{
+			LightingKernel::Shade(pixels, lights.data(), lightCount, cutOff != 0);
+			LightingKernel::ShadeReference(reference, lights.data(), lightCount, cutOff != 0);
+			for (int j = 0; j < 3; j++)
+			{
+				for (uint32_t i = 0; i < ShadingPixelCount; i++)
+				{
+					float expected = reference.color[j][i];
+					float error = fabsf(pixels.color[j][i] - expected);
+					passed = passed && error <= ShadingAbsoluteTolerance + ShadingRelativeTolerance * fabsf(expected);
+					maxError = error / (fabsf(expected) + ShadingAbsoluteTolerance) > maxError ? error / (fabsf(expected) + ShadingAbsoluteTolerance) : maxError;
+				}
+			}
+		}
+
+		printf("%-8u %14.1f %14.1f %14.1f %12.2e\n", lightCount, ShadingPixelCount / (kernelMs * 1000.0),
+			ShadingPixelCount / (referenceMs * 1000.0), (double)ShadingPixelCount * lightCount / (kernelMs * 1000.0), maxError);
+	}
+
+	if (!passed)
+	{
+		fprintf(stderr, "SoftwareRender: shading differs from the reference beyond the tolerance\n");
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t width = 1280, height = 720, workers = 0;
+	double seconds = 1.0;
+	float exposure = 1.0f;
+	const char* pModelPath = NULL;
+	const char* pOutputPath = NULL;
+	BuiltinScene::LightSetup lightSetup = BuiltinScene::LIGHTS_RED;
+	bool benchmark = false;
+	bool shadingBenchmark = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--benchmark") == 0)
+		{
+			benchmark = true;
+		}
+		else if (strcmp(argv[i], "--shading-benchmark") == 0)
+		{
+			shadingBenchmark = true;
+		}
+		else if (strcmp(argv[i], "--size") == 0 && hasValue && ParseSize(argv[i + 1], &width, &height))
+		{
+			i++;
+		}
+		else if (strcmp(argv[i], "--workers") == 0 && hasValue)
+		{
+			workers = (uint32_t)atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--seconds") == 0 && hasValue)
+		{
+			seconds = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--exposure") == 0 && hasValue)
+		{
+			exposure = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--model") == 0 && hasValue)
+		{
+			pModelPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--lights") == 0 && hasValue && ParseLightSetup(argv[i + 1], &lightSetup))
+		{
+			i++;
+		}
+		else if (strcmp(argv[i], "--output") == 0 && hasValue)
+		{
+			pOutputPath = argv[++i];
+		}
+		else
+		{
+			fprintf(stderr, "Usage: SoftwareRender [--size WxH] [--workers N] [--model path] [--lights red|small|field] [--exposure E] [--output image.ppm]\n");
+			fprintf(stderr, "       SoftwareRender --benchmark [--workers N] [--seconds S]\n");
+			fprintf(stderr, "       SoftwareRender --shading-benchmark [--seconds S]\n");
+			return 1;
+		}
+	}
+
+	if (shadingBenchmark)
+	{
+		return RunShadingBenchmark(seconds);
+	}
+	return benchmark ? RunBenchmark(workers, seconds) : RenderScene(width, height, workers, exposure, pModelPath, lightSetup, pOutputPath);
+}
@@ -0,0 +1,289 @@
+#include "StateCache.h"
+
+#include <assert.h>
+
+#define SAFE_RELEASE(p) \
+if (p != NULL) { \
+	p->Release(); \
+	p = NULL;\
+}
+
+StateCache::StateCache()
+	: m_pContext(nullptr)
+	, m_pContext1(nullptr)
+{
+}
+
+void StateCache::Init(ID3D11DeviceContext* pContext)
+{
+	m_pContext = pContext;
+	if (FAILED(pContext->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&m_pContext1)))
+	{
+		m_pContext1 = nullptr;
+	}
+
+	m_shadow.Invalidate();
+	m_shadow.ResetCounters();
+}
+
+void StateCache::Term()
+{
+	SAFE_RELEASE(m_pContext1);
+	m_pContext = nullptr;
+}
+
+ID3D11DeviceContext* StateCache::GetContext() const
+{
+	return m_pContext;
+}
+
+void StateCache::ClearState()
+{
+	m_pContext->ClearState();
+	m_shadow.Clear();
+}
+
+void StateCache::Invalidate()
+{
+	m_shadow.Invalidate();
+}
+
+void StateCache::IASetVertexBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers, const UINT* pStrides, const UINT* pOffsets)
+{
+	const void* handles[PipelineStateShadow::MaxVertexBuffers];
+	for (UINT i = 0; i < count; i++)
+	{
+		handles[i] = ppBuffers[i];
+	}
+
+	PipelineStateShadow::Range range = m_shadow.SetVertexBuffers(startSlot, count, handles, pStrides, pOffsets);
+	if (range.count > 0)
+	{
+		UINT skip = range.first - startSlot;
+		m_pContext->IASetVertexBuffers(range.first, range.count, ppBuffers + skip, pStrides + skip, pOffsets + skip);
+	}
+}
+
+void StateCache::IASetIndexBuffer(ID3D11Buffer* pBuffer, DXGI_FORMAT format, UINT offset)
+{
+	if (m_shadow.SetIndexBuffer(pBuffer, format, offset))
+	{
+		m_pContext->IASetIndexBuffer(pBuffer, format, offset);
+	}
+}
+
+void StateCache::IASetInputLayout(ID3D11InputLayout* pLayout)
+{
+	if (m_shadow.SetInputLayout(pLayout))
+	{
+		m_pContext->IASetInputLayout(pLayout);
+	}
+}
+
+void StateCache::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	if (m_shadow.SetTopology(topology))
+	{
+		m_pContext->IASetPrimitiveTopology(topology);
+	}
+}
+
+void StateCache::VSSetShader(ID3D11VertexShader* pShader)
+{
+	if (m_shadow.SetShader(PipelineStateShadow::STAGE_VS, pShader))
+	{
+		m_pContext->VSSetShader(pShader, nullptr, 0);
+	}
+}
+
+void StateCache::PSSetShader(ID3D11PixelShader* pShader)
+{
+	if (m_shadow.SetShader(PipelineStateShadow::STAGE_PS, pShader))
+	{
+		m_pContext->PSSetShader(pShader, nullptr, 0);
+	}
+}
+
+void StateCache::VSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers)
+{
+	SetConstantBuffers(PipelineStateShadow::STAGE_VS, startSlot, count, ppBuffers, nullptr, nullptr);
+}
+
+void StateCache::PSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers)
+{
+	SetConstantBuffers(PipelineStateShadow::STAGE_PS, startSlot, count, ppBuffers, nullptr, nullptr);
+}
+
+void StateCache::VSSetConstantBuffers1(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant, const UINT* pNumConstants)
+{
+	SetConstantBuffers(PipelineStateShadow::STAGE_VS, startSlot, count, ppBuffers, pFirstConstant, pNumConstants);
+}
+
+void StateCache::PSSetConstantBuffers1(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant, const UINT* pNumConstants)
+{
+	SetConstantBuffers(PipelineStateShadow::STAGE_PS, startSlot, count, ppBuffers, pFirstConstant, pNumConstants);
+}
+
+void StateCache::PSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* ppViews)
+{
+	const void* handles[PipelineStateShadow::MaxShaderResources];
+	for (UINT i = 0; i < count; i++)
+	{
+		handles[i] = ppViews[i];
+	}
+
+	PipelineStateShadow::Range range = m_shadow.SetShaderResources(PipelineStateShadow::STAGE_PS, startSlot, count, handles);
+	if (range.count > 0)
+	{
+		m_pContext->PSSetShaderResources(range.first, range.count, ppViews + (range.first - startSlot));
+	}
+}
+
+void StateCache::PSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const* ppSamplers)
+{
+	const void* handles[PipelineStateShadow::MaxSamplers];
+	for (UINT i = 0; i < count; i++)
+	{
+		handles[i] = ppSamplers[i];
+	}
+
+	PipelineStateShadow::Range range = m_shadow.SetSamplers(PipelineStateShadow::STAGE_PS, startSlot, count, handles);
+	if (range.count > 0)
+	{
+		m_pContext->PSSetSamplers(range.first, range.count, ppSamplers + (range.first - startSlot));
+	}
+}
+
+void StateCache::RSSetState(ID3D11RasterizerState* pState)
+{
+	if (m_shadow.SetRasterizerState(pState))
+	{
+		m_pContext->RSSetState(pState);
+	}
+}
+
+void StateCache::RSSetViewport(const D3D11_VIEWPORT& viewport)
+{
+	if (m_shadow.SetViewport(&viewport.TopLeftX))
+	{
+		m_pContext->RSSetViewports(1, &viewport);
+	}
+}
+
+void StateCache::RSSetScissorRect(const D3D11_RECT& rect)
+{
+	const int32_t values[4] = { rect.left, rect.top, rect.right, rect.bottom };
+	if (m_shadow.SetScissorRect(values))
+	{
+		m_pContext->RSSetScissorRects(1, &rect);
+	}
+}
+
+void StateCache::OMSetRenderTargets(UINT count, ID3D11RenderTargetView* const* ppViews, ID3D11DepthStencilView* pDepthView)
+{
+	const void* handles[PipelineStateShadow::MaxRenderTargets];
+	ID3D11View* outputs[PipelineStateShadow::MaxRenderTargets + 1];
+	for (UINT i = 0; i < count; i++)
+	{
+		handles[i] = ppViews[i];
+		outputs[i] = ppViews[i];
+	}
+	outputs[count] = pDepthView;
+
+	if (m_shadow.SetRenderTargets(count, handles, pDepthView))
+	{
+		UnbindShaderResources(count + 1, outputs);
+		m_pContext->OMSetRenderTargets(count, ppViews, pDepthView);
+	}
+}
+
+const PipelineStateShadow& StateCache::GetShadow() const
+{
+	return m_shadow;
+}
+
+void StateCache::ResetCounters()
+{
+	m_shadow.ResetCounters();
+}
+
+void StateCache::UnbindShaderResources(UINT count, ID3D11View* const* ppOutputs)
+{
+	ID3D11Resource* resources[PipelineStateShadow::MaxRenderTargets + 1];
+	UINT resourceCount = 0;
+	for (UINT i = 0; i < count; i++)
+	{
+		if (ppOutputs[i] != nullptr)
+		{
+			ppOutputs[i]->GetResource(&resources[resourceCount++]);
+		}
+	}
+
+	// Compared by resource, different mips of one texture count as the same
+	for (UINT slot = 0; slot < PipelineStateShadow::MaxShaderResources && resourceCount > 0; slot++)
+	{
+		ID3D11ShaderResourceView* pView = (ID3D11ShaderResourceView*)m_shadow.GetShaderResource(PipelineStateShadow::STAGE_PS, slot);
+		if (pView == nullptr)
+		{
+			continue;
+		}
+
+		ID3D11Resource* pResource = nullptr;
+		pView->GetResource(&pResource);
+		for (UINT i = 0; i < resourceCount; i++)
+		{
+			if (resources[i] == pResource)
+			{
+				ID3D11ShaderResourceView* pNull = nullptr;
+				PSSetShaderResources(slot, 1, &pNull);
+				break;
+			}
+		}
+		SAFE_RELEASE(pResource);
+	}
+
+	for (UINT i = 0; i < resourceCount; i++)
+	{
+		SAFE_RELEASE(resources[i]);
+	}
+}
+
+void StateCache::SetConstantBuffers(PipelineStateShadow::Stage stage, UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers,
+	const UINT* pFirstConstant, const UINT* pNumConstants)
+{
+	const void* handles[PipelineStateShadow::MaxConstantBuffers];
+	for (UINT i = 0; i < count; i++)
+	{
+		handles[i] = ppBuffers[i];
+	}
+
+	PipelineStateShadow::Range range = m_shadow.SetConstantBuffers(stage, startSlot, count, handles, pFirstConstant, pNumConstants);
+	if (range.count == 0)
+	{
+		return;
+	}
+
+	UINT skip = range.first - startSlot;
+	if (pFirstConstant == nullptr)
+	{
+		if (stage == PipelineStateShadow::STAGE_VS)
+		{
+			m_pContext->VSSetConstantBuffers(range.first, range.count, ppBuffers + skip);
+		}
+		else
+		{
+			m_pContext->PSSetConstantBuffers(range.first, range.count, ppBuffers + skip);
+		}
+		return;
+	}
+
+	assert(m_pContext1 != nullptr);
+	if (stage == PipelineStateShadow::STAGE_VS)
+	{
+		m_pContext1->VSSetConstantBuffers1(range.first, range.count, ppBuffers + skip, pFirstConstant + skip, pNumConstants + skip);
+	}
+	else
+	{
+		m_pContext1->PSSetConstantBuffers1(range.first, range.count, ppBuffers + skip, pFirstConstant + skip, pNumConstants + skip);
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include "PipelineStateShadow.h"
+
+// Device context front end that drops binds of state already in place.
+// Everything bound through it has to go through it, after direct context
+// calls Invalidate() must be used. Before new render targets are bound, pixel
+// shader resources of the same resources are unbound through the cache, the
+// runtime would otherwise force them to null behind the shadow's back with a
+// debug layer warning. Views of a resource that is an output at the time must
+// not be bound as shader resources, the runtime drops those too.
+class StateCache
+{
+public:
+	StateCache();
+
+	void Init(ID3D11DeviceContext* pContext);
+	void Term();
+
+	// For calls that do not bind state: clears, draws, maps
+	ID3D11DeviceContext* GetContext() const;
+
+	void ClearState();
+	void Invalidate();
+
+	void IASetVertexBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers, const UINT* pStrides, const UINT* pOffsets);
+	void IASetIndexBuffer(ID3D11Buffer* pBuffer, DXGI_FORMAT format, UINT offset);
+	void IASetInputLayout(ID3D11InputLayout* pLayout);
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+
+	void VSSetShader(ID3D11VertexShader* pShader);
+	void PSSetShader(ID3D11PixelShader* pShader);
+
+	void VSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers);
+	void PSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers);
+	// Offset binds, need a D3D 11.1 context
+	void VSSetConstantBuffers1(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant, const UINT* pNumConstants);
+	void PSSetConstantBuffers1(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant, const UINT* pNumConstants);
+
+	void PSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* ppViews);
+	void PSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const* ppSamplers);
+
+	void RSSetState(ID3D11RasterizerState* pState);
+	void RSSetViewport(const D3D11_VIEWPORT& viewport);
+	void RSSetScissorRect(const D3D11_RECT& rect);
+
+	void OMSetRenderTargets(UINT count, ID3D11RenderTargetView* const* ppViews, ID3D11DepthStencilView* pDepthView);
+
+	const PipelineStateShadow& GetShadow() const;
+	void ResetCounters();
+
+private:
+	// Unbinds pixel shader resources of the resources behind the views
+	void UnbindShaderResources(UINT count, ID3D11View* const* ppOutputs);
+	void SetConstantBuffers(PipelineStateShadow::Stage stage, UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers,
+		const UINT* pFirstConstant, const UINT* pNumConstants);
+
+private:
+	ID3D11DeviceContext* m_pContext;
+	ID3D11DeviceContext1* m_pContext1;
+
+	PipelineStateShadow m_shadow;
+};
@@ -0,0 +1,252 @@
+#include "StaticBatcher.h"
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+const uint32_t StaticBatcher::InvalidMesh;
+
+static void Extend(uint32_t* pBegin, uint32_t* pEnd, uint32_t begin, uint32_t end)
+{
+	if (*pBegin == *pEnd)
+	{
+		*pBegin = begin;
+		*pEnd = end;
+	}
+	else
+	{
+		*pBegin = std::min(*pBegin, begin);
+		*pEnd = std::max(*pEnd, end);
+	}
+}
+
+// Destination of the allocation that started at offset, the offset itself if it did not move
+static uint32_t MovedOffset(const std::vector<BufferSuballocator::Move>& moves, uint32_t offset)
+{
+	std::vector<BufferSuballocator::Move>::const_iterator move = std::lower_bound(moves.begin(), moves.end(), offset,
+		[](const BufferSuballocator::Move& move, uint32_t value) { return move.from < value; });
+	return move != moves.end() && move->from == offset ? move->to : offset;
+}
+
+StaticBatcher::StaticBatcher()
+	: m_vertexSize(0)
+	, m_pageVertexCount(0)
+	, m_pageIndexCount(0)
+{
+}
+
+void StaticBatcher::Init(size_t vertexSize, uint32_t pageVertexCount, uint32_t pageIndexCount)
+{
+	m_vertexSize = vertexSize;
+	m_pageVertexCount = pageVertexCount;
+	m_pageIndexCount = pageIndexCount;
+
+	m_pages.clear();
+	m_meshes.clear();
+	m_freeMeshes.clear();
+}
+
+uint32_t StaticBatcher::Add(const void* pVertices, uint32_t vertexCount, const uint32_t* pIndices, uint32_t indexCount)
+{
+	assert(vertexCount > 0 && indexCount > 0);
+
+	Mesh mesh = { 0, 0, vertexCount, 0, indexCount };
+	bool placed = false;
+	for (uint32_t page = 0; page < (uint32_t)m_pages.size() && !placed; page++)
+	{
+		placed = Place(page, &mesh);
+
+		const BufferSuballocator& vertices = m_pages[page].vertexAllocator;
+		const BufferSuballocator& indices = m_pages[page].indexAllocator;
+		bool fits = vertices.GetFreeSize() >= vertexCount && indices.GetFreeSize() >= indexCount;
+		bool fragmented = vertices.GetLargestFreeSize() < vertices.GetFreeSize() || indices.GetLargestFreeSize() < indices.GetFreeSize();
+		if (!placed && fits && fragmented)
+		{
+			CompactPage(page);
+			placed = Place(page, &mesh);
+		}
+	}
+
+	if (!placed)
+	{
+		uint32_t pageVertexCount = std::max(m_pageVertexCount, vertexCount);
+		uint32_t pageIndexCount = std::max(m_pageIndexCount, indexCount);
+		m_pages.emplace_back();
+		Page& page = m_pages.back();
+		page.vertices.resize(pageVertexCount * m_vertexSize);
+		page.indices.resize(pageIndexCount);
+		page.vertexAllocator.Init(pageVertexCount);
+		page.indexAllocator.Init(pageIndexCount);
+		page.dirty = DirtyRanges();
+
+		placed = Place((uint32_t)m_pages.size() - 1, &mesh);
+		assert(placed);
+	}
+
+	Page& page = m_pages[mesh.page];
+	memcpy(page.vertices.data() + mesh.baseVertex * m_vertexSize, pVertices, vertexCount * m_vertexSize);
+	memcpy(page.indices.data() + mesh.startIndex, pIndices, indexCount * sizeof(uint32_t));
+	MarkDirty(mesh.page, mesh);
+
+	uint32_t id = (uint32_t)m_meshes.size();
+	if (!m_freeMeshes.empty())
+	{
+		id = m_freeMeshes.back();
+		m_freeMeshes.pop_back();
+		m_meshes[id] = mesh;
+	}
+	else
+	{
+		m_meshes.push_back(mesh);
+	}
+	return id;
+}
+
+void StaticBatcher::Remove(uint32_t mesh)
+{
+	assert(mesh < m_meshes.size() && m_meshes[mesh].vertexCount > 0);
+
+	// Contents stay until overwritten, nothing draws them any more
+	Mesh& removed = m_meshes[mesh];
+	Page& page = m_pages[removed.page];
+	page.vertexAllocator.Free(removed.baseVertex);
+	page.indexAllocator.Free(removed.startIndex);
+
+	removed.vertexCount = 0;
+	removed.indexCount = 0;
+	m_freeMeshes.push_back(mesh);
+}
+
+uint32_t StaticBatcher::Compact()
+{
+	uint32_t moved = 0;
+	for (uint32_t page = 0; page < (uint32_t)m_pages.size(); page++)
+	{
+		// Only pages where compacting grows the largest free range
+		const BufferSuballocator& vertices = m_pages[page].vertexAllocator;
+		const BufferSuballocator& indices = m_pages[page].indexAllocator;
+		if (vertices.GetLargestFreeSize() < vertices.GetFreeSize() || indices.GetLargestFreeSize() < indices.GetFreeSize())
+		{
+			moved += CompactPage(page);
+		}
+	}
+	return moved;
+}
+
+const StaticBatcher::Mesh& StaticBatcher::GetMesh(uint32_t mesh) const
+{
+	assert(mesh < m_meshes.size());
+	return m_meshes[mesh];
+}
+
+size_t StaticBatcher::GetVertexSize() const
+{
+	return m_vertexSize;
+}
+
+uint32_t StaticBatcher::GetPageCount() const
+{
+	return (uint32_t)m_pages.size();
+}
+
+uint32_t StaticBatcher::GetPageVertexCapacity(uint32_t page) const
+{
+	return m_pages[page].vertexAllocator.GetCapacity();
+}
+
+uint32_t StaticBatcher::GetPageIndexCapacity(uint32_t page) const
+{
+	return m_pages[page].indexAllocator.GetCapacity();
+}
+
+const void* StaticBatcher::GetPageVertices(uint32_t page) const
+{
+	return m_pages[page].vertices.data();
+}
+
+const uint32_t* StaticBatcher::GetPageIndices(uint32_t page) const
+{
+	return m_pages[page].indices.data();
+}
+
+const StaticBatcher::DirtyRanges& StaticBatcher::GetDirtyRanges(uint32_t page) const
+{
+	return m_pages[page].dirty;
+}
+
+void StaticBatcher::ClearDirtyRanges()
+{
+	for (Page& page : m_pages)
+	{
+		page.dirty = DirtyRanges();
+	}
+}
+
+bool StaticBatcher::Place(uint32_t page, Mesh* pMesh)
+{
+	Page& target = m_pages[page];
+	uint32_t baseVertex = target.vertexAllocator.Allocate(pMesh->vertexCount);
+	if (baseVertex == BufferSuballocator::InvalidOffset)
+	{
+		return false;
+	}
+	uint32_t startIndex = target.indexAllocator.Allocate(pMesh->indexCount);
+	if (startIndex == BufferSuballocator::InvalidOffset)
+	{
+		target.vertexAllocator.Free(baseVertex);
+		return false;
+	}
+
+	pMesh->page = page;
+	pMesh->baseVertex = baseVertex;
+	pMesh->startIndex = startIndex;
+	return true;
+}
+
+uint32_t StaticBatcher::CompactPage(uint32_t page)
+{
+	Page& target = m_pages[page];
+
+	// Moves go to lower offsets in increasing order, so memmove never
+	// overwrites data that is still to be moved
+	std::vector<BufferSuballocator::Move> indexMoves;
+	target.indexAllocator.Compact(&indexMoves);
+	for (const BufferSuballocator::Move& move : indexMoves)
+	{
+		memmove(target.indices.data() + move.to, target.indices.data() + move.from, move.size * sizeof(uint32_t));
+	}
+
+	std::vector<BufferSuballocator::Move> vertexMoves;
+	target.vertexAllocator.Compact(&vertexMoves);
+	for (const BufferSuballocator::Move& move : vertexMoves)
+	{
+		memmove(target.vertices.data() + move.to * m_vertexSize, target.vertices.data() + move.from * m_vertexSize, move.size * m_vertexSize);
+	}
+
+	uint32_t moved = 0;
+	for (Mesh& mesh : m_meshes)
+	{
+		if (mesh.page != page || mesh.vertexCount == 0)
+		{
+			continue;
+		}
+
+		uint32_t baseVertex = MovedOffset(vertexMoves, mesh.baseVertex);
+		uint32_t startIndex = MovedOffset(indexMoves, mesh.startIndex);
+		if (baseVertex != mesh.baseVertex || startIndex != mesh.startIndex)
+		{
+			mesh.baseVertex = baseVertex;
+			mesh.startIndex = startIndex;
+			MarkDirty(page, mesh);
+			moved++;
+		}
+	}
+	return moved;
+}
+
+void StaticBatcher::MarkDirty(uint32_t page, const Mesh& mesh)
+{
+	DirtyRanges& dirty = m_pages[page].dirty;
+	Extend(&dirty.vertexBegin, &dirty.vertexEnd, mesh.baseVertex, mesh.baseVertex + mesh.vertexCount);
+	Extend(&dirty.indexBegin, &dirty.indexEnd, mesh.startIndex, mesh.startIndex + mesh.indexCount);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "BufferSuballocator.h"
+
+// Static meshes of one vertex format merged into a few large vertex and index
+// buffers, called pages. Indices stay local to their mesh and are drawn with
+// its base vertex, so meshes move inside a page without rewriting indices.
+// Pages keep a CPU copy and report the element ranges changed since the last
+// upload, creating the API buffers is left to the caller.
+class StaticBatcher
+{
+public:
+	static const uint32_t InvalidMesh = 0xFFFFFFFF;
+
+	struct Mesh
+	{
+		uint32_t page;
+		uint32_t baseVertex;
+		uint32_t vertexCount;
+		uint32_t startIndex;
+		uint32_t indexCount;
+	};
+
+	// Half-open element ranges, empty if begin == end
+	struct DirtyRanges
+	{
+		uint32_t vertexBegin;
+		uint32_t vertexEnd;
+		uint32_t indexBegin;
+		uint32_t indexEnd;
+	};
+
+	StaticBatcher();
+
+	// Meshes larger than a page get a page of their own size
+	void Init(size_t vertexSize, uint32_t pageVertexCount, uint32_t pageIndexCount);
+
+	// Pages with enough free space that is too fragmented are compacted first,
+	// a new page is added when none has room
+	uint32_t Add(const void* pVertices, uint32_t vertexCount, const uint32_t* pIndices, uint32_t indexCount);
+	void Remove(uint32_t mesh);
+
+	// Slides the meshes of every fragmented page to its front, returns the number of meshes moved
+	uint32_t Compact();
+
+	const Mesh& GetMesh(uint32_t mesh) const;
+
+	size_t GetVertexSize() const;
+	uint32_t GetPageCount() const;
+	uint32_t GetPageVertexCapacity(uint32_t page) const;
+	uint32_t GetPageIndexCapacity(uint32_t page) const;
+	const void* GetPageVertices(uint32_t page) const;
+	const uint32_t* GetPageIndices(uint32_t page) const;
+
+	const DirtyRanges& GetDirtyRanges(uint32_t page) const;
+	void ClearDirtyRanges();
+
+private:
+	struct Page
+	{
+		std::vector<uint8_t> vertices;
+		std::vector<uint32_t> indices;
+		BufferSuballocator vertexAllocator;
+		BufferSuballocator indexAllocator;
+		DirtyRanges dirty;
+	};
+
+	bool Place(uint32_t page, Mesh* pMesh);
+	uint32_t CompactPage(uint32_t page);
+	void MarkDirty(uint32_t page, const Mesh& mesh);
+
+private:
+	size_t m_vertexSize;
+	uint32_t m_pageVertexCount;
+	uint32_t m_pageIndexCount;
+
+	std::vector<Page> m_pages;
+	std::vector<Mesh> m_meshes;
+	std::vector<uint32_t> m_freeMeshes;
+};
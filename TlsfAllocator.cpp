@@ -0,0 +1,424 @@
+#include "TlsfAllocator.h"
+
+#include <assert.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+const uint32_t TlsfAllocator::InvalidHandle;
+const uint32_t TlsfAllocator::SecondLevelBits;
+const uint32_t TlsfAllocator::SecondLevelCount;
+const uint32_t TlsfAllocator::FirstLevelCount;
+const uint32_t TlsfAllocator::InvalidBlock;
+
+// Index of the highest and lowest set bit, value must not be zero
+static uint32_t HighestBit(uint32_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, value);
+	return index;
+#else
+	return 31 - __builtin_clz(value);
+#endif
+}
+
+static uint32_t LowestBit(uint32_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, value);
+	return index;
+#else
+	return __builtin_ctz(value);
+#endif
+}
+
+static uint64_t AlignUp(uint64_t offset, uint32_t alignment)
+{
+	return (offset + alignment - 1) & ~(uint64_t)(alignment - 1);
+}
+
+TlsfAllocator::TlsfAllocator()
+	: m_capacity(0)
+	, m_allocatedSize(0)
+	, m_allocationCount(0)
+	, m_freeBlockCount(0)
+	, m_firstLevelMap(0)
+{
+}
+
+void TlsfAllocator::Init(uint32_t capacity)
+{
+	m_capacity = capacity;
+	m_allocatedSize = 0;
+	m_allocationCount = 0;
+	m_freeBlockCount = 0;
+
+	m_firstLevelMap = 0;
+	for (uint32_t first = 0; first < FirstLevelCount; first++)
+	{
+		m_secondLevelMap[first] = 0;
+		for (uint32_t second = 0; second < SecondLevelCount; second++)
+		{
+			m_heads[first][second] = InvalidBlock;
+		}
+	}
+
+	m_blocks.clear();
+	m_unusedBlocks.clear();
+	m_handles.clear();
+	m_freeHandles.clear();
+
+	if (capacity > 0)
+	{
+		InsertFree(NewBlock(0, capacity));
+	}
+}
+
+TlsfAllocator::Allocation TlsfAllocator::Allocate(uint32_t size, uint32_t alignment)
+{
+	assert(size > 0 && alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	// Any block of size + alignment - 1 holds an aligned range
+	Allocation allocation = { InvalidHandle, 0 };
+	uint64_t needed = (uint64_t)size + alignment - 1;
+	uint32_t block = needed <= 0xFFFFFFFF ? FindFree((uint32_t)needed) : InvalidBlock;
+	if (block == InvalidBlock)
+	{
+		return allocation;
+	}
+
+	RemoveFree(block);
+	block = Use(block, size, alignment);
+
+	uint32_t handle = (uint32_t)m_handles.size();
+	if (!m_freeHandles.empty())
+	{
+		handle = m_freeHandles.back();
+		m_freeHandles.pop_back();
+		m_handles[handle] = block;
+	}
+	else
+	{
+		m_handles.push_back(block);
+	}
+	m_blocks[block].handle = handle;
+
+	m_allocatedSize += size;
+	m_allocationCount++;
+
+	allocation.handle = handle;
+	allocation.offset = m_blocks[block].offset;
+	return allocation;
+}
+
+void TlsfAllocator::Free(uint32_t handle)
+{
+	assert(handle < m_handles.size() && m_handles[handle] != InvalidBlock);
+	uint32_t block = m_handles[handle];
+	m_allocatedSize -= m_blocks[block].size;
+	m_allocationCount--;
+
+	m_handles[handle] = InvalidBlock;
+	m_freeHandles.push_back(handle);
+	Release(block);
+}
+
+uint32_t TlsfAllocator::GetOffset(uint32_t handle) const
+{
+	assert(handle < m_handles.size() && m_handles[handle] != InvalidBlock);
+	return m_blocks[m_handles[handle]].offset;
+}
+
+uint32_t TlsfAllocator::GetSize(uint32_t handle) const
+{
+	assert(handle < m_handles.size() && m_handles[handle] != InvalidBlock);
+	return m_blocks[m_handles[handle]].size;
+}
+
+uint32_t TlsfAllocator::PlanDefragmentation(uint32_t maxBytes, std::vector<Move>* pMoves)
+{
+	pMoves->clear();
+
+	std::vector<uint32_t> used;
+	std::vector<uint32_t> freeBlocks;
+	for (uint32_t block = m_blocks.empty() ? InvalidBlock : 0; block != InvalidBlock; block = m_blocks[block].nextPhysical)
+	{
+		if (m_blocks[block].handle != InvalidHandle)
+		{
+			used.push_back(block);
+		}
+		else
+		{
+			freeBlocks.push_back(block);
+		}
+	}
+
+	// Only free blocks are split and merged, so the records of allocations
+	// still to be visited stay valid. Free blocks above the source are
+	// dropped, later sources are lower, and the ones left only change where
+	// a target is split.
+	uint32_t movedBytes = 0;
+	for (size_t i = used.size(); i-- > 0;)
+	{
+		Block source = m_blocks[used[i]];
+		while (!freeBlocks.empty() && m_blocks[freeBlocks.back()].offset > source.offset)
+		{
+			freeBlocks.pop_back();
+		}
+		if ((uint64_t)movedBytes + source.size > maxBytes)
+		{
+			continue;
+		}
+
+		size_t slot = 0;
+		while (slot < freeBlocks.size() &&
+			AlignUp(m_blocks[freeBlocks[slot]].offset, source.alignment) + source.size > (uint64_t)m_blocks[freeBlocks[slot]].offset + m_blocks[freeBlocks[slot]].size)
+		{
+			slot++;
+		}
+		if (slot == freeBlocks.size())
+		{
+			continue;
+		}
+
+		// The padding keeps the free block's index, the tail is a new block after the allocation
+		uint32_t target = freeBlocks[slot];
+		RemoveFree(target);
+		target = Use(target, source.size, source.alignment);
+		freeBlocks.erase(freeBlocks.begin() + slot);
+		uint32_t prev = m_blocks[target].prevPhysical;
+		uint32_t next = m_blocks[target].nextPhysical;
+		if (next != InvalidBlock && m_blocks[next].handle == InvalidHandle)
+		{
+			freeBlocks.insert(freeBlocks.begin() + slot, next);
+		}
+		if (prev != InvalidBlock && m_blocks[prev].handle == InvalidHandle)
+		{
+			freeBlocks.insert(freeBlocks.begin() + slot, prev);
+		}
+
+		m_blocks[target].handle = source.handle;
+		m_handles[source.handle] = target;
+		Release(used[i]);
+
+		Move move = { source.handle, source.offset, m_blocks[target].offset, source.size };
+		pMoves->push_back(move);
+		movedBytes += source.size;
+	}
+
+	return movedBytes;
+}
+
+TlsfAllocator::Stats TlsfAllocator::GetStats() const
+{
+	Stats stats = {};
+	stats.capacity = m_capacity;
+	stats.allocatedSize = m_allocatedSize;
+	stats.allocationCount = m_allocationCount;
+	stats.freeSize = m_capacity - m_allocatedSize;
+	stats.freeBlockCount = m_freeBlockCount;
+
+	// The largest free block is in the highest non-empty list
+	if (m_firstLevelMap != 0)
+	{
+		uint32_t first = HighestBit(m_firstLevelMap);
+		uint32_t second = HighestBit(m_secondLevelMap[first]);
+		for (uint32_t block = m_heads[first][second]; block != InvalidBlock; block = m_blocks[block].nextFree)
+		{
+			if (m_blocks[block].size > stats.largestFreeSize)
+			{
+				stats.largestFreeSize = m_blocks[block].size;
+			}
+		}
+	}
+	stats.fragmentation = stats.freeSize > 0 ? 1.0f - (float)stats.largestFreeSize / stats.freeSize : 0.0f;
+
+	return stats;
+}
+
+void TlsfAllocator::Mapping(uint32_t size, uint32_t* pFirst, uint32_t* pSecond)
+{
+	// Sizes under SecondLevelCount have one list each
+	if (size < SecondLevelCount)
+	{
+		*pFirst = 0;
+		*pSecond = size;
+	}
+	else
+	{
+		uint32_t highest = HighestBit(size);
+		*pFirst = highest - SecondLevelBits + 1;
+		*pSecond = (size >> (highest - SecondLevelBits)) - SecondLevelCount;
+	}
+}
+
+uint32_t TlsfAllocator::FindFree(uint32_t size) const
+{
+	// Rounded up to the next list start so any block found is large enough
+	if (size >= SecondLevelCount)
+	{
+		uint64_t rounded = (uint64_t)size + (1u << (HighestBit(size) - SecondLevelBits)) - 1;
+		if (rounded > 0xFFFFFFFF)
+		{
+			return InvalidBlock;
+		}
+		size = (uint32_t)rounded;
+	}
+
+	uint32_t first;
+	uint32_t second;
+	Mapping(size, &first, &second);
+
+	uint32_t secondMap = m_secondLevelMap[first] & (~0u << second);
+	if (secondMap == 0)
+	{
+		uint32_t firstMap = first + 1 < FirstLevelCount ? m_firstLevelMap & (~0u << (first + 1)) : 0;
+		if (firstMap == 0)
+		{
+			return InvalidBlock;
+		}
+		first = LowestBit(firstMap);
+		secondMap = m_secondLevelMap[first];
+	}
+	second = LowestBit(secondMap);
+
+	return m_heads[first][second];
+}
+
+void TlsfAllocator::InsertFree(uint32_t block)
+{
+	uint32_t first;
+	uint32_t second;
+	Mapping(m_blocks[block].size, &first, &second);
+
+	uint32_t head = m_heads[first][second];
+	m_blocks[block].handle = InvalidHandle;
+	m_blocks[block].prevFree = InvalidBlock;
+	m_blocks[block].nextFree = head;
+	if (head != InvalidBlock)
+	{
+		m_blocks[head].prevFree = block;
+	}
+	m_heads[first][second] = block;
+
+	m_firstLevelMap |= 1u << first;
+	m_secondLevelMap[first] |= 1u << second;
+	m_freeBlockCount++;
+}
+
+void TlsfAllocator::RemoveFree(uint32_t block)
+{
+	uint32_t first;
+	uint32_t second;
+	Mapping(m_blocks[block].size, &first, &second);
+
+	Block& removed = m_blocks[block];
+	if (removed.prevFree != InvalidBlock)
+	{
+		m_blocks[removed.prevFree].nextFree = removed.nextFree;
+	}
+	else
+	{
+		m_heads[first][second] = removed.nextFree;
+	}
+	if (removed.nextFree != InvalidBlock)
+	{
+		m_blocks[removed.nextFree].prevFree = removed.prevFree;
+	}
+
+	if (m_heads[first][second] == InvalidBlock)
+	{
+		m_secondLevelMap[first] &= ~(1u << second);
+		if (m_secondLevelMap[first] == 0)
+		{
+			m_firstLevelMap &= ~(1u << first);
+		}
+	}
+	m_freeBlockCount--;
+}
+
+uint32_t TlsfAllocator::NewBlock(uint32_t offset, uint32_t size)
+{
+	Block block = { offset, size, 1, InvalidBlock, InvalidBlock, InvalidBlock, InvalidBlock, InvalidHandle };
+	if (!m_unusedBlocks.empty())
+	{
+		uint32_t index = m_unusedBlocks.back();
+		m_unusedBlocks.pop_back();
+		m_blocks[index] = block;
+		return index;
+	}
+	m_blocks.push_back(block);
+	return (uint32_t)m_blocks.size() - 1;
+}
+
+uint32_t TlsfAllocator::Split(uint32_t block, uint32_t size)
+{
+	// The block keeps its first size units, the rest becomes a new block after it
+	uint32_t rest = NewBlock(m_blocks[block].offset + size, m_blocks[block].size - size);
+	uint32_t next = m_blocks[block].nextPhysical;
+	m_blocks[rest].prevPhysical = block;
+	m_blocks[rest].nextPhysical = next;
+	if (next != InvalidBlock)
+	{
+		m_blocks[next].prevPhysical = rest;
+	}
+	m_blocks[block].nextPhysical = rest;
+	m_blocks[block].size = size;
+	return rest;
+}
+
+uint32_t TlsfAllocator::Use(uint32_t block, uint32_t size, uint32_t alignment)
+{
+	// Padding before the aligned offset and the unused tail go back to the free lists
+	uint32_t padding = (uint32_t)(AlignUp(m_blocks[block].offset, alignment) - m_blocks[block].offset);
+	if (padding > 0)
+	{
+		uint32_t aligned = Split(block, padding);
+		InsertFree(block);
+		block = aligned;
+	}
+	if (m_blocks[block].size > size)
+	{
+		InsertFree(Split(block, size));
+	}
+
+	m_blocks[block].alignment = alignment;
+	return block;
+}
+
+void TlsfAllocator::Release(uint32_t block)
+{
+	// Merge with the free blocks right before and after
+	uint32_t prev = m_blocks[block].prevPhysical;
+	if (prev != InvalidBlock && m_blocks[prev].handle == InvalidHandle)
+	{
+		RemoveFree(prev);
+		uint32_t next = m_blocks[block].nextPhysical;
+		m_blocks[prev].size += m_blocks[block].size;
+		m_blocks[prev].nextPhysical = next;
+		if (next != InvalidBlock)
+		{
+			m_blocks[next].prevPhysical = prev;
+		}
+		m_unusedBlocks.push_back(block);
+		block = prev;
+	}
+
+	uint32_t next = m_blocks[block].nextPhysical;
+	if (next != InvalidBlock && m_blocks[next].handle == InvalidHandle)
+	{
+		RemoveFree(next);
+		uint32_t after = m_blocks[next].nextPhysical;
+		m_blocks[block].size += m_blocks[next].size;
+		m_blocks[block].nextPhysical = after;
+		if (after != InvalidBlock)
+		{
+			m_blocks[after].prevPhysical = block;
+		}
+		m_unusedBlocks.push_back(next);
+	}
+
+	InsertFree(block);
+}
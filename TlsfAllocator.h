@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Two-level segregated fit allocator for offsets inside a large backing
+// buffer. Free blocks are kept in lists by size class, the first level is the
+// power of two and the second splits it into 32 linear steps. Bitmaps over
+// the lists make Allocate() and Free() constant time. Allocations are
+// referred to by handles, which stay valid when defragmentation moves them.
+class TlsfAllocator
+{
+public:
+	static const uint32_t InvalidHandle = 0xFFFFFFFF;
+
+	struct Allocation
+	{
+		uint32_t handle; // InvalidHandle if no free block fits
+		uint32_t offset;
+	};
+
+	// Target ranges were free when planned, moves are applied in order
+	struct Move
+	{
+		uint32_t handle;
+		uint32_t from;
+		uint32_t to;
+		uint32_t size;
+	};
+
+	struct Stats
+	{
+		uint32_t capacity;
+		uint32_t allocatedSize;
+		uint32_t allocationCount;
+		uint32_t freeSize;
+		uint32_t freeBlockCount;
+		uint32_t largestFreeSize;
+		float fragmentation; // 1 - largest free block / free size
+	};
+
+	TlsfAllocator();
+
+	void Init(uint32_t capacity);
+
+	// Alignment is a power of two
+	Allocation Allocate(uint32_t size, uint32_t alignment = 1);
+	void Free(uint32_t handle);
+
+	uint32_t GetOffset(uint32_t handle) const;
+	uint32_t GetSize(uint32_t handle) const;
+
+	// Moves allocations from the end of the buffer into the lowest free
+	// blocks they fit, up to maxBytes. The allocator already reflects the
+	// moves, the caller copies the contents. Returns the bytes moved.
+	uint32_t PlanDefragmentation(uint32_t maxBytes, std::vector<Move>* pMoves);
+
+	Stats GetStats() const;
+
+private:
+	static const uint32_t SecondLevelBits = 5;
+	static const uint32_t SecondLevelCount = 1 << SecondLevelBits;
+	static const uint32_t FirstLevelCount = 32 - SecondLevelBits + 1;
+	static const uint32_t InvalidBlock = 0xFFFFFFFF;
+
+	// Blocks tile the buffer in offset order starting with block 0, free ones
+	// are also linked into the list of their size class
+	struct Block
+	{
+		uint32_t offset;
+		uint32_t size;
+		uint32_t alignment;
+		uint32_t prevPhysical;
+		uint32_t nextPhysical;
+		uint32_t prevFree;
+		uint32_t nextFree;
+		uint32_t handle; // InvalidHandle if free
+	};
+
+	static void Mapping(uint32_t size, uint32_t* pFirst, uint32_t* pSecond);
+
+	uint32_t FindFree(uint32_t size) const;
+	void InsertFree(uint32_t block);
+	void RemoveFree(uint32_t block);
+	uint32_t NewBlock(uint32_t offset, uint32_t size);
+	uint32_t Split(uint32_t block, uint32_t size);
+	uint32_t Use(uint32_t block, uint32_t size, uint32_t alignment);
+	void Release(uint32_t block);
+
+private:
+	uint32_t m_capacity;
+	uint32_t m_allocatedSize;
+	uint32_t m_allocationCount;
+	uint32_t m_freeBlockCount;
+
+	uint32_t m_firstLevelMap;
+	uint32_t m_secondLevelMap[FirstLevelCount];
+	uint32_t m_heads[FirstLevelCount][SecondLevelCount];
+
+	std::vector<Block> m_blocks;
+	std::vector<uint32_t> m_unusedBlocks;
+	std::vector<uint32_t> m_handles; // handle to block
+	std::vector<uint32_t> m_freeHandles;
+};
@@ -0,0 +1,436 @@
+// ToneMap : applies the renderer's U2Shader tone mapping to HDR images on the
+// CPU, in batches, and checks the result against GPU output.
+//
+// Usage: ToneMap input output [--exposure E] [--operator uncharted2|reinhard] [--rows N] [--workers N]
+//                [--compare capture] [--tolerance T]
+//        ToneMap --benchmark [--workers N] [--seconds S]
+//
+// Input and output are PFM, Radiance .hdr or uncompressed OpenEXR files. The
+// image is streamed in chunks of --rows rows, memory does not grow with its
+// size. Without --exposure the exposure is derived as RenderWindow does with
+// the eye fully adapted: a first pass averages the log brightness, the second
+// maps. --compare reads a capture of the GPU back buffer in any of the formats
+// and reports the difference to the mapped image, saturated as the
+// R8G8B8A8_UNORM back buffer stores it; the tool fails above the tolerance,
+// by default one 8-bit step. The benchmark times ToneMapper against the
+// scalar reference on a generated 4K image and the readers and writers on a
+// 1080p one, and checks both.
+//
+// Only the C++ standard library is used, so the tool builds on any platform,
+// e.g. "c++ -O2 -std=c++14 -mavx2 -mfma -pthread -I.. ToneMap.cpp
+// ../ToneMapper.cpp ../HdrImageFile.cpp ../VertexCompression.cpp -o ToneMap".
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "HdrImageFile.h"
+#include "ToneMapper.h"
+
+static const uint32_t DefaultChunkRows = 64;
+static const float DefaultTolerance = 1.0f / 255.0f;
+
+static const uint32_t BenchmarkSize[2] = { 3840, 2160 };
+static const uint32_t FileBenchmarkSize[2] = { 1920, 1080 };
+static const char* FileBenchmarkPaths[] = { "ToneMapBenchmark.pfm", "ToneMapBenchmark.hdr", "ToneMapBenchmark.exr" };
+
+// FMA contraction is the only difference to the reference
+static const float MapTolerance = 1e-5f;
+
+// Radiance files keep 8 bits of mantissa relative to the largest channel
+static const float RgbeTolerance = 1.0f / 128.0f;
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double MegapixelsPerSecond(uint64_t pixelCount, double ms)
+{
+	return ms > 0 ? pixelCount / (ms * 1000.0) : 0.0;
+}
+
+static const char* GetFormatName(HdrImageFormat format)
+{
+	switch (format)
+	{
+	case HDR_IMAGE_PFM:
+		return "PFM";
+	case HDR_IMAGE_RGBE:
+		return "Radiance";
+	case HDR_IMAGE_EXR:
+		return "OpenEXR";
+	default:
+		return "unknown";
+	}
+}
+
+// Pass over the image for the exposure RenderWindow sets once the eye has adapted
+static bool ComputeExposure(HdrImageReader& reader, uint32_t chunkRows, std::vector<float>& chunk, float* pExposure)
+{
+	uint32_t width = reader.GetWidth();
+	uint32_t height = reader.GetHeight();
+	double sum = 0;
+	for (uint32_t row = 0; row < height; row += chunkRows)
+	{
+		uint32_t rowCount = std::min(chunkRows, height - row);
+		if (!reader.ReadRows(rowCount, chunk.data()))
+		{
+			return false;
+		}
+		sum += ToneMapper::SumLogBrightness(chunk.data(), (size_t)width * rowCount);
+	}
+
+	float averageBrightness = expf((float)(sum / ((double)width * height))) - 1.0f;
+	*pExposure = averageBrightness > 0 ? ToneMapper::GetExposure(averageBrightness, averageBrightness) : 1.0f;
+	printf("average brightness %g, exposure %g\n", averageBrightness, *pExposure);
+	return reader.Rewind();
+}
+
+static int ToneMapFile(const char* pInputPath, const char* pOutputPath, float exposure, bool autoExposure, ToneMapper::Operator op,
+	uint32_t chunkRows, uint32_t workers, const char* pComparePath, float tolerance)
+{
+	HdrImageReader reader;
+	if (!reader.Open(pInputPath))
+	{
+		fprintf(stderr, "%s: %s\n", pInputPath, reader.GetErrorMessage());
+		return 1;
+	}
+	uint32_t width = reader.GetWidth();
+	uint32_t height = reader.GetHeight();
+	printf("%s: %s %ux%u\n", pInputPath, GetFormatName(reader.GetFormat()), width, height);
+
+	HdrImageWriter writer;
+	if (!writer.Open(pOutputPath, width, height))
+	{
+		fprintf(stderr, "%s: %s\n", pOutputPath, writer.GetErrorMessage());
+		return 1;
+	}
+
+	std::vector<float> chunk((size_t)width * chunkRows * 3);
+	if (autoExposure && !ComputeExposure(reader, chunkRows, chunk, &exposure))
+	{
+		fprintf(stderr, "%s: %s\n", pInputPath, reader.GetErrorMessage());
+		return 1;
+	}
+
+	HdrImageReader capture;
+	std::vector<float> captureChunk;
+	if (pComparePath != NULL)
+	{
+		if (!capture.Open(pComparePath))
+		{
+			fprintf(stderr, "%s: %s\n", pComparePath, capture.GetErrorMessage());
+			return 1;
+		}
+		if (capture.GetWidth() != width || capture.GetHeight() != height)
+		{
+			fprintf(stderr, "%s: %ux%u does not match the input\n", pComparePath, capture.GetWidth(), capture.GetHeight());
+			return 1;
+		}
+		captureChunk.resize(chunk.size());
+	}
+
+	ToneMapper mapper;
+	mapper.Init(op, exposure, workers);
+
+	double readMs = 0, mapMs = 0, writeMs = 0;
+	double errorSum = 0;
+	float maxError = 0;
+	uint64_t failedCount = 0;
+	auto totalStart = std::chrono::steady_clock::now();
+	for (uint32_t row = 0; row < height; row += chunkRows)
+	{
+		uint32_t rowCount = std::min(chunkRows, height - row);
+		size_t pixelCount = (size_t)width * rowCount;
+
+		auto start = std::chrono::steady_clock::now();
+		if (!reader.ReadRows(rowCount, chunk.data()))
+		{
+			fprintf(stderr, "%s: %s\n", pInputPath, reader.GetErrorMessage());
+			return 1;
+		}
+		readMs += MillisecondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		mapper.Map(chunk.data(), chunk.data(), pixelCount);
+		mapMs += MillisecondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		if (!writer.WriteRows(rowCount, chunk.data()))
+		{
+			fprintf(stderr, "%s: %s\n", pOutputPath, writer.GetErrorMessage());
+			return 1;
+		}
+		writeMs += MillisecondsSince(start);
+
+		if (pComparePath != NULL)
+		{
+			if (!capture.ReadRows(rowCount, captureChunk.data()))
+			{
+				fprintf(stderr, "%s: %s\n", pComparePath, capture.GetErrorMessage());
+				return 1;
+			}
+			for (size_t i = 0; i < pixelCount * 3; i++)
+			{
+				float error = fabsf(std::min(std::max(chunk[i], 0.0f), 1.0f) - captureChunk[i]);
+				errorSum += error;
+				maxError = std::max(maxError, error);
+				failedCount += error > tolerance ? 1 : 0;
+			}
+		}
+	}
+	if (!writer.Close())
+	{
+		fprintf(stderr, "%s: %s\n", pOutputPath, writer.GetErrorMessage());
+		return 1;
+	}
+	double totalMs = MillisecondsSince(totalStart);
+
+	uint64_t pixelCount = (uint64_t)width * height;
+	printf("%s: %s, %u rows per chunk, %.1f MB of pixels in memory\n", pOutputPath, GetFormatName(writer.GetFormat()), chunkRows,
+		chunk.size() * sizeof(float) * (pComparePath != NULL ? 2 : 1) / (1024.0 * 1024.0));
+	printf("%-8s %10s %12s\n", "stage", "ms", "Mpixels/s");
+	printf("%-8s %10.1f %12.1f\n", "read", readMs, MegapixelsPerSecond(pixelCount, readMs));
+	printf("%-8s %10.1f %12.1f\n", "map", mapMs, MegapixelsPerSecond(pixelCount, mapMs));
+	printf("%-8s %10.1f %12.1f\n", "write", writeMs, MegapixelsPerSecond(pixelCount, writeMs));
+	printf("%-8s %10.1f %12.1f\n", "total", totalMs, MegapixelsPerSecond(pixelCount, totalMs));
+
+	if (pComparePath != NULL)
+	{
+		printf("%s: max error %.5f, mean error %.6f, %llu of %llu values above %.5f\n", pComparePath, maxError,
+			errorSum / (pixelCount * 3), (unsigned long long)failedCount, (unsigned long long)(pixelCount * 3), tolerance);
+		if (failedCount != 0)
+		{
+			fprintf(stderr, "the capture does not match\n");
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Milliseconds per call of work, called at least three times and until the time is up
+template <typename Work>
+static double TimeWork(double seconds, const Work& work)
+{
+	uint32_t calls = 0;
+	double totalMs = 0;
+	while (calls < 3 || totalMs < seconds * 1000.0)
+	{
+		auto start = std::chrono::steady_clock::now();
+		work();
+		totalMs += MillisecondsSince(start);
+		calls++;
+	}
+	return totalMs / calls;
+}
+
+// Log uniform radiance over six decades, as a rendered frame spans
+static void GenerateImage(uint32_t width, uint32_t height, std::vector<float>& pixels)
+{
+	std::minstd_rand random(1);
+	std::uniform_real_distribution<float> decades(-3.0f, 3.0f);
+	pixels.resize((size_t)width * height * 3);
+	for (float& value : pixels)
+	{
+		value = powf(10.0f, decades(random));
+	}
+}
+
+static bool RunFileBenchmark(const std::vector<float>& pixels, uint32_t width, uint32_t height, double seconds)
+{
+	printf("\n%ux%u files, %u rows per chunk\n", width, height, DefaultChunkRows);
+	printf("%-10s %12s %12s %10s %12s\n", "format", "write MP/s", "read MP/s", "MB", "max error");
+
+	bool passed = true;
+	std::vector<float> chunk((size_t)width * DefaultChunkRows * 3);
+	for (const char* pPath : FileBenchmarkPaths)
+	{
+		bool failed = false;
+		HdrImageWriter writer;
+		double writeMs = TimeWork(seconds / 2, [&]()
+		{
+			failed |= !writer.Open(pPath, width, height);
+			for (uint32_t row = 0; row < height && !failed; row += DefaultChunkRows)
+			{
+				failed |= !writer.WriteRows(std::min(DefaultChunkRows, height - row), &pixels[(size_t)row * width * 3]);
+			}
+			failed |= !writer.Close();
+		});
+
+		// The error is relative to the largest channel of the pixel
+		float maxError = 0;
+		HdrImageReader reader;
+		double readMs = TimeWork(seconds / 2, [&]()
+		{
+			failed |= !reader.Open(pPath);
+			for (uint32_t row = 0; row < height && !failed; row += DefaultChunkRows)
+			{
+				uint32_t rowCount = std::min(DefaultChunkRows, height - row);
+				failed |= !reader.ReadRows(rowCount, chunk.data());
+				const float* pExpected = &pixels[(size_t)row * width * 3];
+				for (size_t i = 0; i < (size_t)width * rowCount * 3 && !failed; i += 3)
+				{
+					float scale = std::max(pExpected[i], std::max(pExpected[i + 1], pExpected[i + 2]));
+					for (int j = 0; j < 3; j++)
+					{
+						maxError = std::max(maxError, fabsf(chunk[i + j] - pExpected[i + j]) / scale);
+					}
+				}
+			}
+			reader.Close();
+		});
+
+		FILE* pFile = NULL;
+#ifdef _MSC_VER
+		fopen_s(&pFile, pPath, "rb");
+#else
+		pFile = fopen(pPath, "rb");
+#endif
+		double megabytes = 0;
+		if (pFile != NULL)
+		{
+			fseek(pFile, 0, SEEK_END);
+			megabytes = ftell(pFile) / (1024.0 * 1024.0);
+			fclose(pFile);
+		}
+		remove(pPath);
+
+		float tolerance = writer.GetFormat() == HDR_IMAGE_RGBE ? RgbeTolerance : 0.0f;
+		passed = passed && !failed && maxError <= tolerance;
+		printf("%-10s %12.1f %12.1f %10.1f %12.2e%s\n", GetFormatName(writer.GetFormat()), MegapixelsPerSecond((uint64_t)width * height, writeMs),
+			MegapixelsPerSecond((uint64_t)width * height, readMs), megabytes, maxError, failed ? " failed" : "");
+		if (failed)
+		{
+			fprintf(stderr, "%s: %s%s\n", pPath, writer.GetErrorMessage(), reader.GetErrorMessage());
+		}
+	}
+	return passed;
+}
+
+static int RunBenchmark(uint32_t workers, double seconds)
+{
+	uint32_t width = BenchmarkSize[0];
+	uint32_t height = BenchmarkSize[1];
+	size_t pixelCount = (size_t)width * height;
+	std::vector<float> pixels, mapped(pixelCount * 3), reference(pixelCount * 3);
+	GenerateImage(width, height, pixels);
+
+	double sum = ToneMapper::SumLogBrightness(pixels.data(), pixelCount);
+	float averageBrightness = expf((float)(sum / pixelCount)) - 1.0f;
+	float exposure = ToneMapper::GetExposure(averageBrightness, averageBrightness);
+
+	printf("%ux%u pixels, exposure %g\n", width, height, exposure);
+	printf("%-12s %12s %12s %12s\n", "operator", "Mpixels/s", "reference", "max error");
+	bool passed = true;
+	for (int op = ToneMapper::OPERATOR_UNCHARTED2; op <= ToneMapper::OPERATOR_REINHARD; op++)
+	{
+		ToneMapper mapper;
+		mapper.Init((ToneMapper::Operator)op, exposure, workers);
+		double mapMs = TimeWork(seconds / 4, [&]() { mapper.Map(pixels.data(), mapped.data(), pixelCount); });
+		double referenceMs = TimeWork(seconds / 4, [&]() { ToneMapper::MapReference((ToneMapper::Operator)op, exposure, pixels.data(), reference.data(), pixelCount); });
+
+		float maxError = 0;
+		for (size_t i = 0; i < pixelCount * 3; i++)
+		{
+			maxError = std::max(maxError, fabsf(mapped[i] - reference[i]));
+		}
+		passed = passed && maxError <= MapTolerance;
+		printf("%-12s %12.1f %12.1f %12.2e\n", op == ToneMapper::OPERATOR_REINHARD ? "reinhard" : "uncharted2",
+			MegapixelsPerSecond(pixelCount, mapMs), MegapixelsPerSecond(pixelCount, referenceMs), maxError);
+	}
+
+	GenerateImage(FileBenchmarkSize[0], FileBenchmarkSize[1], pixels);
+	passed = RunFileBenchmark(pixels, FileBenchmarkSize[0], FileBenchmarkSize[1], seconds) && passed;
+
+	if (!passed)
+	{
+		fprintf(stderr, "results differ from the reference\n");
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	const char* pInputPath = NULL;
+	const char* pOutputPath = NULL;
+	const char* pComparePath = NULL;
+	uint32_t chunkRows = DefaultChunkRows, workers = 0;
+	float exposure = 1.0f, tolerance = DefaultTolerance;
+	bool autoExposure = true;
+	ToneMapper::Operator op = ToneMapper::OPERATOR_UNCHARTED2;
+	double seconds = 1.0;
+	bool benchmark = false;
+	bool usage = false;
+
+	for (int i = 1; i < argc && !usage; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--benchmark") == 0)
+		{
+			benchmark = true;
+		}
+		else if (strcmp(argv[i], "--exposure") == 0 && hasValue)
+		{
+			exposure = (float)atof(argv[++i]);
+			autoExposure = false;
+		}
+		else if (strcmp(argv[i], "--operator") == 0 && hasValue)
+		{
+			i++;
+			usage = strcmp(argv[i], "uncharted2") != 0 && strcmp(argv[i], "reinhard") != 0;
+			op = strcmp(argv[i], "reinhard") == 0 ? ToneMapper::OPERATOR_REINHARD : ToneMapper::OPERATOR_UNCHARTED2;
+		}
+		else if (strcmp(argv[i], "--rows") == 0 && hasValue)
+		{
+			chunkRows = (uint32_t)atoi(argv[++i]);
+			usage = chunkRows == 0;
+		}
+		else if (strcmp(argv[i], "--workers") == 0 && hasValue)
+		{
+			workers = (uint32_t)atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--seconds") == 0 && hasValue)
+		{
+			seconds = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--compare") == 0 && hasValue)
+		{
+			pComparePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--tolerance") == 0 && hasValue)
+		{
+			tolerance = (float)atof(argv[++i]);
+		}
+		else if (argv[i][0] != '-' && pInputPath == NULL)
+		{
+			pInputPath = argv[i];
+		}
+		else if (argv[i][0] != '-' && pOutputPath == NULL)
+		{
+			pOutputPath = argv[i];
+		}
+		else
+		{
+			usage = true;
+		}
+	}
+
+	if (usage || (!benchmark && pOutputPath == NULL))
+	{
+		fprintf(stderr, "Usage: ToneMap input output [--exposure E] [--operator uncharted2|reinhard] [--rows N] [--workers N]\n");
+		fprintf(stderr, "               [--compare capture] [--tolerance T]\n");
+		fprintf(stderr, "       ToneMap --benchmark [--workers N] [--seconds S]\n");
+		return 1;
+	}
+	if (benchmark)
+	{
+		return RunBenchmark(workers, seconds);
+	}
+	return ToneMapFile(pInputPath, pOutputPath, exposure, autoExposure, op, chunkRows, workers, pComparePath, tolerance);
+}
@@ -0,0 +1,153 @@
+#include "ToneMapper.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "SimdPacket.h"
+
+// Curve constants of U2Shader
+static const float A = 0.1f;
+static const float B = 0.50f;
+static const float C = 0.10f;
+static const float D = 0.20f;
+static const float E = 0.02f;
+static const float F = 0.30f;
+static const float W = 11.2f;
+
+// Batches smaller than this per worker are not worth a thread
+static const size_t MinPixelsPerWorker = 64 * 1024;
+
+static float Uncharted2Tonemap(float x)
+{
+	return ((x * (A * x + C * B) + D * E) / (x * (A * x + B) + D * F)) - E / F;
+}
+
+static Packet Uncharted2Tonemap(Packet x)
+{
+	Packet numerator = MulAdd(x, MulAdd(Set(A), x, Set(C * B)), Set(D * E));
+	Packet denominator = MulAdd(x, MulAdd(Set(A), x, Set(B)), Set(D * F));
+	return Sub(Div(numerator, denominator), Set(E / F));
+}
+
+static Packet Reinhard(Packet x)
+{
+	Packet one = Set(1.0f);
+	return Div(Mul(x, Add(one, Div(x, Set(W * W)))), Add(one, x));
+}
+
+ToneMapper::ToneMapper()
+	: m_operator(OPERATOR_UNCHARTED2)
+	, m_exposure(1.0f)
+	, m_whiteScale(1.0f)
+	, m_workerCount(1)
+{
+}
+
+void ToneMapper::Init(Operator op, float exposure, uint32_t workerCount)
+{
+	m_operator = op;
+	m_exposure = exposure;
+	m_whiteScale = 1.0f / Uncharted2Tonemap(W);
+	m_workerCount = std::max(1u, workerCount != 0 ? workerCount : std::thread::hardware_concurrency());
+}
+
+void ToneMapper::Map(const float* pIn, float* pOut, size_t pixelCount) const
+{
+	size_t workerCount = std::min<size_t>(m_workerCount, std::max<size_t>(1, pixelCount / MinPixelsPerWorker));
+	if (workerCount == 1)
+	{
+		MapRange(pIn, pOut, pixelCount * 3);
+		return;
+	}
+
+	// Split on packet boundaries so only the last worker has a tail
+	size_t packetCount = (pixelCount * 3 + PacketWidth - 1) / PacketWidth;
+	std::vector<std::thread> threads;
+	for (size_t w = 0; w < workerCount; w++)
+	{
+		size_t begin = std::min(packetCount * w / workerCount * PacketWidth, pixelCount * 3);
+		size_t end = std::min(packetCount * (w + 1) / workerCount * PacketWidth, pixelCount * 3);
+		threads.push_back(std::thread(&ToneMapper::MapRange, this, pIn + begin, pOut + begin, end - begin));
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+void ToneMapper::MapRange(const float* pIn, float* pOut, size_t valueCount) const
+{
+	size_t fullCount = valueCount / PacketWidth * PacketWidth;
+	size_t tailCount = valueCount - fullCount;
+
+	// Remaining values are mapped in a zero padded packet
+	float tail[PacketWidth];
+	memset(tail, 0, sizeof(tail));
+	memcpy(tail, pIn + fullCount, tailCount * sizeof(float));
+
+	Packet exposure = Set(m_exposure);
+	if (m_operator == OPERATOR_REINHARD)
+	{
+		for (size_t i = 0; i < fullCount; i += PacketWidth)
+		{
+			Store(pOut + i, Reinhard(Mul(exposure, Load(pIn + i))));
+		}
+		Store(tail, Reinhard(Mul(exposure, Load(tail))));
+	}
+	else
+	{
+		Packet whiteScale = Set(m_whiteScale);
+		for (size_t i = 0; i < fullCount; i += PacketWidth)
+		{
+			Store(pOut + i, Mul(Uncharted2Tonemap(Mul(exposure, Load(pIn + i))), whiteScale));
+		}
+		Store(tail, Mul(Uncharted2Tonemap(Mul(exposure, Load(tail))), whiteScale));
+	}
+	memcpy(pOut + fullCount, tail, tailCount * sizeof(float));
+}
+
+void ToneMapper::MapReference(Operator op, float exposure, const float* pIn, float* pOut, size_t pixelCount)
+{
+	for (size_t i = 0; i < pixelCount * 3; i++)
+	{
+		float color = pIn[i];
+		if (op == OPERATOR_REINHARD)
+		{
+			float curr = exposure * color;
+			pOut[i] = curr * (1.0f + curr / (W * W)) / (1.0f + curr);
+		}
+		else
+		{
+			float curr = Uncharted2Tonemap(exposure * color);
+			float whiteScale = 1.0f / Uncharted2Tonemap(W);
+			pOut[i] = curr * whiteScale;
+		}
+	}
+}
+
+double ToneMapper::SumLogBrightness(const float* pIn, size_t pixelCount)
+{
+	double sum = 0;
+	for (size_t i = 0; i < pixelCount; i++)
+	{
+		sum += log10f(pIn[i * 3] + 1);
+	}
+	return sum;
+}
+
+float ToneMapper::GetExposure(float averageBrightness, float adaptedBrightness)
+{
+	return (1.03f - (2.0f / (2 + log10f(10 * adaptedBrightness + 1)))) / averageBrightness;
+}
+
+ToneMapper::Operator ToneMapper::GetOperator() const
+{
+	return m_operator;
+}
+
+float ToneMapper::GetExposure() const
+{
+	return m_exposure;
+}
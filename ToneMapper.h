@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// U2Shader on the CPU: maps interleaved linear RGB floats with the filmic
+// Uncharted 2 curve or the extended Reinhard operator, normalized to the
+// white point 11.2, in packets of 16, 8 or 4 floats with AVX-512, AVX2 or
+// SSE. The curve acts on each channel alone, so rows are mapped as flat float
+// arrays. Large batches are split across worker threads.
+//
+// Output is not clamped, the render target of the shader saturates it.
+class ToneMapper
+{
+public:
+	// Values of TONEMAP_OPERATOR in U2Shader
+	enum Operator
+	{
+		OPERATOR_UNCHARTED2 = 0,
+		OPERATOR_REINHARD = 1,
+	};
+
+	ToneMapper();
+
+	// workerCount 0 picks hardware concurrency
+	void Init(Operator op, float exposure, uint32_t workerCount = 0);
+
+	// pOut may be pIn
+	void Map(const float* pIn, float* pOut, size_t pixelCount) const;
+
+	// One value at a time, statement by statement as in the shader
+	static void MapReference(Operator op, float exposure, const float* pIn, float* pOut, size_t pixelCount);
+
+	// Sum of log10(red + 1) over the pixels. ABShader returns the float3 log
+	// as a float, which keeps the red channel, and the downsampling chain
+	// averages it; the average brightness is expf(sum / count) - 1 as
+	// RenderWindow reads it back.
+	static double SumLogBrightness(const float* pIn, size_t pixelCount);
+
+	// Exposure RenderWindow::Update() sets for the average and the eye adapted brightness
+	static float GetExposure(float averageBrightness, float adaptedBrightness);
+
+	Operator GetOperator() const;
+	float GetExposure() const;
+
+private:
+	void MapRange(const float* pIn, float* pOut, size_t valueCount) const;
+
+private:
+	Operator m_operator;
+	float m_exposure;
+	float m_whiteScale;
+	uint32_t m_workerCount;
+};
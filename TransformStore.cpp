@@ -0,0 +1,277 @@
+#include "TransformStore.h"
+
+#include <assert.h>
+#include <string.h>
+#include <xmmintrin.h>
+#include <algorithm>
+#include <thread>
+
+const uint32_t TransformStore::InvalidEntity;
+
+// Below this a single thread is faster than starting workers
+static const uint32_t MinBlocksPerWorker = 4096;
+
+static void StoreRows(TransformStore::Matrix* pOut, int row, __m128 c0, __m128 c1, __m128 c2, __m128 c3)
+{
+	// Lanes hold four entities, transposing gives one matrix row per entity
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	_mm_storeu_ps(pOut[0].m + row * 4, c0);
+	_mm_storeu_ps(pOut[1].m + row * 4, c1);
+	_mm_storeu_ps(pOut[2].m + row * 4, c2);
+	_mm_storeu_ps(pOut[3].m + row * 4, c3);
+}
+
+static void Multiply(const TransformStore::Matrix& a, const TransformStore::Matrix& b, TransformStore::Matrix* pOut)
+{
+	__m128 b0 = _mm_loadu_ps(b.m + 0);
+	__m128 b1 = _mm_loadu_ps(b.m + 4);
+	__m128 b2 = _mm_loadu_ps(b.m + 8);
+	__m128 b3 = _mm_loadu_ps(b.m + 12);
+
+	for (int row = 0; row < 4; row++)
+	{
+		const float* pA = a.m + row * 4;
+		__m128 r = _mm_mul_ps(_mm_set1_ps(pA[0]), b0);
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(pA[1]), b1));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(pA[2]), b2));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(pA[3]), b3));
+		_mm_storeu_ps(pOut->m + row * 4, r);
+	}
+}
+
+TransformStore::TransformStore()
+	: m_count(0)
+	, m_anyDirty(false)
+	, m_updatedCount(0)
+{
+}
+
+uint32_t TransformStore::Create(uint32_t parent)
+{
+	assert(parent == InvalidEntity || parent < m_count);
+
+	uint32_t entity = m_count++;
+	if (entity % 4 == 0)
+	{
+		size_t padded = (size_t)entity + 4;
+		m_posX.resize(padded, 0.0f);
+		m_posY.resize(padded, 0.0f);
+		m_posZ.resize(padded, 0.0f);
+		m_rotX.resize(padded, 0.0f);
+		m_rotY.resize(padded, 0.0f);
+		m_rotZ.resize(padded, 0.0f);
+		m_rotW.resize(padded, 1.0f);
+		m_scaleX.resize(padded, 1.0f);
+		m_scaleY.resize(padded, 1.0f);
+		m_scaleZ.resize(padded, 1.0f);
+		m_dirty.resize(padded, 0);
+		m_local.resize(padded);
+		m_localNormal.resize(padded);
+	}
+
+	m_parents.push_back(parent);
+	m_changed.push_back(0);
+	m_world.push_back(Matrix());
+	m_normal.push_back(Matrix());
+
+	MarkDirty(entity);
+
+	return entity;
+}
+
+void TransformStore::Clear()
+{
+	*this = TransformStore();
+}
+
+void TransformStore::SetPosition(uint32_t entity, float x, float y, float z)
+{
+	m_posX[entity] = x;
+	m_posY[entity] = y;
+	m_posZ[entity] = z;
+	MarkDirty(entity);
+}
+
+void TransformStore::SetRotation(uint32_t entity, float x, float y, float z, float w)
+{
+	m_rotX[entity] = x;
+	m_rotY[entity] = y;
+	m_rotZ[entity] = z;
+	m_rotW[entity] = w;
+	MarkDirty(entity);
+}
+
+void TransformStore::SetScale(uint32_t entity, float x, float y, float z)
+{
+	assert(x != 0.0f && y != 0.0f && z != 0.0f);
+
+	m_scaleX[entity] = x;
+	m_scaleY[entity] = y;
+	m_scaleZ[entity] = z;
+	MarkDirty(entity);
+}
+
+void TransformStore::Update(uint32_t workerCount)
+{
+	if (!m_anyDirty)
+	{
+		if (m_updatedCount > 0)
+		{
+			std::fill(m_changed.begin(), m_changed.end(), (uint8_t)0);
+			m_updatedCount = 0;
+		}
+		return;
+	}
+
+	uint32_t blocks = (m_count + 3) / 4;
+
+	if (workerCount == 0)
+	{
+		workerCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	uint32_t workers = std::min(workerCount, blocks / MinBlocksPerWorker);
+
+	if (workers <= 1)
+	{
+		ComposeLocal(0, blocks);
+	}
+	else
+	{
+		std::vector<std::thread> threads;
+		uint32_t chunk = (blocks + workers - 1) / workers;
+		for (uint32_t w = 1; w < workers; w++)
+		{
+			uint32_t begin = w * chunk;
+			uint32_t end = std::min(begin + chunk, blocks);
+			threads.push_back(std::thread(&TransformStore::ComposeLocal, this, begin, end));
+		}
+		ComposeLocal(0, chunk);
+
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+	}
+
+	// Parents precede children, one pass propagates changes down the hierarchy
+	m_updatedCount = 0;
+	for (uint32_t i = 0; i < m_count; i++)
+	{
+		uint32_t parent = m_parents[i];
+		bool changed = m_dirty[i] != 0 || (parent != InvalidEntity && m_changed[parent] != 0);
+		m_changed[i] = changed ? 1 : 0;
+		if (!changed)
+		{
+			continue;
+		}
+
+		// Roots use their local matrices as world matrices without a copy
+		if (parent != InvalidEntity)
+		{
+			// Inverse transpose of a product is the product of inverse transposes
+			Multiply(m_local[i], GetWorld(parent), &m_world[i]);
+			Multiply(m_localNormal[i], GetNormal(parent), &m_normal[i]);
+		}
+		m_updatedCount++;
+	}
+
+	std::fill(m_dirty.begin(), m_dirty.end(), (uint8_t)0);
+	m_anyDirty = false;
+}
+
+const TransformStore::Matrix& TransformStore::GetWorld(uint32_t entity) const
+{
+	return m_parents[entity] == InvalidEntity ? m_local[entity] : m_world[entity];
+}
+
+const TransformStore::Matrix& TransformStore::GetNormal(uint32_t entity) const
+{
+	return m_parents[entity] == InvalidEntity ? m_localNormal[entity] : m_normal[entity];
+}
+
+uint32_t TransformStore::GetParent(uint32_t entity) const
+{
+	return m_parents[entity];
+}
+
+bool TransformStore::WasChanged(uint32_t entity) const
+{
+	return m_changed[entity] != 0;
+}
+
+uint32_t TransformStore::GetCount() const
+{
+	return m_count;
+}
+
+uint32_t TransformStore::GetUpdatedCount() const
+{
+	return m_updatedCount;
+}
+
+void TransformStore::ComposeLocal(uint32_t firstBlock, uint32_t lastBlock)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+
+	for (uint32_t block = firstBlock; block < lastBlock; block++)
+	{
+		uint32_t base = block * 4;
+
+		uint32_t dirtyLanes;
+		memcpy(&dirtyLanes, &m_dirty[base], sizeof(dirtyLanes));
+		if (dirtyLanes == 0)
+		{
+			continue;
+		}
+
+		__m128 x = _mm_loadu_ps(&m_rotX[base]);
+		__m128 y = _mm_loadu_ps(&m_rotY[base]);
+		__m128 z = _mm_loadu_ps(&m_rotZ[base]);
+		__m128 w = _mm_loadu_ps(&m_rotW[base]);
+
+		__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+		__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+		__m128 xw = _mm_mul_ps(x, w), yw = _mm_mul_ps(y, w), zw = _mm_mul_ps(z, w);
+
+		// Rotation matrix of a unit quaternion, same layout as XMMatrixRotationQuaternion
+		__m128 r00 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+		__m128 r01 = _mm_mul_ps(two, _mm_add_ps(xy, zw));
+		__m128 r02 = _mm_mul_ps(two, _mm_sub_ps(xz, yw));
+		__m128 r10 = _mm_mul_ps(two, _mm_sub_ps(xy, zw));
+		__m128 r11 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+		__m128 r12 = _mm_mul_ps(two, _mm_add_ps(yz, xw));
+		__m128 r20 = _mm_mul_ps(two, _mm_add_ps(xz, yw));
+		__m128 r21 = _mm_mul_ps(two, _mm_sub_ps(yz, xw));
+		__m128 r22 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+		__m128 sx = _mm_loadu_ps(&m_scaleX[base]);
+		__m128 sy = _mm_loadu_ps(&m_scaleY[base]);
+		__m128 sz = _mm_loadu_ps(&m_scaleZ[base]);
+
+		// World = S * R + T
+		Matrix* pLocal = &m_local[base];
+		StoreRows(pLocal, 0, _mm_mul_ps(r00, sx), _mm_mul_ps(r01, sx), _mm_mul_ps(r02, sx), zero);
+		StoreRows(pLocal, 1, _mm_mul_ps(r10, sy), _mm_mul_ps(r11, sy), _mm_mul_ps(r12, sy), zero);
+		StoreRows(pLocal, 2, _mm_mul_ps(r20, sz), _mm_mul_ps(r21, sz), _mm_mul_ps(r22, sz), zero);
+		StoreRows(pLocal, 3, _mm_loadu_ps(&m_posX[base]), _mm_loadu_ps(&m_posY[base]), _mm_loadu_ps(&m_posZ[base]), one);
+
+		// Inverse transpose of S * R is S^-1 * R, translation does not affect normals
+		__m128 isx = _mm_div_ps(one, sx);
+		__m128 isy = _mm_div_ps(one, sy);
+		__m128 isz = _mm_div_ps(one, sz);
+
+		Matrix* pNormal = &m_localNormal[base];
+		StoreRows(pNormal, 0, _mm_mul_ps(r00, isx), _mm_mul_ps(r01, isx), _mm_mul_ps(r02, isx), zero);
+		StoreRows(pNormal, 1, _mm_mul_ps(r10, isy), _mm_mul_ps(r11, isy), _mm_mul_ps(r12, isy), zero);
+		StoreRows(pNormal, 2, _mm_mul_ps(r20, isz), _mm_mul_ps(r21, isz), _mm_mul_ps(r22, isz), zero);
+		StoreRows(pNormal, 3, zero, zero, zero, one);
+	}
+}
+
+void TransformStore::MarkDirty(uint32_t entity)
+{
+	m_dirty[entity] = 1;
+	m_anyDirty = true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Entity transforms stored as structure of arrays. Update() composes local
+// matrices four entities at a time with SSE, then applies the hierarchy in
+// creation order, so a parent always has to be created before its children.
+// Matrices are row-major in the DirectXMath row-vector convention.
+class TransformStore
+{
+public:
+	static const uint32_t InvalidEntity = 0xFFFFFFFF;
+
+	struct Matrix
+	{
+		float m[16];
+	};
+
+	TransformStore();
+
+	uint32_t Create(uint32_t parent = InvalidEntity);
+	void Clear();
+
+	void SetPosition(uint32_t entity, float x, float y, float z);
+	// Unit quaternion
+	void SetRotation(uint32_t entity, float x, float y, float z, float w);
+	void SetScale(uint32_t entity, float x, float y, float z);
+
+	// Recomputes dirty entities and their descendants, workerCount 0 picks hardware concurrency
+	void Update(uint32_t workerCount = 1);
+
+	const Matrix& GetWorld(uint32_t entity) const;
+	// Inverse transpose of the world matrix
+	const Matrix& GetNormal(uint32_t entity) const;
+	uint32_t GetParent(uint32_t entity) const;
+
+	// True if the world matrix changed by the last Update()
+	bool WasChanged(uint32_t entity) const;
+
+	uint32_t GetCount() const;
+	uint32_t GetUpdatedCount() const;
+
+private:
+	void ComposeLocal(uint32_t firstBlock, uint32_t lastBlock);
+	void MarkDirty(uint32_t entity);
+
+private:
+	uint32_t m_count;
+
+	// Padded to a multiple of four entities
+	std::vector<float> m_posX, m_posY, m_posZ;
+	std::vector<float> m_rotX, m_rotY, m_rotZ, m_rotW;
+	std::vector<float> m_scaleX, m_scaleY, m_scaleZ;
+	std::vector<uint8_t> m_dirty;
+
+	std::vector<uint32_t> m_parents;
+	std::vector<uint8_t> m_changed;
+	std::vector<Matrix> m_local;
+	std::vector<Matrix> m_localNormal;
+	// Only written for entities with a parent
+	std::vector<Matrix> m_world;
+	std::vector<Matrix> m_normal;
+
+	bool m_anyDirty;
+	uint32_t m_updatedCount;
+};
@@ -1,3 +1,8 @@
+// 0 - Uncharted2 filmic, 1 - Reinhard
+#ifndef TONEMAP_OPERATOR
+#define TONEMAP_OPERATOR 0
+#endif
+
 Texture2D colorTexture : register(t0);
 
 SamplerState samplerState : register(s0);
@@ -52,9 +57,14 @@ float3 PS(VSOut input) : SV_TARGET
 {
     float3 color = colorTexture.Sample(samplerState, input.texCoord).rgb;
 
+#if TONEMAP_OPERATOR == 1
+    float3 curr = exposure.r * color;
+    return curr * (1.0f + curr / (W * W)) / (1.0f + curr);
+#else
     float3 curr = Uncharted2Tonemap(exposure.r * color);
     float3 whiteScale = 1.0f / Uncharted2Tonemap(W);
 
     return curr * whiteScale;
+#endif
 }
     
\ No newline at end of file
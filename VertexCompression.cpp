@@ -0,0 +1,317 @@
+#include "VertexCompression.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <emmintrin.h>
+
+static const float PositionRange = 65535.0f;
+static const float Oct16Range = 32767.0f;
+static const float Oct8Range = 127.0f;
+
+// Two blocks of four floats per vertex are transposed into SoA registers
+static_assert(sizeof(MeshVertex) == 32, "MeshVertex is expected to be 8 packed floats");
+static_assert(sizeof(PackedVertexOct16) == 16 && sizeof(PackedVertexOct8) == 12, "Packed vertices must not be padded");
+
+// Four floats to halves in the low 16 bits of each lane, after ryg's SSE2 version
+static __m128i FloatToHalf4(__m128 value)
+{
+	const __m128i signMask = _mm_set1_epi32((int)0x80000000u);
+	const __m128i halfMax = _mm_set1_epi32((127 + 16) << 23);
+	const __m128i minNormal = _mm_set1_epi32((127 - 14) << 23);
+	const __m128i subnormalMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+	const __m128i normalBias = _mm_set1_epi32(0xFFF - ((127 - 15) << 23));
+	const __m128i infinity = _mm_set1_epi32(0x7C00);
+	const __m128i nanBit = _mm_set1_epi32(0x200);
+
+	__m128 sign = _mm_and_ps(value, _mm_castsi128_ps(signMask));
+	__m128 absValue = _mm_xor_ps(value, sign);
+	__m128i absBits = _mm_castps_si128(absValue);
+
+	__m128i isNan = _mm_castps_si128(_mm_cmpunord_ps(absValue, absValue));
+	__m128i isRegular = _mm_cmpgt_epi32(halfMax, absBits);
+	__m128i isSubnormal = _mm_cmpgt_epi32(minNormal, absBits);
+	__m128i infOrNan = _mm_or_si128(_mm_and_si128(isNan, nanBit), infinity);
+
+	// Subnormal results: the float adder does the shift and rounding
+	__m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absValue, _mm_castsi128_ps(subnormalMagic))), subnormalMagic);
+
+	// Normal results: rebias, round to nearest even and shift the mantissa down
+	__m128i mantissaOdd = _mm_srai_epi32(_mm_slli_epi32(absBits, 31 - 13), 31);
+	__m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absBits, normalBias), mantissaOdd), 13);
+
+	__m128i finite = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+	__m128i result = _mm_or_si128(_mm_and_si128(isRegular, finite), _mm_andnot_si128(isRegular, infOrNan));
+	return _mm_or_si128(result, _mm_srli_epi32(_mm_castps_si128(sign), 16));
+}
+
+// Lanes in 0..65535 to the low four 16-bit values, SSE2 has only signed saturation
+static __m128i PackUint16(__m128i a, __m128i b)
+{
+	const __m128i bias32 = _mm_set1_epi32(32768);
+	const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+	return _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(a, bias32), _mm_sub_epi32(b, bias32)), bias16);
+}
+
+static void EncodeBlock(VertexFormat format, const MeshVertex* pVertices, __m128 offset[3], __m128 positionScale, uint8_t* pOut, size_t vertexSize, size_t count)
+{
+	__m128 px = _mm_loadu_ps(pVertices[0].position);
+	__m128 py = _mm_loadu_ps(pVertices[1].position);
+	__m128 pz = _mm_loadu_ps(pVertices[2].position);
+	__m128 u = _mm_loadu_ps(pVertices[3].position);
+	_MM_TRANSPOSE4_PS(px, py, pz, u);
+
+	__m128 v = _mm_loadu_ps(&pVertices[0].uv[1]);
+	__m128 nx = _mm_loadu_ps(&pVertices[1].uv[1]);
+	__m128 ny = _mm_loadu_ps(&pVertices[2].uv[1]);
+	__m128 nz = _mm_loadu_ps(&pVertices[3].uv[1]);
+	_MM_TRANSPOSE4_PS(v, nx, ny, nz);
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000u));
+
+	// Positions, clamped so values on the bounds can not wrap
+	const __m128 positionMax = _mm_set1_ps(PositionRange);
+	__m128i qx = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(px, offset[0]), positionScale), zero), positionMax));
+	__m128i qy = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(py, offset[1]), positionScale), zero), positionMax));
+	__m128i qz = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(pz, offset[2]), positionScale), zero), positionMax));
+
+	// Octahedral normals: project onto |x|+|y|+|z| = 1, fold the lower half over the diagonals
+	__m128 l1 = _mm_add_ps(_mm_add_ps(_mm_and_ps(nx, absMask), _mm_and_ps(ny, absMask)), _mm_and_ps(nz, absMask));
+	__m128 invL1 = _mm_div_ps(one, _mm_max_ps(l1, _mm_set1_ps(1e-20f)));
+	__m128 ox = _mm_mul_ps(nx, invL1);
+	__m128 oy = _mm_mul_ps(ny, invL1);
+	__m128 lower = _mm_cmplt_ps(nz, zero);
+	__m128 fx = _mm_or_ps(_mm_and_ps(ox, signMask), _mm_sub_ps(one, _mm_and_ps(oy, absMask)));
+	__m128 fy = _mm_or_ps(_mm_and_ps(oy, signMask), _mm_sub_ps(one, _mm_and_ps(ox, absMask)));
+	ox = _mm_or_ps(_mm_and_ps(lower, fx), _mm_andnot_ps(lower, ox));
+	oy = _mm_or_ps(_mm_and_ps(lower, fy), _mm_andnot_ps(lower, oy));
+
+	__m128i w = _mm_setzero_si128();
+	__m128i normal = _mm_setzero_si128();
+	if (format == VERTEX_FORMAT_PACKED_OCT8)
+	{
+		const __m128 range = _mm_set1_ps(Oct8Range);
+		const __m128i byteMask = _mm_set1_epi32(0xFF);
+		__m128i ex = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(ox, range)), byteMask);
+		__m128i ey = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(oy, range)), byteMask);
+		w = _mm_or_si128(ex, _mm_slli_epi32(ey, 8));
+	}
+	else
+	{
+		const __m128 range = _mm_set1_ps(Oct16Range);
+		__m128i exy = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(ox, range)), _mm_cvtps_epi32(_mm_mul_ps(oy, range)));
+		normal = _mm_unpacklo_epi16(exy, _mm_srli_si128(exy, 8));
+	}
+
+	// Per vertex x y z w runs of 16 bits
+	__m128i xy = PackUint16(qx, qy);
+	__m128i zw = PackUint16(qz, w);
+	__m128i xyPairs = _mm_unpacklo_epi16(xy, _mm_srli_si128(xy, 8));
+	__m128i zwPairs = _mm_unpacklo_epi16(zw, _mm_srli_si128(zw, 8));
+
+	uint16_t positions[16];
+	_mm_storeu_si128((__m128i*)positions, _mm_unpacklo_epi32(xyPairs, zwPairs));
+	_mm_storeu_si128((__m128i*)(positions + 8), _mm_unpackhi_epi32(xyPairs, zwPairs));
+
+	uint32_t uvs[4];
+	_mm_storeu_si128((__m128i*)uvs, _mm_or_si128(FloatToHalf4(u), _mm_slli_epi32(FloatToHalf4(v), 16)));
+
+	uint32_t normals[4];
+	_mm_storeu_si128((__m128i*)normals, normal);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		uint8_t* pVertex = pOut + i * vertexSize;
+		memcpy(pVertex, positions + i * 4, 8);
+		memcpy(pVertex + 8, &uvs[i], 4);
+		if (format == VERTEX_FORMAT_PACKED_OCT16)
+		{
+			memcpy(pVertex + 12, &normals[i], 4);
+		}
+	}
+}
+
+static void DecodeOctahedral(float x, float y, float* pNormal)
+{
+	float z = 1.0f - fabsf(x) - fabsf(y);
+	float t = z < 0 ? -z : 0.0f;
+	x += x >= 0 ? -t : t;
+	y += y >= 0 ? -t : t;
+
+	float invLength = 1.0f / sqrtf(x * x + y * y + z * z);
+	pNormal[0] = x * invLength;
+	pNormal[1] = y * invLength;
+	pNormal[2] = z * invLength;
+}
+
+size_t VertexCompression::GetVertexSize(VertexFormat format)
+{
+	switch (format)
+	{
+	case VERTEX_FORMAT_PACKED_OCT16:
+		return sizeof(PackedVertexOct16);
+	case VERTEX_FORMAT_PACKED_OCT8:
+		return sizeof(PackedVertexOct8);
+	default:
+		return 36; // TextureVertex
+	}
+}
+
+PositionQuantization VertexCompression::ComputeQuantization(const float* boundsMin, const float* boundsMax)
+{
+	PositionQuantization quantization;
+	quantization.scale = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		quantization.offset[i] = boundsMin[i];
+		float extent = boundsMax[i] - boundsMin[i];
+		quantization.scale = extent > quantization.scale ? extent : quantization.scale;
+	}
+	return quantization;
+}
+
+void VertexCompression::Encode(VertexFormat format, const MeshVertex* pVertices, size_t count, const PositionQuantization& quantization, void* pOut)
+{
+	assert(format != VERTEX_FORMAT_FLOAT);
+
+	__m128 offset[3] = { _mm_set1_ps(quantization.offset[0]), _mm_set1_ps(quantization.offset[1]), _mm_set1_ps(quantization.offset[2]) };
+	__m128 positionScale = _mm_set1_ps(quantization.scale > 0 ? PositionRange / quantization.scale : 0.0f);
+
+	size_t vertexSize = GetVertexSize(format);
+	uint8_t* pDst = (uint8_t*)pOut;
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		EncodeBlock(format, pVertices + i, offset, positionScale, pDst + i * vertexSize, vertexSize, 4);
+	}
+	if (i < count)
+	{
+		// Tail goes through a zero padded block
+		MeshVertex block[4];
+		memset(block, 0, sizeof(block));
+		memcpy(block, pVertices + i, (count - i) * sizeof(MeshVertex));
+		EncodeBlock(format, block, offset, positionScale, pDst + i * vertexSize, vertexSize, count - i);
+	}
+}
+
+void VertexCompression::Decode(VertexFormat format, const void* pIn, size_t count, const PositionQuantization& quantization, MeshVertex* pOut)
+{
+	assert(format != VERTEX_FORMAT_FLOAT);
+
+	size_t vertexSize = GetVertexSize(format);
+	for (size_t i = 0; i < count; i++)
+	{
+		const uint8_t* pVertex = (const uint8_t*)pIn + i * vertexSize;
+		uint16_t position[4];
+		uint16_t uv[2];
+		memcpy(position, pVertex, sizeof(position));
+		memcpy(uv, pVertex + 8, sizeof(uv));
+
+		MeshVertex& vertex = pOut[i];
+		for (int c = 0; c < 3; c++)
+		{
+			vertex.position[c] = position[c] / PositionRange * quantization.scale + quantization.offset[c];
+		}
+		vertex.uv[0] = HalfToFloat(uv[0]);
+		vertex.uv[1] = HalfToFloat(uv[1]);
+
+		float ex, ey;
+		if (format == VERTEX_FORMAT_PACKED_OCT16)
+		{
+			int16_t normal[2];
+			memcpy(normal, pVertex + 12, sizeof(normal));
+			ex = normal[0] / Oct16Range;
+			ey = normal[1] / Oct16Range;
+		}
+		else
+		{
+			ex = (int8_t)(position[3] & 0xFF) / Oct8Range;
+			ey = (int8_t)(position[3] >> 8) / Oct8Range;
+		}
+		DecodeOctahedral(ex < -1.0f ? -1.0f : ex, ey < -1.0f ? -1.0f : ey, vertex.normal);
+	}
+}
+
+uint16_t VertexCompression::FloatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+	uint32_t absBits = bits & 0x7FFFFFFF;
+
+	if (absBits >= 0x7F800000)
+	{
+		// Infinity or NaN, NaNs stay quiet
+		return sign | 0x7C00 | (absBits > 0x7F800000 ? 0x200 : 0);
+	}
+	if (absBits >= 0x477FF000)
+	{
+		// Rounds to a value above the half range
+		return sign | 0x7C00;
+	}
+
+	int exponent = (int)(absBits >> 23) - 127;
+	uint32_t mantissa = (absBits & 0x7FFFFF) | 0x800000;
+	int shift = exponent < -14 ? 13 + (-14 - exponent) : 13;
+	if (shift > 24)
+	{
+		return sign;
+	}
+
+	// Round to nearest even on the dropped bits
+	uint32_t half = mantissa >> shift;
+	uint32_t rest = mantissa & ((1u << shift) - 1);
+	uint32_t midpoint = 1u << (shift - 1);
+	if (rest > midpoint || (rest == midpoint && (half & 1)))
+	{
+		half++;
+	}
+
+	if (exponent < -14)
+	{
+		return sign | (uint16_t)half;
+	}
+	// A mantissa carry moves into the exponent by itself
+	return sign | (uint16_t)((((uint32_t)(exponent + 15)) << 10) + (half - 0x400));
+}
+
+float VertexCompression::HalfToFloat(uint16_t value)
+{
+	uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+	uint32_t exponent = (value >> 10) & 0x1F;
+	uint32_t mantissa = value & 0x3FF;
+
+	uint32_t bits;
+	if (exponent == 0x1F)
+	{
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	}
+	else if (exponent != 0)
+	{
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+	else if (mantissa != 0)
+	{
+		// Subnormal, normalize
+		exponent = 113;
+		while ((mantissa & 0x400) == 0)
+		{
+			mantissa <<= 1;
+			exponent--;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+	}
+	else
+	{
+		bits = sign;
+	}
+
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
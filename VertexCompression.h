@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "MeshImporter.h"
+
+// Scene vertex formats, values match ColorShader's VERTEX_FORMAT
+enum VertexFormat
+{
+	VERTEX_FORMAT_FLOAT = 0, // 36 byte TextureVertex
+	VERTEX_FORMAT_PACKED_OCT16, // 16 bytes
+	VERTEX_FORMAT_PACKED_OCT8 // 12 bytes
+};
+
+// Packed vertices keep positions as 16-bit fractions of a per-mesh cube and
+// UVs as half floats. Normals are octahedral, 2x16 bit snorm or two 8-bit
+// snorm values in the position's w.
+struct PackedVertexOct16
+{
+	uint16_t position[4]; // w is unused
+	uint16_t uv[2];
+	int16_t normal[2];
+};
+
+struct PackedVertexOct8
+{
+	uint16_t position[4]; // w holds normal x in the low byte, y in the high byte
+	uint16_t uv[2];
+};
+
+// mesh position = position / 65535 * scale + offset. The scale is uniform so
+// it can be folded into a rigid instance transform without skewing normals.
+struct PositionQuantization
+{
+	float scale;
+	float offset[3];
+};
+
+class VertexCompression
+{
+public:
+	static size_t GetVertexSize(VertexFormat format);
+
+	static PositionQuantization ComputeQuantization(const float* boundsMin, const float* boundsMax);
+
+	// SSE, four vertices at a time. pOut receives count * GetVertexSize(format) bytes.
+	static void Encode(VertexFormat format, const MeshVertex* pVertices, size_t count, const PositionQuantization& quantization, void* pOut);
+
+	// Scalar reference decoding, the shader does the same
+	static void Decode(VertexFormat format, const void* pIn, size_t count, const PositionQuantization& quantization, MeshVertex* pOut);
+
+	// IEEE half conversions, round to nearest even
+	static uint16_t FloatToHalf(float value);
+	static float HalfToFloat(uint16_t value);
+};
@@ -47,7 +47,6 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance,
                      _In_ int       nCmdShow)
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
 
     // TODO: Place code here.
 
@@ -62,8 +61,20 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance,
         return FALSE;
     }
 
+    // "-lights small" or "-lights field" adds a light field to the scene
+    BuiltinScene::LightSetup lightSetup = BuiltinScene::LIGHTS_RED;
+    for (int i = 0; i < BuiltinScene::LIGHT_SETUP_COUNT; i++)
+    {
+        WCHAR option[MAX_LOADSTRING];
+        swprintf_s(option, L"-lights %S", BuiltinScene::GetLightSetupName((BuiltinScene::LightSetup)i));
+        if (wcsstr(lpCmdLine, option) != NULL)
+        {
+            lightSetup = (BuiltinScene::LightSetup)i;
+        }
+    }
+
     g_pRenderer = new Renderer();
-    if (!g_pRenderer->Init(g_hWnd))
+    if (!g_pRenderer->Init(g_hWnd, lightSetup))
     {
        return FALSE;
     }